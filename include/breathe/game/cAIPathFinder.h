@@ -1,6 +1,11 @@
 #ifndef CAIPATHFINDER_H
 #define CAIPATHFINDER_H
 
+// Standard headers
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 // Spitfire headers
 
 #include <spitfire/spitfire.h>
@@ -8,16 +13,36 @@
 #include <spitfire/math/math.h>
 #include <spitfire/math/cVec3.h>
 #include <spitfire/math/cQuaternion.h>
+#include <spitfire/math/cKDTree.h>
 
 // TODO: Hmmmm, maybe polygons would be better than nodes and edges.  Similar algorithm, but there are no edges, only nodes and each node has a 3d volume (Height also for calculating when to crouch etc.).
 // Multiple sized/turning/crouching units can all use the same path graph, taking care to avoid areas that they would get stuck in.
 // http://www.ai-blog.net/archives/000152.html
+//
+// Usage:
+// breathe::ai::cGraph graph;
+// graph.AddNode(position, 1.0f);
+// ...
+// graph.AddEdge(nodeFrom, nodeTo, 1.0f);
+// ...
+// graph.Optimise();
+//
+// // One per thread, the buffers are reused between queries
+// breathe::ai::cAStar astar;
+// std::vector<size_t> path;
+// if (astar.GetLowestCostPath(graph, nodeStart, nodeEnd, path)) {
+//   const float fCost = astar.GetPathCost();
+//   ...
+// }
 
 namespace breathe
 {
   namespace ai
   {
     class cEdge;
+    class cAStar;
+    class cBidirectionalAStar;
+    class cFlowField;
 
     class cNode
     {
@@ -53,9 +78,15 @@ namespace breathe
 
 
     // NOTE: All nodes must be added first, then edges
+    // Optimise freezes the graph into a compressed sparse row layout for the searches, adding anything after that requires calling Optimise again
     class cGraph
     {
     public:
+      friend class cAStar;
+      friend class cBidirectionalAStar;
+      friend class cFlowField;
+
+      cGraph();
       ~cGraph();
 
       size_t AddNode(const spitfire::math::cVec3& position, float fCost);
@@ -63,7 +94,11 @@ namespace breathe
       // NOTE: The total cost is fCostMultiplier * length(start to end)
       void AddEdge(size_t nodeFrom, size_t nodeTo, float fCostMultiplier);
 
-      void Optimise(); // Sorts the edges within each node, may do more work later on such as calculating distances and costs
+      void Optimise(); // Sorts the edges within each node and builds the compressed sparse row layout
+      bool IsOptimised() const { return bIsOptimised; }
+
+      // Changes every time a node or edge is added or the graph is optimised, anything cached from an older revision is out of date
+      uint32_t GetRevision() const { return revision; }
 
       size_t GetNumberOfNodes() const { return nodes.size(); }
       size_t GetNumberOfEdges() const { return edges.size(); }
@@ -71,15 +106,132 @@ namespace breathe
       const cNode& GetNode(size_t i) const { ASSERT(i < nodes.size()); return *(nodes[i]); }
       const cEdge& GetEdge(size_t i) const { ASSERT(i < edges.size()); return *(edges[i]); }
 
-      const cNode* GetClosestNode(const spitfire::math::cVec3& position) const;
+      const cNode* GetClosestNode(const spitfire::math::cVec3& position) const; // Uses a k-d tree once the graph is optimised
 
     private:
       void Sort(); // Sort the edges in cNode::vEdges
+      void BuildCompressedSparseRows();
+
+      // The lowest cost we can expect to travel between these two nodes, this never overestimates so A* is still optimal
+      float GetHeuristicCost(uint32_t nodeFrom, uint32_t nodeTo) const { return fMinimumCostMultiplier * (positions[nodeFrom] - positions[nodeTo]).GetLength(); }
 
       // If we want to allow dynamic nodes and edges then we have to make these pointer so that the whole buffer doesn't
       // get reallocated when adding nodes or edges, invalidating all the previous pointers to these entries
       std::vector<cNode*> nodes;
       std::vector<cEdge*> edges;
+
+      // Compressed sparse rows, the edges leaving node i are [outgoingOffsets[i], outgoingOffsets[i + 1]) cheapest first
+      // The incoming edges are stored the same way for searching backwards from the end node
+      bool bIsOptimised;
+      uint32_t revision;
+      float fMinimumCostMultiplier;
+      std::vector<spitfire::math::cVec3> positions;
+      std::vector<float> nodeCosts;
+      std::vector<uint32_t> outgoingOffsets;
+      std::vector<uint32_t> outgoingNodes;
+      std::vector<float> outgoingCosts;
+      std::vector<uint32_t> incomingOffsets;
+      std::vector<uint32_t> incomingNodes;
+      std::vector<float> incomingCosts;
+
+      spitfire::math::cKDTree nodeTree; // The node positions for finding the closest node
+    };
+
+
+    // The per node state for one direction of a search
+    // Nodes are only reset when a query first touches them, so a context can be reused for any number of queries without clearing it
+    class cPathSearchContext
+    {
+    public:
+      friend class cAStar;
+      friend class cBidirectionalAStar;
+
+      cPathSearchContext();
+
+      size_t GetNumberOfNodesExpanded() const { return nNodesExpanded; }
+
+    private:
+      struct cNodeState
+      {
+        float fDistance; // From the node this search started at
+        uint32_t parent;
+        uint32_t generation; // The query that this state belongs to
+        bool bIsClosed;
+      };
+
+      void Reset(size_t nNodes);
+      cNodeState& GetState(uint32_t node);
+      bool IsReached(uint32_t node) const { return (states[node].generation == generation); }
+      bool IsClosed(uint32_t node) const { return IsReached(node) && states[node].bIsClosed; }
+      float GetDistance(uint32_t node) const { return IsReached(node) ? states[node].fDistance : spitfire::math::cINFINITY; }
+
+      void Push(float fKey, uint32_t node);
+      std::pair<float, uint32_t> Pop();
+      float GetTopKey() const { return open.empty() ? spitfire::math::cINFINITY : open.front().first; }
+
+      uint32_t generation;
+      std::vector<cNodeState> states;
+      std::vector<std::pair<float, uint32_t>> open; // Binary min heap of key and node, nodes may be in here more than once, the stale entries are skipped when they are popped
+      size_t nNodesExpanded;
+    };
+
+    inline cPathSearchContext::cNodeState& cPathSearchContext::GetState(uint32_t node)
+    {
+      cNodeState& state = states[node];
+      if (state.generation != generation) {
+        state.fDistance = spitfire::math::cINFINITY;
+        state.parent = node;
+        state.generation = generation;
+        state.bIsClosed = false;
+      }
+
+      return state;
+    }
+
+
+    // A* with a binary heap
+    // http://en.wikipedia.org/wiki/A*_search_algorithm
+    //
+    // The heuristic is the straight line distance to the end node multiplied by the cheapest cost multiplier of any edge in the graph.
+    // Unlike cDijkstra this always finds the lowest cost path.  Not thread safe, use one per thread.
+    class cAStar
+    {
+    public:
+      cAStar();
+
+      // Returns false if there is no path, the path includes the start and end nodes
+      bool GetLowestCostPath(const cGraph& graph, const spitfire::math::cVec3& start, const spitfire::math::cVec3& end, std::vector<size_t>& path);
+      bool GetLowestCostPath(const cGraph& graph, size_t nodeStart, size_t nodeEnd, std::vector<size_t>& path);
+
+      float GetPathCost() const { return fPathCost; } // The cost of the last path found
+      size_t GetNumberOfNodesExpanded() const { return context.GetNumberOfNodesExpanded(); }
+
+    private:
+      cPathSearchContext context;
+      float fPathCost;
+    };
+
+
+    // A* searching forwards from the start and backwards from the end at the same time
+    //
+    // Both searches use the average of the two heuristics as their potential so that they agree on the reduced edge costs and
+    // the search can stop as soon as the two open lists can't produce anything cheaper than the best path found so far.
+    // Usually expands fewer nodes than cAStar when the start and end are far apart.  Not thread safe, use one per thread.
+    class cBidirectionalAStar
+    {
+    public:
+      cBidirectionalAStar();
+
+      // Returns false if there is no path, the path includes the start and end nodes
+      bool GetLowestCostPath(const cGraph& graph, size_t nodeStart, size_t nodeEnd, std::vector<size_t>& path);
+
+      float GetPathCost() const { return fPathCost; } // The cost of the last path found
+      size_t GetNumberOfNodesExpanded() const { return forward.GetNumberOfNodesExpanded() + backward.GetNumberOfNodesExpanded(); }
+
+    private:
+      cPathSearchContext forward;
+      cPathSearchContext backward;
+      float fPathCost;
     };
 
 
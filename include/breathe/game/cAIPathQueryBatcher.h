@@ -0,0 +1,204 @@
+#ifndef CAIPATHQUERYBATCHER_H
+#define CAIPATHQUERYBATCHER_H
+
+// Standard headers
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/game/cAIPathFinder.h>
+
+// Answers lots of path queries at once for agents that mostly head to the same few destinations
+//
+// Queries are grouped by zone, personality and destination.  Each group shares one cFlowField, a Dijkstra search that runs
+// backwards from the destination and records the next node towards it for every node it settles, so every agent in the group
+// just follows the field from its start node.  The search only runs as far as it needs to for the starts it has been asked
+// about and carries on from where it stopped the next time.  Flow fields are cached between batches and rebuilt when their
+// graph changes, independent groups are searched on worker threads.
+//
+// Usage:
+// breathe::ai::cPathQueryBatcher batcher;
+// batcher.AddZone(0, graph);
+// batcher.SetPersonality(0, breathe::ai::cPathPersonality());
+//
+// batcher.Clear();
+// const size_t query = batcher.AddQuery(breathe::ai::cPathQuery(0, 0, nodeStart, nodeEnd));
+// ...
+// batcher.Run(spitfire::util::GetDefaultThreadPool());
+// if (batcher.GetResult(query).bIsFound) {
+//   const std::vector<size_t>& path = batcher.GetPath(query);
+//   ...
+// }
+
+namespace breathe
+{
+  namespace ai
+  {
+    // ** cPathPersonality
+
+    // How much an agent cares about the cost of the nodes it travels through, for example a vehicle might avoid rough terrain
+    // The cost of entering a node is fNodeCostWeighting * cNode::fCost on top of the edge cost
+    class cPathPersonality
+    {
+    public:
+      cPathPersonality() : fNodeCostWeighting(0.0f) {}
+
+      float fNodeCostWeighting;
+    };
+
+
+    // ** cFlowField
+
+    // The lowest cost from every node to one destination, built lazily with a Dijkstra search over the incoming edges
+    // Not thread safe, although different flow fields can be expanded at the same time
+    class cFlowField
+    {
+    public:
+      static const uint32_t INVALID_NODE = 0xFFFFFFFF;
+
+      cFlowField(const cGraph& graph, size_t destination, const cPathPersonality& personality);
+
+      cFlowField(const cFlowField&) = delete;
+      cFlowField& operator=(const cFlowField&) = delete;
+
+      bool IsUpToDate() const { return (revision == graph.GetRevision()); }
+
+      // Continues the search until node is settled, returns false if node can't reach the destination
+      bool ExpandUntil(size_t node);
+
+      bool IsSettled(size_t node) const { return (settled[node] != 0); }
+      float GetCost(size_t node) const { return costs[node]; }
+      uint32_t GetNext(size_t node) const { return next[node]; } // The next node towards the destination, INVALID_NODE for the destination itself
+
+      // The path includes node and the destination, node must already be settled
+      void GetPath(size_t node, std::vector<size_t>& path) const;
+
+      size_t GetNumberOfNodesSettled() const { return nNodesSettled; }
+
+    private:
+      const cGraph& graph;
+      uint32_t destination;
+      float fNodeCostWeighting;
+      uint32_t revision;
+
+      std::vector<float> costs;
+      std::vector<uint32_t> next;
+      std::vector<uint8_t> settled;
+      std::vector<std::pair<float, uint32_t>> open; // Binary min heap of cost and node, stale entries are skipped when they are popped
+      size_t nNodesSettled;
+    };
+
+
+    // ** cPathQuery
+
+    class cPathQuery
+    {
+    public:
+      cPathQuery() : zone(0), personality(0), nodeStart(0), nodeEnd(0) {}
+      cPathQuery(uint32_t _zone, uint32_t _personality, size_t _nodeStart, size_t _nodeEnd) : zone(_zone), personality(_personality), nodeStart(_nodeStart), nodeEnd(_nodeEnd) {}
+
+      uint32_t zone;
+      uint32_t personality;
+      size_t nodeStart;
+      size_t nodeEnd;
+    };
+
+    class cPathQueryResult
+    {
+    public:
+      cPathQueryResult() : bIsFound(false), fCost(0.0f) {}
+
+      bool bIsFound;
+      float fCost;
+    };
+
+
+    // ** cPathQueryBatcher
+
+    class cPathQueryBatcher
+    {
+    public:
+      cPathQueryBatcher();
+
+      cPathQueryBatcher(const cPathQueryBatcher&) = delete;
+      cPathQueryBatcher& operator=(const cPathQueryBatcher&) = delete;
+
+      // Each zone is a separate navigation graph, the graph must outlive the batcher and be optimised before each Run
+      void AddZone(uint32_t zone, const cGraph& graph);
+      void SetPersonality(uint32_t personality, const cPathPersonality& settings);
+
+      // Flow fields are rebuilt automatically when their graph changes, this also throws them away when something else about the zone has changed
+      void InvalidateZone(uint32_t zone);
+
+      // The least recently used flow fields are thrown away once there are more than this
+      void SetMaximumCachedFlowFields(size_t _nMaximumCachedFlowFields) { nMaximumCachedFlowFields = _nMaximumCachedFlowFields; }
+      size_t GetNumberOfCachedFlowFields() const { return cache.size(); }
+
+      void Clear(); // Removes the queries, the cache is kept
+      size_t AddQuery(const cPathQuery& query);
+
+      void Run();
+      void Run(spitfire::util::cThreadPool& threadPool);
+
+      const cPathQueryResult& GetResult(size_t query) const { ASSERT(query < results.size()); return results[query]; }
+      const std::vector<size_t>& GetPath(size_t query) const { ASSERT(query < results.size()); return paths[query]; } // Includes the start and end nodes
+
+      // How many groups in the last Run found a flow field in the cache and how many had to start a new one
+      size_t GetCacheHits() const { return nCacheHits; }
+      size_t GetCacheMisses() const { return nCacheMisses; }
+
+    private:
+      struct cKey
+      {
+        bool operator<(const cKey& rhs) const;
+        bool operator==(const cKey& rhs) const { return (zone == rhs.zone) && (personality == rhs.personality) && (destination == rhs.destination); }
+
+        uint32_t zone;
+        uint32_t personality;
+        size_t destination;
+      };
+
+      struct cCacheEntry
+      {
+        std::unique_ptr<cFlowField> pFlowField;
+        uint64_t lastUsed;
+      };
+
+      struct cGroup
+      {
+        cFlowField* pFlowField;
+        size_t first; // Into order
+        size_t last;
+      };
+
+      void Prepare();
+      void RunGroups(size_t firstGroup, size_t lastGroup);
+      void Evict();
+
+      size_t nMaximumCachedFlowFields;
+      uint64_t batch; // Incremented by each Run for the least recently used eviction
+
+      std::map<uint32_t, const cGraph*> zones;
+      std::map<uint32_t, cPathPersonality> personalities;
+      std::map<cKey, cCacheEntry> cache;
+
+      std::vector<cPathQuery> queries;
+      std::vector<std::pair<cKey, size_t>> order; // Queries sorted by key
+      std::vector<cGroup> groups;
+      std::vector<cPathQueryResult> results;
+      std::vector<std::vector<size_t>> paths; // Kept between batches so that the paths don't have to be allocated again
+
+      size_t nCacheHits;
+      size_t nCacheMisses;
+    };
+  }
+}
+
+#endif // CAIPATHQUERYBATCHER_H
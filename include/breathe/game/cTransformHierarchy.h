@@ -0,0 +1,121 @@
+#ifndef CTRANSFORMHIERARCHY_H
+#define CTRANSFORMHIERARCHY_H
+
+// Standard headers
+#include <cstdint>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/math/cMat4.h>
+#include <spitfire/math/cQuaternion.h>
+#include <spitfire/math/cVec3.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/breathe.h>
+
+// The relative and absolute transforms of the scenegraph nodes, kept in arrays in depth first order instead of in each node
+//
+// Changing a relative transform only marks it as dirty, Update then recomputes the absolute matrices of the dirty transforms
+// and their descendants and leaves everything else alone.  Because a subtree is a contiguous range in depth first order the
+// hierarchy is split into independent subtrees that can be updated on different threads, only the few transforms above those
+// subtrees (The spine) are updated first on the calling thread.  Subtrees that contain nothing dirty are skipped entirely.
+//
+// Usage:
+// breathe::scenegraph3d::cTransformHierarchy transforms;
+// const size_t root = transforms.Create(breathe::scenegraph3d::cTransformHierarchy::NULL_TRANSFORM);
+// const size_t child = transforms.Create(root);
+// transforms.SetRelativePosition(child, spitfire::math::cVec3(1.0f, 0.0f, 0.0f));
+// transforms.Update(spitfire::util::GetDefaultThreadPool());
+// const spitfire::math::cMat4& matAbsolute = transforms.GetAbsoluteMatrix(child);
+
+namespace breathe
+{
+  namespace scenegraph3d
+  {
+    class cTransformHierarchy
+    {
+    public:
+      static const size_t NULL_TRANSFORM = size_t(-1);
+
+      cTransformHierarchy();
+
+      cTransformHierarchy(const cTransformHierarchy&) = delete;
+      cTransformHierarchy& operator=(const cTransformHierarchy&) = delete;
+
+      void Clear();
+
+      // The largest number of transforms in a subtree that is updated as one task
+      void SetGrainSize(size_t _nGrainSize) { ASSERT(_nGrainSize != 0); nGrainSize = _nGrainSize; bIsOrderDirty = true; }
+
+      size_t Create(size_t parent);
+      void Destroy(size_t transform); // The transform must not have any children
+      void SetParent(size_t transform, size_t parent);
+
+      size_t GetParent(size_t transform) const;
+      size_t GetCount() const { return nTransforms; }
+
+      const spitfire::math::cVec3& GetRelativePosition(size_t transform) const;
+      const spitfire::math::cQuaternion& GetRelativeRotation(size_t transform) const;
+      void SetRelativePosition(size_t transform, const spitfire::math::cVec3& position);
+      void SetRelativeRotation(size_t transform, const spitfire::math::cQuaternion& rotation);
+
+      // Only valid after Update
+      const spitfire::math::cMat4& GetAbsoluteMatrix(size_t transform) const;
+
+      // True if the relative transform of this transform or one of its ancestors has changed since the last Update
+      bool IsAbsoluteMatrixDirty(size_t transform) const;
+
+      void Update();
+      void Update(spitfire::util::cThreadPool& pool);
+
+      // The number of absolute matrices that the last Update recomputed
+      size_t GetUpdatedCount() const { return nUpdated; }
+
+    private:
+      // A contiguous range of the depth first order containing one or more whole subtrees
+      struct cTask
+      {
+        size_t first;
+        size_t last;
+      };
+
+      size_t GetIndex(size_t transform) const;
+      void MarkDirty(size_t index);
+
+      void RebuildOrder();
+
+      void _Update(spitfire::util::cThreadPool* pPool);
+      size_t UpdateRange(size_t first, size_t last);
+
+      size_t nGrainSize;
+      size_t nTransforms;
+      size_t nUpdated;
+      bool bIsOrderDirty;
+
+      // Indexed by transform, the structure of the hierarchy between calls to RebuildOrder
+      std::vector<size_t> parentTransforms; // NULL_TRANSFORM for the roots
+      std::vector<size_t> childCounts;
+      std::vector<uint8_t> isUsed;
+      std::vector<size_t> freeTransforms;
+      std::vector<size_t> transformToIndex;
+
+      // Indexed in depth first order
+      std::vector<size_t> indexToTransform;
+      std::vector<size_t> parents; // Index of the parent or NULL_TRANSFORM
+      std::vector<spitfire::math::cVec3> relativePositions;
+      std::vector<spitfire::math::cQuaternion> relativeRotations;
+      std::vector<spitfire::math::cMat4> absoluteMatrices;
+      std::vector<uint8_t> isDirty; // Our relative transform has changed
+      std::vector<uint8_t> isChanged; // Our absolute matrix was recomputed in this Update
+      std::vector<size_t> taskForIndex; // The task that this index belongs to or NULL_TRANSFORM for the spine
+
+      std::vector<size_t> spine; // Indices that are above the tasks, in depth first order
+      std::vector<cTask> tasks;
+      std::vector<uint8_t> isTaskDirty;
+      std::vector<size_t> dirtyTasks;
+    };
+  }
+}
+
+#endif // CTRANSFORMHIERARCHY_H
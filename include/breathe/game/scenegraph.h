@@ -7,6 +7,7 @@
 #include <spitfire/math/cVec3.h>
 #include <spitfire/math/cMat4.h>
 #include <spitfire/math/cQuaternion.h>
+#include <spitfire/math/cDynamicAABBTree.h>
 
 #include <breathe/render/cContext.h>
 #include <breathe/render/camera.h>
@@ -14,7 +15,12 @@
 #include <breathe/render/cTextureAtlas.h>
 #include <breathe/render/cMaterial.h>
 #include <breathe/render/cResourceManager.h>
+#include <breathe/render/cInstanceBatcher.h>
+#include <breathe/render/cRenderQueue.h>
 #include <breathe/render/model/cHeightmap.h>
+#include <breathe/render/model/cStaticLOD.h>
+
+#include <breathe/game/cTransformHierarchy.h>
 
 // TODO: We have to remove this, there has to be a better way of doing this?
 #include <breathe/render/model/cMd3.h>
@@ -185,7 +191,7 @@ namespace breathe
 
       bool IsValidAndTurnedOn() const { return (bHasValidValue && bTurnedOn); }
 
-      void Clear() { bHasValidValue = false; bTurnedOn = false; pShader.reset(); }
+      void Clear() { bHasValidValue = false; bTurnedOn = false; pShader.reset(); pInstancingShader.reset(); }
 
       bool operator==(const cStateShader& rhs) const;
       bool operator!=(const cStateShader& rhs) const { return !(*this == rhs); }
@@ -193,11 +199,12 @@ namespace breathe
       bool bHasValidValue;
       bool bTurnedOn;
       render::cShaderRef pShader;
+      render::cShaderRef pInstancingShader; // Optional variant of pShader that reads the model matrix from matInstances[gl_InstanceID]
     };
 
     inline bool cStateShader::operator==(const cStateShader& rhs) const
     {
-      return (bHasValidValue == rhs.bHasValidValue) && (bTurnedOn == rhs.bTurnedOn) && (pShader == rhs.pShader);
+      return (bHasValidValue == rhs.bHasValidValue) && (bTurnedOn == rhs.bTurnedOn) && (pShader == rhs.pShader) && (pInstancingShader == rhs.pInstancingShader);
     }
 
 
@@ -381,6 +388,9 @@ namespace breathe
       void SetGeometryTypeTriangles() { geometryType = scenegraph_common::GEOMETRY_TYPE::TRIANGLES; }
       void SetGeometryTypeQuads() { geometryType = scenegraph_common::GEOMETRY_TYPE::QUADS; }
 
+      // Repeated triangle meshes with this state are drawn as instanced batches with this shader instead
+      void SetInstancingShader(render::cShaderRef pInstancingShader) { shader.pInstancingShader = pInstancingShader; }
+
     private:
       void Assign(const cStateSet& rhs);
       void Clear();
@@ -452,6 +462,7 @@ namespace breathe
     public:
       friend class cUpdateVisitor;
       friend class cCullVisitor;
+      friend class cSceneGraph;
 
       // Child nodes
       typedef std::list<cSceneNodeRef>::iterator child_iterator;
@@ -511,6 +522,14 @@ namespace breathe
       const math::cSphere& GetBoundingSphere() const { return boundingSphere; }
       const math::cBox& GetBoundingBox() const { return boundingBox; }
 
+      // The bounds of our geometry before it is transformed, a point at the origin until it is set
+      bool HasLocalBoundingBox() const { return bHasLocalBoundingBox; }
+      void SetLocalBoundingBox(const math::cAABB3& box) { bHasLocalBoundingBox = true; localBoundingBox = box; }
+      const math::cAABB3& GetLocalBoundingBox() const { return localBoundingBox; }
+
+      // Our local bounding box transformed by our absolute matrix, this is what the culling tree of the scenegraph uses
+      math::cAABB3 GetCullingBox() const;
+
       // We call this from cSceneGraph::Update
       void UpdateBoundingVolumeAndSetBoundingVolumeNotDirty();
 
@@ -567,15 +586,26 @@ namespace breathe
 
       math::cSphere boundingSphere;
       math::cBox boundingBox;
+      bool bHasLocalBoundingBox;
+      math::cAABB3 localBoundingBox;
 
       cSceneNodeRef pParent; // Each node has exactly one parent, no more no less.  pRoot is the only exception, pRoot->pParent == nullptr;
 
+      size_t cullingProxy; // Our proxy in the culling tree of the scenegraph or NULL_PROXY if we are only culled by walking the hierarchy
+
+      // Our absolute matrix is calculated by the transform hierarchy of the scenegraph once we are attached to it
+      cTransformHierarchy* pTransforms;
+      size_t transform;
+
     private:
       cSceneNode(const cSceneNode&); // Prevent copying
       cSceneNode& operator=(const cSceneNode&); // Prevent copying
 
       void GenerateBoundingVolume();
 
+      void AddToTransformHierarchy(cTransformHierarchy& transforms, size_t parent);
+      void RemoveFromTransformHierarchy();
+
       // NOTE: If you override any of these methods you should override all of them
       virtual void _AttachChild(cSceneNodeRef pChild);
       virtual void _DetachChild(cSceneNodeRef pChild);
@@ -693,6 +723,10 @@ namespace breathe
 
       void SetLOD(size_t LOD);
 
+      // One distance per child, increasing, child i is used from distances[i] from the camera until distances[i + 1]
+      // See breathe::render::model::GenerateStaticModelLODs
+      void SetSwitchDistances(const std::vector<float>& _distances) { distances = _distances; }
+
       size_t GetNumberOfChildren() const { return node.size(); }
 
     private:
@@ -704,6 +738,7 @@ namespace breathe
 
       size_t index;
       std::vector<cSceneNodeRef> node;
+      std::vector<float> distances;
     };
 
     inline void cLODNode::SetLOD(size_t LOD)
@@ -717,6 +752,10 @@ namespace breathe
 
     typedef std::shared_ptr<cLODNode> cLODNodeRef;
 
+    // Creates a cLODNode with a cGroupNode of cModelNodes for each level and the switch distances from GenerateStaticModelLODs
+    // Returns an empty reference if any of the meshes could not be converted
+    cLODNodeRef CreateLODNode(const render::model::cStaticModelLOD& lods);
+
 
     class cPagedLODNodeChild : public cSceneNode
     {
@@ -840,6 +879,8 @@ namespace breathe
       friend class cCullVisitor;
       friend class cRenderVisitor;
 
+      cRenderGraph();
+
       // TODO: We have to remove this, there has to be a better way of doing this?
       void AddMD3Model(character::cMd3* pModel, const spitfire::math::cMat4& matAbsolutePositionAndRotation);
 
@@ -859,8 +900,16 @@ namespace breathe
       // Transparent (distance from the camera : renderable at that position)
       // TODO: Should this be multimap?
       std::map<float, cRenderGraphTransparentPair> mTransparent;
+
+      // The far clip distance of the camera that this render graph was culled with, used to normalise the depth of each draw
+      float fFarClipDistance;
     };
 
+    inline cRenderGraph::cRenderGraph() :
+      fFarClipDistance(1000.0f)
+    {
+    }
+
     inline void cRenderGraph::Clear()
     {
       mOpaque.clear();
@@ -918,21 +967,29 @@ namespace breathe
 
       const spitfire::math::cVec3& GetCameraPosition() const { return camera.GetEyePosition(); }
 
+      // Nodes in the culling tree are only visible if the tree found them inside the frustum, every other node is always visible
+      bool IsVisible(const cSceneNode& node) const;
+
     private:
       cSceneGraph& scenegraph;
       const render::cCamera& camera;
+
+      bool bIsCullingEnabled;
+      std::vector<void*> visibleNodes; // Sorted so that we can binary search it
     };
 
 
+    class cSceneGraphRenderQueueContext;
+
     // Render visitor does not visit cSceneGraph nodes, it visits the cRenderGraph nodes that have been collected
+    // The renderables are drawn through a render::cRenderQueue so that only the state that changes between them is applied
     class cRenderVisitor
     {
     public:
       cRenderVisitor(cSceneGraph& scenegraph, render::cContext& context, const math::cFrustum& frustum);
 
     private:
-      void ApplyStateSet(cStateSet& stateSet);
-      void UnApplyStateSet(cStateSet& stateSet);
+      render::cRenderState GetRenderState(cSceneGraphRenderQueueContext& queueContext, const cStateSet& stateSet) const;
     };
 
 
@@ -941,7 +998,9 @@ namespace breathe
     // NOTE: One restriction on the scenegraph at the moment is that every camera must use the same skysystem.
     // It is impossible to have a video camera on another planet in the galaxy with one sky and then also view a planet with another sky,
     // but in most situations this is not incredibly limiting and if this behaviour is required, one solutions may be to build two separate scenegraphs.
-    // TODO: Other versions of cSceneGraph such cSceneGraphOctree and cSceneGraphBSP could be created
+    // Nodes with a local bounding box such as cModelNode, cAnimationNode and cLODNode can be added to a dynamic AABB tree with AddCullingNode,
+    // the tree is refitted in Update from their culling boxes, the local bounding box transformed by the absolute matrix, and each Cull tests
+    // the tree against the camera frustum instead of testing every node.
 
     class cSceneGraph
     {
@@ -972,6 +1031,9 @@ namespace breathe
       void Cull(durationms_t currentTime, const render::cCamera& camera);
       void Render(durationms_t currentTime, render::cContext& context, const math::cFrustum& frustum);
 
+      // How many draws and state changes the last Render did
+      const render::cRenderQueueStatistics& GetRenderQueueStatistics() const { return renderQueue.GetStatistics(); }
+
 
       // Cameras
 
@@ -992,6 +1054,10 @@ namespace breathe
 
       size_t GetNodeCount() const { return nNodes; }
 
+      // Culling tree
+      bool AddCullingNode(cSceneNodeRef pNode); // Returns false if the node has no local bounding box
+      void RemoveCullingNode(cSceneNodeRef pNode);
+
 
       // Objects
 
@@ -1018,9 +1084,15 @@ namespace breathe
       math::cColour ambientColour;
 
       cRenderGraph renderGraph;
+      render::cRenderQueue renderQueue; // Kept between frames so that its buffers are reused
+      render::cInstanceBatcher instanceBatcher;
+      cTransformHierarchy transforms; // Must be destroyed after the nodes
       cSceneNodeRef pRoot;
       cSkySystemRef pSkySystem;
 
+      math::cDynamicAABBTree cullingTree;
+      std::vector<cSceneNodeRef> cullingNodes;
+
       size_t nNodes; // Count of the nodes that the scenegraph has created itself
       //std::map<uint32_t, cSceneNodeRef> nodes; // Unique hash to node map
 
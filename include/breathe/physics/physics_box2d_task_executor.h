@@ -0,0 +1,37 @@
+#ifndef PHYSICS_BOX2D_TASK_EXECUTOR_H
+#define PHYSICS_BOX2D_TASK_EXECUTOR_H
+
+// Box2D headers
+#include <Box2D/Dynamics/b2WorldCallbacks.h>
+
+// Spitfire headers
+#include <spitfire/util/threadpool.h>
+
+// Lets a b2World solve its islands on a thread pool, the calling thread takes part too.
+// The results are exactly the same as solving on one thread and the contact listener is still only called from the thread that calls b2World::Step.
+//
+// Usage:
+// breathe::box2d::cTaskExecutor executor(spitfire::util::GetDefaultThreadPool());
+// world.SetTaskExecutor(&executor);
+// world.Step(fTimeStep, nVelocityIterations, nPositionIterations);
+
+namespace breathe
+{
+  namespace box2d
+  {
+    class cTaskExecutor : public b2TaskExecutor
+    {
+    public:
+      explicit cTaskExecutor(spitfire::util::cThreadPool& threadPool);
+
+      int32 GetThreadCount() const override;
+
+      void Run(b2Task* pTask) override;
+
+    private:
+      spitfire::util::cThreadPool& threadPool;
+    };
+  }
+}
+
+#endif // PHYSICS_BOX2D_TASK_EXECUTOR_H
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstdint>
 #include <list>
 #include <vector>
 
 #include <spitfire/math/geometry.h>
 #include <spitfire/math/cVec3.h>
 
+#include <spitfire/util/threadpool.h>
+
 namespace breathe {
 
 namespace physics {
@@ -45,16 +48,9 @@ private:
 };
 
 
-struct Particle {
-  Particle(const spitfire::math::cVec3& _pos) : lastPos(_pos), pos(_pos) {}
-
-  spitfire::math::cVec3 lastPos;
-  spitfire::math::cVec3 pos;
-};
-
 // A distance constraint, as the points get closer together or further apart the points are pushed/pulled to maintain a set distance
 struct Spring {
-  Spring(Particle* _a, Particle* _b, float _fDistance, float _fStiffness) :
+  Spring(uint32_t _a, uint32_t _b, float _fDistance, float _fStiffness) :
     a(_a),
     b(_b),
     fDistance(_fDistance),
@@ -62,15 +58,15 @@ struct Spring {
   {
   }
 
-  Particle* a;
-  Particle* b;
+  uint32_t a;
+  uint32_t b;
   float fDistance;
   float fStiffness;
 };
 
 // Like a weak spring constraint, only constraining the maximum length, but doesn't care if the particles move closer together
 struct Rope {
-  Rope(Particle* _a, Particle* _b, float _fMaxDistance, float _fStiffness) :
+  Rope(uint32_t _a, uint32_t _b, float _fMaxDistance, float _fStiffness) :
     a(_a),
     b(_b),
     fMaxDistance(_fMaxDistance),
@@ -78,21 +74,79 @@ struct Rope {
   {
   }
 
-  Particle* a;
-  Particle* b;
+  uint32_t a;
+  uint32_t b;
   float fMaxDistance;
   float fStiffness;
 };
 
+// Constraints that don't share any particles, so every constraint in a batch can be relaxed at the same time
+struct cConstraintBatch {
+  size_t GetSize() const { return a.size(); }
+
+  void Add(uint32_t _a, uint32_t _b, float fDistance, float fStiffness);
 
+  std::vector<uint32_t> a;
+  std::vector<uint32_t> b;
+  std::vector<float> fDistanceSquared;
+  std::vector<float> fStiffness;
+};
+
+struct cSettings {
+  cSettings();
+
+  float fTimeStepSeconds; // The length of time that one Update covers
+  size_t nSubSteps; // Each Update is split into this many smaller steps, more sub steps make stiffer cloth than more relaxation steps do
+  size_t nRelaxationSteps; // Constraint relaxation iterations per sub step
+  size_t nMaximumStepsPerUpdate; // UpdateFixedTimeStep never runs more than this many steps, the rest of the time is dropped
+  float fFriction;
+};
+
+// The particles are stored as a structure of arrays and the constraints refer to them by index
+// The springs and ropes are sorted into batches of independent constraints the next time the group is updated after they change
 struct cGroup {
-  std::vector<Particle> particles;
-  std::vector<Particle*> pins; // A pin is a fixed point constraint
+  cGroup();
+
+  size_t GetNumberOfParticles() const { return x.size(); }
+
+  size_t AddParticle(const spitfire::math::cVec3& position);
+  void AddPin(size_t particle); // A pin is a fixed point constraint, the particle stays where it is
+  void AddSpring(size_t a, size_t b, float fDistance, float fStiffness);
+  void AddRope(size_t a, size_t b, float fMaxDistance, float fStiffness);
+
+  spitfire::math::cVec3 GetPosition(size_t particle) const { return spitfire::math::cVec3(x[particle], y[particle], z[particle]); }
+  void SetPosition(size_t particle, const spitfire::math::cVec3& position); // Moves the particle without giving it any velocity
+
+  void BuildConstraintBatches();
+
+  cSettings settings;
+
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> lastX;
+  std::vector<float> lastY;
+  std::vector<float> lastZ;
+
+  std::vector<uint32_t> pins;
   std::vector<Spring> springs;
   std::vector<Rope> ropes;
+
+  bool bIsConstraintBatchesDirty;
+  std::vector<cConstraintBatch> springBatches;
+  std::vector<cConstraintBatch> ropeBatches;
+
+  float fAccumulatedSeconds; // Time left over from the last UpdateFixedTimeStep
 };
 
+// Runs one step of settings.fTimeStepSeconds, the thread pool version relaxes large constraint batches on several threads and gives exactly the same result
 void Update(const cWorld& world, cGroup& group);
+void Update(const cWorld& world, cGroup& group, spitfire::util::cThreadPool& threadPool);
+
+// Runs as many steps as fit in fElapsedSeconds, the remainder is carried over to the next call, returns the number of steps run
+size_t UpdateFixedTimeStep(const cWorld& world, cGroup& group, float fElapsedSeconds);
+size_t UpdateFixedTimeStep(const cWorld& world, cGroup& group, float fElapsedSeconds, spitfire::util::cThreadPool& threadPool);
+
 void Collide(cGroup& group, const spitfire::math::cCapsule& capsule);
 void CollideGroundPlane(cGroup& group, float fGroundHeight);
 
@@ -0,0 +1,114 @@
+#ifndef CINSTANCEBATCHER_H
+#define CINSTANCEBATCHER_H
+
+// Standard headers
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cMat4.h>
+
+// Breathe headers
+#include <breathe/render/cRenderQueue.h>
+
+// Finds draws that use the same vertex buffer object and material and merges them into instanced draws
+//
+// Build groups the draws by state, splits each group into batches of at most the number of instances that the shader can take
+// and packs the absolute matrices of each batch next to each other in one instance buffer.  Groups that are too small to be
+// worth instancing are returned as single draws.  Nothing here touches OpenGL, the batches can then be added to a cRenderQueue.
+//
+// Usage:
+// breathe::render::cInstanceBatcher batcher;
+// batcher.Clear();
+// batcher.Add(state, geometry, matAbsolutePositionAndRotation, item);
+// ...
+// batcher.Build();
+// for (const breathe::render::cInstanceBatch& batch : batcher.GetBatches()) {
+//   const float* pMatrices = batcher.GetInstanceMatrices(batch);
+//   ...
+// }
+// for (size_t item : batcher.GetSingleItems()) ...
+
+namespace breathe
+{
+  namespace render
+  {
+    // ** cInstanceBatch
+
+    class cInstanceBatch
+    {
+    public:
+      cRenderState state;
+      uint32_t geometry;
+      size_t item; // The item of the first instance
+      size_t firstInstance; // Into the instance buffer
+      size_t nInstances;
+    };
+
+
+    // ** cInstanceBatcher
+
+    class cInstanceBatcher
+    {
+    public:
+      static const size_t FLOATS_PER_INSTANCE = 16;
+
+      cInstanceBatcher();
+
+      cInstanceBatcher(const cInstanceBatcher&) = delete;
+      cInstanceBatcher& operator=(const cInstanceBatcher&) = delete;
+
+      // The size of the matrix array in the instancing shader
+      void SetMaximumInstancesPerBatch(size_t _nMaximumInstancesPerBatch) { ASSERT(_nMaximumInstancesPerBatch != 0); nMaximumInstancesPerBatch = _nMaximumInstancesPerBatch; }
+
+      // Groups with fewer draws than this are drawn one at a time
+      void SetMinimumInstances(size_t _nMinimumInstances) { nMinimumInstances = _nMinimumInstances; }
+
+      void Clear();
+      void Reserve(size_t nDraws);
+
+      // geometry is anything else that has to match for draws to be merged, such as the primitive type
+      void Add(const cRenderState& state, uint32_t geometry, const spitfire::math::cMat4& matAbsolutePositionAndRotation, size_t item);
+
+      void Build();
+
+      const std::vector<cInstanceBatch>& GetBatches() const { return batches; }
+      const std::vector<size_t>& GetSingleItems() const { return singleItems; }
+
+      // Column major 4x4 matrices, FLOATS_PER_INSTANCE for each instance
+      const std::vector<float>& GetInstanceBuffer() const { return instanceBuffer; }
+      const float* GetInstanceMatrices(const cInstanceBatch& batch) const { return &instanceBuffer[batch.firstInstance * FLOATS_PER_INSTANCE]; }
+
+      // The items of each instance in the same order as the instance buffer
+      const std::vector<size_t>& GetInstanceItems() const { return instanceItems; }
+
+      size_t GetDrawCount() const { return batches.size() + singleItems.size(); }
+
+    private:
+      struct cDraw
+      {
+        cRenderState state;
+        uint32_t geometry;
+        spitfire::math::cMat4 matAbsolutePositionAndRotation;
+        size_t item;
+      };
+
+      bool IsSameGroup(const cDraw& lhs, const cDraw& rhs) const;
+
+      size_t nMaximumInstancesPerBatch;
+      size_t nMinimumInstances;
+
+      std::vector<cDraw> draws;
+      std::vector<std::pair<uint64_t, uint32_t>> order; // Sort key and index into draws
+
+      std::vector<cInstanceBatch> batches;
+      std::vector<size_t> singleItems;
+      std::vector<float> instanceBuffer;
+      std::vector<size_t> instanceItems;
+    };
+  }
+}
+
+#endif // CINSTANCEBATCHER_H
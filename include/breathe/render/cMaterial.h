@@ -80,6 +80,9 @@ namespace breathe
 
         bool Load(const string_t& sNewFilename);
 
+        // Only reads the file, it doesn't create textures or shaders so it can be called on a worker thread
+        bool Parse(const string_t& sFilename);
+
         void CloneTo(cMaterialRef pDestination);
 
         bool IsLightEmitting() const { return bLight_emit; }
@@ -0,0 +1,182 @@
+#ifndef CRENDERQUEUE_H
+#define CRENDERQUEUE_H
+
+// Standard headers
+#include <cstdint>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Sorts the draws of a frame to minimise state changes and only sends the state that actually changes between draws
+//
+// Each draw is packed into a 64 bit key, the layer comes first, then opaque draws are sorted by shader, texture and vertex buffer
+// object and roughly front to back, and transparent draws are sorted back to front.  The keys are sorted with a radix sort and
+// Submit compares the state of each draw with the previous one so that only the shaders, textures and vertex buffer objects that
+// differ are bound.  None of this touches OpenGL directly, the binds go through a cRenderQueueContext.
+//
+// Usage:
+// breathe::render::cRenderQueue queue;
+// queue.Clear();
+// queue.AddOpaque(0, state, fDepth, item);
+// ...
+// queue.Sort();
+// queue.Submit(context);
+// const breathe::render::cRenderQueueStatistics& statistics = queue.GetStatistics();
+
+namespace breathe
+{
+  namespace render
+  {
+    // ** cRenderState
+    // Identifiers of the state that a draw needs, 0 means nothing is bound
+
+    class cRenderState
+    {
+    public:
+      static const size_t TEXTURE_UNITS = 3; // The same as MAX_TEXTURE_UNITS in cContext.h
+
+      cRenderState();
+
+      bool operator==(const cRenderState& rhs) const;
+      bool operator!=(const cRenderState& rhs) const { return !(*this == rhs); }
+
+      uint32_t shader;
+      uint32_t textures[TEXTURE_UNITS];
+      uint32_t vertexBufferObject;
+      bool bIsAlphaBlending;
+    };
+
+
+    // ** cRenderQueueStatistics
+
+    class cRenderQueueStatistics
+    {
+    public:
+      cRenderQueueStatistics();
+
+      void Reset();
+
+      size_t nDraws;
+      size_t nShaderBinds;
+      size_t nTextureBinds;
+      size_t nVertexBufferObjectBinds;
+      size_t nAlphaBlendingChanges;
+    };
+
+
+    // ** cRenderQueueContext
+    // Implemented by the renderer to actually change the state and draw, and by the unit tests to count what would have been done
+
+    class cRenderQueueContext
+    {
+    public:
+      friend class cRenderQueue;
+
+      virtual ~cRenderQueueContext() {}
+
+    private:
+      virtual void _BindShader(uint32_t shader) = 0;
+      virtual void _BindTexture(size_t unit, uint32_t texture) = 0;
+      virtual void _BindVertexBufferObject(uint32_t vertexBufferObject) = 0;
+      virtual void _SetAlphaBlending(bool bEnable) = 0;
+      virtual void _Draw(size_t item) = 0;
+    };
+
+
+    // ** cRenderQueue
+
+    class cRenderQueue
+    {
+    public:
+      static const size_t LAYERS = 256;
+
+      cRenderQueue() {}
+
+      cRenderQueue(const cRenderQueue&) = delete;
+      cRenderQueue& operator=(const cRenderQueue&) = delete;
+
+      void Clear();
+      void Reserve(size_t nDraws);
+
+      // fDepth is the distance to the camera divided by the far plane distance, item is passed back to cRenderQueueContext::_Draw
+      void AddOpaque(uint8_t layer, const cRenderState& state, float fDepth, size_t item);
+      void AddTransparent(uint8_t layer, const cRenderState& state, float fDepth, size_t item);
+
+      void Sort();
+
+      // Draws everything in sorted order, only changing the state that differs from the previous draw, and unbinds everything at the end
+      void Submit(cRenderQueueContext& context);
+
+      size_t GetCount() const { return keys.size(); }
+      uint64_t GetKey(size_t i) const { return keys[i]; } // In sorted order after Sort
+      size_t GetItem(size_t i) const { return draws[indices[i]].item; }
+      const cRenderState& GetState(size_t i) const { return draws[indices[i]].state; }
+
+      const cRenderQueueStatistics& GetStatistics() const { return statistics; }
+
+      static uint64_t MakeOpaqueKey(uint8_t layer, const cRenderState& state, float fDepth);
+      static uint64_t MakeTransparentKey(uint8_t layer, const cRenderState& state, float fDepth);
+
+    private:
+      struct cDraw
+      {
+        cRenderState state;
+        size_t item;
+      };
+
+      void Apply(cRenderQueueContext& context, const cRenderState& state);
+
+      std::vector<cDraw> draws;
+      std::vector<uint64_t> keys;
+      std::vector<uint32_t> indices; // Into draws, in the same order as keys
+
+      // Scratch buffers for the radix sort
+      std::vector<uint64_t> sortKeys;
+      std::vector<uint32_t> sortIndices;
+
+      cRenderState current;
+      cRenderQueueStatistics statistics;
+    };
+
+
+    // ** Inlines
+
+    // *** cRenderState
+
+    inline cRenderState::cRenderState() :
+      shader(0),
+      vertexBufferObject(0),
+      bIsAlphaBlending(false)
+    {
+      for (size_t i = 0; i < TEXTURE_UNITS; i++) textures[i] = 0;
+    }
+
+    inline bool cRenderState::operator==(const cRenderState& rhs) const
+    {
+      for (size_t i = 0; i < TEXTURE_UNITS; i++) {
+        if (textures[i] != rhs.textures[i]) return false;
+      }
+
+      return (shader == rhs.shader) && (vertexBufferObject == rhs.vertexBufferObject) && (bIsAlphaBlending == rhs.bIsAlphaBlending);
+    }
+
+    // *** cRenderQueueStatistics
+
+    inline cRenderQueueStatistics::cRenderQueueStatistics()
+    {
+      Reset();
+    }
+
+    inline void cRenderQueueStatistics::Reset()
+    {
+      nDraws = 0;
+      nShaderBinds = 0;
+      nTextureBinds = 0;
+      nVertexBufferObjectBinds = 0;
+      nAlphaBlendingChanges = 0;
+    }
+  }
+}
+
+#endif // CRENDERQUEUE_H
@@ -0,0 +1,175 @@
+#ifndef CRESOURCELOADER_H
+#define CRESOURCELOADER_H
+
+// Standard headers
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/threadpool.h>
+
+// Loads resources in two halves so that level loads don't stall the main thread
+// 1. Decode runs on a worker thread, it reads files, decodes images, parses materials, packs atlases etc. and must not touch the GPU
+// 2. Upload runs on the main thread inside Update, after the decode has finished and every dependency has been uploaded
+//
+// Usage:
+// breathe::render::cResourceLoader loader(spitfire::util::GetDefaultThreadPool());
+//
+// std::shared_ptr<voodoo::cImage> pImage(new voodoo::cImage);
+// breathe::render::cResourceHandle texture = loader.Add(
+//   [pImage](std::vector<breathe::render::cResourceHandle>&) { return pImage->LoadFromFile(sFilePath); },
+//   [pImage, pTexture]() { return pTexture->CreateFromImage(*pImage); }
+// );
+//
+// // A material is uploaded after its textures, the decode can also add dependencies it finds while it parses
+// breathe::render::cResourceHandle material = loader.Add(decodeMaterial, uploadMaterial, { texture });
+//
+// // Once per frame, upload for at most 2ms
+// loader.Update(2.0f);
+//
+// if (material.IsLoaded()) ...
+
+namespace breathe
+{
+  namespace render
+  {
+    class cResourceLoader;
+
+    enum class RESOURCE_STATE {
+      DECODING,                 // Queued or running on a worker thread
+      WAITING_FOR_DEPENDENCIES, // Decoded, waiting for the resources that it depends on to be uploaded
+      WAITING_FOR_UPLOAD,       // Waiting for the main thread to call Update
+      LOADED,
+      FAILED
+    };
+
+    class cResourceHandle;
+
+    // ** cResourceJob
+    // Internal state shared between the loader and any cResourceHandle that refer to it
+
+    class cResourceJob
+    {
+    public:
+      typedef std::function<bool(std::vector<cResourceHandle>& dependencies)> DecodeFunction;
+      typedef std::function<bool()> UploadFunction;
+
+      cResourceJob(const DecodeFunction& decode, const UploadFunction& upload);
+
+      DecodeFunction decode;
+      UploadFunction upload;
+
+      std::atomic<RESOURCE_STATE> state;
+
+      // Guarded by the loader's mutex
+      bool bIsDecoded;
+      size_t nDependenciesRemaining;
+      std::vector<std::shared_ptr<cResourceJob>> dependents; // Jobs waiting for this one to be uploaded
+    };
+
+
+    // ** cResourceHandle
+    // A future for a resource, the caller keeps using its placeholder until IsLoaded returns true
+    // A default constructed handle refers to a resource that was already loaded synchronously
+
+    class cResourceHandle
+    {
+    public:
+      cResourceHandle();
+      explicit cResourceHandle(std::shared_ptr<cResourceJob> pJob);
+
+      bool IsValid() const { return (pJob != nullptr); }
+
+      RESOURCE_STATE GetState() const;
+      bool IsLoaded() const { return (GetState() == RESOURCE_STATE::LOADED); }
+      bool IsFailed() const { return (GetState() == RESOURCE_STATE::FAILED); }
+      bool IsFinished() const { const RESOURCE_STATE state = GetState(); return ((state == RESOURCE_STATE::LOADED) || (state == RESOURCE_STATE::FAILED)); }
+
+    private:
+      friend class cResourceLoader;
+
+      std::shared_ptr<cResourceJob> pJob;
+    };
+
+
+    // ** cResourceLoader
+
+    class cResourceLoader
+    {
+    public:
+      explicit cResourceLoader(spitfire::util::cThreadPool& pool);
+      ~cResourceLoader(); // Waits for any decodes that are still running, resources that have not been uploaded are dropped
+
+      // Safe to call from any thread including from inside a decode function
+      // A failed dependency does not fail the resource, the upload function can check the handle and fall back to a placeholder
+      cResourceHandle Add(const cResourceJob::DecodeFunction& decode, const cResourceJob::UploadFunction& upload, const std::vector<cResourceHandle>& dependencies = std::vector<cResourceHandle>());
+
+      // Main thread only, uploads resources in the order that they became ready until fTimeBudgetMS has passed.
+      // At least one resource is uploaded if any are ready so that loading always progresses, returns the number of resources uploaded.
+      size_t Update(float fTimeBudgetMS);
+
+      // Main thread only, blocks until every resource has loaded or failed, for loading screens and tools
+      void Flush();
+
+      size_t GetPendingCount() const { return nPending.load(); } // Resources that have not loaded or failed yet
+      bool IsIdle() const { return (GetPendingCount() == 0); }
+
+    private:
+      cResourceLoader(const cResourceLoader&) = delete;
+      cResourceLoader& operator=(const cResourceLoader&) = delete;
+
+      void Decode(std::shared_ptr<cResourceJob> pJob);
+      void AddDependencyLocked(std::shared_ptr<cResourceJob> pJob, const cResourceHandle& dependency);
+      void MakeReadyIfPossibleLocked(std::shared_ptr<cResourceJob> pJob);
+      void FinishLocked(std::shared_ptr<cResourceJob> pJob, RESOURCE_STATE state);
+
+      spitfire::util::cThreadPool& pool;
+
+      std::mutex mutex;
+      std::condition_variable condition; // Signalled when a resource becomes ready to upload, finishes, or a decode ends
+      std::deque<std::shared_ptr<cResourceJob>> ready; // Decoded with all dependencies uploaded, in the order that they became ready
+
+      std::atomic<size_t> nPending;
+      size_t nDecoding; // Guarded by mutex, decode tasks that have been submitted and not finished yet
+      std::atomic<bool> bIsStopping;
+    };
+
+
+    // ** Inlines
+
+    // *** cResourceJob
+
+    inline cResourceJob::cResourceJob(const DecodeFunction& _decode, const UploadFunction& _upload) :
+      decode(_decode),
+      upload(_upload),
+      state(RESOURCE_STATE::DECODING),
+      bIsDecoded(false),
+      nDependenciesRemaining(0)
+    {
+    }
+
+    // *** cResourceHandle
+
+    inline cResourceHandle::cResourceHandle()
+    {
+    }
+
+    inline cResourceHandle::cResourceHandle(std::shared_ptr<cResourceJob> _pJob) :
+      pJob(_pJob)
+    {
+    }
+
+    inline RESOURCE_STATE cResourceHandle::GetState() const
+    {
+      return IsValid() ? pJob->state.load() : RESOURCE_STATE::LOADED;
+    }
+  }
+}
+
+#endif // CRESOURCELOADER_H
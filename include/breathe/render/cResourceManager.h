@@ -1,6 +1,8 @@
 #ifndef CRESOURCEMANAGER_H
 #define CRESOURCEMANAGER_H
 
+#include <mutex>
+
 #include <spitfire/math/math.h>
 #include <spitfire/math/cVec2.h>
 #include <spitfire/math/cVec3.h>
@@ -15,6 +17,7 @@
 #include <breathe/render/cTexture.h>
 #include <breathe/render/cTextureAtlas.h>
 #include <breathe/render/cTexture.h>
+#include <breathe/render/cResourceLoader.h>
 #include <breathe/render/cVertexBufferObject.h>
 #include <breathe/render/model/cMesh.h>
 #include <breathe/render/cContext.h>
@@ -88,6 +91,19 @@ namespace breathe
       material::cMaterialRef GetMaterial(const string_t& sFilename);
 
 
+      // Asynchronous loading, files are read, decoded and parsed on worker threads and then uploaded by UpdateLoading on the main thread.
+      // The returned texture or material must not be used until outHandle is loaded, GetTexture and GetMaterial return the not found
+      // texture and material until then.  If the resource was already loaded outHandle is a default handle which is always loaded.
+      // If the load fails outHandle fails and the returned texture or material is never used, GetTexture and GetMaterial return the not
+      // found texture and material, the same placeholders that AddTexture and AddMaterial return.
+      cTextureRef AddTextureAsync(const string_t& sNewFilename, cResourceHandle& outHandle); // Can be called from any thread
+      material::cMaterialRef AddMaterialAsync(const string_t& sNewFilename, cResourceHandle& outHandle);
+
+      void UpdateLoading(float fTimeBudgetMS); // Call once per frame to upload the resources that are ready, for at most fTimeBudgetMS
+      void FinishLoading(); // Blocks until everything that has been added has loaded or failed
+      bool IsLoading() const { return !loader.IsIdle(); }
+
+
       void SetAtlasWidth(unsigned int uiNewSegmentWidthPX, unsigned int uiNewSegmentSmallPX, unsigned int uiNewAtlasWidthPX);
 
       void BeginLoadingTextures();
@@ -115,6 +131,12 @@ namespace breathe
 
       cContext& context;
 
+      cResourceLoader loader;
+
+      std::mutex mutexTextures; // Guards mTextureLoading, and mTexture against the worker threads, the main thread can read mTexture without it
+      std::map<string_t, std::pair<cTextureRef, cResourceHandle>> mTextureLoading;
+      std::map<string_t, std::pair<material::cMaterialRef, cResourceHandle>> mMaterialLoading;
+
 
       size_t uiSegmentWidthPX;
       size_t uiSegmentSmallPX;
@@ -13,12 +13,17 @@ namespace breathe
       cCamera();
 
       float_t GetFieldOfViewDegrees() const { return fFOVDegrees; }
+      float_t GetAspectRatio() const { return fAspectRatio; }
+      float_t GetNearClipDistance() const { return fNearClipDistance; }
+      float_t GetFarClipDistance() const { return fFarClipDistance; }
       const spitfire::math::cVec3& GetLookAtPoint() const { return positionLookAtPoint; }
       const spitfire::math::cVec3& GetEyePosition() const { return positionEye; }
       const spitfire::math::cVec3& GetUpDirection() const { return directionUp; }
       const spitfire::math::cVec3& GetRightDirection() const { return directionRight; }
 
       void SetFieldOfViewDegrees(float_t _fFOVDegrees) { fFOVDegrees = _fFOVDegrees; }
+      void SetAspectRatio(float_t _fAspectRatio) { ASSERT(_fAspectRatio > 0.0f); fAspectRatio = _fAspectRatio; }
+      void SetClipDistances(float_t _fNearClipDistance, float_t _fFarClipDistance) { ASSERT(_fNearClipDistance > 0.0f); ASSERT(_fNearClipDistance < _fFarClipDistance); fNearClipDistance = _fNearClipDistance; fFarClipDistance = _fFarClipDistance; }
 
       void SetLookAtCamera(const spitfire::math::cVec3& positionEye, const spitfire::math::cVec3& positionLookAtPoint);
       void SetLookAtCameraZoomToFillScreen(const spitfire::math::cVec3& positionEye, const spitfire::math::cVec3& positionOfObject, float_t fDiameterOfObjectMeters);
@@ -30,6 +35,9 @@ namespace breathe
 
     private:
       float_t fFOVDegrees;
+      float_t fAspectRatio; // Width / height of the viewport
+      float_t fNearClipDistance;
+      float_t fFarClipDistance;
       spitfire::math::cVec3 positionLookAtPoint;
       spitfire::math::cVec3 positionEye;
       spitfire::math::cVec3 directionUp;
@@ -0,0 +1,193 @@
+#ifndef CBINARYMESH_H
+#define CBINARYMESH_H
+
+// Standard headers
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/file.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometryData.h>
+
+// Breathe headers
+#include <breathe/render/model/cStatic.h>
+
+// A pre-baked binary mesh cache, a .bmesh file holds the meshes of a model exactly as opengl::cGeometryData expects them so that
+// loading is a single memory map with no parsing.  Each mesh is an interleaved v3[_n3][_t2] vertex stream, identical vertices
+// are welded into 16 bit indices or the stream is left de-indexed if there are too many unique vertices.
+//
+// The file also records which source model it was baked from, so it can be checked and rebaked when the source changes.
+//
+// Usage:
+// breathe::render::model::cStaticModel model;
+// breathe::render::model::LoadStaticModelUsingCache(TEXT("data/models/crate.obj"), model); // Creates data/models/crate.obj.bmesh the first time
+//
+// Or to upload straight from the mapped file:
+// breathe::render::model::cBinaryMeshFile file;
+// if (file.Open(TEXT("data/models/crate.obj.bmesh"))) {
+//   for (size_t i = 0; i < file.GetMeshCount(); i++) {
+//     opengl::cGeometryData data;
+//     file.GetGeometryData(i, data);
+//     ...
+//   }
+// }
+
+namespace breathe
+{
+  namespace render
+  {
+    namespace model
+    {
+      const uint32_t BINARY_MESH_VERSION = 1;
+
+      // ** cBinaryMeshSourceKey
+      // Identifies the source file that a cache was baked from
+
+      class cBinaryMeshSourceKey
+      {
+      public:
+        cBinaryMeshSourceKey();
+
+        std::string sSourceFilePath; // UTF8
+        uint64_t nSourceSizeBytes;
+        int64_t sourceModifiedTime; // Filesystem clock ticks
+        uint64_t sourceHash; // FNV-1a of the contents
+      };
+
+      // Returns false if the source file can't be read
+      bool GetBinaryMeshSourceKey(const string_t& sSourceFilePath, cBinaryMeshSourceKey& outKey);
+
+
+      // ** cBinaryMeshView
+      // One mesh inside a mapped .bmesh file, the pointers are only valid while the file is open
+
+      class cBinaryMeshView
+      {
+      public:
+        cBinaryMeshView();
+
+        size_t GetFloatsPerPoint() const { return nVerticesPerPoint + nNormalsPerPoint + nTextureCoordinatesPerPoint; }
+        bool IsIndexed() const { return (nIndexCount != 0); }
+
+        const float* pVertices; // Interleaved, GetFloatsPerPoint() floats per vertex
+        size_t nVertexCount;
+
+        size_t nVerticesPerPoint;
+        size_t nNormalsPerPoint;
+        size_t nTextureCoordinatesPerPoint;
+
+        const uint16_t* pIndices; // nullptr if the mesh is de-indexed
+        size_t nIndexCount;
+
+        std::string_view sMaterial; // UTF8
+      };
+
+
+      // ** cBinaryMeshFile
+
+      class cBinaryMeshFile
+      {
+      public:
+        cBinaryMeshFile();
+
+        // Returns false if the file is missing, truncated, from another version or was baked from another source file
+        bool Open(const string_t& sFilePath);
+        void Close();
+
+        bool IsOpen() const { return file.IsOpen(); }
+
+        // The cache is up to date if the source has the same size and modified time, or failing that the same contents
+        bool IsUpToDate(const string_t& sSourceFilePath) const;
+
+        std::string_view GetSourceFilePath() const { return sSourceFilePath; }
+        uint64_t GetSourceSizeBytes() const { return nSourceSizeBytes; }
+        int64_t GetSourceModifiedTime() const { return sourceModifiedTime; }
+        uint64_t GetSourceHash() const { return sourceHash; }
+
+        size_t GetMeshCount() const { return meshes.size(); }
+        const cBinaryMeshView& GetMesh(size_t index) const { ASSERT(index < meshes.size()); return meshes[index]; }
+
+        void GetGeometryData(size_t index, opengl::cGeometryData& data) const;
+        void GetStaticModel(cStaticModel& model) const; // De-indexed, the same as the source loader would have produced
+
+      private:
+        cBinaryMeshFile(const cBinaryMeshFile&) = delete;
+        cBinaryMeshFile& operator=(const cBinaryMeshFile&) = delete;
+
+        spitfire::storage::cMemoryMappedFile file;
+
+        std::string_view sSourceFilePath;
+        uint64_t nSourceSizeBytes;
+        int64_t sourceModifiedTime;
+        uint64_t sourceHash;
+
+        std::vector<cBinaryMeshView> meshes;
+      };
+
+
+      // ** Baking
+
+      // The vertices, normals and texture coordinates of each mesh must describe the same number of points, the normals can be empty
+      bool SaveBinaryMesh(const string_t& sFilePath, const cBinaryMeshSourceKey& key, const cStaticModel& model);
+
+      // Loads a source model with the loader for its extension, only .obj static models are supported
+      bool LoadSourceModel(const string_t& sSourceFilePath, cStaticModel& model);
+
+      bool BakeBinaryMesh(const string_t& sSourceFilePath, const string_t& sBinaryMeshFilePath);
+
+      string_t GetBinaryMeshCacheFilePath(const string_t& sSourceFilePath); // "models/crate.obj" -> "models/crate.obj.bmesh"
+
+      // Loads from the cache if it is up to date, otherwise loads the source and rebakes the cache
+      bool LoadStaticModelUsingCache(const string_t& sSourceFilePath, cStaticModel& model);
+
+
+      // ** Inlines
+
+      // *** cBinaryMeshSourceKey
+
+      inline cBinaryMeshSourceKey::cBinaryMeshSourceKey() :
+        nSourceSizeBytes(0),
+        sourceModifiedTime(0),
+        sourceHash(0)
+      {
+      }
+
+      // *** cBinaryMeshView
+
+      inline cBinaryMeshView::cBinaryMeshView() :
+        pVertices(nullptr),
+        nVertexCount(0),
+        nVerticesPerPoint(0),
+        nNormalsPerPoint(0),
+        nTextureCoordinatesPerPoint(0),
+        pIndices(nullptr),
+        nIndexCount(0)
+      {
+      }
+
+      // *** cBinaryMeshFile
+
+      inline void cBinaryMeshFile::GetGeometryData(size_t index, opengl::cGeometryData& data) const
+      {
+        const cBinaryMeshView& mesh = GetMesh(index);
+
+        data.vertices.assign(mesh.pVertices, mesh.pVertices + (mesh.nVertexCount * mesh.GetFloatsPerPoint()));
+        data.indices.assign(mesh.pIndices, mesh.pIndices + mesh.nIndexCount);
+        data.nVertexCount = mesh.nVertexCount;
+        data.nVerticesPerPoint = mesh.nVerticesPerPoint;
+        data.nNormalsPerPoint = mesh.nNormalsPerPoint;
+        data.nColoursPerPoint = 0;
+        data.nTextureCoordinatesPerPoint = mesh.nTextureCoordinatesPerPoint;
+        data.nFloatUserData0PerPoint = 0;
+        data.nFloatUserData1PerPoint = 0;
+        data.nFloatUserData2PerPoint = 0;
+      }
+    }
+  }
+}
+
+#endif // CBINARYMESH_H
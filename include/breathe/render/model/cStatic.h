@@ -3,6 +3,7 @@
 
 // Spitfire headers
 #include <spitfire/util/string.h>
+#include <spitfire/math/geometry.h>
 
 // Breathe headers
 #include <breathe/breathe.h>
@@ -18,6 +19,9 @@ namespace breathe
       public:
         void Clear();
 
+        // The box around every vertex, returns false if there are no vertices
+        bool GetBoundingBox(spitfire::math::cAABB3& box) const;
+
         std::vector<float_t> vertices;
         std::vector<float_t> textureCoordinates;
         std::vector<float_t> normals;
@@ -0,0 +1,62 @@
+#ifndef CMODEL_STATIC_LOD_H
+#define CMODEL_STATIC_LOD_H
+
+// Standard headers
+#include <vector>
+
+// Breathe headers
+#include <breathe/breathe.h>
+#include <breathe/render/model/cStatic.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometryData.h>
+
+// Generates lower detail versions of a static model with opengl::cGeometrySimplifier, and the distances to switch to each one
+// so that the simplification is never more than a few pixels on the screen.  The levels can be attached to a cLODNode in order
+// and the distances passed to cLODNode::SetSwitchDistances, breathe::scenegraph3d::CreateLODNode does both.
+//
+// Usage:
+// breathe::render::model::cStaticModelLOD lods;
+// breathe::render::model::GenerateStaticModelLODs(model, { 0.5f, 0.25f, 0.1f }, 60.0f, 1080, 1.0f, lods);
+
+namespace breathe
+{
+  namespace render
+  {
+    namespace model
+    {
+      // ** cStaticModelLOD
+
+      class cStaticModelLOD
+      {
+      public:
+        cStaticModelLOD() {}
+        ~cStaticModelLOD() { Clear(); }
+
+        cStaticModelLOD(const cStaticModelLOD&) = delete;
+        cStaticModelLOD& operator=(const cStaticModelLOD&) = delete;
+
+        void Clear();
+
+        std::vector<cStaticModel*> lod; // lod[0] is a copy of the original model
+        std::vector<float> errors; // The largest distance that any mesh in each level moved by, errors[0] is 0
+        std::vector<float> distances; // Each level is used from this distance to the camera onwards, distances[0] is 0
+      };
+
+      // Interleaved in the order that cGeometryData expects, the indices are kept if the mesh has them
+      bool GetGeometryData(const cStaticModelMesh& mesh, opengl::cGeometryData& data);
+
+      // The box around every level, returns false if there are no vertices
+      bool GetStaticModelLODBoundingBox(const cStaticModelLOD& lods, spitfire::math::cAABB3& box);
+
+      // The level to use at fDistance from the camera, the last level with a distance that is less than or equal to fDistance
+      size_t GetStaticModelLODLevel(const std::vector<float>& distances, float fDistance);
+
+      // Each ratio is of the triangle count of each mesh in the model, they should be decreasing
+      // The meshes of every level are de-indexed like the source loaders produce
+      bool GenerateStaticModelLODs(const cStaticModel& model, const std::vector<float>& ratios, float fFieldOfViewDegrees, size_t nViewportHeightPixels, float fMaximumErrorPixels, cStaticModelLOD& lods);
+    }
+  }
+}
+
+#endif // CMODEL_STATIC_LOD_H
@@ -244,6 +244,7 @@ namespace opengl
     bool SetShaderConstant(const std::string& sConstant, const spitfire::math::cColour& value); // NOTE: This will try to look for a vec4 in the shader
     bool SetShaderConstant(const std::string& sConstant, const spitfire::math::cMat3& matrix);
     bool SetShaderConstant(const std::string& sConstant, const spitfire::math::cMat4& matrix);
+    bool SetShaderConstantMatrixArray(const std::string& sConstant, const float* pMatrices, size_t nMatrices); // Column major 4x4 matrices, for a mat4 array in the shader
 
     // A shader must already be bound before these are called
     void SetShaderProjectionAndViewAndModelMatrices(const spitfire::math::cMat4& matProjection, const spitfire::math::cMat4& matView, const spitfire::math::cMat4& matModel);
@@ -270,6 +271,7 @@ namespace opengl
     void DrawStaticVertexBufferObjectLines(cStaticVertexBufferObject& staticVertexBufferObject);
     void DrawStaticVertexBufferObjectTriangles(cStaticVertexBufferObject& staticVertexBufferObject);
     void DrawStaticVertexBufferObjectTriangleStrip(cStaticVertexBufferObject& staticVertexBufferObject);
+    void DrawStaticVertexBufferObjectTrianglesInstanced(cStaticVertexBufferObject& staticVertexBufferObject, size_t nInstances);
     #ifndef BUILD_LIBOPENGLMM_OPENGL_STRICT
     // Quads are deprecated in OpenGL 3.1 core profile
     void DrawStaticVertexBufferObjectQuads(cStaticVertexBufferObject& staticVertexBufferObject);
@@ -0,0 +1,131 @@
+/*************************************************************************
+ *                                                                       *
+ * libopenglmm Library, Copyright (C) 2009 Onwards Chris Pilkington      *
+ * All rights reserved.  Web: http://chris.iluo.net                      *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 2.1 of the  *
+ * License, or (at your option) any later version. The text of the GNU   *
+ * General Public License is included with this library in the           *
+ * file license.txt.                                                     *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.                  *
+ * See the file GPL.txt for more details.                                *
+ *                                                                       *
+ *************************************************************************/
+
+// Post processes triangle lists from cGeometryBuilder and the model loaders so that they render faster
+// 1. Duplicate vertices are welded into an index buffer
+// 2. Triangles are reordered for the post transform vertex cache (Tipsify, Sander, Nehab and Barczak 2007)
+// 3. Clusters of triangles are reordered so that triangles facing outwards are drawn first, which reduces overdraw
+// 4. Vertices are reordered into the order that they are first used for fetch locality
+//
+// ACMR is the average cache miss ratio, vertex shader invocations per triangle, 3.0 for an unindexed triangle list and about 0.5 at best
+// ATVR is the average transform to vertex ratio, vertex shader invocations per unique vertex, 1.0 is ideal
+//
+// Usage:
+// opengl::cGeometryBuilder builder;
+// builder.CreateSphere(1.0f, 30, data, 1);
+//
+// opengl::cGeometryOptimiser optimiser;
+// opengl::cGeometryOptimiserStatistics statistics;
+// optimiser.Optimise(data, statistics);
+// std::cout<<"ACMR "<<statistics.fACMRBefore<<" -> "<<statistics.fACMRAfter<<std::endl;
+
+#ifndef LIBOPENGLMM_CGEOMETRYOPTIMISER_H
+#define LIBOPENGLMM_CGEOMETRYOPTIMISER_H
+
+// Standard headers
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <libopenglmm/cGeometryData.h>
+
+namespace opengl
+{
+  // ** cGeometryOptimiserStatistics
+
+  class cGeometryOptimiserStatistics
+  {
+  public:
+    cGeometryOptimiserStatistics();
+
+    size_t nVertexCountBefore;
+    size_t nVertexCountAfter;
+    float fACMRBefore;
+    float fACMRAfter;
+    float fATVRBefore;
+    float fATVRAfter;
+  };
+
+
+  // ** cGeometryOptimiser
+  // All of the functions expect cGeometryData that holds a triangle list with the positions first in each point
+
+  class cGeometryOptimiser
+  {
+  public:
+    cGeometryOptimiser();
+
+    void SetCacheSize(size_t _nCacheSize) { ASSERT(_nCacheSize >= 3); nCacheSize = _nCacheSize; }
+
+    // How much worse than the vertex cache order a cluster can be before it is split for overdraw, 1.0 keeps only the hard boundaries
+    void SetOverdrawThreshold(float _fOverdrawThreshold) { ASSERT(_fOverdrawThreshold >= 1.0f); fOverdrawThreshold = _fOverdrawThreshold; }
+
+    // Runs every step, returns false and leaves data alone if there are more than 65536 unique vertices
+    bool Optimise(cGeometryData& data) const;
+    bool Optimise(cGeometryData& data, cGeometryOptimiserStatistics& statistics) const;
+
+    // Merges bitwise identical points, returns false and leaves data alone if there are too many unique vertices for 16 bit indices
+    bool WeldVertices(cGeometryData& data) const;
+
+    // These require indexed data
+    void OptimiseVertexCache(cGeometryData& data) const;
+    void OptimiseOverdraw(cGeometryData& data) const; // Call after OptimiseVertexCache, it keeps the cache friendly order within each cluster
+    void OptimiseVertexFetch(cGeometryData& data) const; // Also drops vertices that are not referenced
+
+    // Unindexed data is treated as if every point has its own index
+    float GetACMR(const cGeometryData& data) const;
+    float GetATVR(const cGeometryData& data) const;
+
+  private:
+    size_t nCacheSize; // Entries in the simulated FIFO post transform cache
+    float fOverdrawThreshold;
+  };
+
+
+  // ** Inlines
+
+  // *** cGeometryOptimiserStatistics
+
+  inline cGeometryOptimiserStatistics::cGeometryOptimiserStatistics() :
+    nVertexCountBefore(0),
+    nVertexCountAfter(0),
+    fACMRBefore(0.0f),
+    fACMRAfter(0.0f),
+    fATVRBefore(0.0f),
+    fATVRAfter(0.0f)
+  {
+  }
+
+  // *** cGeometryOptimiser
+
+  inline cGeometryOptimiser::cGeometryOptimiser() :
+    nCacheSize(16),
+    fOverdrawThreshold(1.05f)
+  {
+  }
+
+  inline bool cGeometryOptimiser::Optimise(cGeometryData& data) const
+  {
+    cGeometryOptimiserStatistics statistics;
+    return Optimise(data, statistics);
+  }
+}
+
+#endif // LIBOPENGLMM_CGEOMETRYOPTIMISER_H
@@ -0,0 +1,87 @@
+/*************************************************************************
+ *                                                                       *
+ * libopenglmm Library, Copyright (C) 2009 Onwards Chris Pilkington      *
+ * All rights reserved.  Web: http://chris.iluo.net                      *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 2.1 of the  *
+ * License, or (at your option) any later version. The text of the GNU   *
+ * General Public License is included with this library in the           *
+ * file license.txt.                                                     *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.                  *
+ * See the file GPL.txt for more details.                                *
+ *                                                                       *
+ *************************************************************************/
+
+// Generates lower detail versions of a triangle list for LOD
+//
+// The simplifier collapses edges in the order of their quadric error ("Surface Simplification Using Quadric Error Metrics", Garland and Heckbert 1997).
+// Each collapse moves a vertex onto one of its neighbours so every vertex in the output is one of the input vertices with its normal,
+// texture coordinates and colour unchanged.  Vertices on a UV or normal seam (the same position with different attributes), on an
+// open border, or on a non-manifold edge are never moved, so seams and silhouettes of open meshes stay where they are.
+//
+// Usage:
+// opengl::cGeometrySimplifier simplifier;
+// std::vector<opengl::cGeometryData> lods;
+// std::vector<float> errors;
+// simplifier.GenerateLODs(data, { 0.5f, 0.25f, 0.1f }, lods, errors);
+//
+// // Switch to each LOD when its error would be less than a pixel on a 1080p screen with a 60 degree field of view
+// for (size_t i = 0; i < lods.size(); i++) distances.push_back(opengl::GetLODSwitchDistance(errors[i], 60.0f, 1080, 1.0f));
+
+#ifndef LIBOPENGLMM_CGEOMETRYSIMPLIFIER_H
+#define LIBOPENGLMM_CGEOMETRYSIMPLIFIER_H
+
+// Standard headers
+#include <limits>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <libopenglmm/cGeometryData.h>
+
+namespace opengl
+{
+  // ** cGeometrySimplifier
+  // Expects cGeometryData that holds a triangle list with the positions first in each point, indexed or not
+
+  class cGeometrySimplifier
+  {
+  public:
+    cGeometrySimplifier();
+
+    // In object space, collapses that would move the surface further than this are not done even if the target has not been reached
+    void SetMaximumError(float _fMaximumError) { fMaximumError = _fMaximumError; }
+
+    // The destination is indexed and vertex cache optimised, fError is an upper bound on the distance that the surface moved by
+    // Returns false if the source has more unique vertices than 16 bit indices can address
+    bool Simplify(const cGeometryData& source, size_t nTargetTriangles, cGeometryData& destination, float& fError) const;
+
+    // One LOD for each ratio of the source triangle count, the ratios should be decreasing, errors are increasing
+    bool GenerateLODs(const cGeometryData& source, const std::vector<float>& ratios, std::vector<cGeometryData>& lods, std::vector<float>& errors) const;
+
+  private:
+    float fMaximumError;
+  };
+
+
+  // The distance at which an object space error of fError projects to fMaximumErrorPixels on the screen
+  float GetLODSwitchDistance(float fError, float fFieldOfViewDegrees, size_t nViewportHeightPixels, float fMaximumErrorPixels);
+
+
+  // ** Inlines
+
+  // *** cGeometrySimplifier
+
+  inline cGeometrySimplifier::cGeometrySimplifier() :
+    fMaximumError(std::numeric_limits<float>::max())
+  {
+  }
+}
+
+#endif // LIBOPENGLMM_CGEOMETRYSIMPLIFIER_H
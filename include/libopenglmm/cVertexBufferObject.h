@@ -76,6 +76,9 @@ namespace opengl
     void RenderQuadStrip();
     #endif
 
+    // Draws the geometry nInstances times, the shader picks each instance's data with gl_InstanceID
+    void RenderTrianglesInstanced(size_t nInstances);
+
     void RenderLines2D();
     void RenderTriangles2D();
     #ifndef BUILD_LIBOPENGLMM_OPENGL_STRICT
@@ -85,6 +88,7 @@ namespace opengl
 
   private:
     void RenderGeometry(GLenum geometryType);
+    void RenderGeometryInstanced(GLenum geometryType, size_t nInstances);
     void RenderGeometry2D(GLenum geometryType);
 
     bool bIsCompiled;
@@ -68,8 +68,10 @@ namespace voodoo
     bool CreateFromImage(const cImage& image);
     bool CreateFromBuffer(const uint8_t* pBuffer, size_t width, size_t height, PIXELFORMAT pixelFormat);
 
+    // These support the H8, R8G8B8 and R8G8B8A8 formats
     void CreateFromImageResizeNearestNeighbour(const cImage& image, size_t width, size_t height);
-    void CreateFromImageHalfSize(const cImage& image); // Skips every second pixel
+    void CreateFromImageResize(const cImage& image, size_t width, size_t height, RESIZE_FILTER filter);
+    void CreateFromImageHalfSize(const cImage& image); // Averages each 2x2 block of pixels
     void CreateFromImageDoubleSize(const cImage& image); // Copies each pixel twice
     void CreateFromImageAndSmooth(const cImage& image, size_t iterations);
 
@@ -95,6 +97,7 @@ namespace voodoo
     void FillMagenta();
     void FillTestPattern();
 
+    // These support the H8, R8G8B8 and R8G8B8A8 formats
     void ConvertToGreyScale();
     void ConvertToNegative();
 
@@ -112,6 +115,8 @@ namespace voodoo
     void Assign(const cImage& rhs);
 
     bool IsSameFormat(const cImage& rhs) const;
+
+    size_t GetChannelCountForKernels() const;
   };
 }
 
@@ -0,0 +1,108 @@
+/*************************************************************************
+ *                                                                       *
+ * libvoodoomm Library, Copyright (C) 2009 Onwards Chris Pilkington      *
+ * All rights reserved.  Web: http://chris.iluo.net                      *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 2.1 of the  *
+ * License, or (at your option) any later version. The text of the GNU   *
+ * General Public License is included with this library in the           *
+ * file license.txt.                                                     *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.                  *
+ * See the file GPL.txt for more details.                                *
+ *                                                                       *
+ *************************************************************************/
+
+#pragma once
+
+// Standard headers
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <libvoodoomm/cImage.h>
+
+// Builds every mip level of an image on the CPU so that the chain can be cached at build time and uploaded without glGenerateMipmap
+//
+// Each level is a 2x2 box filter of the level above it, when a dimension is odd the filter is widened to 3 pixels so that every pixel contributes.
+// Filtering is done in linear space, R8G8B8 and R8G8B8A8 images in the sRGB colour space are converted to linear and back, alpha is always linear.
+//
+// voodoo::cMipChain mipChain;
+// mipChain.CreateFromImage(image, voodoo::COLOUR_SPACE::SRGB);
+// for (size_t i = 0; i < mipChain.GetLevelCount(); i++) {
+//   glTexImage2D(GL_TEXTURE_2D, i, GL_SRGB8_ALPHA8, mipChain.GetWidth(i), mipChain.GetHeight(i), 0, GL_RGBA, GL_UNSIGNED_BYTE, mipChain.GetPointerToLevel(i));
+// }
+
+namespace voodoo
+{
+  enum class COLOUR_SPACE {
+    LINEAR,
+    SRGB // Only used for R8G8B8 and R8G8B8A8, the other formats are always linear
+  };
+
+  // ** cMipChain
+
+  class cMipChain
+  {
+  public:
+    cMipChain();
+
+    static bool IsPixelFormatSupported(PIXELFORMAT pixelFormat);
+    static size_t GetLevelCountForSize(size_t width, size_t height);
+
+    bool CreateFromBuffer(const uint8_t* pBuffer, size_t width, size_t height, PIXELFORMAT pixelFormat, COLOUR_SPACE colourSpace);
+    bool CreateFromImage(const cImage& image, COLOUR_SPACE colourSpace);
+
+    void Clear();
+
+    bool IsValid() const { return !levels.empty(); }
+
+    PIXELFORMAT GetPixelFormat() const { return pixelFormat; }
+    COLOUR_SPACE GetColourSpace() const { return colourSpace; }
+
+    size_t GetLevelCount() const { return levels.size(); }
+    size_t GetWidth(size_t level) const;
+    size_t GetHeight(size_t level) const;
+    size_t GetLevelSizeBytes(size_t level) const;
+    const uint8_t* GetPointerToLevel(size_t level) const;
+
+    // The levels are stored one after the other starting with the largest
+    size_t GetBufferSizeBytes() const { return buffer.size(); }
+    const uint8_t* GetPointerToBuffer() const { return buffer.data(); }
+
+    void GetLevel(size_t level, cImage& image) const;
+
+  private:
+    struct cLevel {
+      size_t width;
+      size_t height;
+      size_t offset;
+    };
+
+    PIXELFORMAT pixelFormat;
+    COLOUR_SPACE colourSpace;
+
+    std::vector<cLevel> levels;
+    std::vector<uint8_t> buffer;
+  };
+
+
+  // ** Inlines
+
+  // These are inline so that cMipChain can be used without linking cImage and SDL3_image
+
+  inline bool cMipChain::CreateFromImage(const cImage& image, COLOUR_SPACE _colourSpace)
+  {
+    return CreateFromBuffer(image.GetPointerToBuffer(), image.GetWidth(), image.GetHeight(), image.GetPixelFormat(), _colourSpace);
+  }
+
+  inline void cMipChain::GetLevel(size_t level, cImage& image) const
+  {
+    image.CreateFromBuffer(GetPointerToLevel(level), GetWidth(level), GetHeight(level), pixelFormat);
+  }
+}
@@ -26,24 +26,20 @@
 #include <spitfire/spitfire.h>
 
 #include <spitfire/math/math.h>
+#include <spitfire/math/cRectanglePacker.h>
 
 #include <libvoodoomm/cImage.h>
 
-// TODO: Add a 1 pixel border around every item
+// Packs images into one or more atlas pages
 //
-// TODO: Use a better packing algorithm
-// https://stackoverflow.com/questions/1213394/what-algorithm-can-be-used-for-packing-rectangles-of-different-sizes-into-the-sm
-// https://www.csc.liv.ac.uk/~epa/surveyhtml.html
-// https://blackpawn.com/texts/lightmaps/
-//
-// TODO: Split up the rectangle packing from the texture mapping? The packing could be moved into spitfire::math
-// std::vector<rect> rects;
-// rects.push_back...
-// spitfire::math::cVec2 minimumSize(0.0f, 0.0f);
-// spitfire::math::PackRectsFindArea(rects, minimumSize);
+// Each image can be surrounded by a gutter of padding pixels, with edge extrusion the padding is filled with copies of the edge pixels
+// of the image so that bilinear filtering and lower mip levels don't pick up the neighbouring images.
 //
 // voodoo::cTextureAtlas textureAtlas;
-// textureAtlas.CreateWidthRectsAndImages(minimumSize, rects, images);
+// textureAtlas.Init(2048, 2048, voodoo::PIXELFORMAT::R8G8B8A8);
+// textureAtlas.SetPadding(2, true);
+// textureAtlas.AddImages(images);
+// for (auto&& entry : textureAtlas.GetTextureAtlasEntries()) ...
 
 namespace voodoo
 {
@@ -52,6 +48,7 @@ class cTextureAtlasEntry {
 public:
   cTextureAtlasEntry();
 
+  size_t page;
   size_t x;
   size_t y;
   size_t width;
@@ -65,26 +62,49 @@ public:
 
   void Init(size_t width, size_t height, voodoo::PIXELFORMAT pixelFormat);
 
+  // These only affect images added afterwards
+  void SetAlgorithm(spitfire::math::PACKING_ALGORITHM algorithm);
+  void SetPadding(size_t nPaddingPixels, bool bExtrudeEdges);
+
   bool AddImage(const std::string& textureFilePath);
   bool AddImageResizeNearestNeighbour(const std::string& textureFilePath, size_t cellWidthAndHeight);
 
-  size_t GetWidth() const { return textureAtlas.GetWidth(); }
-  size_t GetHeight() const { return textureAtlas.GetHeight(); }
+  // Packs the images largest first which fills the pages much better than adding them one at a time.
+  // Images with the wrong pixel format or that are too large for a page are skipped, the entries for the rest are added in the same order as the images.
+  // outIsAdded[i] is true if images[i] was added, returns false if any of the images were skipped.
+  bool AddImages(const std::vector<const voodoo::cImage*>& images, std::vector<bool>& outIsAdded);
+  bool AddImages(const std::vector<const voodoo::cImage*>& images) { std::vector<bool> isAdded; return AddImages(images, isAdded); }
+
+  size_t GetWidth() const { return width; }
+  size_t GetHeight() const { return height; }
 
-  const voodoo::cImage& GetImage() const { return textureAtlas; }
+  size_t GetPageCount() const { return pages.size(); }
+  const voodoo::cImage& GetImage() const { return GetPageImage(0); }
+  const voodoo::cImage& GetPageImage(size_t page) const { return pages[page]; }
+
+  // The fraction of the pages covered by images, including their padding
+  float GetOccupancy() const;
 
   const std::vector<cTextureAtlasEntry>& GetTextureAtlasEntries() const { return textureAtlasEntries; }
 
 private:
-  bool AddImageInternal(const std::string& textureFilePath, const voodoo::cImage& image);
+  bool AddImageInternal(const voodoo::cImage& image);
 
-  voodoo::cImage textureAtlas;
+  bool IsImageValidForAtlas(const voodoo::cImage& image) const;
+  void AddPage();
+  void CopyImageToPage(const voodoo::cImage& image, const cTextureAtlasEntry& entry);
 
-  std::vector<cTextureAtlasEntry> textureAtlasEntries;
+  size_t width;
+  size_t height;
+  voodoo::PIXELFORMAT pixelFormat;
+  spitfire::math::PACKING_ALGORITHM algorithm;
+  size_t nPaddingPixels;
+  bool bExtrudeEdges;
 
-  size_t currentX;
-  size_t currentY;
-  size_t currentTallestInRow;
+  std::vector<voodoo::cImage> pages;
+  std::vector<spitfire::math::cRectanglePacker> packers;
+
+  std::vector<cTextureAtlasEntry> textureAtlasEntries;
 };
 
 }
@@ -1,14 +1,99 @@
 #pragma once
 
 // Standard headers
+#include <functional>
 #include <string>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/file.h>
 
 // libvoodoomm headers
 #include <libvoodoomm/cImage.h>
 
+// Radiance HDR (.hdr, RGBE) images
+//
+// The decoder memory maps the file and finds where each scanline starts up front, then the scanlines are decoded and converted to floats in
+// parallel blocks of rows.  DecodeRows hands the image over a block at a time so that huge images can be processed without holding all of it.
+//
+// voodoo::cHDRDecoder decoder;
+// if (decoder.Open("probe.hdr")) {
+//   decoder.DecodeRows(64, [&](size_t y, size_t nRows, const float* pRGB) {
+//     ...
+//     return true;
+//   });
+// }
+
 namespace voodoo
 {
 
+// ** cHDRDecoder
+
+class cHDRDecoder
+{
+public:
+  // Return false to stop decoding
+  typedef std::function<bool(size_t y, size_t nRows, const float* pRGB)> RowsCallback;
+
+  cHDRDecoder();
+
+  bool Open(const std::string& sFilePath);
+  bool OpenFromMemory(const uint8_t* pData, size_t nSizeBytes); // The data must outlive the decoder
+  void Close();
+
+  bool IsOpen() const { return (width != 0); }
+
+  size_t GetWidth() const { return width; }
+  size_t GetHeight() const { return height; }
+
+  // The rows are top to bottom, 3 floats per pixel
+  bool DecodeRGB32F(float* pRGB) const;
+  bool DecodeRows(size_t nRowsPerBlock, const RowsCallback& onRows) const;
+
+private:
+  bool ReadHeader();
+  bool FindScanlines();
+
+  void DecodeRowsRGB32F(size_t first, size_t last, float* pRGB) const;
+
+  spitfire::storage::cMemoryMappedFile file;
+  const uint8_t* pData;
+  size_t nSizeBytes;
+
+  size_t width;
+  size_t height;
+  bool bIsBottomToTop;
+
+  std::vector<size_t> scanlineOffsets; // One more than the height so that each scanline ends where the next one starts
+};
+
+// Writes run length encoded scanlines, pRGB is 3 floats per pixel, top to bottom
+bool SaveHDR(const std::string& sFilePath, const float* pRGB, size_t width, size_t height);
+
 bool LoadHDR(const std::string& sFilePath, cImage& outImage);
+bool SaveHDR(const std::string& sFilePath, const cImage& image);
+
+
+// ** Inlines
+
+// These are inline so that the decoder and encoder can be used without linking cImage and SDL3_image
+
+inline bool LoadHDR(const std::string& sFilePath, cImage& outImage)
+{
+  cHDRDecoder decoder;
+  if (!decoder.Open(sFilePath)) return false;
+
+  if (!outImage.CreateEmptyImage(decoder.GetWidth(), decoder.GetHeight(), PIXELFORMAT::RGB32F)) return false;
+
+  return decoder.DecodeRGB32F(reinterpret_cast<float*>(outImage.GetPointerToBuffer()));
+}
+
+inline bool SaveHDR(const std::string& sFilePath, const cImage& image)
+{
+  if (image.GetPixelFormat() != PIXELFORMAT::RGB32F) return false;
+
+  return SaveHDR(sFilePath, reinterpret_cast<const float*>(image.GetPointerToBuffer()), image.GetWidth(), image.GetHeight());
+}
 
 }
@@ -0,0 +1,46 @@
+#pragma once
+
+// Standard headers
+#include <cstdint>
+#include <string>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// libvoodoomm headers
+#include <libvoodoomm/libvoodoomm.h>
+
+// Image processing kernels used by cImage
+//
+// These work on tightly packed images with one byte per channel and 1 (H8), 3 (R8G8B8) or 4 (R8G8B8A8) channels.  Rows
+// are processed in parallel on spitfire::util::GetDefaultThreadPool() and the inner loops use SSE2 where it is available.
+
+namespace voodoo
+{
+  namespace kernels
+  {
+    // Inverts each channel, alpha is left alone
+    void ConvertToNegative(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels);
+
+    // Sets each colour channel to the luminance of the pixel, alpha is left alone
+    void ConvertToGreyScale(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels);
+
+    // Swaps the rows of any image
+    void FlipVertically(uint8_t* pBuffer, size_t nBytesPerRow, size_t height);
+
+    // Copies the source image into the destination with its top left corner at x, y, then copies its edge pixels outwards into
+    // the nExtrudePixels around it, which have to be inside the destination.  Only whole pixels are copied so any pixel format works.
+    void CopyAndExtrudeEdges(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nBytesPerPixel, uint8_t* pDestination, size_t widthDestination, size_t heightDestination, size_t x, size_t y, size_t nExtrudePixels);
+
+    // Averages each 2x2 block of pixels, the destination is max(1, width / 2) x max(1, height / 2)
+    void HalfSize(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination);
+
+    void ResizeNearestNeighbour(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination, size_t widthDestination, size_t heightDestination);
+
+    // Separable resampling, the filter is widened when shrinking so that every source pixel contributes
+    void Resize(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination, size_t widthDestination, size_t heightDestination, RESIZE_FILTER filter);
+
+    // Each iteration sets each pixel to the average of the 4 pixels above, below, left and right of it, pixels off the edge of the image are replaced by the centre pixel
+    void Smooth(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels, size_t iterations);
+  }
+}
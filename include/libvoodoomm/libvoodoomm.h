@@ -57,6 +57,12 @@ namespace voodoo
     H32  // float heightmap, single float 32 bit channel
   };
 
+  enum class RESIZE_FILTER {
+    BOX,      // Averages the pixels that each destination pixel covers, the same as nearest neighbour when enlarging
+    BILINEAR, // Triangle filter
+    LANCZOS3  // Sharpest, can ring slightly around hard edges
+  };
+
   inline constexpr size_t GetBytesForPixelFormat(PIXELFORMAT pixelFormat)
   {
     if (pixelFormat == PIXELFORMAT::H8) return 1;
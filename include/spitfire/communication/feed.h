@@ -1,9 +1,13 @@
 #ifndef CFEED_H
 #define CFEED_H
 
-#include <spitfire/util/datetime.h>
+// Standard headers
+#include <list>
+#include <string>
 
-#include <breathe/breathe.h>
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/datetime.h>
 
 namespace spitfire
 {
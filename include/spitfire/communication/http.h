@@ -1,6 +1,12 @@
 #pragma once
 
 // Standard headers
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <experimental/net>
 
 // Spitfire headers
@@ -32,11 +38,13 @@ namespace spitfire
       };
 
       class cHTTP;
+      class cConnectionPool;
 
       class cRequest
       {
       public:
         friend class cHTTP;
+        friend class cConnectionPool;
 
         cRequest();
 
@@ -49,9 +57,17 @@ namespace spitfire
         bool IsMethodPost() const { return (method == METHOD::POST); }
         void SetHost(const string_t& _sHost) { sHost = _sHost; }
         const string_t& GetHost() const { return sHost; }
+        void SetPort(port_t _port) { port = _port; }
+        port_t GetPort() const { return port; }
         void SetPath(const string_t& _sPath) { sPath = _sPath; }
         const string_t& GetPath() const { return sPath; }
-        void SetOffsetBytes(size_t _nOffsetBytes) { nOffsetBytes = _nOffsetBytes; }
+        void SetOffsetBytes(size_t _nOffsetBytes); // Request everything from nOffsetBytes onwards, 0 requests the whole content
+        void SetRangeBytes(size_t nFirstByte, size_t nLastByte); // An inclusive range, a nLastByte of std::string::npos means to the end
+        void SetRangeSuffixBytes(size_t nLengthBytes); // Request the last nLengthBytes
+        bool HasRange() const { return bHasRange; }
+        bool GetRangeBytes(size_t nSizeBytes, size_t& nFirstByte, size_t& nLastByte) const; // Resolves the range for content of nSizeBytes, returns false if it is not satisfiable
+
+        std::string GetIfNoneMatch() const;
 
         std::string GetAccept() const;
         std::string GetContentType() const;
@@ -82,8 +98,12 @@ namespace spitfire
 
         METHOD method;
         string_t sHost;
+        port_t port;
         string_t sPath;
+        bool bHasRange;
+        bool bIsRangeSuffix; // If true then nOffsetBytes is the length of the suffix
         size_t nOffsetBytes;
+        size_t nRangeLastByte;
         std::map<std::string, std::string> mOtherHeaders;
         std::map<std::string, std::string> mVariables;
         std::map<std::string, std::string> mFormData;
@@ -177,6 +197,11 @@ namespace spitfire
         void SetCacheControlPublic();
         void SetConnectionClose();
         void SetConnectionKeepAlive();
+        bool IsConnectionKeepAlive() const;
+        void SetETag(const std::string& sETag);
+        void SetAcceptRangesBytes();
+        void SetContentRangeBytes(size_t nFirstByte, size_t nLastByte, size_t nSizeBytes);
+        void SetContentRangeNotSatisfiable(size_t nSizeBytes);
 
         std::string ToString() const;
 
@@ -202,29 +227,129 @@ namespace spitfire
         EXPIRES expires;
         CACHE_CONTROL cacheControl;
         bool bConnectionKeepAlive;
+        std::string sETag;
+        bool bAcceptRangesBytes;
+        std::string sContentRange;
+      };
+
+
+      #ifdef __LINUX__
+      // ** cCachedFile
+      //
+      // An open file and the parts of the response that stay the same until the file changes
+
+      class cCachedFile
+      {
+      public:
+        string_t sFilePath;
+        std::shared_ptr<const spitfire::network::cOpenFile> pFile;
+        std::string sETag;
+        cResponse response; // The length, mime type, ETag and cache control are already filled in
+      };
+
+
+      // ** cOpenFileCache
+      //
+      // A thread safe LRU cache of open files.  Each lookup stats the file and reopens it if the size or modified time has
+      // changed, so serving a cached file costs one stat instead of an open, a read loop and a close.
+
+      class cOpenFileCache
+      {
+      public:
+        explicit cOpenFileCache(size_t nMaxFiles = 256);
+
+        std::shared_ptr<const cCachedFile> GetFile(const string_t& sFilePath); // Returns nullptr if the path is not a regular file
+
+        size_t GetFileCount() const;
+        void Clear();
+
+      private:
+        cOpenFileCache(const cOpenFileCache&) = delete;
+        cOpenFileCache& operator=(const cOpenFileCache&) = delete;
+
+        void Remove(const string_t& sFilePath);
+
+        const size_t nMaxFiles;
+
+        mutable std::mutex mutex;
+        std::list<std::shared_ptr<const cCachedFile>> files; // Most recently used first
+        std::map<string_t, std::list<std::shared_ptr<const cCachedFile>>::iterator> lookup;
       };
 
+      // The cache used by cServerUtil unless it is given another one
+      cOpenFileCache& GetDefaultOpenFileCache();
+      #endif // __LINUX__
+
 
       class cServerUtil
       {
       public:
+        #ifdef __LINUX__
+        cServerUtil();
+        explicit cServerUtil(cOpenFileCache& openFileCache);
+        #endif
+
         bool IsFileInWebDirectory(const std::string sRelativeFilePath) const;
 
-        void SendResponse(spitfire::network::cConnectedClient& connection, const cResponse& response) const;
-        void SendContent(spitfire::network::cConnectedClient& connection, const std::string& sContentUTF8) const;
+        void SendResponse(spitfire::network::cClientConnection& connection, const cResponse& response) const;
+        void SendContent(spitfire::network::cClientConnection& connection, const std::string& sContentUTF8) const;
 
-        void ServeError404(spitfire::network::cConnectedClient& connection, const cRequest& request) const;
-        void ServeError(spitfire::network::cConnectedClient& connection, const cRequest& request, STATUS status) const;
-        void ServePage(spitfire::network::cConnectedClient& connection, const cRequest& request, const string_t& sMimeTypeUTF8, const string_t& sPageContentUTF8) const;
-        void ServeFile(spitfire::network::cConnectedClient& connection, const cRequest& request, const string_t& sMimeTypeUTF8, const string_t& sRelativeFilePath) const;
-        void ServeFile(spitfire::network::cConnectedClient& connection, const cRequest& request) const;
-        void ServeFileWithResolvedFilePath(spitfire::network::cConnectedClient& connection, const cRequest& request, const string_t& sFilePath) const;
+        void ServeError404(spitfire::network::cClientConnection& connection, const cRequest& request) const;
+        void ServeError(spitfire::network::cClientConnection& connection, const cRequest& request, STATUS status) const;
+        void ServePage(spitfire::network::cClientConnection& connection, const cRequest& request, const string_t& sMimeTypeUTF8, const string_t& sPageContentUTF8) const;
+        void ServeFile(spitfire::network::cClientConnection& connection, const cRequest& request, const string_t& sMimeTypeUTF8, const string_t& sRelativeFilePath) const;
+        void ServeFile(spitfire::network::cClientConnection& connection, const cRequest& request) const;
+        void ServeFileWithResolvedFilePath(spitfire::network::cClientConnection& connection, const cRequest& request, const string_t& sFilePath) const;
 
       private:
         bool GetLocalFilePathInWebDirectory(std::string& sRelativeLocalFilePath, const std::string sRelativeFilePath) const;
+
+        #ifdef __LINUX__
+        // Sends the headers and then the body straight from the file with cClientConnection::SendFile, handling ETags and ranges
+        void ServeOpenFile(spitfire::network::cClientConnection& connection, const cRequest& request, const string_t& sFilePath, const std::string& sMimeTypeUTF8) const;
+
+        cOpenFileCache* pOpenFileCache;
+        #endif
       };
 
 
+      // Returns the length of the first request in sData including any content, or 0 if the request has not been completely received yet
+      size_t GetCompleteRequestLength(const std::string& sData);
+
+
+      // ** cServerRequestHandler
+      //
+      // Handles one complete request at a time, typically by calling one of the cServerUtil Serve functions
+
+      class cServerRequestHandler
+      {
+      public:
+        virtual ~cServerRequestHandler() {}
+
+        virtual void HandleRequest(spitfire::network::cClientConnection& connection, const cRequest& request) = 0;
+      };
+
+
+      #ifdef __LINUX__
+      // ** cEventLoopServerConnectionHandler
+      //
+      // Splits the data received by a cEventLoopServer into requests and passes each one to a cServerRequestHandler
+      // Connections are kept open between requests unless the request asked for "Connection: Close" or the response said it, which
+      // includes every error response
+
+      class cEventLoopServerConnectionHandler : public spitfire::network::cEventLoopConnectionHandler
+      {
+      public:
+        explicit cEventLoopServerConnectionHandler(cServerRequestHandler& requestHandler);
+
+        virtual void OnDataReceived(spitfire::network::cEventLoopServer& server, spitfire::network::cEventLoopConnection& connection) override;
+
+      private:
+        cServerRequestHandler& requestHandler;
+      };
+      #endif // __LINUX__
+
+
 
 
 
@@ -312,14 +437,91 @@ namespace spitfire
         mutable uint32_t progress;
       };
 
+
+      // ** cConnectionPool
+      //
+      // Sends requests over keep alive connections that stay open between requests, with a small set of idle connections
+      // kept for each host and port.  Requests to the same host can be pipelined, written back to back on one connection
+      // and the responses read in order, which hides the round trip for lots of small requests.  The number of requests in
+      // flight across all hosts and all of the threads using the pool is bounded.
+      //
+      // Requests are plain HTTP, GET or url encoded POST, POST requests are never pipelined.  If a reused connection turns
+      // out to have been closed by the server before any of the response arrived a GET request is retried once, a POST is never
+      // retried because the server may have already acted on it.  A server that stops sending for longer than the timeout fails
+      // the request rather than returning a truncated response.
+      //
+      // Usage:
+      // spitfire::network::http::cRequest request;
+      // request.SetHost("www.example.com");
+      // request.SetPath("/feed.xml");
+      // spitfire::network::http::GetDefaultConnectionPool().SendRequest(request, listener);
+
+      class cConnectionPool
+      {
+      public:
+        explicit cConnectionPool(size_t nMaxIdleConnectionsPerHost = 4, size_t nMaxRequestsInFlight = 16);
+        ~cConnectionPool();
+
+        void SetPipelining(bool bEnabled, size_t nMaxPipelineDepth = 8);
+        void SetTimeoutMS(timeoutms_t _timeoutMS) { timeoutMS = _timeoutMS; }
+
+        STATUS SendRequest(const cRequest& request, cRequestListener& listener); // Blocks until the response has arrived, returns STATUS::UNKNOWN if it failed
+
+        // Sends a batch of requests, the responses are delivered to listeners[i] in order for each host
+        void SendRequests(const std::vector<cRequest>& requests, const std::vector<cRequestListener*>& listeners, std::vector<STATUS>& outStatuses);
+
+        void CloseIdleConnections();
+
+        size_t GetIdleConnectionCount() const;
+        size_t GetConnectionsOpenedCount() const { return nConnectionsOpened.load(); } // How many connections have been opened since the pool was created
+
+      private:
+        class cPooledConnection;
+
+        cConnectionPool(const cConnectionPool&) = delete;
+        cConnectionPool& operator=(const cConnectionPool&) = delete;
+
+        void SendRequestsToHost(const std::vector<cRequest>& requests, const std::vector<cRequestListener*>& listeners, const std::vector<size_t>& indices, std::vector<STATUS>& outStatuses);
+
+        static std::string CreateRequestData(const cRequest& request); // The header and any content
+
+        std::unique_ptr<cPooledConnection> GetConnection(const cRequest& request, bool& bIsReused);
+        void ReturnConnection(std::unique_ptr<cPooledConnection> pConnection);
+
+        void AcquireRequestsInFlight(size_t nRequests);
+        void ReleaseRequestsInFlight(size_t nRequests);
+
+        const size_t nMaxIdleConnectionsPerHost;
+        const size_t nMaxRequestsInFlight;
+        bool bIsPipelining;
+        size_t nMaxPipelineDepth;
+        timeoutms_t timeoutMS;
+
+        mutable std::mutex mutexIdle;
+        std::map<std::string, std::vector<std::unique_ptr<cPooledConnection>>> idle; // Idle connections for each "host:port", most recently used last
+
+        std::mutex mutexInFlight;
+        std::condition_variable conditionInFlight;
+        size_t nRequestsInFlight;
+
+        std::atomic<size_t> nConnectionsOpened;
+      };
+
+      // A pool shared by the whole application
+      cConnectionPool& GetDefaultConnectionPool();
+
       // ** Inlines
 
       // ** cRequest
 
       inline cRequest::cRequest() :
         method(METHOD::GET),
+        port(80),
         sPath(TEXT("/")),
-        nOffsetBytes(0)
+        bHasRange(false),
+        bIsRangeSuffix(false),
+        nOffsetBytes(0),
+        nRangeLastByte(std::string::npos)
       {
         SetConnectionClose();
       }
@@ -328,8 +530,12 @@ namespace spitfire
       {
         method = METHOD::GET;
         sHost.clear();
+        port = 80;
         sPath.clear();
+        bHasRange = false;
+        bIsRangeSuffix = false;
         nOffsetBytes = 0;
+        nRangeLastByte = std::string::npos;
         mOtherHeaders.clear();
         mFormData.clear();
 
@@ -338,6 +544,31 @@ namespace spitfire
       }
 
 
+      inline void cRequest::SetOffsetBytes(size_t _nOffsetBytes)
+      {
+        bHasRange = (_nOffsetBytes != 0);
+        bIsRangeSuffix = false;
+        nOffsetBytes = _nOffsetBytes;
+        nRangeLastByte = std::string::npos;
+      }
+
+      inline void cRequest::SetRangeBytes(size_t nFirstByte, size_t nLastByte)
+      {
+        bHasRange = true;
+        bIsRangeSuffix = false;
+        nOffsetBytes = nFirstByte;
+        nRangeLastByte = nLastByte;
+      }
+
+      inline void cRequest::SetRangeSuffixBytes(size_t nLengthBytes)
+      {
+        bHasRange = true;
+        bIsRangeSuffix = true;
+        nOffsetBytes = nLengthBytes;
+        nRangeLastByte = std::string::npos;
+      }
+
+
       // ** cHTTP
 
       inline cHTTP::cHTTP() :
@@ -1,8 +1,14 @@
 #pragma once
 
 // Standard headers
+#include <atomic>
+#include <deque>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <vector>
 #include <experimental/net>
 
 // Spitfire headers
@@ -104,11 +110,14 @@ namespace spitfire
 
       size_t GetBytesToRead();
 
-      size_t Read(void* buffer, size_t len, timeoutms_t timeoutMS);
+      size_t Read(void* buffer, size_t len, timeoutms_t timeoutMS); // Returns 0 if the peer closed the connection or the read timed out, use IsTimedOut to tell them apart
       size_t Write(const void* buffer, size_t len);
 
+      bool IsTimedOut() const { return bIsTimedOut; } // Returns true if the last Read timed out waiting for data, the connection is still open
+
     private:
       bool bIsOpen;
+      bool bIsTimedOut;
       std::experimental::net::io_context io_context;
       std::experimental::net::ip::tcp::socket socket;
     };
@@ -119,22 +128,79 @@ namespace spitfire
 
     class cServer;
 
+    #ifdef __LINUX__
+    // ** cOpenFile
+    //
+    // A read only file descriptor that a connection can send straight from the page cache without copying it through
+    // user space.  It is shared so that a file can stay open while it is queued on a connection even if it is evicted
+    // from a cache in the meantime.
+
+    class cOpenFile
+    {
+    public:
+      static std::shared_ptr<cOpenFile> Open(const string_t& sFilePath); // Returns nullptr if the path is not a regular file
+      ~cOpenFile();
+
+      int GetFD() const { return fd; }
+      uint64_t GetSizeBytes() const { return nSizeBytes; }
+      int64_t GetModifiedTimeNS() const { return modifiedTimeNS; }
+
+    private:
+      cOpenFile(int fd, uint64_t nSizeBytes, int64_t modifiedTimeNS);
+
+      cOpenFile(const cOpenFile&) = delete;
+      cOpenFile& operator=(const cOpenFile&) = delete;
+
+      const int fd;
+      const uint64_t nSizeBytes;
+      const int64_t modifiedTimeNS;
+    };
+    #endif // __LINUX__
+
+    // ** cClientConnection
+    //
+    // The parts of a connected client that a protocol handler needs to send a response, implemented by both cConnectedClient and cEventLoopConnection
+
+    class cClientConnection
+    {
+    public:
+      virtual ~cClientConnection() {}
+
+      virtual void Close() = 0;
+
+      virtual bool IsOpen() = 0;
+
+      virtual void SetNoDelay() = 0; // Set no delay so that we don't buffer our data before sending (This should only be required for EventSources)
+
+      virtual void Write(const uint8_t* pBuffer, size_t nBufferSize) = 0;
+      virtual void Write(const std::string& sData) = 0;
+
+      // Called when a response says "Connection: Close", connections that are kept open between requests close once the request has been handled
+      virtual void SetCloseAfterResponse() {}
+
+      #ifdef __LINUX__
+      // Sends nLengthBytes of file starting at nOffsetBytes, the default implementation reads the file into a buffer and calls Write
+      virtual void SendFile(std::shared_ptr<const cOpenFile> pFile, uint64_t nOffsetBytes, uint64_t nLengthBytes);
+      #endif
+    };
+
+
     // ** cConnectedClient
     //
     // A connected client on a server
 
-    class cConnectedClient : public spitfire::util::cThread
+    class cConnectedClient : public spitfire::util::cThread, public cClientConnection
     {
     public:
       explicit cConnectedClient(std::experimental::net::io_context& socket);
 
       void Start(cServer& server);
 
-      void Close();
+      virtual void Close() override;
 
-      bool IsOpen();
+      virtual bool IsOpen() override;
 
-      void SetNoDelay(); // Set no delay so that we don't buffer our data before sending (This should only be required for EventSources)
+      virtual void SetNoDelay() override;
 
       size_t GetBytesToRead();
 
@@ -150,8 +216,12 @@ namespace spitfire
 
       size_t Read(uint8_t* pBuffer, size_t nBufferSize);
 
-      void Write(const uint8_t* pBuffer, size_t nBufferSize);
-      void Write(const std::string& sData);
+      virtual void Write(const uint8_t* pBuffer, size_t nBufferSize) override;
+      virtual void Write(const std::string& sData) override;
+
+      #ifdef __LINUX__
+      virtual void SendFile(std::shared_ptr<const cOpenFile> pFile, uint64_t nOffsetBytes, uint64_t nLengthBytes) override; // Uses sendfile on the blocking socket
+      #endif
 
     private:
       virtual void ThreadFunction() override;
@@ -261,5 +331,126 @@ namespace spitfire
 
       cServerConnectionHandler* pConnectionHandler; // For calling back into the application, every connection is sent here
     };
+
+
+    #ifdef __LINUX__
+    // ** Event loop server
+    //
+    // An alternative to cServer for lots of long lived connections.  Instead of a thread per connection a small number of
+    // reactor threads each wait on an epoll set of non-blocking sockets and call back into the application when data arrives.
+    // Every reactor has its own listening socket bound with SO_REUSEPORT so the kernel spreads new connections between them.
+    //
+    // Callbacks run on the reactor threads so they should not block, slow work can be handed to a cThreadPool and the
+    // response written later because cEventLoopConnection::Write and Close can be called from any thread.
+
+    class cEventLoopServer;
+    class cEventLoopReactor;
+
+    // ** cEventLoopConnection
+
+    class cEventLoopConnection : public cClientConnection, public std::enable_shared_from_this<cEventLoopConnection>
+    {
+    public:
+      friend class cEventLoopReactor;
+
+      cEventLoopConnection(std::weak_ptr<cEventLoopReactor> pReactor, int fd);
+      ~cEventLoopConnection();
+
+      virtual void Close() override; // Closes the connection once everything that has been written has been sent
+
+      virtual bool IsOpen() override;
+
+      virtual void SetNoDelay() override;
+
+      // Appends to the send buffer, the reactor sends it as soon as the socket is writable
+      virtual void Write(const uint8_t* pBuffer, size_t nBufferSize) override;
+      virtual void Write(const std::string& sData) override;
+
+      // Queues the file after anything already written, the reactor sends it with sendfile as the socket becomes writable
+      virtual void SendFile(std::shared_ptr<const cOpenFile> pFile, uint64_t nOffsetBytes, uint64_t nLengthBytes) override;
+
+      // A response has said "Connection: Close", the connection is closed once the cEventLoopConnectionHandler callback returns
+      // A handler that responds later from another thread has to call Close itself once it has written the content
+      virtual void SetCloseAfterResponse() override;
+      bool IsCloseAfterResponse() const { return bIsCloseAfterResponse; }
+
+      // The data received so far that has not been consumed yet, only valid from inside a cEventLoopConnectionHandler callback
+      const std::string& GetReceivedData() const { return sReceived; }
+      void ConsumeReceivedData(size_t nBytes);
+
+    private:
+      cEventLoopConnection(const cEventLoopConnection&) = delete;
+      cEventLoopConnection& operator=(const cEventLoopConnection&) = delete;
+
+      void RequestFlush();
+
+      std::weak_ptr<cEventLoopReactor> pReactor; // The reactor can go away first if the server is stopped while someone else still holds the connection
+      const int fd;
+
+      std::string sReceived;
+
+      // Either a block of data or a range of a file waiting to be sent
+      struct cSendChunk
+      {
+        std::string sData;
+        std::shared_ptr<const cOpenFile> pFile;
+        uint64_t nOffsetBytes; // How far through sData or the file we have sent
+        uint64_t nEndBytes; // Only used for files
+      };
+
+      std::mutex mutexSend;
+      std::deque<cSendChunk> sendQueue;
+      bool bIsWaitingForWritable;
+
+      std::atomic<bool> bIsCloseRequested;
+      std::atomic<bool> bIsClosed;
+      std::atomic<bool> bIsCloseAfterResponse;
+    };
+
+
+    // ** cEventLoopConnectionHandler
+    //
+    // Called from the reactor threads
+
+    class cEventLoopConnectionHandler
+    {
+    public:
+      virtual ~cEventLoopConnectionHandler() {}
+
+      virtual void OnConnected(cEventLoopServer& server, cEventLoopConnection& connection) {}
+      virtual void OnDataReceived(cEventLoopServer& server, cEventLoopConnection& connection) = 0;
+      virtual void OnDisconnected(cEventLoopServer& server, cEventLoopConnection& connection) {}
+    };
+
+
+    // ** cEventLoopServer
+
+    class cEventLoopServer
+    {
+    public:
+      friend class cEventLoopReactor;
+
+      cEventLoopServer();
+      ~cEventLoopServer();
+
+      void SetConnectionHandler(cEventLoopConnectionHandler& connectionHandler);
+
+      bool Start(uint16_t uiPort, size_t nReactors = 0); // A port of 0 picks any free port, nReactors defaults to GetRecommendedConcurrentThreadCount()
+      void Stop();
+
+      uint16_t GetPort() const { return uiPort; } // The port that we are actually listening on
+      size_t GetConnectionCount() const { return nConnections.load(); }
+
+    private:
+      cEventLoopServer(const cEventLoopServer&) = delete;
+      cEventLoopServer& operator=(const cEventLoopServer&) = delete;
+
+      uint16_t uiPort;
+      std::vector<std::shared_ptr<cEventLoopReactor>> reactors;
+      std::atomic<size_t> nConnections;
+
+      cEventLoopConnectionHandler* pConnectionHandler;
+    };
+    #endif // __LINUX__
   }
 }
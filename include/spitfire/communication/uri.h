@@ -1,7 +1,9 @@
 #ifndef CURI_H
 #define CURI_H
 
+#include <cstdlib>
 #include <map>
+#include <string>
 
 #include <spitfire/util/string.h>
 
@@ -149,6 +151,13 @@ namespace spitfire
 
       server = string::StripAfterInclusive(sRemaining, "/");
 
+      // "host:8080"
+      const size_t nColon = server.find(':');
+      if (nColon != std::string::npos) {
+        port = port_t(atoi(server.c_str() + nColon + 1));
+        server.erase(nColon);
+      }
+
       sRemaining = string::StripBeforeInclusive(sRemaining, "/");
 
       // We want a relativePath in the form "", "folder/" or "folder/file.txt"
@@ -205,7 +214,7 @@ namespace spitfire
 
       // If this is not the default port then we want to add ":80" after a http server for example
       port_t port = GetPort();
-      if (port != GetPortFromProtocol(protocol)) full_uri += ":" + port;
+      if (port != GetPortFromProtocol(protocol)) full_uri += ":" + std::to_string(port);
 
       full_uri += "/" + GetRelativePath();
 
@@ -0,0 +1,104 @@
+#ifndef CDYNAMICAABBTREE_H
+#define CDYNAMICAABBTREE_H
+
+// Standard headers
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/math/cVec3.h>
+#include <spitfire/math/cMat4.h>
+#include <spitfire/math/geometry.h>
+#include <spitfire/math/cFrustumCuller.h>
+
+// A bounding volume hierarchy that is updated incrementally as objects move, the same approach as b2DynamicTree in Box2D.
+// Each proxy is stored with a fat box, grown by a margin, so small movements don't change the tree at all.  Leaves are inserted
+// next to the sibling that grows the surface area the least and the tree is kept balanced with AVL style rotations.
+//
+// Culling walks the tree testing each internal node against the planes that its parent still crosses, nodes that are entirely
+// inside the frustum add their whole subtree without any more tests, and leaves are tested in batches with cFrustumCuller::CullAABBs.
+//
+// Usage:
+// spitfire::math::cDynamicAABBTree tree;
+// const size_t proxy = tree.CreateProxy(box, pObject);
+// ...
+// tree.MoveProxy(proxy, newBox);
+// ...
+// std::vector<void*> visible;
+// tree.Cull(culler, visible);
+
+namespace spitfire
+{
+  namespace math
+  {
+    class cDynamicAABBTree
+    {
+    public:
+      static const size_t NULL_PROXY = size_t(-1);
+
+      cDynamicAABBTree();
+
+      cDynamicAABBTree(const cDynamicAABBTree&) = delete;
+      cDynamicAABBTree& operator=(const cDynamicAABBTree&) = delete;
+
+      void Clear();
+
+      // How much each box is grown by when it is inserted
+      void SetMargin(float _fMargin) { ASSERT(_fMargin >= 0.0f); fMargin = _fMargin; }
+
+      size_t CreateProxy(const cAABB3& box, void* pUserData);
+      void DestroyProxy(size_t proxy);
+
+      // Returns true if the proxy had to be reinserted because the box has left its fat box
+      bool MoveProxy(size_t proxy, const cAABB3& box);
+
+      void* GetUserData(size_t proxy) const;
+      const cAABB3& GetFatAABB(size_t proxy) const;
+
+      size_t GetProxyCount() const { return nProxies; }
+      size_t GetHeight() const;
+
+      // Appends the user data of every proxy with a fat box that is at least partly inside the frustum
+      void Cull(const cFrustumCuller& culler, std::vector<void*>& visible) const;
+
+      // Checks the links, heights and boxes of every node, for testing
+      bool IsValid() const;
+
+    private:
+      class cNode
+      {
+      public:
+        bool IsLeaf() const { return (child1 == NULL_PROXY); }
+
+        cAABB3 box;
+        void* pUserData;
+        size_t parent; // The next free node when this node is on the free list
+        size_t child1;
+        size_t child2;
+        int height; // 0 for a leaf, -1 when free
+      };
+
+      size_t AllocateNode();
+      void FreeNode(size_t node);
+
+      void InsertLeaf(size_t leaf);
+      void RemoveLeaf(size_t leaf);
+      size_t Balance(size_t node);
+
+      void AddSubtree(size_t node, std::vector<void*>& visible) const;
+      bool IsValid(size_t node, size_t& nLeaves) const;
+
+      std::vector<cNode> nodes;
+      size_t root;
+      size_t freeList;
+      size_t nProxies;
+      float fMargin;
+    };
+
+    // The box around a local box after it has been rotated and translated by matrix, for moving the proxy of an object
+    cAABB3 GetTransformedAABB(const cAABB3& box, const cMat4& matrix);
+  }
+}
+
+#endif // CDYNAMICAABBTREE_H
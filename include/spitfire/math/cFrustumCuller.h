@@ -0,0 +1,67 @@
+#ifndef CFRUSTUMCULLER_H
+#define CFRUSTUMCULLER_H
+
+// Standard headers
+#include <cstdint>
+
+// Spitfire headers
+#include <spitfire/math/cMat4.h>
+#include <spitfire/math/cVec3.h>
+#include <spitfire/math/geometry.h>
+
+// Frustum tests for culling large numbers of bounding volumes without an OpenGL context
+//
+// The planes are stored as a structure of arrays padded to 8 planes, so one box is tested against 4 planes per SSE instruction,
+// and the batch functions test 4 (SSE2) or 8 (AVX) spheres or boxes per instruction.  Without SSE2 everything falls back to scalar code.
+//
+// Usage:
+// spitfire::math::cFrustumCuller culler;
+// culler.SetFromViewProjectionMatrix(matProjection * matView);
+// if (culler.IsSphereVisible(position, fRadius)) ...
+
+namespace spitfire
+{
+  namespace math
+  {
+    enum class FRUSTUM_CLASSIFICATION {
+      OUTSIDE,
+      INTERSECTS,
+      INSIDE
+    };
+
+    // One bit per plane, left, right, bottom, top, near, far
+    const uint32_t FRUSTUM_PLANES_ALL = 0x3F;
+
+    class cFrustumCuller
+    {
+    public:
+      cFrustumCuller();
+
+      // The planes are extracted from projection * view (Gribb and Hartmann), they face inwards
+      void SetFromViewProjectionMatrix(const cMat4& matViewProjection);
+
+      // Only the planes in planeMask are tested, the planes that the box still crosses are returned in outPlaneMask
+      // When walking a hierarchy pass outPlaneMask to the children, a child can't cross a plane that its parent is inside of
+      FRUSTUM_CLASSIFICATION ClassifyAABB(const cAABB3& box, uint32_t planeMask, uint32_t& outPlaneMask) const;
+
+      bool IsAABBVisible(const cAABB3& box) const;
+      bool IsSphereVisible(const cVec3& position, float fRadius) const;
+
+      // Structure of arrays batch tests, pVisible[i] is set to 1 if the volume is at least partly inside and 0 otherwise
+      void CullSpheres(const float* pX, const float* pY, const float* pZ, const float* pRadius, size_t n, uint8_t* pVisible) const;
+      void CullAABBs(const float* pMinX, const float* pMinY, const float* pMinZ, const float* pMaxX, const float* pMaxY, const float* pMaxZ, size_t n, uint8_t* pVisible) const;
+
+    private:
+      static const size_t PLANES = 6;
+      static const size_t PADDED_PLANES = 8;
+
+      // The padding planes accept everything
+      alignas(32) float normalX[PADDED_PLANES];
+      alignas(32) float normalY[PADDED_PLANES];
+      alignas(32) float normalZ[PADDED_PLANES];
+      alignas(32) float intercept[PADDED_PLANES];
+    };
+  }
+}
+
+#endif // CFRUSTUMCULLER_H
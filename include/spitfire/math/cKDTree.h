@@ -0,0 +1,73 @@
+#ifndef CKDTREE_H
+#define CKDTREE_H
+
+// Standard headers
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/math/cVec3.h>
+
+// A static k-d tree for nearest neighbour, k nearest and radius queries over a set of points that doesn't change.
+// The tree is implicit, the points are reordered so that the median of each range is the splitting point of that range and
+// its left and right halves are the children, so there are no nodes to allocate and a search only touches the points array.
+// Each range is split on its widest axis and small ranges are just scanned.
+//
+// Points at the same distance are returned lowest index first, so a nearest neighbour query returns the same point as a linear scan would.
+//
+// Usage:
+// spitfire::math::cKDTree tree;
+// tree.Build(points);
+// const size_t closest = tree.FindNearest(position);
+// tree.FindKNearest(position, 8, closestPoints);
+// tree.FindInRadius(position, 10.0f, pointsInRange);
+
+namespace spitfire
+{
+  namespace math
+  {
+    class cKDTree
+    {
+    public:
+      static constexpr size_t NULL_INDEX = size_t(-1);
+
+      cKDTree();
+
+      void Clear();
+
+      // The indices returned by the queries are indices into points
+      void Build(const std::vector<cVec3>& points);
+      void Build(const cVec3* pPoints, size_t nPoints);
+
+      size_t GetSize() const { return points.size(); }
+      bool IsEmpty() const { return points.empty(); }
+
+      // Returns NULL_INDEX if the tree is empty
+      size_t FindNearest(const cVec3& position) const;
+
+      // The k closest points, closest first
+      void FindKNearest(const cVec3& position, size_t k, std::vector<size_t>& result) const;
+
+      // Every point within fRadius, in no particular order
+      void FindInRadius(const cVec3& position, float fRadius, std::vector<size_t>& result) const;
+
+    private:
+      static constexpr size_t LEAF_SIZE = 8;
+
+      void Build(std::vector<std::pair<cVec3, uint32_t>>& entries, size_t first, size_t last);
+
+      void FindNearest(size_t first, size_t last, const cVec3& position, size_t& nearest, float& fNearestDistanceSquared) const;
+      void FindKNearest(size_t first, size_t last, const cVec3& position, size_t k, std::vector<std::pair<float, size_t>>& heap) const;
+      void FindInRadius(size_t first, size_t last, const cVec3& position, float fRadiusSquared, std::vector<size_t>& result) const;
+
+      std::vector<cVec3> points; // In tree order
+      std::vector<uint32_t> indices; // The original index of each point
+      std::vector<uint8_t> axes; // The axis that each range is split on, stored at the splitting point
+    };
+  }
+}
+
+#endif // CKDTREE_H
@@ -0,0 +1,118 @@
+#pragma once
+
+// Standard headers
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Packs rectangles into fixed size pages, typically images into texture atlases
+//
+// spitfire::math::cRectanglePacker packer;
+// packer.Init(1024, 1024, spitfire::math::PACKING_ALGORITHM::MAX_RECTS);
+// size_t x = 0;
+// size_t y = 0;
+// if (packer.Insert(64, 32, x, y)) ...
+//
+// Or to pack a batch of rectangles, largest first, into as many pages as they need
+//
+// std::vector<spitfire::math::cRectanglePacker> pages;
+// std::vector<spitfire::math::cPackedRectangle> packed;
+// spitfire::math::PackRectangles(1024, 1024, spitfire::math::PACKING_ALGORITHM::MAX_RECTS, sizes, pages, packed);
+
+namespace spitfire
+{
+  namespace math
+  {
+    enum class PACKING_ALGORITHM {
+      SHELF,     // Fills rows left to right and moves down by the tallest rectangle in the row, fast but wastes a lot of space
+      SKYLINE,   // Bottom left placement on a skyline of the top edges of the rectangles so far, fast and packs well
+      MAX_RECTS  // Best short side fit into a list of the maximal free rectangles, slowest but packs the tightest
+    };
+
+    // ** cRectanglePacker
+
+    class cRectanglePacker
+    {
+    public:
+      cRectanglePacker();
+
+      void Init(size_t width, size_t height, PACKING_ALGORITHM algorithm);
+
+      size_t GetWidth() const { return width; }
+      size_t GetHeight() const { return height; }
+      PACKING_ALGORITHM GetAlgorithm() const { return algorithm; }
+
+      size_t GetRectangleCount() const { return nRectangles; }
+      size_t GetUsedArea() const { return nUsedArea; }
+      float GetOccupancy() const;
+
+      // Returns false if there is no room left for the rectangle
+      bool Insert(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY);
+
+    private:
+      struct cRect {
+        size_t x;
+        size_t y;
+        size_t width;
+        size_t height;
+      };
+
+      struct cSkylineNode {
+        size_t x;
+        size_t y;
+        size_t width;
+      };
+
+      bool InsertShelf(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY);
+
+      bool InsertSkyline(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY);
+      bool SkylineRectangleFits(size_t index, size_t rectangleWidth, size_t rectangleHeight, size_t& outY) const;
+      void SkylineAddLevel(size_t index, const cRect& rect);
+
+      bool InsertMaxRects(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY);
+      void MaxRectsSplitFreeRectangle(const cRect& freeRectangle, const cRect& used);
+      void MaxRectsAddNewFreeRectangle(const cRect& rect);
+
+      size_t width;
+      size_t height;
+      PACKING_ALGORITHM algorithm;
+
+      size_t nRectangles;
+      size_t nUsedArea;
+
+      // Shelf
+      size_t currentX;
+      size_t currentY;
+      size_t currentTallestInRow;
+
+      // Skyline
+      std::vector<cSkylineNode> skyline;
+
+      // Max rects
+      std::vector<cRect> freeRectangles;
+      std::vector<cRect> newFreeRectangles;
+      size_t nMaxFreeWidth; // The largest free rectangles could be different rectangles so this is only good for ruling out a rectangle
+      size_t nMaxFreeHeight;
+    };
+
+
+    // ** PackRectangles
+
+    const size_t INVALID_PAGE = size_t(-1);
+
+    class cPackedRectangle
+    {
+    public:
+      cPackedRectangle();
+
+      size_t page; // INVALID_PAGE if the rectangle is larger than a page
+      size_t x;
+      size_t y;
+    };
+
+    // Sorts the rectangles from largest to smallest and packs them into the existing pages first, then as many new pages as they need.
+    // packed is in the same order as sizes, returns false if any of the rectangles were too large for a page.
+    bool PackRectangles(size_t pageWidth, size_t pageHeight, PACKING_ALGORITHM algorithm, const std::vector<std::pair<size_t, size_t>>& sizes, std::vector<cRectanglePacker>& pages, std::vector<cPackedRectangle>& packed);
+  }
+}
@@ -2,45 +2,219 @@
 #define SPITFIRE_STORAGE_CSV_H
 
 // Standard headers
+#include <charconv>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 // Spitfire headers
 #include <spitfire/storage/file.h>
 
+// https://en.wikipedia.org/wiki/Comma-separated_values
+//
+// Fields containing a line-break, double-quote, and/or commas must be quoted.
+// A (double) quote character in a field must be represented by two double quote characters.
+//
+// Usage:
+// spitfire::csv::cReader reader;
+// reader.Open(TEXT("data.csv"));
+// reader.ReadHeader();
+// const size_t iPrice = reader.GetColumnIndex("price");
+//
+// spitfire::csv::cRow row;
+// while (reader.ReadRow(row)) {
+//   double fPrice = 0.0;
+//   if (row.GetValue(iPrice, fPrice)) ...
+// }
+//
+// Or in parallel, each chunk starts and ends on a row boundary:
+// std::vector<spitfire::csv::cRowReader> chunks;
+// reader.SplitIntoChunks(8, chunks);
+// spitfire::util::ParallelFor(0, chunks.size(), 1, [&](size_t first, size_t last) {
+//   spitfire::csv::cRow row;
+//   for (size_t i = first; i < last; i++) {
+//     while (chunks[i].ReadRow(row)) ...
+//   }
+// });
+
 namespace spitfire
 {
   namespace csv
   {
+    const size_t INVALID_COLUMN = size_t(-1);
+
+    // ** cRow
+    // The columns point into the source of the reader that filled in the row, they are only valid while the source is
+    // still open and until the row is read into again.  Reusing a row means that reading does not allocate once the row
+    // has grown to fit the widest row.
+
+    class cRow
+    {
+    public:
+      friend class cRowReader;
+
+      size_t GetColumnCount() const { return columns.size(); }
+
+      std::string_view GetColumn(size_t iColumn) const { ASSERT(iColumn < columns.size()); return columns[iColumn]; }
+
+      // Parses the column as a number or a bool, returns false if the column is missing or is not a valid value
+      template <class T>
+      bool GetValue(size_t iColumn, T& value) const;
+
+    private:
+      void Clear();
+
+      std::vector<std::string_view> columns;
+
+      // Columns with escaped quotes are unescaped into this buffer, the columns are pointed at it once the whole row has
+      // been read because the buffer may move while it grows
+      struct cUnescapedColumn
+      {
+        size_t iColumn;
+        size_t offset;
+        size_t length;
+      };
+
+      std::string unescaped;
+      std::vector<cUnescapedColumn> unescapedColumns;
+    };
+
+
+    // ** cRowReader
+    // Reads rows from CSV text that it does not own
+
+    class cRowReader
+    {
+    public:
+      cRowReader();
+      explicit cRowReader(std::string_view sContentUTF8);
+
+      bool IsEnd() const { return (pCurrent == pEnd); }
+
+      bool ReadRow(cRow& row); // Returns false at the end of the content, blank lines are skipped
+
+      std::string_view GetRemaining() const { return std::string_view(pCurrent, size_t(pEnd - pCurrent)); }
+
+    private:
+      const char* pCurrent;
+      const char* pEnd;
+    };
+
+
     // ** cReader
+    // Memory maps the file and reads it in place
 
     class cReader
     {
     public:
       bool Open(const string_t& sFilePath);
+      void Close();
+
+      bool IsOpen() const { return file.IsOpen(); }
+
+      bool ReadHeader(); // Reads the first row as the names of the columns
+      size_t GetColumnIndex(std::string_view sName) const; // Returns INVALID_COLUMN if there is no column with this name
+
+      bool ReadRow(cRow& row);
+      bool ReadLine(std::vector<string_t>& values); // Slower as it copies every value, prefer ReadRow
 
-      bool ReadLine(std::vector<string_t>& values);
+      // Splits the rest of the file into up to nChunks pieces of about the same size that can be read independently
+      // NOTE: Each split point has to know whether it is inside a quoted field so this makes one pass over the file counting quotes
+      void SplitIntoChunks(size_t nChunks, std::vector<cRowReader>& chunks) const;
 
     private:
-      storage::cReadTextFile file;
+      storage::cMemoryMappedFile file;
+      cRowReader rows;
+      std::vector<std::string> columnNames;
     };
 
 
     // ** cWriter
+    // Values are escaped straight into a buffer which is written to the file in large blocks
 
     class cWriter
     {
     public:
       cWriter();
+      ~cWriter();
 
       bool Open(const string_t& sFilePath);
+      void Close();
+
+      void AddValue(std::string_view sValueUTF8);
+      #ifdef UNICODE
+      void AddValue(const std::wstring& sValue);
+      #endif
+      void AddValueInt(int64_t value);
+      void AddValueUInt(uint64_t value);
+      void AddValueFloat(double value);
+      void AddValueBool(bool value);
 
-      void AddValue(const string_t& sValue);
       void EndRow();
 
+      void Flush();
+
     private:
+      void BeginValue();
+
+      template <class T>
+      void AddNumber(T value);
+
       std::ofstream o;
+      std::string buffer;
       bool bIsFirstValue;
     };
+
+
+    // ** Inlines
+
+    // ** cRow
+
+    template <class T>
+    inline bool cRow::GetValue(size_t iColumn, T& value) const
+    {
+      static_assert(std::is_arithmetic<T>::value, "GetValue only parses numbers and bools, use GetColumn for strings");
+
+      if (iColumn >= columns.size()) return false;
+
+      const std::string_view sColumn = columns[iColumn];
+
+      if constexpr (std::is_same<T, bool>::value) {
+        if ((sColumn == "true") || (sColumn == "1")) value = true;
+        else if ((sColumn == "false") || (sColumn == "0")) value = false;
+        else return false;
+        return true;
+      } else {
+        const char* pFirst = sColumn.data();
+        const char* pLast = sColumn.data() + sColumn.length();
+
+        // from_chars doesn't accept a leading plus sign
+        if ((pFirst != pLast) && (*pFirst == '+')) pFirst++;
+
+        T parsed = T();
+        const std::from_chars_result result = std::from_chars(pFirst, pLast, parsed);
+        if ((result.ec != std::errc()) || (result.ptr != pLast) || (pFirst == pLast)) return false;
+
+        value = parsed;
+        return true;
+      }
+    }
+
+
+    // ** cWriter
+
+    template <class T>
+    inline void cWriter::AddNumber(T value)
+    {
+      BeginValue();
+
+      char szValue[64];
+      const std::to_chars_result result = std::to_chars(szValue, szValue + sizeof(szValue), value);
+      ASSERT(result.ec == std::errc());
+      buffer.append(szValue, result.ptr);
+    }
   }
 }
 
@@ -20,6 +20,7 @@ namespace spitfire
 {
   namespace xml
   {
+    class cPullParser;
     class reader;
     class writer;
   }
@@ -223,7 +224,7 @@ namespace spitfire
       void SetTypeElement(const std::string& name);
       void SetTypeContentOnly(const std::string& text);
 
-      util::PROCESS_RESULT ParseFromStringParser(const util::cProcessInterface& interface, size_t& nProcessedElements, spitfire::string::cStringParserUTF8& sp);
+      util::PROCESS_RESULT ParseFromPullParser(const util::cProcessInterface& interface, xml::cPullParser& parser);
 
       void WriteToFile(std::ofstream& file, const std::string& sTab) const;
 
@@ -3,6 +3,8 @@
 
 // Standard headers
 #include <fstream>
+#include <string_view>
+#include <vector>
 
 // Spitfire headers
 #include <spitfire/util/string.h>
@@ -194,6 +196,42 @@ namespace spitfire
     };
 
 
+    // ** cMemoryMappedFile
+    // Maps a whole file read only so that it can be parsed in place without copying it into a string first
+    // On platforms without mmap the file is read into a buffer instead
+
+    class cMemoryMappedFile
+    {
+    public:
+      cMemoryMappedFile();
+      explicit cMemoryMappedFile(const string_t& sFilePath);
+      ~cMemoryMappedFile();
+
+      bool Open(const string_t& sFilePath);
+      void Close();
+
+      bool IsOpen() const { return bIsOpen; }
+
+      const uint8_t* GetData() const { return pData; }
+      size_t GetSizeBytes() const { return nSizeBytes; }
+      std::string_view GetView() const { return std::string_view(reinterpret_cast<const char*>(pData), nSizeBytes); }
+
+    private:
+      cMemoryMappedFile(const cMemoryMappedFile&) = delete;
+      cMemoryMappedFile& operator=(const cMemoryMappedFile&) = delete;
+
+      bool bIsOpen;
+      const uint8_t* pData;
+      size_t nSizeBytes;
+
+      #ifdef __LINUX__
+      void* pMapped;
+      #else
+      std::vector<uint8_t> buffer;
+      #endif
+    };
+
+
     // ** Inlines
 
     template <class T>
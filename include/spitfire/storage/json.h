@@ -1,7 +1,14 @@
 #ifndef JSON_H
 #define JSON_H
 
+// Standard headers
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Spitfire headers
 #include <spitfire/storage/document.h>
+#include <spitfire/util/arena.h>
 
 // http://en.wikipedia.org/wiki/JSON
 
@@ -10,30 +17,34 @@ namespace spitfire
   namespace json
   {
     class cNode;
-
-    typedef cNode cDocument;
+    class cDocument;
+    class cParser;
 
     class reader;
     class writer;
 
+    // ** cNode
+    // Nodes and their names and strings all live in the arena of the cDocument that created them, they are freed when the
+    // document is cleared or destroyed
+
     class cNode
     {
     public:
+      friend class cDocument;
+      friend class cParser;
       friend class reader;
       friend class writer;
 
-      cNode();
-      ~cNode();
-
-      cNode* CreateNode(); // This element is owned by the caller of this function
-      cNode* CreateNode(const std::string& sName); // This element is owned by the caller of this function
-      void AppendChild(cNode* pChild); // this cNode takes ownership of the node inside this function, do not delete pChild, cNode will do this for you
+      cNode* CreateNode(); // The node is owned by our document, it is destroyed along with the document
+      cNode* CreateNode(const std::string& sName); // The node is owned by our document, it is destroyed along with the document
+      void AppendChild(cNode* pChild); // pChild must have been created by the same document
 
       const cNode* GetChild(const std::string& sName) const;
       cNode* GetChild(const std::string& sName);
 
-      std::string GetName() const { return sNameUTF8; }
-      void SetName(const std::string& sName) { sNameUTF8 = sName; }
+      std::string GetName() const { return std::string(sNameUTF8); }
+      std::string_view GetNameView() const { return sNameUTF8; }
+      void SetName(const std::string& sName);
 
       bool IsTypeNull() const { return (type == TYPE::NULL_); }
       bool IsTypeObject() const { return (type == TYPE::OBJECT); }
@@ -43,9 +54,12 @@ namespace spitfire
       bool IsTypeFloat() const { return (type == TYPE::FLOAT); }
       bool IsTypeBool() const { return (type == TYPE::BOOL_); }
 
-      const std::vector<cNode*>& GetValueObjectOrArray() const { ASSERT((type == TYPE::OBJECT) || (type == TYPE::ARRAY)); return vValueObjectOrArray; }
-      std::vector<cNode*>& GetValueObjectOrArray() { ASSERT((type == TYPE::OBJECT) || (type == TYPE::ARRAY)); return vValueObjectOrArray; }
+      // NOTE: When a document was read lazily these parse the object or array the first time they are called so they are not thread safe
+      std::span<cNode* const> GetValueObjectOrArray() const;
+      size_t GetChildCount() const { return GetValueObjectOrArray().size(); }
+
       std::string GetValueString() const;
+      std::string_view GetValueStringView() const { ASSERT(type == TYPE::STRING); return sValueUTF8String; }
       int GetValueInt() const { ASSERT(type == TYPE::INT); return iValueInt; }
       double GetValueFloat() const { ASSERT(type == TYPE::FLOAT); return dValueFloat; }
       bool GetValueBool() const { ASSERT(type == TYPE::BOOL_); return bValueBool; }
@@ -53,7 +67,7 @@ namespace spitfire
       void SetTypeNull() { type = TYPE::NULL_; }
       void SetTypeObject() { type = TYPE::OBJECT; }
       void SetTypeArray() { type = TYPE::ARRAY; }
-      void SetTypeString(const std::string& sValue) { type = TYPE::STRING; sValueUTF8String = sValue; }
+      void SetTypeString(const std::string& sValue);
       void SetTypeInt(int iValue) { type = TYPE::INT; iValueInt = iValue; }
       void SetTypeFloat(double fValue) { type = TYPE::FLOAT; dValueFloat = fValue; }
       void SetTypeBool(bool bValue) { type = TYPE::BOOL_; bValueBool = bValue; }
@@ -155,7 +169,14 @@ namespace spitfire
       typedef cIterator iterator;
 
     private:
-      enum class TYPE {
+      explicit cNode(cDocument& document);
+
+      cNode(const cNode&) = delete;
+      cNode& operator=(const cNode&) = delete;
+
+      void Materialise() const; // Parses the children of a lazy object or array
+
+      enum class TYPE : uint8_t {
         NULL_,   // null
         OBJECT,  // Object (an unordered collection of key:value pairs, comma-separated and enclosed in curly braces; the key must be a string)
         ARRAY,   // Array (an ordered sequence of values, comma-separated and enclosed in square brackets. The values don't need to have the same type.)
@@ -165,26 +186,78 @@ namespace spitfire
         BOOL_,   // Boolean (true or false)
       };
 
+      cDocument* pDocument;
       TYPE type;
-      std::string sNameUTF8; // Most nodes will have a name as well as one of the following values
-      std::vector<cNode*> vValueObjectOrArray;
-      std::string sValueUTF8String;
-      int iValueInt;
-      double dValueFloat;
-      bool bValueBool;
+
+      // A lazy object or array remembers where its opening bracket is and is parsed the first time its children are accessed
+      mutable bool bIsLazy;
+      mutable uint32_t nLazyOpenIndex;
+
+      std::string_view sNameUTF8; // Most nodes will have a name as well as one of the following values
+
+      // Children of an object or array, allocated from the arena
+      mutable cNode** pChildren;
+      mutable uint32_t nChildren;
+      mutable uint32_t nChildrenCapacity;
+
+      std::string_view sValueUTF8String;
+      union {
+        int iValueInt;
+        double dValueFloat;
+        bool bValueBool;
+      };
+    };
+
+
+    // ** cDocument
+    // The root node of a document, it owns the arena that every node, name and string in the document is allocated from
+
+    class cDocument : public cNode
+    {
+    public:
+      friend class cNode;
+      friend class cParser;
+      friend class reader;
+
+      cDocument();
+
+      void Clear(); // Clears the root node and frees every other node in the document
+
+      size_t GetArenaSizeBytes() const { return arena.GetAllocatedBytes(); }
+
+    private:
+      cDocument(const cDocument&) = delete;
+      cDocument& operator=(const cDocument&) = delete;
+
+      cNode* NewNode();
+
+      util::cArena arena;
+
+      // Lazy documents keep the source and the structural index around so that they can parse the rest of the document later
+      char* pSource; // A copy of the source in the arena, strings are unescaped in place
+      size_t nSourceLengthBytes;
+      std::vector<uint32_t> structurals; // Offsets of the structural characters in the source with a sentinel at the end
+
+      std::vector<cNode*> scratch; // The children of the objects and arrays that are being parsed
     };
 
 
+    // ** reader
+
     class reader
     {
     public:
+      reader();
+
+      // Lazy documents only parse objects and arrays when their children are first accessed, this is much faster when
+      // only a small part of a large document is used, but errors in the parts that are not accessed are not detected
+      void SetLazy(bool bLazy) { bIsLazy = bLazy; }
+
       bool ReadFromFile(cDocument& doc, const string_t& filename) const;
-      bool ReadFromStringUTF8(cDocument& doc, const std::string& input) const;
+      bool ReadFromStringUTF8(cDocument& doc, std::string_view input) const;
 
     private:
-      bool ReadNodeFromStringParserUTF8(cNode& doc, string::cStringParserUTF8& sp) const;
-      bool ReadObjectOrArray(cNode& object, string::cStringParserUTF8& sp) const;
-      bool ReadString(std::string& sValue, string::cStringParserUTF8& sp) const;
+      bool bIsLazy;
     };
 
 
@@ -195,7 +268,7 @@ namespace spitfire
       bool WriteToStringUTF8(const cDocument& doc, std::string& output) const;
 
     private:
-      bool WriteObjectOrArray(const cNode& object, std::ostream& o, const std::string& sTabs) const;
+      bool WriteObjectOrArray(const cNode& object, std::ostream& o, const std::string& sTabs, bool bIsNamed) const;
     };
 
 
@@ -1,6 +1,11 @@
 #ifndef XML_H
 #define XML_H
 
+// Standard headers
+#include <string_view>
+#include <vector>
+
+// Spitfire headers
 #include <spitfire/storage/document.h>
 #include <spitfire/util/process.h>
 
@@ -21,12 +26,100 @@ namespace spitfire
 {
   namespace xml
   {
+    // ** cPullParser
+    // Walks through an XML document one event at a time without building a tree or copying anything, the names, values
+    // and text are views into the original buffer which must outlive the parser
+    //
+    // Leading and trailing white space around text is trimmed and white space only text is skipped, comments, processing
+    // instructions and DOCTYPE declarations are skipped, CDATA sections are returned as text.  Entities are not decoded,
+    // values are returned exactly as they appear in the document which is also how writer writes them.
+    //
+    // Usage:
+    // spitfire::xml::cPullParser parser(sData);
+    // spitfire::xml::EVENT event = parser.Next();
+    // while ((event != spitfire::xml::EVENT::END_OF_DOCUMENT) && (event != spitfire::xml::EVENT::ERROR)) {
+    //   if (event == spitfire::xml::EVENT::START_ELEMENT) std::cout<<parser.GetName()<<std::endl;
+    //   event = parser.Next();
+    // }
+    //
+
+    enum class EVENT {
+      START_ELEMENT, // GetName() is the name of the element
+      ATTRIBUTE,     // GetName() and GetValue() are the name and value of an attribute of the element that was just started
+      TEXT,          // GetValue() is the text
+      END_ELEMENT,   // GetName() is the name of the element, this is also sent straight after the attributes of <element/>
+      END_OF_DOCUMENT,
+      ERROR          // GetError() describes the error, every call to Next() after an error returns ERROR
+    };
+
+    class cPullParser
+    {
+    public:
+      explicit cPullParser(std::string_view sData);
+
+      EVENT Next();
+
+      std::string_view GetName() const { return sName; }
+      std::string_view GetValue() const { return sValue; }
+
+      size_t GetDepth() const { return openElements.size(); } // The number of elements that have been started but not ended
+      bool IsXMLDeclarationFound() const { return bIsXMLDeclarationFound; }
+
+      const std::string& GetError() const { return sError; }
+      size_t GetOffset() const { return size_t(p - pBegin); } // The current position in bytes, useful for reporting where an error happened
+
+    private:
+      enum class STATE {
+        CONTENT,
+        START_TAG,
+        ERROR
+      };
+
+      EVENT SetError(const std::string& sDescription);
+      bool SkipPast(std::string_view sFind); // Moves just past the next occurrence of sFind, returns false if it is not found
+
+      const char* const pBegin;
+      const char* const pEnd;
+      const char* p;
+
+      STATE state;
+      bool bIsXMLDeclarationFound;
+
+      std::string_view sName;
+      std::string_view sValue;
+      std::vector<std::string_view> openElements;
+
+      std::string sError;
+    };
+
+
+    // ** cSAXListener
+    // Receives the events from ParseSAX, the views are only valid until the function returns
+
+    class cSAXListener
+    {
+    public:
+      virtual ~cSAXListener() {}
+
+      virtual void OnStartElement(std::string_view sName) { (void)sName; }
+      virtual void OnAttribute(std::string_view sName, std::string_view sValue) { (void)sName; (void)sValue; }
+      virtual void OnText(std::string_view sText) { (void)sText; }
+      virtual void OnEndElement(std::string_view sName) { (void)sName; }
+    };
+
+    // Calls the listener for each event in the document, stops early if the interface asks us to
+    util::PROCESS_RESULT ParseSAX(util::cProcessInterface& interface, std::string_view sData, cSAXListener& listener);
+
+
     class reader
     {
     public:
       util::PROCESS_RESULT ReadFromFile(util::cProcessInterface& interface, document::cDocument& doc, const string_t& filename) const;
       util::PROCESS_RESULT ReadFromString(util::cProcessInterface& interface, document::cDocument& doc, const std::string& input) const;
       util::PROCESS_RESULT ReadFromString(util::cProcessInterface& interface, document::cDocument& doc, const std::wstring& input) const { return ReadFromString(interface, doc, spitfire::string::ToUTF8(input)); }
+
+      // Streams the file through the listener without building a document, the file is memory mapped rather than read
+      util::PROCESS_RESULT ParseFile(util::cProcessInterface& interface, cSAXListener& listener, const string_t& filename) const;
     };
 
 
@@ -0,0 +1,112 @@
+#ifndef SPITFIRE_ARENA_H
+#define SPITFIRE_ARENA_H
+
+// Standard headers
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+//
+// *** cArena
+//
+// A bump allocator that hands out memory from large blocks and frees everything at once when it is cleared or destroyed.
+// Allocations are never freed individually and destructors are never called, so only trivially destructible types can
+// be created in an arena.
+//
+// Usage:
+// spitfire::util::cArena arena;
+// cItem* pItem = arena.Create<cItem>(1, 2);
+// std::string_view sName = arena.CopyString("name");
+// ...
+// arena.Clear(); // Everything allocated from the arena is now invalid
+//
+
+namespace spitfire
+{
+  namespace util
+  {
+    class cArena
+    {
+    public:
+      explicit cArena(size_t nBlockSizeBytes = 64 * 1024);
+      ~cArena();
+
+      void* Allocate(size_t nBytes, size_t nAlignment = alignof(std::max_align_t));
+
+      template <class T>
+      T* AllocateArray(size_t nItems); // The items are not constructed
+
+      template <class T, class... Args>
+      T* Create(Args&&... args);
+
+      std::string_view CopyString(std::string_view sValue); // The copy is null terminated
+
+      void Clear(); // Frees everything, the largest block is kept for reuse
+
+      size_t GetAllocatedBytes() const { return nAllocatedBytes; } // The total size of the blocks we own
+
+    private:
+      cArena(const cArena&) = delete;
+      cArena& operator=(const cArena&) = delete;
+
+      struct cBlock
+      {
+        uint8_t* pData;
+        size_t nSizeBytes;
+      };
+
+      void* AllocateFromNewBlock(size_t nBytes, size_t nAlignment);
+
+      const size_t nBlockSizeBytes;
+      std::vector<cBlock> blocks;
+      uint8_t* pCurrent; // The next free byte in the last block
+      uint8_t* pEnd;     // The end of the last block
+      size_t nAllocatedBytes;
+    };
+
+
+    // ** Inlines
+
+    inline void* cArena::Allocate(size_t nBytes, size_t nAlignment)
+    {
+      ASSERT((nAlignment & (nAlignment - 1)) == 0);
+
+      uint8_t* p = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(pCurrent) + (nAlignment - 1)) & ~uintptr_t(nAlignment - 1));
+      if ((pCurrent == nullptr) || (p > pEnd) || (size_t(pEnd - p) < nBytes)) return AllocateFromNewBlock(nBytes, nAlignment);
+
+      pCurrent = p + nBytes;
+      return p;
+    }
+
+    template <class T>
+    inline T* cArena::AllocateArray(size_t nItems)
+    {
+      return static_cast<T*>(Allocate(sizeof(T) * nItems, alignof(T)));
+    }
+
+    template <class T, class... Args>
+    inline T* cArena::Create(Args&&... args)
+    {
+      static_assert(std::is_trivially_destructible<T>::value, "Destructors are not called for objects in an arena");
+      return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    inline std::string_view cArena::CopyString(std::string_view sValue)
+    {
+      char* p = static_cast<char*>(Allocate(sValue.length() + 1, 1));
+      if (!sValue.empty()) memcpy(p, sValue.data(), sValue.length());
+      p[sValue.length()] = 0;
+      return std::string_view(p, sValue.length());
+    }
+  }
+}
+
+#endif // SPITFIRE_ARENA_H
@@ -2,7 +2,9 @@
 #define CQUEUE_H
 
 // Standard headers
+#include <atomic>
 #include <list>
+#include <vector>
 
 // Spitfire headers
 #include <spitfire/util/signalobject.h>
@@ -68,6 +70,7 @@ namespace spitfire
 
       void AddItemToBack(T* pItem); // The queue takes ownership of pItem
       T* RemoveItemFromFront(); // The caller takes ownership of the item that is returned
+      size_t RemoveItemsFromFront(std::vector<T*>& outItems, size_t nMaxItems); // The caller takes ownership of the items that are appended to outItems, returns the number of items removed
 
     private:
       cSignalObject& soAction;
@@ -130,6 +133,241 @@ namespace spitfire
 
       return pItem;
     }
+
+    template <class T>
+    inline size_t cThreadSafeQueue<T>::RemoveItemsFromFront(std::vector<T*>& outItems, size_t nMaxItems)
+    {
+      size_t nRemoved = 0;
+      {
+        cLockObject lock(mutex);
+        while (!items.empty() && (nRemoved < nMaxItems)) {
+          outItems.push_back(items.front());
+          items.pop_front();
+          nRemoved++;
+        }
+
+        if (!items.empty()) {
+          // Tell anyone listening that there is still an item in the queue
+          soAction.Signal();
+        }
+      }
+
+      return nRemoved;
+    }
+
+
+    // ** cLockFreeQueue
+    // A bounded multiple producer, multiple consumer queue with the same ownership semantics as cThreadSafeQueue
+    // Items are stored in a fixed size ring buffer so adding and removing items never allocates or takes a lock
+    // Signals are coalesced, a burst of AddItemToBack calls only signals soAction once until a consumer removes items again
+    // http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+    template <class T>
+    class cLockFreeQueue
+    {
+    public:
+      cLockFreeQueue(cSignalObject& soAction, size_t nCapacity); // nCapacity is rounded up to the next power of two
+      ~cLockFreeQueue();
+
+      bool IsEmpty() const; // NOTE: This is only a snapshot, by the time you call the next function this may have changed
+      size_t GetCapacity() const { return nCapacity; }
+
+      bool TryAddItemToBack(T* pItem); // The queue takes ownership of pItem if this returns true, returns false if the queue is full
+      void AddItemToBack(T* pItem);    // The queue takes ownership of pItem, yields until there is space in the queue
+      T* RemoveItemFromFront();        // The caller takes ownership of the item that is returned, returns nullptr if the queue is empty
+      size_t RemoveItemsFromFront(std::vector<T*>& outItems, size_t nMaxItems); // The caller takes ownership of the items that are appended to outItems, returns the number of items removed
+
+    private:
+      cLockFreeQueue(const cLockFreeQueue&) = delete;
+      cLockFreeQueue& operator=(const cLockFreeQueue&) = delete;
+
+      static size_t RoundUpToPowerOfTwo(size_t n);
+
+      bool Push(T* pItem);
+      T* Pop();
+
+      void SignalIfNotPending();
+
+      // Each cell holds a sequence number so that producers and consumers can claim it without a lock
+      struct cCell
+      {
+        std::atomic<size_t> sequence;
+        T* pItem;
+      };
+
+      // Keep the frequently written positions on separate cache lines to avoid false sharing
+      static constexpr size_t CACHE_LINE_SIZE = 64;
+
+      cSignalObject& soAction;
+
+      const size_t nCapacity;
+      const size_t nMask;
+      cCell* cells;
+
+      alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePosition;
+      alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePosition;
+      alignas(CACHE_LINE_SIZE) std::atomic<bool> bIsSignalPending;
+    };
+
+    template <class T>
+    inline cLockFreeQueue<T>::cLockFreeQueue(cSignalObject& _soAction, size_t _nCapacity) :
+      soAction(_soAction),
+      nCapacity(RoundUpToPowerOfTwo(_nCapacity)),
+      nMask(nCapacity - 1),
+      cells(new cCell[nCapacity]),
+      enqueuePosition(0),
+      dequeuePosition(0),
+      bIsSignalPending(false)
+    {
+      for (size_t i = 0; i < nCapacity; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+        cells[i].pItem = nullptr;
+      }
+    }
+
+    template <class T>
+    inline cLockFreeQueue<T>::~cLockFreeQueue()
+    {
+      // NOTE: All items must be removed before the queue is destroyed
+      ASSERT(IsEmpty());
+
+      delete [] cells;
+    }
+
+    template <class T>
+    inline size_t cLockFreeQueue<T>::RoundUpToPowerOfTwo(size_t n)
+    {
+      size_t nResult = 2;
+      while (nResult < n) nResult <<= 1;
+      return nResult;
+    }
+
+    template <class T>
+    inline bool cLockFreeQueue<T>::IsEmpty() const
+    {
+      return (enqueuePosition.load(std::memory_order_acquire) == dequeuePosition.load(std::memory_order_acquire));
+    }
+
+    template <class T>
+    inline bool cLockFreeQueue<T>::Push(T* pItem)
+    {
+      size_t position = enqueuePosition.load(std::memory_order_relaxed);
+      while (true) {
+        cCell& cell = cells[position & nMask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = intptr_t(sequence) - intptr_t(position);
+        if (difference == 0) {
+          // The cell is free, try to claim it
+          if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            cell.pItem = pItem;
+            cell.sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (difference < 0) {
+          // The queue is full
+          return false;
+        } else {
+          // Another producer claimed this cell, try again with the latest position
+          position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    template <class T>
+    inline T* cLockFreeQueue<T>::Pop()
+    {
+      size_t position = dequeuePosition.load(std::memory_order_relaxed);
+      while (true) {
+        cCell& cell = cells[position & nMask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = intptr_t(sequence) - intptr_t(position + 1);
+        if (difference == 0) {
+          // The cell is full, try to claim it
+          if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            T* pItem = cell.pItem;
+            cell.pItem = nullptr;
+            cell.sequence.store(position + nMask + 1, std::memory_order_release);
+            return pItem;
+          }
+        } else if (difference < 0) {
+          // The queue is empty
+          return nullptr;
+        } else {
+          // Another consumer claimed this cell, try again with the latest position
+          position = dequeuePosition.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    template <class T>
+    inline void cLockFreeQueue<T>::SignalIfNotPending()
+    {
+      // Only the first producer after a consumer has started removing items needs to wake the consumer
+      if (!bIsSignalPending.exchange(true)) soAction.Signal();
+    }
+
+    template <class T>
+    inline bool cLockFreeQueue<T>::TryAddItemToBack(T* pItem)
+    {
+      ASSERT(pItem != nullptr);
+
+      if (!Push(pItem)) return false;
+
+      // Tell anyone listening that something happened
+      SignalIfNotPending();
+
+      return true;
+    }
+
+    template <class T>
+    inline void cLockFreeQueue<T>::AddItemToBack(T* pItem)
+    {
+      ASSERT(pItem != nullptr);
+
+      // Wait for a consumer to make some space
+      while (!Push(pItem)) YieldThisThread();
+
+      // Tell anyone listening that something happened
+      SignalIfNotPending();
+    }
+
+    template <class T>
+    inline T* cLockFreeQueue<T>::RemoveItemFromFront()
+    {
+      // Any item added after this point will signal again, any item added before this point is still in the queue for us to remove
+      bIsSignalPending.store(false);
+
+      T* pItem = Pop();
+
+      if ((pItem != nullptr) && !IsEmpty()) {
+        // Tell anyone listening that there is still an item in the queue
+        SignalIfNotPending();
+      }
+
+      return pItem;
+    }
+
+    template <class T>
+    inline size_t cLockFreeQueue<T>::RemoveItemsFromFront(std::vector<T*>& outItems, size_t nMaxItems)
+    {
+      // Any item added after this point will signal again, any item added before this point is still in the queue for us to remove
+      bIsSignalPending.store(false);
+
+      size_t nRemoved = 0;
+      while (nRemoved < nMaxItems) {
+        T* pItem = Pop();
+        if (pItem == nullptr) break;
+
+        outItems.push_back(pItem);
+        nRemoved++;
+      }
+
+      if ((nRemoved == nMaxItems) && !IsEmpty()) {
+        // Tell anyone listening that there is still an item in the queue
+        SignalIfNotPending();
+      }
+
+      return nRemoved;
+    }
   }
 }
 
@@ -0,0 +1,234 @@
+#ifndef SPITFIRE_THREADPOOL_H
+#define SPITFIRE_THREADPOOL_H
+
+// Standard headers
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/thread.h>
+
+//
+// *** cThreadPool
+//
+// A fixed number of cThread workers that run small tasks.  Each worker has its own deque of tasks, a worker pushes and
+// pops tasks at the back of its own deque and when it runs out of work it steals from the front of the other workers'
+// deques.  Tasks submitted from outside the pool go into a shared queue that every worker also takes from.
+//
+// Usage:
+// spitfire::util::cThreadPool pool(4);
+// spitfire::util::cTaskHandle task = pool.Submit([]() { DoSomething(); });
+// spitfire::util::cTaskHandle next = task.Then([]() { DoSomethingAfterwards(); });
+// next.Wait();
+//
+// spitfire::util::ParallelFor(pool, 0, items.size(), 64, [&](size_t first, size_t last) {
+//   for (size_t i = first; i < last; i++) items[i].Update();
+// });
+//
+
+namespace spitfire
+{
+  namespace util
+  {
+    class cThreadPool;
+    class cThreadPoolWorker;
+
+    // ** cTask
+    // Internal state shared between the pool and any cTaskHandle that refer to it
+
+    class cTask
+    {
+    public:
+      explicit cTask(const std::function<void()>& function);
+
+      std::function<void()> function;
+
+      std::atomic<bool> bIsDone;
+      std::mutex mutex;
+      std::condition_variable condition;
+      std::vector<std::shared_ptr<cTask>> continuations; // Tasks to submit once this task is done
+    };
+
+
+    // ** cTaskHandle
+
+    class cTaskHandle
+    {
+    public:
+      cTaskHandle();
+      cTaskHandle(cThreadPool& pool, std::shared_ptr<cTask> pTask);
+
+      bool IsValid() const { return (pTask != nullptr); }
+      bool IsDone() const;
+
+      void Wait() const; // Blocks until the task is done, if called from a worker thread this runs other tasks while it waits
+
+      cTaskHandle Then(const std::function<void()>& function) const; // Submits function to the pool once this task is done
+
+    private:
+      cThreadPool* pPool;
+      std::shared_ptr<cTask> pTask;
+    };
+
+
+    // ** cThreadPool
+
+    class cThreadPool
+    {
+    public:
+      friend class cTaskHandle;
+      friend class cThreadPoolWorker;
+
+      explicit cThreadPool(size_t nThreads = 0); // nThreads defaults to GetRecommendedConcurrentThreadCount()
+      ~cThreadPool();
+
+      size_t GetThreadCount() const { return workers.size(); }
+
+      cTaskHandle Submit(const std::function<void()>& function);
+
+      bool IsWorkerThread() const; // Returns true if the calling thread is one of this pool's workers
+
+      bool RunPendingTask(); // Runs one pending task on the calling thread if there is one, returns true if a task was run
+
+    private:
+      cThreadPool(const cThreadPool&) = delete;
+      cThreadPool& operator=(const cThreadPool&) = delete;
+
+      struct cWorkQueue
+      {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<cTask>> tasks;
+      };
+
+      void Enqueue(std::shared_ptr<cTask> pTask);
+      std::shared_ptr<cTask> GetTask(size_t index);
+      void RunTask(std::shared_ptr<cTask> pTask);
+
+      void WorkerThreadFunction(size_t index);
+
+      std::vector<cThreadPoolWorker*> workers;
+      std::vector<std::unique_ptr<cWorkQueue>> queues; // One per worker plus the shared queue at the end
+
+      std::atomic<size_t> nPendingTasks;
+      std::atomic<size_t> nSleepingWorkers;
+      std::atomic<bool> bIsStopping;
+      std::mutex mutexSleep;
+      std::condition_variable conditionSleep;
+    };
+
+    // A lazily created pool shared by the whole application, sized with GetRecommendedConcurrentThreadCount()
+    cThreadPool& GetDefaultThreadPool();
+
+
+    // ** ParallelFor
+    // Calls function(first, last) for consecutive ranges of at most nGrainSize items covering [begin, end), the calling thread also processes ranges
+
+    template <class F>
+    inline void ParallelFor(cThreadPool& pool, size_t begin, size_t end, size_t nGrainSize, F function)
+    {
+      if (end <= begin) return;
+
+      nGrainSize = std::max<size_t>(1, nGrainSize);
+      const size_t nChunks = ((end - begin) + nGrainSize - 1) / nGrainSize;
+      if ((nChunks == 1) || (pool.GetThreadCount() == 0)) {
+        function(begin, end);
+        return;
+      }
+
+      // Each task keeps claiming the next chunk until they are all gone, so uneven chunks balance out
+      std::atomic<size_t> nextChunk(0);
+      auto processChunks = [&]() {
+        size_t chunk = 0;
+        while ((chunk = nextChunk.fetch_add(1)) < nChunks) {
+          const size_t first = begin + (chunk * nGrainSize);
+          function(first, std::min(end, first + nGrainSize));
+        }
+      };
+
+      const size_t nTasks = std::min(nChunks - 1, pool.GetThreadCount());
+      std::vector<cTaskHandle> tasks;
+      tasks.reserve(nTasks);
+      for (size_t i = 0; i < nTasks; i++) tasks.push_back(pool.Submit(processChunks));
+
+      processChunks();
+
+      for (auto& task : tasks) task.Wait();
+    }
+
+    template <class F>
+    inline void ParallelFor(size_t begin, size_t end, size_t nGrainSize, F function)
+    {
+      ParallelFor(GetDefaultThreadPool(), begin, end, nGrainSize, function);
+    }
+
+
+    // ** ParallelReduce
+    // Calls function(first, last) for ranges of at most nGrainSize items and combines the results with reduce(lhs, rhs)
+    // The results are always combined in range order so the result is the same regardless of the number of threads
+
+    template <class T, class F, class R>
+    inline T ParallelReduce(cThreadPool& pool, size_t begin, size_t end, size_t nGrainSize, const T& identity, F function, R reduce)
+    {
+      if (end <= begin) return identity;
+
+      nGrainSize = std::max<size_t>(1, nGrainSize);
+      const size_t nChunks = ((end - begin) + nGrainSize - 1) / nGrainSize;
+
+      std::vector<T> results(nChunks, identity);
+      ParallelFor(pool, 0, nChunks, 1, [&](size_t firstChunk, size_t lastChunk) {
+        for (size_t chunk = firstChunk; chunk < lastChunk; chunk++) {
+          const size_t first = begin + (chunk * nGrainSize);
+          results[chunk] = function(first, std::min(end, first + nGrainSize));
+        }
+      });
+
+      T result = identity;
+      for (const T& value : results) result = reduce(result, value);
+      return result;
+    }
+
+    template <class T, class F, class R>
+    inline T ParallelReduce(size_t begin, size_t end, size_t nGrainSize, const T& identity, F function, R reduce)
+    {
+      return ParallelReduce(GetDefaultThreadPool(), begin, end, nGrainSize, identity, function, reduce);
+    }
+
+
+    // ** Inlines
+
+    // *** cTask
+
+    inline cTask::cTask(const std::function<void()>& _function) :
+      function(_function),
+      bIsDone(false)
+    {
+    }
+
+    // *** cTaskHandle
+
+    inline cTaskHandle::cTaskHandle() :
+      pPool(nullptr)
+    {
+    }
+
+    inline cTaskHandle::cTaskHandle(cThreadPool& pool, std::shared_ptr<cTask> _pTask) :
+      pPool(&pool),
+      pTask(_pTask)
+    {
+    }
+
+    inline bool cTaskHandle::IsDone() const
+    {
+      ASSERT(IsValid());
+      return pTask->bIsDone.load();
+    }
+  }
+}
+
+#endif // SPITFIRE_THREADPOOL_H
@@ -16,6 +16,8 @@
 * 3. This notice may not be removed or altered from any source distribution.
 */
 
+// Altered from the original to solve islands on several threads, see b2World::Solve.
+
 #include <Box2D/Dynamics/b2World.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2Fixture.h>
@@ -32,6 +34,8 @@
 #include <Box2D/Collision/b2TimeOfImpact.h>
 #include <Box2D/Common/b2Draw.h>
 #include <Box2D/Common/b2Timer.h>
+#include <algorithm>
+#include <atomic>
 #include <new>
 
 b2World::b2World(const b2Vec2& gravity)
@@ -39,6 +43,10 @@ b2World::b2World(const b2Vec2& gravity)
 	m_destructionListener = NULL;
 	m_debugDraw = NULL;
 
+	m_taskExecutor = NULL;
+	m_threadAllocators = NULL;
+	m_threadAllocatorCount = 0;
+
 	m_bodyList = NULL;
 	m_jointList = NULL;
 
@@ -82,6 +90,13 @@ b2World::~b2World()
 
 		b = bNext;
 	}
+
+	for (int32 i = 0; i < m_threadAllocatorCount; ++i)
+	{
+		m_threadAllocators[i]->~b2StackAllocator();
+		b2Free(m_threadAllocators[i]);
+	}
+	b2Free(m_threadAllocators);
 }
 
 void b2World::SetDestructionListener(b2DestructionListener* listener)
@@ -99,6 +114,11 @@ void b2World::SetContactListener(b2ContactListener* listener)
 	m_contactManager.m_contactListener = listener;
 }
 
+void b2World::SetTaskExecutor(b2TaskExecutor* executor)
+{
+	m_taskExecutor = executor;
+}
+
 void b2World::SetDebugDraw(b2Draw* debugDraw)
 {
 	m_debugDraw = debugDraw;
@@ -382,19 +402,115 @@ void b2World::SetAllowSleeping(bool flag)
 	}
 }
 
+// The bodies, contacts and joints of one island, as ranges of the arrays collected by b2World::Solve.
+struct b2IslandRange
+{
+	int32 bodyStart;
+	int32 bodyCount;
+	int32 contactStart;
+	int32 contactCount;
+	int32 jointStart;
+	int32 jointCount;
+	int32 staticBodyStart;
+	int32 staticBodyCount;
+	bool sleeping;
+};
+
+static bool b2IslandStaticBodyLessThan(const b2IslandStaticBody& a, const b2IslandStaticBody& b)
+{
+	return a.body < b.body;
+}
+
+struct b2IslandLargerThan
+{
+	bool operator()(int32 a, int32 b) const
+	{
+		return islands[a].bodyCount + islands[a].contactCount > islands[b].bodyCount + islands[b].contactCount;
+	}
+
+	const b2IslandRange* islands;
+};
+
+// Solves collected islands. Each thread takes the next unsolved island until there are none left,
+// the islands are ordered largest first so that a large island isn't left until the end.
+class b2IslandSolveTask : public b2Task
+{
+public:
+	void Execute(int32 threadIndex)
+	{
+		b2StackAllocator* allocator = allocators[threadIndex];
+		b2Profile* profile = profiles + threadIndex;
+
+		for (;;)
+		{
+			int32 next = nextIsland.fetch_add(1);
+			if (next >= islandCount)
+			{
+				break;
+			}
+
+			b2IslandRange* range = islands + order[next];
+
+			b2Island island(bodies + range->bodyStart, range->bodyCount,
+							contacts + range->contactStart, range->contactCount,
+							joints + range->jointStart, range->jointCount,
+							staticBodies + range->staticBodyStart, range->staticBodyCount,
+							allocator, impulses != NULL ? impulses + range->contactStart : NULL);
+
+			b2Profile islandProfile;
+			island.Solve(&islandProfile, *step, gravity, allowSleep);
+			profile->solveInit += islandProfile.solveInit;
+			profile->solveVelocity += islandProfile.solveVelocity;
+			profile->solvePosition += islandProfile.solvePosition;
+
+			range->sleeping = island.m_isSleeping;
+		}
+	}
+
+	const b2TimeStep* step;
+	b2Vec2 gravity;
+	bool allowSleep;
+
+	b2Body** bodies;
+	b2Contact** contacts;
+	b2Joint** joints;
+	b2IslandStaticBody* staticBodies;
+	b2ContactImpulse* impulses;
+
+	b2IslandRange* islands;
+	int32* order;
+	int32 islandCount;
+	std::atomic<int32> nextIsland;
+
+	b2StackAllocator** allocators;
+	b2Profile* profiles;
+};
+
 // Find islands, integrate and solve constraints, solve position constraints
+// The islands are all found first and then solved, on several threads if there is a task executor.
 void b2World::Solve(const b2TimeStep& step)
 {
 	m_profile.solveInit = 0.0f;
 	m_profile.solveVelocity = 0.0f;
 	m_profile.solvePosition = 0.0f;
 
-	// Size the island for the worst case.
-	b2Island island(m_bodyCount,
-					m_contactManager.m_contactCount,
-					m_jointCount,
-					&m_stackAllocator,
-					m_contactManager.m_contactListener);
+	b2ContactListener* listener = m_contactManager.m_contactListener;
+	int32 contactCount = m_contactManager.m_contactCount;
+
+	// Size the island lists for the worst case. A static body can be in every island
+	// that touches it, but each time it is reached through a contact or a joint.
+	int32 bodyCapacity = m_bodyCount + contactCount + m_jointCount;
+	int32 staticBodyCapacity = contactCount + m_jointCount;
+	b2Body** bodies = (b2Body**)m_stackAllocator.Allocate(bodyCapacity * sizeof(b2Body*));
+	b2Contact** contacts = (b2Contact**)m_stackAllocator.Allocate(contactCount * sizeof(b2Contact*));
+	b2Joint** joints = (b2Joint**)m_stackAllocator.Allocate(m_jointCount * sizeof(b2Joint*));
+	b2IslandStaticBody* staticBodies = (b2IslandStaticBody*)m_stackAllocator.Allocate(staticBodyCapacity * sizeof(b2IslandStaticBody));
+	b2IslandRange* islands = (b2IslandRange*)m_stackAllocator.Allocate(m_bodyCount * sizeof(b2IslandRange));
+	int32 bodyTotal = 0;
+	int32 contactTotal = 0;
+	int32 jointTotal = 0;
+	int32 staticBodyTotal = 0;
+	int32 islandCount = 0;
 
 	// Clear all the island flags.
 	for (b2Body* b = m_bodyList; b; b = b->m_next)
@@ -410,7 +526,7 @@ void b2World::Solve(const b2TimeStep& step)
 		j->m_islandFlag = false;
 	}
 
-	// Build and simulate all awake islands.
+	// Build all awake islands.
 	int32 stackSize = m_bodyCount;
 	b2Body** stack = (b2Body**)m_stackAllocator.Allocate(stackSize * sizeof(b2Body*));
 	for (b2Body* seed = m_bodyList; seed; seed = seed->m_next)
@@ -431,8 +547,14 @@ void b2World::Solve(const b2TimeStep& step)
 			continue;
 		}
 
-		// Reset island and stack.
-		island.Clear();
+		// Start a new island.
+		b2IslandRange* island = islands + islandCount++;
+		island->bodyStart = bodyTotal;
+		island->contactStart = contactTotal;
+		island->jointStart = jointTotal;
+		island->staticBodyStart = staticBodyTotal;
+		island->sleeping = false;
+
 		int32 stackCount = 0;
 		stack[stackCount++] = seed;
 		seed->m_flags |= b2Body::e_islandFlag;
@@ -443,7 +565,9 @@ void b2World::Solve(const b2TimeStep& step)
 			// Grab the next body off the stack and add it to the island.
 			b2Body* b = stack[--stackCount];
 			b2Assert(b->IsActive() == true);
-			island.Add(b);
+			b2Assert(bodyTotal < bodyCapacity);
+			b->m_islandIndex = bodyTotal - island->bodyStart;
+			bodies[bodyTotal++] = b;
 
 			// Make sure the body is awake.
 			b->SetAwake(true);
@@ -452,6 +576,10 @@ void b2World::Solve(const b2TimeStep& step)
 			// propagate islands across static bodies.
 			if (b->GetType() == b2_staticBody)
 			{
+				b2Assert(staticBodyTotal < staticBodyCapacity);
+				staticBodies[staticBodyTotal].body = b;
+				staticBodies[staticBodyTotal].index = b->m_islandIndex;
+				++staticBodyTotal;
 				continue;
 			}
 
@@ -481,7 +609,8 @@ void b2World::Solve(const b2TimeStep& step)
 					continue;
 				}
 
-				island.Add(contact);
+				b2Assert(contactTotal < contactCount);
+				contacts[contactTotal++] = contact;
 				contact->m_flags |= b2Contact::e_islandFlag;
 
 				b2Body* other = ce->other;
@@ -513,7 +642,8 @@ void b2World::Solve(const b2TimeStep& step)
 					continue;
 				}
 
-				island.Add(je->joint);
+				b2Assert(jointTotal < m_jointCount);
+				joints[jointTotal++] = je->joint;
 				je->joint->m_islandFlag = true;
 
 				if (other->m_flags & b2Body::e_islandFlag)
@@ -527,25 +657,142 @@ void b2World::Solve(const b2TimeStep& step)
 			}
 		}
 
-		b2Profile profile;
-		island.Solve(&profile, step, m_gravity, m_allowSleep);
-		m_profile.solveInit += profile.solveInit;
-		m_profile.solveVelocity += profile.solveVelocity;
-		m_profile.solvePosition += profile.solvePosition;
+		island->bodyCount = bodyTotal - island->bodyStart;
+		island->contactCount = contactTotal - island->contactStart;
+		island->jointCount = jointTotal - island->jointStart;
+		island->staticBodyCount = staticBodyTotal - island->staticBodyStart;
 
-		// Post solve cleanup.
-		for (int32 i = 0; i < island.m_bodyCount; ++i)
+		// Allow static bodies to participate in other islands.
+		b2IslandStaticBody* islandStaticBodies = staticBodies + island->staticBodyStart;
+		for (int32 i = 0; i < island->staticBodyCount; ++i)
 		{
-			// Allow static bodies to participate in other islands.
-			b2Body* b = island.m_bodies[i];
-			if (b->GetType() == b2_staticBody)
+			islandStaticBodies[i].body->m_flags &= ~b2Body::e_islandFlag;
+		}
+
+		// Sort the static bodies so that the island can look up their index.
+		std::sort(islandStaticBodies, islandStaticBodies + island->staticBodyCount, b2IslandStaticBodyLessThan);
+	}
+
+	m_stackAllocator.Free(stack);
+
+	// The contact impulses are reported after every island has been solved.
+	b2ContactImpulse* impulses = NULL;
+	if (listener != NULL)
+	{
+		impulses = (b2ContactImpulse*)m_stackAllocator.Allocate(contactTotal * sizeof(b2ContactImpulse));
+	}
+
+	// Solve the largest islands first.
+	int32* order = (int32*)m_stackAllocator.Allocate(islandCount * sizeof(int32));
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		order[i] = i;
+	}
+	b2IslandLargerThan largerThan;
+	largerThan.islands = islands;
+	std::stable_sort(order, order + islandCount, largerThan);
+
+	int32 threadCount = 1;
+	if (m_taskExecutor != NULL && islandCount > 1)
+	{
+		threadCount = b2Max(m_taskExecutor->GetThreadCount(), 1);
+	}
+
+	// Every thread other than this one needs its own stack allocator.
+	if (m_threadAllocatorCount < threadCount - 1)
+	{
+		b2StackAllocator** threadAllocators = (b2StackAllocator**)b2Alloc((threadCount - 1) * sizeof(b2StackAllocator*));
+		for (int32 i = 0; i < m_threadAllocatorCount; ++i)
+		{
+			threadAllocators[i] = m_threadAllocators[i];
+		}
+		for (int32 i = m_threadAllocatorCount; i < threadCount - 1; ++i)
+		{
+			void* mem = b2Alloc(sizeof(b2StackAllocator));
+			threadAllocators[i] = new (mem) b2StackAllocator;
+		}
+
+		b2Free(m_threadAllocators);
+		m_threadAllocators = threadAllocators;
+		m_threadAllocatorCount = threadCount - 1;
+	}
+
+	b2StackAllocator** allocators = (b2StackAllocator**)m_stackAllocator.Allocate(threadCount * sizeof(b2StackAllocator*));
+	b2Profile* profiles = (b2Profile*)m_stackAllocator.Allocate(threadCount * sizeof(b2Profile));
+	allocators[0] = &m_stackAllocator;
+	for (int32 i = 1; i < threadCount; ++i)
+	{
+		allocators[i] = m_threadAllocators[i - 1];
+	}
+	memset(profiles, 0, threadCount * sizeof(b2Profile));
+
+	// Simulate all the islands.
+	b2IslandSolveTask task;
+	task.step = &step;
+	task.gravity = m_gravity;
+	task.allowSleep = m_allowSleep;
+	task.bodies = bodies;
+	task.contacts = contacts;
+	task.joints = joints;
+	task.staticBodies = staticBodies;
+	task.impulses = impulses;
+	task.islands = islands;
+	task.order = order;
+	task.islandCount = islandCount;
+	task.nextIsland = 0;
+	task.allocators = allocators;
+	task.profiles = profiles;
+
+	if (threadCount > 1)
+	{
+		m_taskExecutor->Run(&task);
+	}
+	else
+	{
+		task.Execute(0);
+	}
+
+	for (int32 i = 0; i < threadCount; ++i)
+	{
+		m_profile.solveInit += profiles[i].solveInit;
+		m_profile.solveVelocity += profiles[i].solveVelocity;
+		m_profile.solvePosition += profiles[i].solvePosition;
+	}
+
+	// Post solve cleanup, in the order that the islands were found.
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		const b2IslandRange* island = islands + i;
+
+		// A static body is put to sleep by an island, then woken again by the next island that touches it.
+		const b2IslandStaticBody* islandStaticBodies = staticBodies + island->staticBodyStart;
+		for (int32 j = 0; j < island->staticBodyCount; ++j)
+		{
+			islandStaticBodies[j].body->SetAwake(island->sleeping == false);
+		}
+
+		if (impulses != NULL)
+		{
+			for (int32 j = island->contactStart; j < island->contactStart + island->contactCount; ++j)
 			{
-				b->m_flags &= ~b2Body::e_islandFlag;
+				listener->PostSolve(contacts[j], impulses + j);
 			}
 		}
 	}
 
-	m_stackAllocator.Free(stack);
+	// Warning: the order should reverse the allocation order.
+	m_stackAllocator.Free(profiles);
+	m_stackAllocator.Free(allocators);
+	m_stackAllocator.Free(order);
+	if (impulses != NULL)
+	{
+		m_stackAllocator.Free(impulses);
+	}
+	m_stackAllocator.Free(islands);
+	m_stackAllocator.Free(staticBodies);
+	m_stackAllocator.Free(joints);
+	m_stackAllocator.Free(contacts);
+	m_stackAllocator.Free(bodies);
 
 	{
 		b2Timer timer;
@@ -15,6 +15,7 @@
 #include <list>
 #include <set>
 #include <algorithm>
+#include <functional>
 
 #include <breathe/game/cAIPathFinder.h>
 
@@ -33,6 +34,13 @@ namespace breathe
 
     // ** cGraph
 
+    cGraph::cGraph() :
+      bIsOptimised(false),
+      revision(0),
+      fMinimumCostMultiplier(spitfire::math::cINFINITY)
+    {
+    }
+
     cGraph::~cGraph()
     {
       {
@@ -56,6 +64,9 @@ namespace breathe
     {
       const size_t index = nodes.size();
 
+      bIsOptimised = false;
+      revision++;
+
       cNode* pNode = new cNode;
       pNode->index = index;
       pNode->position = position;
@@ -71,6 +82,11 @@ namespace breathe
       ASSERT(nodeTo < nodes.size());
 
       ASSERT(nodeFrom != nodeTo);
+      ASSERT(fCostMultiplier >= 0.0f);
+
+      bIsOptimised = false;
+      revision++;
+      fMinimumCostMultiplier = std::min(fMinimumCostMultiplier, fCostMultiplier);
 
       cNode* pNodeFrom = nodes[nodeFrom];
       cNode* pNodeTo = nodes[nodeTo];
@@ -94,13 +110,74 @@ namespace breathe
       }
     }
 
+    void cGraph::BuildCompressedSparseRows()
+    {
+      const size_t nNodes = nodes.size();
+      const size_t nEdges = edges.size();
+
+      positions.resize(nNodes);
+      nodeCosts.resize(nNodes);
+      for (size_t i = 0; i < nNodes; i++) {
+        positions[i] = nodes[i]->position;
+        nodeCosts[i] = nodes[i]->fCost;
+      }
+
+      // The outgoing edges are already sorted cheapest first within each node
+      outgoingOffsets.resize(nNodes + 1);
+      outgoingNodes.resize(nEdges);
+      outgoingCosts.resize(nEdges);
+
+      uint32_t offset = 0;
+      for (size_t i = 0; i < nNodes; i++) {
+        outgoingOffsets[i] = offset;
+
+        const std::vector<cEdge*>& vEdges = nodes[i]->vEdges;
+        for (const cEdge* pEdge : vEdges) {
+          outgoingNodes[offset] = uint32_t(pEdge->pNodeTo->index);
+          outgoingCosts[offset] = pEdge->fCost;
+          offset++;
+        }
+      }
+      outgoingOffsets[nNodes] = offset;
+
+      // Count the incoming edges of each node and then fill them in
+      incomingOffsets.assign(nNodes + 1, 0);
+      for (const cEdge* pEdge : edges) incomingOffsets[pEdge->pNodeTo->index + 1]++;
+      for (size_t i = 0; i < nNodes; i++) incomingOffsets[i + 1] += incomingOffsets[i];
+
+      incomingNodes.resize(nEdges);
+      incomingCosts.resize(nEdges);
+
+      std::vector<uint32_t> next(incomingOffsets.begin(), incomingOffsets.end() - 1);
+      for (size_t i = 0; i < nNodes; i++) {
+        for (uint32_t e = outgoingOffsets[i]; e < outgoingOffsets[i + 1]; e++) {
+          const uint32_t destination = next[outgoingNodes[e]]++;
+          incomingNodes[destination] = uint32_t(i);
+          incomingCosts[destination] = outgoingCosts[e];
+        }
+      }
+
+      if (nEdges == 0) fMinimumCostMultiplier = 0.0f;
+
+      nodeTree.Build(positions);
+
+      bIsOptimised = true;
+      revision++;
+    }
+
     void cGraph::Optimise()
     {
       Sort();
+      BuildCompressedSparseRows();
     }
 
     const cNode* cGraph::GetClosestNode(const spitfire::math::cVec3& position) const
     {
+      if (bIsOptimised) {
+        const size_t closest = nodeTree.FindNearest(position);
+        return (closest != spitfire::math::cKDTree::NULL_INDEX) ? nodes[closest] : nullptr;
+      }
+
       float fClosestDistanceSquared = spitfire::math::cINFINITY;
       const cNode* pClosestNode = nullptr;
 
@@ -227,5 +304,223 @@ namespace breathe
         _GetLowestCostPathRecursive(graph, pNodeCurrent, pNodeEnd, path);
       }
     }
+
+
+    // ** cPathSearchContext
+
+    cPathSearchContext::cPathSearchContext() :
+      generation(0),
+      nNodesExpanded(0)
+    {
+    }
+
+    void cPathSearchContext::Reset(size_t nNodes)
+    {
+      // Starting a new generation invalidates the state of every node without touching them
+      generation++;
+      if ((states.size() != nNodes) || (generation == 0)) {
+        states.assign(nNodes, cNodeState { spitfire::math::cINFINITY, 0, 0, false });
+        generation = 1;
+      }
+
+      open.clear();
+      nNodesExpanded = 0;
+    }
+
+    void cPathSearchContext::Push(float fKey, uint32_t node)
+    {
+      open.push_back(std::make_pair(fKey, node));
+      std::push_heap(open.begin(), open.end(), std::greater<std::pair<float, uint32_t>>());
+    }
+
+    std::pair<float, uint32_t> cPathSearchContext::Pop()
+    {
+      ASSERT(!open.empty());
+      std::pop_heap(open.begin(), open.end(), std::greater<std::pair<float, uint32_t>>());
+      const std::pair<float, uint32_t> top = open.back();
+      open.pop_back();
+      return top;
+    }
+
+
+    // ** cAStar
+
+    cAStar::cAStar() :
+      fPathCost(0.0f)
+    {
+    }
+
+    bool cAStar::GetLowestCostPath(const cGraph& graph, const spitfire::math::cVec3& start, const spitfire::math::cVec3& end, std::vector<size_t>& path)
+    {
+      path.clear();
+
+      const cNode* pNodeStart = graph.GetClosestNode(start);
+      const cNode* pNodeEnd = graph.GetClosestNode(end);
+      if ((pNodeStart == nullptr) || (pNodeEnd == nullptr)) return false;
+
+      return GetLowestCostPath(graph, pNodeStart->index, pNodeEnd->index, path);
+    }
+
+    bool cAStar::GetLowestCostPath(const cGraph& graph, size_t nodeStart, size_t nodeEnd, std::vector<size_t>& path)
+    {
+      ASSERT(graph.IsOptimised());
+      ASSERT(nodeStart < graph.GetNumberOfNodes());
+      ASSERT(nodeEnd < graph.GetNumberOfNodes());
+
+      path.clear();
+      fPathCost = spitfire::math::cINFINITY;
+
+      context.Reset(graph.GetNumberOfNodes());
+
+      const uint32_t start = uint32_t(nodeStart);
+      const uint32_t end = uint32_t(nodeEnd);
+
+      context.GetState(start).fDistance = 0.0f;
+      context.Push(graph.GetHeuristicCost(start, end), start);
+
+      while (!context.open.empty()) {
+        const uint32_t current = context.Pop().second;
+
+        cPathSearchContext::cNodeState& currentState = context.GetState(current);
+        if (currentState.bIsClosed) continue; // A stale entry for a node we have already found a cheaper way to
+
+        currentState.bIsClosed = true;
+        context.nNodesExpanded++;
+
+        if (current == end) break;
+
+        const float fDistance = currentState.fDistance;
+        const uint32_t last = graph.outgoingOffsets[current + 1];
+        for (uint32_t e = graph.outgoingOffsets[current]; e < last; e++) {
+          const uint32_t next = graph.outgoingNodes[e];
+          cPathSearchContext::cNodeState& nextState = context.GetState(next);
+          if (nextState.bIsClosed) continue;
+
+          const float fNextDistance = fDistance + graph.outgoingCosts[e];
+          if (fNextDistance < nextState.fDistance) {
+            nextState.fDistance = fNextDistance;
+            nextState.parent = current;
+            context.Push(fNextDistance + graph.GetHeuristicCost(next, end), next);
+          }
+        }
+      }
+
+      if (!context.IsClosed(end)) return false;
+
+      fPathCost = context.GetDistance(end);
+
+      // Walk back from the end and then reverse the path
+      for (uint32_t node = end; node != start; node = context.states[node].parent) path.push_back(node);
+      path.push_back(start);
+      std::reverse(path.begin(), path.end());
+
+      return true;
+    }
+
+
+    // ** cBidirectionalAStar
+
+    cBidirectionalAStar::cBidirectionalAStar() :
+      fPathCost(0.0f)
+    {
+    }
+
+    bool cBidirectionalAStar::GetLowestCostPath(const cGraph& graph, size_t nodeStart, size_t nodeEnd, std::vector<size_t>& path)
+    {
+      ASSERT(graph.IsOptimised());
+      ASSERT(nodeStart < graph.GetNumberOfNodes());
+      ASSERT(nodeEnd < graph.GetNumberOfNodes());
+
+      path.clear();
+      fPathCost = spitfire::math::cINFINITY;
+
+      const size_t nNodes = graph.GetNumberOfNodes();
+      forward.Reset(nNodes);
+      backward.Reset(nNodes);
+
+      const uint32_t start = uint32_t(nodeStart);
+      const uint32_t end = uint32_t(nodeEnd);
+
+      if (start == end) {
+        fPathCost = 0.0f;
+        path.push_back(start);
+        return true;
+      }
+
+      // The forward potential is half of the distance left to the end minus half of the distance from the start, the backward potential is the negative of that
+      // Both are consistent and the keys of the two searches can be added together and compared against the best path directly
+      auto GetPotential = [&graph, start, end](uint32_t node) -> float
+      {
+        return 0.5f * (graph.GetHeuristicCost(node, end) - graph.GetHeuristicCost(start, node));
+      };
+
+      forward.GetState(start).fDistance = 0.0f;
+      forward.Push(GetPotential(start), start);
+      backward.GetState(end).fDistance = 0.0f;
+      backward.Push(-GetPotential(end), end);
+
+      float fBestCost = spitfire::math::cINFINITY;
+      uint32_t meeting = start;
+
+      while (!forward.open.empty() && !backward.open.empty()) {
+        // Nothing left in either open list can make a cheaper path than the one we already have
+        if ((forward.GetTopKey() + backward.GetTopKey()) >= fBestCost) break;
+
+        // Expand whichever side has the smaller open list
+        const bool bIsForward = (forward.open.size() <= backward.open.size());
+        cPathSearchContext& context = bIsForward ? forward : backward;
+        const cPathSearchContext& other = bIsForward ? backward : forward;
+        const std::vector<uint32_t>& offsets = bIsForward ? graph.outgoingOffsets : graph.incomingOffsets;
+        const std::vector<uint32_t>& neighbours = bIsForward ? graph.outgoingNodes : graph.incomingNodes;
+        const std::vector<float>& costs = bIsForward ? graph.outgoingCosts : graph.incomingCosts;
+        const float fSign = bIsForward ? 1.0f : -1.0f;
+
+        const uint32_t current = context.Pop().second;
+
+        cPathSearchContext::cNodeState& currentState = context.GetState(current);
+        if (currentState.bIsClosed) continue;
+
+        currentState.bIsClosed = true;
+        context.nNodesExpanded++;
+
+        const float fDistance = currentState.fDistance;
+        const uint32_t last = offsets[current + 1];
+        for (uint32_t e = offsets[current]; e < last; e++) {
+          const uint32_t next = neighbours[e];
+          cPathSearchContext::cNodeState& nextState = context.GetState(next);
+          if (nextState.bIsClosed) continue;
+
+          const float fNextDistance = fDistance + costs[e];
+          if (fNextDistance < nextState.fDistance) {
+            nextState.fDistance = fNextDistance;
+            nextState.parent = current;
+            context.Push(fNextDistance + (fSign * GetPotential(next)), next);
+
+            // If the other search has reached this node then we have a path through it
+            const float fCost = fNextDistance + other.GetDistance(next);
+            if (fCost < fBestCost) {
+              fBestCost = fCost;
+              meeting = next;
+            }
+          }
+        }
+      }
+
+      if (fBestCost == spitfire::math::cINFINITY) return false;
+
+      fPathCost = fBestCost;
+
+      // Walk back from the meeting node to the start, then forward from the meeting node to the end
+      for (uint32_t node = meeting; node != start; node = forward.states[node].parent) path.push_back(node);
+      path.push_back(start);
+      std::reverse(path.begin(), path.end());
+
+      for (uint32_t node = meeting; node != end;) {
+        node = backward.states[node].parent;
+        path.push_back(node);
+      }
+
+      return true;
+    }
   }
 }
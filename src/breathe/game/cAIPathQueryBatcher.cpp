@@ -0,0 +1,252 @@
+// Standard headers
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/game/cAIPathQueryBatcher.h>
+
+namespace breathe
+{
+  namespace ai
+  {
+    // ** cFlowField
+
+    cFlowField::cFlowField(const cGraph& _graph, size_t _destination, const cPathPersonality& personality) :
+      graph(_graph),
+      destination(uint32_t(_destination)),
+      fNodeCostWeighting(personality.fNodeCostWeighting),
+      revision(_graph.GetRevision()),
+      nNodesSettled(0)
+    {
+      ASSERT(graph.IsOptimised());
+      ASSERT(_destination < graph.GetNumberOfNodes());
+      ASSERT(fNodeCostWeighting >= 0.0f);
+
+      const size_t nNodes = graph.GetNumberOfNodes();
+      costs.assign(nNodes, spitfire::math::cINFINITY);
+      next.assign(nNodes, INVALID_NODE);
+      settled.assign(nNodes, 0);
+
+      costs[destination] = 0.0f;
+      open.push_back(std::make_pair(0.0f, destination));
+    }
+
+    bool cFlowField::ExpandUntil(size_t node)
+    {
+      ASSERT(IsUpToDate());
+      ASSERT(node < settled.size());
+
+      const std::greater<std::pair<float, uint32_t>> compare;
+
+      while (!settled[node] && !open.empty()) {
+        std::pop_heap(open.begin(), open.end(), compare);
+        const uint32_t current = open.back().second;
+        open.pop_back();
+
+        if (settled[current]) continue; // A stale entry for a node we have already found a cheaper way from
+
+        settled[current] = 1;
+        nNodesSettled++;
+
+        // Every edge into the current node is a way of getting here from another node
+        const float fCost = costs[current] + (fNodeCostWeighting * graph.nodeCosts[current]);
+        const uint32_t last = graph.incomingOffsets[current + 1];
+        for (uint32_t e = graph.incomingOffsets[current]; e < last; e++) {
+          const uint32_t previous = graph.incomingNodes[e];
+          if (settled[previous]) continue;
+
+          const float fPreviousCost = fCost + graph.incomingCosts[e];
+          if (fPreviousCost < costs[previous]) {
+            costs[previous] = fPreviousCost;
+            next[previous] = current;
+            open.push_back(std::make_pair(fPreviousCost, previous));
+            std::push_heap(open.begin(), open.end(), compare);
+          }
+        }
+      }
+
+      return (settled[node] != 0);
+    }
+
+    void cFlowField::GetPath(size_t node, std::vector<size_t>& path) const
+    {
+      ASSERT(IsSettled(node));
+
+      path.clear();
+      for (uint32_t current = uint32_t(node); current != INVALID_NODE; current = next[current]) path.push_back(current);
+
+      ASSERT(path.back() == destination);
+    }
+
+
+    // ** cPathQueryBatcher
+
+    bool cPathQueryBatcher::cKey::operator<(const cKey& rhs) const
+    {
+      if (zone != rhs.zone) return (zone < rhs.zone);
+      if (personality != rhs.personality) return (personality < rhs.personality);
+      return (destination < rhs.destination);
+    }
+
+    cPathQueryBatcher::cPathQueryBatcher() :
+      nMaximumCachedFlowFields(64),
+      batch(0),
+      nCacheHits(0),
+      nCacheMisses(0)
+    {
+    }
+
+    void cPathQueryBatcher::AddZone(uint32_t zone, const cGraph& graph)
+    {
+      InvalidateZone(zone);
+      zones[zone] = &graph;
+    }
+
+    void cPathQueryBatcher::SetPersonality(uint32_t personality, const cPathPersonality& settings)
+    {
+      personalities[personality] = settings;
+
+      // Anything searched with the old settings is out of date
+      std::map<cKey, cCacheEntry>::iterator iter = cache.begin();
+      while (iter != cache.end()) {
+        if (iter->first.personality == personality) iter = cache.erase(iter);
+        else iter++;
+      }
+    }
+
+    void cPathQueryBatcher::InvalidateZone(uint32_t zone)
+    {
+      std::map<cKey, cCacheEntry>::iterator iter = cache.begin();
+      while (iter != cache.end()) {
+        if (iter->first.zone == zone) iter = cache.erase(iter);
+        else iter++;
+      }
+    }
+
+    void cPathQueryBatcher::Clear()
+    {
+      queries.clear();
+      order.clear();
+      groups.clear();
+      results.clear();
+    }
+
+    size_t cPathQueryBatcher::AddQuery(const cPathQuery& query)
+    {
+      ASSERT(zones.find(query.zone) != zones.end());
+      ASSERT(personalities.find(query.personality) != personalities.end());
+
+      const size_t index = queries.size();
+      queries.push_back(query);
+      return index;
+    }
+
+    void cPathQueryBatcher::Evict()
+    {
+      if (cache.size() <= nMaximumCachedFlowFields) return;
+
+      // Remove the least recently used entries first, anything used in this batch is kept
+      std::vector<std::map<cKey, cCacheEntry>::iterator> entries;
+      entries.reserve(cache.size());
+      for (std::map<cKey, cCacheEntry>::iterator iter = cache.begin(); iter != cache.end(); iter++) {
+        if (iter->second.lastUsed != batch) entries.push_back(iter);
+      }
+
+      std::sort(entries.begin(), entries.end(), [](const std::map<cKey, cCacheEntry>::iterator& lhs, const std::map<cKey, cCacheEntry>::iterator& rhs) {
+        return (lhs->second.lastUsed < rhs->second.lastUsed);
+      });
+
+      const size_t nToRemove = std::min(entries.size(), cache.size() - nMaximumCachedFlowFields);
+      for (size_t i = 0; i < nToRemove; i++) cache.erase(entries[i]);
+    }
+
+    void cPathQueryBatcher::Prepare()
+    {
+      batch++;
+      nCacheHits = 0;
+      nCacheMisses = 0;
+
+      const size_t n = queries.size();
+      results.assign(n, cPathQueryResult());
+      if (paths.size() < n) paths.resize(n);
+
+      // Sort the queries so that each group is contiguous
+      order.clear();
+      order.reserve(n);
+      for (size_t i = 0; i < n; i++) order.push_back(std::make_pair(cKey { queries[i].zone, queries[i].personality, queries[i].nodeEnd }, i));
+      std::sort(order.begin(), order.end());
+
+      // Find or create the flow field for each group, this has to be done before the groups are run in parallel
+      groups.clear();
+      size_t first = 0;
+      while (first < n) {
+        const cKey& key = order[first].first;
+
+        size_t last = first + 1;
+        while ((last < n) && (order[last].first == key)) last++;
+
+        std::map<cKey, cCacheEntry>::iterator iter = cache.find(key);
+        if ((iter != cache.end()) && iter->second.pFlowField->IsUpToDate()) {
+          nCacheHits++;
+        } else {
+          nCacheMisses++;
+
+          const cGraph& graph = *zones[key.zone];
+          cCacheEntry& entry = cache[key];
+          entry.pFlowField.reset(new cFlowField(graph, key.destination, personalities[key.personality]));
+          iter = cache.find(key);
+        }
+
+        iter->second.lastUsed = batch;
+        groups.push_back(cGroup { iter->second.pFlowField.get(), first, last });
+
+        first = last;
+      }
+    }
+
+    void cPathQueryBatcher::RunGroups(size_t firstGroup, size_t lastGroup)
+    {
+      for (size_t g = firstGroup; g < lastGroup; g++) {
+        const cGroup& group = groups[g];
+        cFlowField& flowField = *group.pFlowField;
+
+        for (size_t i = group.first; i < group.last; i++) {
+          const size_t query = order[i].second;
+          const size_t nodeStart = queries[query].nodeStart;
+
+          std::vector<size_t>& path = paths[query];
+          path.clear();
+
+          if (flowField.ExpandUntil(nodeStart)) {
+            flowField.GetPath(nodeStart, path);
+            results[query].bIsFound = true;
+            results[query].fCost = flowField.GetCost(nodeStart);
+          }
+        }
+      }
+    }
+
+    void cPathQueryBatcher::Run()
+    {
+      Prepare();
+      RunGroups(0, groups.size());
+      Evict();
+    }
+
+    void cPathQueryBatcher::Run(spitfire::util::cThreadPool& threadPool)
+    {
+      Prepare();
+
+      // Each group has its own flow field so the groups can be run at the same time
+      spitfire::util::ParallelFor(threadPool, 0, groups.size(), 1, [this](size_t firstGroup, size_t lastGroup) {
+        RunGroups(firstGroup, lastGroup);
+      });
+
+      Evict();
+    }
+  }
+}
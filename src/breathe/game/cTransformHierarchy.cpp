@@ -0,0 +1,382 @@
+// Standard headers
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/game/cTransformHierarchy.h>
+
+namespace breathe
+{
+  namespace scenegraph3d
+  {
+    cTransformHierarchy::cTransformHierarchy() :
+      nGrainSize(1024),
+      nTransforms(0),
+      nUpdated(0),
+      bIsOrderDirty(false)
+    {
+    }
+
+    void cTransformHierarchy::Clear()
+    {
+      nTransforms = 0;
+      nUpdated = 0;
+      bIsOrderDirty = false;
+
+      parentTransforms.clear();
+      childCounts.clear();
+      isUsed.clear();
+      freeTransforms.clear();
+      transformToIndex.clear();
+
+      indexToTransform.clear();
+      parents.clear();
+      relativePositions.clear();
+      relativeRotations.clear();
+      absoluteMatrices.clear();
+      isDirty.clear();
+      isChanged.clear();
+      taskForIndex.clear();
+
+      spine.clear();
+      tasks.clear();
+      isTaskDirty.clear();
+      dirtyTasks.clear();
+    }
+
+    size_t cTransformHierarchy::GetIndex(size_t transform) const
+    {
+      ASSERT(transform < isUsed.size());
+      ASSERT(isUsed[transform] != 0);
+      return transformToIndex[transform];
+    }
+
+    void cTransformHierarchy::MarkDirty(size_t index)
+    {
+      isDirty[index] = 1;
+
+      // After the order is rebuilt the dirty tasks are found from the dirty flags instead
+      if (!bIsOrderDirty) {
+        const size_t task = taskForIndex[index];
+        if (task != NULL_TRANSFORM) isTaskDirty[task] = 1;
+      }
+    }
+
+    size_t cTransformHierarchy::Create(size_t parent)
+    {
+      ASSERT((parent == NULL_TRANSFORM) || ((parent < isUsed.size()) && (isUsed[parent] != 0)));
+
+      size_t transform = 0;
+      if (!freeTransforms.empty()) {
+        transform = freeTransforms.back();
+        freeTransforms.pop_back();
+        parentTransforms[transform] = parent;
+        childCounts[transform] = 0;
+        isUsed[transform] = 1;
+      } else {
+        transform = parentTransforms.size();
+        parentTransforms.push_back(parent);
+        childCounts.push_back(0);
+        isUsed.push_back(1);
+        transformToIndex.push_back(0);
+      }
+
+      if (parent != NULL_TRANSFORM) childCounts[parent]++;
+
+      // New transforms are appended out of order until the next RebuildOrder
+      transformToIndex[transform] = indexToTransform.size();
+      indexToTransform.push_back(transform);
+      parents.push_back(NULL_TRANSFORM);
+      relativePositions.push_back(spitfire::math::cVec3());
+      relativeRotations.push_back(spitfire::math::cQuaternion());
+      absoluteMatrices.push_back(spitfire::math::cMat4());
+      isDirty.push_back(1);
+      isChanged.push_back(0);
+      taskForIndex.push_back(NULL_TRANSFORM);
+
+      nTransforms++;
+      bIsOrderDirty = true;
+
+      return transform;
+    }
+
+    void cTransformHierarchy::Destroy(size_t transform)
+    {
+      GetIndex(transform);
+      ASSERT(childCounts[transform] == 0);
+
+      const size_t parent = parentTransforms[transform];
+      if (parent != NULL_TRANSFORM) childCounts[parent]--;
+
+      isUsed[transform] = 0;
+      freeTransforms.push_back(transform);
+
+      nTransforms--;
+      bIsOrderDirty = true;
+    }
+
+    void cTransformHierarchy::SetParent(size_t transform, size_t parent)
+    {
+      const size_t index = GetIndex(transform);
+      ASSERT((parent == NULL_TRANSFORM) || ((parent < isUsed.size()) && (isUsed[parent] != 0)));
+
+#ifndef NDEBUG
+      // We can't be moved below one of our own descendants
+      for (size_t ancestor = parent; ancestor != NULL_TRANSFORM; ancestor = parentTransforms[ancestor]) {
+        ASSERT(ancestor != transform);
+      }
+#endif
+
+      const size_t oldParent = parentTransforms[transform];
+      if (oldParent == parent) return;
+
+      if (oldParent != NULL_TRANSFORM) childCounts[oldParent]--;
+      if (parent != NULL_TRANSFORM) childCounts[parent]++;
+      parentTransforms[transform] = parent;
+
+      MarkDirty(index);
+      bIsOrderDirty = true;
+    }
+
+    size_t cTransformHierarchy::GetParent(size_t transform) const
+    {
+      GetIndex(transform);
+      return parentTransforms[transform];
+    }
+
+    const spitfire::math::cVec3& cTransformHierarchy::GetRelativePosition(size_t transform) const
+    {
+      return relativePositions[GetIndex(transform)];
+    }
+
+    const spitfire::math::cQuaternion& cTransformHierarchy::GetRelativeRotation(size_t transform) const
+    {
+      return relativeRotations[GetIndex(transform)];
+    }
+
+    void cTransformHierarchy::SetRelativePosition(size_t transform, const spitfire::math::cVec3& position)
+    {
+      const size_t index = GetIndex(transform);
+      relativePositions[index] = position;
+      MarkDirty(index);
+    }
+
+    void cTransformHierarchy::SetRelativeRotation(size_t transform, const spitfire::math::cQuaternion& rotation)
+    {
+      const size_t index = GetIndex(transform);
+      relativeRotations[index] = rotation;
+      MarkDirty(index);
+    }
+
+    const spitfire::math::cMat4& cTransformHierarchy::GetAbsoluteMatrix(size_t transform) const
+    {
+      return absoluteMatrices[GetIndex(transform)];
+    }
+
+    bool cTransformHierarchy::IsAbsoluteMatrixDirty(size_t transform) const
+    {
+      for (size_t ancestor = transform; ancestor != NULL_TRANSFORM; ancestor = parentTransforms[ancestor]) {
+        if (isDirty[GetIndex(ancestor)] != 0) return true;
+      }
+
+      return false;
+    }
+
+    void cTransformHierarchy::RebuildOrder()
+    {
+      const size_t nSlots = parentTransforms.size();
+
+      // Build the children of each transform, in the order they were created so that the order is repeatable
+      std::vector<size_t> childOffsets(nSlots + 1, 0);
+      for (size_t transform = 0; transform < nSlots; transform++) {
+        if ((isUsed[transform] != 0) && (parentTransforms[transform] != NULL_TRANSFORM)) childOffsets[parentTransforms[transform] + 1]++;
+      }
+      for (size_t transform = 0; transform < nSlots; transform++) childOffsets[transform + 1] += childOffsets[transform];
+
+      std::vector<size_t> children(childOffsets[nSlots]);
+      std::vector<size_t> nextChild(childOffsets.begin(), childOffsets.end() - 1);
+      for (size_t transform = 0; transform < nSlots; transform++) {
+        if ((isUsed[transform] != 0) && (parentTransforms[transform] != NULL_TRANSFORM)) children[nextChild[parentTransforms[transform]]++] = transform;
+      }
+
+      // Depth first order, pushing the children in reverse so that they come out in order
+      std::vector<size_t> newIndexToTransform;
+      newIndexToTransform.reserve(nTransforms);
+      std::vector<size_t> stack;
+      for (size_t root = nSlots; root != 0; root--) {
+        const size_t transform = root - 1;
+        if ((isUsed[transform] != 0) && (parentTransforms[transform] == NULL_TRANSFORM)) stack.push_back(transform);
+      }
+      while (!stack.empty()) {
+        const size_t transform = stack.back();
+        stack.pop_back();
+        newIndexToTransform.push_back(transform);
+
+        for (size_t i = childOffsets[transform + 1]; i != childOffsets[transform]; i--) stack.push_back(children[i - 1]);
+      }
+      ASSERT(newIndexToTransform.size() == nTransforms);
+
+      // Move the data into the new order
+      const size_t n = newIndexToTransform.size();
+      std::vector<size_t> newParents(n, NULL_TRANSFORM);
+      std::vector<spitfire::math::cVec3> newRelativePositions(n);
+      std::vector<spitfire::math::cQuaternion> newRelativeRotations(n);
+      std::vector<spitfire::math::cMat4> newAbsoluteMatrices(n);
+      std::vector<uint8_t> newIsDirty(n);
+      for (size_t index = 0; index < n; index++) {
+        const size_t transform = newIndexToTransform[index];
+        const size_t oldIndex = transformToIndex[transform];
+        newRelativePositions[index] = relativePositions[oldIndex];
+        newRelativeRotations[index] = relativeRotations[oldIndex];
+        newAbsoluteMatrices[index] = absoluteMatrices[oldIndex];
+        newIsDirty[index] = isDirty[oldIndex];
+      }
+      for (size_t index = 0; index < n; index++) transformToIndex[newIndexToTransform[index]] = index;
+      for (size_t index = 0; index < n; index++) {
+        const size_t parent = parentTransforms[newIndexToTransform[index]];
+        if (parent != NULL_TRANSFORM) newParents[index] = transformToIndex[parent];
+      }
+
+      indexToTransform.swap(newIndexToTransform);
+      parents.swap(newParents);
+      relativePositions.swap(newRelativePositions);
+      relativeRotations.swap(newRelativeRotations);
+      absoluteMatrices.swap(newAbsoluteMatrices);
+      isDirty.swap(newIsDirty);
+      isChanged.assign(n, 0);
+      taskForIndex.assign(n, NULL_TRANSFORM);
+
+      // Subtree sizes, children always come after their parent so walk backwards
+      std::vector<size_t> subtreeSizes(n, 1);
+      for (size_t index = n; index != 0; index--) {
+        const size_t parent = parents[index - 1];
+        if (parent != NULL_TRANSFORM) subtreeSizes[parent] += subtreeSizes[index - 1];
+      }
+
+      // Split the hierarchy into tasks, each range of siblings is cut into runs of whole subtrees up to the grain size
+      // and any subtree that is too big becomes part of the spine and its children are split in turn
+      spine.clear();
+      tasks.clear();
+
+      std::vector<std::pair<size_t, size_t>> ranges;
+      ranges.push_back(std::make_pair(size_t(0), n));
+      while (!ranges.empty()) {
+        const size_t first = ranges.back().first;
+        const size_t last = ranges.back().second;
+        ranges.pop_back();
+
+        size_t taskFirst = first;
+        size_t index = first;
+        while (index < last) {
+          const size_t nSize = subtreeSizes[index];
+          if (nSize > nGrainSize) {
+            if (taskFirst != index) tasks.push_back(cTask { taskFirst, index });
+            spine.push_back(index);
+            ranges.push_back(std::make_pair(index + 1, index + nSize));
+            index += nSize;
+            taskFirst = index;
+          } else {
+            if ((index + nSize - taskFirst) > nGrainSize) {
+              tasks.push_back(cTask { taskFirst, index });
+              taskFirst = index;
+            }
+            index += nSize;
+          }
+        }
+        if (taskFirst != last) tasks.push_back(cTask { taskFirst, last });
+      }
+
+      std::sort(spine.begin(), spine.end());
+
+      isTaskDirty.assign(tasks.size(), 0);
+      for (size_t task = 0; task < tasks.size(); task++) {
+        for (size_t index = tasks[task].first; index < tasks[task].last; index++) {
+          taskForIndex[index] = task;
+          if (isDirty[index] != 0) isTaskDirty[task] = 1;
+        }
+      }
+
+      freeTransforms.clear();
+      for (size_t transform = 0; transform < nSlots; transform++) {
+        if (isUsed[transform] == 0) freeTransforms.push_back(transform);
+      }
+
+      bIsOrderDirty = false;
+    }
+
+    size_t cTransformHierarchy::UpdateRange(size_t first, size_t last)
+    {
+      size_t nUpdatedInRange = 0;
+
+      for (size_t index = first; index < last; index++) {
+        const size_t parent = parents[index];
+        const bool bIsChanged = (isDirty[index] != 0) || ((parent != NULL_TRANSFORM) && (isChanged[parent] != 0));
+        if (bIsChanged) {
+          spitfire::math::cMat4 matRelative;
+          matRelative.SetRotation(relativeRotations[index]);
+          matRelative.SetTranslation(relativePositions[index]);
+
+          if (parent != NULL_TRANSFORM) absoluteMatrices[index] = absoluteMatrices[parent] * matRelative;
+          else absoluteMatrices[index] = matRelative;
+
+          isDirty[index] = 0;
+          nUpdatedInRange++;
+        }
+        isChanged[index] = bIsChanged ? 1 : 0;
+      }
+
+      return nUpdatedInRange;
+    }
+
+    void cTransformHierarchy::_Update(spitfire::util::cThreadPool* pPool)
+    {
+      if (bIsOrderDirty) RebuildOrder();
+
+      nUpdated = 0;
+
+      // The spine is small so it is always walked, this also clears the changed flags from the last update
+      for (size_t index : spine) nUpdated += UpdateRange(index, index + 1);
+
+      // A task has to run if anything in it is dirty or the spine transform above it has moved
+      dirtyTasks.clear();
+      for (size_t task = 0; task < tasks.size(); task++) {
+        const size_t parent = parents[tasks[task].first];
+        if ((isTaskDirty[task] != 0) || ((parent != NULL_TRANSFORM) && (isChanged[parent] != 0))) {
+          dirtyTasks.push_back(task);
+          isTaskDirty[task] = 0;
+        }
+      }
+
+      if (pPool == nullptr) {
+        for (size_t task : dirtyTasks) nUpdated += UpdateRange(tasks[task].first, tasks[task].last);
+        return;
+      }
+
+      nUpdated += spitfire::util::ParallelReduce(*pPool, 0, dirtyTasks.size(), 1, size_t(0),
+        [this](size_t first, size_t last) {
+          size_t nUpdatedInTasks = 0;
+          for (size_t i = first; i < last; i++) {
+            const cTask& task = tasks[dirtyTasks[i]];
+            nUpdatedInTasks += UpdateRange(task.first, task.last);
+          }
+          return nUpdatedInTasks;
+        },
+        [](size_t lhs, size_t rhs) { return lhs + rhs; }
+      );
+    }
+
+    void cTransformHierarchy::Update()
+    {
+      _Update(nullptr);
+    }
+
+    void cTransformHierarchy::Update(spitfire::util::cThreadPool& pool)
+    {
+      _Update(&pool);
+    }
+  }
+}
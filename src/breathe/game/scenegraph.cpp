@@ -4,6 +4,7 @@
 #include <cmath>
 #include <cstring>
 
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <list>
@@ -30,6 +31,7 @@
 #include <spitfire/util/log.h>
 #include <spitfire/util/cTimer.h>
 #include <spitfire/util/unittest.h>
+#include <spitfire/util/threadpool.h>
 
 #include <spitfire/storage/filesystem.h>
 #include <spitfire/storage/xml.h>
@@ -42,6 +44,7 @@
 #include <spitfire/math/cPlane.h>
 #include <spitfire/math/cQuaternion.h>
 #include <spitfire/math/cFrustum.h>
+#include <spitfire/math/cFrustumCuller.h>
 #include <spitfire/math/cOctree.h>
 #include <spitfire/math/cColour.h>
 #include <spitfire/math/geometry.h>
@@ -159,8 +162,13 @@ namespace breathe
       bIsVisible(true),
       bIsBoundingVolumeDirty(true),
       bHasRelativePosition(false),
-      bHasRelativeRotation(false)
+      bHasRelativeRotation(false),
+      bHasLocalBoundingBox(false),
+      cullingProxy(math::cDynamicAABBTree::NULL_PROXY),
+      pTransforms(nullptr),
+      transform(cTransformHierarchy::NULL_TRANSFORM)
     {
+      localBoundingBox.SetMinMax(math::v3Zero, math::v3Zero);
     }
 
     // Determines whether this node is in the scene graph, ie. whether it's ultimate ancestor is the root scene node.
@@ -192,6 +200,7 @@ namespace breathe
     {
       bHasRelativePosition = true;
       relativePosition = position;
+      if (pTransforms != nullptr) pTransforms->SetRelativePosition(transform, position);
       SetBoundingVolumeDirty();
     }
 
@@ -199,12 +208,16 @@ namespace breathe
     {
       bHasRelativeRotation = true;
       relativeRotation = rotation;
+      if (pTransforms != nullptr) pTransforms->SetRelativeRotation(transform, rotation);
       SetBoundingVolumeDirty();
     }
 
     // If we don't have a parent return our relative position, else return our parent's absolute position + our own
     spitfire::math::cMat4 cSceneNode::GetAbsoluteMatrix() const
     {
+      // Once we are in the scenegraph our absolute matrix is calculated in cSceneGraph::Update, until then we calculate it from our parents
+      if ((pTransforms != nullptr) && !pTransforms->IsAbsoluteMatrixDirty(transform)) return pTransforms->GetAbsoluteMatrix(transform);
+
       spitfire::math::cMat4 mat;
       if (bHasRelativeRotation) mat.SetRotation(relativeRotation);
       if (bHasRelativePosition) mat.SetTranslation(relativePosition);
@@ -214,6 +227,11 @@ namespace breathe
       return mat;
     }
 
+    math::cAABB3 cSceneNode::GetCullingBox() const
+    {
+      return math::GetTransformedAABB(localBoundingBox, GetAbsoluteMatrix());
+    }
+
     spitfire::math::cVec3 cSceneNode::GetAbsolutePosition() const
     {
       return GetAbsoluteMatrix().GetTranslation();
@@ -248,7 +266,7 @@ namespace breathe
       if (bHasRelativePosition) boundingSphere.position += relativePosition;
 
       // Set our boundingSphere volume from our possible children as only a derived class will know how
-      boundingSphere.fRadius = UpdateBoundingVolumeAndSetBoundingVolumeNotDirtyReturningBoundingVolumeRadius();
+      boundingSphere.fRadius = _UpdateBoundingVolumeAndSetBoundingVolumeNotDirtyReturningBoundingVolumeRadius();
 
       // We have now updated our boundingSphere and we are not dirty any more
       bIsBoundingVolumeDirty = false;
@@ -270,7 +288,7 @@ namespace breathe
       if (bHasRelativePosition) boundingSphere.position += relativePosition;
 
       // Set our boundingSphere volume from our possible children as only a derived class will know how
-      boundingSphere.fRadius = UpdateBoundingVolumeAndSetBoundingVolumeNotDirtyReturningBoundingVolumeRadius();
+      boundingSphere.fRadius = _UpdateBoundingVolumeAndSetBoundingVolumeNotDirtyReturningBoundingVolumeRadius();
 
       // We have now updated our boundingSphere and we are not dirty any more
       bIsBoundingVolumeDirty = false;
@@ -283,9 +301,24 @@ namespace breathe
       ASSERT(pChild != nullptr);
       ASSERT(!IsParentOfChild(pChild));
 
+      // If pChild is being moved from another parent it has to be detached from that parent first
+      if (pChild->pParent != nullptr) {
+        pChild->pParent->_DetachChild(pChild);
+        pChild->pParent->SetBoundingVolumeDirty();
+      }
+
       _AttachChild(pChild);
 
       pChild->pParent = shared_from_this();
+
+      // Within the same hierarchy the transform of pChild is just moved, otherwise it leaves its old hierarchy and joins ours if we have one
+      if ((pTransforms != nullptr) && (pChild->pTransforms == pTransforms)) pTransforms->SetParent(pChild->transform, transform);
+      else {
+        if (pChild->pTransforms != nullptr) pChild->RemoveFromTransformHierarchy();
+        if (pTransforms != nullptr) pChild->AddToTransformHierarchy(*pTransforms, transform);
+      }
+
+      SetBoundingVolumeDirty();
     }
 
     void cSceneNode::DetachChildForUseLater(cSceneNodeRef pChild)
@@ -295,6 +328,8 @@ namespace breathe
 
       _DetachChild(pChild);
 
+      if (pChild->pTransforms != nullptr) pChild->RemoveFromTransformHierarchy();
+
       pChild->pParent.reset();
     }
 
@@ -305,9 +340,49 @@ namespace breathe
 
       _DeleteChildRecursively(pChild);
 
+      if (pChild->pTransforms != nullptr) pChild->RemoveFromTransformHierarchy();
+
       pChild->pParent.reset();
     }
 
+    void cSceneNode::AddToTransformHierarchy(cTransformHierarchy& transforms, size_t parent)
+    {
+      ASSERT(pTransforms == nullptr);
+
+      pTransforms = &transforms;
+      transform = transforms.Create(parent);
+      if (bHasRelativePosition) transforms.SetRelativePosition(transform, relativePosition);
+      if (bHasRelativeRotation) transforms.SetRelativeRotation(transform, relativeRotation);
+
+      child_iterator iter(children.begin());
+      const child_iterator iterEnd(children.end());
+      while (iter != iterEnd) {
+        ASSERT(*iter != nullptr);
+        (*iter)->AddToTransformHierarchy(transforms, transform);
+
+        iter++;
+      }
+    }
+
+    void cSceneNode::RemoveFromTransformHierarchy()
+    {
+      ASSERT(pTransforms != nullptr);
+
+      // Our children have to be removed first
+      child_iterator iter(children.begin());
+      const child_iterator iterEnd(children.end());
+      while (iter != iterEnd) {
+        ASSERT(*iter != nullptr);
+        if ((*iter)->pTransforms != nullptr) (*iter)->RemoveFromTransformHierarchy();
+
+        iter++;
+      }
+
+      pTransforms->Destroy(transform);
+      pTransforms = nullptr;
+      transform = cTransformHierarchy::NULL_TRANSFORM;
+    }
+
 
 
 
@@ -339,6 +414,7 @@ namespace breathe
       while (iter != iterEnd) {
         ASSERT(*iter != nullptr);
         (*iter)->DeleteAllChildrenRecursively();
+        if ((*iter)->pTransforms != nullptr) (*iter)->RemoveFromTransformHierarchy();
 
         iter++;
       }
@@ -404,6 +480,8 @@ namespace breathe
 
     void cModelNode::_Cull(cCullVisitor& visitor)
     {
+      if (!visitor.IsVisible(*this)) return;
+
       cSceneNode::_Cull(visitor);
 
       visitor.Visit(&stateset, GetAbsoluteMatrix());
@@ -420,6 +498,8 @@ namespace breathe
 
     void cAnimationNode::_Cull(cCullVisitor& visitor)
     {
+      if (!visitor.IsVisible(*this)) return;
+
       cSceneNode::_Cull(visitor);
 
       visitor.Visit(&animation.model, GetAbsoluteMatrix());
@@ -495,11 +575,70 @@ namespace breathe
 
     void cLODNode::_Cull(cCullVisitor& visitor)
     {
-      if (node.empty()) return;
+      if (node.empty() || !visitor.IsVisible(*this)) return;
+
+      // Pick the level by distance if we have switch distances, otherwise use the level that was set with SetLOD
+      if (distances.size() == node.size()) {
+        const float fDistance = (GetAbsolutePosition() - visitor.GetCameraPosition()).GetLength();
+        index = render::model::GetStaticModelLODLevel(distances, fDistance);
+      }
       ASSERT(index < node.size());
 
       // Only visit the node that we require
-      //visitor.Visit(*node[index]);
+      visitor.Visit(*node[index]);
+    }
+
+
+    cLODNodeRef CreateLODNode(const render::model::cStaticModelLOD& lods)
+    {
+      ASSERT(!lods.lod.empty());
+      ASSERT(lods.distances.size() == lods.lod.size());
+
+      cLODNodeRef pLODNode(new cLODNode);
+
+      const size_t n = lods.lod.size();
+      for (size_t i = 0; i < n; i++) {
+        cGroupNodeRef pLevel(new cGroupNode);
+
+        for (const render::model::cStaticModelMesh* pMesh : lods.lod[i]->mesh) {
+          opengl::cGeometryDataPtr pGeometryData = opengl::CreateGeometryData();
+          if (!render::model::GetGeometryData(*pMesh, *pGeometryData)) {
+            LOGERROR("Level ", i, " could not be converted");
+            return cLODNodeRef();
+          }
+
+          render::cVertexBufferObjectRef pVBO(new render::cVertexBufferObject);
+          pVBO->SetData(pGeometryData);
+          pVBO->Compile();
+
+          cModelNodeRef pNode(new cModelNode);
+
+          math::cAABB3 box;
+          if (pMesh->GetBoundingBox(box)) pNode->SetLocalBoundingBox(box);
+
+          scenegraph3d::cStateSet& stateset = pNode->GetStateSet();
+          pResourceManager->AddMaterial(pMesh->sMaterial);
+          stateset.SetStateFromMaterial(pResourceManager->GetMaterial(pMesh->sMaterial));
+          stateset.SetGeometryTypeTriangles();
+
+          scenegraph_common::cStateVertexBufferObject& vertexBufferObject = stateset.GetVertexBufferObject();
+          vertexBufferObject.SetVertexBufferObject(pVBO);
+          vertexBufferObject.SetEnabled(true);
+          vertexBufferObject.SetHasValidValue(true);
+
+          pLevel->AttachChild(pNode);
+        }
+
+        pLODNode->AttachChild(pLevel);
+      }
+
+      pLODNode->SetSwitchDistances(lods.distances);
+
+      // Bounds around every level so that the node can be added to the culling tree
+      math::cAABB3 box;
+      if (render::model::GetStaticModelLODBoundingBox(lods, box)) pLODNode->SetLocalBoundingBox(box);
+
+      return pLODNode;
     }
 
 
@@ -689,9 +828,33 @@ namespace breathe
 
     cCullVisitor::cCullVisitor(cSceneGraph& _scenegraph, const render::cCamera& _camera) :
       scenegraph(_scenegraph),
-      camera(_camera)
+      camera(_camera),
+      bIsCullingEnabled(_scenegraph.IsCullingEnabled())
     {
       ASSERT(scenegraph.GetRoot() != nullptr);
+
+      scenegraph.GetRenderGraph().fFarClipDistance = camera.GetFarClipDistance();
+
+      if (bIsCullingEnabled) {
+        // The projection of the camera, built the same way as cFrustum::Update
+        const float fNear = camera.GetNearClipDistance();
+        const float fFar = camera.GetFarClipDistance();
+        const float fTop = fNear * tan(0.5f * math::DegreesToRadians(camera.GetFieldOfViewDegrees()));
+        const float fRight = fTop * camera.GetAspectRatio();
+
+        math::cMat4 matProjection;
+        matProjection.SetPerspective(-fRight, fRight, -fTop, fTop, fNear, fFar);
+
+        math::cMat4 matView;
+        matView.SetLookAt(camera.GetEyePosition(), camera.GetLookAtPoint(), camera.GetUpDirection());
+
+        math::cFrustumCuller culler;
+        culler.SetFromViewProjectionMatrix(matProjection * matView);
+
+        scenegraph.cullingTree.Cull(culler, visibleNodes);
+        std::sort(visibleNodes.begin(), visibleNodes.end());
+      }
+
       Visit(*scenegraph.GetRoot());
 
       /*listOpaque.clear();
@@ -704,6 +867,13 @@ namespace breathe
       mTransparent.add(fDistance, item);*/
     }
 
+    bool cCullVisitor::IsVisible(const cSceneNode& node) const
+    {
+      if (!bIsCullingEnabled || (node.cullingProxy == math::cDynamicAABBTree::NULL_PROXY)) return true;
+
+      return std::binary_search(visibleNodes.begin(), visibleNodes.end(), static_cast<void*>(const_cast<cSceneNode*>(&node)));
+    }
+
     void cCullVisitor::Visit(cStateSet* pStateSet, const spitfire::math::cMat4& matAbsolutePositionAndRotation)
     {
       scenegraph.GetRenderGraph().AddRenderable(pStateSet, matAbsolutePositionAndRotation);
@@ -750,114 +920,224 @@ namespace breathe
 
 
 
-    void cRenderVisitor::ApplyStateSet(cStateSet& stateSet)
+    // What _Draw needs to know about each renderable
+    class cRenderGraphDraw
     {
-      size_t n = render::MAX_TEXTURE_UNITS;
-      size_t unit = 0;
+    public:
+      render::cVertexBufferObjectRef pVbo;
+      scenegraph_common::GEOMETRY_TYPE geometryType;
+      const spitfire::math::cMat4* pMatAbsolutePositionAndRotation;
+      render::cRenderState state;
+      uint8_t layer;
+      float fDepth;
+      uint32_t instancingShader; // The render queue identifier of the instancing variant of the shader, 0 if there isn't one
+
+      // Set for instanced batches, column major matrices in the instance batcher
+      const float* pInstanceMatrices;
+      size_t nInstances;
+    };
 
-      unit = GL_TEXTURE0_ARB;
+    // Gives each shader, texture or vertex buffer object used in a frame a small identifier for the render queue, 0 is nothing
+    template <class T>
+    class cRenderQueueIdentifiers
+    {
+    public:
+      uint32_t GetIdentifier(const T& pObject);
+      const T& GetObject(uint32_t identifier) const { ASSERT(identifier != 0); return objects[identifier - 1]; }
 
-      const bool bIsAlphaBlending = stateSet.alphablending.IsValidAndTurnedOn();
+    private:
+      std::map<T, uint32_t> identifiers;
+      std::vector<T> objects;
+    };
 
-      for (size_t i = 0; i < n; i++, unit++) {
-        // Activate the current texture unit
-        glActiveTexture(unit);
+    template <class T>
+    uint32_t cRenderQueueIdentifiers<T>::GetIdentifier(const T& pObject)
+    {
+      if (pObject == nullptr) return 0;
 
-        if (bIsAlphaBlending) {
-          glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-          glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-          glEnable(GL_BLEND);
-        }
+      typename std::map<T, uint32_t>::const_iterator iter = identifiers.find(pObject);
+      if (iter != identifiers.end()) return iter->second;
 
-        if (stateSet.texture[i].IsValidAndTurnedOn()) {
-          if (stateSet.texture[i].pTexture->uiMode == render::TEXTURE_MODE::CUBE_MAP) {
-            // Cube map texture
-            glEnable(GL_TEXTURE_CUBE_MAP);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, stateSet.texture[i].pTexture->uiTexture);
+      objects.push_back(pObject);
+      const uint32_t identifier = uint32_t(objects.size());
+      identifiers[pObject] = identifier;
+      return identifier;
+    }
+
+
+    // Applies the state changes that the render queue asks for with OpenGL
+    class cSceneGraphRenderQueueContext : public render::cRenderQueueContext
+    {
+    public:
+      explicit cSceneGraphRenderQueueContext(render::cContext& context);
+
+      cRenderQueueIdentifiers<render::cShaderRef> shaders;
+      cRenderQueueIdentifiers<render::cTextureRef> textures;
+      cRenderQueueIdentifiers<render::cVertexBufferObjectRef> vertexBufferObjects;
+      std::vector<cRenderGraphDraw> draws;
+
+    private:
+      void _BindShader(uint32_t shader) override;
+      void _BindTexture(size_t unit, uint32_t texture) override;
+      void _BindVertexBufferObject(uint32_t vertexBufferObject) override;
+      void _SetAlphaBlending(bool bEnable) override;
+      void _Draw(size_t item) override;
+
+      render::cContext& context;
+      render::cTextureRef boundTextures[render::MAX_TEXTURE_UNITS];
+      render::cVertexBufferObjectRef pBoundVbo;
+    };
+
+    cSceneGraphRenderQueueContext::cSceneGraphRenderQueueContext(render::cContext& _context) :
+      context(_context)
+    {
+    }
+
+    void cSceneGraphRenderQueueContext::_BindShader(uint32_t shader)
+    {
+      if (shader == 0) pContext->UnBindShader();
+      else pContext->BindShader(shaders.GetObject(shader));
+    }
+
+    void cSceneGraphRenderQueueContext::_BindTexture(size_t unit, uint32_t texture)
+    {
+      // Activate the texture unit
+      glActiveTexture(GL_TEXTURE0_ARB + unit);
+
+      // Turn off the previous texture
+      render::cTextureRef pPrevious = boundTextures[unit];
+      if (pPrevious != nullptr) {
+        if (pPrevious->uiMode == render::TEXTURE_MODE::CUBE_MAP) {
+            glDisable(GL_TEXTURE_GEN_R);
+            glDisable(GL_TEXTURE_GEN_T);
+            glDisable(GL_TEXTURE_GEN_S);
 
             glMatrixMode(GL_TEXTURE);
-            glPushMatrix();
-              glLoadIdentity();
+            glPopMatrix();
 
-#if 0
-              float y = -Angle(spitfire::math::cVec2(frustum.eye.x, frustum.eye.y), spitfire::math::cVec2(frustum.target.x, frustum.target.y));
-              float x = -Angle(spitfire::math::cVec2(frustum.eye.y, frustum.eye.z), spitfire::math::cVec2(frustum.target.y, frustum.target.z));
-              //std::cout<<y<<"\t"<<x<<"\n";
+          glMatrixMode(GL_MODELVIEW);
 
-              glRotatef(y, 0.0f, 1.0f, 0.0f);
-              glRotatef(x, 1.0f, 0.0f, 0.0f);
-#elif 0
-              float mat[16];
-              glGetFloatv(GL_MODELVIEW_MATRIX, mat);
+          glDisable(GL_TEXTURE_CUBE_MAP);
+        } else {
+          glBindTexture(GL_TEXTURE_2D, 0);
+          glDisable(GL_TEXTURE_2D);
+        }
+      }
 
-              math::cQuaternion q(mat[8], mat[9], -mat[10]);
+      boundTextures[unit] = (texture != 0) ? textures.GetObject(texture) : render::cTextureRef();
 
-              glLoadMatrixf(static_cast<float*>(q.GetMatrix()));
-#endif
+      render::cTextureRef pTexture = boundTextures[unit];
+      if (pTexture != nullptr) {
+        if (pTexture->uiMode == render::TEXTURE_MODE::CUBE_MAP) {
+          // Cube map texture
+          glEnable(GL_TEXTURE_CUBE_MAP);
+          glBindTexture(GL_TEXTURE_CUBE_MAP, pTexture->uiTexture);
 
-              glMatrixMode(GL_MODELVIEW);
+          glMatrixMode(GL_TEXTURE);
+          glPushMatrix();
+            glLoadIdentity();
 
+            glMatrixMode(GL_MODELVIEW);
 
-              glEnable(GL_TEXTURE_GEN_S);
-              glEnable(GL_TEXTURE_GEN_T);
-              glEnable(GL_TEXTURE_GEN_R);
+            glEnable(GL_TEXTURE_GEN_S);
+            glEnable(GL_TEXTURE_GEN_T);
+            glEnable(GL_TEXTURE_GEN_R);
 
-              glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
-              glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
-              glTexGeni(GL_R, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
-          } else {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, stateSet.texture[i].pTexture->uiTexture);
-          }
+            glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
+            glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
+            glTexGeni(GL_R, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
+        } else {
+          glEnable(GL_TEXTURE_2D);
+          glBindTexture(GL_TEXTURE_2D, pTexture->uiTexture);
         }
       }
 
-      if (stateSet.shader.IsValidAndTurnedOn()) pContext->BindShader(stateSet.shader.pShader);
+      glActiveTexture(GL_TEXTURE0_ARB);
     }
 
-    void cRenderVisitor::UnApplyStateSet(cStateSet& stateSet)
+    void cSceneGraphRenderQueueContext::_BindVertexBufferObject(uint32_t vertexBufferObject)
     {
-      size_t n = render::MAX_TEXTURE_UNITS;
-      size_t unit = 0;
+      if (pBoundVbo != nullptr) pBoundVbo->Unbind();
 
-      unit = GL_TEXTURE0_ARB;
+      pBoundVbo = (vertexBufferObject != 0) ? vertexBufferObjects.GetObject(vertexBufferObject) : render::cVertexBufferObjectRef();
 
-      const bool bIsAlphaBlending = stateSet.alphablending.IsValidAndTurnedOn();
+      if (pBoundVbo != nullptr) {
+        context.StatisticsIncrementVertexBufferObjectsBound();
+        pBoundVbo->Bind();
+      }
+    }
 
-      for (size_t i = 0; i < n; i++, unit++) {
-        // Activate the current texture unit
-        glActiveTexture(unit);
+    void cSceneGraphRenderQueueContext::_SetAlphaBlending(bool bEnable)
+    {
+      glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 
-        if (bIsAlphaBlending) {
-          glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-          glBlendFunc(GL_ONE, GL_ZERO);
-          glDisable(GL_BLEND);
-        }
+      if (bEnable) {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_BLEND);
+      } else {
+        glBlendFunc(GL_ONE, GL_ZERO);
+        glDisable(GL_BLEND);
+      }
+    }
 
-        if (stateSet.texture[i].IsValidAndTurnedOn()) {
-          if (stateSet.texture[i].pTexture->uiMode == render::TEXTURE_MODE::CUBE_MAP) {
-              // Cube map texture
-              glDisable(GL_TEXTURE_GEN_R);
-              glDisable(GL_TEXTURE_GEN_T);
-              glDisable(GL_TEXTURE_GEN_S);
+    void cSceneGraphRenderQueueContext::_Draw(size_t item)
+    {
+      const cRenderGraphDraw& draw = draws[item];
+      ASSERT(draw.pVbo == pBoundVbo);
 
-              glMatrixMode(GL_TEXTURE);
-              glPopMatrix();
+      if (draw.pInstanceMatrices != nullptr) {
+        // The instancing shader applies each instance's matrix itself
+        ASSERT(draw.geometryType == scenegraph_common::GEOMETRY_TYPE::TRIANGLES);
+        context.SetShaderConstantMatrixArray("matInstances", draw.pInstanceMatrices, draw.nInstances);
+        context.StatisticsIncrementVertexBufferObjectsRendered();
+        context.DrawStaticVertexBufferObjectTrianglesInstanced(*draw.pVbo, draw.nInstances);
+        context.StatisticsAddTrianglesRendered(draw.nInstances * draw.pVbo->GetApproximateTriangleCount());
+        return;
+      }
 
-            glMatrixMode(GL_MODELVIEW);
+      glMatrixMode(GL_MODELVIEW);
+      glPushMatrix();
+        glMultMatrixf(draw.pMatAbsolutePositionAndRotation->GetOpenGLMatrixPointer());
+
+#ifdef BUILD_DEBUG
+        pContext->RenderAxisReference();
+#endif
 
-            glDisable(GL_TEXTURE_CUBE_MAP);
-          } else {
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glDisable(GL_TEXTURE_2D);
+        switch (draw.geometryType) {
+          case scenegraph_common::GEOMETRY_TYPE::TRIANGLES: {
+            context.StatisticsIncrementVertexBufferObjectsRendered();
+            draw.pVbo->RenderTriangles();
+            break;
           }
-        }
+          case scenegraph_common::GEOMETRY_TYPE::QUADS: {
+            context.StatisticsIncrementVertexBufferObjectsRendered();
+            draw.pVbo->RenderQuads();
+            break;
+          }
+        };
+
+        glMatrixMode(GL_MODELVIEW);
+      glPopMatrix();
+
+      context.StatisticsAddTrianglesRendered(draw.pVbo->GetApproximateTriangleCount());
+    }
+
+    render::cRenderState cRenderVisitor::GetRenderState(cSceneGraphRenderQueueContext& queueContext, const cStateSet& stateSet) const
+    {
+      ASSERT(render::MAX_TEXTURE_UNITS == render::cRenderState::TEXTURE_UNITS);
+
+      render::cRenderState state;
+
+      if (stateSet.shader.IsValidAndTurnedOn()) state.shader = queueContext.shaders.GetIdentifier(stateSet.shader.pShader);
+
+      for (size_t i = 0; i < render::MAX_TEXTURE_UNITS; i++) {
+        if (stateSet.texture[i].IsValidAndTurnedOn()) state.textures[i] = queueContext.textures.GetIdentifier(stateSet.texture[i].pTexture);
       }
 
-      if (stateSet.shader.IsValidAndTurnedOn()) pContext->UnBindShader();
+      state.vertexBufferObject = queueContext.vertexBufferObjects.GetIdentifier(stateSet.vertexBufferObject.GetVertexBufferObject());
+      state.bIsAlphaBlending = stateSet.alphablending.IsValidAndTurnedOn();
 
-      glActiveTexture(GL_TEXTURE0_ARB);
-      glEnable(GL_TEXTURE_2D);
+      return state;
     }
 
 
@@ -874,55 +1154,87 @@ namespace breathe
 
           pContext->ClearMaterial();
 
-          // Opaque first
+          // Opaque first, sorted by state so that each shader, texture and vertex buffer object is only bound when it changes
+          // Repeated meshes with an instancing shader are merged into instanced batches first
           {
+            // The far plane of the camera that this render graph was culled with
+            const float fFar = rendergraph.fFarClipDistance;
+            ASSERT(fFar > 0.0f);
+
+            cSceneGraphRenderQueueContext queueContext(context);
+
+            render::cRenderQueue& queue = scenegraph.renderQueue;
+            queue.Clear();
+
+            render::cInstanceBatcher& batcher = scenegraph.instanceBatcher;
+            batcher.Clear();
+
             std::map<cStateSet*, cRenderGraph::cRenderableList*>::iterator iter(rendergraph.mOpaque.begin());
             const std::map<cStateSet*, cRenderGraph::cRenderableList*>::iterator iterEnd(rendergraph.mOpaque.end());
             while (iter != iterEnd) {
-              cStateSet* pStateSet = iter->first;
-              cRenderGraph::cRenderableList& renderableList = *iter->second;
+              const cStateSet* pStateSet = iter->first;
+              const cRenderGraph::cRenderableList& renderableList = *iter->second;
+
+              const render::cRenderState state = GetRenderState(queueContext, *pStateSet);
+              const uint8_t layer = uint8_t(int(pStateSet->priority) - int(cStateSet::PRIORITY::FIRST));
+
+              const bool bIsInstancing = (
+                (state.shader != 0) && (pStateSet->shader.pInstancingShader != nullptr) && !state.bIsAlphaBlending &&
+                (pStateSet->geometryType == scenegraph_common::GEOMETRY_TYPE::TRIANGLES)
+              );
+              const uint32_t instancingShader = bIsInstancing ? queueContext.shaders.GetIdentifier(pStateSet->shader.pInstancingShader) : 0;
+
+              const size_t n = renderableList.size();
+              for (size_t i = 0; i < n; i++) {
+                cRenderGraphDraw draw;
+                draw.pVbo = pStateSet->vertexBufferObject.GetVertexBufferObject();
+                draw.geometryType = pStateSet->geometryType;
+                draw.pMatAbsolutePositionAndRotation = &renderableList[i];
+                draw.state = state;
+                draw.layer = layer;
+                draw.fDepth = (renderableList[i].GetTranslation() - frustum.eye).GetLength() / fFar;
+                draw.instancingShader = instancingShader;
+                draw.pInstanceMatrices = nullptr;
+                draw.nInstances = 1;
+
+                // The layer and the instancing shader also have to match for draws to be merged
+                if (bIsInstancing) batcher.Add(state, (instancingShader << 8) | layer, renderableList[i], queueContext.draws.size());
+                else if (state.bIsAlphaBlending) queue.AddTransparent(layer, state, draw.fDepth, queueContext.draws.size());
+                else queue.AddOpaque(layer, state, draw.fDepth, queueContext.draws.size());
+
+                queueContext.draws.push_back(draw);
+              }
 
-              context.StatisticsIncrementStateChanges();
-              ApplyStateSet(*pStateSet);
+              iter++;
+            }
 
-                context.StatisticsIncrementVertexBufferObjectsBound();
-                render::cVertexBufferObjectRef pVbo = pStateSet->vertexBufferObject.GetVertexBufferObject();
-                pVbo->Bind();
+            batcher.Build();
 
-                  const size_t n = renderableList.size();
-                  for (size_t i = 0; i < n; i++) {
-                    glMatrixMode(GL_MODELVIEW);
-                    glPushMatrix();
-                      glMultMatrixf(renderableList[i].GetOpenGLMatrixPointer());
-
-#ifdef BUILD_DEBUG
-                      pContext->RenderAxisReference();
-#endif
+            // Groups that were too small are drawn one at a time as usual
+            for (size_t item : batcher.GetSingleItems()) {
+              const cRenderGraphDraw& draw = queueContext.draws[item];
+              queue.AddOpaque(draw.layer, draw.state, draw.fDepth, item);
+            }
 
-                      switch (pStateSet->geometryType) {
-                        case scenegraph_common::GEOMETRY_TYPE::TRIANGLES: {
-                          context.StatisticsIncrementVertexBufferObjectsRendered();
-                          pVbo->RenderTriangles();
-                          break;
-                        }
-                        case scenegraph_common::GEOMETRY_TYPE::QUADS: {
-                          context.StatisticsIncrementVertexBufferObjectsRendered();
-                          pVbo->RenderQuads();
-                          break;
-                        }
-                      };
+            for (const render::cInstanceBatch& batch : batcher.GetBatches()) {
+              cRenderGraphDraw draw = queueContext.draws[batch.item];
+              draw.pInstanceMatrices = batcher.GetInstanceMatrices(batch);
+              draw.nInstances = batch.nInstances;
 
-                      glMatrixMode(GL_MODELVIEW);
-                    glPopMatrix();
+              // Swap in the instancing variant of the shader
+              ASSERT(draw.instancingShader != 0);
+              draw.state.shader = draw.instancingShader;
+              queue.AddOpaque(draw.layer, draw.state, draw.fDepth, queueContext.draws.size());
 
-                    context.StatisticsAddTrianglesRendered(pVbo->GetApproximateTriangleCount());
-                  }
-                pVbo->Unbind();
+              queueContext.draws.push_back(draw);
+            }
 
-              UnApplyStateSet(*pStateSet);
+            queue.Sort();
+            queue.Submit(queueContext);
 
-              iter++;
-            }
+            // Leave the first texture unit active and enabled for the MD3 and sky passes
+            glActiveTexture(GL_TEXTURE0_ARB);
+            glEnable(GL_TEXTURE_2D);
           }
 
 
@@ -1068,6 +1380,7 @@ namespace breathe
       backgroundColour(0.0f, 0.0f, 1.0f)
     {
       pRoot.reset(new cGroupNode);
+      pRoot->AddToTransformHierarchy(transforms, cTransformHierarchy::NULL_TRANSFORM);
     }
 
     cSceneGraph::~cSceneGraph()
@@ -1131,11 +1444,46 @@ namespace breathe
 
     void cSceneGraph::DestroyNode(cSceneNodeRef pNode)
     {
+      if (pNode->cullingProxy != math::cDynamicAABBTree::NULL_PROXY) RemoveCullingNode(pNode);
+
       //SAFE_DELETE(pNode);
       nNodes--;
     }
 
 
+    // Culling tree
+
+    bool cSceneGraph::AddCullingNode(cSceneNodeRef pNode)
+    {
+      ASSERT(pNode != nullptr);
+      ASSERT(pNode->cullingProxy == math::cDynamicAABBTree::NULL_PROXY);
+
+      // Without bounds the node would be culled as soon as its origin left the frustum
+      if (!pNode->HasLocalBoundingBox()) {
+        LOGERROR("Node has no local bounding box");
+        return false;
+      }
+
+      pNode->cullingProxy = cullingTree.CreateProxy(pNode->GetCullingBox(), pNode.get());
+      cullingNodes.push_back(pNode);
+
+      return true;
+    }
+
+    void cSceneGraph::RemoveCullingNode(cSceneNodeRef pNode)
+    {
+      ASSERT(pNode != nullptr);
+      ASSERT(pNode->cullingProxy != math::cDynamicAABBTree::NULL_PROXY);
+
+      cullingTree.DestroyProxy(pNode->cullingProxy);
+      pNode->cullingProxy = math::cDynamicAABBTree::NULL_PROXY;
+
+      std::vector<cSceneNodeRef>::iterator iter = std::find(cullingNodes.begin(), cullingNodes.end(), pNode);
+      ASSERT(iter != cullingNodes.end());
+      cullingNodes.erase(iter);
+    }
+
+
     // Objects
 
     cEntityRef cSceneGraph::CreateEntity(const std::string& sName, const std::string& sMesh)
@@ -1169,8 +1517,18 @@ namespace breathe
         ambientColour = pSkySystem->GetAmbientColour();
       }
 
+      // Only the dirty subtrees are recalculated, independent subtrees are spread across the thread pool
+      transforms.Update(spitfire::util::GetDefaultThreadPool());
+
       cUpdateVisitor visitor(*this);
 
+      // Refit the culling tree, nodes that stay inside their fat boxes don't change the tree at all
+      const size_t n = cullingNodes.size();
+      for (size_t i = 0; i < n; i++) {
+        const cSceneNodeRef& pNode = cullingNodes[i];
+        cullingTree.MoveProxy(pNode->cullingProxy, pNode->GetCullingBox());
+      }
+
       // TODO: Huh?  Do we need this?  Does it need to be here?
       //pContext->SetClearColour(backgroundColour);
     }
@@ -0,0 +1,39 @@
+// Standard headers
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/physics/physics_box2d_task_executor.h>
+
+namespace breathe
+{
+  namespace box2d
+  {
+    cTaskExecutor::cTaskExecutor(spitfire::util::cThreadPool& _threadPool) :
+      threadPool(_threadPool)
+    {
+    }
+
+    int32 cTaskExecutor::GetThreadCount() const
+    {
+      return int32(threadPool.GetThreadCount()) + 1;
+    }
+
+    void cTaskExecutor::Run(b2Task* pTask)
+    {
+      ASSERT(pTask != nullptr);
+
+      const int32 nThreads = GetThreadCount();
+
+      std::vector<spitfire::util::cTaskHandle> tasks;
+      tasks.reserve(nThreads - 1);
+      for (int32 i = 1; i < nThreads; i++) tasks.push_back(threadPool.Submit([pTask, i]() { pTask->Execute(i); }));
+
+      pTask->Execute(0);
+
+      for (auto& task : tasks) task.Wait();
+    }
+  }
+}
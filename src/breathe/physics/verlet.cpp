@@ -1,5 +1,13 @@
 // Standard headers
 #include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Spitfire headers
 #include <spitfire/spitfire.h>
@@ -84,116 +92,382 @@ void cWorld::Update()
 }
 
 
-void Update(const cWorld& world, cGroup& group)
+// ** cConstraintBatch
+
+void cConstraintBatch::Add(uint32_t _a, uint32_t _b, float fDistance, float _fStiffness)
 {
-  // The particle and constraints updating code is based on verlet-js
-  // https://github.com/subprotocol/verlet-js
+  a.push_back(_a);
+  b.push_back(_b);
+  fDistanceSquared.push_back(fDistance * fDistance);
+  fStiffness.push_back(_fStiffness);
+}
 
-  const spitfire::math::cVec3 forces = 0.0001f * spitfire::math::cVec3(0.0f, world.GetGravity(), 0.0f) + 0.01f * world.GetWind();
 
-	const float fFriction = 0.99f;
+// ** cSettings
 
-  // Apply forces
-  for (auto& p : group.particles) {
-    // Calculate velocity
-    const spitfire::math::cVec3 velocity = fFriction * (p.pos - p.lastPos);
+cSettings::cSettings() :
+  fTimeStepSeconds(1.0f / 60.0f),
+  nSubSteps(1),
+  nRelaxationSteps(16),
+  nMaximumStepsPerUpdate(4),
+  fFriction(0.99f)
+{
+}
 
-    // Save last good state
-    p.lastPos = p.pos;
 
-    // Add forces
-    p.pos += forces;
+// ** cGroup
+
+cGroup::cGroup() :
+  bIsConstraintBatchesDirty(false),
+  fAccumulatedSeconds(0.0f)
+{
+}
+
+size_t cGroup::AddParticle(const spitfire::math::cVec3& position)
+{
+  x.push_back(position.x);
+  y.push_back(position.y);
+  z.push_back(position.z);
+  lastX.push_back(position.x);
+  lastY.push_back(position.y);
+  lastZ.push_back(position.z);
+  return x.size() - 1;
+}
+
+void cGroup::AddPin(size_t particle)
+{
+  ASSERT(particle < GetNumberOfParticles());
+  pins.push_back(uint32_t(particle));
+}
+
+void cGroup::AddSpring(size_t a, size_t b, float fDistance, float fStiffness)
+{
+  ASSERT(a < GetNumberOfParticles());
+  ASSERT(b < GetNumberOfParticles());
+  ASSERT(a != b);
+  springs.push_back(Spring(uint32_t(a), uint32_t(b), fDistance, fStiffness));
+  bIsConstraintBatchesDirty = true;
+}
+
+void cGroup::AddRope(size_t a, size_t b, float fMaxDistance, float fStiffness)
+{
+  ASSERT(a < GetNumberOfParticles());
+  ASSERT(b < GetNumberOfParticles());
+  ASSERT(a != b);
+  ropes.push_back(Rope(uint32_t(a), uint32_t(b), fMaxDistance, fStiffness));
+  bIsConstraintBatchesDirty = true;
+}
+
+void cGroup::SetPosition(size_t particle, const spitfire::math::cVec3& position)
+{
+  x[particle] = lastX[particle] = position.x;
+  y[particle] = lastY[particle] = position.y;
+  z[particle] = lastZ[particle] = position.z;
+}
+
+namespace {
+
+// Greedy colouring, each constraint goes in the first batch that doesn't already use either of its particles
+// Each pass can hand out 64 batches, anything that doesn't fit goes in the batches of the next pass
+template <class T, class GetDistance>
+void BuildBatches(const std::vector<T>& constraints, size_t nParticles, GetDistance getDistance, std::vector<cConstraintBatch>& batches)
+{
+  batches.clear();
+
+  std::vector<uint32_t> remaining(constraints.size());
+  for (size_t i = 0; i < constraints.size(); i++) remaining[i] = uint32_t(i);
+
+  std::vector<uint64_t> used;
+  std::vector<uint32_t> overflow;
+  while (!remaining.empty()) {
+    used.assign(nParticles, 0);
+    overflow.clear();
+
+    const size_t firstBatch = batches.size();
+    for (uint32_t index : remaining) {
+      const T& constraint = constraints[index];
+      const uint64_t available = ~(used[constraint.a] | used[constraint.b]);
+      if (available == 0) {
+        overflow.push_back(index);
+        continue;
+      }
 
-    // Apply inertia
-    p.pos += velocity;
+      const size_t colour = size_t(std::countr_zero(available));
+      used[constraint.a] |= (uint64_t(1) << colour);
+      used[constraint.b] |= (uint64_t(1) << colour);
+
+      if (batches.size() <= (firstBatch + colour)) batches.resize(firstBatch + colour + 1);
+      batches[firstBatch + colour].Add(constraint.a, constraint.b, getDistance(constraint), constraint.fStiffness);
+    }
+
+    remaining.swap(overflow);
   }
+}
 
-  const float relaxationSteps = 16;
-  const float fStepCoefficient = 1.0f / float(relaxationSteps);
+}
 
-  // Apply spring constraints with relaxing
-  for (size_t i = 0; i < relaxationSteps; ++i) {
-    for (auto& spring : group.springs) {
-      const spitfire::math::cVec3 normal = spring.a->pos - spring.b->pos;
-      const float m = normal.GetSquaredLength();
-      const float fScale = (((spring.fDistance * spring.fDistance) - m) / m) * spring.fStiffness * fStepCoefficient;
-      const spitfire::math::cVec3 offset = fScale * normal;
-      spring.a->pos += offset;
-      spring.b->pos -= offset;
+void cGroup::BuildConstraintBatches()
+{
+  BuildBatches(springs, GetNumberOfParticles(), [](const Spring& spring) { return spring.fDistance; }, springBatches);
+  BuildBatches(ropes, GetNumberOfParticles(), [](const Rope& rope) { return rope.fMaxDistance; }, ropeBatches);
+  bIsConstraintBatchesDirty = false;
+}
+
+
+namespace {
+
+// Batches smaller than this are relaxed on the calling thread
+const size_t CONSTRAINT_GRAIN_SIZE = 1024;
+
+// Relaxes constraints [first, last) of a batch, none of them share a particle so they can be applied in any order
+// A spring pushes or pulls the particles towards the set distance, a rope only pulls them together when it is too long
+template <bool bIsRope>
+void RelaxBatch(cGroup& group, const cConstraintBatch& batch, size_t first, size_t last, float fStepCoefficient)
+{
+  float* pX = group.x.data();
+  float* pY = group.y.data();
+  float* pZ = group.z.data();
+  const uint32_t* pA = batch.a.data();
+  const uint32_t* pB = batch.b.data();
+  const float* pDistanceSquared = batch.fDistanceSquared.data();
+  const float* pStiffness = batch.fStiffness.data();
+
+  size_t i = first;
+
+#if defined(__SSE2__)
+  // Gather 4 constraints at a time, do the maths side by side and then scatter the offsets back
+  const __m128 stepCoefficient = _mm_set1_ps(fStepCoefficient);
+  const __m128 zero = _mm_setzero_ps();
+  alignas(16) float offsetX[4];
+  alignas(16) float offsetY[4];
+  alignas(16) float offsetZ[4];
+  for (; (i + 4) <= last; i += 4) {
+    const uint32_t a0 = pA[i];
+    const uint32_t a1 = pA[i + 1];
+    const uint32_t a2 = pA[i + 2];
+    const uint32_t a3 = pA[i + 3];
+    const uint32_t b0 = pB[i];
+    const uint32_t b1 = pB[i + 1];
+    const uint32_t b2 = pB[i + 2];
+    const uint32_t b3 = pB[i + 3];
+
+    const __m128 nx = _mm_sub_ps(_mm_setr_ps(pX[a0], pX[a1], pX[a2], pX[a3]), _mm_setr_ps(pX[b0], pX[b1], pX[b2], pX[b3]));
+    const __m128 ny = _mm_sub_ps(_mm_setr_ps(pY[a0], pY[a1], pY[a2], pY[a3]), _mm_setr_ps(pY[b0], pY[b1], pY[b2], pY[b3]));
+    const __m128 nz = _mm_sub_ps(_mm_setr_ps(pZ[a0], pZ[a1], pZ[a2], pZ[a3]), _mm_setr_ps(pZ[b0], pZ[b1], pZ[b2], pZ[b3]));
+    const __m128 m = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+
+    const __m128 distanceSquared = _mm_loadu_ps(pDistanceSquared + i);
+    const __m128 scale = _mm_mul_ps(_mm_mul_ps(_mm_div_ps(_mm_sub_ps(distanceSquared, m), m), _mm_loadu_ps(pStiffness + i)), stepCoefficient);
+
+    // Particles on top of each other have no direction to be pushed in
+    const __m128 mask = bIsRope ? _mm_cmpgt_ps(m, distanceSquared) : _mm_cmpgt_ps(m, zero);
+    const __m128 maskedScale = _mm_and_ps(mask, scale);
+
+    _mm_store_ps(offsetX, _mm_mul_ps(maskedScale, nx));
+    _mm_store_ps(offsetY, _mm_mul_ps(maskedScale, ny));
+    _mm_store_ps(offsetZ, _mm_mul_ps(maskedScale, nz));
+
+    const uint32_t a[4] = { a0, a1, a2, a3 };
+    const uint32_t b[4] = { b0, b1, b2, b3 };
+    for (size_t j = 0; j < 4; j++) {
+      pX[a[j]] += offsetX[j];
+      pY[a[j]] += offsetY[j];
+      pZ[a[j]] += offsetZ[j];
+      pX[b[j]] -= offsetX[j];
+      pY[b[j]] -= offsetY[j];
+      pZ[b[j]] -= offsetZ[j];
     }
   }
+#endif
+
+  for (; i < last; i++) {
+    const uint32_t a = pA[i];
+    const uint32_t b = pB[i];
+    const float nx = pX[a] - pX[b];
+    const float ny = pY[a] - pY[b];
+    const float nz = pZ[a] - pZ[b];
+    const float m = ((nx * nx) + (ny * ny)) + (nz * nz);
+    if (bIsRope ? (m <= pDistanceSquared[i]) : (m <= 0.0f)) continue;
+
+    const float fScale = (((pDistanceSquared[i] - m) / m) * pStiffness[i]) * fStepCoefficient;
+    pX[a] += fScale * nx;
+    pY[a] += fScale * ny;
+    pZ[a] += fScale * nz;
+    pX[b] -= fScale * nx;
+    pY[b] -= fScale * ny;
+    pZ[b] -= fScale * nz;
+  }
+}
 
-  // Apply rope constraints with relaxing
-  for (size_t i = 0; i < relaxationSteps; ++i) {
-    for (auto& rope : group.ropes) {
-      const spitfire::math::cVec3 normal = rope.a->pos - rope.b->pos;
-      const float m = normal.GetSquaredLength();
-      // Only enforce a maximum length, the rope doesn't care when the points are closer than the maximum length
-      if (m > (rope.fMaxDistance * rope.fMaxDistance)) {
-        const float fScale = (((rope.fMaxDistance * rope.fMaxDistance) - m) / m) * rope.fStiffness * fStepCoefficient;
-        const spitfire::math::cVec3 offset = fScale * normal;
-        rope.a->pos += offset;
-        rope.b->pos -= offset;
+template <bool bIsRope>
+void RelaxBatches(cGroup& group, const std::vector<cConstraintBatch>& batches, size_t nRelaxationSteps, spitfire::util::cThreadPool* pThreadPool)
+{
+  const float fStepCoefficient = 1.0f / float(nRelaxationSteps);
+
+  for (size_t step = 0; step < nRelaxationSteps; step++) {
+    for (const cConstraintBatch& batch : batches) {
+      if ((pThreadPool != nullptr) && (batch.GetSize() > CONSTRAINT_GRAIN_SIZE)) {
+        spitfire::util::ParallelFor(*pThreadPool, 0, batch.GetSize(), CONSTRAINT_GRAIN_SIZE, [&group, &batch, fStepCoefficient](size_t first, size_t last) {
+          RelaxBatch<bIsRope>(group, batch, first, last, fStepCoefficient);
+        });
+      } else {
+        RelaxBatch<bIsRope>(group, batch, 0, batch.GetSize(), fStepCoefficient);
       }
     }
   }
+}
 
-  // Apply our pin constraints (Move all pinned points back to their starting positions)
-  for (auto& pin : group.pins) {
-    pin->pos = pin->lastPos;
+// Move all pinned points back to their starting positions
+void ApplyPins(cGroup& group)
+{
+  for (uint32_t pin : group.pins) {
+    group.x[pin] = group.lastX[pin];
+    group.y[pin] = group.lastY[pin];
+    group.z[pin] = group.lastZ[pin];
   }
 }
 
+void SubStep(cGroup& group, const spitfire::math::cVec3& forces, float fFriction, spitfire::util::cThreadPool* pThreadPool)
+{
+  // Apply forces and inertia
+  float* pX = group.x.data();
+  float* pY = group.y.data();
+  float* pZ = group.z.data();
+  float* pLastX = group.lastX.data();
+  float* pLastY = group.lastY.data();
+  float* pLastZ = group.lastZ.data();
+  const size_t nParticles = group.GetNumberOfParticles();
+  for (size_t i = 0; i < nParticles; i++) {
+    const float fVelocityX = fFriction * (pX[i] - pLastX[i]);
+    const float fVelocityY = fFriction * (pY[i] - pLastY[i]);
+    const float fVelocityZ = fFriction * (pZ[i] - pLastZ[i]);
+
+    // Save last good state
+    pLastX[i] = pX[i];
+    pLastY[i] = pY[i];
+    pLastZ[i] = pZ[i];
+
+    pX[i] = (pX[i] + forces.x) + fVelocityX;
+    pY[i] = (pY[i] + forces.y) + fVelocityY;
+    pZ[i] = (pZ[i] + forces.z) + fVelocityZ;
+  }
+
+  // Apply spring constraints and then rope constraints with relaxing
+  RelaxBatches<false>(group, group.springBatches, group.settings.nRelaxationSteps, pThreadPool);
+  RelaxBatches<true>(group, group.ropeBatches, group.settings.nRelaxationSteps, pThreadPool);
+
+  ApplyPins(group);
+}
+
+void Update(const cWorld& world, cGroup& group, spitfire::util::cThreadPool* pThreadPool)
+{
+  // The particle and constraints updating code is based on verlet-js
+  // https://github.com/subprotocol/verlet-js
+
+  ASSERT(group.settings.nSubSteps != 0);
+  ASSERT(group.settings.nRelaxationSteps != 0);
+
+  if (group.bIsConstraintBatchesDirty) group.BuildConstraintBatches();
+
+  // The forces are tuned for one step per update, a sub step moves a particle 1 / n^2 as far under the same force
+  const size_t nSubSteps = group.settings.nSubSteps;
+  const float fSubStepFraction = 1.0f / float(nSubSteps);
+  const spitfire::math::cVec3 forces = (fSubStepFraction * fSubStepFraction) * (0.0001f * spitfire::math::cVec3(0.0f, world.GetGravity(), 0.0f) + 0.01f * world.GetWind());
+  const float fFriction = (nSubSteps == 1) ? group.settings.fFriction : std::pow(group.settings.fFriction, fSubStepFraction);
+
+  for (size_t i = 0; i < nSubSteps; i++) SubStep(group, forces, fFriction, pThreadPool);
+}
+
+size_t UpdateFixedTimeStep(const cWorld& world, cGroup& group, float fElapsedSeconds, spitfire::util::cThreadPool* pThreadPool)
+{
+  ASSERT(group.settings.fTimeStepSeconds > 0.0f);
+
+  group.fAccumulatedSeconds += fElapsedSeconds;
+
+  size_t nSteps = 0;
+  while ((group.fAccumulatedSeconds >= group.settings.fTimeStepSeconds) && (nSteps < group.settings.nMaximumStepsPerUpdate)) {
+    Update(world, group, pThreadPool);
+    group.fAccumulatedSeconds -= group.settings.fTimeStepSeconds;
+    nSteps++;
+  }
+
+  // If we are too far behind then drop the time rather than trying to catch up next time too
+  if (group.fAccumulatedSeconds >= group.settings.fTimeStepSeconds) group.fAccumulatedSeconds = 0.0f;
+
+  return nSteps;
+}
+
+}
+
+void Update(const cWorld& world, cGroup& group)
+{
+  Update(world, group, nullptr);
+}
+
+void Update(const cWorld& world, cGroup& group, spitfire::util::cThreadPool& threadPool)
+{
+  Update(world, group, &threadPool);
+}
+
+size_t UpdateFixedTimeStep(const cWorld& world, cGroup& group, float fElapsedSeconds)
+{
+  return UpdateFixedTimeStep(world, group, fElapsedSeconds, nullptr);
+}
+
+size_t UpdateFixedTimeStep(const cWorld& world, cGroup& group, float fElapsedSeconds, spitfire::util::cThreadPool& threadPool)
+{
+  return UpdateFixedTimeStep(world, group, fElapsedSeconds, &threadPool);
+}
+
 void Collide(cGroup& group, const spitfire::math::cCapsule& capsule)
 {
-  const float relaxationSteps = 16;
+  const size_t relaxationSteps = 16;
   const float fStepCoefficient = 1.0f / float(relaxationSteps);
 
   // Apply collision constraints with relaxing
-  for (size_t i = 0; i < relaxationSteps; ++i) {
-    for (auto& p : group.particles) {
-      if (capsule.Collide(p.pos)) {
-        // Try to push the particle out of the capsule
-        const spitfire::math::cVec3 closestPoint = spitfire::math::GetClosestPointOnLine(capsule.base, capsule.tip, p.pos);
-        const spitfire::math::cVec3 normal = spitfire::math::normalize(p.pos - closestPoint);
-        const float fIntrusionDistance = capsule.fRadius - (closestPoint - p.pos).GetLength();
-
-        const float fScale = fIntrusionDistance * fStepCoefficient;
-        const spitfire::math::cVec3 offset = fScale * normal;
-        p.pos += offset;
-      }
+  // Each particle is pushed out on its own so all of the relaxation steps for one particle can be done together
+  const size_t nParticles = group.GetNumberOfParticles();
+  for (size_t p = 0; p < nParticles; p++) {
+    spitfire::math::cVec3 position = group.GetPosition(p);
+    for (size_t i = 0; i < relaxationSteps; ++i) {
+      if (!capsule.Collide(position)) break;
+
+      // Try to push the particle out of the capsule
+      const spitfire::math::cVec3 closestPoint = spitfire::math::GetClosestPointOnLine(capsule.base, capsule.tip, position);
+      const spitfire::math::cVec3 normal = spitfire::math::normalize(position - closestPoint);
+      const float fIntrusionDistance = capsule.fRadius - (closestPoint - position).GetLength();
+
+      const float fScale = fIntrusionDistance * fStepCoefficient;
+      position += fScale * normal;
     }
-	}
 
-  // Reapply our pin constraints (Move all pinned points back to their starting positions)
-  for (auto& pin : group.pins) {
-    pin->pos = pin->lastPos;
+    group.x[p] = position.x;
+    group.y[p] = position.y;
+    group.z[p] = position.z;
   }
+
+  // Reapply our pin constraints
+  ApplyPins(group);
 }
 
 void CollideGroundPlane(cGroup& group, float fGroundHeight)
 {
-  const float relaxationSteps = 16;
+  const size_t relaxationSteps = 16;
   const float fStepCoefficient = 1.0f / float(relaxationSteps);
 
   // Apply collision constraints with relaxing
+  float* pY = group.y.data();
+  const size_t nParticles = group.GetNumberOfParticles();
   for (size_t i = 0; i < relaxationSteps; ++i) {
-    for (auto& p : group.particles) {
-      if (p.pos.y < fGroundHeight) {
-        // Try to push the particle out of the ground
-        const float fIntrusionDistance = fGroundHeight - p.pos.y;
-
-        const float fScale = fIntrusionDistance * fStepCoefficient;
-        const float offset = fScale;
-        p.pos.y += offset;
-      }
+    for (size_t p = 0; p < nParticles; p++) {
+      // Try to push the particle out of the ground
+      const float fIntrusionDistance = std::max(0.0f, fGroundHeight - pY[p]);
+      pY[p] += fIntrusionDistance * fStepCoefficient;
     }
-	}
-
-  // Reapply our pin constraints (Move all pinned points back to their starting positions)
-  for (auto& pin : group.pins) {
-    pin->pos = pin->lastPos;
   }
+
+  // Reapply our pin constraints
+  ApplyPins(group);
 }
 
 }
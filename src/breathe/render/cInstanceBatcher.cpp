@@ -0,0 +1,131 @@
+// Standard headers
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/render/cInstanceBatcher.h>
+
+namespace breathe
+{
+  namespace render
+  {
+    namespace
+    {
+      // A quick key to sort by, identifiers that don't fit are truncated so equal keys are then compared in full with IsLess
+      uint64_t GetSortKey(const cRenderState& state, uint32_t geometry)
+      {
+        return (uint64_t(state.vertexBufferObject & 0xFFFFF) << 44) | (uint64_t(geometry & 0xF) << 40) | (uint64_t(state.shader & 0xFFF) << 28) |
+          (uint64_t(state.textures[0] & 0x7FFFFFF) << 1) | (state.bIsAlphaBlending ? 1 : 0);
+      }
+
+      // Orders states so that equal states end up next to each other, the vertex buffer object is compared first as that is what has to match
+      bool IsLess(const cRenderState& lhs, uint32_t lhsGeometry, const cRenderState& rhs, uint32_t rhsGeometry)
+      {
+        if (lhs.vertexBufferObject != rhs.vertexBufferObject) return (lhs.vertexBufferObject < rhs.vertexBufferObject);
+        if (lhsGeometry != rhsGeometry) return (lhsGeometry < rhsGeometry);
+        if (lhs.shader != rhs.shader) return (lhs.shader < rhs.shader);
+        for (size_t i = 0; i < cRenderState::TEXTURE_UNITS; i++) {
+          if (lhs.textures[i] != rhs.textures[i]) return (lhs.textures[i] < rhs.textures[i]);
+        }
+
+        return (lhs.bIsAlphaBlending < rhs.bIsAlphaBlending);
+      }
+    }
+
+    cInstanceBatcher::cInstanceBatcher() :
+      nMaximumInstancesPerBatch(64),
+      nMinimumInstances(4)
+    {
+    }
+
+    void cInstanceBatcher::Clear()
+    {
+      draws.clear();
+      order.clear();
+      batches.clear();
+      singleItems.clear();
+      instanceBuffer.clear();
+      instanceItems.clear();
+    }
+
+    void cInstanceBatcher::Reserve(size_t nDraws)
+    {
+      draws.reserve(nDraws);
+      order.reserve(nDraws);
+    }
+
+    void cInstanceBatcher::Add(const cRenderState& state, uint32_t geometry, const spitfire::math::cMat4& matAbsolutePositionAndRotation, size_t item)
+    {
+      order.push_back(std::make_pair(GetSortKey(state, geometry), uint32_t(draws.size())));
+      draws.push_back(cDraw { state, geometry, matAbsolutePositionAndRotation, item });
+    }
+
+    bool cInstanceBatcher::IsSameGroup(const cDraw& lhs, const cDraw& rhs) const
+    {
+      return (lhs.geometry == rhs.geometry) && (lhs.state == rhs.state);
+    }
+
+    void cInstanceBatcher::Build()
+    {
+      batches.clear();
+      singleItems.clear();
+      instanceBuffer.clear();
+      instanceItems.clear();
+
+      // Group the draws by state, the draws in each group stay in the order they were added
+      std::sort(order.begin(), order.end(), [this](const std::pair<uint64_t, uint32_t>& lhs, const std::pair<uint64_t, uint32_t>& rhs) {
+        if (lhs.first != rhs.first) return (lhs.first < rhs.first);
+
+        const cDraw& a = draws[lhs.second];
+        const cDraw& b = draws[rhs.second];
+        if (IsLess(a.state, a.geometry, b.state, b.geometry)) return true;
+        if (IsLess(b.state, b.geometry, a.state, a.geometry)) return false;
+        return (lhs.second < rhs.second);
+      });
+
+      const size_t n = order.size();
+      size_t first = 0;
+      while (first < n) {
+        const cDraw& draw = draws[order[first].second];
+
+        size_t last = first + 1;
+        while ((last < n) && IsSameGroup(draw, draws[order[last].second])) last++;
+
+        const size_t nDrawsInGroup = last - first;
+        if ((nDrawsInGroup < nMinimumInstances) || (nDrawsInGroup == 1)) {
+          for (size_t i = first; i < last; i++) singleItems.push_back(draws[order[i].second].item);
+        } else {
+          // Pack the matrices of each batch next to each other
+          for (size_t batchFirst = first; batchFirst < last; batchFirst += nMaximumInstancesPerBatch) {
+            const size_t batchLast = std::min(last, batchFirst + nMaximumInstancesPerBatch);
+
+            cInstanceBatch batch;
+            batch.state = draw.state;
+            batch.geometry = draw.geometry;
+            batch.item = draws[order[batchFirst].second].item;
+            batch.firstInstance = instanceItems.size();
+            batch.nInstances = batchLast - batchFirst;
+            batches.push_back(batch);
+
+            const size_t offset = instanceBuffer.size();
+            instanceBuffer.resize(offset + (batch.nInstances * FLOATS_PER_INSTANCE));
+            float* pOut = &instanceBuffer[offset];
+            for (size_t i = batchFirst; i < batchLast; i++) {
+              const cDraw& instance = draws[order[i].second];
+              std::memcpy(pOut, instance.matAbsolutePositionAndRotation.GetOpenGLMatrixPointer(), FLOATS_PER_INSTANCE * sizeof(float));
+              pOut += FLOATS_PER_INSTANCE;
+              instanceItems.push_back(instance.item);
+            }
+          }
+        }
+
+        first = last;
+      }
+    }
+  }
+}
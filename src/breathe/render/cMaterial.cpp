@@ -392,7 +392,33 @@ namespace breathe
         for (size_t i = 0; i < nLayers; i++) SAFE_DELETE(vLayer[i]);
       }
 
-      bool cMaterial::Load(const string_t& inFilename)
+      bool cMaterial::Load(const string_t& sFilename)
+      {
+        if (!Parse(sFilename)) {
+          for (size_t i = 0; i < nLayers; i++) {
+            vLayer[i]->pTexture = pResourceManager->pMaterialNotFoundMaterial->vLayer[0]->pTexture;
+          }
+
+          return false;
+        }
+
+        if (pShader != nullptr) pShader->Init();
+
+        for (size_t i = 0; i < nLayers; i++) {
+          cLayer* pLayer = vLayer[i];
+          if (pLayer->sTexture.empty()) continue;
+
+          if ((TEXTURE_MODE::CUBE_MAP != pLayer->uiTextureMode) && (TEXTURE_MODE::POST_RENDER != pLayer->uiTextureMode)) {
+            // TODO: The texture atlas code is broken so we assume ATLAS::NONE until it is fixed
+            pLayer->pTexture = pResourceManager->AddTexture(pLayer->sTexture);
+          }
+        }
+
+        LOG.Success("Material", breathe::string::ToUTF8(TEXT("Loaded ") + sFilename));
+        return true;
+      }
+
+      bool cMaterial::Parse(const string_t& inFilename)
       {
         LOG.Success("Material", std::string("Looking for ") + breathe::string::ToUTF8(inFilename));
 
@@ -413,10 +439,6 @@ namespace breathe
         iter.FindChild("material");
         if (!iter.IsValid()) {
           LOG.Error("Material", std::string("Not Found ") + breathe::string::ToUTF8(sFilename));
-          for (size_t i = 0; i < nLayers; i++) {
-            vLayer[i]->pTexture = pResourceManager->pMaterialNotFoundMaterial->vLayer[0]->pTexture;
-          }
-
           return false;
         }
 
@@ -459,8 +481,6 @@ namespace breathe
           iter.GetAttribute("texUnit1", pShader->bTexUnit1);
           iter.GetAttribute("texUnit2", pShader->bTexUnit2);
           iter.GetAttribute("texUnit3", pShader->bTexUnit3);
-
-          pShader->Init();
         }
 
 
@@ -495,40 +515,13 @@ namespace breathe
               else if (sValue == "TEXTURE_POST_RENDER")  pLayer->uiTextureMode = TEXTURE_MODE::POST_RENDER;
             }
 
-            unsigned int uiTextureAtlas = ATLAS::NONE;
-            // TODO: The texture atlas code is broken so we assume ATLAS::NONE until it is fixed
-            /*if (iter.GetAttribute("uiTextureAtlas", sValue)) {
-              if (sValue == "ATLAS::LANDSCAPE")      uiTextureAtlas = ATLAS::LANDSCAPE;
-              else if (sValue == "ATLAS::BUILDING")  uiTextureAtlas = ATLAS::BUILDING;
-              else if (sValue == "ATLAS::FOLIAGE")  uiTextureAtlas = ATLAS::FOLIAGE;
-              else if (sValue == "ATLAS::VEHICLES")  uiTextureAtlas = ATLAS::VEHICLES;
-              else if (sValue == "ATLAS::PROPS")    uiTextureAtlas = ATLAS::PROPS;
-              else if (sValue == "ATLAS::WEAPONS")  uiTextureAtlas = ATLAS::WEAPONS;
-              else if (sValue == "ATLAS::EFFECTS")  uiTextureAtlas = ATLAS::EFFECTS;
-            }*/
-
-            if (TEXTURE_MODE::CUBE_MAP == pLayer->uiTextureMode) {
-              uiTextureAtlas = ATLAS::NONE;
-              LOG.Error("CUBEMAP", "CUBEMAP");
-            }
-
-            if ((TEXTURE_MODE::CUBE_MAP != pLayer->uiTextureMode) && (TEXTURE_MODE::POST_RENDER != pLayer->uiTextureMode)) {
-              if (ATLAS::NONE != uiTextureAtlas) {
-                pLayer->pTexture = pResourceManager->AddTextureToAtlas(pLayer->sTexture, uiTextureAtlas);
-              }
-
-              if (nullptr == pLayer->pTexture) {
-                uiTextureAtlas = ATLAS::NONE;
-                pLayer->pTexture = pResourceManager->AddTexture(pLayer->sTexture);
-              }
-            }
+            if (TEXTURE_MODE::CUBE_MAP == pLayer->uiTextureMode) LOG.Error("CUBEMAP", "CUBEMAP");
           }
 
           i++;
           iter++;
         }
 
-        LOG.Success("Material", breathe::string::ToUTF8(TEXT("Loaded ") + sFilename));
         return true;
       }
 
@@ -0,0 +1,183 @@
+// Standard headers
+#include <algorithm>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/render/cRenderQueue.h>
+
+namespace breathe
+{
+  namespace render
+  {
+    namespace
+    {
+      // Opaque keys
+      // | layer 8 | transparent 1 (0) | shader 12 | texture 16 | vertex buffer object 12 | depth 15 |
+      //
+      // Transparent keys
+      // | layer 8 | transparent 1 (1) | inverted depth 24 | shader 12 | texture 12 | vertex buffer object 7 |
+      //
+      // Identifiers that don't fit are truncated, draws with the same key are still compared in full in Submit
+
+      uint64_t QuantiseDepth(float fDepth, size_t nBits)
+      {
+        const uint64_t uMaximum = (uint64_t(1) << nBits) - 1;
+        fDepth = std::max(0.0f, std::min(fDepth, 1.0f));
+        return std::min(uMaximum, uint64_t(fDepth * float(uMaximum)));
+      }
+
+      uint64_t GetBits(uint32_t value, size_t nBits)
+      {
+        return uint64_t(value) & ((uint64_t(1) << nBits) - 1);
+      }
+    }
+
+    uint64_t cRenderQueue::MakeOpaqueKey(uint8_t layer, const cRenderState& state, float fDepth)
+    {
+      return (uint64_t(layer) << 56) |
+        (GetBits(state.shader, 12) << 43) |
+        (GetBits(state.textures[0], 16) << 27) |
+        (GetBits(state.vertexBufferObject, 12) << 15) |
+        QuantiseDepth(fDepth, 15);
+    }
+
+    uint64_t cRenderQueue::MakeTransparentKey(uint8_t layer, const cRenderState& state, float fDepth)
+    {
+      const uint64_t uMaximumDepth = (uint64_t(1) << 24) - 1;
+
+      return (uint64_t(layer) << 56) |
+        (uint64_t(1) << 55) |
+        ((uMaximumDepth - QuantiseDepth(fDepth, 24)) << 31) |
+        (GetBits(state.shader, 12) << 19) |
+        (GetBits(state.textures[0], 12) << 7) |
+        GetBits(state.vertexBufferObject, 7);
+    }
+
+    void cRenderQueue::Clear()
+    {
+      draws.clear();
+      keys.clear();
+      indices.clear();
+    }
+
+    void cRenderQueue::Reserve(size_t nDraws)
+    {
+      draws.reserve(nDraws);
+      keys.reserve(nDraws);
+      indices.reserve(nDraws);
+    }
+
+    void cRenderQueue::AddOpaque(uint8_t layer, const cRenderState& state, float fDepth, size_t item)
+    {
+      ASSERT(!state.bIsAlphaBlending);
+
+      indices.push_back(uint32_t(draws.size()));
+      keys.push_back(MakeOpaqueKey(layer, state, fDepth));
+      draws.push_back(cDraw { state, item });
+    }
+
+    void cRenderQueue::AddTransparent(uint8_t layer, const cRenderState& state, float fDepth, size_t item)
+    {
+      indices.push_back(uint32_t(draws.size()));
+      keys.push_back(MakeTransparentKey(layer, state, fDepth));
+      draws.push_back(cDraw { state, item });
+    }
+
+    void cRenderQueue::Sort()
+    {
+      // Least significant digit first radix sort, 8 bits at a time
+      // Every histogram is built in one pass and digits that are the same for every key are skipped, which is most of them in a typical frame
+      const size_t n = keys.size();
+      if (n <= 1) return;
+
+      const size_t DIGITS = 8;
+      const size_t BUCKETS = 256;
+
+      std::vector<size_t> histograms(DIGITS * BUCKETS, 0);
+      for (size_t i = 0; i < n; i++) {
+        const uint64_t key = keys[i];
+        for (size_t digit = 0; digit < DIGITS; digit++) histograms[(digit * BUCKETS) + ((key >> (digit * 8)) & 0xFF)]++;
+      }
+
+      sortKeys.resize(n);
+      sortIndices.resize(n);
+
+      for (size_t digit = 0; digit < DIGITS; digit++) {
+        size_t* pHistogram = &histograms[digit * BUCKETS];
+
+        // If every key has the same value for this digit then this pass wouldn't change anything
+        if (pHistogram[(keys[0] >> (digit * 8)) & 0xFF] == n) continue;
+
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+          const size_t count = pHistogram[bucket];
+          pHistogram[bucket] = offset;
+          offset += count;
+        }
+
+        const size_t shift = digit * 8;
+        for (size_t i = 0; i < n; i++) {
+          const size_t destination = pHistogram[(keys[i] >> shift) & 0xFF]++;
+          sortKeys[destination] = keys[i];
+          sortIndices[destination] = indices[i];
+        }
+
+        keys.swap(sortKeys);
+        indices.swap(sortIndices);
+      }
+    }
+
+    void cRenderQueue::Apply(cRenderQueueContext& context, const cRenderState& state)
+    {
+      if (state.shader != current.shader) {
+        context._BindShader(state.shader);
+        current.shader = state.shader;
+        statistics.nShaderBinds++;
+      }
+
+      for (size_t unit = 0; unit < cRenderState::TEXTURE_UNITS; unit++) {
+        if (state.textures[unit] != current.textures[unit]) {
+          context._BindTexture(unit, state.textures[unit]);
+          current.textures[unit] = state.textures[unit];
+          statistics.nTextureBinds++;
+        }
+      }
+
+      if (state.vertexBufferObject != current.vertexBufferObject) {
+        context._BindVertexBufferObject(state.vertexBufferObject);
+        current.vertexBufferObject = state.vertexBufferObject;
+        statistics.nVertexBufferObjectBinds++;
+      }
+
+      if (state.bIsAlphaBlending != current.bIsAlphaBlending) {
+        context._SetAlphaBlending(state.bIsAlphaBlending);
+        current.bIsAlphaBlending = state.bIsAlphaBlending;
+        statistics.nAlphaBlendingChanges++;
+      }
+    }
+
+    void cRenderQueue::Submit(cRenderQueueContext& context)
+    {
+      statistics.Reset();
+
+      // We assume that nothing is bound when we start
+      current = cRenderState();
+
+      const size_t n = keys.size();
+      for (size_t i = 0; i < n; i++) {
+        const cDraw& draw = draws[indices[i]];
+
+        Apply(context, draw.state);
+
+        context._Draw(draw.item);
+        statistics.nDraws++;
+      }
+
+      // Leave everything unbound for whatever is rendered next
+      Apply(context, cRenderState());
+    }
+  }
+}
@@ -0,0 +1,175 @@
+// Standard headers
+#include <cassert>
+#include <chrono>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/render/cResourceLoader.h>
+
+namespace breathe
+{
+  namespace render
+  {
+    // ** cResourceLoader
+
+    cResourceLoader::cResourceLoader(spitfire::util::cThreadPool& _pool) :
+      pool(_pool),
+      nPending(0),
+      nDecoding(0),
+      bIsStopping(false)
+    {
+    }
+
+    cResourceLoader::~cResourceLoader()
+    {
+      // Decodes that have not started yet skip their decode function
+      bIsStopping = true;
+
+      // The decode tasks refer to this loader so we have to wait for all of them
+      while (true) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (nDecoding == 0) break;
+        }
+
+        if (!pool.RunPendingTask()) {
+          std::unique_lock<std::mutex> lock(mutex);
+          condition.wait(lock, [this]() { return (nDecoding == 0); });
+        }
+      }
+    }
+
+    cResourceHandle cResourceLoader::Add(const cResourceJob::DecodeFunction& decode, const cResourceJob::UploadFunction& upload, const std::vector<cResourceHandle>& dependencies)
+    {
+      std::shared_ptr<cResourceJob> pJob(new cResourceJob(decode, upload));
+
+      nPending++;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto&& dependency : dependencies) AddDependencyLocked(pJob, dependency);
+        nDecoding++;
+      }
+
+      pool.Submit([this, pJob]() { Decode(pJob); });
+
+      return cResourceHandle(pJob);
+    }
+
+    void cResourceLoader::Decode(std::shared_ptr<cResourceJob> pJob)
+    {
+      std::vector<cResourceHandle> dependencies;
+      const bool bResult = !bIsStopping.load() && (!pJob->decode || pJob->decode(dependencies));
+
+      // Release anything the decode function captured while we are still on the worker thread
+      pJob->decode = nullptr;
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (bResult) {
+        for (auto&& dependency : dependencies) AddDependencyLocked(pJob, dependency);
+        pJob->bIsDecoded = true;
+        MakeReadyIfPossibleLocked(pJob);
+      } else FinishLocked(pJob, RESOURCE_STATE::FAILED);
+
+      ASSERT(nDecoding != 0);
+      nDecoding--;
+      condition.notify_all();
+    }
+
+    void cResourceLoader::AddDependencyLocked(std::shared_ptr<cResourceJob> pJob, const cResourceHandle& dependency)
+    {
+      if (!dependency.IsValid()) return;
+
+      // A resource can't depend on itself, longer cycles are not detected and will never load
+      ASSERT(dependency.pJob != pJob);
+
+      // The state only changes to loaded or failed while the mutex is held so this can't miss the dependency finishing
+      const RESOURCE_STATE state = dependency.pJob->state.load();
+      if ((state == RESOURCE_STATE::LOADED) || (state == RESOURCE_STATE::FAILED)) return;
+
+      pJob->nDependenciesRemaining++;
+      dependency.pJob->dependents.push_back(pJob);
+    }
+
+    void cResourceLoader::MakeReadyIfPossibleLocked(std::shared_ptr<cResourceJob> pJob)
+    {
+      if (!pJob->bIsDecoded) return;
+
+      if (pJob->nDependenciesRemaining != 0) {
+        pJob->state = RESOURCE_STATE::WAITING_FOR_DEPENDENCIES;
+        return;
+      }
+
+      pJob->state = RESOURCE_STATE::WAITING_FOR_UPLOAD;
+      ready.push_back(pJob);
+      condition.notify_all();
+    }
+
+    void cResourceLoader::FinishLocked(std::shared_ptr<cResourceJob> pJob, RESOURCE_STATE state)
+    {
+      ASSERT((state == RESOURCE_STATE::LOADED) || (state == RESOURCE_STATE::FAILED));
+
+      pJob->upload = nullptr;
+      pJob->state = state;
+
+      for (auto&& pDependent : pJob->dependents) {
+        ASSERT(pDependent->nDependenciesRemaining != 0);
+        pDependent->nDependenciesRemaining--;
+        MakeReadyIfPossibleLocked(pDependent);
+      }
+      pJob->dependents.clear();
+
+      ASSERT(nPending != 0);
+      nPending--;
+      condition.notify_all();
+    }
+
+    size_t cResourceLoader::Update(float fTimeBudgetMS)
+    {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      size_t nUploaded = 0;
+
+      while (true) {
+        std::shared_ptr<cResourceJob> pJob;
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (ready.empty()) break;
+          pJob = ready.front();
+          ready.pop_front();
+        }
+
+        const bool bResult = (!pJob->upload || pJob->upload());
+
+        {
+          // Any resources that were only waiting for this one are added to the ready queue and can upload in this update too
+          std::lock_guard<std::mutex> lock(mutex);
+          FinishLocked(pJob, bResult ? RESOURCE_STATE::LOADED : RESOURCE_STATE::FAILED);
+        }
+
+        nUploaded++;
+
+        if (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() >= fTimeBudgetMS) break;
+      }
+
+      return nUploaded;
+    }
+
+    void cResourceLoader::Flush()
+    {
+      while (!IsIdle()) {
+        if (Update(0.0f) != 0) continue;
+
+        // Help with the decodes rather than just waiting for them
+        if (pool.RunPendingTask()) continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return (!ready.empty() || (nPending.load() == 0)); });
+      }
+    }
+  }
+}
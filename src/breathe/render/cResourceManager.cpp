@@ -27,6 +27,7 @@
 #include <spitfire/util/cString.h>
 #include <spitfire/util/log.h>
 #include <spitfire/util/cTimer.h>
+#include <spitfire/util/threadpool.h>
 
 #include <spitfire/algorithm/algorithm.h>
 
@@ -45,6 +46,9 @@
 #include <spitfire/math/cColour.h>
 #include <spitfire/math/geometry.h>
 
+// libvoodoomm headers
+#include <libvoodoomm/cImage.h>
+
 // Breathe headers
 #include <breathe/breathe.h>
 
@@ -55,7 +59,7 @@
 #include <breathe/render/cTextureAtlas.h>
 #include <breathe/render/cMaterial.h>
 #include <breathe/render/cResourceManager.h>
-#include <breathe/render/cResourceManager.h>
+#include <breathe/render/cResourceLoader.h>
 #include <breathe/render/cVertexBufferObject.h>
 
 #include <breathe/render/model/cMesh.h>
@@ -71,7 +75,8 @@ namespace breathe
     // *** cResourceManager
 
     cResourceManager::cResourceManager(cContext& _context) :
-      context(_context)
+      context(_context),
+      loader(spitfire::util::GetDefaultThreadPool())
       //iMaxTextureSize(0)
     {
       for (size_t i = 0; i < nAtlas; i++) {
@@ -199,7 +204,10 @@ namespace breathe
       p->Create();
       p->CopyFromSurfaceToTexture();
 
-      mTexture[s]=p;
+      {
+        std::lock_guard<std::mutex> lock(mutexTextures);
+        mTexture[s]=p;
+      }
 
       std::ostringstream t;
       t << p->uiTexture;
@@ -207,6 +215,64 @@ namespace breathe
       return p;
     }
 
+    cTextureRef cResourceManager::AddTextureAsync(const string_t& sNewFilename, cResourceHandle& outHandle)
+    {
+      ASSERT(sNewFilename != TEXT(""));
+
+      outHandle = cResourceHandle();
+
+      string_t sFilename;
+      breathe::filesystem::FindFile(breathe::string::ToString_t(sNewFilename), sFilename);
+
+      const string_t s = breathe::filesystem::GetFile(sFilename);
+
+      std::lock_guard<std::mutex> lock(mutexTextures);
+
+      // Already loading
+      std::map<string_t, std::pair<cTextureRef, cResourceHandle>>::const_iterator iterLoading = mTextureLoading.find(s);
+      if (iterLoading != mTextureLoading.end()) {
+        outHandle = iterLoading->second.second;
+        return iterLoading->second.first;
+      }
+
+      // Already loaded
+      std::map<string_t, cTextureRef>::const_iterator iter = mTexture.find(s);
+      if (iter != mTexture.end()) return iter->second;
+
+      cTextureRef p(new cTexture);
+
+      std::shared_ptr<voodoo::cImage> pImage(new voodoo::cImage);
+
+      outHandle = loader.Add(
+        [this, pImage, sFilename, s](std::vector<cResourceHandle>&) {
+          if (pImage->LoadFromFile(sFilename)) return true;
+
+          LOG.Error("Render", "Failed to load " + breathe::string::ToUTF8(sFilename));
+
+          // The upload won't run, forget the texture so that GetTexture returns the not found texture like AddTexture does.
+          // This waits for AddTextureAsync to add the loading entry because it holds the lock while it adds this job.
+          std::lock_guard<std::mutex> lock(mutexTextures);
+          mTextureLoading.erase(s);
+
+          return false;
+        },
+        [this, p, pImage, s]() {
+          const bool bResult = p->CreateFromImage(*pImage);
+          if (!bResult) LOG.Error("Render", "Failed to create texture " + breathe::string::ToUTF8(s));
+
+          std::lock_guard<std::mutex> lock(mutexTextures);
+          if (bResult) mTexture[s] = p;
+          mTextureLoading.erase(s);
+
+          return bResult;
+        }
+      );
+
+      mTextureLoading[s] = std::make_pair(p, outHandle);
+
+      return p;
+    }
+
 #ifndef M_PI
 #define M_PI 3.14159265
 #endif
@@ -756,6 +822,88 @@ void init()
       return pMaterial;
     }
 
+    material::cMaterialRef cResourceManager::AddMaterialAsync(const string_t& sNewFilename, cResourceHandle& outHandle)
+    {
+      outHandle = cResourceHandle();
+
+      if (sNewFilename.empty()) return material::cMaterialRef();
+
+      string_t sFilename;
+      filesystem::FindResourceFile(breathe::string::ToString_t(sNewFilename), sFilename);
+
+      const string_t sFile = filesystem::GetFile(sFilename);
+
+      // Already loading
+      std::map<string_t, std::pair<material::cMaterialRef, cResourceHandle>>::const_iterator iterLoading = mMaterialLoading.find(sFile);
+      if (iterLoading != mMaterialLoading.end()) {
+        outHandle = iterLoading->second.second;
+        return iterLoading->second.first;
+      }
+
+      // Already loaded
+      material::cMaterialRef pMaterial = _GetMaterial(sFile);
+      if (pMaterial != pMaterialNotFoundMaterial) return pMaterial;
+
+      pMaterial.reset(new material::cMaterial(sFilename));
+
+      // The textures are only known once the material has been parsed, the material is uploaded after all of them
+      std::shared_ptr<std::vector<cResourceHandle>> pTextureHandles(new std::vector<cResourceHandle>(material::nLayers));
+
+      // mMaterial and mMaterialLoading belong to the main thread so a parse failure is handled in the upload
+      std::shared_ptr<bool> pIsParsed(new bool(false));
+
+      outHandle = loader.Add(
+        [this, pMaterial, pTextureHandles, pIsParsed, sFilename](std::vector<cResourceHandle>& dependencies) {
+          *pIsParsed = pMaterial->Parse(sFilename);
+          if (!*pIsParsed) return true;
+
+          for (size_t i = 0; i < material::nLayers; i++) {
+            material::cLayer* pLayer = pMaterial->vLayer[i];
+            if (pLayer->sTexture.empty() || (TEXTURE_MODE::CUBE_MAP == pLayer->uiTextureMode) || (TEXTURE_MODE::POST_RENDER == pLayer->uiTextureMode)) continue;
+
+            pLayer->pTexture = AddTextureAsync(pLayer->sTexture, (*pTextureHandles)[i]);
+            dependencies.push_back((*pTextureHandles)[i]);
+          }
+
+          return true;
+        },
+        [this, pMaterial, pTextureHandles, pIsParsed, sFile]() {
+          mMaterialLoading.erase(sFile);
+
+          if (!*pIsParsed) {
+            // Use the not found material from now on like AddMaterial does
+            LOG.Error("Render", "Failed to load material " + breathe::string::ToUTF8(sFile));
+            mMaterial[sFile] = pMaterialNotFoundMaterial;
+            return false;
+          }
+
+          for (size_t i = 0; i < material::nLayers; i++) {
+            if ((*pTextureHandles)[i].IsFailed()) pMaterial->vLayer[i]->pTexture = pMaterialNotFoundTexture;
+          }
+
+          if (pMaterial->pShader != nullptr) pMaterial->pShader->Init();
+
+          mMaterial[sFile] = pMaterial;
+
+          return true;
+        }
+      );
+
+      mMaterialLoading[sFile] = std::make_pair(pMaterial, outHandle);
+
+      return pMaterial;
+    }
+
+    void cResourceManager::UpdateLoading(float fTimeBudgetMS)
+    {
+      loader.Update(fTimeBudgetMS);
+    }
+
+    void cResourceManager::FinishLoading()
+    {
+      loader.Flush();
+    }
+
     material::cMaterialRef cResourceManager::AddMaterialAsAlias(const string_t& sNewfilename, const string_t& sAlias)
     {
       LOG<<"cResourceManager::AddMaterialAsAlias sNewfilename=\""<<sNewfilename<<"\""<<std::endl;
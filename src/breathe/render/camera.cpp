@@ -20,6 +20,9 @@ namespace breathe
   {
     cCamera::cCamera() :
       fFOVDegrees(90.0f),
+      fAspectRatio(1.3333f),
+      fNearClipDistance(1.0f),
+      fFarClipDistance(1000.0f),
       directionUp(spitfire::math::v3Up)
     {
     }
@@ -0,0 +1,522 @@
+// Standard headers
+#include <cassert>
+#include <cstring>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/util/log.h>
+#include <spitfire/util/string.h>
+
+#include <spitfire/storage/file.h>
+#include <spitfire/storage/filesystem.h>
+
+// Breathe headers
+#include <breathe/render/model/cBinaryMesh.h>
+#include <breathe/render/model/cFileFormatOBJ.h>
+
+namespace breathe
+{
+  namespace render
+  {
+    namespace model
+    {
+      namespace
+      {
+        // ** File format
+        //
+        // Little endian, native float and integer layouts
+        //
+        // cFileHeader
+        // cFileMesh[nMeshes]
+        // Then for each mesh, each section 16 byte aligned:
+        //   float vertices[nVertexCount * (nVerticesPerPoint + nNormalsPerPoint + nTextureCoordinatesPerPoint)]
+        //   uint16_t indices[nIndexCount]
+        //   char material[nMaterialBytes]
+        // char sourceFilePath[nSourceFilePathBytes]
+
+        const uint32_t BINARY_MESH_MAGIC = 0x48534D42; // "BMSH"
+
+        const size_t SECTION_ALIGNMENT = 16;
+
+        const size_t MAXIMUM_INDEXED_VERTICES = 65536; // cGeometryData has 16 bit indices
+
+        struct cFileHeader
+        {
+          uint32_t magic;
+          uint32_t version;
+          uint32_t nMeshes;
+          uint32_t nSourceFilePathBytes;
+          uint64_t nSourceFilePathOffset;
+          uint64_t nSourceSizeBytes;
+          int64_t sourceModifiedTime;
+          uint64_t sourceHash;
+          uint64_t nFileSizeBytes;
+          uint64_t reserved;
+        };
+
+        struct cFileMesh
+        {
+          uint64_t nVerticesOffset;
+          uint64_t nIndicesOffset;
+          uint64_t nMaterialOffset;
+          uint32_t nVertexCount;
+          uint32_t nIndexCount;
+          uint32_t nMaterialBytes;
+          uint8_t nVerticesPerPoint;
+          uint8_t nNormalsPerPoint;
+          uint8_t nTextureCoordinatesPerPoint;
+          uint8_t reserved;
+        };
+
+        static_assert(sizeof(cFileHeader) == 64);
+        static_assert(sizeof(cFileMesh) == 40);
+        static_assert(sizeof(float_t) == sizeof(float));
+
+
+        uint64_t HashFNV1a(const uint8_t* pData, size_t nSizeBytes, uint64_t hash = 0xcbf29ce484222325ull)
+        {
+          for (size_t i = 0; i < nSizeBytes; i++) {
+            hash ^= pData[i];
+            hash *= 0x100000001b3ull;
+          }
+          return hash;
+        }
+
+        bool GetSourceSizeAndModifiedTime(const string_t& sSourceFilePath, uint64_t& nSizeBytes, int64_t& modifiedTime)
+        {
+          std::error_code error;
+          const std::filesystem::path path(sSourceFilePath);
+
+          nSizeBytes = std::filesystem::file_size(path, error);
+          if (error) return false;
+
+          modifiedTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+          return !error;
+        }
+
+        bool HashSourceFile(const string_t& sSourceFilePath, uint64_t& hash)
+        {
+          spitfire::storage::cMemoryMappedFile file;
+          if (!file.Open(sSourceFilePath)) return false;
+
+          hash = HashFNV1a(file.GetData(), file.GetSizeBytes());
+          return true;
+        }
+
+        bool IsInFile(uint64_t nOffset, uint64_t nSizeBytes, uint64_t nFileSizeBytes)
+        {
+          return (nOffset <= nFileSizeBytes) && (nSizeBytes <= (nFileSizeBytes - nOffset));
+        }
+
+
+        // ** cMeshBaker
+        // Interleaves a cStaticModelMesh and welds identical points
+
+        class cMeshBaker
+        {
+        public:
+          bool Bake(const cStaticModelMesh& mesh);
+
+          size_t nVerticesPerPoint;
+          size_t nNormalsPerPoint;
+          size_t nTextureCoordinatesPerPoint;
+
+          std::vector<float> vertices;
+          size_t nVertexCount;
+          std::vector<uint16_t> indices;
+
+        private:
+          void Weld(const std::vector<float>& points, size_t nPoints);
+        };
+
+        bool cMeshBaker::Bake(const cStaticModelMesh& mesh)
+        {
+          vertices.clear();
+          indices.clear();
+          nVertexCount = 0;
+
+          if ((mesh.vertices.size() % 3) != 0) {
+            LOGERROR("Vertices are not a multiple of 3");
+            return false;
+          }
+
+          const size_t nPoints = mesh.vertices.size() / 3;
+          if (!mesh.normals.empty() && (mesh.normals.size() != (nPoints * 3))) {
+            LOGERROR("Normals do not match the vertices");
+            return false;
+          }
+          if (!mesh.textureCoordinates.empty() && (mesh.textureCoordinates.size() != (nPoints * 2))) {
+            LOGERROR("Texture coordinates do not match the vertices");
+            return false;
+          }
+
+          nVerticesPerPoint = 3;
+          nNormalsPerPoint = mesh.normals.empty() ? 0 : 3;
+          nTextureCoordinatesPerPoint = mesh.textureCoordinates.empty() ? 0 : 2;
+          const size_t nFloatsPerPoint = nVerticesPerPoint + nNormalsPerPoint + nTextureCoordinatesPerPoint;
+
+          // Interleave in the order that cGeometryData and cVertexBufferObject use
+          std::vector<float> points(nPoints * nFloatsPerPoint);
+          for (size_t i = 0; i < nPoints; i++) {
+            float* pPoint = &points[i * nFloatsPerPoint];
+            std::memcpy(pPoint, &mesh.vertices[i * 3], 3 * sizeof(float));
+            pPoint += 3;
+            if (nNormalsPerPoint != 0) {
+              std::memcpy(pPoint, &mesh.normals[i * 3], 3 * sizeof(float));
+              pPoint += 3;
+            }
+            if (nTextureCoordinatesPerPoint != 0) std::memcpy(pPoint, &mesh.textureCoordinates[i * 2], 2 * sizeof(float));
+          }
+
+          if (!mesh.indices.empty()) {
+            // Already indexed, keep the indices if they fit
+            bool bIsValid = (nPoints <= MAXIMUM_INDEXED_VERTICES);
+            for (size_t index : mesh.indices) bIsValid = bIsValid && (index < nPoints);
+
+            if (bIsValid) {
+              vertices.swap(points);
+              nVertexCount = nPoints;
+              indices.assign(mesh.indices.begin(), mesh.indices.end());
+              return true;
+            }
+
+            // Otherwise expand to one point per index and try welding those instead
+            std::vector<float> expanded;
+            expanded.reserve(mesh.indices.size() * nFloatsPerPoint);
+            for (size_t index : mesh.indices) {
+              if (index >= nPoints) {
+                LOGERROR("Index out of range");
+                return false;
+              }
+              expanded.insert(expanded.end(), points.begin() + (index * nFloatsPerPoint), points.begin() + ((index + 1) * nFloatsPerPoint));
+            }
+            Weld(expanded, mesh.indices.size());
+            return true;
+          }
+
+          Weld(points, nPoints);
+          return true;
+        }
+
+        void cMeshBaker::Weld(const std::vector<float>& points, size_t nPoints)
+        {
+          const size_t nFloatsPerPoint = nVerticesPerPoint + nNormalsPerPoint + nTextureCoordinatesPerPoint;
+          const size_t nPointSizeBytes = nFloatsPerPoint * sizeof(float);
+
+          // Open addressing table of indices into vertices, bitwise identical points are merged
+          size_t nTableSize = 16;
+          while (nTableSize < (2 * nPoints)) nTableSize *= 2;
+          const uint32_t EMPTY = uint32_t(-1);
+          std::vector<uint32_t> table(nTableSize, EMPTY);
+
+          vertices.reserve(points.size());
+          indices.reserve(nPoints);
+
+          for (size_t i = 0; i < nPoints; i++) {
+            const float* pPoint = &points[i * nFloatsPerPoint];
+            size_t slot = HashFNV1a(reinterpret_cast<const uint8_t*>(pPoint), nPointSizeBytes) & (nTableSize - 1);
+            while ((table[slot] != EMPTY) && (std::memcmp(&vertices[table[slot] * nFloatsPerPoint], pPoint, nPointSizeBytes) != 0)) slot = (slot + 1) & (nTableSize - 1);
+
+            if (table[slot] == EMPTY) {
+              if (nVertexCount == MAXIMUM_INDEXED_VERTICES) {
+                // Too many unique points for 16 bit indices
+                vertices.assign(points.begin(), points.begin() + (nPoints * nFloatsPerPoint));
+                nVertexCount = nPoints;
+                indices.clear();
+                return;
+              }
+
+              table[slot] = uint32_t(nVertexCount);
+              vertices.insert(vertices.end(), pPoint, pPoint + nFloatsPerPoint);
+              nVertexCount++;
+            }
+
+            indices.push_back(uint16_t(table[slot]));
+          }
+        }
+
+
+        void Align(std::vector<uint8_t>& buffer)
+        {
+          buffer.resize((buffer.size() + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1), 0);
+        }
+
+        uint64_t Append(std::vector<uint8_t>& buffer, const void* pData, size_t nSizeBytes)
+        {
+          Align(buffer);
+          const uint64_t nOffset = buffer.size();
+          if (nSizeBytes != 0) buffer.insert(buffer.end(), static_cast<const uint8_t*>(pData), static_cast<const uint8_t*>(pData) + nSizeBytes);
+          return nOffset;
+        }
+      }
+
+
+      bool GetBinaryMeshSourceKey(const string_t& sSourceFilePath, cBinaryMeshSourceKey& outKey)
+      {
+        outKey.sSourceFilePath = spitfire::string::ToUTF8(sSourceFilePath);
+        return GetSourceSizeAndModifiedTime(sSourceFilePath, outKey.nSourceSizeBytes, outKey.sourceModifiedTime) && HashSourceFile(sSourceFilePath, outKey.sourceHash);
+      }
+
+
+      // ** cBinaryMeshFile
+
+      cBinaryMeshFile::cBinaryMeshFile() :
+        nSourceSizeBytes(0),
+        sourceModifiedTime(0),
+        sourceHash(0)
+      {
+      }
+
+      bool cBinaryMeshFile::Open(const string_t& sFilePath)
+      {
+        Close();
+
+        if (!file.Open(sFilePath)) return false;
+
+        const uint8_t* pData = file.GetData();
+        const uint64_t nSizeBytes = file.GetSizeBytes();
+
+        if (nSizeBytes < sizeof(cFileHeader)) {
+          Close();
+          return false;
+        }
+
+        const cFileHeader& header = *reinterpret_cast<const cFileHeader*>(pData);
+        if (
+          (header.magic != BINARY_MESH_MAGIC) || (header.version != BINARY_MESH_VERSION) || (header.nFileSizeBytes != nSizeBytes) ||
+          !IsInFile(sizeof(cFileHeader), uint64_t(header.nMeshes) * sizeof(cFileMesh), nSizeBytes) ||
+          !IsInFile(header.nSourceFilePathOffset, header.nSourceFilePathBytes, nSizeBytes)
+        ) {
+          Close();
+          return false;
+        }
+
+        sSourceFilePath = std::string_view(reinterpret_cast<const char*>(pData + header.nSourceFilePathOffset), header.nSourceFilePathBytes);
+        nSourceSizeBytes = header.nSourceSizeBytes;
+        sourceModifiedTime = header.sourceModifiedTime;
+        sourceHash = header.sourceHash;
+
+        const cFileMesh* pFileMeshes = reinterpret_cast<const cFileMesh*>(pData + sizeof(cFileHeader));
+
+        meshes.resize(header.nMeshes);
+        for (size_t i = 0; i < header.nMeshes; i++) {
+          const cFileMesh& fileMesh = pFileMeshes[i];
+
+          cBinaryMeshView& mesh = meshes[i];
+          mesh.nVertexCount = fileMesh.nVertexCount;
+          mesh.nVerticesPerPoint = fileMesh.nVerticesPerPoint;
+          mesh.nNormalsPerPoint = fileMesh.nNormalsPerPoint;
+          mesh.nTextureCoordinatesPerPoint = fileMesh.nTextureCoordinatesPerPoint;
+          mesh.nIndexCount = fileMesh.nIndexCount;
+
+          const uint64_t nVerticesSizeBytes = uint64_t(mesh.nVertexCount) * mesh.GetFloatsPerPoint() * sizeof(float);
+          const uint64_t nIndicesSizeBytes = uint64_t(mesh.nIndexCount) * sizeof(uint16_t);
+          if (
+            (mesh.nVerticesPerPoint != 3) || ((mesh.nNormalsPerPoint != 0) && (mesh.nNormalsPerPoint != 3)) || ((mesh.nTextureCoordinatesPerPoint != 0) && (mesh.nTextureCoordinatesPerPoint != 2)) ||
+            ((mesh.nIndexCount != 0) && (mesh.nVertexCount > MAXIMUM_INDEXED_VERTICES)) ||
+            ((fileMesh.nVerticesOffset % SECTION_ALIGNMENT) != 0) || ((fileMesh.nIndicesOffset % SECTION_ALIGNMENT) != 0) ||
+            !IsInFile(fileMesh.nVerticesOffset, nVerticesSizeBytes, nSizeBytes) ||
+            !IsInFile(fileMesh.nIndicesOffset, nIndicesSizeBytes, nSizeBytes) ||
+            !IsInFile(fileMesh.nMaterialOffset, fileMesh.nMaterialBytes, nSizeBytes)
+          ) {
+            Close();
+            return false;
+          }
+
+          // The mapping is page aligned and the sections are 16 byte aligned so these can point straight into it
+          mesh.pVertices = reinterpret_cast<const float*>(pData + fileMesh.nVerticesOffset);
+          mesh.pIndices = (mesh.nIndexCount != 0) ? reinterpret_cast<const uint16_t*>(pData + fileMesh.nIndicesOffset) : nullptr;
+          mesh.sMaterial = std::string_view(reinterpret_cast<const char*>(pData + fileMesh.nMaterialOffset), fileMesh.nMaterialBytes);
+
+          // Every index has to point at a vertex, a corrupt cache is rebuilt rather than read out of bounds
+          for (size_t j = 0; j < mesh.nIndexCount; j++) {
+            if (mesh.pIndices[j] >= mesh.nVertexCount) {
+              Close();
+              return false;
+            }
+          }
+        }
+
+        return true;
+      }
+
+      void cBinaryMeshFile::Close()
+      {
+        meshes.clear();
+        sSourceFilePath = std::string_view();
+        nSourceSizeBytes = 0;
+        sourceModifiedTime = 0;
+        sourceHash = 0;
+
+        file.Close();
+      }
+
+      bool cBinaryMeshFile::IsUpToDate(const string_t& sSourceFilePath) const
+      {
+        if (!IsOpen() || (spitfire::string::ToUTF8(sSourceFilePath) != GetSourceFilePath())) return false;
+
+        uint64_t nSizeBytes = 0;
+        int64_t modifiedTime = 0;
+        if (!GetSourceSizeAndModifiedTime(sSourceFilePath, nSizeBytes, modifiedTime) || (nSizeBytes != nSourceSizeBytes)) return false;
+
+        if (modifiedTime == sourceModifiedTime) return true;
+
+        // The file has been touched, for example by a checkout, but it may still have the same contents
+        uint64_t hash = 0;
+        return HashSourceFile(sSourceFilePath, hash) && (hash == sourceHash);
+      }
+
+      void cBinaryMeshFile::GetStaticModel(cStaticModel& model) const
+      {
+        model.Clear();
+
+        for (auto&& view : meshes) {
+          cStaticModelMesh* pMesh = new cStaticModelMesh;
+          pMesh->sMaterial = spitfire::string::ToString(std::string(view.sMaterial));
+
+          const size_t nFloatsPerPoint = view.GetFloatsPerPoint();
+          const size_t nPoints = view.IsIndexed() ? view.nIndexCount : view.nVertexCount;
+
+          pMesh->vertices.resize(nPoints * 3);
+          pMesh->normals.resize(nPoints * view.nNormalsPerPoint);
+          pMesh->textureCoordinates.resize(nPoints * view.nTextureCoordinatesPerPoint);
+
+          // De-index so that the model is the same as the source loader would have produced
+          for (size_t i = 0; i < nPoints; i++) {
+            const size_t index = view.IsIndexed() ? view.pIndices[i] : i;
+            ASSERT(index < view.nVertexCount);
+            const float* pPoint = view.pVertices + (index * nFloatsPerPoint);
+
+            std::memcpy(&pMesh->vertices[i * 3], pPoint, 3 * sizeof(float));
+            pPoint += 3;
+            if (view.nNormalsPerPoint != 0) {
+              std::memcpy(&pMesh->normals[i * 3], pPoint, 3 * sizeof(float));
+              pPoint += 3;
+            }
+            if (view.nTextureCoordinatesPerPoint != 0) std::memcpy(&pMesh->textureCoordinates[i * 2], pPoint, 2 * sizeof(float));
+          }
+
+          model.mesh.push_back(pMesh);
+        }
+      }
+
+
+      // ** Baking
+
+      bool SaveBinaryMesh(const string_t& sFilePath, const cBinaryMeshSourceKey& key, const cStaticModel& model)
+      {
+        const size_t nMeshes = model.mesh.size();
+
+        std::vector<uint8_t> buffer(sizeof(cFileHeader) + (nMeshes * sizeof(cFileMesh)), 0);
+        std::vector<cFileMesh> fileMeshes(nMeshes);
+
+        cMeshBaker baker;
+        for (size_t i = 0; i < nMeshes; i++) {
+          ASSERT(model.mesh[i] != nullptr);
+          if (!baker.Bake(*model.mesh[i])) return false;
+
+          const std::string sMaterial = spitfire::string::ToUTF8(model.mesh[i]->sMaterial);
+
+          cFileMesh& fileMesh = fileMeshes[i];
+          std::memset(&fileMesh, 0, sizeof(fileMesh));
+          fileMesh.nVertexCount = uint32_t(baker.nVertexCount);
+          fileMesh.nIndexCount = uint32_t(baker.indices.size());
+          fileMesh.nMaterialBytes = uint32_t(sMaterial.length());
+          fileMesh.nVerticesPerPoint = uint8_t(baker.nVerticesPerPoint);
+          fileMesh.nNormalsPerPoint = uint8_t(baker.nNormalsPerPoint);
+          fileMesh.nTextureCoordinatesPerPoint = uint8_t(baker.nTextureCoordinatesPerPoint);
+          fileMesh.nVerticesOffset = Append(buffer, baker.vertices.data(), baker.vertices.size() * sizeof(float));
+          fileMesh.nIndicesOffset = Append(buffer, baker.indices.data(), baker.indices.size() * sizeof(uint16_t));
+          fileMesh.nMaterialOffset = Append(buffer, sMaterial.data(), sMaterial.length());
+        }
+
+        cFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = BINARY_MESH_MAGIC;
+        header.version = BINARY_MESH_VERSION;
+        header.nMeshes = uint32_t(nMeshes);
+        header.nSourceFilePathBytes = uint32_t(key.sSourceFilePath.length());
+        header.nSourceFilePathOffset = Append(buffer, key.sSourceFilePath.data(), key.sSourceFilePath.length());
+        header.nSourceSizeBytes = key.nSourceSizeBytes;
+        header.sourceModifiedTime = key.sourceModifiedTime;
+        header.sourceHash = key.sourceHash;
+        header.nFileSizeBytes = buffer.size();
+
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        if (nMeshes != 0) std::memcpy(buffer.data() + sizeof(cFileHeader), fileMeshes.data(), nMeshes * sizeof(cFileMesh));
+
+        // Write to a temporary file and rename it so that a reader never sees a half written cache
+        const std::filesystem::path path(sFilePath);
+        std::filesystem::path temporaryPath(path);
+        temporaryPath += ".tmp";
+
+        {
+          std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+          if (!file.good()) return false;
+
+          file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+          if (!file.good()) return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        return !error;
+      }
+
+      bool LoadSourceModel(const string_t& sSourceFilePath, cStaticModel& model)
+      {
+        const string_t sExtension = spitfire::string::ToLower(spitfire::filesystem::GetExtensionNoDot(sSourceFilePath));
+        if (sExtension == TEXT("obj")) {
+          cFileFormatOBJ loader;
+          return loader.Load(sSourceFilePath, model);
+        }
+
+        // The format is not supported
+        return false;
+      }
+
+      bool BakeBinaryMesh(const string_t& sSourceFilePath, const string_t& sBinaryMeshFilePath)
+      {
+        cBinaryMeshSourceKey key;
+        if (!GetBinaryMeshSourceKey(sSourceFilePath, key)) return false;
+
+        cStaticModel model;
+        return LoadSourceModel(sSourceFilePath, model) && SaveBinaryMesh(sBinaryMeshFilePath, key, model);
+      }
+
+      string_t GetBinaryMeshCacheFilePath(const string_t& sSourceFilePath)
+      {
+        return sSourceFilePath + TEXT(".bmesh");
+      }
+
+      bool LoadStaticModelUsingCache(const string_t& sSourceFilePath, cStaticModel& model)
+      {
+        const string_t sCacheFilePath = GetBinaryMeshCacheFilePath(sSourceFilePath);
+
+        {
+          cBinaryMeshFile file;
+          if (file.Open(sCacheFilePath) && file.IsUpToDate(sSourceFilePath)) {
+            file.GetStaticModel(model);
+            return true;
+          }
+        }
+
+        cBinaryMeshSourceKey key;
+        if (!GetBinaryMeshSourceKey(sSourceFilePath, key) || !LoadSourceModel(sSourceFilePath, model)) return false;
+
+        // Failing to write the cache doesn't stop us using the model, we'll just try again next time
+        if (!SaveBinaryMesh(sCacheFilePath, key, model)) {
+          LOGERROR("Failed to write cache");
+        }
+
+        return true;
+      }
+    }
+  }
+}
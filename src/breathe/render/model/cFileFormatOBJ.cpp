@@ -275,8 +275,9 @@ namespace breathe
               std::vector<std::string> elements;
               spitfire::string::Split(tokens[index], '/', elements);
 
-              const size_t l = elements.size();
-              ASSERT(l == 3);
+              // "v/vt/vn", anything that is missing defaults to the first one rather than reading past the end
+              ASSERT(elements.size() == 3);
+              elements.resize(3);
 
               p.vertexIndex = spitfire::string::ToUnsignedInt(spitfire::string::ToString(elements[0]));
               if (p.vertexIndex == 0) p.vertexIndex = 1;
@@ -22,6 +22,18 @@ namespace breathe
         sMaterial.clear();
       }
 
+      bool cStaticModelMesh::GetBoundingBox(spitfire::math::cAABB3& box) const
+      {
+        const size_t nPoints = vertices.size() / 3;
+        if (nPoints == 0) return false;
+
+        const spitfire::math::cVec3 first(vertices[0], vertices[1], vertices[2]);
+        box.SetMinMax(first, first);
+        for (size_t i = 1; i < nPoints; i++) box.AddToVolume(spitfire::math::cVec3(vertices[(3 * i)], vertices[(3 * i) + 1], vertices[(3 * i) + 2]));
+
+        return true;
+      }
+
       void cStaticModel::Clear()
       {
         const size_t n = mesh.size();
@@ -0,0 +1,180 @@
+// Standard headers
+#include <cstring>
+
+#include <algorithm>
+
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/log.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometryData.h>
+#include <libopenglmm/cGeometrySimplifier.h>
+
+// Breathe headers
+#include <breathe/render/model/cStaticLOD.h>
+
+namespace breathe
+{
+  namespace render
+  {
+    namespace model
+    {
+      bool GetGeometryData(const cStaticModelMesh& mesh, opengl::cGeometryData& data)
+      {
+        if ((mesh.vertices.size() % 3) != 0) {
+          LOGERROR("Vertices are not a multiple of 3");
+          return false;
+        }
+
+        const size_t nPoints = mesh.vertices.size() / 3;
+        const bool bNormals = (mesh.normals.size() == (nPoints * 3)) && !mesh.normals.empty();
+        const bool bTextureCoordinates = (mesh.textureCoordinates.size() == (nPoints * 2)) && !mesh.textureCoordinates.empty();
+
+        data.nVerticesPerPoint = 3;
+        data.nNormalsPerPoint = bNormals ? 3 : 0;
+        data.nTextureCoordinatesPerPoint = bTextureCoordinates ? 2 : 0;
+        const size_t nFloatsPerPoint = data.nVerticesPerPoint + data.nNormalsPerPoint + data.nTextureCoordinatesPerPoint;
+
+        data.vertices.resize(nPoints * nFloatsPerPoint);
+        for (size_t i = 0; i < nPoints; i++) {
+          float* pPoint = &data.vertices[i * nFloatsPerPoint];
+          std::memcpy(pPoint, &mesh.vertices[i * 3], 3 * sizeof(float));
+          pPoint += 3;
+          if (bNormals) {
+            std::memcpy(pPoint, &mesh.normals[i * 3], 3 * sizeof(float));
+            pPoint += 3;
+          }
+          if (bTextureCoordinates) std::memcpy(pPoint, &mesh.textureCoordinates[i * 2], 2 * sizeof(float));
+        }
+        data.nVertexCount = nPoints;
+
+        data.indices.clear();
+        if (!mesh.indices.empty()) {
+          if (nPoints > 65536) {
+            LOGERROR("Too many vertices for 16 bit indices");
+            return false;
+          }
+          for (size_t index : mesh.indices) {
+            if (index >= nPoints) {
+              LOGERROR("Index out of range");
+              return false;
+            }
+            data.indices.push_back(uint16_t(index));
+          }
+        }
+
+        return true;
+      }
+
+
+      namespace
+      {
+        void GetStaticModelMesh(const opengl::cGeometryData& data, cStaticModelMesh& mesh)
+        {
+          const size_t nFloatsPerPoint = data.nVerticesPerPoint + data.nNormalsPerPoint + data.nTextureCoordinatesPerPoint;
+          const size_t nPoints = data.indices.size();
+
+          mesh.vertices.resize(nPoints * 3);
+          mesh.normals.resize(nPoints * data.nNormalsPerPoint);
+          mesh.textureCoordinates.resize(nPoints * data.nTextureCoordinatesPerPoint);
+          mesh.indices.clear();
+
+          for (size_t i = 0; i < nPoints; i++) {
+            const float* pPoint = &data.vertices[data.indices[i] * nFloatsPerPoint];
+
+            std::memcpy(&mesh.vertices[i * 3], pPoint, 3 * sizeof(float));
+            pPoint += 3;
+            if (data.nNormalsPerPoint != 0) {
+              std::memcpy(&mesh.normals[i * 3], pPoint, 3 * sizeof(float));
+              pPoint += 3;
+            }
+            if (data.nTextureCoordinatesPerPoint != 0) std::memcpy(&mesh.textureCoordinates[i * 2], pPoint, 2 * sizeof(float));
+          }
+        }
+      }
+
+
+      // ** cStaticModelLOD
+
+      void cStaticModelLOD::Clear()
+      {
+        const size_t n = lod.size();
+        for (size_t i = 0; i < n; i++) spitfire::SAFE_DELETE(lod[i]);
+
+        lod.clear();
+        errors.clear();
+        distances.clear();
+      }
+
+
+      bool GetStaticModelLODBoundingBox(const cStaticModelLOD& lods, spitfire::math::cAABB3& box)
+      {
+        bool bIsFound = false;
+        for (const cStaticModel* pModel : lods.lod) {
+          for (const cStaticModelMesh* pMesh : pModel->mesh) {
+            spitfire::math::cAABB3 meshBox;
+            if (!pMesh->GetBoundingBox(meshBox)) continue;
+
+            if (bIsFound) box.AddToVolume(meshBox);
+            else box = meshBox;
+            bIsFound = true;
+          }
+        }
+
+        return bIsFound;
+      }
+
+      size_t GetStaticModelLODLevel(const std::vector<float>& distances, float fDistance)
+      {
+        size_t level = 0;
+        while (((level + 1) < distances.size()) && (fDistance >= distances[level + 1])) level++;
+        return level;
+      }
+
+      bool GenerateStaticModelLODs(const cStaticModel& model, const std::vector<float>& ratios, float fFieldOfViewDegrees, size_t nViewportHeightPixels, float fMaximumErrorPixels, cStaticModelLOD& lods)
+      {
+        lods.Clear();
+
+        const size_t nLevels = ratios.size() + 1;
+        for (size_t i = 0; i < nLevels; i++) lods.lod.push_back(new cStaticModel);
+        lods.errors.resize(nLevels, 0.0f);
+
+        opengl::cGeometrySimplifier simplifier;
+
+        for (const cStaticModelMesh* pSource : model.mesh) {
+          cStaticModelMesh* pOriginal = new cStaticModelMesh(*pSource);
+          lods.lod[0]->mesh.push_back(pOriginal);
+
+          opengl::cGeometryData data;
+          std::vector<opengl::cGeometryData> levels;
+          std::vector<float> errors;
+          if (!GetGeometryData(*pSource, data) || !simplifier.GenerateLODs(data, ratios, levels, errors)) {
+            LOGERROR("Failed to simplify mesh");
+            lods.Clear();
+            return false;
+          }
+
+          for (size_t i = 0; i < levels.size(); i++) {
+            cStaticModelMesh* pMesh = new cStaticModelMesh;
+            pMesh->sMaterial = pSource->sMaterial;
+            GetStaticModelMesh(levels[i], *pMesh);
+            lods.lod[i + 1]->mesh.push_back(pMesh);
+
+            // The whole level switches at once so the worst mesh decides when
+            lods.errors[i + 1] = std::max(lods.errors[i + 1], errors[i]);
+          }
+        }
+
+        for (size_t i = 0; i < nLevels; i++) {
+          if (i != 0) lods.errors[i] = std::max(lods.errors[i], lods.errors[i - 1]);
+          lods.distances.push_back(opengl::GetLODSwitchDistance(lods.errors[i], fFieldOfViewDegrees, nViewportHeightPixels, fMaximumErrorPixels));
+        }
+
+        return true;
+      }
+    }
+  }
+}
@@ -115,6 +115,7 @@
 #include <breathe/render/model/cMesh.h>
 #include <breathe/render/model/cModel.h>
 #include <breathe/render/model/cStatic.h>
+#include <breathe/render/model/cBinaryMesh.h>
 
 #include <breathe/loader_3ds/file.h>
 #include <breathe/loader_3ds/chunk.h>
@@ -665,10 +666,12 @@ namespace breathe
         meshes.clear();
 
 
+        // Load from the .bmesh cache next to the model, the first load bakes it
         breathe::render::model::cStaticModel model;
-
-        breathe::render::model::cStaticModelLoader loader;
-        loader.Load(sFilename, model);
+        if (!breathe::render::model::LoadStaticModelUsingCache(sFilename, model)) {
+          breathe::render::model::cStaticModelLoader loader;
+          loader.Load(sFilename, model);
+        }
 
         const size_t nMeshes = model.mesh.size();
         for (size_t iMesh = 0; iMesh < nMeshes; iMesh++) {
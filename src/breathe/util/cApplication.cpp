@@ -1068,6 +1068,7 @@ namespace breathe
 
     // NOTE: The current state needs to have set this camera correctly by now
     pContext->SetFrustum(camera.CreateFrustumFromCamera());
+    camera.SetAspectRatio(float_t(pContext->GetWidth()) / float_t(pContext->GetHeight()));
 
     // Now update our other sub systems
     breathe::audio::GetManager()->Update(currentTime, camera.GetEyePosition(), camera.GetLookAtPoint(), camera.GetUpDirection());
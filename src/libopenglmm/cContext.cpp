@@ -1373,6 +1373,22 @@ GLenum CubeMapFaceToGLenum(CUBE_MAP_FACE face)
     return true;
   }
 
+  bool cContext::SetShaderConstantMatrixArray(const std::string& sConstant, const float* pMatrices, size_t nMatrices)
+  {
+    assert(pMatrices != nullptr);
+    assert(nMatrices != 0);
+
+    GLint loc = glGetUniformLocation(pCurrentShader->uiShaderProgram, sConstant.c_str());
+    if (loc == -1) {
+      LOG(TEXT("\""), pCurrentShader->sShaderVertex, TEXT("\", \""), pCurrentShader->sShaderFragment, TEXT("\":\""), pCurrentShader->IsCompiledFragment(), TEXT("\" Couldn't set \""), spitfire::string::ToString(sConstant), TEXT("\" perhaps the constant is not actually used within the shader"));
+      assert(loc > 0);
+      return false;
+    }
+
+    glUniformMatrix4fv(loc, GLsizei(nMatrices), GL_FALSE, pMatrices);
+    return true;
+  }
+
 
   // ** cStaticVertexBufferObject
 
@@ -1412,6 +1428,11 @@ GLenum CubeMapFaceToGLenum(CUBE_MAP_FACE face)
     staticVertexBufferObject.RenderTriangleStrip();
   }
 
+  void cContext::DrawStaticVertexBufferObjectTrianglesInstanced(cStaticVertexBufferObject& staticVertexBufferObject, size_t nInstances)
+  {
+    staticVertexBufferObject.RenderTrianglesInstanced(nInstances);
+  }
+
   #ifndef BUILD_LIBOPENGLMM_OPENGL_STRICT
   void cContext::DrawStaticVertexBufferObjectQuads(cStaticVertexBufferObject& staticVertexBufferObject)
   {
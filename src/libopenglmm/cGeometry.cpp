@@ -206,9 +206,6 @@ namespace opengl
     const int latitudes = int(nSegments);
     const int longitudes = int(nSegments);
 
-    const float fSegmentTextureWidth = 1.0f / latitudes;
-    const float fSegmentTextureHeight = 1.0f / longitudes;
-
     for (int i = 0; i <= latitudes; i++) {
       double lat0 = spitfire::math::cPI * (-0.5 + double(i - 1) / latitudes);
       double z0 = sin(lat0);
@@ -227,9 +224,6 @@ namespace opengl
           double x1 = cos(lng1);
           double y1 = sin(lng1);
 
-          const float fU = float(j) * fSegmentTextureWidth;
-          const float fV = float(i) * fSegmentTextureHeight;
-
           builder.PushBack(position + fRadius * spitfire::math::cVec3(x1 * zr1, y1 * zr1, z1), spitfire::math::cVec3(x1 * zr1, y1 * zr1, z1), colour);
           builder.PushBack(position + fRadius * spitfire::math::cVec3(x0 * zr1, y0 * zr1, z1), spitfire::math::cVec3(x0 * zr1, y0 * zr1, z1), colour);
           builder.PushBack(position + fRadius * spitfire::math::cVec3(x0 * zr0, y0 * zr0, z0), spitfire::math::cVec3(x0 * zr0, y0 * zr0, z0), colour);
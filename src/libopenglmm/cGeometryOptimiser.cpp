@@ -0,0 +1,436 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/math/cVec3.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometryOptimiser.h>
+
+namespace opengl
+{
+  namespace
+  {
+    const size_t MAXIMUM_INDEXED_VERTICES = 65536;
+
+    size_t GetFloatsPerPoint(const cGeometryData& data)
+    {
+      return data.nVerticesPerPoint + data.nNormalsPerPoint + data.nColoursPerPoint + data.nTextureCoordinatesPerPoint +
+        data.nFloatUserData0PerPoint + data.nFloatUserData1PerPoint + data.nFloatUserData2PerPoint;
+    }
+
+    size_t GetIndexCount(const cGeometryData& data)
+    {
+      return data.indices.empty() ? data.nVertexCount : data.indices.size();
+    }
+
+    size_t GetIndex(const cGeometryData& data, size_t i)
+    {
+      return data.indices.empty() ? i : data.indices[i];
+    }
+
+    uint64_t HashPoint(const float* pPoint, size_t nFloatsPerPoint)
+    {
+      // FNV-1a over the bits of the point
+      const uint8_t* pData = reinterpret_cast<const uint8_t*>(pPoint);
+      const size_t nSizeBytes = nFloatsPerPoint * sizeof(float);
+      uint64_t hash = 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < nSizeBytes; i++) {
+        hash ^= pData[i];
+        hash *= 0x100000001b3ull;
+      }
+      return hash;
+    }
+
+    spitfire::math::cVec3 GetPosition(const cGeometryData& data, size_t nFloatsPerPoint, size_t index)
+    {
+      const float* pPoint = &data.vertices[index * nFloatsPerPoint];
+      return spitfire::math::cVec3(pPoint[0], pPoint[1], pPoint[2]);
+    }
+
+
+    // ** cVertexCache
+    // A FIFO post transform cache, a vertex is in the cache if fewer than nCacheSize misses have happened since it was added
+
+    class cVertexCache
+    {
+    public:
+      cVertexCache(size_t nVertexCount, size_t nCacheSize);
+
+      void Clear() { nTime += nCacheSize + 1; }
+
+      bool IsInCache(size_t index) const { return ((nTime - timestamps[index]) <= nCacheSize); }
+      bool Use(size_t index); // Returns true if it was a miss
+
+      size_t GetTime() const { return nTime; }
+      size_t GetTimestamp(size_t index) const { return timestamps[index]; }
+
+    private:
+      size_t nCacheSize;
+      size_t nTime;
+      std::vector<size_t> timestamps;
+    };
+
+    cVertexCache::cVertexCache(size_t nVertexCount, size_t _nCacheSize) :
+      nCacheSize(_nCacheSize),
+      nTime(_nCacheSize + 1),
+      timestamps(nVertexCount, 0)
+    {
+    }
+
+    bool cVertexCache::Use(size_t index)
+    {
+      if (IsInCache(index)) return false;
+
+      timestamps[index] = nTime;
+      nTime++;
+      return true;
+    }
+
+
+    // ** cCluster
+
+    struct cCluster
+    {
+      size_t start;
+      size_t end;
+      float fSortKey;
+    };
+  }
+
+
+  // ** cGeometryOptimiser
+
+  bool cGeometryOptimiser::Optimise(cGeometryData& data, cGeometryOptimiserStatistics& statistics) const
+  {
+    statistics.nVertexCountBefore = data.nVertexCount;
+    statistics.fACMRBefore = GetACMR(data);
+    statistics.fATVRBefore = GetATVR(data);
+
+    if (!WeldVertices(data)) return false;
+
+    OptimiseVertexCache(data);
+    OptimiseOverdraw(data);
+    OptimiseVertexFetch(data);
+
+    statistics.nVertexCountAfter = data.nVertexCount;
+    statistics.fACMRAfter = GetACMR(data);
+    statistics.fATVRAfter = GetATVR(data);
+
+    return true;
+  }
+
+  bool cGeometryOptimiser::WeldVertices(cGeometryData& data) const
+  {
+    const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+    ASSERT(data.vertices.size() == (data.nVertexCount * nFloatsPerPoint));
+
+    // Open addressing table of the first point with each value
+    size_t nTableSize = 16;
+    while (nTableSize < (2 * data.nVertexCount)) nTableSize *= 2;
+    const uint32_t EMPTY = uint32_t(-1);
+    std::vector<uint32_t> table(nTableSize, EMPTY);
+
+    std::vector<uint32_t> remap(data.nVertexCount);
+    std::vector<float> vertices;
+    vertices.reserve(data.vertices.size());
+    size_t nUniqueVertices = 0;
+
+    for (size_t i = 0; i < data.nVertexCount; i++) {
+      const float* pPoint = &data.vertices[i * nFloatsPerPoint];
+      size_t slot = HashPoint(pPoint, nFloatsPerPoint) & (nTableSize - 1);
+      while ((table[slot] != EMPTY) && (std::memcmp(&vertices[table[slot] * nFloatsPerPoint], pPoint, nFloatsPerPoint * sizeof(float)) != 0)) slot = (slot + 1) & (nTableSize - 1);
+
+      if (table[slot] == EMPTY) {
+        if (nUniqueVertices == MAXIMUM_INDEXED_VERTICES) return false;
+
+        table[slot] = uint32_t(nUniqueVertices);
+        vertices.insert(vertices.end(), pPoint, pPoint + nFloatsPerPoint);
+        nUniqueVertices++;
+      }
+
+      remap[i] = table[slot];
+    }
+
+    const size_t nIndices = GetIndexCount(data);
+    std::vector<uint16_t> indices(nIndices);
+    for (size_t i = 0; i < nIndices; i++) indices[i] = uint16_t(remap[GetIndex(data, i)]);
+
+    data.vertices.swap(vertices);
+    data.indices.swap(indices);
+    data.nVertexCount = nUniqueVertices;
+
+    return true;
+  }
+
+  // Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", Sander, Nehab and Barczak 2007
+  // We fan around the most recently used vertex that will still be in the cache after its remaining triangles are emitted,
+  // when there isn't one we jump to a vertex from the dead end stack, or failing that the next vertex with triangles left.
+  void cGeometryOptimiser::OptimiseVertexCache(cGeometryData& data) const
+  {
+    ASSERT(!data.indices.empty() || (data.nVertexCount == 0));
+
+    const size_t nVertices = data.nVertexCount;
+    const size_t nTriangles = data.indices.size() / 3;
+    if (nTriangles == 0) return;
+
+    // Triangles around each vertex
+    std::vector<uint32_t> live(nVertices, 0);
+    for (size_t i = 0; i < (nTriangles * 3); i++) live[data.indices[i]]++;
+
+    std::vector<uint32_t> offsets(nVertices + 1, 0);
+    for (size_t v = 0; v < nVertices; v++) offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<uint32_t> adjacency(nTriangles * 3);
+    {
+      std::vector<uint32_t> position(offsets.begin(), offsets.end() - 1);
+      for (size_t t = 0; t < nTriangles; t++) {
+        for (size_t j = 0; j < 3; j++) adjacency[position[data.indices[(t * 3) + j]]++] = uint32_t(t);
+      }
+    }
+
+    cVertexCache cache(nVertices, nCacheSize);
+    std::vector<bool> emitted(nTriangles, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+
+    std::vector<uint16_t> indices;
+    indices.reserve(nTriangles * 3);
+
+    size_t cursor = 0;
+    auto SkipDeadEnd = [&]() -> int64_t {
+      while (!deadEnds.empty()) {
+        const uint32_t v = deadEnds.back();
+        deadEnds.pop_back();
+        if (live[v] != 0) return v;
+      }
+
+      for (; cursor < nVertices; cursor++) {
+        if (live[cursor] != 0) return int64_t(cursor);
+      }
+
+      return -1;
+    };
+
+    int64_t fanningVertex = SkipDeadEnd();
+    while (fanningVertex >= 0) {
+      candidates.clear();
+
+      for (uint32_t a = offsets[size_t(fanningVertex)]; a < offsets[size_t(fanningVertex) + 1]; a++) {
+        const uint32_t t = adjacency[a];
+        if (emitted[t]) continue;
+
+        for (size_t j = 0; j < 3; j++) {
+          const uint16_t v = data.indices[(t * 3) + j];
+          indices.push_back(v);
+          deadEnds.push_back(v);
+          candidates.push_back(v);
+          live[v]--;
+          cache.Use(v);
+        }
+
+        emitted[t] = true;
+      }
+
+      // Pick the candidate that has been in the cache the longest that will still be in the cache once its triangles are emitted
+      int64_t next = -1;
+      int64_t bestPriority = -1;
+      for (uint32_t v : candidates) {
+        if (live[v] == 0) continue;
+
+        int64_t priority = 0;
+        const int64_t age = int64_t(cache.GetTime() - cache.GetTimestamp(v));
+        if ((age + (2 * int64_t(live[v]))) <= int64_t(nCacheSize)) priority = age;
+
+        if (priority > bestPriority) {
+          bestPriority = priority;
+          next = v;
+        }
+      }
+
+      fanningVertex = (next >= 0) ? next : SkipDeadEnd();
+    }
+
+    ASSERT(indices.size() == (nTriangles * 3));
+
+    // Anything after the last whole triangle is left where it was
+    indices.insert(indices.end(), data.indices.begin() + (nTriangles * 3), data.indices.end());
+
+    data.indices.swap(indices);
+  }
+
+  // Splits the triangles into clusters and sorts the clusters so that those facing away from the center of the mesh are drawn first,
+  // they are more likely to occlude the rest of the mesh.  A cluster starts wherever the cache order already flushes the cache, and
+  // also wherever the cache efficiency since the start of the cluster is within fOverdrawThreshold of the efficiency of the whole cluster.
+  void cGeometryOptimiser::OptimiseOverdraw(cGeometryData& data) const
+  {
+    if (data.nVerticesPerPoint != 3) return;
+
+    const size_t nTriangles = data.indices.size() / 3;
+    if (nTriangles < 2) return;
+
+    const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+
+    // Hard boundaries, where all three vertices of a triangle miss the cache
+    std::vector<size_t> hardBoundaries;
+    std::vector<size_t> hardMisses;
+    {
+      cVertexCache cache(data.nVertexCount, nCacheSize);
+      size_t nMisses = 0;
+      for (size_t t = 0; t < nTriangles; t++) {
+        size_t nTriangleMisses = 0;
+        for (size_t j = 0; j < 3; j++) if (cache.Use(data.indices[(t * 3) + j])) nTriangleMisses++;
+
+        if ((nTriangleMisses == 3) && (t != 0)) {
+          hardBoundaries.push_back(t);
+          hardMisses.push_back(nMisses);
+          nMisses = 0;
+        }
+        nMisses += nTriangleMisses;
+      }
+      hardBoundaries.push_back(nTriangles);
+      hardMisses.push_back(nMisses);
+    }
+
+    // Soft boundaries inside each hard cluster
+    std::vector<cCluster> clusters;
+    {
+      cVertexCache cache(data.nVertexCount, nCacheSize);
+      size_t start = 0;
+      for (size_t h = 0; h < hardBoundaries.size(); h++) {
+        const size_t end = hardBoundaries[h];
+        const float fThresholdACMR = fOverdrawThreshold * float(hardMisses[h]) / float(end - start);
+
+        cache.Clear();
+        size_t clusterStart = start;
+        size_t nMisses = 0;
+        for (size_t t = start; t < end; t++) {
+          for (size_t j = 0; j < 3; j++) if (cache.Use(data.indices[(t * 3) + j])) nMisses++;
+
+          const size_t nClusterTriangles = t + 1 - clusterStart;
+          if (((t + 1) < end) && (float(nMisses) <= (fThresholdACMR * float(nClusterTriangles)))) {
+            clusters.push_back({ clusterStart, t + 1, 0.0f });
+            clusterStart = t + 1;
+            nMisses = 0;
+            cache.Clear();
+          }
+        }
+        // The remainder is merged into the previous cluster if it is worse than the threshold
+        const bool bIsRemainderEfficient = (float(nMisses) <= (fThresholdACMR * float(end - clusterStart)));
+        if (!bIsRemainderEfficient && !clusters.empty() && (clusters.back().end == clusterStart) && (clusters.back().start >= start)) clusters.back().end = end;
+        else clusters.push_back({ clusterStart, end, 0.0f });
+
+        start = end;
+      }
+    }
+
+    if (clusters.size() < 2) return;
+
+    // Area weighted centroid and normal of each cluster
+    std::vector<spitfire::math::cVec3> centroids(clusters.size());
+    std::vector<spitfire::math::cVec3> normals(clusters.size());
+    spitfire::math::cVec3 meshCentroid;
+    float fMeshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); c++) {
+      spitfire::math::cVec3 centroid;
+      spitfire::math::cVec3 normal;
+      float fArea = 0.0f;
+      for (size_t t = clusters[c].start; t < clusters[c].end; t++) {
+        const spitfire::math::cVec3 p0 = GetPosition(data, nFloatsPerPoint, data.indices[(t * 3)]);
+        const spitfire::math::cVec3 p1 = GetPosition(data, nFloatsPerPoint, data.indices[(t * 3) + 1]);
+        const spitfire::math::cVec3 p2 = GetPosition(data, nFloatsPerPoint, data.indices[(t * 3) + 2]);
+        const spitfire::math::cVec3 cross = (p1 - p0).CrossProduct(p2 - p0);
+        const float fTriangleArea = cross.GetLength();
+
+        centroid += (p0 + p1 + p2) * (fTriangleArea / 3.0f);
+        normal += cross;
+        fArea += fTriangleArea;
+      }
+
+      if (fArea > 0.0f) centroid /= fArea;
+      centroids[c] = centroid;
+      normals[c] = normal;
+
+      meshCentroid += centroid * fArea;
+      fMeshArea += fArea;
+    }
+    if (fMeshArea > 0.0f) meshCentroid /= fMeshArea;
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+      const float fLength = normals[c].GetLength();
+      clusters[c].fSortKey = (fLength > 0.0f) ? (centroids[c] - meshCentroid).DotProduct(normals[c] / fLength) : 0.0f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const cCluster& lhs, const cCluster& rhs) { return (lhs.fSortKey > rhs.fSortKey); });
+
+    std::vector<uint16_t> indices;
+    indices.reserve(data.indices.size());
+    for (auto&& cluster : clusters) indices.insert(indices.end(), data.indices.begin() + (cluster.start * 3), data.indices.begin() + (cluster.end * 3));
+    indices.insert(indices.end(), data.indices.begin() + (nTriangles * 3), data.indices.end());
+
+    data.indices.swap(indices);
+  }
+
+  void cGeometryOptimiser::OptimiseVertexFetch(cGeometryData& data) const
+  {
+    ASSERT(!data.indices.empty() || (data.nVertexCount == 0));
+
+    const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+    const uint32_t UNUSED = uint32_t(-1);
+    std::vector<uint32_t> remap(data.nVertexCount, UNUSED);
+
+    std::vector<float> vertices;
+    vertices.reserve(data.vertices.size());
+    size_t nVertices = 0;
+
+    for (auto&& index : data.indices) {
+      if (remap[index] == UNUSED) {
+        remap[index] = uint32_t(nVertices);
+        vertices.insert(vertices.end(), data.vertices.begin() + (index * nFloatsPerPoint), data.vertices.begin() + ((index + 1) * nFloatsPerPoint));
+        nVertices++;
+      }
+
+      index = uint16_t(remap[index]);
+    }
+
+    data.vertices.swap(vertices);
+    data.nVertexCount = nVertices;
+  }
+
+  float cGeometryOptimiser::GetACMR(const cGeometryData& data) const
+  {
+    const size_t nTriangles = GetIndexCount(data) / 3;
+    if (nTriangles == 0) return 0.0f;
+
+    cVertexCache cache(data.nVertexCount, nCacheSize);
+    size_t nMisses = 0;
+    for (size_t i = 0; i < (nTriangles * 3); i++) if (cache.Use(GetIndex(data, i))) nMisses++;
+
+    return float(nMisses) / float(nTriangles);
+  }
+
+  float cGeometryOptimiser::GetATVR(const cGeometryData& data) const
+  {
+    const size_t nIndices = GetIndexCount(data);
+
+    cVertexCache cache(data.nVertexCount, nCacheSize);
+    std::vector<bool> used(data.nVertexCount, false);
+    size_t nMisses = 0;
+    size_t nUsed = 0;
+    for (size_t i = 0; i < nIndices; i++) {
+      const size_t index = GetIndex(data, i);
+      if (cache.Use(index)) nMisses++;
+      if (!used[index]) {
+        used[index] = true;
+        nUsed++;
+      }
+    }
+
+    return (nUsed != 0) ? (float(nMisses) / float(nUsed)) : 0.0f;
+  }
+}
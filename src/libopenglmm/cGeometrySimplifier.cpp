@@ -0,0 +1,474 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/math/math.h>
+#include <spitfire/math/cVec3.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometryOptimiser.h>
+#include <libopenglmm/cGeometrySimplifier.h>
+
+namespace opengl
+{
+  namespace
+  {
+    size_t GetFloatsPerPoint(const cGeometryData& data)
+    {
+      return data.nVerticesPerPoint + data.nNormalsPerPoint + data.nColoursPerPoint + data.nTextureCoordinatesPerPoint +
+        data.nFloatUserData0PerPoint + data.nFloatUserData1PerPoint + data.nFloatUserData2PerPoint;
+    }
+
+    uint64_t GetEdgeKey(uint32_t a, uint32_t b)
+    {
+      return (a < b) ? ((uint64_t(a) << 32) | b) : ((uint64_t(b) << 32) | a);
+    }
+
+
+    // ** cQuadric
+    // The sum of the squared distances to a set of planes, stored as the upper half of a symmetric 4x4 matrix
+
+    class cQuadric
+    {
+    public:
+      cQuadric();
+
+      void AddPlane(double a, double b, double c, double d);
+      void operator+=(const cQuadric& rhs);
+
+      double GetError(const spitfire::math::cVec3& p) const;
+
+    private:
+      double a2, ab, ac, ad;
+      double b2, bc, bd;
+      double c2, cd;
+      double d2;
+    };
+
+    cQuadric::cQuadric() :
+      a2(0.0), ab(0.0), ac(0.0), ad(0.0),
+      b2(0.0), bc(0.0), bd(0.0),
+      c2(0.0), cd(0.0),
+      d2(0.0)
+    {
+    }
+
+    void cQuadric::AddPlane(double a, double b, double c, double d)
+    {
+      a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+      b2 += b * b; bc += b * c; bd += b * d;
+      c2 += c * c; cd += c * d;
+      d2 += d * d;
+    }
+
+    void cQuadric::operator+=(const cQuadric& rhs)
+    {
+      a2 += rhs.a2; ab += rhs.ab; ac += rhs.ac; ad += rhs.ad;
+      b2 += rhs.b2; bc += rhs.bc; bd += rhs.bd;
+      c2 += rhs.c2; cd += rhs.cd;
+      d2 += rhs.d2;
+    }
+
+    double cQuadric::GetError(const spitfire::math::cVec3& p) const
+    {
+      const double x = p.x;
+      const double y = p.y;
+      const double z = p.z;
+      const double fError = (a2 * x * x) + (2.0 * ab * x * y) + (2.0 * ac * x * z) + (2.0 * ad * x) +
+        (b2 * y * y) + (2.0 * bc * y * z) + (2.0 * bd * y) +
+        (c2 * z * z) + (2.0 * cd * z) +
+        d2;
+
+      // Rounding can take it slightly below zero
+      return std::max(fError, 0.0);
+    }
+
+
+    // ** cCollapse
+    // Moving vertex from onto vertex to
+
+    struct cCollapse
+    {
+      double fCost;
+      uint32_t from;
+      uint32_t to;
+
+      bool operator>(const cCollapse& rhs) const { return (fCost > rhs.fCost); }
+    };
+
+
+    // ** cSimplifier
+    // The state of one simplification
+
+    class cSimplifier
+    {
+    public:
+      explicit cSimplifier(cGeometryData& data);
+
+      void Simplify(size_t nTargetTriangles, double fMaximumError);
+
+      void GetIndices(std::vector<uint16_t>& indices) const;
+      double GetError() const { return fError; }
+
+    private:
+      double GetCost(uint32_t from, uint32_t to) const;
+      double GetDeviation(uint32_t from, uint32_t to) const;
+      void PushCollapses(uint32_t triangle);
+      bool IsValid(uint32_t from, uint32_t to) const;
+      void Collapse(uint32_t from, uint32_t to);
+
+      bool Contains(uint32_t triangle, uint32_t vertex) const;
+      bool ContainsGroup(uint32_t triangle, uint32_t group) const;
+
+      std::vector<spitfire::math::cVec3> positions;
+      std::vector<uint32_t> groups; // Vertices with the same position are in the same group
+      std::vector<bool> locked; // Per group
+      std::vector<cQuadric> quadrics; // Per group
+      std::vector<double> deviations; // Per group, how far the surface around this position could have moved from the original
+
+      std::vector<uint32_t> triangles; // 3 vertices per triangle
+      std::vector<bool> alive;
+      size_t nAliveTriangles;
+      std::vector<std::vector<uint32_t>> vertexTriangles; // May contain dead triangles and triangles that no longer use the vertex
+
+      std::priority_queue<cCollapse, std::vector<cCollapse>, std::greater<cCollapse>> queue;
+
+      double fError;
+    };
+
+    cSimplifier::cSimplifier(cGeometryData& data) :
+      nAliveTriangles(0),
+      fError(0.0)
+    {
+      const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+      const size_t nVertices = data.nVertexCount;
+
+      positions.resize(nVertices);
+      for (size_t i = 0; i < nVertices; i++) {
+        const float* pPoint = &data.vertices[i * nFloatsPerPoint];
+        positions[i].Set(pPoint[0], pPoint[1], pPoint[2]);
+      }
+
+      // Group the vertices by position
+      size_t nGroups = 0;
+      std::vector<size_t> wedges;
+      {
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        groups.resize(nVertices);
+        for (size_t i = 0; i < nVertices; i++) {
+          uint32_t bits[3];
+          std::memcpy(bits, &data.vertices[i * nFloatsPerPoint], sizeof(bits));
+          const uint64_t hash = (uint64_t(bits[0]) * 73856093ull) ^ (uint64_t(bits[1]) * 19349663ull) ^ (uint64_t(bits[2]) * 83492791ull);
+
+          std::vector<uint32_t>& bucket = buckets[hash];
+          bool bFound = false;
+          for (uint32_t other : bucket) {
+            if (std::memcmp(&data.vertices[other * nFloatsPerPoint], &data.vertices[i * nFloatsPerPoint], sizeof(bits)) == 0) {
+              groups[i] = groups[other];
+              wedges[groups[i]]++;
+              bFound = true;
+              break;
+            }
+          }
+
+          if (!bFound) {
+            groups[i] = uint32_t(nGroups);
+            wedges.push_back(1);
+            bucket.push_back(uint32_t(i));
+            nGroups++;
+          }
+        }
+      }
+
+      // Degenerate triangles draw nothing so they are dropped
+      const size_t nTriangles = data.indices.size() / 3;
+      triangles.reserve(nTriangles * 3);
+      for (size_t t = 0; t < nTriangles; t++) {
+        const uint32_t a = data.indices[(t * 3)];
+        const uint32_t b = data.indices[(t * 3) + 1];
+        const uint32_t c = data.indices[(t * 3) + 2];
+        if ((groups[a] == groups[b]) || (groups[b] == groups[c]) || (groups[a] == groups[c])) continue;
+
+        triangles.push_back(a);
+        triangles.push_back(b);
+        triangles.push_back(c);
+      }
+      nAliveTriangles = triangles.size() / 3;
+      alive.assign(nAliveTriangles, true);
+
+      // Seams, borders and non-manifold edges are locked
+      locked.resize(nGroups);
+      for (size_t g = 0; g < nGroups; g++) locked[g] = (wedges[g] > 1);
+
+      std::unordered_map<uint64_t, uint32_t> edges;
+      for (size_t i = 0; i < triangles.size(); i += 3) {
+        for (size_t j = 0; j < 3; j++) edges[GetEdgeKey(groups[triangles[i + j]], groups[triangles[i + ((j + 1) % 3)]])]++;
+      }
+      for (auto&& edge : edges) {
+        if (edge.second != 2) {
+          locked[uint32_t(edge.first >> 32)] = true;
+          locked[uint32_t(edge.first & 0xFFFFFFFF)] = true;
+        }
+      }
+
+      // Quadrics from the planes of the triangles around each position
+      quadrics.resize(nGroups);
+      deviations.resize(nGroups, 0.0);
+      for (size_t i = 0; i < triangles.size(); i += 3) {
+        const spitfire::math::cVec3& p0 = positions[triangles[i]];
+        const spitfire::math::cVec3 normal = (positions[triangles[i + 1]] - p0).CrossProduct(positions[triangles[i + 2]] - p0);
+        const float fLength = normal.GetLength();
+        if (fLength <= 0.0f) continue;
+
+        const spitfire::math::cVec3 n = normal / fLength;
+        cQuadric quadric;
+        quadric.AddPlane(n.x, n.y, n.z, -n.DotProduct(p0));
+        for (size_t j = 0; j < 3; j++) quadrics[groups[triangles[i + j]]] += quadric;
+      }
+
+      vertexTriangles.resize(nVertices);
+      for (size_t i = 0; i < triangles.size(); i += 3) {
+        for (size_t j = 0; j < 3; j++) vertexTriangles[triangles[i + j]].push_back(uint32_t(i / 3));
+      }
+
+      for (size_t t = 0; t < nAliveTriangles; t++) PushCollapses(uint32_t(t));
+    }
+
+    bool cSimplifier::Contains(uint32_t triangle, uint32_t vertex) const
+    {
+      const uint32_t* pTriangle = &triangles[triangle * 3];
+      return (pTriangle[0] == vertex) || (pTriangle[1] == vertex) || (pTriangle[2] == vertex);
+    }
+
+    bool cSimplifier::ContainsGroup(uint32_t triangle, uint32_t group) const
+    {
+      const uint32_t* pTriangle = &triangles[triangle * 3];
+      return (groups[pTriangle[0]] == group) || (groups[pTriangle[1]] == group) || (groups[pTriangle[2]] == group);
+    }
+
+    double cSimplifier::GetCost(uint32_t from, uint32_t to) const
+    {
+      cQuadric quadric = quadrics[groups[from]];
+      quadric += quadrics[groups[to]];
+      return quadric.GetError(positions[to]);
+    }
+
+    double cSimplifier::GetDeviation(uint32_t from, uint32_t to) const
+    {
+      // The distance that to is from the planes of the triangles that are moving, added to how far they had already moved
+      double fDistance = 0.0;
+      for (uint32_t t : vertexTriangles[from]) {
+        if (!alive[t] || !Contains(t, from)) continue;
+
+        const spitfire::math::cVec3& p0 = positions[triangles[t * 3]];
+        const spitfire::math::cVec3 normal = (positions[triangles[(t * 3) + 1]] - p0).CrossProduct(positions[triangles[(t * 3) + 2]] - p0);
+        const float fLength = normal.GetLength();
+        if (fLength > 0.0f) fDistance = std::max(fDistance, double(std::fabs(normal.DotProduct(positions[to] - p0)) / fLength));
+      }
+
+      return std::max(deviations[groups[to]], deviations[groups[from]] + fDistance);
+    }
+
+    void cSimplifier::PushCollapses(uint32_t triangle)
+    {
+      for (size_t j = 0; j < 3; j++) {
+        const uint32_t a = triangles[(triangle * 3) + j];
+        const uint32_t b = triangles[(triangle * 3) + ((j + 1) % 3)];
+        if (!locked[groups[a]]) queue.push({ GetCost(a, b), a, b });
+        if (!locked[groups[b]]) queue.push({ GetCost(b, a), b, a });
+      }
+    }
+
+    bool cSimplifier::IsValid(uint32_t from, uint32_t to) const
+    {
+      const uint32_t groupTo = groups[to];
+
+      // The edge has to still exist, and every triangle that touches the other position has to use this vertex
+      // otherwise the triangles around from would take the attributes from the other side of a seam
+      size_t nShared = 0;
+      std::vector<uint32_t> neighboursFrom;
+      for (uint32_t t : vertexTriangles[from]) {
+        if (!alive[t] || !Contains(t, from)) continue;
+
+        if (ContainsGroup(t, groupTo)) {
+          if (!Contains(t, to)) return false;
+          nShared++;
+        }
+
+        for (size_t j = 0; j < 3; j++) neighboursFrom.push_back(groups[triangles[(t * 3) + j]]);
+      }
+      if (nShared == 0) return false;
+
+      // Link condition, the two vertices can only have the neighbours that are on their shared triangles in common or the surface would fold
+      std::sort(neighboursFrom.begin(), neighboursFrom.end());
+      neighboursFrom.erase(std::unique(neighboursFrom.begin(), neighboursFrom.end()), neighboursFrom.end());
+
+      std::vector<uint32_t> neighboursTo;
+      for (uint32_t t : vertexTriangles[to]) {
+        if (!alive[t] || !Contains(t, to)) continue;
+        for (size_t j = 0; j < 3; j++) neighboursTo.push_back(groups[triangles[(t * 3) + j]]);
+      }
+      std::sort(neighboursTo.begin(), neighboursTo.end());
+      neighboursTo.erase(std::unique(neighboursTo.begin(), neighboursTo.end()), neighboursTo.end());
+
+      std::vector<uint32_t> common;
+      std::set_intersection(neighboursFrom.begin(), neighboursFrom.end(), neighboursTo.begin(), neighboursTo.end(), std::back_inserter(common));
+      if (common.size() != (nShared + 2)) return false; // The shared triangles' third vertices plus from and to themselves
+
+      // Don't flip or squash any of the triangles that move
+      for (uint32_t t : vertexTriangles[from]) {
+        if (!alive[t] || !Contains(t, from) || ContainsGroup(t, groupTo)) continue;
+
+        spitfire::math::cVec3 before[3];
+        spitfire::math::cVec3 after[3];
+        for (size_t j = 0; j < 3; j++) {
+          const uint32_t v = triangles[(t * 3) + j];
+          before[j] = positions[v];
+          after[j] = (v == from) ? positions[to] : positions[v];
+        }
+
+        const spitfire::math::cVec3 normalBefore = (before[1] - before[0]).CrossProduct(before[2] - before[0]);
+        const spitfire::math::cVec3 normalAfter = (after[1] - after[0]).CrossProduct(after[2] - after[0]);
+        const float fLengthBefore = normalBefore.GetLength();
+        const float fLengthAfter = normalAfter.GetLength();
+        if ((fLengthAfter <= 1e-12f) || (normalBefore.DotProduct(normalAfter) < (0.2f * fLengthBefore * fLengthAfter))) return false;
+      }
+
+      return true;
+    }
+
+    void cSimplifier::Collapse(uint32_t from, uint32_t to)
+    {
+      const uint32_t groupTo = groups[to];
+
+      deviations[groupTo] = GetDeviation(from, to);
+      fError = std::max(fError, deviations[groupTo]);
+
+      for (uint32_t t : vertexTriangles[from]) {
+        if (!alive[t] || !Contains(t, from)) continue;
+
+        if (ContainsGroup(t, groupTo)) {
+          alive[t] = false;
+          nAliveTriangles--;
+          continue;
+        }
+
+        for (size_t j = 0; j < 3; j++) {
+          if (triangles[(t * 3) + j] == from) triangles[(t * 3) + j] = to;
+        }
+        vertexTriangles[to].push_back(t);
+      }
+      vertexTriangles[from].clear();
+
+      quadrics[groupTo] += quadrics[groups[from]];
+
+      // The costs around to have changed, the queue holds the old costs which are re-evaluated when they are popped
+      std::vector<uint32_t>& around = vertexTriangles[to];
+      around.erase(std::remove_if(around.begin(), around.end(), [this, to](uint32_t t) { return (!alive[t] || !Contains(t, to)); }), around.end());
+      std::sort(around.begin(), around.end());
+      around.erase(std::unique(around.begin(), around.end()), around.end());
+      for (uint32_t t : around) PushCollapses(t);
+    }
+
+    void cSimplifier::Simplify(size_t nTargetTriangles, double fMaximumError)
+    {
+      while ((nAliveTriangles > nTargetTriangles) && !queue.empty()) {
+        const cCollapse collapse = queue.top();
+        queue.pop();
+
+        if (vertexTriangles[collapse.from].empty()) continue;
+
+        // The quadrics only grow so a cost can only have gone up since it was pushed
+        const double fCost = GetCost(collapse.from, collapse.to);
+        if (fCost > collapse.fCost) {
+          queue.push({ fCost, collapse.from, collapse.to });
+          continue;
+        }
+
+        // The quadric orders the collapses, the deviation is what the caller asked us to limit
+        if ((GetDeviation(collapse.from, collapse.to) > fMaximumError) || !IsValid(collapse.from, collapse.to)) continue;
+
+        Collapse(collapse.from, collapse.to);
+      }
+    }
+
+    void cSimplifier::GetIndices(std::vector<uint16_t>& indices) const
+    {
+      indices.clear();
+      for (size_t t = 0; t < alive.size(); t++) {
+        if (!alive[t]) continue;
+        for (size_t j = 0; j < 3; j++) indices.push_back(uint16_t(triangles[(t * 3) + j]));
+      }
+    }
+  }
+
+
+  // ** cGeometrySimplifier
+
+  bool cGeometrySimplifier::Simplify(const cGeometryData& source, size_t nTargetTriangles, cGeometryData& destination, float& fError) const
+  {
+    ASSERT(source.nVerticesPerPoint == 3);
+
+    fError = 0.0f;
+
+    cGeometryOptimiser optimiser;
+
+    destination = source;
+    if (!optimiser.WeldVertices(destination)) return false;
+
+    cSimplifier simplifier(destination);
+    simplifier.Simplify(nTargetTriangles, fMaximumError);
+    simplifier.GetIndices(destination.indices);
+
+    fError = float(simplifier.GetError());
+
+    optimiser.OptimiseVertexCache(destination);
+    optimiser.OptimiseVertexFetch(destination);
+
+    return true;
+  }
+
+  bool cGeometrySimplifier::GenerateLODs(const cGeometryData& source, const std::vector<float>& ratios, std::vector<cGeometryData>& lods, std::vector<float>& errors) const
+  {
+    lods.clear();
+    errors.clear();
+
+    const size_t nSourceTriangles = (source.indices.empty() ? source.nVertexCount : source.indices.size()) / 3;
+
+    for (float fRatio : ratios) {
+      ASSERT((fRatio > 0.0f) && (fRatio <= 1.0f));
+
+      lods.push_back(cGeometryData());
+      float fError = 0.0f;
+      if (!Simplify(source, size_t(fRatio * float(nSourceTriangles)), lods.back(), fError)) {
+        lods.clear();
+        errors.clear();
+        return false;
+      }
+
+      // Each LOD is simplified from the source so a smaller ratio could stop at a slightly lower error
+      if (!errors.empty()) fError = std::max(fError, errors.back());
+      errors.push_back(fError);
+    }
+
+    return true;
+  }
+
+  float GetLODSwitchDistance(float fError, float fFieldOfViewDegrees, size_t nViewportHeightPixels, float fMaximumErrorPixels)
+  {
+    ASSERT(fFieldOfViewDegrees > 0.0f);
+    ASSERT(nViewportHeightPixels != 0);
+    ASSERT(fMaximumErrorPixels > 0.0f);
+
+    // An object space length of fError at distance d covers fError * nViewportHeightPixels / (2 * d * tan(fov / 2)) pixels
+    const float fTanHalfFieldOfView = std::tan(0.5f * spitfire::math::DegreesToRadians(fFieldOfViewDegrees));
+    return (fError * float(nViewportHeightPixels)) / (2.0f * fTanHalfFieldOfView * fMaximumErrorPixels);
+  }
+}
@@ -428,6 +428,18 @@ namespace opengl
     }
   }
 
+  void cStaticVertexBufferObject::RenderGeometryInstanced(GLenum geometryType, size_t nInstances)
+  {
+    assert(IsCompiled());
+    assert(!bIs2D);
+
+    if (pGeometryDataPtr->indices.empty()) {
+      glDrawArraysInstanced(geometryType, 0, int(pGeometryDataPtr->nVertexCount), int(nInstances));
+    } else {
+      glDrawElementsInstanced(geometryType, int(pGeometryDataPtr->indices.size()), GL_UNSIGNED_SHORT,  pGeometryDataPtr->indices.data(), int(nInstances));
+    }
+  }
+
   void cStaticVertexBufferObject::RenderGeometry2D(GLenum geometryType)
   {
     assert(IsCompiled());
@@ -456,6 +468,11 @@ namespace opengl
     RenderGeometry(GL_TRIANGLE_STRIP);
   }
 
+  void cStaticVertexBufferObject::RenderTrianglesInstanced(size_t nInstances)
+  {
+    RenderGeometryInstanced(GL_TRIANGLES, nInstances);
+  }
+
   #ifndef BUILD_LIBOPENGLMM_OPENGL_STRICT
   void cStaticVertexBufferObject::RenderQuads()
   {
@@ -27,6 +27,7 @@
 // libvoodoomm headers
 #include <libvoodoomm/cImage.h>
 #include <libvoodoomm/hdr.h>
+#include <libvoodoomm/kernels.h>
 
 #ifdef PLATFORM_LINUX_OR_UNIX
 #include <sys/stat.h>
@@ -395,6 +396,13 @@ namespace voodoo
     return (width == rhs.width) && (height == rhs.height) && (pixelFormat == rhs.pixelFormat);
   }
 
+  size_t cImage::GetChannelCountForKernels() const
+  {
+    // The kernels only support formats with one byte per channel
+    assert((pixelFormat == PIXELFORMAT::H8) || (pixelFormat == PIXELFORMAT::R8G8B8) || (pixelFormat == PIXELFORMAT::R8G8B8A8));
+    return GetBytesPerPixel();
+  }
+
   size_t cImage::GetBytesPerPixel() const
   {
     return GetBytesForPixelFormat(pixelFormat);
@@ -547,66 +555,31 @@ namespace voodoo
     return surface.SaveToPNG(sFilePath);
   }
 
-  void cImage::CreateFromImageResizeNearestNeighbour(const cImage& image, size_t width, size_t height)
+  void cImage::CreateFromImageResizeNearestNeighbour(const cImage& image, size_t _width, size_t _height)
   {
-    // Only RGBA is supported at the moment
-    assert(image.pixelFormat == PIXELFORMAT::R8G8B8A8);
-
-    CreateEmptyImage(width, height, image.pixelFormat);
+    const size_t nChannels = image.GetChannelCountForKernels();
 
-    const size_t widthSource = image.width;
-    const size_t heightSource = image.height;
+    CreateEmptyImage(_width, _height, image.pixelFormat);
 
-    const size_t widthDestination = width;
-    const size_t heightDestination = height;
+    kernels::ResizeNearestNeighbour(image.buffer.data(), image.width, image.height, nChannels, buffer.data(), width, height);
+  }
 
-    // How many pixels from the source to skip for every pixel in the destination
-    const size_t scalingFactorHorizontal = std::max<size_t>(1, widthSource / widthDestination);
-    const size_t scalingFactorVertical = std::max<size_t>(1, heightSource / heightDestination);
+  void cImage::CreateFromImageResize(const cImage& image, size_t _width, size_t _height, RESIZE_FILTER filter)
+  {
+    const size_t nChannels = image.GetChannelCountForKernels();
 
-    for (size_t y = 0; y < heightDestination; y++) {
-      for (size_t x = 0; x < widthDestination; x++) {
-        const size_t indexSource = (((y * scalingFactorVertical) * widthSource) + (x * scalingFactorHorizontal)) * 4;
-        const size_t indexDestination = ((y * widthDestination) + x) * 4;
+    CreateEmptyImage(_width, _height, image.pixelFormat);
 
-        buffer[indexDestination] = image.buffer[indexSource]; // Red
-        buffer[indexDestination + 1] = image.buffer[indexSource + 1]; // Green
-        buffer[indexDestination + 2] = image.buffer[indexSource + 2]; // Blue
-        buffer[indexDestination + 3] = image.buffer[indexSource + 3]; // Alpha
-      }
-    }
+    kernels::Resize(image.buffer.data(), image.width, image.height, nChannels, buffer.data(), width, height, filter);
   }
 
   void cImage::CreateFromImageHalfSize(const cImage& image)
   {
-    std::cout<<"cImage::CreateFromImageHalfSize source pf: "<<int(image.pixelFormat)<<std::endl;
-  
-    // Only RGBA is supported at the moment
-    assert(image.pixelFormat == PIXELFORMAT::R8G8B8A8);
-
-    // Only width and heights divisible by 2 are supported at the moment
-    assert(spitfire::math::IsDivisibleByTwo(image.width));
-    assert(spitfire::math::IsDivisibleByTwo(image.height));
-
-    CreateEmptyImage(image.width / 2, image.height / 2, image.pixelFormat);
+    const size_t nChannels = image.GetChannelCountForKernels();
 
-    const size_t widthSource = image.width;
-    //const size_t heightSource = image.height;
-
-    const size_t widthDestination = width;
-    const size_t heightDestination = height;
+    CreateEmptyImage(std::max<size_t>(1, image.width / 2), std::max<size_t>(1, image.height / 2), image.pixelFormat);
 
-    for (size_t y = 0; y < heightDestination; y++) {
-      for (size_t x = 0; x < widthDestination; x++) {
-        const size_t indexSource = (((2 * y) * (2 * widthDestination)) + (2 * x)) * 4;
-        const size_t indexDestination = ((y * widthDestination) + x) * 4;
-
-        buffer[indexDestination] = image.buffer[indexSource]; // Red
-        buffer[indexDestination + 1] = image.buffer[indexSource + 1]; // Green
-        buffer[indexDestination + 2] = image.buffer[indexSource + 2]; // Blue
-        buffer[indexDestination + 3] = image.buffer[indexSource + 3]; // Alpha
-      }
-    }
+    kernels::HalfSize(image.buffer.data(), image.width, image.height, nChannels, buffer.data());
   }
 
   void cImage::CreateFromImageDoubleSize(const cImage& image)
@@ -642,53 +615,25 @@ namespace voodoo
 
   void cImage::CreateFromImageAndSmooth(const cImage& image, size_t iterations)
   {
-    (void)image;
-    (void)iterations;
-
-    /*const size_t n = image.width * image.height;
-
-    imageOut.SetDimensions(n);
-
-    std::vector<spitfire::math::cColour> temp = source;
-
-    spitfire::math::cColour surrounding[5];
-
-    for (size_t i = 0; i < iterations; i++) {
-      for (size_t y = 0; y < depthLightmap; y++) {
-        for (size_t x = 0; x < widthLightmap; x++) {
-
-          surrounding[0] = surrounding[1] = surrounding[2] = surrounding[3] = surrounding[4] = GetLightmapPixel(temp, x, y);
-
-          // We sample from the 4 surrounding pixels in a cross shape
-          if (x != 0) surrounding[0] = GetLightmapPixel(temp, x - 1, y);
-          if ((y + 1) < depthLightmap) surrounding[1] = GetLightmapPixel(temp, x, y + 1);
-          if (y != 0) surrounding[3] = GetLightmapPixel(temp, x, y - 1);
-          if ((x + 1) < widthLightmap) surrounding[4] = GetLightmapPixel(temp, x + 1, y);
-
-          //const spitfire::math::cColour averageOfSurrounding = 0.25f * (surrounding[0] + surrounding[1] + surrounding[3] + surrounding[4]);
-          //const spitfire::math::cColour final = 0.5f * (surrounding[2] + averageOfSurrounding);
-          const spitfire::math::cColour final = 0.25f * (surrounding[0] + surrounding[1] + surrounding[3] + surrounding[4]);
+    const size_t nChannels = image.GetChannelCountForKernels();
 
-          const size_t index = (y * widthLightmap) + x;
+    Assign(image);
 
-          destination[index] = final;
-        }
-      }
+    kernels::Smooth(buffer.data(), width, height, nChannels, iterations);
+  }
 
+  void cImage::ConvertToGreyScale()
+  {
+    if (buffer.empty()) return;
 
-      // If we are still going then set temp to destination for the next iteration
-      if ((i + 1) < iterations) temp = destination;
-    }*/
+    kernels::ConvertToGreyScale(buffer.data(), width, height, GetChannelCountForKernels());
   }
 
   void cImage::ConvertToNegative()
   {
-    const size_t n = width * height * GetBytesPerPixel();
-    for (size_t i = 0; i < n; i += 4) {
-      buffer[i] = 255 - buffer[i]; // Red
-      buffer[i + 1] = 255 - buffer[i + 1]; // Green
-      buffer[i + 2] = 255 - buffer[i + 2]; // Blue
-    }
+    if (buffer.empty()) return;
+
+    kernels::ConvertToNegative(buffer.data(), width, height, GetChannelCountForKernels());
   }
 
   void cImage::FillColour(uint8_t red, uint8_t green, uint8_t blue)
@@ -809,17 +754,10 @@ namespace voodoo
   {
     if (buffer.empty()) return;
 
-    // For each row swap it with the corresponding row on the other side of the image
-    const size_t nBytesPerRow = GetBytesPerPixel() * width;
+    const size_t nBytesPerRow = GetBytesPerRow();
     assert(buffer.size() == nBytesPerRow * height);
 
-    std::vector<uint8_t> tempBuffer(nBytesPerRow);
-    const size_t halfHeight = height / 2;
-    for (size_t y = 0; y < halfHeight; y++) {
-      std::memcpy(&tempBuffer[0], &buffer[(nBytesPerRow * (height - 1)) - (y * nBytesPerRow)], nBytesPerRow);
-      std::memcpy(&buffer[(nBytesPerRow * (height - 1)) - (y * nBytesPerRow)], &buffer[(y * nBytesPerRow)], nBytesPerRow);
-      std::memcpy(&buffer[(y * nBytesPerRow)], &tempBuffer[0], nBytesPerRow);
-    }
+    kernels::FlipVertically(buffer.data(), nBytesPerRow, height);
   }
 
   void cImage::FlipHorizontally()
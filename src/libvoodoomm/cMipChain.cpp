@@ -0,0 +1,485 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/util/threadpool.h>
+
+// libvoodoomm headers
+#include <libvoodoomm/cMipChain.h>
+
+namespace voodoo
+{
+  namespace
+  {
+    enum class STORAGE {
+      UINT8,
+      UINT16,
+      HALF,
+      FLOAT
+    };
+
+    STORAGE GetStorage(PIXELFORMAT pixelFormat)
+    {
+      switch (pixelFormat) {
+        case PIXELFORMAT::H16: return STORAGE::UINT16;
+        case PIXELFORMAT::RGB16F: return STORAGE::HALF;
+        case PIXELFORMAT::RGB32F:
+        case PIXELFORMAT::H32: return STORAGE::FLOAT;
+        default: return STORAGE::UINT8;
+      }
+    }
+
+    size_t GetChannelCount(PIXELFORMAT pixelFormat)
+    {
+      switch (pixelFormat) {
+        case PIXELFORMAT::H8:
+        case PIXELFORMAT::H16:
+        case PIXELFORMAT::H32: return 1;
+        case PIXELFORMAT::R8G8B8A8: return 4;
+        default: return 3;
+      }
+    }
+
+    // Aim for about 64 KB of floats in each task
+    size_t GetRowGrainSize(size_t nValuesPerRow)
+    {
+      return std::max<size_t>(1, (16 * 1024) / std::max<size_t>(1, nValuesPerRow));
+    }
+
+
+    // ** sRGB
+
+    float SRGBToLinear(float fValue)
+    {
+      return (fValue <= 0.04045f) ? (fValue / 12.92f) : std::pow((fValue + 0.055f) / 1.055f, 2.4f);
+    }
+
+    class cSRGBTables
+    {
+    public:
+      cSRGBTables();
+
+      uint8_t LinearToSRGB(float fValue) const;
+
+      float toLinear[256];
+
+    private:
+      static constexpr size_t LOOKUP_SIZE = 4096;
+
+      float thresholds[255]; // The linear value half way between each sRGB value and the next
+      uint8_t fromLinear[LOOKUP_SIZE];
+    };
+
+    cSRGBTables::cSRGBTables()
+    {
+      for (size_t i = 0; i < 256; i++) toLinear[i] = SRGBToLinear(float(i) / 255.0f);
+      for (size_t i = 0; i < 255; i++) thresholds[i] = SRGBToLinear((float(i) + 0.5f) / 255.0f);
+
+      uint8_t value = 0;
+      for (size_t i = 0; i < LOOKUP_SIZE; i++) {
+        const float fLinear = float(i) / float(LOOKUP_SIZE - 1);
+        while ((value < 255) && (fLinear >= thresholds[value])) value++;
+        fromLinear[i] = value;
+      }
+    }
+
+    inline uint8_t cSRGBTables::LinearToSRGB(float fValue) const
+    {
+      if (!(fValue > 0.0f)) return 0;
+      if (fValue >= 1.0f) return 255;
+
+      // The table gets us within a value or two of the answer, the thresholds make it exact
+      uint8_t value = fromLinear[size_t(fValue * float(LOOKUP_SIZE - 1))];
+      while ((value < 255) && (fValue >= thresholds[value])) value++;
+      return value;
+    }
+
+    const cSRGBTables& GetSRGBTables()
+    {
+      static const cSRGBTables tables;
+      return tables;
+    }
+
+
+    // ** Half floats
+
+    float HalfToFloat(uint16_t value)
+    {
+      const uint32_t sign = uint32_t(value & 0x8000) << 16;
+      const uint32_t exponent = (value >> 10) & 0x1F;
+      const uint32_t mantissa = value & 0x3FF;
+
+      if (exponent == 0) {
+        // Zero or denormal
+        const float fValue = float(mantissa) * (1.0f / 16777216.0f);
+        return (sign != 0) ? -fValue : fValue;
+      }
+
+      uint32_t bits = 0;
+      if (exponent == 31) bits = sign | 0x7F800000 | (mantissa << 13); // Infinity or NaN
+      else bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+      float fValue = 0.0f;
+      std::memcpy(&fValue, &bits, sizeof(fValue));
+      return fValue;
+    }
+
+    // Rounds to the nearest half, ties go to even
+    uint16_t FloatToHalf(float fValue)
+    {
+      uint32_t bits = 0;
+      std::memcpy(&bits, &fValue, sizeof(bits));
+
+      const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+      bits &= 0x7FFFFFFF;
+
+      if (bits >= 0x7F800000) return sign | 0x7C00 | ((bits > 0x7F800000) ? 0x200 : 0); // Infinity or NaN
+      if (bits >= 0x477FF000) return sign | 0x7C00; // Too big, 65520 and above round to infinity
+
+      if (bits < 0x38800000) {
+        // Denormal or zero
+        if (bits < 0x33000000) return sign;
+
+        const uint32_t shift = 126 - (bits >> 23);
+        const uint32_t mantissa = (bits & 0x7FFFFF) | 0x800000;
+        uint32_t value = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if ((remainder > halfway) || ((remainder == halfway) && ((value & 1) != 0))) value++;
+        return sign | uint16_t(value);
+      }
+
+      // The carry from rounding can correctly go up into the exponent
+      uint32_t value = (bits - 0x38000000) >> 13;
+      const uint32_t remainder = bits & 0x1FFF;
+      if ((remainder > 0x1000) || ((remainder == 0x1000) && ((value & 1) != 0))) value++;
+      return sign | uint16_t(value);
+    }
+
+
+    // ** Conversion to and from floats
+    //
+    // 8 and 16 bit linear values are kept in their original range so that averaging them is exact, sRGB values are converted to 0..1
+
+    class cConverter
+    {
+    public:
+      cConverter(PIXELFORMAT pixelFormat, COLOUR_SPACE colourSpace);
+
+      void Decode(const uint8_t* pSource, size_t nPixels, float* pDestination) const;
+      void Encode(const float* pSource, size_t nPixels, uint8_t* pDestination) const;
+
+    private:
+      STORAGE storage;
+      size_t nChannels;
+      bool bIsSRGB;
+      const cSRGBTables& sRGBTables;
+    };
+
+    cConverter::cConverter(PIXELFORMAT pixelFormat, COLOUR_SPACE colourSpace) :
+      storage(GetStorage(pixelFormat)),
+      nChannels(GetChannelCount(pixelFormat)),
+      bIsSRGB((colourSpace == COLOUR_SPACE::SRGB) && ((pixelFormat == PIXELFORMAT::R8G8B8) || (pixelFormat == PIXELFORMAT::R8G8B8A8))),
+      sRGBTables(GetSRGBTables())
+    {
+    }
+
+    void cConverter::Decode(const uint8_t* pSource, size_t nPixels, float* pDestination) const
+    {
+      const size_t n = nPixels * nChannels;
+
+      switch (storage) {
+        case STORAGE::UINT8: {
+          if (bIsSRGB) {
+            // Alpha is linear
+            const float* pToLinear = sRGBTables.toLinear;
+            for (size_t i = 0; i < n; i++) pDestination[i] = ((nChannels == 4) && ((i % 4) == 3)) ? (float(pSource[i]) / 255.0f) : pToLinear[pSource[i]];
+          } else {
+            for (size_t i = 0; i < n; i++) pDestination[i] = float(pSource[i]);
+          }
+          break;
+        }
+        case STORAGE::UINT16: {
+          for (size_t i = 0; i < n; i++) {
+            uint16_t value = 0;
+            std::memcpy(&value, pSource + (2 * i), sizeof(value));
+            pDestination[i] = float(value);
+          }
+          break;
+        }
+        case STORAGE::HALF: {
+          for (size_t i = 0; i < n; i++) {
+            uint16_t value = 0;
+            std::memcpy(&value, pSource + (2 * i), sizeof(value));
+            pDestination[i] = HalfToFloat(value);
+          }
+          break;
+        }
+        case STORAGE::FLOAT: {
+          std::memcpy(pDestination, pSource, n * sizeof(float));
+          break;
+        }
+      }
+    }
+
+    void cConverter::Encode(const float* pSource, size_t nPixels, uint8_t* pDestination) const
+    {
+      const size_t n = nPixels * nChannels;
+
+      switch (storage) {
+        case STORAGE::UINT8: {
+          if (bIsSRGB) {
+            for (size_t i = 0; i < n; i++) {
+              if ((nChannels == 4) && ((i % 4) == 3)) pDestination[i] = uint8_t(std::clamp(pSource[i] * 255.0f, 0.0f, 255.0f) + 0.5f);
+              else pDestination[i] = sRGBTables.LinearToSRGB(pSource[i]);
+            }
+          } else {
+            for (size_t i = 0; i < n; i++) pDestination[i] = uint8_t(std::min(pSource[i], 255.0f) + 0.5f);
+          }
+          break;
+        }
+        case STORAGE::UINT16: {
+          for (size_t i = 0; i < n; i++) {
+            const uint16_t value = uint16_t(std::min(pSource[i], 65535.0f) + 0.5f);
+            std::memcpy(pDestination + (2 * i), &value, sizeof(value));
+          }
+          break;
+        }
+        case STORAGE::HALF: {
+          for (size_t i = 0; i < n; i++) {
+            const uint16_t value = FloatToHalf(pSource[i]);
+            std::memcpy(pDestination + (2 * i), &value, sizeof(value));
+          }
+          break;
+        }
+        case STORAGE::FLOAT: {
+          std::memcpy(pDestination, pSource, n * sizeof(float));
+          break;
+        }
+      }
+    }
+
+
+    // ** Filtering
+
+    // The source pixels that contribute to a destination pixel along one axis
+    struct cTaps {
+      size_t index[3];
+      float weight[3];
+      size_t nTaps;
+    };
+
+    void CalculateTaps(size_t nSource, std::vector<cTaps>& taps)
+    {
+      const size_t nDestination = std::max<size_t>(1, nSource / 2);
+      taps.resize(nDestination);
+
+      for (size_t i = 0; i < nDestination; i++) {
+        cTaps& t = taps[i];
+        if (nSource == 1) {
+          t.nTaps = 1;
+          t.index[0] = 0;
+          t.weight[0] = 1.0f;
+        } else if ((nSource % 2) == 0) {
+          t.nTaps = 2;
+          t.index[0] = 2 * i;
+          t.index[1] = (2 * i) + 1;
+          t.weight[0] = t.weight[1] = 0.5f;
+        } else {
+          // Odd sizes use a 3 pixel filter with the weights shifting across the image so that each source pixel contributes equally overall
+          const float fScale = 1.0f / float(nSource);
+          t.nTaps = 3;
+          t.index[0] = 2 * i;
+          t.index[1] = (2 * i) + 1;
+          t.index[2] = (2 * i) + 2;
+          t.weight[0] = float(nDestination - i) * fScale;
+          t.weight[1] = float(nDestination) * fScale;
+          t.weight[2] = float(i + 1) * fScale;
+        }
+      }
+    }
+
+    // Each of pRows is the source row for the matching vertical tap
+    template <size_t nChannels>
+    void DownsampleRow(const float* const pRows[3], size_t widthSource, const std::vector<cTaps>& tapsX, const cTaps& tapY, float* pOut)
+    {
+      const size_t widthDestination = tapsX.size();
+
+      if (((widthSource % 2) == 0) && (tapY.nTaps == 2)) {
+        // The common case, a plain 2x2 box
+        for (size_t x = 0; x < widthDestination; x++) {
+          const float* p0 = pRows[0] + (2 * x * nChannels);
+          const float* p1 = pRows[1] + (2 * x * nChannels);
+          for (size_t c = 0; c < nChannels; c++) pOut[(x * nChannels) + c] = ((p0[c] + p0[nChannels + c]) + (p1[c] + p1[nChannels + c])) * 0.25f;
+        }
+        return;
+      }
+
+      for (size_t x = 0; x < widthDestination; x++) {
+        const cTaps& tapX = tapsX[x];
+        float values[nChannels] = { 0.0f };
+        for (size_t j = 0; j < tapY.nTaps; j++) {
+          for (size_t i = 0; i < tapX.nTaps; i++) {
+            const float fWeight = tapY.weight[j] * tapX.weight[i];
+            const float* p = pRows[j] + (tapX.index[i] * nChannels);
+            for (size_t c = 0; c < nChannels; c++) values[c] += fWeight * p[c];
+          }
+        }
+        for (size_t c = 0; c < nChannels; c++) pOut[(x * nChannels) + c] = values[c];
+      }
+    }
+
+    void DownsampleRow(size_t nChannels, const float* const pRows[3], size_t widthSource, const std::vector<cTaps>& tapsX, const cTaps& tapY, float* pOut)
+    {
+      if (nChannels == 1) DownsampleRow<1>(pRows, widthSource, tapsX, tapY, pOut);
+      else if (nChannels == 3) DownsampleRow<3>(pRows, widthSource, tapsX, tapY, pOut);
+      else DownsampleRow<4>(pRows, widthSource, tapsX, tapY, pOut);
+    }
+  }
+
+
+  // ** cMipChain
+
+  cMipChain::cMipChain() :
+    pixelFormat(PIXELFORMAT::R8G8B8A8),
+    colourSpace(COLOUR_SPACE::LINEAR)
+  {
+  }
+
+  bool cMipChain::IsPixelFormatSupported(PIXELFORMAT pixelFormat)
+  {
+    return (pixelFormat != PIXELFORMAT::R5G6B5);
+  }
+
+  size_t cMipChain::GetLevelCountForSize(size_t width, size_t height)
+  {
+    size_t nLevels = 1;
+    for (size_t size = std::max(width, height); size > 1; size /= 2) nLevels++;
+    return nLevels;
+  }
+
+  void cMipChain::Clear()
+  {
+    levels.clear();
+    buffer.clear();
+  }
+
+  size_t cMipChain::GetWidth(size_t level) const
+  {
+    ASSERT(level < levels.size());
+    return levels[level].width;
+  }
+
+  size_t cMipChain::GetHeight(size_t level) const
+  {
+    ASSERT(level < levels.size());
+    return levels[level].height;
+  }
+
+  size_t cMipChain::GetLevelSizeBytes(size_t level) const
+  {
+    ASSERT(level < levels.size());
+    return levels[level].width * levels[level].height * GetBytesForPixelFormat(pixelFormat);
+  }
+
+  const uint8_t* cMipChain::GetPointerToLevel(size_t level) const
+  {
+    ASSERT(level < levels.size());
+    return buffer.data() + levels[level].offset;
+  }
+
+  bool cMipChain::CreateFromBuffer(const uint8_t* pBuffer, size_t width, size_t height, PIXELFORMAT _pixelFormat, COLOUR_SPACE _colourSpace)
+  {
+    Clear();
+
+    if ((pBuffer == nullptr) || (width == 0) || (height == 0) || !IsPixelFormatSupported(_pixelFormat)) return false;
+
+    pixelFormat = _pixelFormat;
+    colourSpace = _colourSpace;
+
+    // Lay out the levels
+    const size_t nBytesPerPixel = GetBytesForPixelFormat(pixelFormat);
+    const size_t nLevels = GetLevelCountForSize(width, height);
+    levels.resize(nLevels);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < nLevels; i++) {
+      levels[i].width = std::max<size_t>(1, width >> i);
+      levels[i].height = std::max<size_t>(1, height >> i);
+      levels[i].offset = offset;
+      offset += levels[i].width * levels[i].height * nBytesPerPixel;
+    }
+
+    buffer.resize(offset);
+
+    // The first level is the original image
+    std::memcpy(buffer.data(), pBuffer, width * height * nBytesPerPixel);
+
+    if (nLevels == 1) return true;
+
+    const size_t nChannels = GetChannelCount(pixelFormat);
+    const cConverter converter(pixelFormat, colourSpace);
+
+    // Each level depends on the one before it so we go a level at a time and split the rows of each level across the thread pool,
+    // each task filters its rows and converts them back to the pixel format while they are still in the cache.
+    // The first level is converted to floats a few rows at a time as it is read rather than all at once, which would need a buffer 4 times the size of the next level.
+    std::vector<float> source(levels[1].width * levels[1].height * nChannels);
+    std::vector<float> destination(source.size());
+
+    std::vector<cTaps> tapsX;
+    std::vector<cTaps> tapsY;
+
+    for (size_t i = 1; i < nLevels; i++) {
+      const cLevel& levelSource = levels[i - 1];
+      const cLevel& levelDestination = levels[i];
+
+      CalculateTaps(levelSource.width, tapsX);
+      CalculateTaps(levelSource.height, tapsY);
+      ASSERT(tapsX.size() == levelDestination.width);
+      ASSERT(tapsY.size() == levelDestination.height);
+
+      const bool bIsFirstLevel = (i == 1);
+      const float* pSource = source.data();
+      float* pDestination = (bIsFirstLevel ? source.data() : destination.data());
+      uint8_t* pOutput = buffer.data() + levelDestination.offset;
+      const size_t widthSource = levelSource.width;
+      const size_t widthDestination = levelDestination.width;
+      const size_t nValuesPerRowSource = widthSource * nChannels;
+      const size_t nBytesPerRowSource = widthSource * nBytesPerPixel;
+      const size_t nValuesPerRow = widthDestination * nChannels;
+      const size_t nBytesPerRow = widthDestination * nBytesPerPixel;
+
+      spitfire::util::ParallelFor(0, levelDestination.height, GetRowGrainSize(nValuesPerRowSource), [=, &converter, &tapsX, &tapsY](size_t first, size_t last) {
+        std::vector<float> decoded(bIsFirstLevel ? (3 * nValuesPerRowSource) : 0);
+
+        for (size_t y = first; y < last; y++) {
+          const cTaps& tapY = tapsY[y];
+          const float* pRows[3] = { nullptr, nullptr, nullptr };
+          for (size_t j = 0; j < tapY.nTaps; j++) {
+            if (bIsFirstLevel) {
+              float* pRow = decoded.data() + (j * nValuesPerRowSource);
+              converter.Decode(pBuffer + (tapY.index[j] * nBytesPerRowSource), widthSource, pRow);
+              pRows[j] = pRow;
+            } else pRows[j] = pSource + (tapY.index[j] * nValuesPerRowSource);
+          }
+
+          DownsampleRow(nChannels, pRows, widthSource, tapsX, tapY, pDestination + (y * nValuesPerRow));
+        }
+
+        converter.Encode(pDestination + (first * nValuesPerRow), (last - first) * widthDestination, pOutput + (first * nBytesPerRow));
+      });
+
+      // The level we just made is the source for the next one
+      if (!bIsFirstLevel) std::swap(source, destination);
+    }
+
+    return true;
+  }
+}
@@ -1,14 +1,17 @@
 // Standard headers
+#include <cassert>
 #include <cstring>
 #include <iostream>
 
 // libvoodoomm headers
 #include <libvoodoomm/cTextureAtlas.h>
+#include <libvoodoomm/kernels.h>
 
 namespace voodoo
 {
   
 cTextureAtlasEntry::cTextureAtlasEntry() :
+  page(0),
   x(0),
   y(0),
   width(0),
@@ -18,34 +21,71 @@ cTextureAtlasEntry::cTextureAtlasEntry() :
 
 
 cTextureAtlas::cTextureAtlas() :
-  currentX(0),
-  currentY(0),
-  currentTallestInRow(0)
+  width(0),
+  height(0),
+  pixelFormat(PIXELFORMAT::R8G8B8A8),
+  algorithm(spitfire::math::PACKING_ALGORITHM::MAX_RECTS),
+  nPaddingPixels(0),
+  bExtrudeEdges(false)
 {
 }
 
-void cTextureAtlas::Init(size_t width, size_t height, voodoo::PIXELFORMAT pixelFormat)
+void cTextureAtlas::Init(size_t _width, size_t _height, voodoo::PIXELFORMAT _pixelFormat)
 {
-  textureAtlas.CreateEmptyImage(width, height, pixelFormat);
+  width = _width;
+  height = _height;
+  pixelFormat = _pixelFormat;
+
+  pages.clear();
+  packers.clear();
+  textureAtlasEntries.clear();
+
+  AddPage();
 }
 
-bool cTextureAtlas::AddImage(const std::string& textureFilePath)
+void cTextureAtlas::SetAlgorithm(spitfire::math::PACKING_ALGORITHM _algorithm)
+{
+  algorithm = _algorithm;
+}
+
+void cTextureAtlas::SetPadding(size_t _nPaddingPixels, bool _bExtrudeEdges)
 {
-  std::cout<<"cTextureAtlas::AddImage Loading image \""<<textureFilePath<<"\""<<std::endl;
+  nPaddingPixels = _nPaddingPixels;
+  bExtrudeEdges = _bExtrudeEdges;
+}
+
+float cTextureAtlas::GetOccupancy() const
+{
+  if (packers.empty()) return 0.0f;
+
+  size_t nUsedArea = 0;
+  for (auto&& packer : packers) nUsedArea += packer.GetUsedArea();
+
+  return float(nUsedArea) / float(packers.size() * width * height);
+}
 
+void cTextureAtlas::AddPage()
+{
+  pages.push_back(voodoo::cImage());
+  pages.back().CreateEmptyImage(width, height, pixelFormat);
+
+  packers.push_back(spitfire::math::cRectanglePacker());
+  packers.back().Init(width, height, algorithm);
+}
+
+bool cTextureAtlas::AddImage(const std::string& textureFilePath)
+{
   voodoo::cImage image;
   if (!image.LoadFromFile(textureFilePath)) {
     std::cout<<"cTextureAtlas::AddImage Error loading texture from file \""<<textureFilePath<<"\""<<std::endl;
     return false;
   }
 
-  return AddImageInternal(textureFilePath, image);
+  return AddImageInternal(image);
 }
 
 bool cTextureAtlas::AddImageResizeNearestNeighbour(const std::string& textureFilePath, size_t cellWidthAndHeight)
 {
-  std::cout<<"cTextureAtlas::AddImage Loading image \""<<textureFilePath<<"\""<<std::endl;
-
   voodoo::cImage image;
   if (!image.LoadFromFile(textureFilePath)) {
     std::cout<<"cTextureAtlas::AddImage Error loading texture from file \""<<textureFilePath<<"\""<<std::endl;
@@ -55,69 +95,111 @@ bool cTextureAtlas::AddImageResizeNearestNeighbour(const std::string& textureFil
   voodoo::cImage imageResized;
   imageResized.CreateFromImageResizeNearestNeighbour(image, cellWidthAndHeight, cellWidthAndHeight);
 
-  return AddImageInternal(textureFilePath, imageResized);
+  return AddImageInternal(imageResized);
 }
 
-bool cTextureAtlas::AddImageInternal(const std::string& textureFilePath, const voodoo::cImage& image)
+bool cTextureAtlas::IsImageValidForAtlas(const voodoo::cImage& image) const
 {
-  const size_t atlasWidth = textureAtlas.GetWidth();
-  const size_t atlasHeight = textureAtlas.GetHeight();
+  if (image.GetPixelFormat() != pixelFormat) {
+    std::cout<<"cTextureAtlas::IsImageValidForAtlas Error texture pixel format does not match the atlas"<<std::endl;
+    return false;
+  }
 
-  const size_t imageWidth = image.GetWidth();
-  const size_t imageHeight = image.GetHeight();
-  if ((imageWidth > atlasWidth) || (imageHeight > atlasHeight)) {
-    std::cout<<"cTextureAtlas::AddImageInternal Error texture "<<imageWidth<<"x"<<imageHeight<<" is too large to fit in the atlas "<<atlasWidth<<"x"<<atlasHeight<<std::endl;
+  const size_t paddedWidth = image.GetWidth() + (2 * nPaddingPixels);
+  const size_t paddedHeight = image.GetHeight() + (2 * nPaddingPixels);
+  if ((paddedWidth > width) || (paddedHeight > height)) {
+    std::cout<<"cTextureAtlas::IsImageValidForAtlas Error texture "<<image.GetWidth()<<"x"<<image.GetHeight()<<" is too large to fit in the atlas "<<width<<"x"<<height<<std::endl;
     return false;
   }
 
-  std::cout<<"cTextureAtlas::AddImageInternal loaded texture"<<std::endl;
-  // Try to place the image on this row
-  if (imageWidth > (atlasWidth - currentX)) {
-    // Move to the next row
-    currentX = 0;
-    currentY += currentTallestInRow;
-    if (currentY > atlasHeight) currentY = atlasHeight;
-    currentTallestInRow = 0;
+  return true;
+}
+
+bool cTextureAtlas::AddImageInternal(const voodoo::cImage& image)
+{
+  if (!IsImageValidForAtlas(image)) return false;
+
+  const size_t paddedWidth = image.GetWidth() + (2 * nPaddingPixels);
+  const size_t paddedHeight = image.GetHeight() + (2 * nPaddingPixels);
+
+  // Try each page and then start a new one
+  cTextureAtlasEntry entry;
+  bool bIsFound = false;
+  for (size_t i = 0; i < packers.size(); i++) {
+    if (packers[i].Insert(paddedWidth, paddedHeight, entry.x, entry.y)) {
+      entry.page = i;
+      bIsFound = true;
+      break;
+    }
   }
 
-  // Try to place the image again, if it doesn't fit now it is never going to fit
-  if ((imageWidth > (atlasWidth - currentX)) || (imageHeight > (atlasHeight - currentY))) {
-    std::cout<<"cTextureAtlas::AddImageInternal Error no room left in texture atlas for texture \""<<textureFilePath<<"\""<<std::endl;
-    return false;
+  if (!bIsFound) {
+    AddPage();
+    entry.page = packers.size() - 1;
+    bIsFound = packers.back().Insert(paddedWidth, paddedHeight, entry.x, entry.y);
+    assert(bIsFound);
   }
 
-  std::cout<<"cTextureAtlas::AddImageInternal Adding entry"<<std::endl;
-  // We found a place for the texture, so add en entry for it
-  cTextureAtlasEntry entry;
-  entry.x = currentX;
-  entry.y = currentY;
-  entry.width = imageWidth;
-  entry.height = imageHeight;
+  entry.x += nPaddingPixels;
+  entry.y += nPaddingPixels;
+  entry.width = image.GetWidth();
+  entry.height = image.GetHeight();
   textureAtlasEntries.push_back(entry);
 
-  std::cout<<"cTextureAtlas::AddImageInternal Copying image "<<imageWidth<<"x"<<imageHeight<<" into texture atlas "<<atlasWidth<<"x"<<atlasHeight<<" at point "<<currentX<<","<<currentY<<std::endl;
-  
-  assert(image.GetPixelFormat() == textureAtlas.GetPixelFormat());
-  // Copy the image to the texture atlas
-  //uint8_t* pTextureAtlasBuffer = textureAtlas.GetPointerToBuffer() + (currentY * textureAtlas.GetBytesPerRow()) + (currentX * textureAtlas.GetBytesPerPixel());
-  uint8_t* pTextureAtlasBuffer = textureAtlas.GetPointerToBuffer();
-  assert(pTextureAtlasBuffer != nullptr);
-  const uint8_t* pImageBuffer = image.GetPointerToBuffer();
-  assert(pImageBuffer != nullptr);
-  for (size_t y = 0; y < imageHeight; y++) {
-    //uint8_t* pDest = pTextureAtlasBuffer + (y * textureAtlas.GetBytesPerRow());
-    uint8_t* pDest = pTextureAtlasBuffer + (currentY * textureAtlas.GetBytesPerRow()) + (currentX * textureAtlas.GetBytesPerPixel()) + (y * textureAtlas.GetBytesPerRow());
-    const uint8_t* pSrc = pImageBuffer + (y * image.GetBytesPerRow());
-    memcpy(pDest, pSrc, image.GetBytesPerRow());
+  CopyImageToPage(image, entry);
+
+  return true;
+}
+
+bool cTextureAtlas::AddImages(const std::vector<const voodoo::cImage*>& images, std::vector<bool>& outIsAdded)
+{
+  outIsAdded.assign(images.size(), false);
+
+  // Pack the images that will fit
+  std::vector<size_t> validImages;
+  std::vector<std::pair<size_t, size_t>> sizes;
+  for (size_t i = 0; i < images.size(); i++) {
+    if (!IsImageValidForAtlas(*images[i])) continue;
+
+    outIsAdded[i] = true;
+    validImages.push_back(i);
+    sizes.push_back(std::make_pair(images[i]->GetWidth() + (2 * nPaddingPixels), images[i]->GetHeight() + (2 * nPaddingPixels)));
   }
 
-  // Move to the next position
-  currentX += imageWidth;
-  if (imageHeight > currentTallestInRow) currentTallestInRow = imageHeight;
+  std::vector<spitfire::math::cPackedRectangle> packed;
+  spitfire::math::PackRectangles(width, height, algorithm, sizes, packers, packed);
 
-  std::cout<<"cTextureAtlas::AddImageInternal returning"<<std::endl;
+  // Create the images for any new pages
+  while (pages.size() < packers.size()) {
+    pages.push_back(voodoo::cImage());
+    pages.back().CreateEmptyImage(width, height, pixelFormat);
+  }
 
-  return true;
+  for (size_t i = 0; i < validImages.size(); i++) {
+    const voodoo::cImage& image = *images[validImages[i]];
+
+    cTextureAtlasEntry entry;
+    entry.page = packed[i].page;
+    entry.x = packed[i].x + nPaddingPixels;
+    entry.y = packed[i].y + nPaddingPixels;
+    entry.width = image.GetWidth();
+    entry.height = image.GetHeight();
+    textureAtlasEntries.push_back(entry);
+
+    CopyImageToPage(image, entry);
+  }
+
+  return (validImages.size() == images.size());
+}
+
+void cTextureAtlas::CopyImageToPage(const voodoo::cImage& image, const cTextureAtlasEntry& entry)
+{
+  if ((entry.width == 0) || (entry.height == 0)) return;
+
+  voodoo::cImage& page = pages[entry.page];
+
+  const size_t nExtrudePixels = bExtrudeEdges ? nPaddingPixels : 0;
+  kernels::CopyAndExtrudeEdges(image.GetPointerToBuffer(), entry.width, entry.height, page.GetBytesPerPixel(), page.GetPointerToBuffer(), width, height, entry.x, entry.y, nExtrudePixels);
 }
 
 }
@@ -5,25 +5,22 @@
 #include <cassert>
 #include <cmath>
 
-#include <array>
+#include <algorithm>
 #include <string>
-#include <sstream>
-#include <iostream>
-#include <map>
+#include <string_view>
 #include <vector>
 
-// SDL headers
-#include <SDL3_image/SDL_image.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Spitfire headers
 #include <spitfire/spitfire.h>
+#include <spitfire/util/string.h>
+#include <spitfire/util/threadpool.h>
 
 // libvoodoomm headers
-#include <libvoodoomm/cImage.h>
-
-#ifdef PLATFORM_LINUX_OR_UNIX
-#include <sys/stat.h>
-#endif
+#include <libvoodoomm/hdr.h>
 
 namespace {
 
@@ -36,187 +33,438 @@ typedef unsigned char RGBE[4];
 #define  MINELEN	8				// minimum scanline length for encoding
 #define  MAXELEN	0x7fff			// maximum scanline length for encoding
 
+const size_t MINRUNLENGTH = 4; // Shorter runs are written as part of a non-run
+
+// Aim for about 64 KB of floats in each task
+size_t GetRowGrainSize(size_t width)
+{
+  return std::max<size_t>(1, (64 * 1024) / std::max<size_t>(1, width * 3 * sizeof(float)));
+}
+
+bool IsRunLengthEncoded(const uint8_t* p, const uint8_t* pEnd, size_t width)
+{
+  return (width >= MINELEN) && (width <= MAXELEN) && ((pEnd - p) >= 4) && (p[0] == 2) && (p[1] == 2) && ((p[2] & 0x80) == 0);
+}
+
+// Returns the start of the next scanline or nullptr if the scanline is invalid or runs off the end of the data
+const uint8_t* SkipScanline(const uint8_t* p, const uint8_t* pEnd, size_t width)
+{
+  if (IsRunLengthEncoded(p, pEnd, width)) {
+    if (((size_t(p[2]) << 8) | size_t(p[3])) != width) return nullptr;
+    p += 4;
+
+    // Each component is run length encoded separately
+    for (size_t i = 0; i < 4; i++) {
+      for (size_t x = 0; x < width; ) {
+        if (p == pEnd) return nullptr;
+        const uint8_t code = *p++;
+        size_t count = 0;
+        if (code > 128) {
+          // Run
+          count = code & 127;
+          if (p == pEnd) return nullptr;
+          p++;
+        } else {
+          // Non-run
+          count = code;
+          if (size_t(pEnd - p) < count) return nullptr;
+          p += count;
+        }
+
+        if ((count == 0) || ((x + count) > width)) return nullptr;
+        x += count;
+      }
+    }
+
+    return p;
+  }
+
+  // Flat or the old run length encoding where 1, 1, 1, n repeats the previous pixel
+  size_t rshift = 0;
+  for (size_t x = 0; x < width; ) {
+    if ((pEnd - p) < 4) return nullptr;
+    if ((p[R] == 1) && (p[G] == 1) && (p[B] == 1)) {
+      // Each repeat in a row is another 8 bits of the count, by the fifth the count is far wider than any scanline
+      if (rshift > 24) return nullptr;
+
+      const size_t count = size_t(p[E]) << rshift;
+      if ((x == 0) || ((x + count) > width)) return nullptr;
+      x += count;
+      rshift += 8;
+    } else {
+      x++;
+      rshift = 0;
+    }
+    p += 4;
+  }
+
+  return p;
+}
+
+// The scanline has already been checked by SkipScanline
+void DecodeScanline(const uint8_t* p, size_t width, RGBE* scanline)
+{
+  if (IsRunLengthEncoded(p, p + 4, width)) {
+    p += 4;
+
+    for (size_t i = 0; i < 4; i++) {
+      for (size_t x = 0; x < width; ) {
+        const uint8_t code = *p++;
+        if (code > 128) {
+          size_t count = code & 127;
+          const uint8_t value = *p++;
+          while (count--) scanline[x++][i] = value;
+        } else {
+          size_t count = code;
+          while (count--) scanline[x++][i] = *p++;
+        }
+      }
+    }
+
+    return;
+  }
+
+  size_t rshift = 0;
+  for (size_t x = 0; x < width; ) {
+    if ((p[R] == 1) && (p[G] == 1) && (p[B] == 1)) {
+      ASSERT(rshift <= 24);
+      for (size_t count = size_t(p[E]) << rshift; count > 0; count--) {
+        memcpy(scanline[x], scanline[x - 1], 4);
+        x++;
+      }
+      rshift += 8;
+    } else {
+      memcpy(scanline[x], p, 4);
+      x++;
+      rshift = 0;
+    }
+    p += 4;
+  }
+}
+
+// Each component is the mantissa / 256 * 2 ^ (exponent - 128), an exponent of 0 is black
+inline void RGBEToFloat(const RGBE rgbe, float* cols)
+{
+  if (rgbe[E] == 0) {
+    cols[0] = cols[1] = cols[2] = 0.0f;
+    return;
+  }
+
+  const int expo = int(rgbe[E]) - 136;
+  cols[0] = std::ldexp(float(rgbe[R]), expo);
+  cols[1] = std::ldexp(float(rgbe[G]), expo);
+  cols[2] = std::ldexp(float(rgbe[B]), expo);
+}
+
+void workOnRGBE(const RGBE* scan, size_t len, float* cols)
+{
+  size_t i = 0;
+
+  #if defined(__SSE2__)
+  // 4 pixels at a time, we build the scale directly from the exponent which only works while 2 ^ (exponent - 136) is a normal float.
+  // Each pixel is written as 4 floats and the next pixel overwrites the 4th, so we stop while there is still a pixel after each group.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i minimumExponent = _mm_set1_epi32(10);
+  const __m128i exponentBias = _mm_set1_epi32(136 - 127);
+  for (; (i + 5) <= len; i += 4) {
+    const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scan + i));
+    const __m128i exponents = _mm_srli_epi32(packed, 24);
+    if (_mm_movemask_epi8(_mm_cmplt_epi32(exponents, minimumExponent)) != 0) {
+      // Black or tiny values
+      for (size_t j = 0; j < 4; j++) RGBEToFloat(scan[i + j], cols + (3 * (i + j)));
+      continue;
+    }
+
+    const __m128 scales = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(exponents, exponentBias), 23));
+
+    const __m128i lo = _mm_unpacklo_epi8(packed, zero);
+    const __m128i hi = _mm_unpackhi_epi8(packed, zero);
+    float* pOut = cols + (3 * i);
+    _mm_storeu_ps(pOut, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(0, 0, 0, 0))));
+    _mm_storeu_ps(pOut + 3, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(1, 1, 1, 1))));
+    _mm_storeu_ps(pOut + 6, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(2, 2, 2, 2))));
+    _mm_storeu_ps(pOut + 9, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(3, 3, 3, 3))));
+  }
+  #endif
+
+  for (; i < len; i++) RGBEToFloat(scan[i], cols + (3 * i));
+}
+
+void FloatToRGBE(const float* cols, size_t len, RGBE* scan)
+{
+  for (size_t i = 0; i < len; i++, cols += 3) {
+    const float red = std::max(cols[0], 0.0f);
+    const float green = std::max(cols[1], 0.0f);
+    const float blue = std::max(cols[2], 0.0f);
+    const float v = std::max(red, std::max(green, blue));
+
+    if (!(v >= 1e-32f)) {
+      scan[i][R] = scan[i][G] = scan[i][B] = scan[i][E] = 0;
+      continue;
+    }
+
+    int expo = 0;
+    const float mantissa = std::frexp(v, &expo);
+    if (expo > 127) {
+      // Too bright, clamp to the brightest value we can store
+      scan[i][R] = scan[i][G] = scan[i][B] = scan[i][E] = 255;
+      continue;
+    }
+
+    const float scale = mantissa * 256.0f / v;
+    scan[i][R] = uint8_t(red * scale);
+    scan[i][G] = uint8_t(green * scale);
+    scan[i][B] = uint8_t(blue * scale);
+    scan[i][E] = uint8_t(expo + 128);
+  }
+}
+
+// Appends a scanline in the new run length encoding, each component is encoded separately
+void EncodeScanline(const RGBE* scanline, size_t width, std::vector<uint8_t>& out)
+{
+  if ((width < MINELEN) || (width > MAXELEN)) {
+    // Too short or too long for run length encoding
+    const uint8_t* p = &scanline[0][0];
+    out.insert(out.end(), p, p + (4 * width));
+    return;
+  }
+
+  out.push_back(2);
+  out.push_back(2);
+  out.push_back(uint8_t(width >> 8));
+  out.push_back(uint8_t(width & 0xFF));
+
+  std::vector<uint8_t> data(width);
+
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t x = 0; x < width; x++) data[x] = scanline[x][i];
+
+    size_t cur = 0;
+    while (cur < width) {
+      // Find the next run that is long enough to be worth encoding
+      size_t beg_run = cur;
+      size_t run_count = 0;
+      size_t old_run_count = 0;
+      while ((run_count < MINRUNLENGTH) && (beg_run < width)) {
+        beg_run += run_count;
+        old_run_count = run_count;
+        run_count = 1;
+        while (((beg_run + run_count) < width) && (run_count < 127) && (data[beg_run] == data[beg_run + run_count])) run_count++;
+      }
+
+      // If the data before the run is a short run then write it as a run
+      if ((old_run_count > 1) && (old_run_count == (beg_run - cur))) {
+        out.push_back(uint8_t(128 + old_run_count));
+        out.push_back(data[cur]);
+        cur = beg_run;
+      }
+
+      // Write the bytes up to the start of the run
+      while (cur < beg_run) {
+        const size_t nonrun_count = std::min<size_t>(128, beg_run - cur);
+        out.push_back(uint8_t(nonrun_count));
+        out.insert(out.end(), data.begin() + cur, data.begin() + cur + nonrun_count);
+        cur += nonrun_count;
+      }
+
+      // Write the run
+      if (run_count >= MINRUNLENGTH) {
+        out.push_back(uint8_t(128 + run_count));
+        out.push_back(data[beg_run]);
+        cur += run_count;
+      }
+    }
+  }
+}
+
 }
 
 namespace voodoo
 {
 
-void workOnRGBE(RGBE *scan, int len, float *cols);
-bool decrunch(RGBE *scanline, int len, FILE *file);
-bool oldDecrunch(RGBE *scanline, int len, FILE *file);
+// ** cHDRDecoder
+
+cHDRDecoder::cHDRDecoder() :
+  pData(nullptr),
+  nSizeBytes(0),
+  width(0),
+  height(0),
+  bIsBottomToTop(false)
+{
+}
+
+bool cHDRDecoder::Open(const std::string& sFilePath)
+{
+  Close();
+
+  if (!file.Open(spitfire::string::ToString(sFilePath))) return false;
 
-bool LoadHDR(const std::string& sFilePath, cImage& outImage)
+  if (!OpenFromMemory(file.GetData(), file.GetSizeBytes())) {
+    file.Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool cHDRDecoder::OpenFromMemory(const uint8_t* _pData, size_t _nSizeBytes)
 {
-	int i;
-	char str[200];
-	FILE *file;
+  pData = _pData;
+  nSizeBytes = _nSizeBytes;
+
+  if (!ReadHeader() || !FindScanlines()) {
+    pData = nullptr;
+    nSizeBytes = 0;
+    width = 0;
+    height = 0;
+    scanlineOffsets.clear();
+    return false;
+  }
+
+  return true;
+}
+
+void cHDRDecoder::Close()
+{
+  pData = nullptr;
+  nSizeBytes = 0;
+  width = 0;
+  height = 0;
+  bIsBottomToTop = false;
+  scanlineOffsets.clear();
+  file.Close();
+}
+
+bool cHDRDecoder::ReadHeader()
+{
+  const std::string_view sContent(reinterpret_cast<const char*>(pData), nSizeBytes);
+  if ((sContent.substr(0, 10) != "#?RADIANCE") && (sContent.substr(0, 6) != "#?RGBE")) return false;
+
+  // The header is a line per variable up to a blank line
+  size_t position = 0;
+  while (true) {
+    const size_t end = sContent.find('\n', position);
+    if (end == std::string_view::npos) return false;
+
+    const std::string_view sLine = sContent.substr(position, end - position);
+    position = end + 1;
+
+    if (sLine.empty()) break;
+
+    if ((sLine.substr(0, 7) == "FORMAT=") && (sLine != "FORMAT=32-bit_rle_rgbe")) return false;
+  }
 
-	file = fopen(sFilePath.c_str(), "rb");
-	if (!file)
-		return false;
+  // Then the resolution, we only support rows of +X pixels
+  const size_t end = sContent.find('\n', position);
+  if (end == std::string_view::npos) return false;
 
-	fread(str, 10, 1, file);
-	if (memcmp(str, "#?RADIANCE", 10)) {
-		fclose(file);
-		return false;
-	}
+  const std::string sResolution(sContent.substr(position, end - position));
+  char y = 0;
+  int h = 0;
+  int w = 0;
+  if ((sscanf(sResolution.c_str(), "%cY %d +X %d", &y, &h, &w) != 3) || ((y != '-') && (y != '+')) || (h <= 0) || (w <= 0)) return false;
+
+  width = size_t(w);
+  height = size_t(h);
+  bIsBottomToTop = (y == '+');
+
+  scanlineOffsets.clear();
+  scanlineOffsets.push_back(end + 1);
+
+  return true;
+}
+
+bool cHDRDecoder::FindScanlines()
+{
+  // Each scanline has to be read to find where the next one starts, but this is much cheaper than decoding them
+  scanlineOffsets.reserve(height + 1);
+
+  const uint8_t* p = pData + scanlineOffsets[0];
+  const uint8_t* pEnd = pData + nSizeBytes;
+  for (size_t y = 0; y < height; y++) {
+    p = SkipScanline(p, pEnd, width);
+    if (p == nullptr) return false;
+
+    scanlineOffsets.push_back(size_t(p - pData));
+  }
+
+  return true;
+}
+
+void cHDRDecoder::DecodeRowsRGB32F(size_t first, size_t last, float* pRGB) const
+{
+  const size_t nFloatsPerRow = 3 * width;
 
-	fseek(file, 1, SEEK_CUR);
+  spitfire::util::ParallelFor(first, last, GetRowGrainSize(width), [this, first, pRGB, nFloatsPerRow](size_t firstRow, size_t lastRow) {
+    std::vector<RGBE> scanline(width);
 
-	i = 0;
-	char c = 0, oldc;
-	while(true) {
-		oldc = c;
-		c = fgetc(file);
-		if (c == 0xa && oldc == 0xa)
-			break;
-	}
-
-	char reso[200];
-	i = 0;
-	while(true) {
-		c = fgetc(file);
-		reso[i++] = c;
-		if (c == 0xa)
-			break;
-	}
-
-	int w, h;
-	if (!sscanf(reso, "-Y %d +X %d", &h, &w)) {
-		fclose(file);
-		return false;
-	}
-
-	if (!outImage.CreateEmptyImage(w, h, PIXELFORMAT::RGB32F)) {
-		fclose(file);
-		return false;
-	}
-
-	float* cols = reinterpret_cast<float*>(outImage.GetPointerToBuffer());
-
-	RGBE *scanline = new RGBE[w];
-	if (!scanline) {
-		fclose(file);
-		return false;
-	}
-
-	// convert image 
-	for (int y = h - 1; y >= 0; y--) {
-		if (decrunch(scanline, w, file) == false)
-			break;
-		workOnRGBE(scanline, w, cols);
-		cols += w * 3;
-	}
-
-	delete [] scanline;
-	fclose(file);
-
-
-
-	/*cols = reinterpret_cast<float*>(outImage.GetPointerToBuffer());
-	const size_t n = 3 * size_t(w) * size_t(h);
-	std::cout<<"dimensions "<<w<<"x"<<h<<", floats "<<n<<std::endl;
-	for (size_t i = 0; i < n; i += 3) {
-		cols[i] = 0.0f;
-		//cols[i + 1] = 255;
-		//cols[i + 2] = 255;
-	}*/
-
-	return true;
-}
-
-float convertComponent(int expo, int val)
-{
-	float v = val / 256.0f;
-	float d = (float) pow(2, expo);
-	return v * d;
-}
-
-void workOnRGBE(RGBE *scan, int len, float *cols)
-{
-	while (len-- > 0) {
-		int expo = scan[0][E] - 128;
-		cols[0] = convertComponent(expo, scan[0][R]);
-		cols[1] = convertComponent(expo, scan[0][G]);
-		cols[2] = convertComponent(expo, scan[0][B]);
-		cols += 3;
-		scan++;
-	}
-}
-
-bool decrunch(RGBE *scanline, int len, FILE *file)
-{
-	int  i, j;
-					
-	if (len < MINELEN || len > MAXELEN)
-		return oldDecrunch(scanline, len, file);
-
-	i = fgetc(file);
-	if (i != 2) {
-		fseek(file, -1, SEEK_CUR);
-		return oldDecrunch(scanline, len, file);
-	}
-
-	scanline[0][G] = fgetc(file);
-	scanline[0][B] = fgetc(file);
-	i = fgetc(file);
-
-	if (scanline[0][G] != 2 || scanline[0][B] & 128) {
-		scanline[0][R] = 2;
-		scanline[0][E] = i;
-		return oldDecrunch(scanline + 1, len - 1, file);
-	}
-
-	// read each component
-	for (i = 0; i < 4; i++) {
-	    for (j = 0; j < len; ) {
-			unsigned char code = fgetc(file);
-			if (code > 128) { // run
-			    code &= 127;
-			    unsigned char val = fgetc(file);
-			    while (code--)
-					scanline[j++][i] = val;
-			}
-			else  {	// non-run
-			    while(code--)
-					scanline[j++][i] = fgetc(file);
-			}
-		}
+    for (size_t y = firstRow; y < lastRow; y++) {
+      const size_t iScanline = bIsBottomToTop ? (height - 1 - y) : y;
+      DecodeScanline(pData + scanlineOffsets[iScanline], width, scanline.data());
+      workOnRGBE(scanline.data(), width, pRGB + ((y - first) * nFloatsPerRow));
     }
+  });
+}
+
+bool cHDRDecoder::DecodeRGB32F(float* pRGB) const
+{
+  if (!IsOpen()) return false;
+
+  DecodeRowsRGB32F(0, height, pRGB);
+
+  return true;
+}
+
+bool cHDRDecoder::DecodeRows(size_t nRowsPerBlock, const RowsCallback& onRows) const
+{
+  if (!IsOpen()) return false;
+
+  nRowsPerBlock = std::max<size_t>(1, std::min(nRowsPerBlock, height));
+
+  std::vector<float> rows(nRowsPerBlock * width * 3);
+
+  for (size_t y = 0; y < height; y += nRowsPerBlock) {
+    const size_t nRows = std::min(nRowsPerBlock, height - y);
+    DecodeRowsRGB32F(y, y + nRows, rows.data());
+    if (!onRows(y, nRows, rows.data())) return false;
+  }
+
+  return true;
+}
+
+
+bool SaveHDR(const std::string& sFilePath, const float* pRGB, size_t width, size_t height)
+{
+  if ((pRGB == nullptr) || (width == 0) || (height == 0)) return false;
+
+  FILE* file = fopen(sFilePath.c_str(), "wb");
+  if (file == nullptr) return false;
+
+  const std::string sHeader = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+  bool bIsOk = (fwrite(sHeader.data(), 1, sHeader.length(), file) == sHeader.length());
+
+  // Encode blocks of about 4 MB of pixels in parallel and then write them in order
+  const size_t nRowsPerBlock = std::max<size_t>(1, (4 * 1024 * 1024) / (width * sizeof(RGBE)));
+  std::vector<std::vector<uint8_t>> encoded(std::min(nRowsPerBlock, height));
+
+  for (size_t y = 0; bIsOk && (y < height); y += nRowsPerBlock) {
+    const size_t nRows = std::min(nRowsPerBlock, height - y);
+
+    spitfire::util::ParallelFor(0, nRows, GetRowGrainSize(width), [&encoded, pRGB, width, y](size_t first, size_t last) {
+      std::vector<RGBE> scanline(width);
+      for (size_t i = first; i < last; i++) {
+        FloatToRGBE(pRGB + ((y + i) * width * 3), width, scanline.data());
+        encoded[i].clear();
+        EncodeScanline(scanline.data(), width, encoded[i]);
+      }
+    });
+
+    for (size_t i = 0; bIsOk && (i < nRows); i++) bIsOk = (fwrite(encoded[i].data(), 1, encoded[i].size(), file) == encoded[i].size());
+  }
+
+  if (fclose(file) != 0) bIsOk = false;
+
+  return bIsOk;
+}
 
-	return feof(file) ? false : true;
-}
-
-bool oldDecrunch(RGBE *scanline, int len, FILE *file)
-{
-	int i;
-	int rshift = 0;
-	
-	while (len > 0) {
-		scanline[0][R] = fgetc(file);
-		scanline[0][G] = fgetc(file);
-		scanline[0][B] = fgetc(file);
-		scanline[0][E] = fgetc(file);
-		if (feof(file))
-			return false;
-
-		if (scanline[0][R] == 1 &&
-			scanline[0][G] == 1 &&
-			scanline[0][B] == 1) {
-			for (i = scanline[0][E] << rshift; i > 0; i--) {
-				memcpy(&scanline[0][0], &scanline[-1][0], 4);
-				scanline++;
-				len--;
-			}
-			rshift += 8;
-		}
-		else {
-			scanline++;
-			len--;
-			rshift = 0;
-		}
-	}
-	return true;
-}
- 
 }
@@ -0,0 +1,577 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/math/math.h>
+#include <spitfire/util/threadpool.h>
+
+// libvoodoomm headers
+#include <libvoodoomm/kernels.h>
+
+namespace voodoo
+{
+  namespace kernels
+  {
+    namespace
+    {
+      // Aim for about 64 KB of work in each task
+      size_t GetRowGrainSize(size_t nBytesPerRow)
+      {
+        return std::max<size_t>(1, (64 * 1024) / std::max<size_t>(1, nBytesPerRow));
+      }
+
+      inline uint8_t GetLuminance(uint8_t r, uint8_t g, uint8_t b)
+      {
+        // ITU-R BT.601 weights scaled so that they add up to 256
+        return uint8_t(((77 * r) + (150 * g) + (29 * b) + 128) >> 8);
+      }
+
+      inline uint8_t ClampToByte(float fValue)
+      {
+        return uint8_t(std::clamp(std::nearbyint(fValue), 0.0f, 255.0f));
+      }
+
+
+      // ** Resampling filters
+
+      float FilterBox(float x)
+      {
+        return ((x >= -0.5f) && (x < 0.5f)) ? 1.0f : 0.0f;
+      }
+
+      float FilterTriangle(float x)
+      {
+        x = std::fabs(x);
+        return (x < 1.0f) ? (1.0f - x) : 0.0f;
+      }
+
+      float Sinc(float x)
+      {
+        if (std::fabs(x) < 1e-6f) return 1.0f;
+
+        x *= spitfire::math::cPI;
+        return std::sin(x) / x;
+      }
+
+      float FilterLanczos3(float x)
+      {
+        return (std::fabs(x) < 3.0f) ? (Sinc(x) * Sinc(x / 3.0f)) : 0.0f;
+      }
+
+      // The source pixels and their weights for each destination pixel along one axis
+      struct cContributions
+      {
+        size_t nMaxTaps;
+        std::vector<size_t> first;
+        std::vector<size_t> count;
+        std::vector<float> weights; // nMaxTaps weights for each destination pixel
+      };
+
+      void CalculateContributions(size_t nSource, size_t nDestination, RESIZE_FILTER filter, cContributions& contributions)
+      {
+        float (*pFilter)(float) = FilterBox;
+        float fRadius = 0.5f;
+        if (filter == RESIZE_FILTER::BILINEAR) {
+          pFilter = FilterTriangle;
+          fRadius = 1.0f;
+        } else if (filter == RESIZE_FILTER::LANCZOS3) {
+          pFilter = FilterLanczos3;
+          fRadius = 3.0f;
+        }
+
+        // When shrinking the filter is stretched to cover all of the source pixels under each destination pixel
+        const float fScale = float(nDestination) / float(nSource);
+        const float fFilterScale = std::max(1.0f, 1.0f / fScale);
+        const float fSupport = fRadius * fFilterScale;
+
+        contributions.nMaxTaps = size_t(std::ceil(2.0f * fSupport)) + 2;
+        contributions.first.resize(nDestination);
+        contributions.count.resize(nDestination);
+        contributions.weights.assign(nDestination * contributions.nMaxTaps, 0.0f);
+
+        for (size_t i = 0; i < nDestination; i++) {
+          const float fCentre = (float(i) + 0.5f) / fScale;
+          const ptrdiff_t iLeft = std::max<ptrdiff_t>(0, ptrdiff_t(std::floor(fCentre - fSupport)));
+          const ptrdiff_t iRight = std::min<ptrdiff_t>(ptrdiff_t(nSource) - 1, ptrdiff_t(std::ceil(fCentre + fSupport)));
+
+          float* pWeights = &contributions.weights[i * contributions.nMaxTaps];
+
+          size_t n = 0;
+          float fTotal = 0.0f;
+          for (ptrdiff_t j = iLeft; (j <= iRight) && (n < contributions.nMaxTaps); j++) {
+            const float fWeight = pFilter(((float(j) + 0.5f) - fCentre) / fFilterScale);
+            pWeights[n++] = fWeight;
+            fTotal += fWeight;
+          }
+
+          if (fTotal == 0.0f) {
+            // A box filter can fall between pixels, use the nearest pixel instead
+            contributions.first[i] = std::min(nSource - 1, size_t(fCentre));
+            contributions.count[i] = 1;
+            pWeights[0] = 1.0f;
+            for (size_t k = 1; k < n; k++) pWeights[k] = 0.0f;
+            continue;
+          }
+
+          // Skip the pixels at either end that don't contribute
+          size_t iFirstUsed = 0;
+          while ((iFirstUsed < n) && (pWeights[iFirstUsed] == 0.0f)) iFirstUsed++;
+          while ((n > iFirstUsed) && (pWeights[n - 1] == 0.0f)) n--;
+
+          // Normalise the weights, this also takes care of the pixels that were off the edge of the source
+          for (size_t k = iFirstUsed; k < n; k++) pWeights[k - iFirstUsed] = pWeights[k] / fTotal;
+          for (size_t k = n - iFirstUsed; k < contributions.nMaxTaps; k++) pWeights[k] = 0.0f;
+
+          contributions.first[i] = size_t(iLeft) + iFirstUsed;
+          contributions.count[i] = n - iFirstUsed;
+        }
+      }
+
+      void ResizeRowHorizontal(const uint8_t* pSourceRow, size_t nChannels, const cContributions& horizontal, size_t widthDestination, float* pOut)
+      {
+        #if defined(__SSE2__)
+        if (nChannels == 4) {
+          const __m128i zero = _mm_setzero_si128();
+          for (size_t x = 0; x < widthDestination; x++) {
+            const uint8_t* pPixel = pSourceRow + (horizontal.first[x] * 4);
+            const float* pWeights = &horizontal.weights[x * horizontal.nMaxTaps];
+            const size_t n = horizontal.count[x];
+
+            __m128 accumulated = _mm_setzero_ps();
+            for (size_t k = 0; k < n; k++) {
+              int32_t rgba = 0;
+              std::memcpy(&rgba, pPixel + (k * 4), 4);
+              const __m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(rgba), zero), zero);
+              accumulated = _mm_add_ps(accumulated, _mm_mul_ps(_mm_set1_ps(pWeights[k]), _mm_cvtepi32_ps(pixel)));
+            }
+
+            _mm_storeu_ps(pOut + (x * 4), accumulated);
+          }
+
+          return;
+        }
+        #endif
+
+        for (size_t x = 0; x < widthDestination; x++) {
+          const uint8_t* pPixel = pSourceRow + (horizontal.first[x] * nChannels);
+          const float* pWeights = &horizontal.weights[x * horizontal.nMaxTaps];
+          const size_t n = horizontal.count[x];
+
+          for (size_t c = 0; c < nChannels; c++) {
+            float fAccumulated = 0.0f;
+            for (size_t k = 0; k < n; k++) fAccumulated += pWeights[k] * float(pPixel[(k * nChannels) + c]);
+            pOut[(x * nChannels) + c] = fAccumulated;
+          }
+        }
+      }
+
+      void AccumulateRow(float* pAccumulated, const float* pRow, float fWeight, size_t n)
+      {
+        size_t i = 0;
+
+        #if defined(__SSE2__)
+        const __m128 weight = _mm_set1_ps(fWeight);
+        for (; (i + 4) <= n; i += 4) {
+          _mm_storeu_ps(pAccumulated + i, _mm_add_ps(_mm_loadu_ps(pAccumulated + i), _mm_mul_ps(weight, _mm_loadu_ps(pRow + i))));
+        }
+        #endif
+
+        for (; i < n; i++) pAccumulated[i] += fWeight * pRow[i];
+      }
+
+      void StoreRow(const float* pAccumulated, uint8_t* pOut, size_t n)
+      {
+        size_t i = 0;
+
+        #if defined(__SSE2__)
+        // The conversion rounds to nearest and the packs saturate to 0..255
+        for (; (i + 16) <= n; i += 16) {
+          const __m128i a = _mm_cvtps_epi32(_mm_loadu_ps(pAccumulated + i));
+          const __m128i b = _mm_cvtps_epi32(_mm_loadu_ps(pAccumulated + i + 4));
+          const __m128i c = _mm_cvtps_epi32(_mm_loadu_ps(pAccumulated + i + 8));
+          const __m128i d = _mm_cvtps_epi32(_mm_loadu_ps(pAccumulated + i + 12));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+        #endif
+
+        for (; i < n; i++) pOut[i] = ClampToByte(pAccumulated[i]);
+      }
+
+      template <size_t nChannels>
+      void HalfSizeRow(const uint8_t* pRow0, const uint8_t* pRow1, size_t widthSource, size_t xFirst, size_t xLast, uint8_t* pOut)
+      {
+        for (size_t x = xFirst; x < xLast; x++) {
+          const size_t x0 = (2 * x) * nChannels;
+          const size_t x1 = std::min((2 * x) + 1, widthSource - 1) * nChannels;
+          for (size_t c = 0; c < nChannels; c++) {
+            pOut[(x * nChannels) + c] = uint8_t((pRow0[x0 + c] + pRow0[x1 + c] + pRow1[x0 + c] + pRow1[x1 + c] + 2) >> 2);
+          }
+        }
+      }
+
+      template <size_t nChannels>
+      void ResizeNearestNeighbourRow(const uint8_t* pRow, const size_t* pOffsets, size_t widthDestination, uint8_t* pOut)
+      {
+        for (size_t x = 0; x < widthDestination; x++) std::memcpy(pOut + (x * nChannels), pRow + pOffsets[x], nChannels);
+      }
+    }
+
+
+    void ConvertToNegative(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels)
+    {
+      assert((nChannels == 1) || (nChannels == 3) || (nChannels == 4));
+
+      const size_t nBytesPerRow = width * nChannels;
+
+      // NOTE: The lambdas capture by value because the compiler has to assume that writing to a uint8_t* can change anything captured by reference
+      spitfire::util::ParallelFor(0, height, GetRowGrainSize(nBytesPerRow), [=](size_t first, size_t last) {
+        // The rows are contiguous so we can treat them as one run of bytes
+        uint8_t* p = pBuffer + (first * nBytesPerRow);
+        const size_t n = (last - first) * nBytesPerRow;
+        size_t i = 0;
+
+        if (nChannels == 4) {
+          #if defined(__SSE2__)
+          const __m128i mask = _mm_set1_epi32(0x00FFFFFF); // Leave the alpha alone
+          for (; (i + 16) <= n; i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_xor_si128(v, mask));
+          }
+          #endif
+
+          for (; i < n; i += 4) {
+            p[i] = 255 - p[i]; // Red
+            p[i + 1] = 255 - p[i + 1]; // Green
+            p[i + 2] = 255 - p[i + 2]; // Blue
+          }
+        } else {
+          #if defined(__SSE2__)
+          const __m128i mask = _mm_set1_epi8(char(0xFF));
+          for (; (i + 16) <= n; i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_xor_si128(v, mask));
+          }
+          #endif
+
+          for (; i < n; i++) p[i] = 255 - p[i];
+        }
+      });
+    }
+
+    void ConvertToGreyScale(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels)
+    {
+      assert((nChannels == 1) || (nChannels == 3) || (nChannels == 4));
+
+      // A height map is already grey
+      if (nChannels == 1) return;
+
+      const size_t nBytesPerRow = width * nChannels;
+
+      spitfire::util::ParallelFor(0, height, GetRowGrainSize(nBytesPerRow), [=](size_t first, size_t last) {
+        uint8_t* p = pBuffer + (first * nBytesPerRow);
+        const size_t nPixels = (last - first) * width;
+        size_t i = 0;
+
+        if (nChannels == 4) {
+          #if defined(__SSE2__)
+          const __m128i zero = _mm_setzero_si128();
+          const __m128i weights = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+          const __m128i rounding = _mm_set1_epi32(128);
+          const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+          for (; (i + 4) <= nPixels; i += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + (i * 4)));
+
+            // Each pair of 32 bit lanes is (77r + 150g) and (29b) for one pixel
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights);
+            lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+            hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+
+            // Gather the luminance of the 4 pixels into one register
+            lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i y = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), rounding), 8);
+
+            // Copy it into red, green and blue and put the alpha back
+            y = _mm_or_si128(y, _mm_or_si128(_mm_slli_epi32(y, 8), _mm_slli_epi32(y, 16)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + (i * 4)), _mm_or_si128(y, _mm_and_si128(v, alphaMask)));
+          }
+          #endif
+
+          for (; i < nPixels; i++) {
+            uint8_t* pPixel = p + (i * 4);
+            const uint8_t y = GetLuminance(pPixel[0], pPixel[1], pPixel[2]);
+            pPixel[0] = y;
+            pPixel[1] = y;
+            pPixel[2] = y;
+          }
+        } else {
+          for (; i < nPixels; i++) {
+            uint8_t* pPixel = p + (i * 3);
+            const uint8_t y = GetLuminance(pPixel[0], pPixel[1], pPixel[2]);
+            pPixel[0] = y;
+            pPixel[1] = y;
+            pPixel[2] = y;
+          }
+        }
+      });
+    }
+
+    void FlipVertically(uint8_t* pBuffer, size_t nBytesPerRow, size_t height)
+    {
+      // Swap each row with the corresponding row on the other side of the image
+      spitfire::util::ParallelFor(0, height / 2, GetRowGrainSize(2 * nBytesPerRow), [=](size_t first, size_t last) {
+        std::vector<uint8_t> temp(nBytesPerRow);
+        for (size_t y = first; y < last; y++) {
+          uint8_t* pRowA = pBuffer + (y * nBytesPerRow);
+          uint8_t* pRowB = pBuffer + ((height - 1 - y) * nBytesPerRow);
+          std::memcpy(temp.data(), pRowA, nBytesPerRow);
+          std::memcpy(pRowA, pRowB, nBytesPerRow);
+          std::memcpy(pRowB, temp.data(), nBytesPerRow);
+        }
+      });
+    }
+
+    void CopyAndExtrudeEdges(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nBytesPerPixel, uint8_t* pDestination, size_t widthDestination, size_t heightDestination, size_t x, size_t y, size_t nExtrudePixels)
+    {
+      assert((x >= nExtrudePixels) && ((x + widthSource + nExtrudePixels) <= widthDestination));
+      assert((y >= nExtrudePixels) && ((y + heightSource + nExtrudePixels) <= heightDestination));
+      (void)heightDestination;
+
+      if ((widthSource == 0) || (heightSource == 0)) return;
+
+      const size_t nBytesPerRowSource = widthSource * nBytesPerPixel;
+      const size_t nBytesPerRowDestination = widthDestination * nBytesPerPixel;
+
+      // Copy each row and extrude its first and last pixels to the left and right
+      for (size_t row = 0; row < heightSource; row++) {
+        uint8_t* pRow = pDestination + ((y + row) * nBytesPerRowDestination) + (x * nBytesPerPixel);
+        std::memcpy(pRow, pSource + (row * nBytesPerRowSource), nBytesPerRowSource);
+
+        const uint8_t* pRight = pRow + nBytesPerRowSource - nBytesPerPixel;
+        for (size_t i = 1; i <= nExtrudePixels; i++) {
+          std::memcpy(pRow - (i * nBytesPerPixel), pRow, nBytesPerPixel);
+          std::memcpy(pRow + nBytesPerRowSource + ((i - 1) * nBytesPerPixel), pRight, nBytesPerPixel);
+        }
+      }
+
+      // Then extrude the top and bottom rows including the corners
+      const size_t nBytesPerPaddedRow = (widthSource + (2 * nExtrudePixels)) * nBytesPerPixel;
+      const uint8_t* pTop = pDestination + (y * nBytesPerRowDestination) + ((x - nExtrudePixels) * nBytesPerPixel);
+      const uint8_t* pBottom = pTop + ((heightSource - 1) * nBytesPerRowDestination);
+      for (size_t i = 1; i <= nExtrudePixels; i++) {
+        std::memcpy(pDestination + ((y - i) * nBytesPerRowDestination) + ((x - nExtrudePixels) * nBytesPerPixel), pTop, nBytesPerPaddedRow);
+        std::memcpy(pDestination + ((y + heightSource - 1 + i) * nBytesPerRowDestination) + ((x - nExtrudePixels) * nBytesPerPixel), pBottom, nBytesPerPaddedRow);
+      }
+    }
+
+    void HalfSize(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination)
+    {
+      assert((nChannels == 1) || (nChannels == 3) || (nChannels == 4));
+
+      const size_t widthDestination = std::max<size_t>(1, widthSource / 2);
+      const size_t heightDestination = std::max<size_t>(1, heightSource / 2);
+      const size_t nBytesPerRowSource = widthSource * nChannels;
+      const size_t nBytesPerRowDestination = widthDestination * nChannels;
+
+      spitfire::util::ParallelFor(0, heightDestination, GetRowGrainSize(2 * nBytesPerRowSource), [=](size_t first, size_t last) {
+        for (size_t y = first; y < last; y++) {
+          // For odd sizes the last row and column of the source is skipped, for a size of 1 the row or column is reused
+          const uint8_t* pRow0 = pSource + ((2 * y) * nBytesPerRowSource);
+          const uint8_t* pRow1 = pSource + (std::min((2 * y) + 1, heightSource - 1) * nBytesPerRowSource);
+          uint8_t* pOut = pDestination + (y * nBytesPerRowDestination);
+
+          size_t x = 0;
+
+          #if defined(__SSE2__)
+          const __m128i zero = _mm_setzero_si128();
+          const __m128i two = _mm_set1_epi16(2);
+          if ((widthSource >= 2) && (nChannels == 4)) {
+            for (; (x + 4) <= widthDestination; x += 4) {
+              const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + (x * 8)));
+              const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + (x * 8) + 16));
+              const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + (x * 8)));
+              const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + (x * 8) + 16));
+
+              // Add the rows together, each register holds 2 source pixels with 16 bits per channel
+              __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+              __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+              __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+              __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+              // Add the pairs of pixels together, the sum ends up in the low 64 bits
+              s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+              s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+              s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+              s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+              const __m128i d01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), two), 2);
+              const __m128i d23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), two), 2);
+              _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + (x * 4)), _mm_packus_epi16(d01, d23));
+            }
+          } else if ((widthSource >= 2) && (nChannels == 1)) {
+            const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+            for (; (x + 8) <= widthDestination; x += 8) {
+              const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + (x * 2)));
+              const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + (x * 2)));
+
+              // The even and odd bytes are the left and right pixel of each pair
+              const __m128i sum = _mm_add_epi16(
+                _mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8)),
+                _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8))
+              );
+              const __m128i average = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+              _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut + x), _mm_packus_epi16(average, average));
+            }
+          }
+          #endif
+
+          if (nChannels == 1) HalfSizeRow<1>(pRow0, pRow1, widthSource, x, widthDestination, pOut);
+          else if (nChannels == 3) HalfSizeRow<3>(pRow0, pRow1, widthSource, x, widthDestination, pOut);
+          else HalfSizeRow<4>(pRow0, pRow1, widthSource, x, widthDestination, pOut);
+        }
+      });
+    }
+
+    void ResizeNearestNeighbour(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination, size_t widthDestination, size_t heightDestination)
+    {
+      assert((nChannels == 1) || (nChannels == 3) || (nChannels == 4));
+
+      // Sample the source pixel under the centre of each destination pixel
+      std::vector<size_t> offsets(widthDestination);
+      for (size_t x = 0; x < widthDestination; x++) offsets[x] = std::min(widthSource - 1, (((2 * x) + 1) * widthSource) / (2 * widthDestination)) * nChannels;
+
+      const size_t nBytesPerRowSource = widthSource * nChannels;
+      const size_t nBytesPerRowDestination = widthDestination * nChannels;
+      const size_t* pOffsets = offsets.data();
+
+      spitfire::util::ParallelFor(0, heightDestination, GetRowGrainSize(nBytesPerRowDestination), [=](size_t first, size_t last) {
+        for (size_t y = first; y < last; y++) {
+          const size_t ySource = std::min(heightSource - 1, (((2 * y) + 1) * heightSource) / (2 * heightDestination));
+          const uint8_t* pRow = pSource + (ySource * nBytesPerRowSource);
+          uint8_t* pOut = pDestination + (y * nBytesPerRowDestination);
+
+          if (nChannels == 1) ResizeNearestNeighbourRow<1>(pRow, pOffsets, widthDestination, pOut);
+          else if (nChannels == 3) ResizeNearestNeighbourRow<3>(pRow, pOffsets, widthDestination, pOut);
+          else ResizeNearestNeighbourRow<4>(pRow, pOffsets, widthDestination, pOut);
+        }
+      });
+    }
+
+    void Resize(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination, size_t widthDestination, size_t heightDestination, RESIZE_FILTER filter)
+    {
+      assert((nChannels == 1) || (nChannels == 3) || (nChannels == 4));
+
+      if ((widthSource == 0) || (heightSource == 0) || (widthDestination == 0) || (heightDestination == 0)) return;
+
+      cContributions horizontal;
+      CalculateContributions(widthSource, widthDestination, filter, horizontal);
+      cContributions vertical;
+      CalculateContributions(heightSource, heightDestination, filter, vertical);
+
+      const size_t nBytesPerRowSource = widthSource * nChannels;
+      const size_t nValuesPerRow = widthDestination * nChannels;
+
+      // Each task filters the source rows it needs horizontally into its own buffer and then filters those vertically,
+      // the few source rows that are shared with the neighbouring tasks are filtered twice
+      const size_t nGrainSize = std::max<size_t>(16, GetRowGrainSize(nValuesPerRow * sizeof(float)));
+      spitfire::util::ParallelFor(0, heightDestination, nGrainSize, [&](size_t first, size_t last) {
+        size_t sourceFirst = vertical.first[first];
+        size_t sourceLast = sourceFirst;
+        for (size_t y = first; y < last; y++) {
+          sourceFirst = std::min(sourceFirst, vertical.first[y]);
+          sourceLast = std::max(sourceLast, vertical.first[y] + vertical.count[y]);
+        }
+
+        std::vector<float> filtered((sourceLast - sourceFirst) * nValuesPerRow);
+        for (size_t ySource = sourceFirst; ySource < sourceLast; ySource++) {
+          ResizeRowHorizontal(pSource + (ySource * nBytesPerRowSource), nChannels, horizontal, widthDestination, &filtered[(ySource - sourceFirst) * nValuesPerRow]);
+        }
+
+        std::vector<float> accumulated(nValuesPerRow);
+        for (size_t y = first; y < last; y++) {
+          std::fill(accumulated.begin(), accumulated.end(), 0.0f);
+
+          const float* pWeights = &vertical.weights[y * vertical.nMaxTaps];
+          const size_t n = vertical.count[y];
+          for (size_t k = 0; k < n; k++) {
+            AccumulateRow(accumulated.data(), &filtered[((vertical.first[y] + k) - sourceFirst) * nValuesPerRow], pWeights[k], nValuesPerRow);
+          }
+
+          StoreRow(accumulated.data(), pDestination + (y * nValuesPerRow), nValuesPerRow);
+        }
+      });
+    }
+
+    void Smooth(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels, size_t iterations)
+    {
+      assert((nChannels == 1) || (nChannels == 3) || (nChannels == 4));
+
+      if ((width == 0) || (height == 0)) return;
+
+      const size_t nBytesPerRow = width * nChannels;
+
+      std::vector<uint8_t> source(nBytesPerRow * height);
+
+      for (size_t i = 0; i < iterations; i++) {
+        std::memcpy(source.data(), pBuffer, source.size());
+
+        spitfire::util::ParallelFor(0, height, GetRowGrainSize(nBytesPerRow), [&](size_t first, size_t last) {
+          for (size_t y = first; y < last; y++) {
+            const uint8_t* pCentre = source.data() + (y * nBytesPerRow);
+            const uint8_t* pUp = (y != 0) ? (pCentre - nBytesPerRow) : pCentre;
+            const uint8_t* pDown = ((y + 1) < height) ? (pCentre + nBytesPerRow) : pCentre;
+            uint8_t* pOut = pBuffer + (y * nBytesPerRow);
+
+            // The first and last pixels only have one horizontal neighbour
+            auto SmoothPixel = [&](size_t x) {
+              for (size_t c = 0; c < nChannels; c++) {
+                const size_t index = (x * nChannels) + c;
+                const uint8_t left = (x != 0) ? pCentre[index - nChannels] : pCentre[index];
+                const uint8_t right = ((x + 1) < width) ? pCentre[index + nChannels] : pCentre[index];
+                pOut[index] = uint8_t((left + right + pUp[index] + pDown[index] + 2) >> 2);
+              }
+            };
+
+            SmoothPixel(0);
+            if (width > 1) SmoothPixel(width - 1);
+
+            // Every channel of the pixels in between can be done the same way
+            size_t index = nChannels;
+            const size_t indexEnd = (width > 2) ? (nBytesPerRow - nChannels) : 0;
+
+            #if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            for (; (index + 16) <= indexEnd; index += 16) {
+              const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCentre + index - nChannels));
+              const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCentre + index + nChannels));
+              const __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pUp + index));
+              const __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDown + index));
+
+              __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(right, zero)), _mm_add_epi16(_mm_unpacklo_epi8(up, zero), _mm_unpacklo_epi8(down, zero)));
+              __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(right, zero)), _mm_add_epi16(_mm_unpackhi_epi8(up, zero), _mm_unpackhi_epi8(down, zero)));
+              lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+              hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+              _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + index), _mm_packus_epi16(lo, hi));
+            }
+            #endif
+
+            for (; index < indexEnd; index++) pOut[index] = uint8_t((pCentre[index - nChannels] + pCentre[index + nChannels] + pUp[index] + pDown[index] + 2) >> 2);
+          }
+        });
+      }
+    }
+  }
+}
@@ -12,9 +12,6 @@
 #include <map>
 #include <sstream>
 
-// Boost headers
-#include <boost/asio.hpp>
-
 // Other libraries
 #ifdef WIN32
 #include <windows.h>
@@ -23,12 +20,13 @@
 // Spitfire
 #include <spitfire/spitfire.h>
 
-#include <spitfire/util/cString.h>
+#include <spitfire/util/string.h>
 #include <spitfire/util/log.h>
 #include <spitfire/util/thread.h>
 
 #include <spitfire/math/math.h>
 
+#include <spitfire/storage/document.h>
 #include <spitfire/storage/xml.h>
 
 #include <spitfire/communication/network.h>
@@ -36,99 +34,97 @@
 #include <spitfire/communication/http.h>
 #include <spitfire/communication/feed.h>
 
-// Breathe headers
-#include <breathe/breathe.h>
-
 namespace spitfire
 {
   namespace network
   {
     void cFeed::ParseAtomFeed(const std::string& sContent)
     {
-      LOG<<"cFeed::ParseAtomFeed"<<std::endl;
+      gLog<<"cFeed::ParseAtomFeed"<<std::endl;
 
       Clear();
 
-      xml::cNode root;
+      document::cDocument root;
 
       xml::reader reader;
-      if (!reader.ReadFromString(root, sContent)) {
-        LOG<<"cFeed::ParseAtomFeed XML Could not be read from string, returning"<<std::endl;
+      util::cProcessInterfaceVoid interface;
+      if (reader.ReadFromString(interface, root, sContent) != util::PROCESS_RESULT::COMPLETE) {
+        gLog<<"cFeed::ParseAtomFeed XML Could not be read from string, returning"<<std::endl;
         return;
       }
 
       // Now load all the rest from the config file
-      xml::cNode::iterator iter(root);
+      document::cNode::const_iterator iter(root);
 
       if (!iter.IsValid()) {
-        LOG<<"cFeed::ParseAtomFeed XML document not found, returning"<<std::endl;
+        gLog<<"cFeed::ParseAtomFeed XML document not found, returning"<<std::endl;
         return;
       }
 
       iter.FindChild("feed");
       if (!iter.IsValid()) {
-        LOG<<"cFeed::ParseAtomFeed feed node not found, returning"<<std::endl;
+        gLog<<"cFeed::ParseAtomFeed feed node not found, returning"<<std::endl;
         return;
       }
 
       std::string sXMLNameSpace;
       if (iter.GetAttribute("xmlns", sXMLNameSpace)) {
-        LOG<<"cFeed::ParseAtomFeed xmlns found \""<<sXMLNameSpace<<"\""<<std::endl;
+        gLog<<"cFeed::ParseAtomFeed xmlns found \""<<sXMLNameSpace<<"\""<<std::endl;
         ASSERT(sXMLNameSpace == "http://www.w3.org/2005/Atom");
       }
 
-      xml::cNode::iterator iterTitle(iter.GetChild("title"));
+      document::cNode::const_iterator iterTitle(iter.GetChild("title"));
       if (iterTitle.IsValid()) {
         title = iterTitle.GetChildContent();
-        LOG<<"cFeed::ParseAtomFeed title found \""<<title<<"\""<<std::endl;
+        gLog<<"cFeed::ParseAtomFeed title found \""<<title<<"\""<<std::endl;
       }
 
       iter.FindChild("entry");
       if (!iter.IsValid()) {
-        LOG<<"cFeed::ParseAtomFeed entry node not found, returning"<<std::endl;
+        gLog<<"cFeed::ParseAtomFeed entry node not found, returning"<<std::endl;
         return;
       }
 
       while (iter.IsValid()) {
         cFeedArticle* pArticle = new cFeedArticle;
 
-        xml::cNode::iterator iterId(iter.GetChild("id"));
+        document::cNode::const_iterator iterId(iter.GetChild("id"));
         if (iterId.IsValid()) {
           pArticle->id = iterId.GetChildContent();
-          //LOG<<"cFeed::ParseAtomFeed id found \""<<pArticle->id<<"\""<<std::endl;
+          //gLog<<"cFeed::ParseAtomFeed id found \""<<pArticle->id<<"\""<<std::endl;
         }
 
-        xml::cNode::iterator iterTitle(iter.GetChild("title"));
+        document::cNode::const_iterator iterTitle(iter.GetChild("title"));
         if (iterTitle.IsValid()) {
           pArticle->title = iterTitle.GetChildContent();
-          //LOG<<"cFeed::ParseAtomFeed title found \""<<pArticle->title<<"\""<<std::endl;
+          //gLog<<"cFeed::ParseAtomFeed title found \""<<pArticle->title<<"\""<<std::endl;
         }
 
-        xml::cNode::iterator iterDate(iter.GetChild("updated"));
+        document::cNode::const_iterator iterDate(iter.GetChild("updated"));
         if (iterDate.IsValid()) {
           pArticle->date = iterDate.GetChildContent();
-          //LOG<<"cFeed::ParseAtomFeed id found \""<<pArticle->date<<"\""<<std::endl;
+          //gLog<<"cFeed::ParseAtomFeed id found \""<<pArticle->date<<"\""<<std::endl;
         }
 
-        xml::cNode::iterator iterSummary(iter.GetChild("summary"));
+        document::cNode::const_iterator iterSummary(iter.GetChild("summary"));
         if (iterSummary.IsValid()) {
           pArticle->summary = iterSummary.GetChildContent();
-          //LOG<<"cFeed::ParseAtomFeed summary found \""<<pArticle->summary<<"\""<<std::endl;
+          //gLog<<"cFeed::ParseAtomFeed summary found \""<<pArticle->summary<<"\""<<std::endl;
         }
 
-        xml::cNode::iterator iterLink(iter.GetChild("link"));
+        document::cNode::const_iterator iterLink(iter.GetChild("link"));
         if (iterLink.IsValid()) {
           iterLink.GetAttribute("rel", pArticle->link.rel);
           iterLink.GetAttribute("type", pArticle->link.type);
           iterLink.GetAttribute("href", pArticle->link.href);
-          //LOG<<"cFeed::ParseAtomFeed link found \""<<pArticle->link.rel<<"\" \""<<pArticle->link.type<<"\" \""<<pArticle->link.href<<"\""<<std::endl;
+          //gLog<<"cFeed::ParseAtomFeed link found \""<<pArticle->link.rel<<"\" \""<<pArticle->link.type<<"\" \""<<pArticle->link.href<<"\""<<std::endl;
         }
 
-        xml::cNode::iterator iterContent(iter.GetChild("content"));
+        document::cNode::const_iterator iterContent(iter.GetChild("content"));
         if (iterContent.IsValid()) {
           iterContent.GetAttribute("type", pArticle->content.type);
           iterContent.GetAttribute("src", pArticle->content.src);
-          //LOG<<"cFeed::ParseAtomFeed content found \""<<pArticle->content.type<<"\" \""<<pArticle->content.src<<"\""<<std::endl;
+          //gLog<<"cFeed::ParseAtomFeed content found \""<<pArticle->content.type<<"\" \""<<pArticle->content.src<<"\""<<std::endl;
         }
 
         articles.push_back(pArticle);
@@ -136,24 +132,56 @@ namespace spitfire
         iter.Next("entry");
       };
 
-      LOG<<"cFeed::ParseAtomFeed returning"<<std::endl;
+      gLog<<"cFeed::ParseAtomFeed returning"<<std::endl;
     }
 
-    void cFeed::DownloadFeed(const string_t& sURL)
+    namespace
     {
-      /*Clear();
+      class cFeedDownloadListener : public http::cRequestListener
+      {
+      public:
+        std::string sContent;
+
+      private:
+        virtual void _OnTextContentReceived(const std::string& sText) override { sContent += sText; }
+        virtual void _OnBinaryContentReceived(const void* pContent, size_t len) override { sContent.append(static_cast<const char*>(pContent), len); }
+      };
+    }
 
-      cHTTPDownloader downloader;
+    void cFeed::DownloadFeed(const string_t& sURL)
+    {
+      Clear();
 
-      downloader.Download(sURL);
+      const cURI uri(spitfire::string::ToUTF8(sURL));
+      if (!uri.IsValidServer()) {
+        gLog<<"cFeed::DownloadFeed Invalid url \""<<sURL<<"\", returning"<<std::endl;
+        return;
+      }
 
-      while (downloader.IsConnected()) {
-        Yield();
-      };
+      cFeedDownloadListener listener;
 
-      if (!downloader.IsSuccessfulDownload()) return;
+      if (uri.GetProtocol() == cURI::PROTOCOL::HTTPS) {
+        #ifdef BUILD_NETWORK_TLS
+        http::DownloadHTTPS(spitfire::string::ToUTF8(sURL), listener);
+        #else
+        gLog<<"cFeed::DownloadFeed HTTPS is not supported, returning"<<std::endl;
+        return;
+        #endif
+      } else {
+        http::cRequest request;
+        request.SetHost(uri.GetHost());
+        request.SetPort(uri.GetPort());
+        request.SetPath(uri.GetRelativePath());
+        request.SetConnectionKeepAlive();
+
+        // Feeds are polled from the same few hosts so keep the connections open between downloads
+        if (http::GetDefaultConnectionPool().SendRequest(request, listener) != http::STATUS::OK) {
+          gLog<<"cFeed::DownloadFeed Download failed, returning"<<std::endl;
+          return;
+        }
+      }
 
-      ParseAtomFeed(downloader.GetContent());*/
+      ParseAtomFeed(listener.sContent);
     }
   }
 }
@@ -13,6 +13,8 @@
 #include <sstream>
 
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <thread>
 
@@ -21,6 +23,14 @@
 #include <windows.h>
 #endif
 
+#ifdef __LINUX__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#endif
+
 #ifdef BUILD_NETWORK_TLS
 #include <gnutls/gnutls.h>
 
@@ -284,11 +294,16 @@ namespace spitfire
       {
         switch (status) {
           case STATUS::OK: return TEXT("Ok");
+          case STATUS::PARTIAL_CONTENT: return TEXT("Partial Content");
+
+          case STATUS::NOT_MODIFIED: return TEXT("Not Modified");
 
           case STATUS::BAD_REQUEST: return TEXT("Bad Request");
           case STATUS::FORBIDDEN: return TEXT("Forbidden");
           case STATUS::NOT_FOUND: return TEXT("Not Found");
           case STATUS::METHOD_NOT_ALLOWED: return TEXT("Method Not Allowed");
+          case STATUS::REQUEST_ENTITY_TOO_LONG: return TEXT("Request Entity Too Large");
+          case STATUS::REQUEST_RANGE_NOT_SATISFIABLE: return TEXT("Requested Range Not Satisfiable");
           case STATUS::INTERNAL_SERVER_ERROR: return TEXT("Internal Server Error");
           case STATUS::NOT_IMPLEMENTED: return TEXT("Not Implemented");
           case STATUS::HTTP_VERSION_NOT_SUPPORTED: return TEXT("HTTP Version Not Supported");
@@ -334,10 +349,46 @@ namespace spitfire
         return true;
       }
 
-      bool ParseRequest(cRequest& request, const std::string& sRequest)
+      bool ParseUnsigned(const std::string& sValue, size_t& value)
+      {
+        if (sValue.empty() || (sValue.length() > 18)) return false;
+
+        value = 0;
+        for (char c : sValue) {
+          if ((c < '0') || (c > '9')) return false;
+          value = (value * 10) + size_t(c - '0');
+        }
+
+        return true;
+      }
+
+      void ParseRange(cRequest& request, const std::string& sValue)
       {
-        gLog<<"ParseRequest sRequest=\""<<sRequest<<"\""<<std::endl;
+        // Range: bytes=500-999, bytes=500- or bytes=-500
+        // Only a single range is supported, anything else is ignored and the whole content is sent which is allowed by the spec
+        if (!spitfire::string::StartsWith(sValue, "bytes=")) return;
+
+        const std::string sRange = spitfire::string::Trim(sValue.substr(6));
+        if (sRange.find(',') != std::string::npos) return;
+
+        const size_t nDash = sRange.find('-');
+        if (nDash == std::string::npos) return;
+
+        const std::string sFirst = spitfire::string::Trim(sRange.substr(0, nDash));
+        const std::string sLast = spitfire::string::Trim(sRange.substr(nDash + 1));
+
+        size_t nFirstByte = 0;
+        size_t nLastByte = 0;
+        if (sFirst.empty()) {
+          if (ParseUnsigned(sLast, nLastByte)) request.SetRangeSuffixBytes(nLastByte);
+        } else if (ParseUnsigned(sFirst, nFirstByte)) {
+          if (sLast.empty()) request.SetRangeBytes(nFirstByte, std::string::npos);
+          else if (ParseUnsigned(sLast, nLastByte) && (nFirstByte <= nLastByte)) request.SetRangeBytes(nFirstByte, nLastByte);
+        }
+      }
 
+      bool ParseRequest(cRequest& request, const std::string& sRequest)
+      {
         request.Clear();
 
         string::cStringParserUTF8 sp(sRequest);
@@ -377,19 +428,19 @@ namespace spitfire
             size_t found = sValue.find(":");
             if (found != std::string::npos) {
               // Split the host and port up
-              sValue = sValue.substr(0, found);
-              //std::string sPort = sValue.substr(found + 1);
+              size_t nPort = 0;
+              if (ParseUnsigned(sValue.substr(found + 1), nPort) && (nPort <= 65535)) request.SetPort(port_t(nPort));
 
-              request.SetHost(sValue);
-              // TODO: Do something with the port
+              request.SetHost(sValue.substr(0, found));
             } else request.SetHost(sValue);
+          } else if (spitfire::string::IsEqualInsensitive(sKey, "Range")) {
+            ParseRange(request, sValue);
           } else {
             request.AddOtherHeader(sKey, sValue);
           }
         }
 
         // Decode any form url encoded data
-        gLog<<"request.GetContentType()=\""<<request.GetContentType()<<"\""<<std::endl;
         if (spitfire::string::StartsWith(request.GetContentType(), "application/x-www-form-urlencoded")) {
           const size_t nContentLengthBytes = request.GetContentLengthBytes();
           if (nContentLengthBytes != 0) {
@@ -417,15 +468,12 @@ namespace spitfire
             // Make sure that we ignore bytes after the content length
             sLine.resize(nContentLengthBytes);
 
-            gLog<<"ParseRequest url encoded string \""<<sLine<<"\""<<std::endl;
-
             // Decode our url encoded string;
             std::vector<std::string> pairs;
             spitfire::string::Split(sLine, '&', pairs);
 
             const size_t n = pairs.size();
             for (size_t i = 0; i < n; i++) {
-              gLog<<"ParseRequest Pair \""<<pairs[i]<<"\""<<std::endl;
               size_t found = 0;
               if (!spitfire::string::Find(pairs[i], "=", found)) {
                 gLog<<"ParseRequest Invalid pair \""<<pairs[i]<<"\", returning false"<<std::endl;
@@ -434,13 +482,11 @@ namespace spitfire
 
               const std::string sKey = pairs[i].substr(0, found);
               const std::string sValue = spitfire::network::Decode(pairs[i].substr(found + 1));
-              gLog<<"ParseRequest Split \""<<sKey<<"\"=\""<<sValue<<"\""<<std::endl;
               request.AddFormData(sKey, sValue);
             }
           }
         }
 
-        gLog<<"ParseRequest returning true"<<std::endl;
         return true;
       }
 
@@ -454,7 +500,8 @@ namespace spitfire
         nContentLengthBytes(0),
         bContentDispositionServeInline(true),
         expires(EXPIRES::ONE_YEAR),
-        cacheControl(CACHE_CONTROL::NOT_SPECIFIED)
+        cacheControl(CACHE_CONTROL::NOT_SPECIFIED),
+        bAcceptRangesBytes(false)
       {
         SetContentTypeTextHTMLUTF8();
         SetConnectionClose();
@@ -467,7 +514,8 @@ namespace spitfire
 
       void cResponse::SetContentLengthBytes(size_t _nContentLengthBytes)
       {
-        if (_nContentLengthBytes != 0) bContentLengthSet = true;
+        // An explicit zero is still sent so that keep alive clients know there is no content
+        bContentLengthSet = true;
         nContentLengthBytes = _nContentLengthBytes;
       }
 
@@ -538,10 +586,39 @@ namespace spitfire
         bConnectionKeepAlive = true;
       }
 
-      std::string cResponse::ToString() const
+      bool cResponse::IsConnectionKeepAlive() const
+      {
+        return bConnectionKeepAlive;
+      }
+
+      void cResponse::SetETag(const std::string& _sETag)
+      {
+        sETag = _sETag;
+      }
+
+      void cResponse::SetAcceptRangesBytes()
+      {
+        bAcceptRangesBytes = true;
+      }
+
+      void cResponse::SetContentRangeBytes(size_t nFirstByte, size_t nLastByte, size_t nSizeBytes)
       {
-        gLog<<"cResponse::ToString mime=\""<<sMimeType<<"\""<<std::endl;
+        // Content-Range: bytes 500-999/1234
+        std::ostringstream o;
+        o<<"bytes "<<nFirstByte<<"-"<<nLastByte<<"/"<<nSizeBytes;
+        sContentRange = o.str();
+      }
 
+      void cResponse::SetContentRangeNotSatisfiable(size_t nSizeBytes)
+      {
+        // Content-Range: bytes */1234
+        std::ostringstream o;
+        o<<"bytes */"<<nSizeBytes;
+        sContentRange = o.str();
+      }
+
+      std::string cResponse::ToString() const
+      {
         std::ostringstream o;
         o<<"HTTP/1.1 "<<GetStatusAsString(status)<<" "<<GetStatusDescription(status)<<"\n";
         o<<"Status: "<<GetStatusAsString(status)<<" "<<GetStatusDescription(status)<<"\n";
@@ -575,6 +652,9 @@ namespace spitfire
         //o<<"Server: Apache 1.0 (Unix)\n";
         //o<<"x-frame-options: SAMEORIGIN\n";
         //o<<"x-xss-protection: 1; mode=block\n";
+        if (!sETag.empty()) o<<"ETag: "<<sETag<<"\n";
+        if (bAcceptRangesBytes) o<<"Accept-Ranges: bytes\n";
+        if (!sContentRange.empty()) o<<"Content-Range: "<<sContentRange<<"\n";
         if (bContentLengthSet) o<<"Content-Length: "<<nContentLengthBytes<<"\n";
         o<<"Connection: "<<(bConnectionKeepAlive ? "Keep-Alive" : "Close")<<"\n\n";
 
@@ -678,6 +758,35 @@ namespace spitfire
         return "";
       }
 
+      std::string cRequest::GetIfNoneMatch() const
+      {
+        const std::map<std::string, std::string>::const_iterator iter = MapFindCaseInsensitive(mOtherHeaders, "If-None-Match");
+        if (iter != mOtherHeaders.end()) return iter->second;
+
+        return "";
+      }
+
+      bool cRequest::GetRangeBytes(size_t nSizeBytes, size_t& nFirstByte, size_t& nLastByte) const
+      {
+        ASSERT(bHasRange);
+
+        if (nSizeBytes == 0) return false;
+
+        if (bIsRangeSuffix) {
+          if (nOffsetBytes == 0) return false;
+
+          nFirstByte = (nOffsetBytes < nSizeBytes) ? (nSizeBytes - nOffsetBytes) : 0;
+          nLastByte = nSizeBytes - 1;
+          return true;
+        }
+
+        if (nOffsetBytes >= nSizeBytes) return false;
+
+        nFirstByte = nOffsetBytes;
+        nLastByte = std::min(nRangeLastByte, nSizeBytes - 1);
+        return true;
+      }
+
       size_t cRequest::GetContentLengthBytes() const
       {
         const std::map<std::string, std::string>::const_iterator iter = MapFindCaseInsensitive(mOtherHeaders, "Content-Length");
@@ -746,12 +855,14 @@ namespace spitfire
 
         o<<" "<<sRelativeURIWithAnyVariables<<" HTTP/1.1"<<STR_END;
 
-        // TODO: Use ports other than 80 when required
-        //if (uri.GetPort() == 80) o<<"Host: "<<uri.GetServer()<<STR_END;
-        //else o<<"Host: "<<uri.GetServer()<<":"<<uri.GetPort()<<STR_END;
-        o<<"Host: "<<spitfire::string::ToUTF8(sHost)<<STR_END;
+        if (port == 80) o<<"Host: "<<spitfire::string::ToUTF8(sHost)<<STR_END;
+        else o<<"Host: "<<spitfire::string::ToUTF8(sHost)<<":"<<port<<STR_END;
 
-        if (nOffsetBytes != 0) o<<"Range: bytes="<<nOffsetBytes<<"-"<<STR_END;
+        if (bHasRange) {
+          if (bIsRangeSuffix) o<<"Range: bytes=-"<<nOffsetBytes<<STR_END;
+          else if (nRangeLastByte == std::string::npos) o<<"Range: bytes="<<nOffsetBytes<<"-"<<STR_END;
+          else o<<"Range: bytes="<<nOffsetBytes<<"-"<<nRangeLastByte<<STR_END;
+        }
 
         o<<"User-Agent: Mozilla/4.0 (compatible; Spitfire 1.0; Linux)"<<STR_END;
         o<<"Accept: */*"<<STR_END;
@@ -786,19 +897,138 @@ Content-Transfer-Encoding: binary
 
 
 
+      #ifdef __LINUX__
+      // ** cOpenFileCache
+
+      cOpenFileCache::cOpenFileCache(size_t _nMaxFiles) :
+        nMaxFiles(std::max<size_t>(1, _nMaxFiles))
+      {
+      }
+
+      std::shared_ptr<const cCachedFile> cOpenFileCache::GetFile(const string_t& sFilePath)
+      {
+        struct stat fileStat;
+        const bool bIsFile = (stat(sFilePath.c_str(), &fileStat) == 0) && S_ISREG(fileStat.st_mode);
+        const int64_t modifiedTimeNS = bIsFile ? ((int64_t(fileStat.st_mtim.tv_sec) * 1000000000) + int64_t(fileStat.st_mtim.tv_nsec)) : 0;
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+
+          std::map<string_t, std::list<std::shared_ptr<const cCachedFile>>::iterator>::iterator iter = lookup.find(sFilePath);
+          if (iter != lookup.end()) {
+            std::shared_ptr<const cCachedFile> pCachedFile = *(iter->second);
+            if (bIsFile && (pCachedFile->pFile->GetSizeBytes() == uint64_t(fileStat.st_size)) && (pCachedFile->pFile->GetModifiedTimeNS() == modifiedTimeNS)) {
+              // Move it to the front of the list
+              files.splice(files.begin(), files, iter->second);
+              return pCachedFile;
+            }
+
+            // The file has changed or gone away
+            Remove(sFilePath);
+          }
+        }
+
+        if (!bIsFile) return std::shared_ptr<const cCachedFile>();
+
+        // Open the file outside of the lock so that other files can still be served in the meantime
+        std::shared_ptr<const spitfire::network::cOpenFile> pFile = spitfire::network::cOpenFile::Open(sFilePath);
+        if (pFile == nullptr) return std::shared_ptr<const cCachedFile>();
+
+        std::shared_ptr<cCachedFile> pCachedFile = std::make_shared<cCachedFile>();
+        pCachedFile->sFilePath = sFilePath;
+        pCachedFile->pFile = pFile;
+
+        // A validator made from the size and modified time the same way as most web servers do, the modified time is in nanoseconds
+        // so it is sent as a strong ETag which also lets clients use it for range requests
+        std::ostringstream o;
+        o<<"\""<<std::hex<<pFile->GetSizeBytes()<<"-"<<pFile->GetModifiedTimeNS()<<"\"";
+        pCachedFile->sETag = o.str();
+
+        const string_t sExtension = filesystem::GetExtensionNoDot(sFilePath);
+        bool bServeInline = false;
+        const std::string sMimeTypeUTF8 = GetMimeTypeFromExtension(sExtension, bServeInline);
+
+        cResponse& response = pCachedFile->response;
+        response.SetStatus(STATUS::OK);
+        response.SetContentLengthBytes(size_t(pFile->GetSizeBytes()));
+        response.SetContentMimeType(sMimeTypeUTF8);
+        if (bServeInline) response.SetContentDispositionInline(filesystem::GetFile(sFilePath));
+        if (IsCachePublicForExtension(sExtension)) response.SetCacheControlPublic();
+        response.SetETag(pCachedFile->sETag);
+        response.SetAcceptRangesBytes();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Another thread may have opened the same file while we were
+        Remove(sFilePath);
+
+        files.push_front(pCachedFile);
+        lookup[sFilePath] = files.begin();
+
+        // Evict the least recently used files, they stay open until the last connection sending them has finished
+        while (files.size() > nMaxFiles) Remove(files.back()->sFilePath);
+
+        return pCachedFile;
+      }
+
+      void cOpenFileCache::Remove(const string_t& sFilePath)
+      {
+        std::map<string_t, std::list<std::shared_ptr<const cCachedFile>>::iterator>::iterator iter = lookup.find(sFilePath);
+        if (iter == lookup.end()) return;
+
+        files.erase(iter->second);
+        lookup.erase(iter);
+      }
+
+      size_t cOpenFileCache::GetFileCount() const
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.size();
+      }
+
+      void cOpenFileCache::Clear()
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        lookup.clear();
+        files.clear();
+      }
+
+      cOpenFileCache& GetDefaultOpenFileCache()
+      {
+        static cOpenFileCache cache;
+        return cache;
+      }
+      #endif // __LINUX__
+
+
       // ** cServerUtil
 
-      void cServerUtil::SendResponse(cConnectedClient& connection, const cResponse& response) const
+      #ifdef __LINUX__
+      cServerUtil::cServerUtil() :
+        pOpenFileCache(&GetDefaultOpenFileCache())
+      {
+      }
+
+      cServerUtil::cServerUtil(cOpenFileCache& openFileCache) :
+        pOpenFileCache(&openFileCache)
+      {
+      }
+      #endif
+
+      void cServerUtil::SendResponse(cClientConnection& connection, const cResponse& response) const
       {
         connection.Write(response.ToString());
+
+        // We told the client that we are closing the connection so we have to actually close it
+        if (!response.IsConnectionKeepAlive()) connection.SetCloseAfterResponse();
       }
 
-      void cServerUtil::SendContent(cConnectedClient& connection, const std::string& sContentUTF8) const
+      void cServerUtil::SendContent(cClientConnection& connection, const std::string& sContentUTF8) const
       {
         connection.Write(sContentUTF8);
       }
 
-      void cServerUtil::ServeError404(cConnectedClient& connection, const cRequest& request) const
+      void cServerUtil::ServeError404(cClientConnection& connection, const cRequest& request) const
       {
         string_t sContentUTF8(
           "<!DOCTYPE html>"
@@ -830,7 +1060,7 @@ Content-Transfer-Encoding: binary
         SendContent(connection, sContentUTF8);
       }
 
-      void cServerUtil::ServeError(cConnectedClient& connection, const cRequest& request, STATUS status) const
+      void cServerUtil::ServeError(cClientConnection& connection, const cRequest& request, STATUS status) const
       {
         string_t sContentUTF8(
           "<!DOCTYPE html>"
@@ -860,16 +1090,18 @@ Content-Transfer-Encoding: binary
 
         SendResponse(connection, response);
         SendContent(connection, sContentUTF8);
-        SendContent(connection, "\n\n");
       }
 
-      void cServerUtil::ServeFile(cConnectedClient& connection, const cRequest& request, const string_t& sMimeTypeUTF8, const string_t& sRelativeFilePath) const
+      void cServerUtil::ServeFile(cClientConnection& connection, const cRequest& request, const string_t& sMimeTypeUTF8, const string_t& sRelativeFilePath) const
       {
         if (!request.IsMethodGet()) {
           ServeError(connection, request, STATUS::NOT_IMPLEMENTED);
           return;
         }
 
+        #ifdef __LINUX__
+        ServeOpenFile(connection, request, sRelativeFilePath, sMimeTypeUTF8);
+        #else
         if (!filesystem::FileExists(sRelativeFilePath)) {
           ServeError404(connection, request);
           return;
@@ -909,15 +1141,19 @@ Content-Transfer-Encoding: binary
         }
 
         connection.Write("\n\n");
+        #endif
       }
 
-      void cServerUtil::ServeFileWithResolvedFilePath(cConnectedClient& connection, const cRequest& request, const string_t& sFilePath) const
+      void cServerUtil::ServeFileWithResolvedFilePath(cClientConnection& connection, const cRequest& request, const string_t& sFilePath) const
       {
         if (!request.IsMethodGet()) {
           ServeError(connection, request, STATUS::NOT_IMPLEMENTED);
           return;
         }
 
+        #ifdef __LINUX__
+        ServeOpenFile(connection, request, sFilePath, "");
+        #else
         if (!filesystem::FileExists(sFilePath)) {
           ServeError404(connection, request);
           return;
@@ -960,7 +1196,56 @@ Content-Transfer-Encoding: binary
         }
 
         connection.Write("\n\n");
+        #endif
+      }
+
+      #ifdef __LINUX__
+      void cServerUtil::ServeOpenFile(cClientConnection& connection, const cRequest& request, const string_t& sFilePath, const std::string& sMimeTypeUTF8) const
+      {
+        std::shared_ptr<const cCachedFile> pCachedFile = pOpenFileCache->GetFile(sFilePath);
+        if (pCachedFile == nullptr) {
+          if (!filesystem::FileExists(sFilePath)) ServeError404(connection, request);
+          else ServeError(connection, request, STATUS::INTERNAL_SERVER_ERROR);
+          return;
+        }
+
+        // Start with the headers that were worked out when the file was opened
+        cResponse response(pCachedFile->response);
+        if (!sMimeTypeUTF8.empty()) response.SetContentMimeType(sMimeTypeUTF8);
+        if (request.IsConnectionKeepAlive()) response.SetConnectionKeepAlive();
+
+        // The client already has this version of the file
+        const std::string sIfNoneMatch = request.GetIfNoneMatch();
+        if (!sIfNoneMatch.empty() && ((sIfNoneMatch == "*") || (sIfNoneMatch.find(pCachedFile->sETag) != std::string::npos))) {
+          response.SetStatus(STATUS::NOT_MODIFIED);
+          SendResponse(connection, response);
+          return;
+        }
+
+        const size_t nFileSizeBytes = size_t(pCachedFile->pFile->GetSizeBytes());
+        size_t nFirstByte = 0;
+        size_t nLengthBytes = nFileSizeBytes;
+
+        if (request.HasRange()) {
+          size_t nLastByte = 0;
+          if (!request.GetRangeBytes(nFileSizeBytes, nFirstByte, nLastByte)) {
+            response.SetStatus(STATUS::REQUEST_RANGE_NOT_SATISFIABLE);
+            response.SetContentRangeNotSatisfiable(nFileSizeBytes);
+            response.SetContentLengthBytes(0);
+            SendResponse(connection, response);
+            return;
+          }
+
+          nLengthBytes = (nLastByte - nFirstByte) + 1;
+          response.SetStatus(STATUS::PARTIAL_CONTENT);
+          response.SetContentRangeBytes(nFirstByte, nLastByte, nFileSizeBytes);
+          response.SetContentLengthBytes(nLengthBytes);
+        }
+
+        SendResponse(connection, response);
+        connection.SendFile(pCachedFile->pFile, nFirstByte, nLengthBytes);
       }
+      #endif // __LINUX__
 
       bool cServerUtil::GetLocalFilePathInWebDirectory(std::string& sResolvedLocalFilePath, const std::string sRelativeFilePath) const
       {
@@ -995,7 +1280,7 @@ Content-Transfer-Encoding: binary
         return GetLocalFilePathInWebDirectory(sResolvedLocalFilePath, sRelativeFilePath);
       }
 
-      void cServerUtil::ServeFile(cConnectedClient& connection, const cRequest& request) const
+      void cServerUtil::ServeFile(cClientConnection& connection, const cRequest& request) const
       {
         std::string sResolvedLocalFilePath;
         if (!GetLocalFilePathInWebDirectory(sResolvedLocalFilePath, request.GetPath())) {
@@ -1008,6 +1293,83 @@ Content-Transfer-Encoding: binary
       }
 
 
+      size_t GetCompleteRequestLength(const std::string& sData)
+      {
+        // Find the blank line at the end of the header
+        size_t nHeaderLength = 0;
+        const size_t nCRLF = sData.find("\r\n\r\n");
+        const size_t nLF = sData.find("\n\n");
+        if ((nCRLF != std::string::npos) && ((nLF == std::string::npos) || (nCRLF < nLF))) nHeaderLength = nCRLF + 4;
+        else if (nLF != std::string::npos) nHeaderLength = nLF + 2;
+        else return 0;
+
+        // Look for a content length in the header
+        size_t nContentLengthBytes = 0;
+        size_t nLineStart = sData.find('\n') + 1;
+        while (nLineStart < nHeaderLength) {
+          size_t nLineEnd = sData.find('\n', nLineStart);
+          if ((nLineEnd == std::string::npos) || (nLineEnd > nHeaderLength)) nLineEnd = nHeaderLength;
+
+          const size_t nColon = sData.find(':', nLineStart);
+          if ((nColon != std::string::npos) && (nColon < nLineEnd) && spitfire::string::IsEqualInsensitive(sData.substr(nLineStart, nColon - nLineStart), "Content-Length")) {
+            nContentLengthBytes = spitfire::string::ToUnsignedInt(spitfire::string::Trim(sData.substr(nColon + 1, nLineEnd - (nColon + 1))));
+            break;
+          }
+
+          nLineStart = nLineEnd + 1;
+        }
+
+        const size_t nRequestLength = nHeaderLength + nContentLengthBytes;
+        return (sData.length() >= nRequestLength) ? nRequestLength : 0;
+      }
+
+
+      #ifdef __LINUX__
+      // ** cEventLoopServerConnectionHandler
+
+      cEventLoopServerConnectionHandler::cEventLoopServerConnectionHandler(cServerRequestHandler& _requestHandler) :
+        requestHandler(_requestHandler)
+      {
+      }
+
+      void cEventLoopServerConnectionHandler::OnDataReceived(spitfire::network::cEventLoopServer& server, spitfire::network::cEventLoopConnection& connection)
+      {
+        // Don't let a client make us buffer an endless header
+        const size_t nMaxHeaderLengthBytes = 64 * 1024;
+
+        // There may be several pipelined requests waiting
+        while (connection.IsOpen()) {
+          const std::string& sReceived = connection.GetReceivedData();
+          const size_t nRequestLength = GetCompleteRequestLength(sReceived);
+          if (nRequestLength == 0) {
+            if (sReceived.length() > nMaxHeaderLengthBytes) {
+              cRequest request;
+              cServerUtil util;
+              util.ServeError(connection, request, STATUS::REQUEST_ENTITY_TOO_LONG);
+              connection.Close();
+            }
+            break;
+          }
+
+          cRequest request;
+          const bool bIsValid = ParseRequest(request, sReceived.substr(0, nRequestLength));
+          connection.ConsumeReceivedData(nRequestLength);
+
+          if (!bIsValid) {
+            cServerUtil util;
+            util.ServeError(connection, request, STATUS::BAD_REQUEST);
+            connection.Close();
+            break;
+          }
+
+          requestHandler.HandleRequest(connection, request);
+
+          if (request.IsConnectionClose() || connection.IsCloseAfterResponse()) connection.Close();
+        }
+      }
+      #endif // __LINUX__
+
+
 
       // ** cConnectionHTTP
 
@@ -1035,6 +1397,12 @@ Content-Transfer-Encoding: binary
           len = connection.Read(szHeaderBuffer, nBufferLength, 5000);
           //gLog<<"cConnectionHTTP::ReadHeader Read has finished"<<std::endl;
           if (len == 0) {
+            if (connection.IsTimedOut()) {
+              // A partial header is no use to anyone
+              gLog<<"cConnectionHTTP::ReadHeader Timed out waiting for the header"<<std::endl;
+              return 0;
+            }
+
             gLog<<"cConnectionHTTP::ReadHeader Read 0 bytes, breaking"<<std::endl;
             break;
           }
@@ -1436,6 +1804,13 @@ Content-Transfer-Encoding: binary
           } while (len != 0);
         }
 
+        if (connection.IsTimedOut()) {
+          // The server stopped sending before the end of the content, the download is incomplete
+          gLog<<"cHTTP::SendRequest Timed out reading the content"<<std::endl;
+          connection.Close();
+          return;
+        }
+
         connection.Close();
 
         state = STATE::FINISHED;
@@ -1443,6 +1818,521 @@ Content-Transfer-Encoding: binary
       }
 
 
+      // ** cConnectionPool
+
+      namespace
+      {
+        // A response read from a pooled connection
+        class cPooledResponse
+        {
+        public:
+          cPooledResponse();
+
+          std::string GetHeaderValue(const std::string& sName) const;
+
+          STATUS status;
+          std::string sHeader;
+          std::map<std::string, std::string> headerValues;
+          std::string sContent;
+          bool bIsKeepAlive;
+        };
+
+        cPooledResponse::cPooledResponse() :
+          status(STATUS::UNKNOWN),
+          bIsKeepAlive(false)
+        {
+        }
+
+        std::string cPooledResponse::GetHeaderValue(const std::string& sName) const
+        {
+          const std::map<std::string, std::string>::const_iterator iter = MapFindCaseInsensitive(headerValues, sName);
+          if (iter != headerValues.end()) return iter->second;
+
+          return "";
+        }
+
+        std::string GetHostKey(const cRequest& request)
+        {
+          return spitfire::string::ToUTF8(request.GetHost()) + ":" + spitfire::string::ToString(request.GetPort());
+        }
+
+        bool IsTextContentType(const std::string& sContentType)
+        {
+          return (
+            spitfire::string::StartsWith(sContentType, "text/") ||
+            (sContentType.find("xml") != std::string::npos) ||
+            (sContentType.find("json") != std::string::npos) ||
+            (sContentType.find("javascript") != std::string::npos)
+          );
+        }
+
+        void DeliverResponse(const cPooledResponse& response, cRequestListener& listener)
+        {
+          listener.OnStatusReceived(response.status);
+          listener.OnHeaderReceived(response.sHeader);
+
+          listener.OnStateChanged(STATE::RECEIVING_CONTENT);
+          if (!response.sContent.empty()) {
+            if (IsTextContentType(response.GetHeaderValue("Content-Type"))) listener.OnTextContentReceived(response.sContent);
+            else listener.OnBinaryContentReceived(response.sContent.data(), response.sContent.length());
+          }
+
+          listener.OnStateChanged(STATE::FINISHED);
+        }
+      }
+
+
+      // ** cConnectionPool::cPooledConnection
+
+      class cConnectionPool::cPooledConnection
+      {
+      public:
+        cPooledConnection(const std::string& sHostKey, timeoutms_t timeoutMS);
+
+        bool Open(const cRequest& request);
+        bool IsOpen() const { return connection.IsOpen(); }
+        bool IsTimedOut() const { return connection.IsTimedOut(); }
+        bool IsStale(); // Returns true if the server has closed the connection while it was idle
+
+        bool Write(const std::string& sData);
+        bool ReadResponse(cPooledResponse& response, bool& bIsResponseStarted);
+
+        const std::string sHostKey;
+
+      private:
+        bool ReadMore();
+        bool ReadLine(std::string& sLine);
+        bool ReadContent(size_t nLengthBytes, std::string& sContent);
+
+        const timeoutms_t timeoutMS;
+        network::cConnectionTCP connection;
+        std::string sReceived; // Received but not parsed yet, there may be more than one response in here when pipelining
+      };
+
+      cConnectionPool::cPooledConnection::cPooledConnection(const std::string& _sHostKey, timeoutms_t _timeoutMS) :
+        sHostKey(_sHostKey),
+        timeoutMS(_timeoutMS)
+      {
+      }
+
+      bool cConnectionPool::cPooledConnection::Open(const cRequest& request)
+      {
+        if (!connection.Open(spitfire::string::ToUTF8(request.GetHost()), request.GetPort())) return false;
+
+        #ifdef __LINUX__
+        // Requests are small and we wait for every response so don't let Nagle hold them back
+        const int value = 1;
+        setsockopt(connection.GetFD(), IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+        #endif
+
+        return true;
+      }
+
+      bool cConnectionPool::cPooledConnection::IsStale()
+      {
+        if (!connection.IsOpen() || !sReceived.empty()) return true;
+
+        #ifdef __LINUX__
+        // An idle connection should have nothing to read, if it is readable the server has closed it
+        pollfd fds;
+        fds.fd = connection.GetFD();
+        fds.events = POLLIN;
+        fds.revents = 0;
+        return (poll(&fds, 1, 0) != 0);
+        #else
+        return false;
+        #endif
+      }
+
+      bool cConnectionPool::cPooledConnection::Write(const std::string& sData)
+      {
+        size_t nSent = 0;
+        while (nSent < sData.length()) {
+          if (!connection.IsOpen()) return false;
+
+          const size_t n = connection.Write(sData.data() + nSent, sData.length() - nSent);
+          if (n == 0) return false;
+          nSent += n;
+        }
+
+        return true;
+      }
+
+      bool cConnectionPool::cPooledConnection::ReadMore()
+      {
+        if (!connection.IsOpen()) return false;
+
+        char buffer[16 * 1024];
+        const size_t n = connection.Read(buffer, sizeof(buffer), timeoutMS);
+        if (n == 0) return false;
+
+        sReceived.append(buffer, n);
+        return true;
+      }
+
+      bool cConnectionPool::cPooledConnection::ReadLine(std::string& sLine)
+      {
+        size_t nEnd = std::string::npos;
+        while ((nEnd = sReceived.find('\n')) == std::string::npos) {
+          if (!ReadMore()) return false;
+        }
+
+        // Lines should end in "\r\n" but we accept a bare "\n" too
+        sLine = sReceived.substr(0, ((nEnd != 0) && (sReceived[nEnd - 1] == '\r')) ? (nEnd - 1) : nEnd);
+        sReceived.erase(0, nEnd + 1);
+        return true;
+      }
+
+      bool cConnectionPool::cPooledConnection::ReadContent(size_t nLengthBytes, std::string& sContent)
+      {
+        while (sReceived.length() < nLengthBytes) {
+          if (!ReadMore()) return false;
+        }
+
+        sContent.append(sReceived, 0, nLengthBytes);
+        sReceived.erase(0, nLengthBytes);
+        return true;
+      }
+
+      bool cConnectionPool::cPooledConnection::ReadResponse(cPooledResponse& response, bool& bIsResponseStarted)
+      {
+        bIsResponseStarted = !sReceived.empty();
+
+        // Read the header, skipping any interim responses such as "100 Continue"
+        int iStatus = 0;
+        std::string sVersion;
+        do {
+          // The header ends with an empty line
+          response.sHeader.clear();
+          std::string sLine;
+          while (true) {
+            if (!ReadLine(sLine)) return false;
+            bIsResponseStarted = true;
+            if (sLine.empty()) break;
+            response.sHeader += sLine + "\n";
+          }
+
+          // HTTP/1.1 200 OK
+          const size_t nVersionEnd = response.sHeader.find(' ');
+          if (nVersionEnd == std::string::npos) return false;
+          sVersion = response.sHeader.substr(0, nVersionEnd);
+          iStatus = atoi(response.sHeader.c_str() + nVersionEnd + 1);
+        } while ((iStatus >= 100) && (iStatus < 200));
+
+        if (!spitfire::string::StartsWith(sVersion, "HTTP/") || (iStatus == 0)) return false;
+
+        response.status = STATUS(iStatus);
+
+        // Key value pairs
+        response.headerValues.clear();
+        size_t nLineStart = response.sHeader.find('\n') + 1;
+        while (nLineStart < response.sHeader.length()) {
+          const size_t nLineEnd = response.sHeader.find('\n', nLineStart);
+          const std::string sLine = response.sHeader.substr(nLineStart, nLineEnd - nLineStart);
+          const size_t nColon = sLine.find(':');
+          if (nColon != std::string::npos) response.headerValues[sLine.substr(0, nColon)] = spitfire::string::StripTrailing(spitfire::string::StripLeading(sLine.substr(nColon + 1), " \t"), " \t");
+          nLineStart = nLineEnd + 1;
+        }
+
+        // HTTP/1.1 connections are kept alive unless the server says otherwise, HTTP/1.0 connections have to ask for it
+        const std::string sConnection = response.GetHeaderValue("Connection");
+        if (sVersion == "HTTP/1.0") response.bIsKeepAlive = spitfire::string::IsEqualInsensitive(sConnection, "Keep-Alive");
+        else response.bIsKeepAlive = !spitfire::string::IsEqualInsensitive(sConnection, "Close");
+
+        // Read the content
+        response.sContent.clear();
+
+        if ((response.status == STATUS::NO_CONTENT) || (response.status == STATUS::NOT_MODIFIED)) return true;
+
+        if (spitfire::string::IsEqualInsensitive(response.GetHeaderValue("Transfer-Encoding"), "chunked")) {
+          // Each chunk is the length in hex on its own line, then the chunk, then a new line, the last chunk has a length of 0
+          std::string sLine;
+          while (true) {
+            if (!ReadLine(sLine)) return false;
+
+            const size_t nChunkLengthBytes = size_t(strtoull(sLine.c_str(), nullptr, 16));
+            if (nChunkLengthBytes == 0) {
+              // Skip any trailers up to the final empty line
+              do {
+                if (!ReadLine(sLine)) return false;
+              } while (!sLine.empty());
+              break;
+            }
+
+            if (!ReadContent(nChunkLengthBytes, response.sContent) || !ReadLine(sLine)) return false;
+          }
+        } else if (MapFindCaseInsensitive(response.headerValues, "Content-Length") != response.headerValues.end()) {
+          const size_t nContentLengthBytes = size_t(strtoull(response.GetHeaderValue("Content-Length").c_str(), nullptr, 10));
+          if (!ReadContent(nContentLengthBytes, response.sContent)) return false;
+        } else {
+          // The content ends when the server closes the connection
+          while (ReadMore()) {
+          }
+
+          // Only a close from the server ends the content, if we gave up waiting it is incomplete
+          if (IsTimedOut()) return false;
+
+          response.sContent = sReceived;
+          sReceived.clear();
+          response.bIsKeepAlive = false;
+        }
+
+        return true;
+      }
+
+
+      // ** cConnectionPool
+
+      cConnectionPool::cConnectionPool(size_t _nMaxIdleConnectionsPerHost, size_t _nMaxRequestsInFlight) :
+        nMaxIdleConnectionsPerHost(_nMaxIdleConnectionsPerHost),
+        nMaxRequestsInFlight(std::max<size_t>(1, _nMaxRequestsInFlight)),
+        bIsPipelining(false),
+        nMaxPipelineDepth(1),
+        timeoutMS(30000),
+        nRequestsInFlight(0),
+        nConnectionsOpened(0)
+      {
+      }
+
+      cConnectionPool::~cConnectionPool()
+      {
+        CloseIdleConnections();
+      }
+
+      void cConnectionPool::SetPipelining(bool bEnabled, size_t _nMaxPipelineDepth)
+      {
+        bIsPipelining = bEnabled;
+        nMaxPipelineDepth = std::max<size_t>(1, _nMaxPipelineDepth);
+      }
+
+      void cConnectionPool::CloseIdleConnections()
+      {
+        std::lock_guard<std::mutex> lock(mutexIdle);
+        idle.clear();
+      }
+
+      size_t cConnectionPool::GetIdleConnectionCount() const
+      {
+        std::lock_guard<std::mutex> lock(mutexIdle);
+
+        size_t nConnections = 0;
+        for (auto& iter : idle) nConnections += iter.second.size();
+        return nConnections;
+      }
+
+      void cConnectionPool::AcquireRequestsInFlight(size_t nRequests)
+      {
+        ASSERT(nRequests <= nMaxRequestsInFlight);
+
+        std::unique_lock<std::mutex> lock(mutexInFlight);
+        conditionInFlight.wait(lock, [this, nRequests]() { return ((nRequestsInFlight + nRequests) <= nMaxRequestsInFlight); });
+        nRequestsInFlight += nRequests;
+      }
+
+      void cConnectionPool::ReleaseRequestsInFlight(size_t nRequests)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutexInFlight);
+          nRequestsInFlight -= nRequests;
+        }
+        conditionInFlight.notify_all();
+      }
+
+      std::unique_ptr<cConnectionPool::cPooledConnection> cConnectionPool::GetConnection(const cRequest& request, bool& bIsReused)
+      {
+        const std::string sHostKey = GetHostKey(request);
+
+        {
+          std::lock_guard<std::mutex> lock(mutexIdle);
+
+          std::map<std::string, std::vector<std::unique_ptr<cPooledConnection>>>::iterator iter = idle.find(sHostKey);
+          if (iter != idle.end()) {
+            std::vector<std::unique_ptr<cPooledConnection>>& connections = iter->second;
+            while (!connections.empty()) {
+              std::unique_ptr<cPooledConnection> pConnection = std::move(connections.back());
+              connections.pop_back();
+
+              if (!pConnection->IsStale()) {
+                bIsReused = true;
+                return pConnection;
+              }
+            }
+          }
+        }
+
+        bIsReused = false;
+
+        std::unique_ptr<cPooledConnection> pConnection(new cPooledConnection(sHostKey, timeoutMS));
+        if (!pConnection->Open(request)) {
+          gLog<<"cConnectionPool::GetConnection Could not connect to \""<<sHostKey<<"\""<<std::endl;
+          return std::unique_ptr<cPooledConnection>();
+        }
+
+        nConnectionsOpened++;
+
+        return pConnection;
+      }
+
+      void cConnectionPool::ReturnConnection(std::unique_ptr<cPooledConnection> pConnection)
+      {
+        std::lock_guard<std::mutex> lock(mutexIdle);
+
+        std::vector<std::unique_ptr<cPooledConnection>>& connections = idle[pConnection->sHostKey];
+
+        // If we already have enough idle connections to this host then this one is just closed
+        if (connections.size() < nMaxIdleConnectionsPerHost) connections.push_back(std::move(pConnection));
+      }
+
+      std::string cConnectionPool::CreateRequestData(const cRequest& request)
+      {
+        ASSERT(request.file.sFilePath.empty()); // Multipart file uploads are only supported by cHTTP
+
+        std::ostringstream o;
+        o<<request.CreateRequestHeader();
+
+        // Pass on any other headers that the request header doesn't already have
+        for (auto& iter : request.GetOtherHeaders()) {
+          if (
+            spitfire::string::IsEqualInsensitive(iter.first, "Connection") ||
+            spitfire::string::IsEqualInsensitive(iter.first, "Accept") ||
+            spitfire::string::IsEqualInsensitive(iter.first, "Content-Type") ||
+            spitfire::string::IsEqualInsensitive(iter.first, "Content-Length")
+          ) continue;
+
+          o<<iter.first<<": "<<iter.second<<STR_END;
+        }
+
+        if (request.IsMethodPost()) {
+          const std::string sVariables(request.CreateVariablesString());
+          o<<"Content-Type: application/x-www-form-urlencoded"<<STR_END;
+          o<<"Content-Length: "<<sVariables.length()<<STR_END;
+          o<<STR_END;
+          o<<sVariables;
+        } else o<<STR_END;
+
+        return o.str();
+      }
+
+      STATUS cConnectionPool::SendRequest(const cRequest& request, cRequestListener& listener)
+      {
+        const std::vector<cRequest> requests(1, request);
+        const std::vector<cRequestListener*> listeners(1, &listener);
+        std::vector<STATUS> statuses;
+        SendRequests(requests, listeners, statuses);
+        return statuses[0];
+      }
+
+      void cConnectionPool::SendRequests(const std::vector<cRequest>& requests, const std::vector<cRequestListener*>& listeners, std::vector<STATUS>& outStatuses)
+      {
+        ASSERT(requests.size() == listeners.size());
+
+        outStatuses.assign(requests.size(), STATUS::UNKNOWN);
+
+        // Group the requests by host, keeping them in order for each host
+        std::map<std::string, std::vector<size_t>> hosts;
+        for (size_t i = 0; i < requests.size(); i++) hosts[GetHostKey(requests[i])].push_back(i);
+
+        for (auto& iter : hosts) SendRequestsToHost(requests, listeners, iter.second, outStatuses);
+      }
+
+      void cConnectionPool::SendRequestsToHost(const std::vector<cRequest>& requests, const std::vector<cRequestListener*>& listeners, const std::vector<size_t>& indices, std::vector<STATUS>& outStatuses)
+      {
+        std::deque<size_t> pending(indices.begin(), indices.end());
+        std::vector<size_t> attempts(requests.size(), 0);
+
+        while (!pending.empty()) {
+          if (listeners[pending.front()]->IsToStop()) {
+            pending.pop_front();
+            continue;
+          }
+
+          // Work out how many requests to send on this connection before reading the responses
+          size_t nBatch = 1;
+          if (bIsPipelining && requests[pending.front()].IsMethodGet()) {
+            const size_t nMaxBatch = std::min(std::min(nMaxPipelineDepth, nMaxRequestsInFlight), pending.size());
+            while ((nBatch < nMaxBatch) && requests[pending[nBatch]].IsMethodGet()) nBatch++;
+          }
+
+          AcquireRequestsInFlight(nBatch);
+
+          for (size_t i = 0; i < nBatch; i++) listeners[pending[i]]->OnStateChanged(STATE::CONNECTING);
+
+          bool bIsReused = false;
+          std::unique_ptr<cPooledConnection> pConnection = GetConnection(requests[pending.front()], bIsReused);
+          if (pConnection == nullptr) {
+            ReleaseRequestsInFlight(nBatch);
+
+            // Every other request to this host would fail the same way
+            for (size_t index : pending) listeners[index]->OnStateChanged(STATE::CONNECTION_FAILED);
+            return;
+          }
+
+          // Send the whole batch at once
+          std::string sData;
+          for (size_t i = 0; i < nBatch; i++) {
+            listeners[pending[i]]->OnStateChanged(STATE::SENDING_REQUEST);
+            sData += CreateRequestData(requests[pending[i]]);
+          }
+
+          bool bIsFailed = !pConnection->Write(sData);
+          bool bIsResponseStarted = false;
+          bool bIsConnectionReusable = !bIsFailed;
+
+          // Read the responses in the same order
+          size_t nCompleted = 0;
+          while (!bIsFailed && (nCompleted < nBatch)) {
+            const size_t index = pending[nCompleted];
+            listeners[index]->OnStateChanged(STATE::RECEIVING_HEADER);
+
+            cPooledResponse response;
+            if (!pConnection->ReadResponse(response, bIsResponseStarted)) {
+              bIsFailed = true;
+              bIsConnectionReusable = false;
+              break;
+            }
+
+            outStatuses[index] = response.status;
+            DeliverResponse(response, *listeners[index]);
+            nCompleted++;
+
+            // The server won't answer anything else we sent on this connection
+            if (!response.bIsKeepAlive) {
+              bIsConnectionReusable = false;
+              break;
+            }
+          }
+
+          pending.erase(pending.begin(), pending.begin() + nCompleted);
+
+          const bool bIsTimedOut = pConnection->IsTimedOut();
+
+          // Return the connection before releasing our slots so that the next request can reuse it instead of opening another
+          if (bIsConnectionReusable && pConnection->IsOpen()) ReturnConnection(std::move(pConnection));
+
+          ReleaseRequestsInFlight(nBatch);
+
+          // A reused connection is often closed by the server just before we send on it, so a request that failed on a reused
+          // connection before any of the response arrived is retried once.  Anything else, a new connection, a partial response,
+          // a timeout or a POST that the server may have already acted on, is reported as failed
+          if (bIsFailed && !pending.empty()) {
+            const size_t index = pending.front();
+            attempts[index]++;
+            const bool bIsRetry = bIsReused && !bIsResponseStarted && !bIsTimedOut && requests[index].IsMethodGet() && (attempts[index] == 1);
+            if (!bIsRetry) {
+              listeners[index]->OnStateChanged(STATE::DISCONNECTED);
+              pending.pop_front();
+            }
+          }
+        }
+      }
+
+      cConnectionPool& GetDefaultConnectionPool()
+      {
+        static cConnectionPool pool;
+        return pool;
+      }
+
+
       #ifdef BUILD_NETWORK_TLS
       // Use the system ca-certificates file
       // Unfortunately this can differ in each distribution.  This worked on Ubuntu
@@ -22,9 +22,18 @@
 
 #ifdef __LINUX__
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <ifaddrs.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -210,6 +219,7 @@ namespace spitfire
 
     cConnectionTCP::cConnectionTCP() :
       bIsOpen(false),
+      bIsTimedOut(false),
       socket(io_context)
     {
     }
@@ -218,8 +228,6 @@ namespace spitfire
     {
       ASSERT(!IsOpen());
 
-      std::cout<<"cConnectionTCP::Open "<<ip<<":"<<port<<std::endl;
-
       std::optional<std::experimental::net::ip::tcp::endpoint> endpoint = hostname_lookup_endpoint(ip, "http");
       if (endpoint) {
         // Set the correct port
@@ -273,10 +281,31 @@ namespace spitfire
 
     size_t cConnectionTCP::Read(void* buffer, size_t len, timeoutms_t timeoutMS)
     {
-      gLog<<"cConnectionTCP::Read Reading up to "<<len<<" bytes with timeout "<<timeoutMS<<std::endl;
-
       ASSERT(IsOpen());
 
+      bIsTimedOut = false;
+
+      #ifdef __LINUX__
+      if (timeoutMS != 0) {
+        // Wait for something to read so that we don't block forever on a server that has stopped responding
+        pollfd fds;
+        fds.fd = socket.native_handle();
+        fds.events = POLLIN;
+        fds.revents = 0;
+        const int iResult = poll(&fds, 1, int(timeoutMS));
+        if (iResult == 0) {
+          bIsTimedOut = true;
+          return 0;
+        } else if (iResult < 0) {
+          gLog<<"cConnectionTCP::Read ERROR Polling the socket"<<std::endl;
+          Close();
+          return 0;
+        }
+      }
+      #else
+      (void)timeoutMS;
+      #endif
+
       std::error_code error;
 
       const size_t nLength = socket.read_some(std::experimental::net::buffer(static_cast<char*>(buffer), len), error);
@@ -290,14 +319,11 @@ namespace spitfire
         ASSERT(nLength <= len);
       }
 
-      gLog<<"cConnectionTCP::Read len="<<nLength<<std::endl;
       return nLength;
     }
 
     size_t cConnectionTCP::Write(const void* buffer, size_t len)
     {
-      gLog<<"cConnectionTCP::Write"<<std::endl;
-
       ASSERT(IsOpen());
 
       std::error_code error;
@@ -319,6 +345,62 @@ namespace spitfire
 
 
 
+    #ifdef __LINUX__
+    // ** cOpenFile
+
+    std::shared_ptr<cOpenFile> cOpenFile::Open(const string_t& sFilePath)
+    {
+      const int fd = open(sFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) return std::shared_ptr<cOpenFile>();
+
+      struct stat fileStat;
+      if ((fstat(fd, &fileStat) != 0) || !S_ISREG(fileStat.st_mode)) {
+        close(fd);
+        return std::shared_ptr<cOpenFile>();
+      }
+
+      const int64_t modifiedTimeNS = (int64_t(fileStat.st_mtim.tv_sec) * 1000000000) + int64_t(fileStat.st_mtim.tv_nsec);
+
+      return std::shared_ptr<cOpenFile>(new cOpenFile(fd, uint64_t(fileStat.st_size), modifiedTimeNS));
+    }
+
+    cOpenFile::cOpenFile(int _fd, uint64_t _nSizeBytes, int64_t _modifiedTimeNS) :
+      fd(_fd),
+      nSizeBytes(_nSizeBytes),
+      modifiedTimeNS(_modifiedTimeNS)
+    {
+    }
+
+    cOpenFile::~cOpenFile()
+    {
+      close(fd);
+    }
+
+
+    // ** cClientConnection
+
+    void cClientConnection::SendFile(std::shared_ptr<const cOpenFile> pFile, uint64_t nOffsetBytes, uint64_t nLengthBytes)
+    {
+      ASSERT(pFile != nullptr);
+
+      const size_t nBufferSizeBytes = 64 * 1024;
+      std::vector<uint8_t> buffer(nBufferSizeBytes);
+
+      while ((nLengthBytes != 0) && IsOpen()) {
+        const ssize_t nRead = pread(pFile->GetFD(), buffer.data(), size_t(std::min<uint64_t>(nLengthBytes, nBufferSizeBytes)), off_t(nOffsetBytes));
+        if (nRead <= 0) {
+          if ((nRead < 0) && (errno == EINTR)) continue;
+          break;
+        }
+
+        Write(buffer.data(), size_t(nRead));
+        nOffsetBytes += nRead;
+        nLengthBytes -= nRead;
+      }
+    }
+    #endif // __LINUX__
+
+
     // ** cConnectedClient
 
     cConnectedClient::cConnectedClient(std::experimental::net::io_context& _socket) :
@@ -401,6 +483,30 @@ namespace spitfire
       socket.write_some(std::experimental::net::buffer(sData));
     }
 
+    #ifdef __LINUX__
+    void cConnectedClient::SendFile(std::shared_ptr<const cOpenFile> pFile, uint64_t nOffsetBytes, uint64_t nLengthBytes)
+    {
+      ASSERT(pFile != nullptr);
+
+      const int fdSocket = socket.native_handle();
+
+      off_t offset = off_t(nOffsetBytes);
+      while (nLengthBytes != 0) {
+        const ssize_t nSent = sendfile(fdSocket, pFile->GetFD(), &offset, size_t(std::min<uint64_t>(nLengthBytes, 0x40000000)));
+        if (nSent > 0) nLengthBytes -= nSent;
+        else if ((nSent < 0) && (errno == EINTR)) continue;
+        else if ((nSent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+          // The socket has been put in non-blocking mode so wait until it can take some more
+          pollfd fds;
+          fds.fd = fdSocket;
+          fds.events = POLLOUT;
+          fds.revents = 0;
+          if (poll(&fds, 1, 10000) <= 0) break;
+        } else break;
+      }
+    }
+    #endif
+
 
 
     // ** cTCPConnectionListener
@@ -612,5 +718,488 @@ namespace spitfire
 
       gLog<<"cServer::ThreadFunction returning"<<std::endl;
     }
+
+
+    #ifdef __LINUX__
+    // ** cEventLoopReactor
+    //
+    // One epoll set and the listening socket and connections that belong to it
+
+    class cEventLoopReactor : public util::cThread, public std::enable_shared_from_this<cEventLoopReactor>
+    {
+    public:
+      cEventLoopReactor(cEventLoopServer& server, int fdListen);
+      ~cEventLoopReactor();
+
+      void Stop();
+
+      bool IsReactorThread() const { return (std::this_thread::get_id() == idThread); }
+
+      void RequestFlush(std::shared_ptr<cEventLoopConnection> pConnection); // Called when a connection has something to send or wants to close
+
+    private:
+      virtual void ThreadFunction() override;
+
+      void Wake();
+      void FlushPending();
+
+      void AcceptConnections();
+      void OnReadable(std::shared_ptr<cEventLoopConnection> pConnection);
+      void Flush(cEventLoopConnection& connection);
+      void CloseConnection(std::shared_ptr<cEventLoopConnection> pConnection);
+      void CloseConnectionIfFinished(std::shared_ptr<cEventLoopConnection> pConnection);
+
+      util::cSignalObject soAction;
+
+      cEventLoopServer& server;
+
+      const int fdListen;
+      int fdEpoll;
+      int fdWake;
+
+      std::atomic<std::thread::id> idThread; // Set by the reactor thread when it starts, read from any thread
+
+      std::map<int, std::shared_ptr<cEventLoopConnection>> connections;
+
+      std::mutex mutexPending;
+      std::vector<std::shared_ptr<cEventLoopConnection>> pending;
+    };
+
+    cEventLoopReactor::cEventLoopReactor(cEventLoopServer& _server, int _fdListen) :
+      util::cThread(soAction, "cEventLoopReactor"),
+      soAction("cEventLoopReactor_soAction"),
+      server(_server),
+      fdListen(_fdListen),
+      fdEpoll(epoll_create1(EPOLL_CLOEXEC)),
+      fdWake(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = fdListen;
+      epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdListen, &event);
+
+      event.events = EPOLLIN;
+      event.data.fd = fdWake;
+      epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdWake, &event);
+    }
+
+    cEventLoopReactor::~cEventLoopReactor()
+    {
+      Stop();
+
+      close(fdWake);
+      close(fdEpoll);
+      close(fdListen);
+    }
+
+    void cEventLoopReactor::Stop()
+    {
+      StopThreadSoon();
+      Wake();
+      WaitToStop();
+    }
+
+    void cEventLoopReactor::Wake()
+    {
+      const uint64_t value = 1;
+      const ssize_t result = write(fdWake, &value, sizeof(value));
+      (void)result;
+    }
+
+    void cEventLoopReactor::RequestFlush(std::shared_ptr<cEventLoopConnection> pConnection)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutexPending);
+        pending.push_back(pConnection);
+      }
+
+      // If we are on the reactor thread then the pending connections are flushed at the end of this iteration anyway
+      if (!IsReactorThread()) Wake();
+    }
+
+    void cEventLoopReactor::FlushPending()
+    {
+      std::vector<std::shared_ptr<cEventLoopConnection>> flush;
+      {
+        std::lock_guard<std::mutex> lock(mutexPending);
+        flush.swap(pending);
+      }
+
+      for (auto& pConnection : flush) {
+        Flush(*pConnection);
+        CloseConnectionIfFinished(pConnection);
+      }
+    }
+
+    void cEventLoopReactor::AcceptConnections()
+    {
+      while (true) {
+        const int fd = accept4(fdListen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) break;
+
+        std::shared_ptr<cEventLoopConnection> pConnection = std::make_shared<cEventLoopConnection>(weak_from_this(), fd);
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+          pConnection->bIsClosed = true;
+          continue;
+        }
+
+        connections[fd] = pConnection;
+        server.nConnections++;
+
+        if (server.pConnectionHandler != nullptr) server.pConnectionHandler->OnConnected(server, *pConnection);
+
+        Flush(*pConnection);
+        CloseConnectionIfFinished(pConnection);
+      }
+    }
+
+    void cEventLoopReactor::OnReadable(std::shared_ptr<cEventLoopConnection> pConnection)
+    {
+      cEventLoopConnection& connection = *pConnection;
+
+      bool bIsPeerClosed = false;
+      bool bIsReceived = false;
+
+      char buffer[16 * 1024];
+      while (true) {
+        const ssize_t nRead = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (nRead > 0) {
+          connection.sReceived.append(buffer, nRead);
+          bIsReceived = true;
+          if (size_t(nRead) < sizeof(buffer)) break;
+        } else if (nRead == 0) {
+          bIsPeerClosed = true;
+          break;
+        } else {
+          if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) bIsPeerClosed = true;
+          break;
+        }
+      }
+
+      if (bIsReceived && !connection.bIsCloseRequested && (server.pConnectionHandler != nullptr)) server.pConnectionHandler->OnDataReceived(server, connection);
+
+      if (bIsPeerClosed) {
+        CloseConnection(pConnection);
+        return;
+      }
+
+      Flush(connection);
+      CloseConnectionIfFinished(pConnection);
+    }
+
+    void cEventLoopReactor::Flush(cEventLoopConnection& connection)
+    {
+      if (connection.bIsClosed) return;
+
+      std::lock_guard<std::mutex> lock(connection.mutexSend);
+
+      std::deque<cEventLoopConnection::cSendChunk>& sendQueue = connection.sendQueue;
+      while (!sendQueue.empty()) {
+        cEventLoopConnection::cSendChunk& chunk = sendQueue.front();
+
+        ssize_t nSent = 0;
+        if (chunk.pFile == nullptr) {
+          if (chunk.nOffsetBytes == chunk.sData.length()) {
+            sendQueue.pop_front();
+            continue;
+          }
+
+          nSent = send(connection.fd, chunk.sData.data() + chunk.nOffsetBytes, chunk.sData.length() - chunk.nOffsetBytes, MSG_NOSIGNAL);
+        } else {
+          if (chunk.nOffsetBytes == chunk.nEndBytes) {
+            sendQueue.pop_front();
+            continue;
+          }
+
+          // The file goes straight from the page cache to the socket
+          off_t offset = off_t(chunk.nOffsetBytes);
+          nSent = sendfile(connection.fd, chunk.pFile->GetFD(), &offset, size_t(std::min<uint64_t>(chunk.nEndBytes - chunk.nOffsetBytes, 0x40000000)));
+        }
+
+        if (nSent > 0) chunk.nOffsetBytes += nSent;
+        else if ((nSent < 0) && (errno == EINTR)) continue;
+        else if ((nSent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) break;
+        else {
+          // The peer has gone away or the file was truncated, there is no point trying to send the rest
+          sendQueue.clear();
+          connection.bIsCloseRequested = true;
+          break;
+        }
+      }
+
+      const bool bIsFinished = sendQueue.empty();
+
+      // Only ask for writable events while we have something left to send
+      if (bIsFinished == connection.bIsWaitingForWritable) {
+        connection.bIsWaitingForWritable = !bIsFinished;
+
+        epoll_event event;
+        event.events = connection.bIsWaitingForWritable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = connection.fd;
+        epoll_ctl(fdEpoll, EPOLL_CTL_MOD, connection.fd, &event);
+      }
+    }
+
+    void cEventLoopReactor::CloseConnectionIfFinished(std::shared_ptr<cEventLoopConnection> pConnection)
+    {
+      if (!pConnection->bIsCloseRequested || pConnection->bIsClosed) return;
+
+      bool bIsSendBufferEmpty = false;
+      {
+        std::lock_guard<std::mutex> lock(pConnection->mutexSend);
+        bIsSendBufferEmpty = pConnection->sendQueue.empty();
+      }
+
+      if (bIsSendBufferEmpty) CloseConnection(pConnection);
+    }
+
+    void cEventLoopReactor::CloseConnection(std::shared_ptr<cEventLoopConnection> pConnection)
+    {
+      if (pConnection->bIsClosed) return;
+
+      pConnection->bIsCloseRequested = true;
+      pConnection->bIsClosed = true;
+
+      epoll_ctl(fdEpoll, EPOLL_CTL_DEL, pConnection->fd, nullptr);
+      shutdown(pConnection->fd, SHUT_RDWR);
+      connections.erase(pConnection->fd);
+      server.nConnections--;
+
+      if (server.pConnectionHandler != nullptr) server.pConnectionHandler->OnDisconnected(server, *pConnection);
+
+      // The socket itself is closed when the last reference to the connection goes away so that a handler that still
+      // holds a reference can never write to a file descriptor that has been reused for another connection
+    }
+
+    void cEventLoopReactor::ThreadFunction()
+    {
+      idThread = std::this_thread::get_id();
+
+      const size_t nMaxEvents = 256;
+      epoll_event events[nMaxEvents];
+
+      while (!IsToStop()) {
+        const int nEvents = epoll_wait(fdEpoll, events, nMaxEvents, 1000);
+        for (int i = 0; i < nEvents; i++) {
+          const int fd = events[i].data.fd;
+          if (fd == fdListen) AcceptConnections();
+          else if (fd == fdWake) {
+            uint64_t value = 0;
+            const ssize_t result = read(fdWake, &value, sizeof(value));
+            (void)result;
+          } else {
+            std::map<int, std::shared_ptr<cEventLoopConnection>>::iterator iter = connections.find(fd);
+            if (iter == connections.end()) continue;
+
+            // Keep the connection alive while we are using it even if it is closed in a callback
+            std::shared_ptr<cEventLoopConnection> pConnection = iter->second;
+
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) OnReadable(pConnection);
+            else if ((events[i].events & EPOLLOUT) != 0) {
+              Flush(*pConnection);
+              CloseConnectionIfFinished(pConnection);
+            }
+          }
+        }
+
+        // Send anything that was written from another thread or to another connection during a callback
+        FlushPending();
+      }
+
+      // Close all of our connections
+      while (!connections.empty()) CloseConnection(connections.begin()->second);
+
+      {
+        std::lock_guard<std::mutex> lock(mutexPending);
+        pending.clear();
+      }
+    }
+
+
+    // ** cEventLoopConnection
+
+    cEventLoopConnection::cEventLoopConnection(std::weak_ptr<cEventLoopReactor> _pReactor, int _fd) :
+      pReactor(_pReactor),
+      fd(_fd),
+      bIsWaitingForWritable(false),
+      bIsCloseRequested(false),
+      bIsClosed(false),
+      bIsCloseAfterResponse(false)
+    {
+    }
+
+    cEventLoopConnection::~cEventLoopConnection()
+    {
+      close(fd);
+    }
+
+    void cEventLoopConnection::Close()
+    {
+      if (bIsCloseRequested.exchange(true)) return;
+
+      // Let the reactor close the socket once it has sent everything
+      RequestFlush();
+    }
+
+    bool cEventLoopConnection::IsOpen()
+    {
+      return !bIsCloseRequested && !bIsClosed;
+    }
+
+    void cEventLoopConnection::SetNoDelay()
+    {
+      const int value = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+    }
+
+    void cEventLoopConnection::Write(const uint8_t* pBuffer, size_t nBufferSize)
+    {
+      if (bIsClosed) return;
+
+      {
+        std::lock_guard<std::mutex> lock(mutexSend);
+        if (sendQueue.empty() || (sendQueue.back().pFile != nullptr)) sendQueue.push_back({ std::string(), std::shared_ptr<const cOpenFile>(), 0, 0 });
+        sendQueue.back().sData.append(reinterpret_cast<const char*>(pBuffer), nBufferSize);
+      }
+
+      // Tell the reactor that there is something to send
+      RequestFlush();
+    }
+
+    void cEventLoopConnection::Write(const std::string& sData)
+    {
+      Write(reinterpret_cast<const uint8_t*>(sData.data()), sData.length());
+    }
+
+    void cEventLoopConnection::SendFile(std::shared_ptr<const cOpenFile> pFile, uint64_t nOffsetBytes, uint64_t nLengthBytes)
+    {
+      ASSERT(pFile != nullptr);
+      if (bIsClosed || (nLengthBytes == 0)) return;
+
+      {
+        std::lock_guard<std::mutex> lock(mutexSend);
+        sendQueue.push_back({ std::string(), pFile, nOffsetBytes, nOffsetBytes + nLengthBytes });
+      }
+
+      RequestFlush();
+    }
+
+    void cEventLoopConnection::SetCloseAfterResponse()
+    {
+      bIsCloseAfterResponse = true;
+    }
+
+    void cEventLoopConnection::RequestFlush()
+    {
+      // If the reactor has already gone then it has already shut the connection down, there is nothing left to send it on
+      std::shared_ptr<cEventLoopReactor> pLockedReactor = pReactor.lock();
+      if (pLockedReactor == nullptr) {
+        bIsClosed = true;
+        return;
+      }
+
+      pLockedReactor->RequestFlush(shared_from_this());
+    }
+
+    void cEventLoopConnection::ConsumeReceivedData(size_t nBytes)
+    {
+      ASSERT(nBytes <= sReceived.length());
+      sReceived.erase(0, nBytes);
+    }
+
+
+    // ** cEventLoopServer
+
+    namespace
+    {
+      int CreateListeningSocket(uint16_t uiPort)
+      {
+        const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+
+        const int value = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(uiPort);
+
+        if ((bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) || (listen(fd, SOMAXCONN) != 0)) {
+          close(fd);
+          return -1;
+        }
+
+        return fd;
+      }
+
+      uint16_t GetListeningPort(int fd)
+      {
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) return 0;
+
+        return ntohs(address.sin_port);
+      }
+    }
+
+    cEventLoopServer::cEventLoopServer() :
+      uiPort(0),
+      nConnections(0),
+      pConnectionHandler(nullptr)
+    {
+    }
+
+    cEventLoopServer::~cEventLoopServer()
+    {
+      Stop();
+    }
+
+    void cEventLoopServer::SetConnectionHandler(cEventLoopConnectionHandler& connectionHandler)
+    {
+      pConnectionHandler = &connectionHandler;
+    }
+
+    bool cEventLoopServer::Start(uint16_t _uiPort, size_t nReactors)
+    {
+      ASSERT(reactors.empty());
+
+      if (nReactors == 0) nReactors = util::GetRecommendedConcurrentThreadCount();
+
+      uiPort = _uiPort;
+
+      for (size_t i = 0; i < nReactors; i++) {
+        const int fdListen = CreateListeningSocket(uiPort);
+        if (fdListen < 0) {
+          gLog<<"cEventLoopServer::Start Could not listen on port "<<uiPort<<std::endl;
+          Stop();
+          return false;
+        }
+
+        // If we were asked for any port then the rest of the reactors have to share the one that the first reactor got
+        if (uiPort == 0) uiPort = GetListeningPort(fdListen);
+
+        reactors.push_back(std::make_shared<cEventLoopReactor>(*this, fdListen));
+      }
+
+      for (auto& pReactor : reactors) pReactor->Run();
+
+      return true;
+    }
+
+    void cEventLoopServer::Stop()
+    {
+      for (auto& pReactor : reactors) pReactor->Stop();
+
+      // Connections only hold weak references to the reactors so they can't send on a reactor that has been destroyed
+      reactors.clear();
+    }
+    #endif // __LINUX__
   }
 }
@@ -12,9 +12,6 @@
 #include <map>
 #include <sstream>
 
-// Boost headers
-#include <boost/asio.hpp>
-
 // Other libraries
 #ifdef WIN32
 #include <windows.h>
@@ -23,7 +20,7 @@
 // Spitfire headers
 #include <spitfire/spitfire.h>
 
-#include <spitfire/util/cString.h>
+#include <spitfire/util/string.h>
 #include <spitfire/util/log.h>
 #include <spitfire/util/thread.h>
 
@@ -32,9 +29,6 @@
 #include <spitfire/communication/network.h>
 #include <spitfire/communication/uri.h>
 
-// Breathe headers
-#include <breathe/breathe.h>
-
 namespace spitfire
 {
   namespace network
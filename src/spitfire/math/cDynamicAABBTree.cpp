@@ -0,0 +1,459 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/math/math.h>
+#include <spitfire/math/cDynamicAABBTree.h>
+
+namespace spitfire
+{
+  namespace math
+  {
+    namespace
+    {
+      cAABB3 Combine(const cAABB3& a, const cAABB3& b)
+      {
+        cAABB3 result;
+        result.SetMinMax(
+          cVec3(std::min(a.cornerMin.x, b.cornerMin.x), std::min(a.cornerMin.y, b.cornerMin.y), std::min(a.cornerMin.z, b.cornerMin.z)),
+          cVec3(std::max(a.cornerMax.x, b.cornerMax.x), std::max(a.cornerMax.y, b.cornerMax.y), std::max(a.cornerMax.z, b.cornerMax.z))
+        );
+        return result;
+      }
+
+      bool Contains(const cAABB3& outer, const cAABB3& inner)
+      {
+        return (outer.cornerMin.x <= inner.cornerMin.x) && (outer.cornerMin.y <= inner.cornerMin.y) && (outer.cornerMin.z <= inner.cornerMin.z) &&
+          (inner.cornerMax.x <= outer.cornerMax.x) && (inner.cornerMax.y <= outer.cornerMax.y) && (inner.cornerMax.z <= outer.cornerMax.z);
+      }
+
+      float GetSurfaceArea(const cAABB3& box)
+      {
+        const float x = box.cornerMax.x - box.cornerMin.x;
+        const float y = box.cornerMax.y - box.cornerMin.y;
+        const float z = box.cornerMax.z - box.cornerMin.z;
+        return 2.0f * ((x * y) + (y * z) + (z * x));
+      }
+
+      // Leaves waiting to be tested together
+      class cLeafBatch
+      {
+      public:
+        static const size_t SIZE = 16;
+
+        cLeafBatch() : n(0) {}
+
+        void Add(const cAABB3& box, void* pUserData, const cFrustumCuller& culler, std::vector<void*>& visible);
+        void Flush(const cFrustumCuller& culler, std::vector<void*>& visible);
+
+      private:
+        size_t n;
+        float minX[SIZE];
+        float minY[SIZE];
+        float minZ[SIZE];
+        float maxX[SIZE];
+        float maxY[SIZE];
+        float maxZ[SIZE];
+        void* userData[SIZE];
+      };
+
+      void cLeafBatch::Add(const cAABB3& box, void* pUserData, const cFrustumCuller& culler, std::vector<void*>& visible)
+      {
+        minX[n] = box.cornerMin.x;
+        minY[n] = box.cornerMin.y;
+        minZ[n] = box.cornerMin.z;
+        maxX[n] = box.cornerMax.x;
+        maxY[n] = box.cornerMax.y;
+        maxZ[n] = box.cornerMax.z;
+        userData[n] = pUserData;
+        n++;
+
+        if (n == SIZE) Flush(culler, visible);
+      }
+
+      void cLeafBatch::Flush(const cFrustumCuller& culler, std::vector<void*>& visible)
+      {
+        uint8_t results[SIZE];
+        culler.CullAABBs(minX, minY, minZ, maxX, maxY, maxZ, n, results);
+        for (size_t i = 0; i < n; i++) {
+          if (results[i] != 0) visible.push_back(userData[i]);
+        }
+
+        n = 0;
+      }
+    }
+
+    cDynamicAABBTree::cDynamicAABBTree() :
+      root(NULL_PROXY),
+      freeList(NULL_PROXY),
+      nProxies(0),
+      fMargin(0.1f)
+    {
+    }
+
+    void cDynamicAABBTree::Clear()
+    {
+      nodes.clear();
+      root = NULL_PROXY;
+      freeList = NULL_PROXY;
+      nProxies = 0;
+    }
+
+    size_t cDynamicAABBTree::AllocateNode()
+    {
+      if (freeList == NULL_PROXY) {
+        nodes.push_back(cNode());
+        freeList = nodes.size() - 1;
+        nodes[freeList].parent = NULL_PROXY;
+      }
+
+      const size_t node = freeList;
+      freeList = nodes[node].parent;
+
+      cNode& result = nodes[node];
+      result.pUserData = nullptr;
+      result.parent = NULL_PROXY;
+      result.child1 = NULL_PROXY;
+      result.child2 = NULL_PROXY;
+      result.height = 0;
+      return node;
+    }
+
+    void cDynamicAABBTree::FreeNode(size_t node)
+    {
+      ASSERT(node < nodes.size());
+      nodes[node].parent = freeList;
+      nodes[node].height = -1;
+      freeList = node;
+    }
+
+    size_t cDynamicAABBTree::CreateProxy(const cAABB3& box, void* pUserData)
+    {
+      const size_t proxy = AllocateNode();
+      const cVec3 margin(fMargin, fMargin, fMargin);
+      nodes[proxy].box.SetMinMax(box.cornerMin - margin, box.cornerMax + margin);
+      nodes[proxy].pUserData = pUserData;
+
+      InsertLeaf(proxy);
+      nProxies++;
+
+      return proxy;
+    }
+
+    void cDynamicAABBTree::DestroyProxy(size_t proxy)
+    {
+      ASSERT(proxy < nodes.size());
+      ASSERT(nodes[proxy].IsLeaf());
+
+      RemoveLeaf(proxy);
+      FreeNode(proxy);
+      nProxies--;
+    }
+
+    bool cDynamicAABBTree::MoveProxy(size_t proxy, const cAABB3& box)
+    {
+      ASSERT(proxy < nodes.size());
+      ASSERT(nodes[proxy].IsLeaf());
+
+      if (Contains(nodes[proxy].box, box)) return false;
+
+      RemoveLeaf(proxy);
+
+      const cVec3 margin(fMargin, fMargin, fMargin);
+      nodes[proxy].box.SetMinMax(box.cornerMin - margin, box.cornerMax + margin);
+
+      InsertLeaf(proxy);
+      return true;
+    }
+
+    void* cDynamicAABBTree::GetUserData(size_t proxy) const
+    {
+      ASSERT(proxy < nodes.size());
+      return nodes[proxy].pUserData;
+    }
+
+    const cAABB3& cDynamicAABBTree::GetFatAABB(size_t proxy) const
+    {
+      ASSERT(proxy < nodes.size());
+      return nodes[proxy].box;
+    }
+
+    size_t cDynamicAABBTree::GetHeight() const
+    {
+      return (root == NULL_PROXY) ? 0 : size_t(nodes[root].height);
+    }
+
+    void cDynamicAABBTree::InsertLeaf(size_t leaf)
+    {
+      if (root == NULL_PROXY) {
+        root = leaf;
+        nodes[root].parent = NULL_PROXY;
+        return;
+      }
+
+      // Find the best sibling, going down the tree while it is cheaper to push the leaf into a child than to pair it with this node
+      const cAABB3 leafBox = nodes[leaf].box;
+      size_t index = root;
+      while (!nodes[index].IsLeaf()) {
+        const size_t child1 = nodes[index].child1;
+        const size_t child2 = nodes[index].child2;
+
+        const float fArea = GetSurfaceArea(nodes[index].box);
+        const float fCombinedArea = GetSurfaceArea(Combine(nodes[index].box, leafBox));
+
+        // The cost of making a new parent for this node and the leaf
+        const float fCost = 2.0f * fCombinedArea;
+
+        // The minimum cost of pushing the leaf further down the tree
+        const float fInheritanceCost = 2.0f * (fCombinedArea - fArea);
+
+        float fCost1 = GetSurfaceArea(Combine(leafBox, nodes[child1].box)) + fInheritanceCost;
+        if (!nodes[child1].IsLeaf()) fCost1 -= GetSurfaceArea(nodes[child1].box);
+
+        float fCost2 = GetSurfaceArea(Combine(leafBox, nodes[child2].box)) + fInheritanceCost;
+        if (!nodes[child2].IsLeaf()) fCost2 -= GetSurfaceArea(nodes[child2].box);
+
+        if ((fCost < fCost1) && (fCost < fCost2)) break;
+
+        index = (fCost1 < fCost2) ? child1 : child2;
+      }
+
+      const size_t sibling = index;
+
+      // Create a new parent for the sibling and the leaf
+      const size_t oldParent = nodes[sibling].parent;
+      const size_t newParent = AllocateNode();
+      nodes[newParent].parent = oldParent;
+      nodes[newParent].box = Combine(leafBox, nodes[sibling].box);
+      nodes[newParent].height = nodes[sibling].height + 1;
+      nodes[newParent].child1 = sibling;
+      nodes[newParent].child2 = leaf;
+      nodes[sibling].parent = newParent;
+      nodes[leaf].parent = newParent;
+
+      if (oldParent == NULL_PROXY) root = newParent;
+      else if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+      else nodes[oldParent].child2 = newParent;
+
+      // Walk back up fixing the heights and boxes
+      index = nodes[leaf].parent;
+      while (index != NULL_PROXY) {
+        index = Balance(index);
+
+        const size_t child1 = nodes[index].child1;
+        const size_t child2 = nodes[index].child2;
+        nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+        nodes[index].box = Combine(nodes[child1].box, nodes[child2].box);
+
+        index = nodes[index].parent;
+      }
+    }
+
+    void cDynamicAABBTree::RemoveLeaf(size_t leaf)
+    {
+      if (leaf == root) {
+        root = NULL_PROXY;
+        return;
+      }
+
+      const size_t parent = nodes[leaf].parent;
+      const size_t grandParent = nodes[parent].parent;
+      const size_t sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+      if (grandParent == NULL_PROXY) {
+        root = sibling;
+        nodes[sibling].parent = NULL_PROXY;
+        FreeNode(parent);
+        return;
+      }
+
+      // Replace the parent with the sibling
+      if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+      else nodes[grandParent].child2 = sibling;
+      nodes[sibling].parent = grandParent;
+      FreeNode(parent);
+
+      size_t index = grandParent;
+      while (index != NULL_PROXY) {
+        index = Balance(index);
+
+        const size_t child1 = nodes[index].child1;
+        const size_t child2 = nodes[index].child2;
+        nodes[index].box = Combine(nodes[child1].box, nodes[child2].box);
+        nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+
+        index = nodes[index].parent;
+      }
+    }
+
+    // If one side of a is more than one level taller than the other, rotate the taller child up to replace a
+    size_t cDynamicAABBTree::Balance(size_t a)
+    {
+      if (nodes[a].IsLeaf() || (nodes[a].height < 2)) return a;
+
+      const size_t b = nodes[a].child1;
+      const size_t c = nodes[a].child2;
+      const int balance = nodes[c].height - nodes[b].height;
+
+      if (balance > 1) {
+        // Rotate c up
+        const size_t f = nodes[c].child1;
+        const size_t g = nodes[c].child2;
+
+        nodes[c].child1 = a;
+        nodes[c].parent = nodes[a].parent;
+        nodes[a].parent = c;
+
+        if (nodes[c].parent == NULL_PROXY) root = c;
+        else if (nodes[nodes[c].parent].child1 == a) nodes[nodes[c].parent].child1 = c;
+        else nodes[nodes[c].parent].child2 = c;
+
+        // Keep the taller of c's children and give the other one to a
+        const size_t keep = (nodes[f].height > nodes[g].height) ? f : g;
+        const size_t give = (keep == f) ? g : f;
+        nodes[c].child2 = keep;
+        nodes[a].child2 = give;
+        nodes[give].parent = a;
+        nodes[a].box = Combine(nodes[b].box, nodes[give].box);
+        nodes[c].box = Combine(nodes[a].box, nodes[keep].box);
+        nodes[a].height = 1 + std::max(nodes[b].height, nodes[give].height);
+        nodes[c].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+
+        return c;
+      }
+
+      if (balance < -1) {
+        // Rotate b up
+        const size_t d = nodes[b].child1;
+        const size_t e = nodes[b].child2;
+
+        nodes[b].child1 = a;
+        nodes[b].parent = nodes[a].parent;
+        nodes[a].parent = b;
+
+        if (nodes[b].parent == NULL_PROXY) root = b;
+        else if (nodes[nodes[b].parent].child1 == a) nodes[nodes[b].parent].child1 = b;
+        else nodes[nodes[b].parent].child2 = b;
+
+        const size_t keep = (nodes[d].height > nodes[e].height) ? d : e;
+        const size_t give = (keep == d) ? e : d;
+        nodes[b].child2 = keep;
+        nodes[a].child1 = give;
+        nodes[give].parent = a;
+        nodes[a].box = Combine(nodes[c].box, nodes[give].box);
+        nodes[b].box = Combine(nodes[a].box, nodes[keep].box);
+        nodes[a].height = 1 + std::max(nodes[c].height, nodes[give].height);
+        nodes[b].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+
+        return b;
+      }
+
+      return a;
+    }
+
+    void cDynamicAABBTree::AddSubtree(size_t node, std::vector<void*>& visible) const
+    {
+      if (nodes[node].IsLeaf()) {
+        visible.push_back(nodes[node].pUserData);
+        return;
+      }
+
+      AddSubtree(nodes[node].child1, visible);
+      AddSubtree(nodes[node].child2, visible);
+    }
+
+    void cDynamicAABBTree::Cull(const cFrustumCuller& culler, std::vector<void*>& visible) const
+    {
+      if (root == NULL_PROXY) return;
+
+      // Each entry is a node and the planes that its parent still crosses
+      std::vector<std::pair<size_t, uint32_t>> stack;
+      stack.reserve(2 * (GetHeight() + 1));
+      stack.push_back(std::make_pair(root, FRUSTUM_PLANES_ALL));
+
+      cLeafBatch batch;
+
+      while (!stack.empty()) {
+        const size_t node = stack.back().first;
+        const uint32_t planeMask = stack.back().second;
+        stack.pop_back();
+
+        if (nodes[node].IsLeaf()) {
+          batch.Add(nodes[node].box, nodes[node].pUserData, culler, visible);
+          continue;
+        }
+
+        uint32_t childPlaneMask = 0;
+        const FRUSTUM_CLASSIFICATION classification = culler.ClassifyAABB(nodes[node].box, planeMask, childPlaneMask);
+        if (classification == FRUSTUM_CLASSIFICATION::OUTSIDE) continue;
+
+        if (classification == FRUSTUM_CLASSIFICATION::INSIDE) {
+          AddSubtree(node, visible);
+          continue;
+        }
+
+        stack.push_back(std::make_pair(nodes[node].child1, childPlaneMask));
+        stack.push_back(std::make_pair(nodes[node].child2, childPlaneMask));
+      }
+
+      batch.Flush(culler, visible);
+    }
+
+    bool cDynamicAABBTree::IsValid(size_t node, size_t& nLeaves) const
+    {
+      const cNode& current = nodes[node];
+      if (current.height < 0) return false;
+
+      if (current.IsLeaf()) {
+        nLeaves++;
+        return (current.height == 0) && (current.child2 == NULL_PROXY);
+      }
+
+      const size_t child1 = current.child1;
+      const size_t child2 = current.child2;
+      if ((child1 >= nodes.size()) || (child2 >= nodes.size())) return false;
+      if ((nodes[child1].parent != node) || (nodes[child2].parent != node)) return false;
+      if (current.height != (1 + std::max(nodes[child1].height, nodes[child2].height))) return false;
+      if (!Contains(current.box, nodes[child1].box) || !Contains(current.box, nodes[child2].box)) return false;
+
+      return IsValid(child1, nLeaves) && IsValid(child2, nLeaves);
+    }
+
+    bool cDynamicAABBTree::IsValid() const
+    {
+      if (root == NULL_PROXY) return (nProxies == 0);
+      if (nodes[root].parent != NULL_PROXY) return false;
+
+      size_t nLeaves = 0;
+      return IsValid(root, nLeaves) && (nLeaves == nProxies);
+    }
+
+
+    cAABB3 GetTransformedAABB(const cAABB3& box, const cMat4& matrix)
+    {
+      const cVec3 centre = matrix.GetRotatedVec3(box.GetCentre()) + matrix.GetTranslation();
+
+      // Each axis of the box is rotated and the absolute values are summed
+      const cVec3 half = 0.5f * (box.cornerMax - box.cornerMin);
+      const cVec3 x = matrix.GetRotatedVec3(cVec3(half.x, 0.0f, 0.0f));
+      const cVec3 y = matrix.GetRotatedVec3(cVec3(0.0f, half.y, 0.0f));
+      const cVec3 z = matrix.GetRotatedVec3(cVec3(0.0f, 0.0f, half.z));
+      const cVec3 extents(
+        std::fabs(x.x) + std::fabs(y.x) + std::fabs(z.x),
+        std::fabs(x.y) + std::fabs(y.y) + std::fabs(z.y),
+        std::fabs(x.z) + std::fabs(y.z) + std::fabs(z.z)
+      );
+
+      cAABB3 result;
+      result.SetMinMax(centre - extents, centre + extents);
+      return result;
+    }
+  }
+}
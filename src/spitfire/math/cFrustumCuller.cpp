@@ -0,0 +1,229 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/math/math.h>
+#include <spitfire/math/cFrustumCuller.h>
+
+namespace spitfire
+{
+  namespace math
+  {
+    cFrustumCuller::cFrustumCuller()
+    {
+      for (size_t i = 0; i < PADDED_PLANES; i++) {
+        normalX[i] = 0.0f;
+        normalY[i] = 0.0f;
+        normalZ[i] = 0.0f;
+        intercept[i] = 1.0f;
+      }
+    }
+
+    void cFrustumCuller::SetFromViewProjectionMatrix(const cMat4& m)
+    {
+      // Each plane is the last row of the matrix plus or minus one of the other rows
+      const float signs[PLANES] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+      for (size_t i = 0; i < PLANES; i++) {
+        const size_t row = i / 2;
+        const float fSign = signs[i];
+        const float a = m[3] + (fSign * m[row]);
+        const float b = m[7] + (fSign * m[4 + row]);
+        const float c = m[11] + (fSign * m[8 + row]);
+        const float d = m[15] + (fSign * m[12 + row]);
+
+        const float fLength = std::sqrt((a * a) + (b * b) + (c * c));
+        ASSERT(fLength > 0.0f);
+        normalX[i] = a / fLength;
+        normalY[i] = b / fLength;
+        normalZ[i] = c / fLength;
+        intercept[i] = d / fLength;
+      }
+    }
+
+    FRUSTUM_CLASSIFICATION cFrustumCuller::ClassifyAABB(const cAABB3& box, uint32_t planeMask, uint32_t& outPlaneMask) const
+    {
+      const float cx = 0.5f * (box.cornerMin.x + box.cornerMax.x);
+      const float cy = 0.5f * (box.cornerMin.y + box.cornerMax.y);
+      const float cz = 0.5f * (box.cornerMin.z + box.cornerMax.z);
+      const float ex = 0.5f * (box.cornerMax.x - box.cornerMin.x);
+      const float ey = 0.5f * (box.cornerMax.y - box.cornerMin.y);
+      const float ez = 0.5f * (box.cornerMax.z - box.cornerMin.z);
+
+      uint32_t outside = 0;
+      uint32_t crossing = 0;
+
+#if defined(__SSE2__)
+      // 4 planes at a time, the distance from the centre and the projected radius of the box onto each normal
+      const __m128 signMask = _mm_set1_ps(-0.0f);
+      const __m128 x = _mm_set1_ps(cx);
+      const __m128 y = _mm_set1_ps(cy);
+      const __m128 z = _mm_set1_ps(cz);
+      const __m128 extentX = _mm_set1_ps(ex);
+      const __m128 extentY = _mm_set1_ps(ey);
+      const __m128 extentZ = _mm_set1_ps(ez);
+      for (size_t i = 0; i < PADDED_PLANES; i += 4) {
+        const __m128 nx = _mm_load_ps(&normalX[i]);
+        const __m128 ny = _mm_load_ps(&normalY[i]);
+        const __m128 nz = _mm_load_ps(&normalZ[i]);
+        const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_add_ps(_mm_mul_ps(nz, z), _mm_load_ps(&intercept[i])));
+        const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), extentX), _mm_mul_ps(_mm_andnot_ps(signMask, ny), extentY)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), extentZ));
+        outside |= uint32_t(_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()))) << i;
+        crossing |= uint32_t(_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(d, r), _mm_setzero_ps()))) << i;
+      }
+#else
+      for (size_t i = 0; i < PLANES; i++) {
+        const float d = ((normalX[i] * cx) + (normalY[i] * cy)) + ((normalZ[i] * cz) + intercept[i]);
+        const float r = (std::fabs(normalX[i]) * ex) + (std::fabs(normalY[i]) * ey) + (std::fabs(normalZ[i]) * ez);
+        if ((d + r) < 0.0f) outside |= (1 << i);
+        if ((d - r) < 0.0f) crossing |= (1 << i);
+      }
+#endif
+
+      if ((outside & planeMask) != 0) {
+        outPlaneMask = 0;
+        return FRUSTUM_CLASSIFICATION::OUTSIDE;
+      }
+
+      outPlaneMask = (crossing & planeMask);
+      return (outPlaneMask == 0) ? FRUSTUM_CLASSIFICATION::INSIDE : FRUSTUM_CLASSIFICATION::INTERSECTS;
+    }
+
+    bool cFrustumCuller::IsAABBVisible(const cAABB3& box) const
+    {
+      uint32_t planeMask = 0;
+      return (ClassifyAABB(box, FRUSTUM_PLANES_ALL, planeMask) != FRUSTUM_CLASSIFICATION::OUTSIDE);
+    }
+
+    bool cFrustumCuller::IsSphereVisible(const cVec3& position, float fRadius) const
+    {
+      for (size_t i = 0; i < PLANES; i++) {
+        // Grouped the same as the batch version so that they agree exactly
+        const float d = ((normalX[i] * position.x) + (normalY[i] * position.y)) + ((normalZ[i] * position.z) + intercept[i]);
+        if (!(d >= -fRadius)) return false;
+      }
+
+      return true;
+    }
+
+    void cFrustumCuller::CullSpheres(const float* pX, const float* pY, const float* pZ, const float* pRadius, size_t n, uint8_t* pVisible) const
+    {
+      size_t i = 0;
+
+#if defined(__AVX__)
+      for (; (i + 8) <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(pX + i);
+        const __m256 y = _mm256_loadu_ps(pY + i);
+        const __m256 z = _mm256_loadu_ps(pZ + i);
+        const __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(pRadius + i));
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t p = 0; p < PLANES; p++) {
+          const __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(normalX[p]), x), _mm256_mul_ps(_mm256_set1_ps(normalY[p]), y)),
+            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(normalZ[p]), z), _mm256_set1_ps(intercept[p])));
+          visible = _mm256_and_ps(visible, _mm256_cmp_ps(d, negativeRadius, _CMP_GE_OQ));
+        }
+        const int mask = _mm256_movemask_ps(visible);
+        for (size_t j = 0; j < 8; j++) pVisible[i + j] = uint8_t((mask >> j) & 1);
+      }
+#endif
+
+#if defined(__SSE2__)
+      for (; (i + 4) <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(pX + i);
+        const __m128 y = _mm_loadu_ps(pY + i);
+        const __m128 z = _mm_loadu_ps(pZ + i);
+        const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(pRadius + i));
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t p = 0; p < PLANES; p++) {
+          const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normalX[p]), x), _mm_mul_ps(_mm_set1_ps(normalY[p]), y)),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(normalZ[p]), z), _mm_set1_ps(intercept[p])));
+          visible = _mm_and_ps(visible, _mm_cmpge_ps(d, negativeRadius));
+        }
+        const int mask = _mm_movemask_ps(visible);
+        for (size_t j = 0; j < 4; j++) pVisible[i + j] = uint8_t((mask >> j) & 1);
+      }
+#endif
+
+      for (; i < n; i++) pVisible[i] = IsSphereVisible(cVec3(pX[i], pY[i], pZ[i]), pRadius[i]) ? 1 : 0;
+    }
+
+    void cFrustumCuller::CullAABBs(const float* pMinX, const float* pMinY, const float* pMinZ, const float* pMaxX, const float* pMaxY, const float* pMaxZ, size_t n, uint8_t* pVisible) const
+    {
+      size_t i = 0;
+
+#if defined(__AVX__)
+      for (; (i + 8) <= n; i += 8) {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        const __m256 minX = _mm256_loadu_ps(pMinX + i);
+        const __m256 minY = _mm256_loadu_ps(pMinY + i);
+        const __m256 minZ = _mm256_loadu_ps(pMinZ + i);
+        const __m256 maxX = _mm256_loadu_ps(pMaxX + i);
+        const __m256 maxY = _mm256_loadu_ps(pMaxY + i);
+        const __m256 maxZ = _mm256_loadu_ps(pMaxZ + i);
+        const __m256 x = _mm256_mul_ps(_mm256_add_ps(minX, maxX), half);
+        const __m256 y = _mm256_mul_ps(_mm256_add_ps(minY, maxY), half);
+        const __m256 z = _mm256_mul_ps(_mm256_add_ps(minZ, maxZ), half);
+        const __m256 extentX = _mm256_mul_ps(_mm256_sub_ps(maxX, minX), half);
+        const __m256 extentY = _mm256_mul_ps(_mm256_sub_ps(maxY, minY), half);
+        const __m256 extentZ = _mm256_mul_ps(_mm256_sub_ps(maxZ, minZ), half);
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t p = 0; p < PLANES; p++) {
+          const __m256 nx = _mm256_set1_ps(normalX[p]);
+          const __m256 ny = _mm256_set1_ps(normalY[p]);
+          const __m256 nz = _mm256_set1_ps(normalZ[p]);
+          const __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, x), _mm256_mul_ps(ny, y)), _mm256_add_ps(_mm256_mul_ps(nz, z), _mm256_set1_ps(intercept[p])));
+          const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), extentX), _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), extentY)), _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), extentZ));
+          visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        const int mask = _mm256_movemask_ps(visible);
+        for (size_t j = 0; j < 8; j++) pVisible[i + j] = uint8_t((mask >> j) & 1);
+      }
+#endif
+
+#if defined(__SSE2__)
+      for (; (i + 4) <= n; i += 4) {
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 minX = _mm_loadu_ps(pMinX + i);
+        const __m128 minY = _mm_loadu_ps(pMinY + i);
+        const __m128 minZ = _mm_loadu_ps(pMinZ + i);
+        const __m128 maxX = _mm_loadu_ps(pMaxX + i);
+        const __m128 maxY = _mm_loadu_ps(pMaxY + i);
+        const __m128 maxZ = _mm_loadu_ps(pMaxZ + i);
+        const __m128 x = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+        const __m128 y = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+        const __m128 z = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+        const __m128 extentX = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+        const __m128 extentY = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+        const __m128 extentZ = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t p = 0; p < PLANES; p++) {
+          const __m128 nx = _mm_set1_ps(normalX[p]);
+          const __m128 ny = _mm_set1_ps(normalY[p]);
+          const __m128 nz = _mm_set1_ps(normalZ[p]);
+          const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_add_ps(_mm_mul_ps(nz, z), _mm_set1_ps(intercept[p])));
+          const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), extentX), _mm_mul_ps(_mm_andnot_ps(signMask, ny), extentY)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), extentZ));
+          visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        const int mask = _mm_movemask_ps(visible);
+        for (size_t j = 0; j < 4; j++) pVisible[i + j] = uint8_t((mask >> j) & 1);
+      }
+#endif
+
+      for (; i < n; i++) {
+        cAABB3 box;
+        box.SetMinMax(cVec3(pMinX[i], pMinY[i], pMinZ[i]), cVec3(pMaxX[i], pMaxY[i], pMaxZ[i]));
+        pVisible[i] = IsAABBVisible(box) ? 1 : 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,223 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+#include <spitfire/math/math.h>
+#include <spitfire/math/cKDTree.h>
+
+namespace spitfire
+{
+  namespace math
+  {
+    namespace
+    {
+      // Closer first, then the lowest index so that ties always resolve the same way
+      inline bool IsCloser(float fDistanceSquared, size_t index, float fOtherDistanceSquared, size_t otherIndex)
+      {
+        return (fDistanceSquared < fOtherDistanceSquared) || ((fDistanceSquared == fOtherDistanceSquared) && (index < otherIndex));
+      }
+
+      struct cHeapCompare
+      {
+        bool operator()(const std::pair<float, size_t>& lhs, const std::pair<float, size_t>& rhs) const
+        {
+          return IsCloser(lhs.first, lhs.second, rhs.first, rhs.second);
+        }
+      };
+    }
+
+    cKDTree::cKDTree()
+    {
+    }
+
+    void cKDTree::Clear()
+    {
+      points.clear();
+      indices.clear();
+      axes.clear();
+    }
+
+    void cKDTree::Build(const std::vector<cVec3>& _points)
+    {
+      Build(_points.data(), _points.size());
+    }
+
+    void cKDTree::Build(const cVec3* pPoints, size_t nPoints)
+    {
+      ASSERT((pPoints != nullptr) || (nPoints == 0));
+
+      // Sort the points and their indices together, then split them apart again
+      std::vector<std::pair<cVec3, uint32_t>> entries(nPoints);
+      for (size_t i = 0; i < nPoints; i++) entries[i] = std::make_pair(pPoints[i], uint32_t(i));
+
+      axes.assign(nPoints, 0);
+
+      Build(entries, 0, nPoints);
+
+      points.resize(nPoints);
+      indices.resize(nPoints);
+      for (size_t i = 0; i < nPoints; i++) {
+        points[i] = entries[i].first;
+        indices[i] = entries[i].second;
+      }
+    }
+
+    void cKDTree::Build(std::vector<std::pair<cVec3, uint32_t>>& entries, size_t first, size_t last)
+    {
+      if ((last - first) <= LEAF_SIZE) return;
+
+      // Split on the widest axis of this range
+      cVec3 minimum = entries[first].first;
+      cVec3 maximum = entries[first].first;
+      for (size_t i = first + 1; i < last; i++) {
+        const cVec3& point = entries[i].first;
+        for (int axis = 0; axis < 3; axis++) {
+          minimum[axis] = std::min(minimum[axis], point[axis]);
+          maximum[axis] = std::max(maximum[axis], point[axis]);
+        }
+      }
+
+      const cVec3 extent = maximum - minimum;
+      int axis = 0;
+      if (extent.y > extent[axis]) axis = 1;
+      if (extent.z > extent[axis]) axis = 2;
+
+      // Everything before the median is not greater than it on this axis and everything after is not less
+      const size_t median = first + ((last - first) / 2);
+      std::nth_element(entries.begin() + first, entries.begin() + median, entries.begin() + last, [axis](const std::pair<cVec3, uint32_t>& lhs, const std::pair<cVec3, uint32_t>& rhs) {
+        return (lhs.first[axis] < rhs.first[axis]);
+      });
+
+      axes[median] = uint8_t(axis);
+
+      Build(entries, first, median);
+      Build(entries, median + 1, last);
+    }
+
+    size_t cKDTree::FindNearest(const cVec3& position) const
+    {
+      size_t nearest = NULL_INDEX;
+      float fNearestDistanceSquared = cINFINITY;
+      FindNearest(0, points.size(), position, nearest, fNearestDistanceSquared);
+      return nearest;
+    }
+
+    void cKDTree::FindNearest(size_t first, size_t last, const cVec3& position, size_t& nearest, float& fNearestDistanceSquared) const
+    {
+      if ((last - first) <= LEAF_SIZE) {
+        for (size_t i = first; i < last; i++) {
+          const float fDistanceSquared = (points[i] - position).GetSquaredLength();
+          if (IsCloser(fDistanceSquared, indices[i], fNearestDistanceSquared, nearest)) {
+            fNearestDistanceSquared = fDistanceSquared;
+            nearest = indices[i];
+          }
+        }
+        return;
+      }
+
+      const size_t median = first + ((last - first) / 2);
+      const int axis = axes[median];
+
+      const float fDistanceSquared = (points[median] - position).GetSquaredLength();
+      if (IsCloser(fDistanceSquared, indices[median], fNearestDistanceSquared, nearest)) {
+        fNearestDistanceSquared = fDistanceSquared;
+        nearest = indices[median];
+      }
+
+      // Search the side the position is on first, then the other side only if it could have anything closer
+      const float fDistanceToPlane = position[axis] - points[median][axis];
+      if (fDistanceToPlane < 0.0f) {
+        FindNearest(first, median, position, nearest, fNearestDistanceSquared);
+        if ((fDistanceToPlane * fDistanceToPlane) <= fNearestDistanceSquared) FindNearest(median + 1, last, position, nearest, fNearestDistanceSquared);
+      } else {
+        FindNearest(median + 1, last, position, nearest, fNearestDistanceSquared);
+        if ((fDistanceToPlane * fDistanceToPlane) <= fNearestDistanceSquared) FindNearest(first, median, position, nearest, fNearestDistanceSquared);
+      }
+    }
+
+    void cKDTree::FindKNearest(const cVec3& position, size_t k, std::vector<size_t>& result) const
+    {
+      result.clear();
+      if (k == 0) return;
+
+      // A max heap of the closest points found so far, the furthest is at the front
+      std::vector<std::pair<float, size_t>> heap;
+      heap.reserve(k + 1);
+      FindKNearest(0, points.size(), position, k, heap);
+
+      std::sort_heap(heap.begin(), heap.end(), cHeapCompare());
+      result.reserve(heap.size());
+      for (const std::pair<float, size_t>& entry : heap) result.push_back(entry.second);
+    }
+
+    void cKDTree::FindKNearest(size_t first, size_t last, const cVec3& position, size_t k, std::vector<std::pair<float, size_t>>& heap) const
+    {
+      auto Add = [&heap, k](float fDistanceSquared, size_t index)
+      {
+        if (heap.size() < k) {
+          heap.push_back(std::make_pair(fDistanceSquared, index));
+          std::push_heap(heap.begin(), heap.end(), cHeapCompare());
+        } else if (IsCloser(fDistanceSquared, index, heap.front().first, heap.front().second)) {
+          std::pop_heap(heap.begin(), heap.end(), cHeapCompare());
+          heap.back() = std::make_pair(fDistanceSquared, index);
+          std::push_heap(heap.begin(), heap.end(), cHeapCompare());
+        }
+      };
+
+      if ((last - first) <= LEAF_SIZE) {
+        for (size_t i = first; i < last; i++) Add((points[i] - position).GetSquaredLength(), indices[i]);
+        return;
+      }
+
+      const size_t median = first + ((last - first) / 2);
+      const int axis = axes[median];
+
+      Add((points[median] - position).GetSquaredLength(), indices[median]);
+
+      const float fDistanceToPlane = position[axis] - points[median][axis];
+      const bool bIsLeft = (fDistanceToPlane < 0.0f);
+      if (bIsLeft) FindKNearest(first, median, position, k, heap);
+      else FindKNearest(median + 1, last, position, k, heap);
+
+      if ((heap.size() < k) || ((fDistanceToPlane * fDistanceToPlane) <= heap.front().first)) {
+        if (bIsLeft) FindKNearest(median + 1, last, position, k, heap);
+        else FindKNearest(first, median, position, k, heap);
+      }
+    }
+
+    void cKDTree::FindInRadius(const cVec3& position, float fRadius, std::vector<size_t>& result) const
+    {
+      ASSERT(fRadius >= 0.0f);
+
+      result.clear();
+      FindInRadius(0, points.size(), position, fRadius * fRadius, result);
+    }
+
+    void cKDTree::FindInRadius(size_t first, size_t last, const cVec3& position, float fRadiusSquared, std::vector<size_t>& result) const
+    {
+      if ((last - first) <= LEAF_SIZE) {
+        for (size_t i = first; i < last; i++) {
+          if ((points[i] - position).GetSquaredLength() <= fRadiusSquared) result.push_back(indices[i]);
+        }
+        return;
+      }
+
+      const size_t median = first + ((last - first) / 2);
+      const int axis = axes[median];
+
+      if ((points[median] - position).GetSquaredLength() <= fRadiusSquared) result.push_back(indices[median]);
+
+      const float fDistanceToPlane = position[axis] - points[median][axis];
+      const bool bIsWithinPlane = ((fDistanceToPlane * fDistanceToPlane) <= fRadiusSquared);
+      if ((fDistanceToPlane < 0.0f) || bIsWithinPlane) FindInRadius(first, median, position, fRadiusSquared, result);
+      if ((fDistanceToPlane >= 0.0f) || bIsWithinPlane) FindInRadius(median + 1, last, position, fRadiusSquared, result);
+    }
+  }
+}
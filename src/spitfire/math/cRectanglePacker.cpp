@@ -0,0 +1,350 @@
+// Standard headers
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+// Spitfire headers
+#include <spitfire/math/cRectanglePacker.h>
+
+namespace spitfire
+{
+  namespace math
+  {
+    // ** cRectanglePacker
+
+    cRectanglePacker::cRectanglePacker() :
+      width(0),
+      height(0),
+      algorithm(PACKING_ALGORITHM::MAX_RECTS),
+      nRectangles(0),
+      nUsedArea(0),
+      currentX(0),
+      currentY(0),
+      currentTallestInRow(0),
+      nMaxFreeWidth(0),
+      nMaxFreeHeight(0)
+    {
+    }
+
+    void cRectanglePacker::Init(size_t _width, size_t _height, PACKING_ALGORITHM _algorithm)
+    {
+      width = _width;
+      height = _height;
+      algorithm = _algorithm;
+
+      nRectangles = 0;
+      nUsedArea = 0;
+
+      currentX = 0;
+      currentY = 0;
+      currentTallestInRow = 0;
+
+      skyline.clear();
+      if (algorithm == PACKING_ALGORITHM::SKYLINE) skyline.push_back({ 0, 0, width });
+
+      freeRectangles.clear();
+      newFreeRectangles.clear();
+      if (algorithm == PACKING_ALGORITHM::MAX_RECTS) freeRectangles.push_back({ 0, 0, width, height });
+      nMaxFreeWidth = width;
+      nMaxFreeHeight = height;
+    }
+
+    float cRectanglePacker::GetOccupancy() const
+    {
+      const size_t nArea = width * height;
+      return (nArea != 0) ? (float(nUsedArea) / float(nArea)) : 0.0f;
+    }
+
+    bool cRectanglePacker::Insert(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY)
+    {
+      outX = 0;
+      outY = 0;
+
+      if ((rectangleWidth > width) || (rectangleHeight > height)) return false;
+
+      // Empty rectangles fit anywhere and don't take up any room
+      if ((rectangleWidth == 0) || (rectangleHeight == 0)) return true;
+
+      bool bIsInserted = false;
+      switch (algorithm) {
+        case PACKING_ALGORITHM::SHELF: bIsInserted = InsertShelf(rectangleWidth, rectangleHeight, outX, outY); break;
+        case PACKING_ALGORITHM::SKYLINE: bIsInserted = InsertSkyline(rectangleWidth, rectangleHeight, outX, outY); break;
+        case PACKING_ALGORITHM::MAX_RECTS: bIsInserted = InsertMaxRects(rectangleWidth, rectangleHeight, outX, outY); break;
+      }
+
+      if (bIsInserted) {
+        nRectangles++;
+        nUsedArea += rectangleWidth * rectangleHeight;
+      }
+
+      return bIsInserted;
+    }
+
+    bool cRectanglePacker::InsertShelf(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY)
+    {
+      // Try to place the rectangle on this row
+      if (rectangleWidth > (width - currentX)) {
+        // Move to the next row
+        currentX = 0;
+        currentY = std::min(currentY + currentTallestInRow, height);
+        currentTallestInRow = 0;
+      }
+
+      // Try to place the rectangle again, if it doesn't fit now it is never going to fit
+      if ((rectangleWidth > (width - currentX)) || (rectangleHeight > (height - currentY))) return false;
+
+      outX = currentX;
+      outY = currentY;
+
+      currentX += rectangleWidth;
+      currentTallestInRow = std::max(currentTallestInRow, rectangleHeight);
+
+      return true;
+    }
+
+    bool cRectanglePacker::SkylineRectangleFits(size_t index, size_t rectangleWidth, size_t rectangleHeight, size_t& outY) const
+    {
+      const size_t x = skyline[index].x;
+      if ((x + rectangleWidth) > width) return false;
+
+      // The rectangle sits on the highest node that it spans
+      size_t y = 0;
+      size_t widthLeft = rectangleWidth;
+      for (size_t i = index; widthLeft != 0; i++) {
+        ASSERT(i < skyline.size());
+        y = std::max(y, skyline[i].y);
+        if ((y + rectangleHeight) > height) return false;
+        widthLeft -= std::min(widthLeft, skyline[i].width);
+      }
+
+      outY = y;
+      return true;
+    }
+
+    void cRectanglePacker::SkylineAddLevel(size_t index, const cRect& rect)
+    {
+      skyline.insert(skyline.begin() + index, { rect.x, rect.y + rect.height, rect.width });
+
+      // Shrink or remove the nodes that are now under the new node
+      const size_t right = rect.x + rect.width;
+      for (size_t i = index + 1; i < skyline.size(); ) {
+        cSkylineNode& node = skyline[i];
+        if (node.x >= right) break;
+
+        const size_t shrink = right - node.x;
+        if (node.width <= shrink) {
+          skyline.erase(skyline.begin() + i);
+          continue;
+        }
+
+        node.x += shrink;
+        node.width -= shrink;
+        break;
+      }
+
+      // Merge neighbouring nodes at the same height
+      for (size_t i = (index != 0) ? (index - 1) : 0; (i + 1) < skyline.size(); ) {
+        if (skyline[i].y == skyline[i + 1].y) {
+          skyline[i].width += skyline[i + 1].width;
+          skyline.erase(skyline.begin() + i + 1);
+        } else {
+          if (i > index) break;
+          i++;
+        }
+      }
+    }
+
+    bool cRectanglePacker::InsertSkyline(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY)
+    {
+      // Bottom left, the lowest top edge wins and then the narrowest node
+      size_t bestIndex = std::numeric_limits<size_t>::max();
+      size_t bestTop = std::numeric_limits<size_t>::max();
+      size_t bestWidth = std::numeric_limits<size_t>::max();
+
+      const size_t n = skyline.size();
+      for (size_t i = 0; i < n; i++) {
+        size_t y = 0;
+        if (!SkylineRectangleFits(i, rectangleWidth, rectangleHeight, y)) continue;
+
+        const size_t top = y + rectangleHeight;
+        if ((top < bestTop) || ((top == bestTop) && (skyline[i].width < bestWidth))) {
+          bestIndex = i;
+          bestTop = top;
+          bestWidth = skyline[i].width;
+          outX = skyline[i].x;
+          outY = y;
+        }
+      }
+
+      if (bestIndex == std::numeric_limits<size_t>::max()) return false;
+
+      SkylineAddLevel(bestIndex, { outX, outY, rectangleWidth, rectangleHeight });
+
+      return true;
+    }
+
+    namespace
+    {
+      inline bool IsContainedIn(size_t ax, size_t ay, size_t aWidth, size_t aHeight, size_t bx, size_t by, size_t bWidth, size_t bHeight)
+      {
+        return (ax >= bx) && (ay >= by) && ((ax + aWidth) <= (bx + bWidth)) && ((ay + aHeight) <= (by + bHeight));
+      }
+    }
+
+    void cRectanglePacker::MaxRectsAddNewFreeRectangle(const cRect& rect)
+    {
+      // Only keep the maximal rectangles
+      for (size_t i = 0; i < newFreeRectangles.size(); ) {
+        const cRect& other = newFreeRectangles[i];
+        if (IsContainedIn(rect.x, rect.y, rect.width, rect.height, other.x, other.y, other.width, other.height)) return;
+
+        if (IsContainedIn(other.x, other.y, other.width, other.height, rect.x, rect.y, rect.width, rect.height)) {
+          newFreeRectangles[i] = newFreeRectangles.back();
+          newFreeRectangles.pop_back();
+        } else i++;
+      }
+
+      newFreeRectangles.push_back(rect);
+    }
+
+    void cRectanglePacker::MaxRectsSplitFreeRectangle(const cRect& freeRectangle, const cRect& used)
+    {
+      // The parts of the free rectangle above, below, left and right of the used rectangle, they overlap each other
+      if (used.y > freeRectangle.y) MaxRectsAddNewFreeRectangle({ freeRectangle.x, freeRectangle.y, freeRectangle.width, used.y - freeRectangle.y });
+      if ((used.y + used.height) < (freeRectangle.y + freeRectangle.height)) MaxRectsAddNewFreeRectangle({ freeRectangle.x, used.y + used.height, freeRectangle.width, (freeRectangle.y + freeRectangle.height) - (used.y + used.height) });
+      if (used.x > freeRectangle.x) MaxRectsAddNewFreeRectangle({ freeRectangle.x, freeRectangle.y, used.x - freeRectangle.x, freeRectangle.height });
+      if ((used.x + used.width) < (freeRectangle.x + freeRectangle.width)) MaxRectsAddNewFreeRectangle({ used.x + used.width, freeRectangle.y, (freeRectangle.x + freeRectangle.width) - (used.x + used.width), freeRectangle.height });
+    }
+
+    bool cRectanglePacker::InsertMaxRects(size_t rectangleWidth, size_t rectangleHeight, size_t& outX, size_t& outY)
+    {
+      // Nearly full pages are skipped without looking at every free rectangle
+      if ((rectangleWidth > nMaxFreeWidth) || (rectangleHeight > nMaxFreeHeight)) return false;
+
+      // Best short side fit, the free rectangle that leaves the smallest gap along one side wins
+      size_t bestShortSide = std::numeric_limits<size_t>::max();
+      size_t bestLongSide = std::numeric_limits<size_t>::max();
+      bool bIsFound = false;
+
+      for (const cRect& rect : freeRectangles) {
+        if ((rectangleWidth > rect.width) || (rectangleHeight > rect.height)) continue;
+
+        const size_t leftoverHorizontal = rect.width - rectangleWidth;
+        const size_t leftoverVertical = rect.height - rectangleHeight;
+        const size_t shortSide = std::min(leftoverHorizontal, leftoverVertical);
+        const size_t longSide = std::max(leftoverHorizontal, leftoverVertical);
+        if ((shortSide < bestShortSide) || ((shortSide == bestShortSide) && (longSide < bestLongSide))) {
+          bestShortSide = shortSide;
+          bestLongSide = longSide;
+          outX = rect.x;
+          outY = rect.y;
+          bIsFound = true;
+        }
+      }
+
+      if (!bIsFound) return false;
+
+      const cRect used = { outX, outY, rectangleWidth, rectangleHeight };
+
+      // Split every free rectangle that overlaps the new rectangle
+      newFreeRectangles.clear();
+      for (size_t i = 0; i < freeRectangles.size(); ) {
+        const cRect rect = freeRectangles[i];
+        const bool bIsOverlapping = (used.x < (rect.x + rect.width)) && ((used.x + used.width) > rect.x) && (used.y < (rect.y + rect.height)) && ((used.y + used.height) > rect.y);
+        if (!bIsOverlapping) {
+          i++;
+          continue;
+        }
+
+        freeRectangles[i] = freeRectangles.back();
+        freeRectangles.pop_back();
+        MaxRectsSplitFreeRectangle(rect, used);
+      }
+
+      // The new free rectangles are smaller than the ones they came from so we only have to check if they are inside an old one
+      for (const cRect& rect : freeRectangles) {
+        for (size_t i = 0; i < newFreeRectangles.size(); ) {
+          const cRect& other = newFreeRectangles[i];
+          if (IsContainedIn(other.x, other.y, other.width, other.height, rect.x, rect.y, rect.width, rect.height)) {
+            newFreeRectangles[i] = newFreeRectangles.back();
+            newFreeRectangles.pop_back();
+          } else i++;
+        }
+      }
+
+      freeRectangles.insert(freeRectangles.end(), newFreeRectangles.begin(), newFreeRectangles.end());
+
+      nMaxFreeWidth = 0;
+      nMaxFreeHeight = 0;
+      for (const cRect& rect : freeRectangles) {
+        nMaxFreeWidth = std::max(nMaxFreeWidth, rect.width);
+        nMaxFreeHeight = std::max(nMaxFreeHeight, rect.height);
+      }
+
+      return true;
+    }
+
+
+    // ** PackRectangles
+
+    cPackedRectangle::cPackedRectangle() :
+      page(INVALID_PAGE),
+      x(0),
+      y(0)
+    {
+    }
+
+    bool PackRectangles(size_t pageWidth, size_t pageHeight, PACKING_ALGORITHM algorithm, const std::vector<std::pair<size_t, size_t>>& sizes, std::vector<cRectanglePacker>& pages, std::vector<cPackedRectangle>& packed)
+    {
+      packed.assign(sizes.size(), cPackedRectangle());
+
+      // Largest first gives the best fill, the longest side matters most and the index keeps the order the same on every platform
+      std::vector<size_t> order(sizes.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [&sizes](size_t lhs, size_t rhs) {
+        const size_t lhsLongSide = std::max(sizes[lhs].first, sizes[lhs].second);
+        const size_t rhsLongSide = std::max(sizes[rhs].first, sizes[rhs].second);
+        if (lhsLongSide != rhsLongSide) return (lhsLongSide > rhsLongSide);
+
+        const size_t lhsShortSide = std::min(sizes[lhs].first, sizes[lhs].second);
+        const size_t rhsShortSide = std::min(sizes[rhs].first, sizes[rhs].second);
+        if (lhsShortSide != rhsShortSide) return (lhsShortSide > rhsShortSide);
+
+        return (lhs < rhs);
+      });
+
+      bool bIsAllPacked = true;
+
+      for (size_t index : order) {
+        const size_t rectangleWidth = sizes[index].first;
+        const size_t rectangleHeight = sizes[index].second;
+        if ((rectangleWidth > pageWidth) || (rectangleHeight > pageHeight)) {
+          bIsAllPacked = false;
+          continue;
+        }
+
+        cPackedRectangle& rectangle = packed[index];
+
+        const size_t nPages = pages.size();
+        for (size_t i = 0; i < nPages; i++) {
+          if (pages[i].Insert(rectangleWidth, rectangleHeight, rectangle.x, rectangle.y)) {
+            rectangle.page = i;
+            break;
+          }
+        }
+
+        if (rectangle.page == INVALID_PAGE) {
+          // Start a new page
+          pages.push_back(cRectanglePacker());
+          pages.back().Init(pageWidth, pageHeight, algorithm);
+          const bool bIsInserted = pages.back().Insert(rectangleWidth, rectangleHeight, rectangle.x, rectangle.y);
+          ASSERT(bIsInserted);
+          (void)bIsInserted;
+          rectangle.page = nPages;
+        }
+      }
+
+      return bIsAllPacked;
+    }
+  }
+}
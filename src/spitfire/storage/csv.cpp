@@ -1,5 +1,6 @@
 // Standard headers
-#include <sstream>
+#include <algorithm>
+#include <cstring>
 
 // Spitfire headers
 #include <spitfire/storage/csv.h>
@@ -8,143 +9,355 @@ namespace spitfire
 {
   namespace csv
   {
-    // ** cReader
+    // ** cRow
 
-    bool cReader::Open(const string_t& sFilePath)
+    void cRow::Clear()
     {
-      return file.Open(sFilePath);
+      columns.clear();
+      unescaped.clear();
+      unescapedColumns.clear();
     }
 
-    bool cReader::ReadLine(std::vector<string_t>& values)
+
+    // ** cRowReader
+
+    cRowReader::cRowReader() :
+      pCurrent(nullptr),
+      pEnd(nullptr)
     {
-      std::cout<<"cReader::ReadLine"<<std::endl;
+    }
 
-      values.clear();
+    cRowReader::cRowReader(std::string_view sContentUTF8) :
+      pCurrent(sContentUTF8.data()),
+      pEnd(sContentUTF8.data() + sContentUTF8.length())
+    {
+    }
+
+    bool cRowReader::ReadRow(cRow& row)
+    {
+      row.Clear();
 
-      // Fields containing a line-break, double-quote, and/or commas must be quoted.
-      // A (double) quote character in a field must be represented by two double quote characters.
+      // Skip blank lines
+      while ((pCurrent != pEnd) && ((*pCurrent == '\n') || (*pCurrent == '\r'))) pCurrent++;
 
-      bool bReadAllValues = false;
+      if (pCurrent == pEnd) return false;
 
-      string_t sLine;
-      file.ReadLineUTF8(sLine);
+      const char* p = pCurrent;
 
-      string::cStringParser sp(sLine);
-      while (!sp.IsEnd()) {
-        if (sp.GetCharacter() == TEXT('\"')) {
-          sp.SkipCharacter();
+      // The end of the current line, this is only valid until a quoted field goes past it
+      const char* pLineEnd = static_cast<const char*>(memchr(p, '\n', size_t(pEnd - p)));
+      if (pLineEnd == nullptr) pLineEnd = pEnd;
 
-          ostringstream_t oValue;
+      while (true) {
+        if ((p != pEnd) && (*p == '\"')) {
+          // Quoted field
+          p++;
+          const char* pStart = p;
+          const char* pSegmentStart = p;
+          bool bIsEscaped = false;
+          size_t offset = 0;
 
-          bool bFoundEndQuote = false;
-          while (!bFoundEndQuote) {
-            if (sp.IsEnd()) {
-              std::cerr<<"cReader::ReadLine Error unexpected end of string"<<std::endl;
-              break;
+          while (true) {
+            const char* pQuote = static_cast<const char*>(memchr(p, '\"', size_t(pEnd - p)));
+            if (pQuote == nullptr) {
+              // Unterminated, take the rest of the content
+              pQuote = pEnd;
             }
 
-            string_t sText;
-            if (sp.GetToStringAndSkip(TEXT("\""), sText)) {
-              if (sp.IsEnd()) {
-                oValue<<sText;
-                bFoundEndQuote = true;
-              } else {
-                const char_t c = sp.GetCharacterAndSkip();
-                if (c == TEXT('\"')) {
-                  oValue<<sText;
-                  oValue<<"\"";
-                } else if (c == TEXT(',')) {
-                  oValue<<sText;
-                  bFoundEndQuote = true;
-                } else {
-                  std::cerr<<"cReader::ReadLine Error found unexpected string at "<<sp.GetToEndAndSkip()<<std::endl;
-                }
+            if ((pQuote != pEnd) && ((pQuote + 1) != pEnd) && (pQuote[1] == '\"')) {
+              // An escaped quote
+              if (!bIsEscaped) {
+                bIsEscaped = true;
+                offset = row.unescaped.size();
               }
-            } else {
-              oValue<<sp.GetToEndAndSkip();
+              row.unescaped.append(pSegmentStart, pQuote + 1);
+              p = pQuote + 2;
+              pSegmentStart = p;
+              continue;
+            }
 
-              file.ReadLineUTF8(sLine);
+            if (bIsEscaped) {
+              row.unescaped.append(pSegmentStart, pQuote);
+              row.unescapedColumns.push_back({ row.columns.size(), offset, row.unescaped.size() - offset });
+              row.columns.push_back(std::string_view());
+            } else row.columns.push_back(std::string_view(pStart, size_t(pQuote - pStart)));
 
-              string::cStringParser sp2(sLine);
-              sp = sp2;
-            }
+            p = (pQuote != pEnd) ? (pQuote + 1) : pEnd;
+            break;
           }
 
-          values.push_back(oValue.str());
+          // Anything between the closing quote and the next separator is ignored
+          if (p > pLineEnd) {
+            pLineEnd = static_cast<const char*>(memchr(p, '\n', size_t(pEnd - p)));
+            if (pLineEnd == nullptr) pLineEnd = pEnd;
+          }
+          const char* pComma = static_cast<const char*>(memchr(p, ',', size_t(pLineEnd - p)));
+          p = (pComma != nullptr) ? pComma : pLineEnd;
         } else {
-          //std::cout<<"cReader::ReadLine 0"<<std::endl;
-          string_t sValue;
-          if (sp.GetToStringAndSkip(TEXT(","), sValue)) {
-            //std::cout<<"cReader::ReadLine 1"<<std::endl;
-            values.push_back(sValue);
-          } else {
-            //std::cout<<"cReader::ReadLine 2"<<std::endl;
-            values.push_back(sp.GetToEndAndSkip());
-            bReadAllValues = true;
+          // Unquoted field
+          const char* pComma = static_cast<const char*>(memchr(p, ',', size_t(pLineEnd - p)));
+          const char* pFieldEnd = (pComma != nullptr) ? pComma : pLineEnd;
+
+          // Windows line endings
+          const char* pValueEnd = pFieldEnd;
+          if ((pComma == nullptr) && (pValueEnd != p) && (pValueEnd[-1] == '\r')) pValueEnd--;
+
+          row.columns.push_back(std::string_view(p, size_t(pValueEnd - p)));
+          p = pFieldEnd;
+        }
+
+        if (p == pEnd) break;
+        if (*p == '\n') {
+          p++;
+          break;
+        }
+
+        // Skip the comma
+        ASSERT(*p == ',');
+        p++;
+      }
+
+      pCurrent = p;
+
+      // The unescaped buffer has stopped growing so we can point the columns at it now
+      for (auto&& column : row.unescapedColumns) row.columns[column.iColumn] = std::string_view(row.unescaped.data() + column.offset, column.length);
+
+      return true;
+    }
+
+
+    // ** cReader
+
+    bool cReader::Open(const string_t& sFilePath)
+    {
+      Close();
+
+      if (!file.Open(sFilePath)) return false;
+
+      std::string_view sContent = file.GetView();
+
+      // Skip the UTF-8 byte order mark
+      if ((sContent.length() >= 3) && (sContent.substr(0, 3) == "\xEF\xBB\xBF")) sContent.remove_prefix(3);
+
+      rows = cRowReader(sContent);
+
+      return true;
+    }
+
+    void cReader::Close()
+    {
+      rows = cRowReader();
+      columnNames.clear();
+      file.Close();
+    }
+
+    bool cReader::ReadHeader()
+    {
+      columnNames.clear();
+
+      cRow row;
+      if (!rows.ReadRow(row)) return false;
+
+      for (size_t i = 0; i < row.GetColumnCount(); i++) columnNames.push_back(std::string(row.GetColumn(i)));
+
+      return true;
+    }
+
+    size_t cReader::GetColumnIndex(std::string_view sName) const
+    {
+      const size_t n = columnNames.size();
+      for (size_t i = 0; i < n; i++) {
+        if (columnNames[i] == sName) return i;
+      }
+
+      return INVALID_COLUMN;
+    }
+
+    bool cReader::ReadRow(cRow& row)
+    {
+      return rows.ReadRow(row);
+    }
+
+    bool cReader::ReadLine(std::vector<string_t>& values)
+    {
+      values.clear();
+
+      cRow row;
+      if (!rows.ReadRow(row)) return false;
+
+      const size_t n = row.GetColumnCount();
+      values.reserve(n);
+      for (size_t i = 0; i < n; i++) {
+        #ifdef UNICODE
+        values.push_back(string::ToString(std::string(row.GetColumn(i))));
+        #else
+        values.push_back(string_t(row.GetColumn(i)));
+        #endif
+      }
+
+      return true;
+    }
+
+    void cReader::SplitIntoChunks(size_t nChunks, std::vector<cRowReader>& chunks) const
+    {
+      chunks.clear();
+
+      const std::string_view sRemaining = rows.GetRemaining();
+      if (sRemaining.empty()) return;
+
+      nChunks = std::max<size_t>(1, nChunks);
+
+      const char* pBegin = sRemaining.data();
+      const char* pEnd = sRemaining.data() + sRemaining.length();
+      const size_t nChunkSizeBytes = std::max<size_t>(1, sRemaining.length() / nChunks);
+
+      // We count the quotes as we go so that we know whether each line break is inside a quoted field
+      const char* pChunkStart = pBegin;
+      const char* pCounted = pBegin;
+      size_t nQuotes = 0;
+
+      for (size_t i = 1; (i < nChunks) && (pChunkStart != pEnd); i++) {
+        const char* pTarget = std::max(pBegin + (i * nChunkSizeBytes), pChunkStart);
+        if (pTarget >= pEnd) break;
+
+        nQuotes += size_t(std::count(pCounted, pTarget, '\"'));
+        pCounted = pTarget;
+
+        // Find the first line break after the target that is not inside a quoted field
+        const char* pSplit = pEnd;
+        while (pCounted != pEnd) {
+          const char* pLineBreak = static_cast<const char*>(memchr(pCounted, '\n', size_t(pEnd - pCounted)));
+          if (pLineBreak == nullptr) {
+            nQuotes += size_t(std::count(pCounted, pEnd, '\"'));
+            pCounted = pEnd;
+            break;
+          }
+
+          nQuotes += size_t(std::count(pCounted, pLineBreak, '\"'));
+          pCounted = pLineBreak + 1;
+
+          if ((nQuotes % 2) == 0) {
+            pSplit = pLineBreak + 1;
             break;
           }
         }
+
+        chunks.push_back(cRowReader(std::string_view(pChunkStart, size_t(pSplit - pChunkStart))));
+        pChunkStart = pSplit;
       }
 
-      std::cout<<"cReader::ReadLine Finished reading "<<values.size()<<" values, returning "<<bReadAllValues<<std::endl;
-      return bReadAllValues;
+      if (pChunkStart != pEnd) chunks.push_back(cRowReader(std::string_view(pChunkStart, size_t(pEnd - pChunkStart))));
     }
 
 
     // ** cWriter
 
+    const size_t WRITER_BUFFER_SIZE_BYTES = 64 * 1024;
+
     cWriter::cWriter() :
       bIsFirstValue(true)
     {
     }
 
+    cWriter::~cWriter()
+    {
+      Close();
+    }
+
     bool cWriter::Open(const string_t& sFilePath)
     {
-      o.open(string::ToUTF8(sFilePath).c_str());
+      Close();
+
+      o.open(string::ToUTF8(sFilePath).c_str(), std::ios::out | std::ios::binary);
+      buffer.reserve(WRITER_BUFFER_SIZE_BYTES + 1024);
+      bIsFirstValue = true;
       return o.is_open();
     }
 
-    void cWriter::AddValue(const string_t& sValue)
+    void cWriter::Close()
     {
-      if (!bIsFirstValue) o<<",";
-
-      // Fields containing a line-break, double-quote, and/or commas must be quoted.
-      // A (double) quote character in a field must be represented by two double quote characters.
+      if (!o.is_open()) return;
 
-      std::ostringstream oValue;
-      string::cStringParser sp(sValue);
-      bool bNeedsQuoting = false;
-      while (!sp.IsEnd()) {
-        const string_t s = sp.GetCharacterPossiblySurrogatePairAndSkip();
-        assert(!s.empty());
-        const char_t c = s[0];
-        switch (c) {
-          case TEXT('\r'):
-          case TEXT('\n'):
-          case TEXT(','): {
-            bNeedsQuoting = true;
-            break;
-          }
-          case TEXT('\"'): {
-            bNeedsQuoting = true;
-            oValue<<"\"";
-            break;
-          }
-        }
+      Flush();
+      o.close();
+    }
 
-        oValue<<string::ToUTF8(s);
+    void cWriter::Flush()
+    {
+      if (!buffer.empty()) {
+        o.write(buffer.data(), buffer.size());
+        buffer.clear();
       }
 
-      if (bNeedsQuoting) o<<"\""<<oValue.str()<<"\"";
-      else o<<oValue.str();
+      o.flush();
+    }
 
+    void cWriter::BeginValue()
+    {
+      if (!bIsFirstValue) buffer += ',';
       bIsFirstValue = false;
     }
 
+    void cWriter::AddValue(std::string_view sValueUTF8)
+    {
+      BeginValue();
+
+      if (sValueUTF8.find_first_of(",\"\r\n") == std::string_view::npos) {
+        buffer.append(sValueUTF8);
+        return;
+      }
+
+      // Quote the value and double any quotes in it
+      buffer += '\"';
+      while (true) {
+        const size_t i = sValueUTF8.find('\"');
+        if (i == std::string_view::npos) break;
+
+        buffer.append(sValueUTF8.substr(0, i + 1));
+        buffer += '\"';
+        sValueUTF8.remove_prefix(i + 1);
+      }
+      buffer.append(sValueUTF8);
+      buffer += '\"';
+    }
+
+    #ifdef UNICODE
+    void cWriter::AddValue(const std::wstring& sValue)
+    {
+      AddValue(string::ToUTF8(sValue));
+    }
+    #endif
+
+    void cWriter::AddValueInt(int64_t value)
+    {
+      AddNumber(value);
+    }
+
+    void cWriter::AddValueUInt(uint64_t value)
+    {
+      AddNumber(value);
+    }
+
+    void cWriter::AddValueFloat(double value)
+    {
+      AddNumber(value);
+    }
+
+    void cWriter::AddValueBool(bool value)
+    {
+      BeginValue();
+      buffer.append(value ? "true" : "false");
+    }
+
     void cWriter::EndRow()
     {
-      o<<std::endl;
+      buffer += '\n';
       bIsFirstValue = true;
+
+      if (buffer.size() >= WRITER_BUFFER_SIZE_BYTES) {
+        o.write(buffer.data(), buffer.size());
+        buffer.clear();
+      }
     }
   }
 }
@@ -24,8 +24,10 @@
 #include <spitfire/util/log.h>
 #endif
 
+#include <spitfire/storage/file.h>
 #include <spitfire/storage/filesystem.h>
 #include <spitfire/storage/document.h>
+#include <spitfire/storage/xml.h>
 
 #ifdef BUILD_XML_MATH
 #include <spitfire/math/math.h>
@@ -83,221 +85,74 @@ namespace spitfire
 
     util::PROCESS_RESULT cNode::LoadFromString(util::cProcessInterface& interface, const std::string& sData)
     {
-      size_t nProcessedElements = 0;
-      spitfire::string::cStringParserUTF8 sp(sData);
-      return ParseFromStringParser(interface, nProcessedElements, sp);
+      xml::cPullParser parser(sData);
+      return ParseFromPullParser(interface, parser);
     }
 
     util::PROCESS_RESULT cNode::LoadFromFile(util::cProcessInterface& interface, const string_t& inFilename)
     {
       LOG("\"", inFilename, "\"");
-      std::ifstream f(spitfire::string::ToUTF8(inFilename).c_str());
 
-      if (!f.is_open()) {
+      // The file is parsed straight out of the mapping so we never hold a second copy of it
+      storage::cMemoryMappedFile file;
+      if (!file.Open(inFilename)) {
         CONSOLE<<"XML "<<inFilename<<" not found, returning false"<<std::endl;
         return util::PROCESS_RESULT::FAILED;
       }
 
-      const size_t nFileSizeBytes = filesystem::GetFileSizeBytes(inFilename);
-      std::string sData;
-      sData.reserve(nFileSizeBytes);
-      std::string line;
-      while(!f.eof()) {
-        std::getline(f, line);
-
-        // Get rid of leading tabs
-        sData += string::StripLeadingWhiteSpace(line);
-      }
-      f.close();
-
-      //LOG(inFilename, " contains \"", spitfire::string::ToString(sData), "\", returning");
-      return LoadFromString(interface, sData);
+      xml::cPullParser parser(file.GetView());
+      return ParseFromPullParser(interface, parser);
     }
 
-    util::PROCESS_RESULT cNode::ParseFromStringParser(const util::cProcessInterface& interface, size_t& nProcessedElements, spitfire::string::cStringParserUTF8& sp)
+    util::PROCESS_RESULT cNode::ParseFromPullParser(const util::cProcessInterface& interface, xml::cPullParser& parser)
     {
-      //LOG("\"", sp.GetToEnd(), "\"");
+      // Build the tree iteratively so that deeply nested documents can't overflow the stack
+      cNode* pCurrent = this;
 
-      while (!sp.IsEnd()) {
-        if (nProcessedElements > 100) {
+      size_t nProcessedEvents = 0;
+      while (true) {
+        if (nProcessedEvents > 1000) {
           if (interface.IsToStop()) return util::PROCESS_RESULT::STOPPED_BY_INTERFACE;
-          nProcessedElements = 0;
+          nProcessedEvents = 0;
         }
 
-        nProcessedElements++;
+        nProcessedEvents++;
 
-        //const std::string sTmp = sp.GetToEnd();
-        //LOG("While \"", sTmp, "\"");
-
-        sp.SkipWhiteSpace();
-
-        // XML declaration
-        // <?xml version="1.0" encoding="UTF-8"?>
-        while (sp.StartsWithAndSkip("<?xml")) {
-          if (!sp.SkipToString("?>")) {
-            LOG("Unterminated XML declaration, returning false");
-            return util::PROCESS_RESULT::FAILED;
+        switch (parser.Next()) {
+          case xml::EVENT::START_ELEMENT: {
+            cNode* pNode = pCurrent->CreateNodeAsChildAndAppend();
+            pNode->sName = parser.GetName();
+            pCurrent = pNode;
+            break;
           }
-
-          //LOG("Found XML declaration node");
-          type = TYPE::XML_DECLARATION;
-          sp.SkipWhiteSpace();
-        }
-
-        // Comments
-        // <!-- ... -->
-        while (sp.StartsWithAndSkip("<!--")) {
-          if (!sp.SkipToString("-->")) {
-            LOG("Unterminated Comment, returning false");
-            return util::PROCESS_RESULT::FAILED;
+          case xml::EVENT::ATTRIBUTE: {
+            const std::string_view sValue = parser.GetValue();
+            std::string& sAttribute = pCurrent->mAttribute[std::string(parser.GetName())];
+            if (sValue.find('\\') == std::string_view::npos) sAttribute = sValue;
+            else sAttribute = string::Replace(std::string(sValue), "\\\"", "\"");
+            break;
           }
-
-          //LOG("Found comment node");
-          type = TYPE::COMMENT;
-        }
-
-        std::string sContent;
-        if (sp.GetToStringAndSkip("<", sContent)) {
-          sp.SkipWhiteSpace();
-
-          if (sp.GetCharacter() == '/') {
-            sp.SkipCharacter();
-
-            // </name>
-            if (!sContent.empty() && (sContent != "/>")) {
-              cNode* pNode = CreateNodeAsChildAndAppend();
-              ASSERT(pNode != nullptr);
-              pNode->SetTypeContentOnly(sContent);
-            }
-
-            std::string sClose;
-            if (sp.GetToStringAndSkip(">", sClose)) {
-              if (sClose != sName) {
-                LOG("Opening tag \"", spitfire::string::ToString(sName), "\" doesn't match closing tag \"", spitfire::string::ToString(sClose), "\", returning false");
-                return util::PROCESS_RESULT::FAILED;
-              }
-            } else {
-              LOG("Tag \"", spitfire::string::ToString(sName), "\" doesn't have a closing tag, returning false");
-              return util::PROCESS_RESULT::FAILED;
-            }
-
-            //LOG("Found end of tag, breaking");
+          case xml::EVENT::TEXT: {
+            cNode* pNode = pCurrent->CreateNodeAsChildAndAppend();
+            pNode->type = TYPE::CONTENT_ONLY;
+            pNode->sContentOnly = parser.GetValue();
             break;
           }
-
-          std::string sResult;
-          if (sp.GetToOneOfTheseCharacters("/ >", sResult)) {
-            sp.SkipCharacters(sResult.length());
-
-            // Collect name
-            std::string inName = string::StripTrailing(sResult, " ");
-
-            // attribute="value"...
-            sp.SkipWhiteSpace();
-
-            cNode* p = CreateNodeAsChildAndAppend();
-
-            //LOG("Found node ", spitfire::string::ToString(inName));
-            p->sName = inName;
-
-            // Fill in attributes if any, and find the end of the opening tag
-            if (sp.GetCharacter() == '/') {
-              // />
-              if (!sp.SkipToStringAndSkip(">")) {
-                LOG("Tag \"", spitfire::string::ToString(inName), "\" doesn't have a closing bracket, returning false");
-                return util::PROCESS_RESULT::FAILED;
-              }
-            } else {
-              std::string sData;
-              if (!sp.GetToStringAndSkip(">", sData)) {
-                LOG("Tag \"", spitfire::string::ToString(inName), "\" opening declaration doesn't terminate, returning false");
-                return util::PROCESS_RESULT::FAILED;
-              }
-
-              // Append a closing bracket because we took one off when parsing
-              sData += ">";
-
-              // attribute="value">
-              std::string::iterator iter = sData.begin();
-
-              std::string sAttributeName;
-              std::string sAttributeValue;
-
-              while ((iter != sData.end()) && (*iter != '/') && (*iter != '>')) {
-                if (*iter == ' ') {
-                  p->SetAttribute(sAttributeName, "");
-                  sAttributeName = "";
-                  sData = string::StripLeading(&*iter, " ");
-                  iter = sData.begin();
-                  continue;
-                } else if (*iter == '=') {
-                  iter++;
-                  if ((iter != sData.end()) && (*iter == '\"')) {
-                    sData.erase(sData.begin(), ++iter);
-                    sData = string::StripLeading(sData, " ");
-
-                    std::string::size_type nQuote = sData.find("\"");
-                    std::string::size_type nSlashQuote = sData.find("\\\"");
-
-                    while (std::string::npos != nQuote) {
-                      if (nQuote < nSlashQuote) {
-                        // attribute="value"
-                        p->SetAttribute(sAttributeName, sAttributeValue + sData.substr(0, nQuote));
-                        sAttributeName = "";
-                        sAttributeValue = "";
-                        sData = string::StripLeading(sData.substr(nQuote + 1), " ");
-                        break;
-                      } else {
-                        // attribute="value\"innervalue..."
-                        sAttributeValue += sData.substr(0, nSlashQuote);
-                        sData = string::StripLeading(sData.substr(nSlashQuote + 2), " ");
-                      }
-
-                      nQuote = sData.find("\"");
-                      nSlashQuote = sData.find("\\\"");
-                    };
-
-                    iter = sData.begin();
-                    continue;
-                  }
-                } else sAttributeName += *iter;
-
-                iter++;
-              };
-
-              if ('>' == *iter) {
-                // >...
-                iter++;
-                if (!sAttributeName.empty()) {
-                  // attribute>
-                  p->SetAttribute(sAttributeName, sAttributeValue);
-                  sAttributeName = "";
-                }
-
-                util::PROCESS_RESULT result = (*vChild.rbegin())->ParseFromStringParser(interface, nProcessedElements, sp);
-                if (result != util::PROCESS_RESULT::COMPLETE) {
-                  LOGERROR("Error parsing child node, returning");
-                  return result;
-                }
-              }
-            }
-          } else {
-            LOG("here, returning true");
+          case xml::EVENT::END_ELEMENT: {
+            ASSERT(pCurrent != this);
+            pCurrent = pCurrent->pParent;
+            break;
+          }
+          case xml::EVENT::END_OF_DOCUMENT: {
+            if (parser.IsXMLDeclarationFound()) type = TYPE::XML_DECLARATION;
             return util::PROCESS_RESULT::COMPLETE;
           }
-        } else {
-          // No tags, just content for the parent tag (this)
-          cNode* p = CreateNodeAsChildAndAppend();
-
-          p->type = TYPE::CONTENT_ONLY;
-          p->sContentOnly += string::StripTrailingWhiteSpace(sp.GetToEnd());
-          //LOG("Content only, returning true");
-          return util::PROCESS_RESULT::COMPLETE;
+          case xml::EVENT::ERROR: {
+            LOG(parser.GetError(), ", returning false");
+            return util::PROCESS_RESULT::FAILED;
+          }
         }
       }
-
-      //LOG("At end of function, returning true");
-      return util::PROCESS_RESULT::COMPLETE;
     }
 
 
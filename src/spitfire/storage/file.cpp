@@ -28,6 +28,13 @@
 #include <windows.h>
 #endif
 
+#ifdef __LINUX__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace spitfire
 {
   namespace storage
@@ -471,5 +478,103 @@ namespace spitfire
       file.write(str.c_str(), str.length() * sizeof(char));
       file.write("\n", sizeof(char));
     }
+
+
+    // ** cMemoryMappedFile
+
+    cMemoryMappedFile::cMemoryMappedFile() :
+      bIsOpen(false),
+      pData(nullptr),
+      nSizeBytes(0)
+      #ifdef __LINUX__
+      , pMapped(nullptr)
+      #endif
+    {
+    }
+
+    cMemoryMappedFile::cMemoryMappedFile(const string_t& sFilePath) :
+      bIsOpen(false),
+      pData(nullptr),
+      nSizeBytes(0)
+      #ifdef __LINUX__
+      , pMapped(nullptr)
+      #endif
+    {
+      Open(sFilePath);
+    }
+
+    cMemoryMappedFile::~cMemoryMappedFile()
+    {
+      Close();
+    }
+
+    bool cMemoryMappedFile::Open(const string_t& sFilePath)
+    {
+      Close();
+
+      #ifdef __LINUX__
+      const int fd = open(spitfire::string::ToUTF8(sFilePath).c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) return false;
+
+      struct stat s;
+      if ((fstat(fd, &s) != 0) || !S_ISREG(s.st_mode)) {
+        close(fd);
+        return false;
+      }
+
+      nSizeBytes = size_t(s.st_size);
+
+      // mmap doesn't accept a length of 0 so an empty file is open but has no data
+      if (nSizeBytes != 0) {
+        void* p = mmap(nullptr, nSizeBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+          close(fd);
+          nSizeBytes = 0;
+          return false;
+        }
+
+        // We almost always read from the start to the end
+        madvise(p, nSizeBytes, MADV_SEQUENTIAL);
+
+        pMapped = p;
+        pData = static_cast<const uint8_t*>(p);
+      }
+
+      // The mapping stays valid after the file is closed
+      close(fd);
+      #else
+      std::ifstream file(spitfire::string::ToUTF8(sFilePath).c_str(), std::ios::in | std::ios::binary);
+      if (!file.is_open()) return false;
+
+      file.seekg(0, std::ios::end);
+      nSizeBytes = size_t(file.tellg());
+      file.seekg(0, std::ios::beg);
+
+      buffer.resize(nSizeBytes);
+      if (nSizeBytes != 0) file.read(reinterpret_cast<char*>(buffer.data()), nSizeBytes);
+
+      pData = buffer.data();
+      #endif
+
+      bIsOpen = true;
+
+      return true;
+    }
+
+    void cMemoryMappedFile::Close()
+    {
+      #ifdef __LINUX__
+      if (pMapped != nullptr) {
+        munmap(pMapped, nSizeBytes);
+        pMapped = nullptr;
+      }
+      #else
+      buffer.clear();
+      #endif
+
+      bIsOpen = false;
+      pData = nullptr;
+      nSizeBytes = 0;
+    }
   }
 }
@@ -8,6 +8,10 @@
 #include <iostream>
 #include <fstream>
 
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <limits>
 #include <list>
 #include <string>
 #include <sstream>
@@ -15,6 +19,10 @@
 #include <map>
 #include <stack>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 // Spitfire Includes
 #include <spitfire/spitfire.h>
 
@@ -24,36 +32,575 @@
 #include <spitfire/util/log.h>
 #endif
 
+#include <spitfire/storage/file.h>
 #include <spitfire/storage/json.h>
 
 namespace spitfire
 {
   namespace json
   {
-    cNode::cNode() :
+    // ** Structural character scanner
+    //
+    // The first pass finds every structural character in the source 64 bytes at a time, these are { } [ ] : , the
+    // opening quote of each string and the first character of each number, true, false and null.  Anything inside a
+    // string is ignored.  The second pass then only has to visit these offsets instead of every character.
+
+    namespace
+    {
+      const size_t BLOCK_SIZE_BYTES = 64;
+      const size_t MAX_DEPTH = 1024;
+
+      struct cBlockMasks
+      {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t op;         // { } [ ] : ,
+        uint64_t whitespace;
+      };
+
+      #if defined(__AVX2__)
+      inline void GetBlockMasks(const char* p, cBlockMasks& masks)
+      {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i lowerCase = _mm256_set1_epi8(0x20);
+        const __m256i braceOpen = _mm256_set1_epi8('{');
+        const __m256i braceClose = _mm256_set1_epi8('}');
+        const __m256i colon = _mm256_set1_epi8(':');
+        const __m256i comma = _mm256_set1_epi8(',');
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i lineFeed = _mm256_set1_epi8('\n');
+        const __m256i carriageReturn = _mm256_set1_epi8('\r');
+
+        masks.quote = 0;
+        masks.backslash = 0;
+        masks.op = 0;
+        masks.whitespace = 0;
+
+        for (size_t i = 0; i < 2; i++) {
+          const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + (32 * i)));
+
+          // Setting 0x20 turns [ and ] into { and } and leaves : and , alone
+          const __m256i lower = _mm256_or_si256(v, lowerCase);
+          const __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, braceOpen), _mm256_cmpeq_epi8(lower, braceClose)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma))
+          );
+          const __m256i whitespace = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, lineFeed), _mm256_cmpeq_epi8(v, carriageReturn))
+          );
+
+          const size_t shift = 32 * i;
+          masks.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)))) << shift;
+          masks.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)))) << shift;
+          masks.op |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << shift;
+          masks.whitespace |= uint64_t(uint32_t(_mm256_movemask_epi8(whitespace))) << shift;
+        }
+      }
+      #elif defined(__SSE2__)
+      inline void GetBlockMasks(const char* p, cBlockMasks& masks)
+      {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i lowerCase = _mm_set1_epi8(0x20);
+        const __m128i braceOpen = _mm_set1_epi8('{');
+        const __m128i braceClose = _mm_set1_epi8('}');
+        const __m128i colon = _mm_set1_epi8(':');
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i lineFeed = _mm_set1_epi8('\n');
+        const __m128i carriageReturn = _mm_set1_epi8('\r');
+
+        masks.quote = 0;
+        masks.backslash = 0;
+        masks.op = 0;
+        masks.whitespace = 0;
+
+        for (size_t i = 0; i < 4; i++) {
+          const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + (16 * i)));
+
+          // Setting 0x20 turns [ and ] into { and } and leaves : and , alone
+          const __m128i lower = _mm_or_si128(v, lowerCase);
+          const __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, braceOpen), _mm_cmpeq_epi8(lower, braceClose)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma))
+          );
+          const __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, lineFeed), _mm_cmpeq_epi8(v, carriageReturn))
+          );
+
+          const size_t shift = 16 * i;
+          masks.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << shift;
+          masks.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))) << shift;
+          masks.op |= uint64_t(uint16_t(_mm_movemask_epi8(op))) << shift;
+          masks.whitespace |= uint64_t(uint16_t(_mm_movemask_epi8(whitespace))) << shift;
+        }
+      }
+      #else
+      inline void GetBlockMasks(const char* p, cBlockMasks& masks)
+      {
+        masks.quote = 0;
+        masks.backslash = 0;
+        masks.op = 0;
+        masks.whitespace = 0;
+
+        for (size_t i = 0; i < BLOCK_SIZE_BYTES; i++) {
+          const uint64_t bit = uint64_t(1) << i;
+          switch (p[i]) {
+            case '"': masks.quote |= bit; break;
+            case '\\': masks.backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': masks.op |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': masks.whitespace |= bit; break;
+          }
+        }
+      }
+      #endif
+
+      // Returns a mask with a bit set for each character in the string that is escaped by a backslash
+      inline uint64_t GetEscapedMask(uint64_t backslash, bool& bIsPreviousEscaped)
+      {
+        uint64_t escaped = (bIsPreviousEscaped ? 1 : 0);
+        bIsPreviousEscaped = false;
+
+        // An escaped backslash doesn't escape the next character
+        uint64_t remaining = backslash & ~escaped;
+
+        // Backslashes are rare outside of a few strings so we just walk through them
+        while (remaining != 0) {
+          const int i = std::countr_zero(remaining);
+          if (i == 63) {
+            bIsPreviousEscaped = true;
+            break;
+          }
+
+          escaped |= (uint64_t(1) << (i + 1));
+          remaining &= ~(uint64_t(3) << i);
+        }
+
+        return escaped;
+      }
+
+      // Each bit is the xor of itself and every bit before it, this turns a mask of quotes into a mask of the insides of strings
+      inline uint64_t PrefixXor(uint64_t bits)
+      {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+      }
+
+      // pSource must be padded with white space up to a multiple of BLOCK_SIZE_BYTES
+      bool FindStructuralCharacters(const char* pSource, size_t nPaddedLengthBytes, std::vector<uint32_t>& structurals)
+      {
+        ASSERT((nPaddedLengthBytes % BLOCK_SIZE_BYTES) == 0);
+
+        structurals.clear();
+        structurals.reserve(nPaddedLengthBytes / 8);
+
+        bool bIsPreviousEscaped = false;
+        uint64_t previousInString = 0;
+        uint64_t previousScalar = 0;
+
+        cBlockMasks masks;
+        for (size_t offset = 0; offset < nPaddedLengthBytes; offset += BLOCK_SIZE_BYTES) {
+          GetBlockMasks(pSource + offset, masks);
+
+          uint64_t escaped = 0;
+          if ((masks.backslash != 0) || bIsPreviousEscaped) escaped = GetEscapedMask(masks.backslash, bIsPreviousEscaped);
+
+          const uint64_t quotes = masks.quote & ~escaped;
+
+          // The opening quote is inside the string and the closing quote is not
+          const uint64_t inString = PrefixXor(quotes) ^ previousInString;
+          previousInString = uint64_t(int64_t(inString) >> 63);
+
+          // The start of each run of characters that are not structural, white space or strings is a number, true, false or null
+          const uint64_t scalar = ~(masks.op | masks.whitespace | masks.quote) & ~inString;
+          const uint64_t scalarStarts = scalar & ~((scalar << 1) | previousScalar);
+          previousScalar = scalar >> 63;
+
+          uint64_t structural = (masks.op & ~inString) | (quotes & inString) | scalarStarts;
+          while (structural != 0) {
+            structurals.push_back(uint32_t(offset + std::countr_zero(structural)));
+            structural &= (structural - 1);
+          }
+        }
+
+        // The source ended inside a string
+        return (previousInString == 0);
+      }
+
+      inline bool IsScalarEnd(char c)
+      {
+        switch (c) {
+          case 0: case ' ': case '\t': case '\n': case '\r': case ',': case '}': case ']': case ':': return true;
+        }
+
+        return false;
+      }
+
+      inline int GetHexValue(char c)
+      {
+        if ((c >= '0') && (c <= '9')) return c - '0';
+        if ((c >= 'a') && (c <= 'f')) return 10 + (c - 'a');
+        if ((c >= 'A') && (c <= 'F')) return 10 + (c - 'A');
+        return -1;
+      }
+
+      bool ReadHex4(const char* p, uint32_t& value)
+      {
+        value = 0;
+        for (size_t i = 0; i < 4; i++) {
+          const int iDigit = GetHexValue(p[i]);
+          if (iDigit < 0) return false;
+          value = (value << 4) | uint32_t(iDigit);
+        }
+
+        return true;
+      }
+
+      char* WriteUTF8(char* pOut, uint32_t c)
+      {
+        if (c < 0x80) {
+          *pOut++ = char(c);
+        } else if (c < 0x800) {
+          *pOut++ = char(0xC0 | (c >> 6));
+          *pOut++ = char(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+          *pOut++ = char(0xE0 | (c >> 12));
+          *pOut++ = char(0x80 | ((c >> 6) & 0x3F));
+          *pOut++ = char(0x80 | (c & 0x3F));
+        } else {
+          *pOut++ = char(0xF0 | (c >> 18));
+          *pOut++ = char(0x80 | ((c >> 12) & 0x3F));
+          *pOut++ = char(0x80 | ((c >> 6) & 0x3F));
+          *pOut++ = char(0x80 | (c & 0x3F));
+        }
+
+        return pOut;
+      }
+    }
+
+
+    // ** cParser
+    // Builds nodes from the structural index, strings are unescaped in place in the document's copy of the source
+
+    class cParser
+    {
+    public:
+      cParser(cDocument& document, bool bIsLazy);
+
+      bool ParseRoot();
+      bool ParseObjectOrArray(cNode& node, uint32_t iOpen, uint32_t& iClose);
+
+    private:
+      char GetCharacter(uint32_t i) const { return pSource[document.structurals[i]]; }
+
+      bool ParseValue(cNode& node, uint32_t& i);
+      bool ParseString(uint32_t i, std::string_view& sValue);
+      bool ParseScalar(cNode& node, uint32_t i);
+      bool SkipObjectOrArray(uint32_t iOpen, uint32_t& iClose) const;
+
+      cDocument& document;
+      char* pSource;
+      const bool bIsLazy;
+      size_t nDepth;
+    };
+
+    cParser::cParser(cDocument& _document, bool _bIsLazy) :
+      document(_document),
+      pSource(_document.pSource),
+      bIsLazy(_bIsLazy),
+      nDepth(0)
+    {
+    }
+
+    bool cParser::ParseRoot()
+    {
+      // There is always a sentinel at the end
+      if (document.structurals.size() < 2) return false;
+
+      uint32_t i = 0;
+      const char c = GetCharacter(i);
+      if ((c == '{') || (c == '[')) {
+        uint32_t iClose = 0;
+        if (!ParseObjectOrArray(document, i, iClose)) return false;
+        i = iClose + 1;
+      } else if (!ParseValue(document, i)) return false;
+
+      // Anything after the root value is an error
+      return (i == (document.structurals.size() - 1));
+    }
+
+    bool cParser::ParseObjectOrArray(cNode& node, uint32_t iOpen, uint32_t& iClose)
+    {
+      const bool bIsObject = (GetCharacter(iOpen) == '{');
+      const char cClose = (bIsObject ? '}' : ']');
+
+      node.type = (bIsObject ? cNode::TYPE::OBJECT : cNode::TYPE::ARRAY);
+
+      if (nDepth >= MAX_DEPTH) return false;
+      nDepth++;
+
+      const size_t nScratchStart = document.scratch.size();
+
+      uint32_t i = iOpen + 1;
+      if (GetCharacter(i) != cClose) {
+        while (true) {
+          cNode* pChild = document.NewNode();
+
+          if (bIsObject) {
+            // "name": value
+            if ((GetCharacter(i) != '"') || !ParseString(i, pChild->sNameUTF8)) return false;
+            i++;
+            if (GetCharacter(i) != ':') return false;
+            i++;
+          }
+
+          if (!ParseValue(*pChild, i)) return false;
+
+          document.scratch.push_back(pChild);
+
+          const char c = GetCharacter(i);
+          if (c == cClose) break;
+          if (c != ',') return false;
+          i++;
+        }
+      }
+
+      iClose = i;
+      nDepth--;
+
+      // Move the children from the scratch stack into the arena
+      const size_t n = document.scratch.size() - nScratchStart;
+      node.pChildren = document.arena.AllocateArray<cNode*>(n);
+      if (n != 0) memcpy(node.pChildren, &document.scratch[nScratchStart], n * sizeof(cNode*));
+      node.nChildren = uint32_t(n);
+      node.nChildrenCapacity = uint32_t(n);
+      document.scratch.resize(nScratchStart);
+
+      return true;
+    }
+
+    bool cParser::SkipObjectOrArray(uint32_t iOpen, uint32_t& iClose) const
+    {
+      // Strings have already been taken out of the index so we only have to count brackets
+      size_t nLevels = 0;
+      for (uint32_t i = iOpen; true; i++) {
+        switch (GetCharacter(i)) {
+          case '{':
+          case '[': {
+            nLevels++;
+            break;
+          }
+          case '}':
+          case ']': {
+            nLevels--;
+            if (nLevels == 0) {
+              iClose = i;
+              return true;
+            }
+            break;
+          }
+          case 0: {
+            // The sentinel
+            return false;
+          }
+        }
+      }
+    }
+
+    bool cParser::ParseValue(cNode& node, uint32_t& i)
+    {
+      const char c = GetCharacter(i);
+      switch (c) {
+        case '{':
+        case '[': {
+          uint32_t iClose = 0;
+          if (bIsLazy) {
+            node.type = ((c == '{') ? cNode::TYPE::OBJECT : cNode::TYPE::ARRAY);
+            node.bIsLazy = true;
+            node.nLazyOpenIndex = i;
+            if (!SkipObjectOrArray(i, iClose)) return false;
+          } else if (!ParseObjectOrArray(node, i, iClose)) return false;
+
+          i = iClose + 1;
+          return true;
+        }
+        case '"': {
+          node.type = cNode::TYPE::STRING;
+          if (!ParseString(i, node.sValueUTF8String)) return false;
+          i++;
+          return true;
+        }
+        case 0:
+        case '}':
+        case ']':
+        case ':':
+        case ',': {
+          return false;
+        }
+      }
+
+      if (!ParseScalar(node, i)) return false;
+      i++;
+      return true;
+    }
+
+    bool cParser::ParseString(uint32_t i, std::string_view& sValue)
+    {
+      char* pStart = pSource + document.structurals[i] + 1;
+      char* pSourceEnd = pSource + document.nSourceLengthBytes;
+
+      // The scanner has already checked that every string is terminated
+      char* pQuote = static_cast<char*>(memchr(pStart, '"', size_t(pSourceEnd - pStart)));
+      ASSERT(pQuote != nullptr);
+
+      char* pBackslash = static_cast<char*>(memchr(pStart, '\\', size_t(pQuote - pStart)));
+      if (pBackslash == nullptr) {
+        // Nothing to unescape
+        sValue = std::string_view(pStart, size_t(pQuote - pStart));
+        return true;
+      }
+
+      // Unescape in place, the unescaped string is never longer than the escaped one
+      const char* pIn = pBackslash;
+      char* pOut = pBackslash;
+      while (*pIn != '"') {
+        if (*pIn != '\\') {
+          *pOut++ = *pIn++;
+          continue;
+        }
+
+        pIn++;
+        switch (*pIn) {
+          case '"': *pOut++ = '"'; pIn++; break;
+          case '\\': *pOut++ = '\\'; pIn++; break;
+          case '/': *pOut++ = '/'; pIn++; break;
+          case 'b': *pOut++ = '\b'; pIn++; break;
+          case 'f': *pOut++ = '\f'; pIn++; break;
+          case 'n': *pOut++ = '\n'; pIn++; break;
+          case 'r': *pOut++ = '\r'; pIn++; break;
+          case 't': *pOut++ = '\t'; pIn++; break;
+          case 'u': {
+            uint32_t c = 0;
+            if (!ReadHex4(pIn + 1, c)) return false;
+            pIn += 5;
+
+            // A surrogate pair for a character outside the basic multilingual plane
+            if ((c >= 0xD800) && (c <= 0xDBFF)) {
+              uint32_t low = 0;
+              if ((pIn[0] != '\\') || (pIn[1] != 'u') || !ReadHex4(pIn + 2, low) || (low < 0xDC00) || (low > 0xDFFF)) return false;
+              pIn += 6;
+              c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            }
+
+            pOut = WriteUTF8(pOut, c);
+            break;
+          }
+          default: {
+            return false;
+          }
+        }
+      }
+
+      sValue = std::string_view(pStart, size_t(pOut - pStart));
+      return true;
+    }
+
+    bool cParser::ParseScalar(cNode& node, uint32_t i)
+    {
+      const char* p = pSource + document.structurals[i];
+
+      const char* pEnd = p;
+      while (!IsScalarEnd(*pEnd)) pEnd++;
+
+      const std::string_view sValue(p, size_t(pEnd - p));
+      if (sValue == "true") {
+        node.SetTypeBool(true);
+        return true;
+      } else if (sValue == "false") {
+        node.SetTypeBool(false);
+        return true;
+      } else if (sValue == "null") {
+        node.SetTypeNull();
+        return true;
+      }
+
+      if (sValue.find_first_of(".eE") == std::string_view::npos) {
+        int64_t iValue = 0;
+        const std::from_chars_result result = std::from_chars(p, pEnd, iValue);
+        if ((result.ec == std::errc()) && (result.ptr == pEnd)) {
+          if ((iValue >= std::numeric_limits<int>::min()) && (iValue <= std::numeric_limits<int>::max())) node.SetTypeInt(int(iValue));
+          else node.SetTypeFloat(double(iValue));
+          return true;
+        }
+
+        // Too big for an int64_t so fall through and read it as a float
+      }
+
+      double dValue = 0.0;
+      const std::from_chars_result result = std::from_chars(p, pEnd, dValue);
+      if ((result.ec != std::errc()) || (result.ptr != pEnd)) return false;
+
+      node.SetTypeFloat(dValue);
+      return true;
+    }
+
+
+    // ** cNode
+
+    cNode::cNode(cDocument& document) :
+      pDocument(&document),
       type(TYPE::NULL_),
-      iValueInt(0),
-      dValueFloat(0.0),
-      bValueBool(false)
+      bIsLazy(false),
+      nLazyOpenIndex(0),
+      pChildren(nullptr),
+      nChildren(0),
+      nChildrenCapacity(0),
+      dValueFloat(0.0)
     {
     }
 
-    cNode::~cNode()
+    void cNode::Materialise() const
+    {
+      ASSERT(bIsLazy);
+      bIsLazy = false;
+
+      cParser parser(*pDocument, true);
+      uint32_t iClose = 0;
+      if (!parser.ParseObjectOrArray(const_cast<cNode&>(*this), nLazyOpenIndex, iClose)) {
+        #ifndef FIRESTARTER
+        gLog.Error("JSON", "cNode::Materialise Error parsing \"" + GetName() + "\"");
+        #endif
+        pChildren = nullptr;
+        nChildren = 0;
+        nChildrenCapacity = 0;
+      }
+    }
+
+    std::span<cNode* const> cNode::GetValueObjectOrArray() const
     {
-      // Delete all children for the object or array vector
-      // NOTE: There could be children no matter what the type as the type may have changed since they were added
-      const size_t n = vValueObjectOrArray.size();
-      for (size_t i = 0; i < n; i++) SAFE_DELETE(vValueObjectOrArray[i]);
+      ASSERT((type == TYPE::OBJECT) || (type == TYPE::ARRAY));
+      if (bIsLazy) Materialise();
+      return std::span<cNode* const>(pChildren, nChildren);
     }
 
     cNode* cNode::CreateNode()
     {
-      return new cNode;
+      return pDocument->NewNode();
     }
 
     cNode* cNode::CreateNode(const std::string& _sName)
     {
-      cNode* pNode = new cNode;
+      cNode* pNode = pDocument->NewNode();
       pNode->SetName(_sName);
       return pNode;
     }
@@ -61,14 +608,27 @@ namespace spitfire
     void cNode::AppendChild(cNode* pChild)
     {
       ASSERT((type == TYPE::OBJECT) || (type == TYPE::ARRAY));
-      vValueObjectOrArray.push_back(pChild);
+      ASSERT(pChild->pDocument == pDocument);
+
+      if (bIsLazy) Materialise();
+
+      if (nChildren == nChildrenCapacity) {
+        // Grow the array, the old one is left in the arena until the document is cleared
+        const uint32_t nNewCapacity = std::max<uint32_t>(4, 2 * nChildrenCapacity);
+        cNode** pNewChildren = pDocument->arena.AllocateArray<cNode*>(nNewCapacity);
+        if (nChildren != 0) memcpy(pNewChildren, pChildren, nChildren * sizeof(cNode*));
+        pChildren = pNewChildren;
+        nChildrenCapacity = nNewCapacity;
+      }
+
+      pChildren[nChildren++] = pChild;
     }
 
     const cNode* cNode::GetChild(const std::string& sName) const
     {
       ASSERT(type == TYPE::OBJECT);
-      for (auto&& item : vValueObjectOrArray) {
-        if (item->GetName() == sName) {
+      for (auto&& item : GetValueObjectOrArray()) {
+        if (item->sNameUTF8 == sName) {
           return item;
         }
       }
@@ -79,8 +639,8 @@ namespace spitfire
     cNode* cNode::GetChild(const std::string& sName)
     {
       ASSERT(type == TYPE::OBJECT);
-      for (auto&& item : vValueObjectOrArray) {
-        if (item->GetName() == sName) {
+      for (auto&& item : GetValueObjectOrArray()) {
+        if (item->sNameUTF8 == sName) {
           return item;
         }
       }
@@ -88,18 +648,31 @@ namespace spitfire
       return nullptr;
     }
 
+    void cNode::SetName(const std::string& sName)
+    {
+      sNameUTF8 = pDocument->arena.CopyString(sName);
+    }
+
+    void cNode::SetTypeString(const std::string& sValue)
+    {
+      type = TYPE::STRING;
+      sValueUTF8String = pDocument->arena.CopyString(sValue);
+    }
+
     void cNode::Clear()
     {
+      // The children and strings stay in the arena until the document is cleared
       type = TYPE::NULL_;
-      sNameUTF8.clear();
+      sNameUTF8 = std::string_view();
 
-      const size_t n = vValueObjectOrArray.size();
-      for (size_t i = 0; i < n; i++) SAFE_DELETE(vValueObjectOrArray[i]);
+      pChildren = nullptr;
+      nChildren = 0;
+      nChildrenCapacity = 0;
+      bIsLazy = false;
+      nLazyOpenIndex = 0;
 
-      sValueUTF8String.clear();
-      iValueInt = 0;
+      sValueUTF8String = std::string_view();
       dValueFloat = 0.0;
-      bValueBool = false;
     }
 
     std::string cNode::GetValueString() const
@@ -120,14 +693,14 @@ namespace spitfire
         }
       }
 
-      return sValueUTF8String;
+      return std::string(sValueUTF8String);
     }
 
     bool cNode::GetAttribute(const std::string& sAttribute, uint8_t& value) const
     {
       ASSERT(type == TYPE::OBJECT);
-      for (auto&& item : vValueObjectOrArray) {
-        if (item->GetName() == sAttribute) {
+      for (auto&& item : GetValueObjectOrArray()) {
+        if (item->sNameUTF8 == sAttribute) {
           const int iValue = item->GetValueInt();
           if ((iValue >= 0) && (iValue <= 0xff)) {
             value = static_cast<uint8_t>(iValue);
@@ -144,8 +717,8 @@ namespace spitfire
     bool cNode::GetAttribute(const std::string& sAttribute, uint16_t& value) const
     {
       ASSERT(type == TYPE::OBJECT);
-      for (auto&& item : vValueObjectOrArray) {
-        if (item->GetName() == sAttribute) {
+      for (auto&& item : GetValueObjectOrArray()) {
+        if (item->sNameUTF8 == sAttribute) {
           const int iValue = item->GetValueInt();
           if ((iValue >= 0) && (iValue <= 0xffff)) {
             value = static_cast<uint16_t>(iValue);
@@ -162,8 +735,8 @@ namespace spitfire
     bool cNode::GetAttribute(const std::string& sAttribute, std::string& value) const
     {
       ASSERT(type == TYPE::OBJECT);
-      for (auto&& item : vValueObjectOrArray) {
-        if (item->GetName() == sAttribute) {
+      for (auto&& item : GetValueObjectOrArray()) {
+        if (item->sNameUTF8 == sAttribute) {
           value = item->GetValueString();
           return true;
         }
@@ -174,61 +747,92 @@ namespace spitfire
 
     void cNode::SetAttribute(const std::string& sAttribute, const char* szValue)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeString(szValue);
     }
 
     void cNode::SetAttribute(const std::string& sAttribute, const wchar_t* szValue)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeString(spitfire::string::ToUTF8(szValue));
     }
 
     void cNode::SetAttribute(const std::string& sAttribute, const std::string& sValue)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeString(sValue);
     }
 
     void cNode::SetAttribute(const std::string& sAttribute, const std::wstring& sValue)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeString(spitfire::string::ToUTF8(sValue));
     }
 
     void cNode::SetAttribute(const std::string& sAttribute, const bool value)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeBool(value);
     }
 
     void cNode::SetAttribute(const std::string& sAttribute, const uint64_t value)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeInt(value);
     }
 
     void cNode::SetAttribute(const std::string& sAttribute, const int64_t value)
     {
-      cNode* pNode = CreateNode(sAttribute.c_str());
+      cNode* pNode = CreateNode(sAttribute);
       AppendChild(pNode);
       pNode->SetTypeInt(value);
     }
 
 
+    // ** cDocument
+
+    cDocument::cDocument() :
+      cNode(*this),
+      pSource(nullptr),
+      nSourceLengthBytes(0)
+    {
+    }
+
+    void cDocument::Clear()
+    {
+      cNode::Clear();
+
+      pSource = nullptr;
+      nSourceLengthBytes = 0;
+      std::vector<uint32_t>().swap(structurals);
+      scratch.clear();
+
+      arena.Clear();
+    }
+
+    cNode* cDocument::NewNode()
+    {
+      return new (arena.Allocate(sizeof(cNode), alignof(cNode))) cNode(*this);
+    }
+
+
     // ** reader
 
-    bool reader::ReadFromFile(cDocument& doc, const string_t& filename) const
+    reader::reader() :
+      bIsLazy(false)
     {
-      std::ifstream f(spitfire::string::ToUTF8(filename).c_str());
+    }
 
-      if (!f.is_open()) {
+    bool reader::ReadFromFile(cDocument& doc, const string_t& filename) const
+    {
+      storage::cMemoryMappedFile file;
+      if (!file.Open(filename)) {
 #ifndef FIRESTARTER
         gLog.Error("JSON", spitfire::string::ToUTF8(filename) + " not found, returning false");
         CONSOLE<<"JSON "<<filename<<" not found, returning false"<<std::endl;
@@ -236,232 +840,83 @@ namespace spitfire
         return false;
       }
 
-      std::ostringstream o;
-      std::string line;
-      while(!f.eof()) {
-        std::getline(f, line);
-        o<<line;
-      }
-      f.close();
-
-      const std::string content = o.str();
-
-      return ReadFromStringUTF8(doc, content);
+      return ReadFromStringUTF8(doc, file.GetView());
     }
 
-    bool reader::ReadFromStringUTF8(cDocument& doc, const std::string& content) const
+    bool reader::ReadFromStringUTF8(cDocument& doc, std::string_view content) const
     {
       doc.Clear();
-      doc.SetTypeObject();
 
-      string::cStringParserUTF8 sp(content);
-      if (sp.IsEnd()) return false;
+      if (content.length() >= std::numeric_limits<uint32_t>::max()) return false;
 
-      return ReadObjectOrArray(doc, sp);
-    }
-
-    bool reader::ReadObjectOrArray(cNode& object, string::cStringParserUTF8& sp) const
-    {
-      sp.SkipWhiteSpace();
+      // Copy the source into the arena padded with white space to a whole number of blocks, so that the scanner can
+      // always read whole blocks and we always have at least one byte at the end for the sentinel
+      const size_t nPaddedLengthBytes = ((content.length() / BLOCK_SIZE_BYTES) + 1) * BLOCK_SIZE_BYTES;
+      doc.pSource = static_cast<char*>(doc.arena.Allocate(nPaddedLengthBytes, BLOCK_SIZE_BYTES));
+      doc.nSourceLengthBytes = content.length();
+      if (!content.empty()) memcpy(doc.pSource, content.data(), content.length());
+      memset(doc.pSource + content.length(), ' ', nPaddedLengthBytes - content.length());
 
-      char c = sp.GetCharacter();
-      if ((c != '{') && (c != '[')) {
-        std::cout<<"reader::ReadObjectOrArray This is not an object or array, returning false"<<std::endl;
+      if (!FindStructuralCharacters(doc.pSource, nPaddedLengthBytes, doc.structurals)) {
+        LOG("Unterminated string, returning false");
+        doc.Clear();
         return false;
       }
 
-      sp.SkipCharacter();
-
-      while (true) {
-        if (sp.IsEnd()) {
-          std::cout<<"reader::ReadObjectOrArray At end of string, returning false"<<std::endl;
-          return false;
-        }
-
-        sp.SkipWhiteSpace();
-        c = sp.GetCharacter();
-        if ((c == '}') || (c == ']')) {
-          // Skip the closing bracket
-          sp.SkipCharacter();
-          if (sp.IsEnd()) break;
+      // Add a sentinel so that the parser never runs off the end
+      doc.pSource[content.length()] = 0;
+      doc.structurals.push_back(uint32_t(content.length()));
 
-          sp.SkipWhiteSpace();
-          if (sp.IsEnd()) break;
-          // If we have a comma at the end of the line then we need to skip it
-          if (sp.GetCharacter() == ',') sp.SkipCharacter();
+      cParser parser(doc, bIsLazy);
+      if (!parser.ParseRoot()) {
+        LOG("Error parsing JSON, returning false");
+        doc.Clear();
+        return false;
+      }
 
-          break;
-        }
+      // Only lazy documents need the index again
+      if (!bIsLazy) std::vector<uint32_t>().swap(doc.structurals);
+      doc.scratch.clear();
 
-        c = sp.GetCharacter();
-        if (sp.GetCharacters(4) == "null") {
-          sp.SkipCharacters(4);
-          cNode* pNull = object.CreateNode();
-          pNull->SetTypeNull();
-          object.AppendChild(pNull);
-
-          sp.SkipWhiteSpace();
-          // If we have a comma at the end of the line then we need to skip it
-          if (sp.GetCharacter() == ',') sp.SkipCharacter();
-        } else if (c == '{') {
-          cNode* pObject = object.CreateNode();
-          pObject->SetTypeObject();
-          object.AppendChild(pObject);
-          if (!ReadObjectOrArray(*pObject, sp)) {
-            std::cout<<"reader::ReadObjectOrArray Error reading object, returning false"<<std::endl;
-            return false;
-          }
-        } else if (c == '[') {
-          cNode* pArray = object.CreateNode();
-          pArray->SetTypeArray();
-          object.AppendChild(pArray);
-          if (!ReadObjectOrArray(*pArray, sp)) {
-            std::cout<<"reader::ReadObjectOrArray Error reading array, returning false"<<std::endl;
-            return false;
-          }
-        } else {
-          std::string sName;
-          if (!ReadString(sName, sp)) {
-            std::cout<<"reader::ReadObjectOrArray Error reading string, returning false"<<std::endl;
-            return false;
-          }
+      return true;
+    }
 
-          sp.SkipWhiteSpace();
-          c = sp.GetCharacter();
-          switch (c) {
-            case '{': {
-              cNode* pObject = object.CreateNode();
-              pObject->SetName(sName);
-              pObject->SetTypeObject();
 
-              object.AppendChild(pObject);
-              if (!ReadObjectOrArray(*pObject, sp)) {
-                std::cout<<"reader::ReadObjectOrArray Error reading object, returning false"<<std::endl;
-                return false;
-              }
+    // ** writer
 
-              // If we have a comma at the end of the line then we need to skip it
-              if (sp.GetCharacter() == ',') sp.SkipCharacter();
+    namespace
+    {
+      std::string EscapeString(std::string_view sValue)
+      {
+        std::string sEscaped;
+        sEscaped.reserve(sValue.length());
 
-              break;
-            }
-            case ':': {
-              sp.SkipCharacter();
-              sp.SkipWhiteSpace();
-
-              c = sp.GetCharacter();
-              if (c == '{') {
-                cNode* pObject = object.CreateNode();
-                pObject->SetName(sName);
-                pObject->SetTypeObject();
-                object.AppendChild(pObject);
-                if (!ReadObjectOrArray(*pObject, sp)) {
-                  std::cout<<"reader::ReadObjectOrArray Error reading object, returning false"<<std::endl;
-                  return false;
-                }
-              } else if (c == '[') {
-                cNode* pArray = object.CreateNode();
-                pArray->SetName(sName);
-                pArray->SetTypeArray();
-                object.AppendChild(pArray);
-                if (!ReadObjectOrArray(*pArray, sp)) {
-                  std::cout<<"reader::ReadObjectOrArray Error reading array, returning false"<<std::endl;
-                  return false;
-                }
-              } else if (c == '"') {
-                // Read a string value
-                std::string sValue;
-                if (!ReadString(sValue, sp))  {
-                  std::cout<<"reader::ReadObjectOrArray Error reading string, returning false"<<std::endl;
-                  return false;
-                }
-
-                cNode* pProperty = object.CreateNode();
-                pProperty->SetName(sName);
-                pProperty->SetTypeString(sValue);
-                object.AppendChild(pProperty);
-              } else {
-                // Read the value
-                std::string sValue;
-                while (true) {
-                  if (sp.IsEnd()) {
-                    #ifndef FIRESTARTER
-                    gLog.Error("JSON", "Unexpected end of string while reading value, returning false");
-                    #endif
-                    return false;
-                  }
-
-                  c = sp.GetCharacter();
-                  if ((c == ',') || (c == '}') || spitfire::string::IsWhiteSpace(c)) break;
-                  else {
-                    sValue += c;
-                    sp.SkipCharacter();
-                  }
-                }
-
-                //std::cout<<"Value \""<<sValue<<"\""<<std::endl;
-                cNode* pProperty = object.CreateNode();
-                object.AppendChild(pProperty);
-                pProperty->SetName(sName);
-
-                if ((sValue == "true") || (sValue == "false")) {
-                  //std::cout<<"Found bool"<<std::endl;
-                  // Read a boolean
-                  const bool bIsValueTrue = (sValue == "true");
-                  pProperty->SetTypeBool(bIsValueTrue);
-                } else if (sValue.find('.') != std::string::npos) {
-                  //std::cout<<"Found float"<<std::endl;
-                  // Read a float value
-                  const double dValueFloat = string::ToFloat(string::ToString(sValue));
-                  pProperty->SetTypeFloat(dValueFloat);
-                } else {
-                  //std::cout<<"Found int"<<std::endl;
-                  // Read an int value
-                  const int iValueInt = string::ToInt(string::ToString(sValue));
-                  pProperty->SetTypeInt(iValueInt);
-                }
-              }
-
-              // If we have a comma at the end of the line then we need to skip it
-              if (sp.GetCharacter() == ',') sp.SkipCharacter();
-
-              break;
-            }
+        for (char c : sValue) {
+          switch (c) {
+            case '"': sEscaped += "\\\""; break;
+            case '\\': sEscaped += "\\\\"; break;
+            case '\b': sEscaped += "\\b"; break;
+            case '\f': sEscaped += "\\f"; break;
+            case '\n': sEscaped += "\\n"; break;
+            case '\r': sEscaped += "\\r"; break;
+            case '\t': sEscaped += "\\t"; break;
             default: {
-              std::cout<<"Unexpected character '"<<c<<"' in object"<<std::endl;
-              return false;
+              if (static_cast<unsigned char>(c) < 0x20) {
+                // Other control characters
+                const char* szHex = "0123456789abcdef";
+                sEscaped += "\\u00";
+                sEscaped += szHex[(c >> 4) & 0xF];
+                sEscaped += szHex[c & 0xF];
+              } else sEscaped += c;
             }
           }
         }
-      }
-
-      return true;
-    }
-
-    bool reader::ReadString(std::string& sValue, string::cStringParserUTF8& sp) const
-    {
-      char c = sp.GetCharacterAndSkip();
-      if (c != '"') return false;
-
-      while (true) {
 
-        if (sp.IsEnd()) return false;
-
-        c = sp.GetCharacterAndSkip();
-        if (c == '"') break;
-        else if ((c == '\\') && (sp.GetCharacter() == '"')) {
-          // Handle "\""
-          sp.SkipCharacter();
-          sValue += "\"";
-        } else sValue += c;
+        return sEscaped;
       }
-
-      return true;
     }
 
 
-    // ** writer
-
     bool writer::WriteToFile(const cDocument& doc, const string_t& filename) const
     {
       std::ofstream f(spitfire::string::ToUTF8(filename).c_str());
@@ -474,7 +929,7 @@ namespace spitfire
       }
 
       // Write the root object to the file
-      WriteObjectOrArray(doc, f, "");
+      WriteObjectOrArray(doc, f, "", false);
       f<<std::endl;
 
       f.close();
@@ -488,16 +943,15 @@ namespace spitfire
 
       // Write the root object to the string
       std::ostringstream o;
-      WriteObjectOrArray(doc, o, "");
+      WriteObjectOrArray(doc, o, "", false);
       content = o.str() + "\n";
 
       return bResult;
     }
 
-    bool writer::WriteObjectOrArray(const cNode& object, std::ostream& o, const std::string& _sTabs) const
+    bool writer::WriteObjectOrArray(const cNode& object, std::ostream& o, const std::string& _sTabs, bool bIsNamed) const
     {
-      const std::string sName = object.GetName();
-      if (!sName.empty()) o<<_sTabs<<"\""<<sName<<"\":"<<std::endl;
+      if (bIsNamed) o<<_sTabs<<"\""<<EscapeString(object.GetNameView())<<"\":"<<std::endl;
 
       if (object.IsTypeObject()) o<<_sTabs<<"{"<<std::endl;
       else o<<_sTabs<<"["<<std::endl;
@@ -505,19 +959,21 @@ namespace spitfire
       {
         const std::string sTabs = _sTabs + "  ";
 
-        const std::vector<cNode*>& children = object.GetValueObjectOrArray();
+        // Only the members of an object have names
+        const bool bIsChildNamed = object.IsTypeObject();
+
+        const std::span<cNode* const> children = object.GetValueObjectOrArray();
         const size_t n = children.size();
-        std::cout<<"child with "<<n<<" children"<<std::endl;
         for (size_t i = 0; i < n; i++) {
           const cNode& child = *children[i];
-          if (child.IsTypeNull()) {
-            o<<sTabs<<"null";
-          } else if (child.IsTypeObject() || child.IsTypeArray()) {
-            if (!WriteObjectOrArray(child, o, sTabs)) return false;
+          if (child.IsTypeObject() || child.IsTypeArray()) {
+            if (!WriteObjectOrArray(child, o, sTabs, bIsChildNamed)) return false;
           } else {
-            o<<sTabs<<"\""<<child.GetName()<<"\": ";
+            o<<sTabs;
+            if (bIsChildNamed) o<<"\""<<EscapeString(child.GetNameView())<<"\": ";
 
-            if (child.IsTypeString()) o<<"\""<<child.GetValueString()<<"\"";
+            if (child.IsTypeNull()) o<<"null";
+            else if (child.IsTypeString()) o<<"\""<<EscapeString(child.GetValueStringView())<<"\"";
             else if (child.IsTypeInt()) o<<child.GetValueInt();
             else if (child.IsTypeFloat()) o<<child.GetValueFloat();
             else if (child.IsTypeBool()) o<<spitfire::string::ToUTF8(spitfire::string::ToString(child.GetValueBool()));
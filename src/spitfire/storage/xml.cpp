@@ -24,12 +24,262 @@
 #include <spitfire/util/log.h>
 #endif
 
+#include <spitfire/storage/file.h>
 #include <spitfire/storage/xml.h>
 
 namespace spitfire
 {
   namespace xml
   {
+    namespace
+    {
+      inline bool IsWhiteSpace(char c)
+      {
+        return ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'));
+      }
+
+      // Names end at white space, the end of a tag or the start of an attribute value
+      inline bool IsNameEnd(char c)
+      {
+        return (IsWhiteSpace(c) || (c == '/') || (c == '>') || (c == '='));
+      }
+
+      inline bool StartsWith(const char* p, const char* pEnd, std::string_view sFind)
+      {
+        return ((size_t(pEnd - p) >= sFind.length()) && (memcmp(p, sFind.data(), sFind.length()) == 0));
+      }
+
+      std::string_view TrimWhiteSpace(const char* pFirst, const char* pLast)
+      {
+        while ((pFirst != pLast) && IsWhiteSpace(*pFirst)) pFirst++;
+        while ((pLast != pFirst) && IsWhiteSpace(*(pLast - 1))) pLast--;
+        return std::string_view(pFirst, size_t(pLast - pFirst));
+      }
+    }
+
+
+    // ** cPullParser
+
+    cPullParser::cPullParser(std::string_view sData) :
+      pBegin(sData.data()),
+      pEnd(sData.data() + sData.length()),
+      p(sData.data()),
+      state(STATE::CONTENT),
+      bIsXMLDeclarationFound(false)
+    {
+      // Skip the UTF-8 byte order mark
+      if (StartsWith(p, pEnd, "\xEF\xBB\xBF")) p += 3;
+    }
+
+    EVENT cPullParser::SetError(const std::string& sDescription)
+    {
+      state = STATE::ERROR;
+      sError = sDescription + " at offset " + spitfire::string::ToUTF8(spitfire::string::ToString(GetOffset()));
+      sName = std::string_view();
+      sValue = std::string_view();
+      return EVENT::ERROR;
+    }
+
+    bool cPullParser::SkipPast(std::string_view sFind)
+    {
+      const std::string_view sRemaining(p, size_t(pEnd - p));
+      const size_t i = sRemaining.find(sFind);
+      if (i == std::string_view::npos) return false;
+
+      p += i + sFind.length();
+      return true;
+    }
+
+    EVENT cPullParser::Next()
+    {
+      if (state == STATE::ERROR) return EVENT::ERROR;
+
+      if (state == STATE::START_TAG) {
+        // Attributes of the element we just started
+        while ((p != pEnd) && IsWhiteSpace(*p)) p++;
+        if (p == pEnd) return SetError("Unterminated tag \"" + std::string(openElements.back()) + "\"");
+
+        if (*p == '>') {
+          p++;
+          state = STATE::CONTENT;
+        } else if (*p == '/') {
+          // <element/>
+          if (!StartsWith(p, pEnd, "/>")) return SetError("Expected \"/>\" in tag \"" + std::string(openElements.back()) + "\"");
+          p += 2;
+          state = STATE::CONTENT;
+          sName = openElements.back();
+          sValue = std::string_view();
+          openElements.pop_back();
+          return EVENT::END_ELEMENT;
+        } else {
+          // name="value", name='value', name=value or just name
+          const char* pName = p;
+          while ((p != pEnd) && !IsNameEnd(*p)) p++;
+          sName = std::string_view(pName, size_t(p - pName));
+          if (sName.empty()) return SetError("Invalid attribute in tag \"" + std::string(openElements.back()) + "\"");
+
+          while ((p != pEnd) && IsWhiteSpace(*p)) p++;
+
+          sValue = std::string_view();
+          if ((p != pEnd) && (*p == '=')) {
+            p++;
+            while ((p != pEnd) && IsWhiteSpace(*p)) p++;
+            if (p == pEnd) return SetError("Unterminated attribute \"" + std::string(sName) + "\"");
+
+            if ((*p == '\"') || (*p == '\'')) {
+              const char quote = *p;
+              p++;
+              const char* pValue = p;
+
+              // Older versions of writer escaped quotes inside values with a backslash
+              while ((p != pEnd) && (*p != quote)) {
+                if ((*p == '\\') && ((p + 1) != pEnd) && (*(p + 1) == quote)) p++;
+                p++;
+              }
+              if (p == pEnd) return SetError("Unterminated value for attribute \"" + std::string(sName) + "\"");
+
+              sValue = std::string_view(pValue, size_t(p - pValue));
+              p++;
+            } else {
+              const char* pValue = p;
+              while ((p != pEnd) && !IsWhiteSpace(*p) && (*p != '>') && !StartsWith(p, pEnd, "/>")) p++;
+              sValue = std::string_view(pValue, size_t(p - pValue));
+            }
+          }
+
+          return EVENT::ATTRIBUTE;
+        }
+      }
+
+      while (true) {
+        while ((p != pEnd) && IsWhiteSpace(*p)) p++;
+
+        if (p == pEnd) {
+          if (!openElements.empty()) return SetError("Element \"" + std::string(openElements.back()) + "\" is not closed");
+
+          sName = std::string_view();
+          sValue = std::string_view();
+          return EVENT::END_OF_DOCUMENT;
+        }
+
+        if (*p != '<') {
+          // Text up to the next tag
+          const char* pText = p;
+          const char* pTag = static_cast<const char*>(memchr(p, '<', size_t(pEnd - p)));
+          if (pTag == nullptr) pTag = pEnd;
+          p = pTag;
+
+          sName = std::string_view();
+          sValue = TrimWhiteSpace(pText, pTag);
+          return EVENT::TEXT;
+        }
+
+        if (StartsWith(p, pEnd, "<!--")) {
+          p += 4;
+          if (!SkipPast("-->")) return SetError("Unterminated comment");
+          continue;
+        }
+
+        if (StartsWith(p, pEnd, "<?")) {
+          // <?xml version="1.0"?>, but not <?xml-stylesheet ...?>
+          if (StartsWith(p, pEnd, "<?xml") && ((p + 5) != pEnd) && (IsWhiteSpace(*(p + 5)) || (*(p + 5) == '?'))) bIsXMLDeclarationFound = true;
+          p += 2;
+          if (!SkipPast("?>")) return SetError("Unterminated processing instruction");
+          continue;
+        }
+
+        if (StartsWith(p, pEnd, "<![CDATA[")) {
+          p += 9;
+          const char* pText = p;
+          if (!SkipPast("]]>")) return SetError("Unterminated CDATA section");
+
+          sName = std::string_view();
+          sValue = std::string_view(pText, size_t(p - 3 - pText));
+          if (sValue.empty()) continue;
+          return EVENT::TEXT;
+        }
+
+        if (StartsWith(p, pEnd, "<!")) {
+          // <!DOCTYPE ...>
+          p += 2;
+          if (!SkipPast(">")) return SetError("Unterminated declaration");
+          continue;
+        }
+
+        if (StartsWith(p, pEnd, "</")) {
+          p += 2;
+          const char* pName = p;
+          const char* pClose = static_cast<const char*>(memchr(p, '>', size_t(pEnd - p)));
+          if (pClose == nullptr) return SetError("Unterminated closing tag");
+          p = pClose + 1;
+
+          sName = TrimWhiteSpace(pName, pClose);
+          sValue = std::string_view();
+          if (openElements.empty()) return SetError("Closing tag \"" + std::string(sName) + "\" without an opening tag");
+          if (sName != openElements.back()) return SetError("Opening tag \"" + std::string(openElements.back()) + "\" doesn't match closing tag \"" + std::string(sName) + "\"");
+
+          openElements.pop_back();
+          return EVENT::END_ELEMENT;
+        }
+
+        // <element
+        p++;
+        const char* pName = p;
+        while ((p != pEnd) && !IsNameEnd(*p)) p++;
+        sName = std::string_view(pName, size_t(p - pName));
+        sValue = std::string_view();
+        if (sName.empty()) return SetError("Tag without a name");
+
+        openElements.push_back(sName);
+        state = STATE::START_TAG;
+        return EVENT::START_ELEMENT;
+      }
+    }
+
+
+    util::PROCESS_RESULT ParseSAX(util::cProcessInterface& interface, std::string_view sData, cSAXListener& listener)
+    {
+      cPullParser parser(sData);
+
+      size_t nProcessedEvents = 0;
+      while (true) {
+        // Checking for a stop request is slow so only do it every now and then
+        if (nProcessedEvents > 1000) {
+          if (interface.IsToStop()) return util::PROCESS_RESULT::STOPPED_BY_INTERFACE;
+          nProcessedEvents = 0;
+        }
+
+        nProcessedEvents++;
+
+        switch (parser.Next()) {
+          case EVENT::START_ELEMENT: {
+            listener.OnStartElement(parser.GetName());
+            break;
+          }
+          case EVENT::ATTRIBUTE: {
+            listener.OnAttribute(parser.GetName(), parser.GetValue());
+            break;
+          }
+          case EVENT::TEXT: {
+            listener.OnText(parser.GetValue());
+            break;
+          }
+          case EVENT::END_ELEMENT: {
+            listener.OnEndElement(parser.GetName());
+            break;
+          }
+          case EVENT::END_OF_DOCUMENT: {
+            return util::PROCESS_RESULT::COMPLETE;
+          }
+          case EVENT::ERROR: {
+            LOG(parser.GetError());
+            return util::PROCESS_RESULT::FAILED;
+          }
+        }
+      }
+    }
+
+
     // ** reader
 
     util::PROCESS_RESULT reader::ReadFromFile(util::cProcessInterface& interface, document::cDocument& doc, const string_t& filename) const
@@ -46,6 +296,17 @@ namespace spitfire
       return doc.LoadFromString(interface, content);
     }
 
+    util::PROCESS_RESULT reader::ParseFile(util::cProcessInterface& interface, cSAXListener& listener, const string_t& filename) const
+    {
+      storage::cMemoryMappedFile file;
+      if (!file.Open(filename)) {
+        LOG("XML \"", spitfire::string::ToString(filename), "\" not found, returning false");
+        return util::PROCESS_RESULT::FAILED;
+      }
+
+      return ParseSAX(interface, file.GetView(), listener);
+    }
+
 
     // ** writer
 
@@ -0,0 +1,63 @@
+// Standard headers
+#include <algorithm>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/arena.h>
+
+namespace spitfire
+{
+  namespace util
+  {
+    // ** cArena
+
+    cArena::cArena(size_t _nBlockSizeBytes) :
+      nBlockSizeBytes(std::max<size_t>(256, _nBlockSizeBytes)),
+      pCurrent(nullptr),
+      pEnd(nullptr),
+      nAllocatedBytes(0)
+    {
+    }
+
+    cArena::~cArena()
+    {
+      for (auto& block : blocks) delete [] block.pData;
+    }
+
+    void* cArena::AllocateFromNewBlock(size_t nBytes, size_t nAlignment)
+    {
+      // Large allocations get a block of their own so that we don't waste the rest of a normal sized block
+      const size_t nSizeBytes = std::max(nBlockSizeBytes, nBytes + nAlignment);
+
+      cBlock block;
+      block.pData = new uint8_t[nSizeBytes];
+      block.nSizeBytes = nSizeBytes;
+      blocks.push_back(block);
+      nAllocatedBytes += nSizeBytes;
+
+      pCurrent = block.pData;
+      pEnd = block.pData + nSizeBytes;
+
+      return Allocate(nBytes, nAlignment);
+    }
+
+    void cArena::Clear()
+    {
+      if (blocks.empty()) return;
+
+      // Keep the largest block, it is probably the right size for the next time we are used
+      std::vector<cBlock>::iterator iterLargest = std::max_element(blocks.begin(), blocks.end(), [](const cBlock& lhs, const cBlock& rhs) { return (lhs.nSizeBytes < rhs.nSizeBytes); });
+      const cBlock largest = *iterLargest;
+      blocks.erase(iterLargest);
+
+      for (auto& block : blocks) delete [] block.pData;
+      blocks.clear();
+
+      blocks.push_back(largest);
+      nAllocatedBytes = largest.nSizeBytes;
+
+      pCurrent = largest.pData;
+      pEnd = largest.pData + largest.nSizeBytes;
+    }
+  }
+}
@@ -0,0 +1,253 @@
+// Standard headers
+#include <cassert>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/log.h>
+#include <spitfire/util/threadpool.h>
+
+namespace spitfire
+{
+  namespace util
+  {
+    // The pool and index of the worker that is running on this thread, if any
+    THREAD_LOCAL cThreadPool* pCurrentThreadPool = nullptr;
+    THREAD_LOCAL size_t currentWorkerIndex = 0;
+
+
+    // ** cThreadPoolWorker
+
+    class cThreadPoolWorker : public cThread
+    {
+    public:
+      cThreadPoolWorker(cThreadPool& pool, size_t index);
+
+    private:
+      virtual void ThreadFunction() override;
+
+      cThreadPool& pool;
+      const size_t index;
+
+      cSignalObject soAction;
+    };
+
+    cThreadPoolWorker::cThreadPoolWorker(cThreadPool& _pool, size_t _index) :
+      cThread(soAction, TEXT("cThreadPoolWorker")),
+      pool(_pool),
+      index(_index),
+      soAction(TEXT("cThreadPoolWorker_soAction"))
+    {
+    }
+
+    void cThreadPoolWorker::ThreadFunction()
+    {
+      pool.WorkerThreadFunction(index);
+    }
+
+
+    // ** cTaskHandle
+
+    void cTaskHandle::Wait() const
+    {
+      ASSERT(IsValid());
+
+      if (pPool->IsWorkerThread()) {
+        // Blocking a worker could deadlock the pool if the task we are waiting on is sitting in a queue, so help out instead
+        while (!pTask->bIsDone.load()) {
+          if (!pPool->RunPendingTask()) YieldThisThread();
+        }
+        return;
+      }
+
+      std::unique_lock<std::mutex> lock(pTask->mutex);
+      pTask->condition.wait(lock, [this]() { return pTask->bIsDone.load(); });
+    }
+
+    cTaskHandle cTaskHandle::Then(const std::function<void()>& function) const
+    {
+      ASSERT(IsValid());
+
+      std::shared_ptr<cTask> pContinuation = std::make_shared<cTask>(function);
+
+      {
+        std::lock_guard<std::mutex> lock(pTask->mutex);
+        if (!pTask->bIsDone.load()) {
+          // The continuation will be submitted when this task completes
+          pTask->continuations.push_back(pContinuation);
+          return cTaskHandle(*pPool, pContinuation);
+        }
+      }
+
+      // This task is already done so we can submit the continuation straight away
+      pPool->Enqueue(pContinuation);
+
+      return cTaskHandle(*pPool, pContinuation);
+    }
+
+
+    // ** cThreadPool
+
+    cThreadPool::cThreadPool(size_t nThreads) :
+      nPendingTasks(0),
+      nSleepingWorkers(0),
+      bIsStopping(false)
+    {
+      if (nThreads == 0) nThreads = GetRecommendedConcurrentThreadCount();
+
+      // One queue per worker plus the shared queue for tasks submitted from other threads
+      for (size_t i = 0; i < nThreads + 1; i++) queues.push_back(std::unique_ptr<cWorkQueue>(new cWorkQueue));
+
+      for (size_t i = 0; i < nThreads; i++) workers.push_back(new cThreadPoolWorker(*this, i));
+
+      for (auto pWorker : workers) pWorker->Run();
+    }
+
+    cThreadPool::~cThreadPool()
+    {
+      for (auto pWorker : workers) pWorker->StopThreadSoon();
+
+      {
+        std::lock_guard<std::mutex> lock(mutexSleep);
+        bIsStopping = true;
+      }
+      conditionSleep.notify_all();
+
+      for (auto pWorker : workers) {
+        pWorker->WaitToStop();
+        delete pWorker;
+      }
+      workers.clear();
+
+      // Run anything that was left over so that nobody waits forever on a task that never runs
+      while (RunPendingTask()) {
+      }
+    }
+
+    bool cThreadPool::IsWorkerThread() const
+    {
+      return (pCurrentThreadPool == this);
+    }
+
+    cTaskHandle cThreadPool::Submit(const std::function<void()>& function)
+    {
+      std::shared_ptr<cTask> pTask = std::make_shared<cTask>(function);
+      Enqueue(pTask);
+      return cTaskHandle(*this, pTask);
+    }
+
+    void cThreadPool::Enqueue(std::shared_ptr<cTask> pTask)
+    {
+      // Workers push onto their own queue, everyone else uses the shared queue
+      const size_t index = IsWorkerThread() ? currentWorkerIndex : (queues.size() - 1);
+
+      nPendingTasks++;
+
+      {
+        cWorkQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(pTask);
+      }
+
+      // Only wake a worker if one is actually sleeping
+      if (nSleepingWorkers.load() != 0) {
+        {
+          std::lock_guard<std::mutex> lock(mutexSleep);
+        }
+        conditionSleep.notify_one();
+      }
+    }
+
+    std::shared_ptr<cTask> cThreadPool::GetTask(size_t index)
+    {
+      const size_t nQueues = queues.size();
+      const size_t indexShared = nQueues - 1;
+
+      // Our own queue is used like a stack because the most recent task is the most likely to still be in the cache
+      if (index != indexShared) {
+        cWorkQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+          std::shared_ptr<cTask> pTask = queue.tasks.back();
+          queue.tasks.pop_back();
+          nPendingTasks--;
+          return pTask;
+        }
+      }
+
+      // Then the shared queue, then steal the oldest task from another worker
+      for (size_t i = 0; i < nQueues; i++) {
+        const size_t victim = (indexShared + i) % nQueues;
+        if (victim == index) continue;
+
+        cWorkQueue& queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+          std::shared_ptr<cTask> pTask = queue.tasks.front();
+          queue.tasks.pop_front();
+          nPendingTasks--;
+          return pTask;
+        }
+      }
+
+      return std::shared_ptr<cTask>();
+    }
+
+    void cThreadPool::RunTask(std::shared_ptr<cTask> pTask)
+    {
+      pTask->function();
+
+      std::vector<std::shared_ptr<cTask>> continuations;
+      {
+        std::lock_guard<std::mutex> lock(pTask->mutex);
+        pTask->bIsDone = true;
+        continuations.swap(pTask->continuations);
+      }
+      pTask->condition.notify_all();
+
+      for (auto& pContinuation : continuations) Enqueue(pContinuation);
+    }
+
+    bool cThreadPool::RunPendingTask()
+    {
+      const size_t index = IsWorkerThread() ? currentWorkerIndex : (queues.size() - 1);
+      std::shared_ptr<cTask> pTask = GetTask(index);
+      if (pTask == nullptr) return false;
+
+      RunTask(pTask);
+      return true;
+    }
+
+    void cThreadPool::WorkerThreadFunction(size_t index)
+    {
+      pCurrentThreadPool = this;
+      currentWorkerIndex = index;
+
+      while (!bIsStopping.load()) {
+        std::shared_ptr<cTask> pTask = GetTask(index);
+        if (pTask != nullptr) {
+          RunTask(pTask);
+          continue;
+        }
+
+        // Nothing to do so wait until a task is submitted
+        std::unique_lock<std::mutex> lock(mutexSleep);
+        nSleepingWorkers++;
+        conditionSleep.wait(lock, [this]() { return bIsStopping.load() || (nPendingTasks.load() != 0); });
+        nSleepingWorkers--;
+      }
+
+      pCurrentThreadPool = nullptr;
+    }
+
+
+    cThreadPool& GetDefaultThreadPool()
+    {
+      static cThreadPool pool;
+      return pool;
+    }
+  }
+}
@@ -44,7 +44,7 @@ namespace bom {
       return false;
     }
 
-    const std::vector<spitfire::json::cNode*> data_children = data->GetValueObjectOrArray();
+    const std::span<spitfire::json::cNode* const> data_children = data->GetValueObjectOrArray();
     for (auto&& child : data_children) {
       locations_response_entry item;
       child->GetAttribute("geohash", item.geohash);
@@ -15,6 +15,10 @@
 #include <list>
 #include <set>
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <random>
 
 #include <gtest/gtest.h>
 
@@ -101,3 +105,279 @@ TEST(breathe, cAIPathFinderTest)
   ASSERT_EQ(6, path[3]);
   ASSERT_EQ(7, path[4]);
 }
+
+namespace {
+
+// A plain Dijkstra on the cNode and cEdge objects to check the searches against
+float GetReferenceLowestCost(const breathe::ai::cGraph& graph, size_t nodeStart, size_t nodeEnd)
+{
+  std::vector<float> distances(graph.GetNumberOfNodes(), spitfire::math::cINFINITY);
+  std::priority_queue<std::pair<float, size_t>, std::vector<std::pair<float, size_t>>, std::greater<std::pair<float, size_t>>> open;
+
+  distances[nodeStart] = 0.0f;
+  open.push(std::make_pair(0.0f, nodeStart));
+  while (!open.empty()) {
+    const std::pair<float, size_t> top = open.top();
+    open.pop();
+    if (top.first > distances[top.second]) continue;
+    if (top.second == nodeEnd) return top.first;
+
+    for (const breathe::ai::cEdge* pEdge : graph.GetNode(top.second).vEdges) {
+      const float fDistance = top.first + pEdge->fCost;
+      if (fDistance < distances[pEdge->pNodeTo->index]) {
+        distances[pEdge->pNodeTo->index] = fDistance;
+        open.push(std::make_pair(fDistance, pEdge->pNodeTo->index));
+      }
+    }
+  }
+
+  return spitfire::math::cINFINITY;
+}
+
+float GetPathCost(const breathe::ai::cGraph& graph, const std::vector<size_t>& path)
+{
+  float fCost = 0.0f;
+  for (size_t i = 1; i < path.size(); i++) {
+    float fCheapest = spitfire::math::cINFINITY;
+    for (const breathe::ai::cEdge* pEdge : graph.GetNode(path[i - 1]).vEdges) {
+      if (pEdge->pNodeTo->index == path[i]) fCheapest = std::min(fCheapest, pEdge->fCost);
+    }
+    fCost += fCheapest;
+  }
+
+  return fCost;
+}
+
+// A grid with edges in both directions between neighbours, each with a random cost multiplier
+void CreateGridGraph(breathe::ai::cGraph& graph, size_t nWidth, uint32_t seed)
+{
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> multiplier(1.0f, 3.0f);
+
+  for (size_t y = 0; y < nWidth; y++) {
+    for (size_t x = 0; x < nWidth; x++) graph.AddNode(spitfire::math::cVec3(float(x), float(y), 0.0f), 1.0f);
+  }
+
+  for (size_t y = 0; y < nWidth; y++) {
+    for (size_t x = 0; x < nWidth; x++) {
+      const size_t i = (y * nWidth) + x;
+      if ((x + 1) < nWidth) {
+        graph.AddEdge(i, i + 1, multiplier(generator));
+        graph.AddEdge(i + 1, i, multiplier(generator));
+      }
+      if ((y + 1) < nWidth) {
+        graph.AddEdge(i, i + nWidth, multiplier(generator));
+        graph.AddEdge(i + nWidth, i, multiplier(generator));
+      }
+    }
+  }
+
+  graph.Optimise();
+}
+
+// Random points with one way edges to the points within fRadius, bucketed so that building a large graph is quick
+void CreateRandomGeometricGraph(breathe::ai::cGraph& graph, size_t nNodes, float fRadius, uint32_t seed)
+{
+  std::mt19937 generator(seed);
+  const float fSize = std::sqrt(float(nNodes));
+  std::uniform_real_distribution<float> coordinate(0.0f, fSize);
+
+  const size_t nBuckets = size_t(fSize / fRadius) + 1;
+  std::vector<std::vector<size_t>> buckets(nBuckets * nBuckets);
+  for (size_t i = 0; i < nNodes; i++) {
+    const spitfire::math::cVec3 position(coordinate(generator), coordinate(generator), 0.0f);
+    graph.AddNode(position, 1.0f);
+    buckets[(size_t(position.y / fRadius) * nBuckets) + size_t(position.x / fRadius)].push_back(i);
+  }
+
+  for (size_t i = 0; i < nNodes; i++) {
+    const spitfire::math::cVec3& position = graph.GetNode(i).position;
+    const int bx = int(position.x / fRadius);
+    const int by = int(position.y / fRadius);
+    for (int y = std::max(0, by - 1); y <= std::min(int(nBuckets) - 1, by + 1); y++) {
+      for (int x = std::max(0, bx - 1); x <= std::min(int(nBuckets) - 1, bx + 1); x++) {
+        for (size_t j : buckets[(size_t(y) * nBuckets) + size_t(x)]) {
+          // Skip a few so that some edges only go one way
+          if ((j != i) && ((graph.GetNode(j).position - position).GetLength() < fRadius) && ((generator() % 8) != 0)) graph.AddEdge(i, j, 1.0f + float(generator() % 3));
+        }
+      }
+    }
+  }
+
+  graph.Optimise();
+}
+
+}
+
+TEST(BreatheAIPathFinder, TestAStar)
+{
+  breathe::ai::cGraph graph;
+
+  // The same graph as above, cDijkstra walks 2, 3, 4, 6, 7 but 2, 4, 6, 7 is cheaper
+  const spitfire::math::cVec3 nodes[] = {
+    spitfire::math::cVec3(1.0f, 3.0f, 0.0f), spitfire::math::cVec3(1.0f, 1.0f, 0.0f), spitfire::math::cVec3(2.0f, 1.0f, 0.0f),
+    spitfire::math::cVec3(2.0f, 2.0f, 0.0f), spitfire::math::cVec3(4.0f, 1.0f, 0.0f), spitfire::math::cVec3(10.0f, 4.0f, 0.0f),
+    spitfire::math::cVec3(4.0f, 3.0f, 0.0f), spitfire::math::cVec3(5.0f, 3.0f, 0.0f), spitfire::math::cVec3(6.0f, 1.0f, 0.0f)
+  };
+  const std::pair<size_t, size_t> edges[] = {
+    { 0, 1 }, { 1, 2 }, { 2, 3 }, { 2, 4 }, { 3, 4 }, { 3, 5 }, { 4, 6 }, { 5, 7 }, { 6, 7 }, { 4, 8 }, { 7, 8 },
+  };
+  for (size_t i = 0; i < countof(nodes); i++) graph.AddNode(nodes[i], 1.0f);
+  for (size_t i = 0; i < countof(edges); i++) graph.AddEdge(edges[i].first, edges[i].second, 1.0f);
+
+  EXPECT_FALSE(graph.IsOptimised());
+  graph.Optimise();
+  EXPECT_TRUE(graph.IsOptimised());
+
+  const std::vector<size_t> expected = { 2, 4, 6, 7 };
+  std::vector<size_t> path;
+
+  breathe::ai::cAStar astar;
+  ASSERT_TRUE(astar.GetLowestCostPath(graph, 2, 7, path));
+  EXPECT_EQ(expected, path);
+  EXPECT_FLOAT_EQ(5.0f, astar.GetPathCost());
+
+  breathe::ai::cBidirectionalAStar bidirectional;
+  ASSERT_TRUE(bidirectional.GetLowestCostPath(graph, 2, 7, path));
+  EXPECT_EQ(expected, path);
+  EXPECT_FLOAT_EQ(5.0f, bidirectional.GetPathCost());
+
+  // From positions
+  ASSERT_TRUE(astar.GetLowestCostPath(graph, spitfire::math::cVec3(2.1f, 0.9f, 0.0f), spitfire::math::cVec3(5.0f, 3.2f, 0.0f), path));
+  EXPECT_EQ(expected, path);
+
+  // The edges only go one way
+  EXPECT_FALSE(astar.GetLowestCostPath(graph, 7, 2, path));
+  EXPECT_TRUE(path.empty());
+  EXPECT_FALSE(bidirectional.GetLowestCostPath(graph, 7, 2, path));
+  EXPECT_TRUE(path.empty());
+
+  // Start and end at the same node
+  ASSERT_TRUE(astar.GetLowestCostPath(graph, 4, 4, path));
+  EXPECT_EQ(std::vector<size_t>({ 4 }), path);
+  ASSERT_TRUE(bidirectional.GetLowestCostPath(graph, 4, 4, path));
+  EXPECT_EQ(std::vector<size_t>({ 4 }), path);
+}
+
+TEST(BreatheAIPathFinder, TestAStarMatchesDijkstra)
+{
+  breathe::ai::cGraph grid;
+  CreateGridGraph(grid, 40, 1234);
+
+  breathe::ai::cGraph geometric;
+  CreateRandomGeometricGraph(geometric, 2000, 1.5f, 5678);
+
+  std::mt19937 generator(42);
+
+  breathe::ai::cAStar astar;
+  breathe::ai::cBidirectionalAStar bidirectional;
+  std::vector<size_t> path;
+
+  for (const breathe::ai::cGraph* pGraph : { &grid, &geometric }) {
+    const breathe::ai::cGraph& graph = *pGraph;
+    size_t nFound = 0;
+
+    for (size_t i = 0; i < 100; i++) {
+      const size_t nodeStart = generator() % graph.GetNumberOfNodes();
+      const size_t nodeEnd = generator() % graph.GetNumberOfNodes();
+      const float fExpected = GetReferenceLowestCost(graph, nodeStart, nodeEnd);
+
+      const bool bIsFound = (fExpected != spitfire::math::cINFINITY);
+      if (bIsFound) nFound++;
+
+      ASSERT_EQ(bIsFound, astar.GetLowestCostPath(graph, nodeStart, nodeEnd, path));
+      if (bIsFound) {
+        EXPECT_NEAR(fExpected, astar.GetPathCost(), 0.001f * fExpected);
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(nodeStart, path.front());
+        EXPECT_EQ(nodeEnd, path.back());
+        EXPECT_NEAR(fExpected, GetPathCost(graph, path), 0.001f * fExpected);
+      }
+
+      ASSERT_EQ(bIsFound, bidirectional.GetLowestCostPath(graph, nodeStart, nodeEnd, path));
+      if (bIsFound) {
+        EXPECT_NEAR(fExpected, bidirectional.GetPathCost(), 0.001f * fExpected);
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(nodeStart, path.front());
+        EXPECT_EQ(nodeEnd, path.back());
+        EXPECT_NEAR(fExpected, GetPathCost(graph, path), 0.001f * fExpected);
+      }
+    }
+
+    EXPECT_LT(50u, nFound);
+  }
+}
+
+TEST(BreatheAIPathFinder, DISABLED_TestBenchmark)
+{
+  // cDijkstra is recursive so it only gets the smaller graphs
+  breathe::ai::cGraph grid;
+  CreateGridGraph(grid, 100, 1234);
+
+  breathe::ai::cGraph geometric;
+  CreateRandomGeometricGraph(geometric, 10000, 1.5f, 5678);
+
+  breathe::ai::cGraph largeGrid;
+  CreateGridGraph(largeGrid, 316, 4321);
+
+  const std::pair<const char*, const breathe::ai::cGraph*> graphs[] = {
+    { "grid 10k", &grid },
+    { "geometric 10k", &geometric },
+    { "grid 100k", &largeGrid },
+  };
+
+  const size_t nQueries = 50;
+
+  for (const std::pair<const char*, const breathe::ai::cGraph*>& entry : graphs) {
+    const breathe::ai::cGraph& graph = *entry.second;
+    const bool bIsDijkstra = (graph.GetNumberOfNodes() <= 10000);
+
+    std::mt19937 generator(42);
+    std::vector<std::pair<size_t, size_t>> queries;
+    for (size_t i = 0; i < nQueries; i++) queries.push_back(std::make_pair(generator() % graph.GetNumberOfNodes(), generator() % graph.GetNumberOfNodes()));
+
+    std::vector<size_t> path;
+
+    // cDijkstra greedily follows the cheapest edge so it is quick but often doesn't reach the end
+    double fDijkstraMS = 0.0;
+    size_t nDijkstraReachedEnd = 0;
+    if (bIsDijkstra) {
+      breathe::ai::cDijkstra dijkstra;
+      const auto start = std::chrono::high_resolution_clock::now();
+      for (const std::pair<size_t, size_t>& query : queries) {
+        dijkstra.GetLowestCostPath(graph, query.first, query.second, path);
+        if (!path.empty() && (path.back() == query.second)) nDijkstraReachedEnd++;
+      }
+      fDijkstraMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nQueries;
+    }
+
+    breathe::ai::cAStar astar;
+    size_t nAStarExpanded = 0;
+    size_t nAStarReachedEnd = 0;
+    std::vector<float> costs;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::pair<size_t, size_t>& query : queries) {
+      astar.GetLowestCostPath(graph, query.first, query.second, path);
+      nAStarExpanded += astar.GetNumberOfNodesExpanded();
+      if (!path.empty()) nAStarReachedEnd++;
+      costs.push_back(astar.GetPathCost());
+    }
+    const double fAStarMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nQueries;
+
+    breathe::ai::cBidirectionalAStar bidirectional;
+    size_t nBidirectionalExpanded = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < nQueries; i++) {
+      bidirectional.GetLowestCostPath(graph, queries[i].first, queries[i].second, path);
+      nBidirectionalExpanded += bidirectional.GetNumberOfNodesExpanded();
+      if (costs[i] != spitfire::math::cINFINITY) {
+        EXPECT_NEAR(costs[i], bidirectional.GetPathCost(), 0.001f * costs[i]);
+      }
+    }
+    const double fBidirectionalMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nQueries;
+
+    std::cout<<"cAIPathFinder "<<entry.first<<" nodes="<<graph.GetNumberOfNodes()<<" edges="<<graph.GetNumberOfEdges();
+    if (bIsDijkstra) std::cout<<" cDijkstra="<<fDijkstraMS<<"ms reached="<<nDijkstraReachedEnd<<"/"<<nQueries;
+    std::cout<<" cAStar="<<fAStarMS<<"ms reached="<<nAStarReachedEnd<<"/"<<nQueries<<" expanded="<<(nAStarExpanded / nQueries)<<" cBidirectionalAStar="<<fBidirectionalMS<<"ms expanded="<<(nBidirectionalExpanded / nQueries)<<std::endl;
+  }
+}
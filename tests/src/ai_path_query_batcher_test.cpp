@@ -0,0 +1,253 @@
+// Standard headers
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/game/cAIPathFinder.h>
+#include <breathe/game/cAIPathQueryBatcher.h>
+
+namespace {
+
+// A grid with edges in both directions between neighbours, each with a random cost multiplier
+void CreateGridGraph(breathe::ai::cGraph& graph, size_t nWidth, uint32_t seed)
+{
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> multiplier(1.0f, 3.0f);
+
+  for (size_t y = 0; y < nWidth; y++) {
+    for (size_t x = 0; x < nWidth; x++) graph.AddNode(spitfire::math::cVec3(float(x), float(y), 0.0f), float(generator() % 4));
+  }
+
+  for (size_t y = 0; y < nWidth; y++) {
+    for (size_t x = 0; x < nWidth; x++) {
+      const size_t i = (y * nWidth) + x;
+      if ((x + 1) < nWidth) {
+        graph.AddEdge(i, i + 1, multiplier(generator));
+        graph.AddEdge(i + 1, i, multiplier(generator));
+      }
+      if ((y + 1) < nWidth) {
+        graph.AddEdge(i, i + nWidth, multiplier(generator));
+        graph.AddEdge(i + nWidth, i, multiplier(generator));
+      }
+    }
+  }
+
+  graph.Optimise();
+}
+
+// Lots of agents spread over the graph heading to a few destinations
+void CreateQueries(const breathe::ai::cGraph& graph, size_t nQueries, size_t nDestinations, uint32_t seed, std::vector<breathe::ai::cPathQuery>& queries)
+{
+  std::mt19937 generator(seed);
+
+  std::vector<size_t> destinations;
+  for (size_t i = 0; i < nDestinations; i++) destinations.push_back(generator() % graph.GetNumberOfNodes());
+
+  queries.clear();
+  for (size_t i = 0; i < nQueries; i++) queries.push_back(breathe::ai::cPathQuery(0, 0, generator() % graph.GetNumberOfNodes(), destinations[i % nDestinations]));
+}
+
+}
+
+TEST(BreatheAIPathQueryBatcher, TestMatchesAStar)
+{
+  breathe::ai::cGraph graph;
+  CreateGridGraph(graph, 40, 1234);
+
+  std::vector<breathe::ai::cPathQuery> queries;
+  CreateQueries(graph, 200, 5, 5678, queries);
+
+  breathe::ai::cPathQueryBatcher batcher;
+  batcher.AddZone(0, graph);
+  batcher.SetPersonality(0, breathe::ai::cPathPersonality());
+
+  for (const breathe::ai::cPathQuery& query : queries) batcher.AddQuery(query);
+  batcher.Run();
+
+  EXPECT_EQ(0u, batcher.GetCacheHits());
+  EXPECT_EQ(5u, batcher.GetCacheMisses());
+
+  breathe::ai::cAStar astar;
+  std::vector<size_t> path;
+  for (size_t i = 0; i < queries.size(); i++) {
+    ASSERT_TRUE(astar.GetLowestCostPath(graph, queries[i].nodeStart, queries[i].nodeEnd, path));
+
+    const breathe::ai::cPathQueryResult& result = batcher.GetResult(i);
+    ASSERT_TRUE(result.bIsFound);
+    EXPECT_NEAR(astar.GetPathCost(), result.fCost, 0.001f * astar.GetPathCost());
+
+    const std::vector<size_t>& batchedPath = batcher.GetPath(i);
+    ASSERT_FALSE(batchedPath.empty());
+    EXPECT_EQ(queries[i].nodeStart, batchedPath.front());
+    EXPECT_EQ(queries[i].nodeEnd, batchedPath.back());
+  }
+
+  // The same destinations again are answered from the cache
+  batcher.Clear();
+  for (const breathe::ai::cPathQuery& query : queries) batcher.AddQuery(query);
+  batcher.Run(spitfire::util::GetDefaultThreadPool());
+
+  EXPECT_EQ(5u, batcher.GetCacheHits());
+  EXPECT_EQ(0u, batcher.GetCacheMisses());
+  for (size_t i = 0; i < queries.size(); i++) {
+    ASSERT_TRUE(astar.GetLowestCostPath(graph, queries[i].nodeStart, queries[i].nodeEnd, path));
+    EXPECT_NEAR(astar.GetPathCost(), batcher.GetResult(i).fCost, 0.001f * astar.GetPathCost());
+  }
+}
+
+TEST(BreatheAIPathQueryBatcher, TestPersonality)
+{
+  // Two ways from 0 to 3, through 1 which is short but rough or through 2 which is longer
+  breathe::ai::cGraph graph;
+  graph.AddNode(spitfire::math::cVec3(0.0f, 0.0f, 0.0f), 0.0f);
+  graph.AddNode(spitfire::math::cVec3(1.0f, 0.0f, 0.0f), 10.0f);
+  graph.AddNode(spitfire::math::cVec3(1.0f, 2.0f, 0.0f), 0.0f);
+  graph.AddNode(spitfire::math::cVec3(2.0f, 0.0f, 0.0f), 0.0f);
+  graph.AddEdge(0, 1, 1.0f);
+  graph.AddEdge(1, 3, 1.0f);
+  graph.AddEdge(0, 2, 1.0f);
+  graph.AddEdge(2, 3, 1.0f);
+  graph.Optimise();
+
+  breathe::ai::cPathPersonality wheeledVehicle;
+  wheeledVehicle.fNodeCostWeighting = 1.0f;
+
+  breathe::ai::cPathQueryBatcher batcher;
+  batcher.AddZone(0, graph);
+  batcher.SetPersonality(0, breathe::ai::cPathPersonality());
+  batcher.SetPersonality(1, wheeledVehicle);
+
+  const size_t human = batcher.AddQuery(breathe::ai::cPathQuery(0, 0, 0, 3));
+  const size_t vehicle = batcher.AddQuery(breathe::ai::cPathQuery(0, 1, 0, 3));
+  const size_t unreachable = batcher.AddQuery(breathe::ai::cPathQuery(0, 0, 3, 0));
+  const size_t here = batcher.AddQuery(breathe::ai::cPathQuery(0, 1, 3, 3));
+  batcher.Run();
+
+  EXPECT_EQ(std::vector<size_t>({ 0, 1, 3 }), batcher.GetPath(human));
+  EXPECT_FLOAT_EQ(2.0f, batcher.GetResult(human).fCost);
+
+  EXPECT_EQ(std::vector<size_t>({ 0, 2, 3 }), batcher.GetPath(vehicle));
+  EXPECT_FLOAT_EQ(2.0f * std::sqrt(5.0f), batcher.GetResult(vehicle).fCost);
+
+  EXPECT_FALSE(batcher.GetResult(unreachable).bIsFound);
+  EXPECT_TRUE(batcher.GetPath(unreachable).empty());
+
+  EXPECT_TRUE(batcher.GetResult(here).bIsFound);
+  EXPECT_EQ(std::vector<size_t>({ 3 }), batcher.GetPath(here));
+
+  // Each personality has its own flow field for the same destination
+  EXPECT_EQ(3u, batcher.GetNumberOfCachedFlowFields());
+}
+
+TEST(BreatheAIPathQueryBatcher, TestInvalidation)
+{
+  breathe::ai::cGraph graph;
+  CreateGridGraph(graph, 20, 1234);
+
+  breathe::ai::cGraph other;
+  CreateGridGraph(other, 10, 4321);
+
+  std::vector<breathe::ai::cPathQuery> queries;
+  CreateQueries(graph, 50, 5, 5678, queries);
+
+  breathe::ai::cPathQueryBatcher batcher;
+  batcher.AddZone(0, graph);
+  batcher.AddZone(1, other);
+  batcher.SetPersonality(0, breathe::ai::cPathPersonality());
+
+  auto RunQueries = [&](const std::vector<breathe::ai::cPathQuery>& batch)
+  {
+    batcher.Clear();
+    for (const breathe::ai::cPathQuery& query : batch) batcher.AddQuery(query);
+    batcher.AddQuery(breathe::ai::cPathQuery(1, 0, 0, 99));
+    batcher.Run();
+  };
+
+  RunQueries(queries);
+  EXPECT_EQ(6u, batcher.GetCacheMisses());
+  EXPECT_EQ(6u, batcher.GetNumberOfCachedFlowFields());
+
+  // Changing the graph throws away the flow fields for that zone only
+  graph.AddEdge(0, 399, 1.0f);
+  graph.Optimise();
+  RunQueries(queries);
+  EXPECT_EQ(1u, batcher.GetCacheHits());
+  EXPECT_EQ(5u, batcher.GetCacheMisses());
+
+  // The new edge is a short cut from 0 to 399
+  batcher.Clear();
+  const size_t query = batcher.AddQuery(breathe::ai::cPathQuery(0, 0, 0, 399));
+  batcher.Run();
+  EXPECT_EQ(std::vector<size_t>({ 0, 399 }), batcher.GetPath(query));
+
+  RunQueries(queries);
+  batcher.InvalidateZone(1);
+  RunQueries(queries);
+  EXPECT_EQ(5u, batcher.GetCacheHits());
+  EXPECT_EQ(1u, batcher.GetCacheMisses());
+
+  // Everything used in a batch is kept, older flow fields are evicted once there are too many
+  batcher.SetMaximumCachedFlowFields(2);
+  RunQueries(queries);
+  EXPECT_EQ(6u, batcher.GetNumberOfCachedFlowFields());
+  RunQueries(std::vector<breathe::ai::cPathQuery>());
+  EXPECT_EQ(2u, batcher.GetNumberOfCachedFlowFields());
+}
+
+TEST(BreatheAIPathQueryBatcher, DISABLED_TestBenchmark)
+{
+  breathe::ai::cGraph graph;
+  CreateGridGraph(graph, 316, 1234);
+
+  const size_t nQueries = 2000;
+  std::vector<breathe::ai::cPathQuery> queries;
+  CreateQueries(graph, nQueries, 8, 5678, queries);
+
+  // One query at a time
+  breathe::ai::cAStar astar;
+  std::vector<size_t> path;
+  const size_t nAStarQueries = 200;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < nAStarQueries; i++) astar.GetLowestCostPath(graph, queries[i].nodeStart, queries[i].nodeEnd, path);
+  const double fAStarSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+  breathe::ai::cPathQueryBatcher batcher;
+  batcher.AddZone(0, graph);
+  batcher.SetPersonality(0, breathe::ai::cPathPersonality());
+
+  auto RunBatch = [&](bool bIsThreaded) -> double
+  {
+    const auto batchStart = std::chrono::high_resolution_clock::now();
+    batcher.Clear();
+    for (const breathe::ai::cPathQuery& query : queries) batcher.AddQuery(query);
+    if (bIsThreaded) batcher.Run(spitfire::util::GetDefaultThreadPool());
+    else batcher.Run();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - batchStart).count();
+  };
+
+  const double fColdSeconds = RunBatch(false);
+  const double fWarmSeconds = RunBatch(false);
+  EXPECT_EQ(8u, batcher.GetCacheHits());
+
+  batcher.InvalidateZone(0);
+  const double fColdThreadedSeconds = RunBatch(true);
+  const double fWarmThreadedSeconds = RunBatch(true);
+
+  for (size_t i = 0; i < nAStarQueries; i++) {
+    ASSERT_TRUE(astar.GetLowestCostPath(graph, queries[i].nodeStart, queries[i].nodeEnd, path));
+    EXPECT_NEAR(astar.GetPathCost(), batcher.GetResult(i).fCost, 0.001f * astar.GetPathCost());
+  }
+
+  std::cout<<"cAIPathQueryBatcher nodes="<<graph.GetNumberOfNodes()<<" queries="<<nQueries<<" destinations=8"<<std::endl;
+  std::cout<<"cAIPathQueryBatcher cAStar="<<(nAStarQueries / fAStarSeconds)<<" queries/s"<<std::endl;
+  std::cout<<"cAIPathQueryBatcher cold="<<(nQueries / fColdSeconds)<<" queries/s warm="<<(nQueries / fWarmSeconds)<<" queries/s"<<std::endl;
+  std::cout<<"cAIPathQueryBatcher threads="<<spitfire::util::GetDefaultThreadPool().GetThreadCount()<<" cold="<<(nQueries / fColdThreadedSeconds)<<" queries/s warm="<<(nQueries / fWarmThreadedSeconds)<<" queries/s"<<std::endl;
+}
@@ -0,0 +1,387 @@
+// Standard headers
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/filesystem.h>
+
+// Breathe headers
+#include <breathe/render/model/cBinaryMesh.h>
+#include <breathe/render/model/cFileFormatOBJ.h>
+
+namespace {
+
+const char* CUBE_OBJ =
+  "# A cube with shared corners\n"
+  "o Cube\n"
+  "v -1 -1 -1\nv 1 -1 -1\nv 1 1 -1\nv -1 1 -1\nv -1 -1 1\nv 1 -1 1\nv 1 1 1\nv -1 1 1\n"
+  "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+  "vn 0 0 -1\nvn 0 0 1\nvn 0 -1 0\nvn 0 1 0\nvn -1 0 0\nvn 1 0 0\n"
+  "usemtl crate\n"
+  "s off\n"
+  "f 1/1/1 3/3/1 2/2/1\nf 1/1/1 4/4/1 3/3/1\n"
+  "f 5/1/2 6/2/2 7/3/2\nf 5/1/2 7/3/2 8/4/2\n"
+  "f 1/1/3 2/2/3 6/3/3\nf 1/1/3 6/3/3 5/4/3\n"
+  "f 4/1/4 8/2/4 7/3/4\nf 4/1/4 7/3/4 3/4/4\n"
+  "f 1/1/5 5/2/5 8/3/5 4/4/5\n" // Quads are turned into triangle fans
+  "f 2/1/6 3/2/6 7/3/6 6/4/6\n";
+
+const char* TWO_OBJECTS_OBJ =
+  "o First\n"
+  "v 0 0 0\nv 1 0 0\nv 1 1 0\n"
+  "vt 0 0\nvt 1 0\nvt 1 1\n"
+  "vn 0 0 1\n"
+  "usemtl first\n"
+  "f 1/1/1 2/2/1 3/3/1\n"
+  "o Second\n"
+  "v 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1\nv 0.5 1.5 1\n"
+  "vt 0 1\n"
+  "vn 0 1 0\n"
+  "usemtl second\n"
+  "f 4/1/2 5/2/2 6/3/2 7/4/2 8/4/2\n";
+
+void WriteFile(const spitfire::string_t& sFilePath, const std::string& sContents)
+{
+  std::ofstream file(sFilePath, std::ios::binary | std::ios::trunc);
+  file<<sContents;
+}
+
+std::string CreateGridOBJ(size_t nCells)
+{
+  std::ostringstream o;
+  o<<"o Grid\n";
+  for (size_t y = 0; y <= nCells; y++) {
+    for (size_t x = 0; x <= nCells; x++) o<<"v "<<x<<" "<<((x * y) % 7) * 0.25f<<" "<<y<<"\n";
+  }
+  for (size_t y = 0; y <= nCells; y++) {
+    for (size_t x = 0; x <= nCells; x++) o<<"vt "<<float(x) / nCells<<" "<<float(y) / nCells<<"\n";
+  }
+  o<<"vn 0 1 0\n";
+  o<<"usemtl grid\n";
+  for (size_t y = 0; y < nCells; y++) {
+    for (size_t x = 0; x < nCells; x++) {
+      const size_t a = 1 + (y * (nCells + 1)) + x;
+      const size_t b = a + 1;
+      const size_t c = a + nCells + 1;
+      const size_t d = c + 1;
+      o<<"f "<<a<<"/"<<a<<"/1 "<<b<<"/"<<b<<"/1 "<<d<<"/"<<d<<"/1\n";
+      o<<"f "<<a<<"/"<<a<<"/1 "<<d<<"/"<<d<<"/1 "<<c<<"/"<<c<<"/1\n";
+    }
+  }
+  return o.str();
+}
+
+void ExpectSameModel(const breathe::render::model::cStaticModel& expected, const breathe::render::model::cStaticModel& actual)
+{
+  ASSERT_EQ(expected.mesh.size(), actual.mesh.size());
+  for (size_t i = 0; i < expected.mesh.size(); i++) {
+    EXPECT_TRUE(expected.mesh[i]->vertices == actual.mesh[i]->vertices) << i;
+    EXPECT_TRUE(expected.mesh[i]->textureCoordinates == actual.mesh[i]->textureCoordinates) << i;
+    EXPECT_TRUE(expected.mesh[i]->normals == actual.mesh[i]->normals) << i;
+    EXPECT_EQ(expected.mesh[i]->sMaterial, actual.mesh[i]->sMaterial) << i;
+  }
+}
+
+void DeleteFiles(const spitfire::string_t& sSourceFilePath)
+{
+  spitfire::filesystem::DeleteFile(sSourceFilePath);
+  spitfire::filesystem::DeleteFile(breathe::render::model::GetBinaryMeshCacheFilePath(sSourceFilePath));
+}
+
+}
+
+TEST(BreatheBinaryMesh, TestRoundTripOBJ)
+{
+  for (const char* szOBJ : { CUBE_OBJ, TWO_OBJECTS_OBJ }) {
+    const spitfire::string_t sSourceFilePath = TEXT("breathe_binary_mesh_test.obj");
+    const spitfire::string_t sCacheFilePath = TEXT("breathe_binary_mesh_test.obj.bmesh");
+    WriteFile(sSourceFilePath, szOBJ);
+
+    breathe::render::model::cStaticModel original;
+    ASSERT_TRUE(breathe::render::model::cFileFormatOBJ().Load(sSourceFilePath, original));
+
+    breathe::render::model::cBinaryMeshSourceKey key;
+    ASSERT_TRUE(breathe::render::model::GetBinaryMeshSourceKey(sSourceFilePath, key));
+    ASSERT_TRUE(breathe::render::model::SaveBinaryMesh(sCacheFilePath, key, original));
+
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(sCacheFilePath));
+    EXPECT_TRUE(file.IsUpToDate(sSourceFilePath));
+    EXPECT_EQ("breathe_binary_mesh_test.obj", file.GetSourceFilePath());
+    EXPECT_EQ(key.nSourceSizeBytes, file.GetSourceSizeBytes());
+    EXPECT_EQ(key.sourceHash, file.GetSourceHash());
+
+    breathe::render::model::cStaticModel loaded;
+    file.GetStaticModel(loaded);
+    ExpectSameModel(original, loaded);
+
+    DeleteFiles(sSourceFilePath);
+  }
+}
+
+TEST(BreatheBinaryMesh, TestGeometryData)
+{
+  const spitfire::string_t sSourceFilePath = TEXT("breathe_binary_mesh_test_geometry.obj");
+  WriteFile(sSourceFilePath, CUBE_OBJ);
+  ASSERT_TRUE(breathe::render::model::BakeBinaryMesh(sSourceFilePath, breathe::render::model::GetBinaryMeshCacheFilePath(sSourceFilePath)));
+
+  breathe::render::model::cBinaryMeshFile file;
+  ASSERT_TRUE(file.Open(breathe::render::model::GetBinaryMeshCacheFilePath(sSourceFilePath)));
+  ASSERT_EQ(1, file.GetMeshCount());
+
+  // 12 triangles, each face of the cube has 4 unique corners
+  const breathe::render::model::cBinaryMeshView& mesh = file.GetMesh(0);
+  EXPECT_TRUE(mesh.IsIndexed());
+  EXPECT_EQ(36, mesh.nIndexCount);
+  EXPECT_EQ(24, mesh.nVertexCount);
+  EXPECT_EQ(8, mesh.GetFloatsPerPoint());
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(mesh.pVertices) % 16);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(mesh.pIndices) % 16);
+  EXPECT_NE(std::string_view::npos, mesh.sMaterial.find("crate.mat"));
+
+  opengl::cGeometryData data;
+  file.GetGeometryData(0, data);
+  EXPECT_EQ(24, data.nVertexCount);
+  EXPECT_EQ(3, data.nVerticesPerPoint);
+  EXPECT_EQ(3, data.nNormalsPerPoint);
+  EXPECT_EQ(2, data.nTextureCoordinatesPerPoint);
+  EXPECT_EQ(24 * 8, data.vertices.size());
+  ASSERT_EQ(36, data.indices.size());
+
+  // The first triangle is 1/1/1 3/3/1 2/2/1, the texture coordinates are flipped by the loader
+  const float expected[8] = { -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f };
+  for (size_t i = 0; i < 8; i++) EXPECT_EQ(expected[i], data.vertices[(data.indices[0] * 8) + i]) << i;
+
+  file.Close();
+  DeleteFiles(sSourceFilePath);
+}
+
+TEST(BreatheBinaryMesh, TestStaleCache)
+{
+  const spitfire::string_t sSourceFilePath = TEXT("breathe_binary_mesh_test_stale.obj");
+  const spitfire::string_t sCacheFilePath = breathe::render::model::GetBinaryMeshCacheFilePath(sSourceFilePath);
+  WriteFile(sSourceFilePath, CUBE_OBJ);
+  ASSERT_TRUE(breathe::render::model::BakeBinaryMesh(sSourceFilePath, sCacheFilePath));
+
+  {
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(sCacheFilePath));
+    EXPECT_TRUE(file.IsUpToDate(sSourceFilePath));
+
+    // A different source file is never up to date
+    EXPECT_FALSE(file.IsUpToDate(TEXT("breathe_binary_mesh_test_other.obj")));
+  }
+
+  // Touching the file without changing it keeps the cache
+  const std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(sSourceFilePath);
+  std::filesystem::last_write_time(sSourceFilePath, modifiedTime + std::chrono::seconds(10));
+  {
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(sCacheFilePath));
+    EXPECT_TRUE(file.IsUpToDate(sSourceFilePath));
+  }
+
+  // Changing the contents without changing the size is caught by the hash
+  std::string sChanged(CUBE_OBJ);
+  sChanged.replace(sChanged.find("v 1 1 1"), 7, "v 1 1 2");
+  WriteFile(sSourceFilePath, sChanged);
+  std::filesystem::last_write_time(sSourceFilePath, modifiedTime + std::chrono::seconds(20));
+  {
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(sCacheFilePath));
+    EXPECT_FALSE(file.IsUpToDate(sSourceFilePath));
+  }
+
+  // Loading rebakes the cache
+  breathe::render::model::cStaticModel model;
+  ASSERT_TRUE(breathe::render::model::LoadStaticModelUsingCache(sSourceFilePath, model));
+  {
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(sCacheFilePath));
+    EXPECT_TRUE(file.IsUpToDate(sSourceFilePath));
+  }
+
+  // A removed source file is not up to date either
+  spitfire::filesystem::DeleteFile(sSourceFilePath);
+  {
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(sCacheFilePath));
+    EXPECT_FALSE(file.IsUpToDate(sSourceFilePath));
+  }
+
+  DeleteFiles(sSourceFilePath);
+}
+
+TEST(BreatheBinaryMesh, TestInvalidFiles)
+{
+  const spitfire::string_t sSourceFilePath = TEXT("breathe_binary_mesh_test_invalid.obj");
+  const spitfire::string_t sCacheFilePath = breathe::render::model::GetBinaryMeshCacheFilePath(sSourceFilePath);
+  WriteFile(sSourceFilePath, TWO_OBJECTS_OBJ);
+  ASSERT_TRUE(breathe::render::model::BakeBinaryMesh(sSourceFilePath, sCacheFilePath));
+
+  std::string sContents;
+  {
+    std::ifstream file(sCacheFilePath, std::ios::binary);
+    sContents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  ASSERT_LT(64, sContents.size());
+
+  breathe::render::model::cBinaryMeshFile file;
+
+  // Missing
+  EXPECT_FALSE(file.Open(TEXT("breathe_binary_mesh_test_missing.bmesh")));
+  EXPECT_FALSE(file.IsOpen());
+
+  // Truncated at every length up to the whole file
+  for (size_t length = 0; length < sContents.size(); length += 7) {
+    WriteFile(sCacheFilePath, sContents.substr(0, length));
+    EXPECT_FALSE(file.Open(sCacheFilePath)) << length;
+  }
+
+  // Another version
+  std::string sVersion(sContents);
+  sVersion[4] = char(breathe::render::model::BINARY_MESH_VERSION + 1);
+  WriteFile(sCacheFilePath, sVersion);
+  EXPECT_FALSE(file.Open(sCacheFilePath));
+
+  // Not a binary mesh
+  WriteFile(sCacheFilePath, std::string(sContents.size(), 'x'));
+  EXPECT_FALSE(file.Open(sCacheFilePath));
+
+  // A mesh that points outside the file
+  std::string sOutside(sContents);
+  sOutside[64 + 7] = char(0x10);
+  WriteFile(sCacheFilePath, sOutside);
+  EXPECT_FALSE(file.Open(sCacheFilePath));
+
+  // Normals and texture coordinates with the wrong number of components
+  std::string sNormals(sContents);
+  sNormals[64 + 37] = char(2);
+  WriteFile(sCacheFilePath, sNormals);
+  EXPECT_FALSE(file.Open(sCacheFilePath));
+
+  std::string sTextureCoordinates(sContents);
+  sTextureCoordinates[64 + 38] = char(3);
+  WriteFile(sCacheFilePath, sTextureCoordinates);
+  EXPECT_FALSE(file.Open(sCacheFilePath));
+
+  // An index past the last vertex
+  uint64_t nIndicesOffset = 0;
+  std::memcpy(&nIndicesOffset, &sContents[64 + 8], sizeof(nIndicesOffset));
+  ASSERT_LT(nIndicesOffset + 2, sContents.size());
+  std::string sIndex(sContents);
+  sIndex[nIndicesOffset] = char(0xff);
+  sIndex[nIndicesOffset + 1] = char(0xff);
+  WriteFile(sCacheFilePath, sIndex);
+  EXPECT_FALSE(file.Open(sCacheFilePath));
+
+  // The header still matches the source so only the validation stops it being used, the cache is rebuilt from the source instead
+  {
+    breathe::render::model::cStaticModel model;
+    ASSERT_TRUE(breathe::render::model::LoadStaticModelUsingCache(sSourceFilePath, model));
+    ASSERT_EQ(2, model.mesh.size());
+    EXPECT_EQ(3 * 3, model.mesh[0]->vertices.size());
+    EXPECT_TRUE(file.Open(sCacheFilePath));
+    file.Close();
+  }
+
+  // And the original is fine
+  WriteFile(sCacheFilePath, sContents);
+  EXPECT_TRUE(file.Open(sCacheFilePath));
+  EXPECT_EQ(2, file.GetMeshCount());
+  file.Close();
+
+  // Unsupported source formats can't be baked
+  EXPECT_FALSE(breathe::render::model::BakeBinaryMesh(TEXT("breathe_binary_mesh_test.3ds"), TEXT("breathe_binary_mesh_test.3ds.bmesh")));
+
+  DeleteFiles(sSourceFilePath);
+}
+
+TEST(BreatheBinaryMesh, TestLargeMeshIsDeIndexed)
+{
+  // More unique points than 16 bit indices can address
+  breathe::render::model::cStaticModel model;
+  breathe::render::model::cStaticModelMesh* pMesh = new breathe::render::model::cStaticModelMesh;
+  const size_t nPoints = 70000;
+  for (size_t i = 0; i < nPoints; i++) {
+    pMesh->vertices.push_back(float(i));
+    pMesh->vertices.push_back(0.0f);
+    pMesh->vertices.push_back(0.0f);
+  }
+  pMesh->sMaterial = TEXT("large.mat");
+  model.mesh.push_back(pMesh);
+
+  const spitfire::string_t sCacheFilePath = TEXT("breathe_binary_mesh_test_large.bmesh");
+  breathe::render::model::cBinaryMeshSourceKey key;
+  ASSERT_TRUE(breathe::render::model::SaveBinaryMesh(sCacheFilePath, key, model));
+
+  breathe::render::model::cBinaryMeshFile file;
+  ASSERT_TRUE(file.Open(sCacheFilePath));
+  ASSERT_EQ(1, file.GetMeshCount());
+  EXPECT_FALSE(file.GetMesh(0).IsIndexed());
+  EXPECT_EQ(nPoints, file.GetMesh(0).nVertexCount);
+  EXPECT_EQ(3, file.GetMesh(0).GetFloatsPerPoint());
+
+  breathe::render::model::cStaticModel loaded;
+  file.GetStaticModel(loaded);
+  ExpectSameModel(model, loaded);
+
+  file.Close();
+  spitfire::filesystem::DeleteFile(sCacheFilePath);
+}
+
+TEST(BreatheBinaryMesh, DISABLED_TestBenchmark)
+{
+  const spitfire::string_t sSourceFilePath = TEXT("breathe_binary_mesh_benchmark.obj");
+  WriteFile(sSourceFilePath, CreateGridOBJ(150));
+
+  breathe::render::model::cStaticModel reference;
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(breathe::render::model::cFileFormatOBJ().Load(sSourceFilePath, reference));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"cFileFormatOBJ::Load time="<<fDurationMS<<"ms"<<std::endl;
+  }
+
+  // The first load bakes the cache
+  {
+    breathe::render::model::cStaticModel model;
+    const auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(breathe::render::model::LoadStaticModelUsingCache(sSourceFilePath, model));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"LoadStaticModelUsingCache cold time="<<fDurationMS<<"ms"<<std::endl;
+  }
+
+  {
+    breathe::render::model::cStaticModel model;
+    const auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(breathe::render::model::LoadStaticModelUsingCache(sSourceFilePath, model));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"LoadStaticModelUsingCache warm time="<<fDurationMS<<"ms"<<std::endl;
+
+    ExpectSameModel(reference, model);
+  }
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    breathe::render::model::cBinaryMeshFile file;
+    ASSERT_TRUE(file.Open(breathe::render::model::GetBinaryMeshCacheFilePath(sSourceFilePath)));
+    opengl::cGeometryData data;
+    file.GetGeometryData(0, data);
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"cBinaryMeshFile::GetGeometryData time="<<fDurationMS<<"ms vertices="<<data.nVertexCount<<" indices="<<data.indices.size()<<std::endl;
+
+    EXPECT_EQ(151 * 151, data.nVertexCount);
+    EXPECT_EQ(150 * 150 * 6, data.indices.size());
+  }
+
+  DeleteFiles(sSourceFilePath);
+}
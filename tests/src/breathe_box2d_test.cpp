@@ -0,0 +1,219 @@
+// Standard headers
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Box2D headers
+#include <Box2D/Box2D.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/physics/physics_box2d_task_executor.h>
+
+namespace {
+
+const float fTimeStep = 1.0f / 60.0f;
+const int32 nVelocityIterations = 8;
+const int32 nPositionIterations = 3;
+
+// Records every PostSolve call by the indices of the bodies involved so that two worlds can be compared
+class cPostSolveRecorder : public b2ContactListener
+{
+public:
+  struct cEntry {
+    bool operator==(const cEntry& rhs) const { return (bodyA == rhs.bodyA) && (bodyB == rhs.bodyB) && (nPoints == rhs.nPoints) && (fNormalImpulse == rhs.fNormalImpulse) && (fTangentImpulse == rhs.fTangentImpulse); }
+
+    uintptr_t bodyA;
+    uintptr_t bodyB;
+    int32 nPoints;
+    float fNormalImpulse;
+    float fTangentImpulse;
+  };
+
+  void PostSolve(b2Contact* pContact, const b2ContactImpulse* pImpulse) override
+  {
+    entries.push_back(cEntry {
+      uintptr_t(pContact->GetFixtureA()->GetBody()->GetUserData()),
+      uintptr_t(pContact->GetFixtureB()->GetBody()->GetUserData()),
+      pImpulse->count,
+      pImpulse->normalImpulses[0],
+      pImpulse->tangentImpulses[0]
+    });
+  }
+
+  std::vector<cEntry> entries;
+};
+
+b2Body* CreateBox(b2World& world, uintptr_t& index, float x, float y)
+{
+  b2BodyDef bodyDef;
+  bodyDef.type = b2_dynamicBody;
+  bodyDef.position.Set(x, y);
+  bodyDef.userData = (void*)(index++);
+
+  b2PolygonShape box;
+  box.SetAsBox(0.5f, 0.5f);
+
+  b2Body* pBody = world.CreateBody(&bodyDef);
+  pBody->CreateFixture(&box, 1.0f);
+  return pBody;
+}
+
+// Pyramids, stacks and chains hanging from the ground, every island shares the static ground body
+void CreateScene(b2World& world, size_t nPyramids, size_t nStacks, size_t nChains)
+{
+  uintptr_t index = 0;
+
+  b2BodyDef groundDef;
+  groundDef.userData = (void*)(index++);
+  b2Body* pGround = world.CreateBody(&groundDef);
+
+  b2EdgeShape edge;
+  edge.Set(b2Vec2(-1000.0f, 0.0f), b2Vec2(1000.0f, 0.0f));
+  pGround->CreateFixture(&edge, 0.0f);
+
+  for (size_t p = 0; p < nPyramids; p++) {
+    const float fX = -400.0f + (40.0f * p);
+    for (size_t row = 0; row < 10; row++) {
+      for (size_t i = 0; i < (10 - row); i++) CreateBox(world, index, fX + float(i) + (0.5f * row), 0.5f + float(row));
+    }
+  }
+
+  for (size_t s = 0; s < nStacks; s++) {
+    for (size_t i = 0; i < 10; i++) CreateBox(world, index, 20.0f + (4.0f * s), 0.5f + float(i));
+  }
+
+  // Chains of boxes swinging from a point above the ground
+  for (size_t c = 0; c < nChains; c++) {
+    const float fX = -800.0f + (20.0f * c);
+    b2Body* pPrevious = pGround;
+    for (size_t i = 0; i < 8; i++) {
+      b2Body* pLink = CreateBox(world, index, fX + 1.0f + float(i), 30.0f);
+
+      b2RevoluteJointDef jointDef;
+      jointDef.Initialize(pPrevious, pLink, b2Vec2(fX + 0.5f + float(i), 30.0f));
+      world.CreateJoint(&jointDef);
+
+      pPrevious = pLink;
+    }
+  }
+}
+
+// A hash of every position and angle, bit for bit
+uint64_t GetStateHash(const b2World& world)
+{
+  uint64_t hash = 1469598103934665603ull;
+  for (const b2Body* pBody = world.GetBodyList(); pBody != nullptr; pBody = pBody->GetNext()) {
+    const b2Vec2 position = pBody->GetPosition();
+    const float values[3] = { position.x, position.y, pBody->GetAngle() };
+    for (float fValue : values) {
+      uint32_t bits = 0;
+      std::memcpy(&bits, &fValue, sizeof(bits));
+      hash = (hash ^ bits) * 1099511628211ull;
+    }
+  }
+
+  return hash;
+}
+
+}
+
+TEST(BreatheBox2D, TestParallelIslandSolverIsDeterministic)
+{
+  b2World serialWorld(b2Vec2(0.0f, -10.0f));
+  cPostSolveRecorder serialRecorder;
+  serialWorld.SetContactListener(&serialRecorder);
+  CreateScene(serialWorld, 4, 20, 4);
+
+  spitfire::util::cThreadPool pool(3);
+  breathe::box2d::cTaskExecutor executor(pool);
+  EXPECT_EQ(4, executor.GetThreadCount());
+
+  b2World parallelWorld(b2Vec2(0.0f, -10.0f));
+  cPostSolveRecorder parallelRecorder;
+  parallelWorld.SetContactListener(&parallelRecorder);
+  parallelWorld.SetTaskExecutor(&executor);
+  CreateScene(parallelWorld, 4, 20, 4);
+
+  for (size_t i = 0; i < 240; i++) {
+    serialWorld.Step(fTimeStep, nVelocityIterations, nPositionIterations);
+    parallelWorld.Step(fTimeStep, nVelocityIterations, nPositionIterations);
+
+    ASSERT_EQ(GetStateHash(serialWorld), GetStateHash(parallelWorld)) << "step " << i;
+  }
+
+  EXPECT_FALSE(serialRecorder.entries.empty());
+  EXPECT_TRUE(serialRecorder.entries == parallelRecorder.entries);
+
+  // The bodies that went to sleep, including the shared ground body, are the same too
+  const b2Body* pSerialBody = serialWorld.GetBodyList();
+  const b2Body* pParallelBody = parallelWorld.GetBodyList();
+  for (; (pSerialBody != nullptr) && (pParallelBody != nullptr); pSerialBody = pSerialBody->GetNext(), pParallelBody = pParallelBody->GetNext()) {
+    EXPECT_EQ(pSerialBody->IsAwake(), pParallelBody->IsAwake());
+  }
+  EXPECT_TRUE((pSerialBody == nullptr) && (pParallelBody == nullptr));
+}
+
+TEST(BreatheBox2D, TestParallelIslandSolverSettles)
+{
+  spitfire::util::cThreadPool pool(3);
+  breathe::box2d::cTaskExecutor executor(pool);
+
+  b2World world(b2Vec2(0.0f, -10.0f));
+  world.SetTaskExecutor(&executor);
+  CreateScene(world, 2, 10, 2);
+
+  for (size_t i = 0; i < 600; i++) world.Step(fTimeStep, nVelocityIterations, nPositionIterations);
+
+  for (const b2Body* pBody = world.GetBodyList(); pBody != nullptr; pBody = pBody->GetNext()) {
+    if (pBody->GetType() != b2_dynamicBody) continue;
+
+    // Nothing has fallen through the ground and the chains are still hanging from their anchors
+    const b2Vec2 position = pBody->GetPosition();
+    EXPECT_GT(position.y, 0.4f);
+    if (pBody->GetJointList() != nullptr) {
+      EXPECT_GT(position.y, 21.0f);
+    } else {
+      EXPECT_LT(pBody->GetLinearVelocity().Length(), 0.5f);
+    }
+  }
+
+  // The stacks are still standing
+  size_t nTopOfStacks = 0;
+  for (const b2Body* pBody = world.GetBodyList(); pBody != nullptr; pBody = pBody->GetNext()) {
+    if ((pBody->GetPosition().x > 19.0f) && (pBody->GetPosition().y > 9.0f)) nTopOfStacks++;
+  }
+  EXPECT_EQ(10, nTopOfStacks);
+}
+
+TEST(BreatheBox2D, DISABLED_TestParallelIslandSolverBenchmark)
+{
+  for (size_t nThreads : { 1, 2, 4 }) {
+    spitfire::util::cThreadPool pool(nThreads - 1);
+    breathe::box2d::cTaskExecutor executor(pool);
+
+    b2World world(b2Vec2(0.0f, -10.0f));
+    if (nThreads != 1) world.SetTaskExecutor(&executor);
+    CreateScene(world, 10, 100, 10);
+
+    // The bodies are still moving so nothing has gone to sleep yet
+    const size_t nSteps = 120;
+    double fSolveMS = 0.0;
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < nSteps; i++) {
+      world.Step(fTimeStep, nVelocityIterations, nPositionIterations);
+      fSolveMS += world.GetProfile().solve;
+    }
+    const double fStepMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nSteps;
+
+    std::cout<<"box2d bodies="<<world.GetBodyCount()<<" contacts="<<world.GetContactCount()<<" threads="<<nThreads<<" step="<<fStepMS<<"ms solve="<<(fSolveMS / nSteps)<<"ms"<<std::endl;
+  }
+}
@@ -0,0 +1,147 @@
+// Standard headers
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cMat4.h>
+#include <spitfire/math/cVec3.h>
+
+// Breathe headers
+#include <breathe/render/cInstanceBatcher.h>
+
+namespace {
+
+breathe::render::cRenderState CreateState(uint32_t shader, uint32_t texture, uint32_t vertexBufferObject)
+{
+  breathe::render::cRenderState state;
+  state.shader = shader;
+  state.textures[0] = texture;
+  state.vertexBufferObject = vertexBufferObject;
+  return state;
+}
+
+spitfire::math::cMat4 CreateMatrix(size_t item)
+{
+  spitfire::math::cMat4 mat;
+  mat.SetTranslation(spitfire::math::cVec3(float(item), float(item * 2), float(item * 3)));
+  return mat;
+}
+
+}
+
+TEST(BreatheInstanceBatcher, TestGroupsAndPacksMatrices)
+{
+  breathe::render::cInstanceBatcher batcher;
+  batcher.SetMaximumInstancesPerBatch(4);
+  batcher.SetMinimumInstances(2);
+
+  // 6 trees and 2 rocks interleaved, a bush that is on its own and a tree mesh with a different material
+  const breathe::render::cRenderState tree = CreateState(1, 10, 100);
+  const breathe::render::cRenderState rock = CreateState(1, 11, 101);
+  const breathe::render::cRenderState bush = CreateState(1, 12, 102);
+  const breathe::render::cRenderState deadTree = CreateState(1, 13, 100);
+
+  std::vector<breathe::render::cRenderState> states = { tree, rock, tree, tree, bush, tree, rock, tree, deadTree, tree };
+  for (size_t i = 0; i < states.size(); i++) batcher.Add(states[i], 0, CreateMatrix(i), i);
+
+  batcher.Build();
+
+  // The trees are split into 4 + 2, the rocks are one batch, the bush and the dead tree are single draws
+  const std::vector<breathe::render::cInstanceBatch>& batches = batcher.GetBatches();
+  ASSERT_EQ(3u, batches.size());
+  EXPECT_EQ(5u, batcher.GetDrawCount());
+
+  EXPECT_EQ(tree, batches[0].state);
+  EXPECT_EQ(4u, batches[0].nInstances);
+  EXPECT_EQ(0u, batches[0].item);
+  EXPECT_EQ(tree, batches[1].state);
+  EXPECT_EQ(2u, batches[1].nInstances);
+  EXPECT_EQ(rock, batches[2].state);
+  EXPECT_EQ(2u, batches[2].nInstances);
+
+  const std::vector<size_t>& singleItems = batcher.GetSingleItems();
+  ASSERT_EQ(2u, singleItems.size());
+  EXPECT_EQ(8u, singleItems[0]);
+  EXPECT_EQ(4u, singleItems[1]);
+
+  // The instances keep the order they were added in and each matrix is packed in column major order
+  const std::vector<size_t> expectedItems = { 0, 2, 3, 5, 7, 9, 1, 6 };
+  EXPECT_EQ(expectedItems, batcher.GetInstanceItems());
+  ASSERT_EQ(8u * breathe::render::cInstanceBatcher::FLOATS_PER_INSTANCE, batcher.GetInstanceBuffer().size());
+
+  for (const breathe::render::cInstanceBatch& batch : batches) {
+    const float* pMatrices = batcher.GetInstanceMatrices(batch);
+    for (size_t i = 0; i < batch.nInstances; i++) {
+      const size_t item = batcher.GetInstanceItems()[batch.firstInstance + i];
+      const spitfire::math::cMat4 expected = CreateMatrix(item);
+      for (size_t entry = 0; entry < 16; entry++) EXPECT_EQ(expected[entry], pMatrices[(i * 16) + entry]);
+    }
+  }
+}
+
+TEST(BreatheInstanceBatcher, TestGeometryAndAlphaBlendingAreNotMerged)
+{
+  breathe::render::cInstanceBatcher batcher;
+  batcher.SetMinimumInstances(2);
+
+  breathe::render::cRenderState transparent = CreateState(1, 10, 100);
+  transparent.bIsAlphaBlending = true;
+
+  for (size_t i = 0; i < 3; i++) {
+    batcher.Add(CreateState(1, 10, 100), 0, CreateMatrix(i), i);
+    batcher.Add(CreateState(1, 10, 100), 1, CreateMatrix(i), 10 + i);
+    batcher.Add(transparent, 0, CreateMatrix(i), 20 + i);
+  }
+
+  batcher.Build();
+
+  ASSERT_EQ(3u, batcher.GetBatches().size());
+  EXPECT_TRUE(batcher.GetSingleItems().empty());
+  for (const breathe::render::cInstanceBatch& batch : batcher.GetBatches()) EXPECT_EQ(3u, batch.nInstances);
+
+  // Clearing starts a new frame
+  batcher.Clear();
+  batcher.Build();
+  EXPECT_EQ(0u, batcher.GetDrawCount());
+  EXPECT_TRUE(batcher.GetInstanceBuffer().empty());
+}
+
+TEST(BreatheInstanceBatcher, DISABLED_TestBenchmark)
+{
+  // A forest of 10 species with a few unique props
+  const size_t nDraws = 100000;
+  const size_t nFrames = 10;
+
+  std::mt19937 generator(1234);
+  std::vector<breathe::render::cRenderState> states;
+  std::vector<spitfire::math::cMat4> matrices;
+  for (size_t i = 0; i < nDraws; i++) {
+    const uint32_t species = ((i % 100) == 0) ? uint32_t(1000 + i) : uint32_t(generator() % 10);
+    states.push_back(CreateState(1, 10 + species, 100 + species));
+
+    spitfire::math::cMat4 mat;
+    mat.SetTranslation(spitfire::math::cVec3(float(generator() % 1000), 0.0f, float(generator() % 1000)));
+    matrices.push_back(mat);
+  }
+
+  breathe::render::cInstanceBatcher batcher;
+
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (size_t frame = 0; frame < nFrames; frame++) {
+    batcher.Clear();
+    batcher.Reserve(nDraws);
+    for (size_t i = 0; i < nDraws; i++) batcher.Add(states[i], 0, matrices[i], i);
+    batcher.Build();
+  }
+  const double fBuildMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nFrames;
+
+  EXPECT_EQ(nDraws, batcher.GetInstanceItems().size() + batcher.GetSingleItems().size());
+  EXPECT_GT(nDraws / 20, batcher.GetDrawCount());
+
+  std::cout<<"cInstanceBatcher draws="<<nDraws<<" instanced draws="<<batcher.GetDrawCount()<<" build="<<fBuildMS<<"ms"<<std::endl;
+}
@@ -0,0 +1,235 @@
+// Standard headers
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// Breathe headers
+#include <breathe/render/cRenderQueue.h>
+
+namespace {
+
+// Keeps track of what would be bound in OpenGL and checks that each draw sees the state it asked for
+class cMockRenderQueueContext : public breathe::render::cRenderQueueContext
+{
+public:
+  explicit cMockRenderQueueContext(const std::vector<breathe::render::cRenderState>& _expected) : nWrongStates(0), expected(_expected) {}
+
+  std::vector<size_t> drawn;
+  size_t nWrongStates;
+  breathe::render::cRenderState bound;
+
+private:
+  void _BindShader(uint32_t shader) override { bound.shader = shader; }
+  void _BindTexture(size_t unit, uint32_t texture) override { bound.textures[unit] = texture; }
+  void _BindVertexBufferObject(uint32_t vertexBufferObject) override { bound.vertexBufferObject = vertexBufferObject; }
+  void _SetAlphaBlending(bool bEnable) override { bound.bIsAlphaBlending = bEnable; }
+
+  void _Draw(size_t item) override
+  {
+    if (bound != expected[item]) nWrongStates++;
+    drawn.push_back(item);
+  }
+
+  const std::vector<breathe::render::cRenderState>& expected;
+};
+
+breathe::render::cRenderState CreateState(uint32_t shader, uint32_t texture, uint32_t vertexBufferObject)
+{
+  breathe::render::cRenderState state;
+  state.shader = shader;
+  state.textures[0] = texture;
+  state.vertexBufferObject = vertexBufferObject;
+  return state;
+}
+
+// A frame with lots of objects sharing a few shaders and textures
+void CreateFrame(size_t nDraws, uint32_t seed, std::vector<breathe::render::cRenderState>& states, std::vector<float>& depths)
+{
+  std::mt19937 generator(seed);
+
+  states.clear();
+  depths.clear();
+  for (size_t i = 0; i < nDraws; i++) {
+    breathe::render::cRenderState state = CreateState(1 + (generator() % 16), 1 + (generator() % 64), 1 + (generator() % 256));
+    if ((i % 10) == 0) state.textures[1] = 100 + (generator() % 4);
+    if ((i % 20) == 0) state.bIsAlphaBlending = true;
+    states.push_back(state);
+    depths.push_back(std::uniform_real_distribution<float>(0.0f, 1.0f)(generator));
+  }
+}
+
+void AddFrame(breathe::render::cRenderQueue& queue, const std::vector<breathe::render::cRenderState>& states, const std::vector<float>& depths)
+{
+  queue.Clear();
+  queue.Reserve(states.size());
+  for (size_t i = 0; i < states.size(); i++) {
+    if (states[i].bIsAlphaBlending) queue.AddTransparent(0, states[i], depths[i], i);
+    else queue.AddOpaque(0, states[i], depths[i], i);
+  }
+}
+
+}
+
+TEST(BreatheRenderQueue, TestKeys)
+{
+  const breathe::render::cRenderState a = CreateState(1, 1, 1);
+  const breathe::render::cRenderState b = CreateState(2, 1, 1);
+
+  // Layers come first
+  EXPECT_LT(breathe::render::cRenderQueue::MakeTransparentKey(0, b, 0.0f), breathe::render::cRenderQueue::MakeOpaqueKey(1, a, 0.0f));
+
+  // Opaque before transparent
+  EXPECT_LT(breathe::render::cRenderQueue::MakeOpaqueKey(0, b, 1.0f), breathe::render::cRenderQueue::MakeTransparentKey(0, a, 0.0f));
+
+  // Opaque are sorted by state before depth, and then front to back
+  EXPECT_LT(breathe::render::cRenderQueue::MakeOpaqueKey(0, a, 1.0f), breathe::render::cRenderQueue::MakeOpaqueKey(0, b, 0.0f));
+  EXPECT_LT(breathe::render::cRenderQueue::MakeOpaqueKey(0, a, 0.25f), breathe::render::cRenderQueue::MakeOpaqueKey(0, a, 0.5f));
+
+  // Transparent are sorted back to front before state
+  EXPECT_LT(breathe::render::cRenderQueue::MakeTransparentKey(0, b, 0.5f), breathe::render::cRenderQueue::MakeTransparentKey(0, a, 0.25f));
+
+  // Depths outside the far plane are clamped
+  EXPECT_EQ(breathe::render::cRenderQueue::MakeOpaqueKey(0, a, 1.0f), breathe::render::cRenderQueue::MakeOpaqueKey(0, a, 2.0f));
+  EXPECT_EQ(breathe::render::cRenderQueue::MakeOpaqueKey(0, a, 0.0f), breathe::render::cRenderQueue::MakeOpaqueKey(0, a, -1.0f));
+}
+
+TEST(BreatheRenderQueue, TestSortIsStableAndMatchesStdSort)
+{
+  std::vector<breathe::render::cRenderState> states;
+  std::vector<float> depths;
+  CreateFrame(10000, 1234, states, depths);
+
+  // Quantise some depths to the same value so that there are plenty of equal keys
+  for (size_t i = 0; i < depths.size(); i += 3) depths[i] = 0.5f;
+
+  breathe::render::cRenderQueue queue;
+  AddFrame(queue, states, depths);
+
+  std::vector<std::pair<uint64_t, size_t>> expected;
+  for (size_t i = 0; i < queue.GetCount(); i++) expected.push_back(std::make_pair(queue.GetKey(i), queue.GetItem(i)));
+  std::stable_sort(expected.begin(), expected.end(), [](const std::pair<uint64_t, size_t>& lhs, const std::pair<uint64_t, size_t>& rhs) { return lhs.first < rhs.first; });
+
+  queue.Sort();
+
+  ASSERT_EQ(expected.size(), queue.GetCount());
+  size_t nMismatches = 0;
+  for (size_t i = 0; i < queue.GetCount(); i++) {
+    if ((queue.GetKey(i) != expected[i].first) || (queue.GetItem(i) != expected[i].second)) nMismatches++;
+  }
+  EXPECT_EQ(0u, nMismatches);
+}
+
+TEST(BreatheRenderQueue, TestSubmitOnlyChangesDifferentState)
+{
+  std::vector<breathe::render::cRenderState> states;
+  std::vector<float> depths;
+
+  // 3 shaders with 2 textures each, drawn in an interleaved order
+  for (size_t i = 0; i < 60; i++) {
+    states.push_back(CreateState(1 + (i % 3), 10 + (i % 2), 20));
+    depths.push_back(float(i) / 60.0f);
+  }
+
+  breathe::render::cRenderQueue queue;
+  AddFrame(queue, states, depths);
+  queue.Sort();
+
+  cMockRenderQueueContext context(states);
+  queue.Submit(context);
+
+  EXPECT_EQ(0u, context.nWrongStates);
+  EXPECT_EQ(60u, context.drawn.size());
+  EXPECT_EQ(breathe::render::cRenderState(), context.bound);
+
+  // One bind per shader and the unbind at the end
+  const breathe::render::cRenderQueueStatistics& statistics = queue.GetStatistics();
+  EXPECT_EQ(60u, statistics.nDraws);
+  EXPECT_EQ(4u, statistics.nShaderBinds);
+  EXPECT_EQ(7u, statistics.nTextureBinds); // Both textures for each shader and the unbind
+  EXPECT_EQ(2u, statistics.nVertexBufferObjectBinds);
+  EXPECT_EQ(0u, statistics.nAlphaBlendingChanges);
+
+  // Transparent draws are drawn last and back to front
+  states.clear();
+  depths.clear();
+  breathe::render::cRenderState transparent = CreateState(1, 10, 20);
+  transparent.bIsAlphaBlending = true;
+  states.push_back(transparent);
+  depths.push_back(0.1f);
+  states.push_back(CreateState(1, 10, 20));
+  depths.push_back(0.2f);
+  states.push_back(transparent);
+  depths.push_back(0.9f);
+
+  AddFrame(queue, states, depths);
+  queue.Sort();
+
+  cMockRenderQueueContext context2(states);
+  queue.Submit(context2);
+
+  EXPECT_EQ(0u, context2.nWrongStates);
+  ASSERT_EQ(3u, context2.drawn.size());
+  EXPECT_EQ(1u, context2.drawn[0]);
+  EXPECT_EQ(2u, context2.drawn[1]);
+  EXPECT_EQ(0u, context2.drawn[2]);
+  EXPECT_EQ(2u, queue.GetStatistics().nAlphaBlendingChanges);
+}
+
+TEST(BreatheRenderQueue, DISABLED_TestBenchmark)
+{
+  const size_t nDraws = 100000;
+  const size_t nFrames = 20;
+
+  std::vector<breathe::render::cRenderState> states;
+  std::vector<float> depths;
+  CreateFrame(nDraws, 5678, states, depths);
+
+  breathe::render::cRenderQueue queue;
+
+  // Submission order, the state is still only changed when it differs from the previous draw
+  AddFrame(queue, states, depths);
+  cMockRenderQueueContext unsortedContext(states);
+  queue.Submit(unsortedContext);
+  const breathe::render::cRenderQueueStatistics unsorted = queue.GetStatistics();
+  EXPECT_EQ(0u, unsortedContext.nWrongStates);
+
+  double fRadixMS = 0.0;
+  double fStdSortMS = 0.0;
+  for (size_t frame = 0; frame < nFrames; frame++) {
+    AddFrame(queue, states, depths);
+    std::vector<uint64_t> keys;
+    keys.reserve(nDraws);
+    for (size_t i = 0; i < nDraws; i++) keys.push_back(queue.GetKey(i));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    queue.Sort();
+    fRadixMS += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    std::sort(keys.begin(), keys.end());
+    fStdSortMS += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    EXPECT_EQ(keys.back(), queue.GetKey(nDraws - 1));
+  }
+
+  cMockRenderQueueContext sortedContext(states);
+  queue.Submit(sortedContext);
+  const breathe::render::cRenderQueueStatistics sorted = queue.GetStatistics();
+  EXPECT_EQ(0u, sortedContext.nWrongStates);
+
+  EXPECT_LT(sorted.nShaderBinds, unsorted.nShaderBinds);
+  EXPECT_LT(sorted.nTextureBinds, unsorted.nTextureBinds);
+  EXPECT_LT(sorted.nVertexBufferObjectBinds, unsorted.nVertexBufferObjectBinds);
+
+  std::cout<<"cRenderQueue draws="<<nDraws<<" radix sort="<<(fRadixMS / nFrames)<<"ms std::sort="<<(fStdSortMS / nFrames)<<"ms"<<std::endl;
+  std::cout<<"cRenderQueue unsorted shader="<<unsorted.nShaderBinds<<" texture="<<unsorted.nTextureBinds<<" vbo="<<unsorted.nVertexBufferObjectBinds<<" blend="<<unsorted.nAlphaBlendingChanges<<std::endl;
+  std::cout<<"cRenderQueue sorted shader="<<sorted.nShaderBinds<<" texture="<<sorted.nTextureBinds<<" vbo="<<sorted.nVertexBufferObjectBinds<<" blend="<<sorted.nAlphaBlendingChanges<<std::endl;
+}
@@ -0,0 +1,300 @@
+// Standard headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cRectanglePacker.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/render/cResourceLoader.h>
+
+namespace {
+
+// Stands in for an image decoder
+std::vector<uint8_t> DecodeImage(size_t width, size_t height, uint8_t value)
+{
+  return std::vector<uint8_t>(width * height * 4, value);
+}
+
+// Uploads until everything has finished, like a game would once per frame
+void UpdateUntilIdle(breathe::render::cResourceLoader& loader)
+{
+  while (!loader.IsIdle()) {
+    loader.Update(1.0f);
+    std::this_thread::yield();
+  }
+}
+
+}
+
+TEST(BreatheResourceLoader, TestDecodeOnWorkersUploadOnMainThread)
+{
+  spitfire::util::cThreadPool pool(4);
+  breathe::render::cResourceLoader loader(pool);
+
+  // Hold the decodes until everything has been added to show that Add doesn't wait for them
+  std::mutex mutexGate;
+  mutexGate.lock();
+
+  const std::thread::id mainThread = std::this_thread::get_id();
+  std::atomic<size_t> nDecoded(0);
+
+  const size_t n = 32;
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> images;
+  std::vector<std::vector<uint8_t>> uploaded(n);
+  std::vector<std::thread::id> uploadThreads(n);
+  std::vector<breathe::render::cResourceHandle> handles;
+
+  for (size_t i = 0; i < n; i++) {
+    std::shared_ptr<std::vector<uint8_t>> pImage(new std::vector<uint8_t>);
+    images.push_back(pImage);
+
+    handles.push_back(loader.Add(
+      [&, pImage, i](std::vector<breathe::render::cResourceHandle>&) {
+        { std::lock_guard<std::mutex> lock(mutexGate); }
+        *pImage = DecodeImage(16, 16, uint8_t(i));
+        nDecoded++;
+        return true;
+      },
+      [&, pImage, i]() {
+        uploadThreads[i] = std::this_thread::get_id();
+        uploaded[i] = *pImage;
+        return true;
+      }
+    ));
+  }
+
+  EXPECT_EQ(n, loader.GetPendingCount());
+  for (auto&& handle : handles) EXPECT_EQ(breathe::render::RESOURCE_STATE::DECODING, handle.GetState());
+
+  // Nothing is uploaded until the decodes have finished
+  EXPECT_EQ(0, loader.Update(1000.0f));
+
+  mutexGate.unlock();
+
+  UpdateUntilIdle(loader);
+
+  EXPECT_EQ(n, nDecoded.load());
+  for (size_t i = 0; i < n; i++) {
+    EXPECT_TRUE(handles[i].IsLoaded());
+    EXPECT_EQ(mainThread, uploadThreads[i]);
+    EXPECT_EQ(DecodeImage(16, 16, uint8_t(i)), uploaded[i]);
+  }
+
+  // A default handle is a resource that was loaded synchronously
+  EXPECT_TRUE(breathe::render::cResourceHandle().IsLoaded());
+}
+
+TEST(BreatheResourceLoader, TestDependencies)
+{
+  spitfire::util::cThreadPool pool(4);
+  breathe::render::cResourceLoader loader(pool);
+
+  // The order that the uploads happen in, only touched on the main thread
+  std::vector<std::string> order;
+
+  auto AddTexture = [&](const std::string& sName, bool bIsValid) {
+    return loader.Add(
+      [bIsValid](std::vector<breathe::render::cResourceHandle>&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return bIsValid;
+      },
+      [&order, sName]() {
+        order.push_back(sName);
+        return true;
+      }
+    );
+  };
+
+  // Known dependencies
+  breathe::render::cResourceHandle diffuse = AddTexture("diffuse", true);
+  breathe::render::cResourceHandle normal = AddTexture("normal", true);
+  breathe::render::cResourceHandle material = loader.Add(
+    nullptr,
+    [&]() {
+      EXPECT_TRUE(diffuse.IsLoaded());
+      EXPECT_TRUE(normal.IsLoaded());
+      order.push_back("material");
+      return true;
+    },
+    { diffuse, normal }
+  );
+
+  // Dependencies found while parsing, one of them fails but the material still loads and can fall back to a placeholder
+  std::vector<breathe::render::cResourceHandle> parsedTextures;
+  bool bUsedPlaceholder = false;
+  breathe::render::cResourceHandle parsedMaterial = loader.Add(
+    [&](std::vector<breathe::render::cResourceHandle>& dependencies) {
+      parsedTextures.push_back(AddTexture("detail", true));
+      parsedTextures.push_back(AddTexture("missing", false));
+      parsedTextures.push_back(diffuse);
+      dependencies = parsedTextures;
+      return true;
+    },
+    [&]() {
+      for (auto&& texture : parsedTextures) {
+        EXPECT_TRUE(texture.IsFinished());
+        if (texture.IsFailed()) bUsedPlaceholder = true;
+      }
+      order.push_back("parsedmaterial");
+      return true;
+    }
+  );
+
+  // A resource that fails to decode is never uploaded
+  breathe::render::cResourceHandle missing = AddTexture("failed", false);
+
+  UpdateUntilIdle(loader);
+
+  EXPECT_TRUE(material.IsLoaded());
+  EXPECT_TRUE(parsedMaterial.IsLoaded());
+  EXPECT_TRUE(bUsedPlaceholder);
+  EXPECT_TRUE(missing.IsFailed());
+  ASSERT_EQ(3, parsedTextures.size());
+  EXPECT_TRUE(parsedTextures[0].IsLoaded());
+  EXPECT_TRUE(parsedTextures[1].IsFailed());
+
+  auto GetPosition = [&](const std::string& sName) {
+    return std::find(order.begin(), order.end(), sName) - order.begin();
+  };
+  ASSERT_EQ(5, order.size());
+  EXPECT_LT(GetPosition("diffuse"), GetPosition("material"));
+  EXPECT_LT(GetPosition("normal"), GetPosition("material"));
+  EXPECT_LT(GetPosition("diffuse"), GetPosition("parsedmaterial"));
+  EXPECT_LT(GetPosition("detail"), GetPosition("parsedmaterial"));
+  EXPECT_EQ(order.end(), std::find(order.begin(), order.end(), "missing"));
+
+  // Depending on resources that have already finished doesn't wait
+  breathe::render::cResourceHandle late = loader.Add(nullptr, nullptr, { diffuse, missing });
+  loader.Flush();
+  EXPECT_TRUE(late.IsLoaded());
+
+  // An upload can fail too
+  breathe::render::cResourceHandle uploadFailed = loader.Add(nullptr, []() { return false; });
+  loader.Flush();
+  EXPECT_TRUE(uploadFailed.IsFailed());
+}
+
+TEST(BreatheResourceLoader, TestUploadTimeBudget)
+{
+  spitfire::util::cThreadPool pool(2);
+  breathe::render::cResourceLoader loader(pool);
+
+  const size_t n = 20;
+  std::vector<breathe::render::cResourceHandle> handles;
+  for (size_t i = 0; i < n; i++) {
+    handles.push_back(loader.Add(nullptr, []() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      return true;
+    }));
+  }
+
+  // Wait for all of the decodes
+  for (auto&& handle : handles) {
+    while (handle.GetState() == breathe::render::RESOURCE_STATE::DECODING) std::this_thread::yield();
+    EXPECT_EQ(breathe::render::RESOURCE_STATE::WAITING_FOR_UPLOAD, handle.GetState());
+  }
+
+  // Even with no budget one resource is uploaded so that loading always progresses
+  EXPECT_EQ(1, loader.Update(0.0f));
+
+  // Each upload takes at least 2ms so a 5ms budget can only fit a few of them
+  const size_t nUploaded = loader.Update(5.0f);
+  EXPECT_LE(1, nUploaded);
+  EXPECT_GE(3, nUploaded);
+  EXPECT_EQ(n - 1 - nUploaded, loader.GetPendingCount());
+
+  loader.Flush();
+  EXPECT_TRUE(loader.IsIdle());
+  for (auto&& handle : handles) EXPECT_TRUE(handle.IsLoaded());
+}
+
+TEST(BreatheResourceLoader, TestAtlasPagesOnWorkers)
+{
+  spitfire::util::cThreadPool pool(4);
+  breathe::render::cResourceLoader loader(pool);
+
+  // The atlas decodes its images and packs them into pages on a worker, only the pages are uploaded
+  const size_t nPageSize = 128;
+  std::vector<std::pair<size_t, size_t>> sizes;
+  for (size_t i = 0; i < 100; i++) sizes.push_back(std::make_pair(8 + (i % 5) * 4, 8 + (i % 3) * 8));
+
+  std::shared_ptr<std::vector<std::vector<uint8_t>>> pPages(new std::vector<std::vector<uint8_t>>);
+  size_t nUploadedPages = 0;
+
+  breathe::render::cResourceHandle atlas = loader.Add(
+    [&pool, sizes, pPages, nPageSize](std::vector<breathe::render::cResourceHandle>&) {
+      std::vector<std::vector<uint8_t>> images(sizes.size());
+      spitfire::util::ParallelFor(pool, 0, sizes.size(), 8, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) images[i] = DecodeImage(sizes[i].first, sizes[i].second, uint8_t(1 + i));
+      });
+
+      std::vector<spitfire::math::cRectanglePacker> packers;
+      std::vector<spitfire::math::cPackedRectangle> packed;
+      if (!spitfire::math::PackRectangles(nPageSize, nPageSize, spitfire::math::PACKING_ALGORITHM::SKYLINE, sizes, packers, packed)) return false;
+
+      pPages->assign(packers.size(), std::vector<uint8_t>(nPageSize * nPageSize * 4, 0));
+      for (size_t i = 0; i < sizes.size(); i++) {
+        const size_t nRowBytes = sizes[i].first * 4;
+        for (size_t y = 0; y < sizes[i].second; y++) {
+          std::copy(images[i].begin() + (y * nRowBytes), images[i].begin() + ((y + 1) * nRowBytes), (*pPages)[packed[i].page].begin() + (((packed[i].y + y) * nPageSize) + packed[i].x) * 4);
+        }
+      }
+
+      return true;
+    },
+    [pPages, &nUploadedPages]() {
+      nUploadedPages = pPages->size();
+      return true;
+    }
+  );
+
+  loader.Flush();
+
+  EXPECT_TRUE(atlas.IsLoaded());
+  EXPECT_LT(1, nUploadedPages);
+
+  // Every image made it into a page
+  size_t nUsedPixels = 0;
+  size_t nExpectedPixels = 0;
+  for (auto&& page : *pPages) {
+    for (size_t i = 0; i < page.size(); i += 4) if (page[i] != 0) nUsedPixels++;
+  }
+  for (auto&& size : sizes) nExpectedPixels += size.first * size.second;
+  EXPECT_EQ(nExpectedPixels, nUsedPixels);
+}
+
+TEST(BreatheResourceLoader, TestDestroyWhileLoading)
+{
+  spitfire::util::cThreadPool pool(2);
+
+  std::atomic<size_t> nUploaded(0);
+
+  {
+    breathe::render::cResourceLoader loader(pool);
+    for (size_t i = 0; i < 100; i++) {
+      loader.Add(
+        [](std::vector<breathe::render::cResourceHandle>&) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          return true;
+        },
+        [&nUploaded]() {
+          nUploaded++;
+          return true;
+        }
+      );
+    }
+
+    // The loader waits for the decodes that are running and skips the rest
+  }
+
+  EXPECT_EQ(0, nUploaded.load());
+}
@@ -0,0 +1,271 @@
+// Standard headers
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cMat4.h>
+#include <spitfire/math/cQuaternion.h>
+#include <spitfire/math/cVec3.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/game/cTransformHierarchy.h>
+
+namespace {
+
+const size_t NULL_TRANSFORM = breathe::scenegraph3d::cTransformHierarchy::NULL_TRANSFORM;
+
+// A hierarchy with the parent of each transform always created before it, like a scene that was loaded from a file
+class cScene
+{
+public:
+  void Create(breathe::scenegraph3d::cTransformHierarchy& transforms, size_t nTransforms, size_t nRoots, uint32_t seed);
+
+  void Move(breathe::scenegraph3d::cTransformHierarchy& transforms, size_t index);
+
+  // Absolute matrices calculated in the same order as the hierarchy multiplies them, so the results should be identical
+  void GetReferenceMatrices(const breathe::scenegraph3d::cTransformHierarchy& transforms, std::vector<spitfire::math::cMat4>& matrices) const;
+
+  std::vector<size_t> handles;
+  std::vector<size_t> parents; // Index into handles or NULL_TRANSFORM
+
+private:
+  std::mt19937 generator;
+};
+
+void cScene::Create(breathe::scenegraph3d::cTransformHierarchy& transforms, size_t nTransforms, size_t nRoots, uint32_t seed)
+{
+  generator.seed(seed);
+
+  for (size_t i = 0; i < nTransforms; i++) {
+    // Mostly shallow and wide with a few long chains
+    size_t parent = NULL_TRANSFORM;
+    if (i >= nRoots) {
+      if ((generator() % 4) == 0) parent = i - 1;
+      else parent = std::uniform_int_distribution<size_t>(0, i - 1)(generator);
+    }
+
+    parents.push_back(parent);
+    handles.push_back(transforms.Create((parent == NULL_TRANSFORM) ? NULL_TRANSFORM : handles[parent]));
+    Move(transforms, i);
+  }
+}
+
+void cScene::Move(breathe::scenegraph3d::cTransformHierarchy& transforms, size_t index)
+{
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+  const spitfire::math::cVec3 position(distribution(generator), distribution(generator), distribution(generator));
+  transforms.SetRelativePosition(handles[index], position);
+
+  spitfire::math::cQuaternion rotation;
+  rotation.SetFromAxisAngle(spitfire::math::cVec3(0.0f, 1.0f, 0.0f), distribution(generator));
+  transforms.SetRelativeRotation(handles[index], rotation);
+}
+
+void cScene::GetReferenceMatrices(const breathe::scenegraph3d::cTransformHierarchy& transforms, std::vector<spitfire::math::cMat4>& matrices) const
+{
+  matrices.resize(handles.size());
+  for (size_t i = 0; i < handles.size(); i++) {
+    spitfire::math::cMat4 matRelative;
+    matRelative.SetRotation(transforms.GetRelativeRotation(handles[i]));
+    matRelative.SetTranslation(transforms.GetRelativePosition(handles[i]));
+
+    if (parents[i] != NULL_TRANSFORM) matrices[i] = matrices[parents[i]] * matRelative;
+    else matrices[i] = matRelative;
+  }
+}
+
+bool IsEqual(const spitfire::math::cMat4& lhs, const spitfire::math::cMat4& rhs)
+{
+  for (size_t i = 0; i < 16; i++) {
+    if (lhs[i] != rhs[i]) return false;
+  }
+
+  return true;
+}
+
+size_t CountMismatches(const cScene& scene, const breathe::scenegraph3d::cTransformHierarchy& transforms)
+{
+  std::vector<spitfire::math::cMat4> matrices;
+  scene.GetReferenceMatrices(transforms, matrices);
+
+  size_t nMismatches = 0;
+  for (size_t i = 0; i < scene.handles.size(); i++) {
+    if (!IsEqual(matrices[i], transforms.GetAbsoluteMatrix(scene.handles[i]))) nMismatches++;
+  }
+
+  return nMismatches;
+}
+
+}
+
+TEST(BreatheTransformHierarchy, TestDirtyPropagation)
+{
+  breathe::scenegraph3d::cTransformHierarchy transforms;
+
+  // root -> a -> b, root -> c
+  const size_t root = transforms.Create(NULL_TRANSFORM);
+  const size_t a = transforms.Create(root);
+  const size_t b = transforms.Create(a);
+  const size_t c = transforms.Create(root);
+  EXPECT_EQ(4u, transforms.GetCount());
+  EXPECT_EQ(a, transforms.GetParent(b));
+
+  transforms.SetRelativePosition(root, spitfire::math::cVec3(1.0f, 0.0f, 0.0f));
+  transforms.SetRelativePosition(a, spitfire::math::cVec3(0.0f, 2.0f, 0.0f));
+  transforms.SetRelativePosition(b, spitfire::math::cVec3(0.0f, 0.0f, 3.0f));
+  transforms.SetRelativePosition(c, spitfire::math::cVec3(4.0f, 0.0f, 0.0f));
+
+  transforms.Update();
+  EXPECT_EQ(4u, transforms.GetUpdatedCount());
+  EXPECT_EQ(spitfire::math::cVec3(1.0f, 2.0f, 3.0f), transforms.GetAbsoluteMatrix(b).GetTranslation());
+  EXPECT_EQ(spitfire::math::cVec3(5.0f, 0.0f, 0.0f), transforms.GetAbsoluteMatrix(c).GetTranslation());
+
+  // Nothing has moved
+  transforms.Update();
+  EXPECT_EQ(0u, transforms.GetUpdatedCount());
+
+  // Moving a leaf only updates the leaf
+  transforms.SetRelativePosition(c, spitfire::math::cVec3(5.0f, 0.0f, 0.0f));
+  transforms.Update();
+  EXPECT_EQ(1u, transforms.GetUpdatedCount());
+  EXPECT_EQ(spitfire::math::cVec3(6.0f, 0.0f, 0.0f), transforms.GetAbsoluteMatrix(c).GetTranslation());
+
+  // Moving a node updates its subtree
+  transforms.SetRelativePosition(a, spitfire::math::cVec3(0.0f, 3.0f, 0.0f));
+  transforms.Update();
+  EXPECT_EQ(2u, transforms.GetUpdatedCount());
+  EXPECT_EQ(spitfire::math::cVec3(1.0f, 3.0f, 3.0f), transforms.GetAbsoluteMatrix(b).GetTranslation());
+
+  // Moving b below c
+  transforms.SetParent(b, c);
+  transforms.Update();
+  EXPECT_EQ(1u, transforms.GetUpdatedCount());
+  EXPECT_EQ(spitfire::math::cVec3(6.0f, 0.0f, 3.0f), transforms.GetAbsoluteMatrix(b).GetTranslation());
+
+  // Destroying a leaf and reusing its transform
+  transforms.Destroy(b);
+  EXPECT_EQ(3u, transforms.GetCount());
+  const size_t d = transforms.Create(a);
+  EXPECT_EQ(b, d);
+  transforms.Update();
+  EXPECT_EQ(1u, transforms.GetUpdatedCount());
+  EXPECT_EQ(spitfire::math::cVec3(1.0f, 3.0f, 0.0f), transforms.GetAbsoluteMatrix(d).GetTranslation());
+}
+
+TEST(BreatheTransformHierarchy, TestAbsoluteMatrixDirty)
+{
+  breathe::scenegraph3d::cTransformHierarchy transforms;
+
+  // root -> a -> b, root -> c
+  const size_t root = transforms.Create(NULL_TRANSFORM);
+  const size_t a = transforms.Create(root);
+  const size_t b = transforms.Create(a);
+  const size_t c = transforms.Create(root);
+  EXPECT_TRUE(transforms.IsAbsoluteMatrixDirty(b));
+
+  transforms.Update();
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(root));
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(b));
+
+  // Moving a makes b dirty too but not its sibling c
+  transforms.SetRelativePosition(a, spitfire::math::cVec3(0.0f, 1.0f, 0.0f));
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(root));
+  EXPECT_TRUE(transforms.IsAbsoluteMatrixDirty(a));
+  EXPECT_TRUE(transforms.IsAbsoluteMatrixDirty(b));
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(c));
+
+  transforms.Update();
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(b));
+
+  // Moving b below c
+  transforms.SetParent(b, c);
+  EXPECT_TRUE(transforms.IsAbsoluteMatrixDirty(b));
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(c));
+
+  transforms.Update();
+  EXPECT_FALSE(transforms.IsAbsoluteMatrixDirty(b));
+}
+
+TEST(BreatheTransformHierarchy, TestParallelUpdateMatchesReference)
+{
+  spitfire::util::cThreadPool pool(4);
+
+  breathe::scenegraph3d::cTransformHierarchy transforms;
+  transforms.SetGrainSize(64);
+
+  cScene scene;
+  scene.Create(transforms, 20000, 8, 1234);
+
+  transforms.Update(pool);
+  EXPECT_EQ(20000u, transforms.GetUpdatedCount());
+  EXPECT_EQ(0u, CountMismatches(scene, transforms));
+
+  // Move a few transforms each frame
+  std::mt19937 generator(5678);
+  for (size_t frame = 0; frame < 10; frame++) {
+    for (size_t i = 0; i < 50; i++) scene.Move(transforms, generator() % scene.handles.size());
+
+    transforms.Update(pool);
+    EXPECT_GT(20000u, transforms.GetUpdatedCount());
+    EXPECT_EQ(0u, CountMismatches(scene, transforms));
+  }
+
+  // Reparent a subtree under a root, the parent is still created before the child so the reference order is valid
+  const size_t child = scene.handles.size() - 1;
+  scene.parents[child] = 0;
+  transforms.SetParent(scene.handles[child], scene.handles[0]);
+  transforms.Update(pool);
+  EXPECT_EQ(0u, CountMismatches(scene, transforms));
+
+  // Moving a root updates its whole subtree
+  scene.Move(transforms, 0);
+  transforms.Update(pool);
+  EXPECT_EQ(0u, CountMismatches(scene, transforms));
+}
+
+TEST(BreatheTransformHierarchy, DISABLED_TestBenchmark)
+{
+  spitfire::util::cThreadPool pool(4);
+
+  const size_t nTransforms = 200000;
+  const size_t nMovedPerFrame = nTransforms / 100;
+  const size_t nFrames = 20;
+
+  breathe::scenegraph3d::cTransformHierarchy transforms;
+  cScene scene;
+  scene.Create(transforms, nTransforms, 64, 4321);
+  transforms.Update(pool);
+
+  // Recomputing every absolute matrix every frame, what cUpdateVisitor used to do
+  std::vector<spitfire::math::cMat4> matrices;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t frame = 0; frame < nFrames; frame++) scene.GetReferenceMatrices(transforms, matrices);
+  const double fFullMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nFrames;
+
+  std::mt19937 generator(8765);
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t frame = 0; frame < nFrames; frame++) {
+    for (size_t i = 0; i < nMovedPerFrame; i++) scene.Move(transforms, generator() % nTransforms);
+    transforms.Update();
+  }
+  const double fDirtyMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nFrames;
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t frame = 0; frame < nFrames; frame++) {
+    for (size_t i = 0; i < nMovedPerFrame; i++) scene.Move(transforms, generator() % nTransforms);
+    transforms.Update(pool);
+  }
+  const double fParallelMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nFrames;
+
+  EXPECT_EQ(0u, CountMismatches(scene, transforms));
+
+  std::cout<<"cTransformHierarchy transforms="<<nTransforms<<" moved="<<nMovedPerFrame<<" full="<<fFullMS<<"ms dirty="<<fDirtyMS<<"ms dirty parallel="<<fParallelMS<<"ms"<<std::endl;
+}
@@ -0,0 +1,302 @@
+// Standard headers
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/threadpool.h>
+
+// Breathe headers
+#include <breathe/physics/verlet.h>
+
+namespace {
+
+// A cloth hanging from its top row, with structural and shear springs
+void CreateCloth(breathe::physics::verlet::cGroup& group, size_t nWidth, size_t nHeight, float fSpacing)
+{
+  for (size_t y = 0; y < nHeight; y++) {
+    for (size_t x = 0; x < nWidth; x++) group.AddParticle(spitfire::math::cVec3(fSpacing * float(x), -fSpacing * float(y), 0.0f));
+  }
+
+  const float fStiffness = 1.0f;
+  const float fDiagonal = std::sqrt(2.0f) * fSpacing;
+  for (size_t y = 0; y < nHeight; y++) {
+    for (size_t x = 0; x < nWidth; x++) {
+      const size_t i = (y * nWidth) + x;
+      if ((x + 1) < nWidth) group.AddSpring(i, i + 1, fSpacing, fStiffness);
+      if ((y + 1) < nHeight) group.AddSpring(i, i + nWidth, fSpacing, fStiffness);
+      if (((x + 1) < nWidth) && ((y + 1) < nHeight)) group.AddSpring(i, i + nWidth + 1, fDiagonal, fStiffness);
+      if ((x > 0) && ((y + 1) < nHeight)) group.AddSpring(i, i + nWidth - 1, fDiagonal, fStiffness);
+    }
+  }
+
+  for (size_t x = 0; x < nWidth; x++) group.AddPin(x);
+}
+
+void InitWorld(breathe::physics::verlet::cWorld& world)
+{
+  breathe::physics::verlet::cWindProperties wind;
+  wind.generalWindForce = spitfire::math::cVec3(0.0f, 0.0f, 0.01f);
+  wind.fMaxHorizontalForce = 0.01f;
+  wind.fMaxVerticalForce = 0.001f;
+  world.Init(-9.8f, wind);
+}
+
+float GetAverageSpringError(const breathe::physics::verlet::cGroup& group)
+{
+  float fTotal = 0.0f;
+  for (const breathe::physics::verlet::Spring& spring : group.springs) {
+    fTotal += std::fabs((group.GetPosition(spring.a) - group.GetPosition(spring.b)).GetLength() - spring.fDistance) / spring.fDistance;
+  }
+  return fTotal / float(group.springs.size());
+}
+
+
+// The previous array of structures solver with pointers to the particles, for comparison
+namespace reference {
+
+struct Particle {
+  explicit Particle(const spitfire::math::cVec3& _pos) : lastPos(_pos), pos(_pos) {}
+
+  spitfire::math::cVec3 lastPos;
+  spitfire::math::cVec3 pos;
+};
+
+struct Spring {
+  Particle* a;
+  Particle* b;
+  float fDistance;
+  float fStiffness;
+};
+
+struct cGroup {
+  std::vector<Particle> particles;
+  std::vector<Particle*> pins;
+  std::vector<Spring> springs;
+};
+
+void Create(cGroup& group, const breathe::physics::verlet::cGroup& other)
+{
+  for (size_t i = 0; i < other.GetNumberOfParticles(); i++) group.particles.push_back(Particle(other.GetPosition(i)));
+  for (uint32_t pin : other.pins) group.pins.push_back(&group.particles[pin]);
+  for (const breathe::physics::verlet::Spring& spring : other.springs) group.springs.push_back(Spring { &group.particles[spring.a], &group.particles[spring.b], spring.fDistance, spring.fStiffness });
+}
+
+void Update(const breathe::physics::verlet::cWorld& world, cGroup& group)
+{
+  const spitfire::math::cVec3 forces = 0.0001f * spitfire::math::cVec3(0.0f, world.GetGravity(), 0.0f) + 0.01f * world.GetWind();
+  const float fFriction = 0.99f;
+
+  for (auto& p : group.particles) {
+    const spitfire::math::cVec3 velocity = fFriction * (p.pos - p.lastPos);
+    p.lastPos = p.pos;
+    p.pos += forces;
+    p.pos += velocity;
+  }
+
+  const size_t relaxationSteps = 16;
+  const float fStepCoefficient = 1.0f / float(relaxationSteps);
+  for (size_t i = 0; i < relaxationSteps; ++i) {
+    for (auto& spring : group.springs) {
+      const spitfire::math::cVec3 normal = spring.a->pos - spring.b->pos;
+      const float m = normal.GetSquaredLength();
+      const float fScale = (((spring.fDistance * spring.fDistance) - m) / m) * spring.fStiffness * fStepCoefficient;
+      const spitfire::math::cVec3 offset = fScale * normal;
+      spring.a->pos += offset;
+      spring.b->pos -= offset;
+    }
+  }
+
+  for (auto& pin : group.pins) pin->pos = pin->lastPos;
+}
+
+}
+
+}
+
+TEST(BreatheVerlet, TestConstraintBatches)
+{
+  breathe::physics::verlet::cGroup group;
+  CreateCloth(group, 20, 10, 0.1f);
+
+  // A hub with more springs than one pass of batches can hold
+  const size_t hub = group.AddParticle(spitfire::math::cVec3(0.0f, 1.0f, 0.0f));
+  for (size_t i = 0; i < 100; i++) group.AddRope(hub, i, 2.0f, 1.0f);
+
+  EXPECT_TRUE(group.bIsConstraintBatchesDirty);
+  group.BuildConstraintBatches();
+  EXPECT_FALSE(group.bIsConstraintBatchesDirty);
+
+  // Every constraint is in exactly one batch and no batch uses a particle twice
+  auto CheckBatches = [&group](const std::vector<breathe::physics::verlet::cConstraintBatch>& batches, size_t nConstraints)
+  {
+    size_t nTotal = 0;
+    for (const breathe::physics::verlet::cConstraintBatch& batch : batches) {
+      std::vector<int> used(group.GetNumberOfParticles(), 0);
+      for (size_t i = 0; i < batch.GetSize(); i++) {
+        EXPECT_EQ(0, used[batch.a[i]]++);
+        EXPECT_EQ(0, used[batch.b[i]]++);
+      }
+      nTotal += batch.GetSize();
+    }
+    EXPECT_EQ(nConstraints, nTotal);
+  };
+
+  CheckBatches(group.springBatches, group.springs.size());
+  CheckBatches(group.ropeBatches, group.ropes.size());
+
+  EXPECT_GE(10u, group.springBatches.size());
+  EXPECT_EQ(100u, group.ropeBatches.size());
+}
+
+TEST(BreatheVerlet, TestCloth)
+{
+  breathe::physics::verlet::cWorld world;
+  InitWorld(world);
+
+  breathe::physics::verlet::cGroup group;
+  CreateCloth(group, 60, 40, 0.05f);
+
+  breathe::physics::verlet::cGroup threaded;
+  CreateCloth(threaded, 60, 40, 0.05f);
+
+  spitfire::util::cThreadPool pool(4);
+
+  for (size_t i = 0; i < 100; i++) {
+    breathe::physics::verlet::Update(world, group);
+    breathe::physics::verlet::Update(world, threaded, pool);
+  }
+
+  // The batches don't share particles so the threads give exactly the same result
+  EXPECT_TRUE(group.x == threaded.x);
+  EXPECT_TRUE(group.y == threaded.y);
+  EXPECT_TRUE(group.z == threaded.z);
+
+  // The cloth has fallen but the pins have stayed where they are and the springs have held it together
+  for (size_t x = 0; x < 60; x++) {
+    EXPECT_EQ(0.05f * float(x), group.x[x]);
+    EXPECT_EQ(0.0f, group.y[x]);
+    EXPECT_EQ(0.0f, group.z[x]);
+  }
+
+  for (size_t i = 0; i < group.GetNumberOfParticles(); i++) {
+    ASSERT_TRUE(std::isfinite(group.x[i]) && std::isfinite(group.y[i]) && std::isfinite(group.z[i]));
+  }
+
+  EXPECT_LT(group.y[group.GetNumberOfParticles() - 1], -0.05f * 39.0f);
+  EXPECT_LT(GetAverageSpringError(group), 0.1f);
+
+  // More sub steps make for stiffer cloth
+  breathe::physics::verlet::cGroup subStepped;
+  CreateCloth(subStepped, 60, 40, 0.05f);
+  subStepped.settings.nSubSteps = 4;
+  for (size_t i = 0; i < 100; i++) breathe::physics::verlet::Update(world, subStepped);
+
+  EXPECT_LT(GetAverageSpringError(subStepped), GetAverageSpringError(group));
+}
+
+TEST(BreatheVerlet, TestRopeAndCollisions)
+{
+  breathe::physics::verlet::cWorld world;
+  InitWorld(world);
+
+  // A rope only pulls the particles together when they are too far apart
+  breathe::physics::verlet::cGroup group;
+  group.AddParticle(spitfire::math::cVec3(0.0f, 0.0f, 0.0f));
+  group.AddParticle(spitfire::math::cVec3(0.5f, 0.0f, 0.0f));
+  group.AddParticle(spitfire::math::cVec3(3.0f, 0.0f, 0.0f));
+  group.AddPin(0);
+  group.AddRope(0, 1, 1.0f, 1.0f);
+  group.AddRope(0, 2, 1.0f, 1.0f);
+  group.settings.nSubSteps = 4;
+
+  breathe::physics::verlet::Update(world, group);
+  EXPECT_NEAR(0.5f, group.x[1], 0.01f);
+  EXPECT_LT(group.x[2], 3.0f);
+
+  for (size_t i = 0; i < 500; i++) breathe::physics::verlet::Update(world, group);
+  EXPECT_LT(group.GetPosition(1).GetLength(), 1.05f);
+  EXPECT_LT(group.GetPosition(2).GetLength(), 1.05f);
+
+  // Particles below the ground are pushed back up towards it
+  const float fBefore = group.y[2];
+  ASSERT_LT(fBefore, -0.1f);
+  breathe::physics::verlet::CollideGroundPlane(group, 0.0f);
+  EXPECT_EQ(0.0f, group.y[0]);
+  EXPECT_GT(group.y[2], 0.5f * fBefore);
+  EXPECT_LE(group.y[2], 0.0f);
+
+  // A particle inside a capsule is pushed out of it
+  group.SetPosition(2, spitfire::math::cVec3(10.2f, 1.0f, 0.0f));
+  spitfire::math::cCapsule capsule;
+  capsule.SetBase(spitfire::math::cVec3(10.0f, 0.0f, 0.0f));
+  capsule.SetTip(spitfire::math::cVec3(10.0f, 2.0f, 0.0f));
+  capsule.SetRadius(0.5f);
+  breathe::physics::verlet::Collide(group, capsule);
+  EXPECT_GT(group.x[2], 10.3f);
+  EXPECT_NEAR(1.0f, group.y[2], 0.001f);
+}
+
+TEST(BreatheVerlet, TestFixedTimeStep)
+{
+  breathe::physics::verlet::cWorld world;
+  InitWorld(world);
+
+  breathe::physics::verlet::cGroup group;
+  CreateCloth(group, 4, 4, 0.1f);
+  group.settings.fTimeStepSeconds = 0.01f;
+
+  EXPECT_EQ(0u, breathe::physics::verlet::UpdateFixedTimeStep(world, group, 0.004f));
+  EXPECT_EQ(1u, breathe::physics::verlet::UpdateFixedTimeStep(world, group, 0.007f));
+  EXPECT_EQ(2u, breathe::physics::verlet::UpdateFixedTimeStep(world, group, 0.02f));
+
+  // A long frame runs the maximum number of steps and then drops the rest of the time
+  EXPECT_EQ(4u, breathe::physics::verlet::UpdateFixedTimeStep(world, group, 1.0f));
+  EXPECT_EQ(0.0f, group.fAccumulatedSeconds);
+  EXPECT_EQ(0u, breathe::physics::verlet::UpdateFixedTimeStep(world, group, 0.005f));
+}
+
+TEST(BreatheVerlet, DISABLED_TestBenchmark)
+{
+  breathe::physics::verlet::cWorld world;
+  InitWorld(world);
+
+  const size_t nWidth = 200;
+  const size_t nHeight = 200;
+  const size_t nUpdates = 20;
+
+  breathe::physics::verlet::cGroup group;
+  CreateCloth(group, nWidth, nHeight, 0.05f);
+
+  reference::cGroup referenceGroup;
+  reference::Create(referenceGroup, group);
+
+  // Particles times relaxation iterations per millisecond
+  const double fWork = double(group.GetNumberOfParticles() * group.settings.nRelaxationSteps * nUpdates);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < nUpdates; i++) reference::Update(world, referenceGroup);
+  const double fReferenceMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < nUpdates; i++) breathe::physics::verlet::Update(world, group);
+  const double fSerialMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  breathe::physics::verlet::cGroup threaded;
+  CreateCloth(threaded, nWidth, nHeight, 0.05f);
+  spitfire::util::cThreadPool& pool = spitfire::util::GetDefaultThreadPool();
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < nUpdates; i++) breathe::physics::verlet::Update(world, threaded, pool);
+  const double fThreadedMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  EXPECT_TRUE(group.y == threaded.y);
+  EXPECT_LT(GetAverageSpringError(group), 0.05f);
+
+  std::cout<<"verlet particles="<<group.GetNumberOfParticles()<<" springs="<<group.springs.size()<<" batches="<<group.springBatches.size()<<std::endl;
+  std::cout<<"verlet reference="<<(fWork / fReferenceMS)<<" serial="<<(fWork / fSerialMS)<<" threads="<<pool.GetThreadCount()<<" threaded="<<(fWork / fThreadedMS)<<" particles*iterations/ms"<<std::endl;
+}
@@ -0,0 +1,297 @@
+// Standard headers
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/csv.h>
+#include <spitfire/storage/file.h>
+#include <spitfire/storage/filesystem.h>
+#include <spitfire/util/threadpool.h>
+
+namespace {
+
+std::string CreateLargeDocument(size_t nRows)
+{
+  std::string sData = "id,name,price,quantity,in_stock\n";
+  for (size_t i = 0; i < nRows; i++) {
+    const std::string sIndex = spitfire::string::ToString(i);
+    if ((i % 10) == 0) sData += sIndex + ",\"item, \"\"" + sIndex + "\"\"\nspecial\"," + sIndex + ".25," + sIndex + ",true\n";
+    else sData += sIndex + ",item " + sIndex + "," + sIndex + ".5," + sIndex + ",false\n";
+  }
+  return sData;
+}
+
+}
+
+TEST(SpitfireCSV, TestReadRow)
+{
+  const std::string sData =
+    "a,b,c\r\n"
+    "1,\"quoted, with comma\",\"with \"\"quotes\"\"\"\n"
+    "\n"
+    "2,\"multi\nline\",\r\n"
+    ",,\n"
+    "\"unterminated";
+
+  spitfire::csv::cRowReader reader(sData);
+  spitfire::csv::cRow row;
+
+  ASSERT_TRUE(reader.ReadRow(row));
+  ASSERT_EQ(3, row.GetColumnCount());
+  EXPECT_EQ("a", row.GetColumn(0));
+  EXPECT_EQ("b", row.GetColumn(1));
+  EXPECT_EQ("c", row.GetColumn(2));
+
+  ASSERT_TRUE(reader.ReadRow(row));
+  ASSERT_EQ(3, row.GetColumnCount());
+  EXPECT_EQ("1", row.GetColumn(0));
+  EXPECT_EQ("quoted, with comma", row.GetColumn(1));
+  EXPECT_EQ("with \"quotes\"", row.GetColumn(2));
+
+  // The blank line is skipped
+  ASSERT_TRUE(reader.ReadRow(row));
+  ASSERT_EQ(3, row.GetColumnCount());
+  EXPECT_EQ("2", row.GetColumn(0));
+  EXPECT_EQ("multi\nline", row.GetColumn(1));
+  EXPECT_EQ("", row.GetColumn(2));
+
+  ASSERT_TRUE(reader.ReadRow(row));
+  ASSERT_EQ(3, row.GetColumnCount());
+  EXPECT_EQ("", row.GetColumn(0));
+  EXPECT_EQ("", row.GetColumn(2));
+
+  ASSERT_TRUE(reader.ReadRow(row));
+  ASSERT_EQ(1, row.GetColumnCount());
+  EXPECT_EQ("unterminated", row.GetColumn(0));
+
+  EXPECT_FALSE(reader.ReadRow(row));
+  EXPECT_TRUE(reader.IsEnd());
+}
+
+TEST(SpitfireCSV, TestGetValue)
+{
+  spitfire::csv::cRowReader reader("42,-7,+3.5,1e3,true,0,abc,,4294967296");
+  spitfire::csv::cRow row;
+  ASSERT_TRUE(reader.ReadRow(row));
+
+  int iValue = 0;
+  EXPECT_TRUE(row.GetValue(0, iValue));
+  EXPECT_EQ(42, iValue);
+  EXPECT_TRUE(row.GetValue(1, iValue));
+  EXPECT_EQ(-7, iValue);
+
+  uint32_t uiValue = 0;
+  EXPECT_FALSE(row.GetValue(1, uiValue));
+
+  double fValue = 0.0;
+  EXPECT_TRUE(row.GetValue(2, fValue));
+  EXPECT_DOUBLE_EQ(3.5, fValue);
+  EXPECT_TRUE(row.GetValue(3, fValue));
+  EXPECT_DOUBLE_EQ(1000.0, fValue);
+
+  bool bValue = false;
+  EXPECT_TRUE(row.GetValue(4, bValue));
+  EXPECT_TRUE(bValue);
+  EXPECT_TRUE(row.GetValue(5, bValue));
+  EXPECT_FALSE(bValue);
+
+  // Not numbers, empty and out of range
+  EXPECT_FALSE(row.GetValue(6, iValue));
+  EXPECT_FALSE(row.GetValue(7, iValue));
+  EXPECT_FALSE(row.GetValue(8, iValue));
+  EXPECT_FALSE(row.GetValue(9, iValue));
+
+  int64_t lValue = 0;
+  EXPECT_TRUE(row.GetValue(8, lValue));
+  EXPECT_EQ(4294967296, lValue);
+}
+
+TEST(SpitfireCSV, TestWriteAndReadBack)
+{
+  const spitfire::string_t sFilePath = TEXT("csv_test_document.csv");
+
+  {
+    spitfire::csv::cWriter writer;
+    ASSERT_TRUE(writer.Open(sFilePath));
+    writer.AddValue("name");
+    writer.AddValue("count");
+    writer.AddValue("ratio");
+    writer.AddValue("enabled");
+    writer.EndRow();
+
+    for (size_t i = 0; i < 10000; i++) {
+      writer.AddValue("item \"" + spitfire::string::ToString(i) + "\",\nnext");
+      writer.AddValueUInt(i);
+      writer.AddValueFloat(double(i) / 4.0);
+      writer.AddValueBool((i % 2) == 0);
+      writer.EndRow();
+    }
+
+    writer.AddValueInt(-1);
+    writer.EndRow();
+  }
+
+  spitfire::csv::cReader reader;
+  ASSERT_TRUE(reader.Open(sFilePath));
+  ASSERT_TRUE(reader.ReadHeader());
+  const size_t iName = reader.GetColumnIndex("name");
+  const size_t iCount = reader.GetColumnIndex("count");
+  const size_t iRatio = reader.GetColumnIndex("ratio");
+  const size_t iEnabled = reader.GetColumnIndex("enabled");
+  EXPECT_EQ(spitfire::csv::INVALID_COLUMN, reader.GetColumnIndex("missing"));
+
+  spitfire::csv::cRow row;
+  for (size_t i = 0; i < 10000; i++) {
+    ASSERT_TRUE(reader.ReadRow(row));
+    ASSERT_EQ(4, row.GetColumnCount());
+    EXPECT_EQ("item \"" + spitfire::string::ToString(i) + "\",\nnext", row.GetColumn(iName));
+
+    size_t nCount = 0;
+    EXPECT_TRUE(row.GetValue(iCount, nCount));
+    EXPECT_EQ(i, nCount);
+
+    double fRatio = 0.0;
+    EXPECT_TRUE(row.GetValue(iRatio, fRatio));
+    EXPECT_DOUBLE_EQ(double(i) / 4.0, fRatio);
+
+    bool bEnabled = false;
+    EXPECT_TRUE(row.GetValue(iEnabled, bEnabled));
+    EXPECT_EQ((i % 2) == 0, bEnabled);
+  }
+
+  std::vector<spitfire::string_t> values;
+  ASSERT_TRUE(reader.ReadLine(values));
+  ASSERT_EQ(1, values.size());
+  EXPECT_STREQ(TEXT("-1"), values[0].c_str());
+
+  EXPECT_FALSE(reader.ReadRow(row));
+
+  reader.Close();
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
+
+TEST(SpitfireCSV, TestSplitIntoChunks)
+{
+  const spitfire::string_t sFilePath = TEXT("csv_test_chunks.csv");
+  const size_t nRows = 1000;
+  spitfire::storage::WriteTextContents(sFilePath, CreateLargeDocument(nRows));
+
+  spitfire::csv::cReader reader;
+  ASSERT_TRUE(reader.Open(sFilePath));
+  ASSERT_TRUE(reader.ReadHeader());
+
+  for (size_t nChunks : { 1, 2, 3, 7, 64, 5000 }) {
+    std::vector<spitfire::csv::cRowReader> chunks;
+    reader.SplitIntoChunks(nChunks, chunks);
+    EXPECT_LE(chunks.size(), nChunks);
+
+    // Every row is read exactly once and the multi line quoted fields are never split
+    std::vector<size_t> counts(nRows, 0);
+    spitfire::csv::cRow row;
+    for (auto& chunk : chunks) {
+      while (chunk.ReadRow(row)) {
+        ASSERT_EQ(5, row.GetColumnCount());
+        size_t id = 0;
+        ASSERT_TRUE(row.GetValue(0, id));
+        ASSERT_LT(id, nRows);
+        counts[id]++;
+      }
+    }
+
+    for (size_t count : counts) ASSERT_EQ(1, count);
+  }
+
+  reader.Close();
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
+
+TEST(SpitfireCSV, DISABLED_BenchmarkCSVRead)
+{
+  const spitfire::string_t sFilePath = TEXT("csv_benchmark_document.csv");
+  const size_t nRows = 500000;
+  const std::string sData = CreateLargeDocument(nRows);
+  spitfire::storage::WriteTextContents(sFilePath, sData);
+
+  const double fSizeMB = double(sData.length()) / (1024.0 * 1024.0);
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    spitfire::csv::cReader reader;
+    ASSERT_TRUE(reader.Open(sFilePath));
+    ASSERT_TRUE(reader.ReadHeader());
+
+    std::vector<spitfire::string_t> values;
+    double fTotal = 0.0;
+    size_t nFound = 0;
+    while (reader.ReadLine(values)) {
+      fTotal += spitfire::string::ToFloat(values[2]);
+      nFound++;
+    }
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    EXPECT_EQ(nRows, nFound);
+    EXPECT_LT(0.0, fTotal);
+
+    std::cout<<"CSV ReadLine size="<<fSizeMB<<"MB time="<<(fDurationSeconds * 1000.0)<<"ms throughput="<<(fSizeMB / fDurationSeconds)<<"MB/s"<<std::endl;
+  }
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    spitfire::csv::cReader reader;
+    ASSERT_TRUE(reader.Open(sFilePath));
+    ASSERT_TRUE(reader.ReadHeader());
+
+    spitfire::csv::cRow row;
+    double fTotal = 0.0;
+    size_t nFound = 0;
+    while (reader.ReadRow(row)) {
+      double fPrice = 0.0;
+      if (row.GetValue(2, fPrice)) fTotal += fPrice;
+      nFound++;
+    }
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    EXPECT_EQ(nRows, nFound);
+    EXPECT_LT(0.0, fTotal);
+
+    std::cout<<"CSV ReadRow size="<<fSizeMB<<"MB time="<<(fDurationSeconds * 1000.0)<<"ms throughput="<<(fSizeMB / fDurationSeconds)<<"MB/s"<<std::endl;
+  }
+
+  {
+    spitfire::util::cThreadPool pool;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    spitfire::csv::cReader reader;
+    ASSERT_TRUE(reader.Open(sFilePath));
+    ASSERT_TRUE(reader.ReadHeader());
+
+    std::vector<spitfire::csv::cRowReader> chunks;
+    reader.SplitIntoChunks(4 * std::max<size_t>(1, pool.GetThreadCount()), chunks);
+
+    std::atomic<size_t> nFound(0);
+    spitfire::util::ParallelFor(pool, 0, chunks.size(), 1, [&](size_t first, size_t last) {
+      spitfire::csv::cRow row;
+      for (size_t i = first; i < last; i++) {
+        size_t nFoundInChunk = 0;
+        while (chunks[i].ReadRow(row)) {
+          double fPrice = 0.0;
+          if (row.GetValue(2, fPrice)) nFoundInChunk++;
+        }
+        nFound += nFoundInChunk;
+      }
+    });
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    EXPECT_EQ(nRows, nFound.load());
+
+    std::cout<<"CSV ReadRow parallel threads="<<pool.GetThreadCount()<<" size="<<fSizeMB<<"MB time="<<(fDurationSeconds * 1000.0)<<"ms throughput="<<(fSizeMB / fDurationSeconds)<<"MB/s"<<std::endl;
+  }
+
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
@@ -0,0 +1,443 @@
+// Standard headers
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/communication/feed.h>
+#include <spitfire/communication/http.h>
+#include <spitfire/communication/network.h>
+
+namespace {
+
+const std::string sFeed =
+  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+  "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n"
+  "  <title>Test Feed</title>\n"
+  "  <entry>\n"
+  "    <id>1</id>\n"
+  "    <title>First</title>\n"
+  "    <updated>2026-10-01T00:00:00Z</updated>\n"
+  "    <summary>The first article</summary>\n"
+  "  </entry>\n"
+  "  <entry>\n"
+  "    <id>2</id>\n"
+  "    <title>Second</title>\n"
+  "    <updated>2026-10-02T00:00:00Z</updated>\n"
+  "    <summary>The second article</summary>\n"
+  "  </entry>\n"
+  "</feed>\n";
+
+class cTestRequestHandler : public spitfire::network::http::cServerRequestHandler
+{
+public:
+  cTestRequestHandler() : nDropped(0) {}
+
+  virtual void HandleRequest(spitfire::network::cClientConnection& connection, const spitfire::network::http::cRequest& request) override
+  {
+    if (request.GetPath() == "/chunked") {
+      connection.Write("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n");
+      connection.Write("5\r\nHello\r\n");
+      connection.Write("8;extension=1\r\n chunked\r\n");
+      connection.Write("0\r\nTrailer: value\r\n\r\n");
+      return;
+    } else if (request.GetPath() == "/stall") {
+      // Part of the content and then nothing, the connection stays open
+      connection.Write("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 20\r\n\r\nHello");
+      return;
+    } else if (request.GetPath() == "/stalluntilclose") {
+      // The content would end when the connection is closed but we never close it
+      connection.Write("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nHello");
+      return;
+    } else if (request.GetPath() == "/drop") {
+      // Close the connection without answering, like a server that timed out the connection just as the request arrived
+      nDropped++;
+      connection.Close();
+      return;
+    }
+
+    const std::string sContent = (request.GetPath() == "/feed.xml") ? sFeed : ("Hello " + request.GetPath());
+
+    spitfire::network::http::cResponse response;
+    response.SetContentTypeTextPlainUTF8();
+    response.SetContentLengthBytes(sContent.length());
+    response.SetExpiresMinusOne();
+
+    // Close the connection after every response, which is what a server that doesn't support keep alive does
+    const bool bIsKeepAlive = request.IsConnectionKeepAlive() && (request.GetPath() != "/close");
+    if (bIsKeepAlive) response.SetConnectionKeepAlive();
+
+    spitfire::network::http::cServerUtil util;
+    util.SendResponse(connection, response);
+    util.SendContent(connection, sContent);
+
+    if (!bIsKeepAlive) connection.Close();
+  }
+
+  std::atomic<size_t> nDropped;
+};
+
+class cCountingConnectionHandler : public spitfire::network::http::cEventLoopServerConnectionHandler
+{
+public:
+  explicit cCountingConnectionHandler(spitfire::network::http::cServerRequestHandler& requestHandler) : cEventLoopServerConnectionHandler(requestHandler), nConnections(0) {}
+
+  virtual void OnConnected(spitfire::network::cEventLoopServer& server, spitfire::network::cEventLoopConnection& connection) override
+  {
+    nConnections++;
+  }
+
+  std::atomic<size_t> nConnections;
+};
+
+class cTestRequestListener : public spitfire::network::http::cRequestListener
+{
+public:
+  cTestRequestListener() : status(spitfire::network::http::STATUS::UNKNOWN), state(spitfire::network::http::STATE::BEFORE_DOWNLOADING) {}
+
+  spitfire::network::http::STATUS status;
+  spitfire::network::http::STATE state;
+  std::string sContent;
+
+private:
+  virtual void _OnStateChanged(spitfire::network::http::STATE _state) override { state = _state; }
+  virtual void _OnStatusReceived(spitfire::network::http::STATUS _status) override { status = _status; }
+  virtual void _OnTextContentReceived(const std::string& sText) override { sContent += sText; }
+  virtual void _OnBinaryContentReceived(const void* pContent, size_t len) override { sContent.append(static_cast<const char*>(pContent), len); }
+};
+
+spitfire::network::http::cRequest CreateRequest(uint16_t uiPort, const std::string& sPath)
+{
+  spitfire::network::http::cRequest request;
+  request.SetHost("127.0.0.1");
+  request.SetPort(uiPort);
+  request.SetPath(sPath);
+  request.SetConnectionKeepAlive();
+  return request;
+}
+
+}
+
+TEST(SpitfireNetwork, TestConnectionPoolKeepAlive)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  spitfire::network::http::cConnectionPool pool;
+
+  for (size_t i = 0; i < 20; i++) {
+    const std::string sPath = "request" + spitfire::string::ToString(i);
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::OK, pool.SendRequest(CreateRequest(server.GetPort(), sPath), listener));
+    EXPECT_EQ(spitfire::network::http::STATUS::OK, listener.status);
+    EXPECT_EQ(spitfire::network::http::STATE::FINISHED, listener.state);
+    EXPECT_EQ("Hello /" + sPath, listener.sContent);
+  }
+
+  // Every request went over the same connection
+  EXPECT_EQ(1, pool.GetConnectionsOpenedCount());
+  EXPECT_EQ(1, pool.GetIdleConnectionCount());
+  EXPECT_EQ(1, connectionHandler.nConnections.load());
+
+  // Chunked content
+  cTestRequestListener listener;
+  EXPECT_EQ(spitfire::network::http::STATUS::OK, pool.SendRequest(CreateRequest(server.GetPort(), "chunked"), listener));
+  EXPECT_EQ("Hello chunked", listener.sContent);
+  EXPECT_EQ(1, pool.GetConnectionsOpenedCount());
+
+  pool.CloseIdleConnections();
+  EXPECT_EQ(0, pool.GetIdleConnectionCount());
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestConnectionPoolServerClosesConnection)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  spitfire::network::http::cConnectionPool pool;
+
+  // The server closes the connection after each of these so nothing can be reused
+  for (size_t i = 0; i < 3; i++) {
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::OK, pool.SendRequest(CreateRequest(server.GetPort(), "close"), listener));
+    EXPECT_EQ("Hello /close", listener.sContent);
+  }
+  EXPECT_EQ(3, pool.GetConnectionsOpenedCount());
+  EXPECT_EQ(0, pool.GetIdleConnectionCount());
+
+  // A pipelined batch where the server closes the connection part way through is finished on new connections
+  pool.SetPipelining(true, 8);
+
+  std::vector<spitfire::network::http::cRequest> requests;
+  requests.push_back(CreateRequest(server.GetPort(), "a"));
+  requests.push_back(CreateRequest(server.GetPort(), "close"));
+  requests.push_back(CreateRequest(server.GetPort(), "b"));
+  requests.push_back(CreateRequest(server.GetPort(), "c"));
+
+  std::vector<cTestRequestListener> listeners(requests.size());
+  std::vector<spitfire::network::http::cRequestListener*> pListeners;
+  for (auto& listener : listeners) pListeners.push_back(&listener);
+
+  std::vector<spitfire::network::http::STATUS> statuses;
+  pool.SendRequests(requests, pListeners, statuses);
+
+  ASSERT_EQ(4, statuses.size());
+  for (auto status : statuses) EXPECT_EQ(spitfire::network::http::STATUS::OK, status);
+  EXPECT_EQ("Hello /a", listeners[0].sContent);
+  EXPECT_EQ("Hello /close", listeners[1].sContent);
+  EXPECT_EQ("Hello /b", listeners[2].sContent);
+  EXPECT_EQ("Hello /c", listeners[3].sContent);
+  EXPECT_EQ(5, pool.GetConnectionsOpenedCount());
+
+  // An idle connection that the server has closed is noticed and replaced
+  server.Stop();
+  ASSERT_TRUE(server.Start(server.GetPort(), 1));
+
+  cTestRequestListener listener;
+  EXPECT_EQ(spitfire::network::http::STATUS::OK, pool.SendRequest(CreateRequest(server.GetPort(), "after"), listener));
+  EXPECT_EQ("Hello /after", listener.sContent);
+  EXPECT_EQ(6, pool.GetConnectionsOpenedCount());
+
+  server.Stop();
+
+  // Nothing is listening now
+  cTestRequestListener listenerFailed;
+  EXPECT_EQ(spitfire::network::http::STATUS::UNKNOWN, pool.SendRequest(CreateRequest(server.GetPort(), "failed"), listenerFailed));
+  EXPECT_NE(spitfire::network::http::STATE::FINISHED, listenerFailed.state);
+}
+
+TEST(SpitfireNetwork, TestConnectionPoolPipelining)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  spitfire::network::http::cConnectionPool pool(4, 4);
+  pool.SetPipelining(true, 8);
+
+  const size_t nRequests = 50;
+  std::vector<spitfire::network::http::cRequest> requests;
+  for (size_t i = 0; i < nRequests; i++) requests.push_back(CreateRequest(server.GetPort(), "pipelined" + spitfire::string::ToString(i)));
+
+  std::vector<cTestRequestListener> listeners(nRequests);
+  std::vector<spitfire::network::http::cRequestListener*> pListeners;
+  for (auto& listener : listeners) pListeners.push_back(&listener);
+
+  std::vector<spitfire::network::http::STATUS> statuses;
+  pool.SendRequests(requests, pListeners, statuses);
+
+  ASSERT_EQ(nRequests, statuses.size());
+  for (size_t i = 0; i < nRequests; i++) {
+    EXPECT_EQ(spitfire::network::http::STATUS::OK, statuses[i]);
+    EXPECT_EQ("Hello /pipelined" + spitfire::string::ToString(i), listeners[i].sContent);
+  }
+
+  EXPECT_EQ(1, pool.GetConnectionsOpenedCount());
+
+  // Several threads sharing the pool never have more requests in flight than the limit
+  std::vector<std::thread> threads;
+  std::atomic<size_t> nSuccessful(0);
+  for (size_t t = 0; t < 8; t++) {
+    threads.push_back(std::thread([&]() {
+      for (size_t i = 0; i < 10; i++) {
+        cTestRequestListener listener;
+        if (pool.SendRequest(CreateRequest(server.GetPort(), "thread"), listener) == spitfire::network::http::STATUS::OK) nSuccessful++;
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+
+  EXPECT_EQ(80, nSuccessful.load());
+  EXPECT_LE(pool.GetConnectionsOpenedCount(), 5);
+  EXPECT_LE(pool.GetIdleConnectionCount(), 4);
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestConnectionPoolTimeout)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  spitfire::network::http::cConnectionPool pool;
+  pool.SetTimeoutMS(200);
+
+  // A server that stops sending part way through the content is a failure, not a short response
+  for (const char* szPath : { "stall", "stalluntilclose" }) {
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::UNKNOWN, pool.SendRequest(CreateRequest(server.GetPort(), szPath), listener));
+    EXPECT_NE(spitfire::network::http::STATE::FINISHED, listener.state);
+    EXPECT_TRUE(listener.sContent.empty());
+  }
+
+  // The stalled connections were not kept
+  EXPECT_EQ(0, pool.GetIdleConnectionCount());
+
+  // Timeouts are not retried
+  EXPECT_EQ(2, pool.GetConnectionsOpenedCount());
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestConnectionPoolRetry)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  spitfire::network::http::cConnectionPool pool;
+
+  // A POST on a reused connection that fails before any response arrives is not retried, the server may have acted on it
+  {
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::OK, pool.SendRequest(CreateRequest(server.GetPort(), "a"), listener));
+    EXPECT_EQ(1, pool.GetIdleConnectionCount());
+  }
+  {
+    spitfire::network::http::cRequest request = CreateRequest(server.GetPort(), "drop");
+    request.SetMethodPost();
+    request.AddVariable("name", "value");
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::UNKNOWN, pool.SendRequest(request, listener));
+    EXPECT_EQ(spitfire::network::http::STATE::DISCONNECTED, listener.state);
+  }
+  EXPECT_EQ(1, requestHandler.nDropped.load());
+  EXPECT_EQ(1, pool.GetConnectionsOpenedCount());
+
+  // A GET in the same situation is retried once on a new connection
+  {
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::OK, pool.SendRequest(CreateRequest(server.GetPort(), "b"), listener));
+    EXPECT_EQ(1, pool.GetIdleConnectionCount());
+  }
+  {
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::UNKNOWN, pool.SendRequest(CreateRequest(server.GetPort(), "drop"), listener));
+    EXPECT_EQ(spitfire::network::http::STATE::DISCONNECTED, listener.state);
+  }
+  EXPECT_EQ(3, requestHandler.nDropped.load());
+  EXPECT_EQ(3, pool.GetConnectionsOpenedCount());
+
+  // A GET that fails on a new connection is not retried
+  {
+    cTestRequestListener listener;
+    EXPECT_EQ(spitfire::network::http::STATUS::UNKNOWN, pool.SendRequest(CreateRequest(server.GetPort(), "drop"), listener));
+  }
+  EXPECT_EQ(4, requestHandler.nDropped.load());
+  EXPECT_EQ(4, pool.GetConnectionsOpenedCount());
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestFeedDownloadThroughConnectionPool)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  const size_t nConnectionsOpenedBefore = spitfire::network::http::GetDefaultConnectionPool().GetConnectionsOpenedCount();
+
+  const spitfire::string_t sURL = TEXT("http://127.0.0.1:") + spitfire::string::ToString(server.GetPort()) + TEXT("/feed.xml");
+
+  // Polling the feed reuses the same connection
+  for (size_t i = 0; i < 3; i++) {
+    spitfire::network::cFeed feed;
+    feed.DownloadFeed(sURL);
+
+    EXPECT_EQ("Test Feed", feed.GetTitle());
+
+    std::vector<std::string> titles;
+    for (spitfire::network::cFeed::const_iterator iter = feed.ArticlesBegin(); iter != feed.ArticlesEnd(); iter++) titles.push_back((*iter)->GetTitle());
+    ASSERT_EQ(2, titles.size());
+    EXPECT_EQ("First", titles[0]);
+    EXPECT_EQ("Second", titles[1]);
+  }
+
+  EXPECT_EQ(nConnectionsOpenedBefore + 1, spitfire::network::http::GetDefaultConnectionPool().GetConnectionsOpenedCount());
+  EXPECT_EQ(1, connectionHandler.nConnections.load());
+
+  // A missing feed leaves the feed empty
+  spitfire::network::cFeed feed;
+  feed.DownloadFeed(TEXT("http://127.0.0.1:") + spitfire::string::ToString(server.GetPort()) + TEXT("/drop"));
+  EXPECT_TRUE(feed.GetTitle().empty());
+  EXPECT_TRUE(feed.ArticlesBegin() == feed.ArticlesEnd());
+
+  spitfire::network::http::GetDefaultConnectionPool().CloseIdleConnections();
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, DISABLED_BenchmarkConnectionPool)
+{
+  cTestRequestHandler requestHandler;
+  cCountingConnectionHandler connectionHandler(requestHandler);
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  const size_t nRequests = 1000;
+
+  std::vector<spitfire::network::http::cRequest> requests;
+  for (size_t i = 0; i < nRequests; i++) requests.push_back(CreateRequest(server.GetPort(), "benchmark"));
+
+  std::vector<cTestRequestListener> listeners(nRequests);
+  std::vector<spitfire::network::http::cRequestListener*> pListeners;
+  for (auto& listener : listeners) pListeners.push_back(&listener);
+
+  struct cMode {
+    const char* szName;
+    size_t nMaxIdleConnectionsPerHost;
+    bool bIsPipelining;
+  };
+  const cMode modes[] = {
+    { "new connection per request", 0, false },
+    { "keep alive", 1, false },
+    { "keep alive and pipelining", 1, true },
+  };
+
+  for (const cMode& mode : modes) {
+    spitfire::network::http::cConnectionPool pool(mode.nMaxIdleConnectionsPerHost, 16);
+    pool.SetPipelining(mode.bIsPipelining, 16);
+
+    std::vector<spitfire::network::http::STATUS> statuses;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    if (mode.bIsPipelining) pool.SendRequests(requests, pListeners, statuses);
+    else {
+      for (size_t i = 0; i < nRequests; i++) statuses.push_back(pool.SendRequest(requests[i], listeners[i]));
+    }
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    size_t nSuccessful = 0;
+    for (auto status : statuses) if (status == spitfire::network::http::STATUS::OK) nSuccessful++;
+    EXPECT_EQ(nRequests, nSuccessful);
+
+    std::cout<<"cConnectionPool "<<mode.szName<<" requests="<<nRequests<<" connections="<<pool.GetConnectionsOpenedCount()
+      <<" requests/sec="<<(double(nRequests) / fDurationSeconds)<<std::endl;
+  }
+
+  server.Stop();
+}
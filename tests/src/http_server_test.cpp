@@ -0,0 +1,703 @@
+// Standard headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Linux headers
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/communication/http.h>
+#include <spitfire/communication/network.h>
+#include <spitfire/storage/file.h>
+#include <spitfire/storage/filesystem.h>
+#include <spitfire/util/thread.h>
+
+namespace {
+
+class cTestRequestHandler : public spitfire::network::http::cServerRequestHandler
+{
+public:
+  cTestRequestHandler() : nRequests(0) {}
+
+  virtual void HandleRequest(spitfire::network::cClientConnection& connection, const spitfire::network::http::cRequest& request) override
+  {
+    nRequests++;
+
+    if (request.GetPath() == "/missing") {
+      spitfire::network::http::cServerUtil util;
+      util.ServeError404(connection, request);
+      return;
+    } else if (request.GetPath() == "/error") {
+      spitfire::network::http::cServerUtil util;
+      util.ServeError(connection, request, spitfire::network::http::STATUS::INTERNAL_SERVER_ERROR);
+      return;
+    }
+
+    const std::string sContent = "Hello " + request.GetPath();
+
+    spitfire::network::http::cResponse response;
+    response.SetStatus(spitfire::network::http::STATUS::OK);
+    response.SetContentTypeTextPlainUTF8();
+    response.SetContentLengthBytes(sContent.length());
+    response.SetExpiresMinusOne();
+    if (request.IsConnectionKeepAlive()) response.SetConnectionKeepAlive();
+
+    spitfire::network::http::cServerUtil util;
+    util.SendResponse(connection, response);
+    util.SendContent(connection, sContent);
+  }
+
+  std::atomic<size_t> nRequests;
+};
+
+int ConnectToLocalHost(uint16_t uiPort)
+{
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(uiPort);
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  const int value = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+
+  return fd;
+}
+
+std::string CreateRequest(const std::string& sPath, bool bKeepAlive, const std::string& sExtraHeaders = "")
+{
+  return "GET " + sPath + " HTTP/1.1\r\nHost: 127.0.0.1\r\n" + sExtraHeaders + "Connection: " + (bKeepAlive ? "Keep-Alive" : "Close") + "\r\n\r\n";
+}
+
+class cFileRequestHandler : public spitfire::network::http::cServerRequestHandler
+{
+public:
+  cFileRequestHandler(spitfire::network::http::cOpenFileCache& _cache, const spitfire::string_t& _sFilePath) : cache(_cache), sFilePath(_sFilePath) {}
+
+  virtual void HandleRequest(spitfire::network::cClientConnection& connection, const spitfire::network::http::cRequest& request) override
+  {
+    spitfire::network::http::cServerUtil util(cache);
+    util.ServeFileWithResolvedFilePath(connection, request, sFilePath);
+  }
+
+private:
+  spitfire::network::http::cOpenFileCache& cache;
+  const spitfire::string_t sFilePath;
+};
+
+// The old way of serving a file, reading it through user space
+class cReadFileRequestHandler : public spitfire::network::http::cServerRequestHandler
+{
+public:
+  explicit cReadFileRequestHandler(const spitfire::string_t& _sFilePath) : sFilePath(_sFilePath) {}
+
+  virtual void HandleRequest(spitfire::network::cClientConnection& connection, const spitfire::network::http::cRequest& request) override
+  {
+    spitfire::storage::cReadFile file(sFilePath);
+    std::string sContent;
+    uint8_t buffer[1024];
+    while (true) {
+      const size_t nRead = file.Read(buffer, sizeof(buffer));
+      if (nRead == 0) break;
+      sContent.append(reinterpret_cast<const char*>(buffer), nRead);
+    }
+
+    spitfire::network::http::cResponse response;
+    response.SetContentLengthBytes(sContent.length());
+    response.SetContentMimeType("application/octet-stream");
+    if (request.IsConnectionKeepAlive()) response.SetConnectionKeepAlive();
+
+    spitfire::network::http::cServerUtil util;
+    util.SendResponse(connection, response);
+    util.SendContent(connection, sContent);
+  }
+
+private:
+  const spitfire::string_t sFilePath;
+};
+
+std::string CreateTestFileContent(size_t nSizeBytes)
+{
+  std::string sContent(nSizeBytes, 0);
+  for (size_t i = 0; i < nSizeBytes; i++) sContent[i] = char('a' + ((i * 7) % 26));
+  return sContent;
+}
+
+void WriteTestFile(const spitfire::string_t& sFilePath, const std::string& sContent)
+{
+  spitfire::storage::cWriteFile file(sFilePath);
+  file.Write(sContent.data(), sContent.length());
+}
+
+std::string GetResponseHeader(const std::string& sResponse, const std::string& sName)
+{
+  const size_t nStart = sResponse.find("\n" + sName + ": ");
+  if (nStart == std::string::npos) return "";
+
+  const size_t nValue = nStart + 1 + sName.length() + 2;
+  return sResponse.substr(nValue, sResponse.find('\n', nValue) - nValue);
+}
+
+// Reads responses until the server closes the connection and splits them up
+std::vector<std::string> ReadResponsesUntilClosed(int fd)
+{
+  std::string sReceived;
+  char buffer[16 * 1024];
+  while (true) {
+    const ssize_t nRead = recv(fd, buffer, sizeof(buffer), 0);
+    if (nRead <= 0) break;
+    sReceived.append(buffer, nRead);
+  }
+
+  std::vector<std::string> responses;
+  while (true) {
+    size_t nLength = spitfire::network::http::GetCompleteRequestLength(sReceived);
+
+    // A 304 has the Content-Length of the file but no content
+    if (sReceived.find("HTTP/1.1 304") == 0) {
+      const size_t nHeaderEnd = sReceived.find("\n\n");
+      nLength = (nHeaderEnd != std::string::npos) ? (nHeaderEnd + 2) : 0;
+    }
+
+    if (nLength == 0) break;
+
+    responses.push_back(sReceived.substr(0, nLength));
+    sReceived.erase(0, nLength);
+  }
+
+  return responses;
+}
+
+}
+
+TEST(SpitfireNetwork, TestGetCompleteRequestLength)
+{
+  EXPECT_EQ(0, spitfire::network::http::GetCompleteRequestLength(""));
+  EXPECT_EQ(0, spitfire::network::http::GetCompleteRequestLength("GET / HTTP/1.1\r\nHost: a\r\n"));
+
+  const std::string sGet = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+  EXPECT_EQ(sGet.length(), spitfire::network::http::GetCompleteRequestLength(sGet));
+  EXPECT_EQ(sGet.length(), spitfire::network::http::GetCompleteRequestLength(sGet + "GET /second HTTP/1.1\r\n"));
+
+  // Content is only complete once all of the bytes have arrived
+  const std::string sPostHeader = "POST /form HTTP/1.1\r\nHost: a\r\ncontent-length: 10\r\n\r\n";
+  EXPECT_EQ(0, spitfire::network::http::GetCompleteRequestLength(sPostHeader + "12345"));
+  EXPECT_EQ(sPostHeader.length() + 10, spitfire::network::http::GetCompleteRequestLength(sPostHeader + "1234567890"));
+
+  // cResponse::ToString uses bare new lines
+  const std::string sResponse = "HTTP/1.1 200 OK\nContent-Length: 2\n\nOK";
+  EXPECT_EQ(sResponse.length(), spitfire::network::http::GetCompleteRequestLength(sResponse));
+}
+
+TEST(SpitfireNetwork, TestParseRequestRange)
+{
+  spitfire::network::http::cRequest request;
+  size_t nFirstByte = 0;
+  size_t nLastByte = 0;
+
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true)));
+  EXPECT_FALSE(request.HasRange());
+
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true, "Range: bytes=100-199\r\n")));
+  ASSERT_TRUE(request.HasRange());
+  EXPECT_TRUE(request.GetRangeBytes(1000, nFirstByte, nLastByte));
+  EXPECT_EQ(100, nFirstByte);
+  EXPECT_EQ(199, nLastByte);
+
+  // The end is clamped to the size of the content
+  EXPECT_TRUE(request.GetRangeBytes(150, nFirstByte, nLastByte));
+  EXPECT_EQ(100, nFirstByte);
+  EXPECT_EQ(149, nLastByte);
+  EXPECT_FALSE(request.GetRangeBytes(100, nFirstByte, nLastByte));
+
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true, "range: bytes=500-\r\n")));
+  ASSERT_TRUE(request.HasRange());
+  EXPECT_TRUE(request.GetRangeBytes(1000, nFirstByte, nLastByte));
+  EXPECT_EQ(500, nFirstByte);
+  EXPECT_EQ(999, nLastByte);
+
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true, "Range: bytes=-300\r\n")));
+  ASSERT_TRUE(request.HasRange());
+  EXPECT_TRUE(request.GetRangeBytes(1000, nFirstByte, nLastByte));
+  EXPECT_EQ(700, nFirstByte);
+  EXPECT_EQ(999, nLastByte);
+
+  // Multiple ranges and garbage are ignored so the whole content is served
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true, "Range: bytes=0-1,5-6\r\n")));
+  EXPECT_FALSE(request.HasRange());
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true, "Range: bytes=20-10\r\n")));
+  EXPECT_FALSE(request.HasRange());
+  ASSERT_TRUE(spitfire::network::http::ParseRequest(request, CreateRequest("/file", true, "Range: lines=1-2\r\n")));
+  EXPECT_FALSE(request.HasRange());
+}
+
+TEST(SpitfireNetwork, TestOpenFileCache)
+{
+  const spitfire::string_t sFilePathA = TEXT("http_server_test_cache_a.txt");
+  const spitfire::string_t sFilePathB = TEXT("http_server_test_cache_b.txt");
+  const spitfire::string_t sFilePathC = TEXT("http_server_test_cache_c.txt");
+  WriteTestFile(sFilePathA, "aaaa");
+  WriteTestFile(sFilePathB, "bbbbbbbb");
+  WriteTestFile(sFilePathC, "cc");
+
+  spitfire::network::http::cOpenFileCache cache(2);
+
+  std::shared_ptr<const spitfire::network::http::cCachedFile> pA = cache.GetFile(sFilePathA);
+  ASSERT_TRUE(pA != nullptr);
+  EXPECT_EQ(4, pA->pFile->GetSizeBytes());
+  EXPECT_FALSE(pA->sETag.empty());
+  EXPECT_EQ(pA, cache.GetFile(sFilePathA));
+
+  // Folders and missing files are not cached
+  EXPECT_TRUE(cache.GetFile(TEXT(".")) == nullptr);
+  EXPECT_TRUE(cache.GetFile(TEXT("http_server_test_missing.txt")) == nullptr);
+  EXPECT_EQ(1, cache.GetFileCount());
+
+  // A is the least recently used so it is evicted, but it stays open for anyone still holding it
+  std::shared_ptr<const spitfire::network::http::cCachedFile> pB = cache.GetFile(sFilePathB);
+  ASSERT_TRUE(pB != nullptr);
+  EXPECT_NE(pA->sETag, pB->sETag);
+  EXPECT_EQ(pB, cache.GetFile(sFilePathB));
+  EXPECT_TRUE(cache.GetFile(sFilePathC) != nullptr);
+  EXPECT_EQ(2, cache.GetFileCount());
+  EXPECT_NE(pA, cache.GetFile(sFilePathA));
+  char c = 0;
+  EXPECT_EQ(1, pread(pA->pFile->GetFD(), &c, 1, 0));
+  EXPECT_EQ('a', c);
+
+  // Changing the file opens it again
+  std::shared_ptr<const spitfire::network::http::cCachedFile> pC = cache.GetFile(sFilePathC);
+  WriteTestFile(sFilePathC, "cccccc");
+  std::shared_ptr<const spitfire::network::http::cCachedFile> pChanged = cache.GetFile(sFilePathC);
+  ASSERT_TRUE(pChanged != nullptr);
+  EXPECT_NE(pC, pChanged);
+  EXPECT_EQ(6, pChanged->pFile->GetSizeBytes());
+
+  // Deleting the file removes it from the cache
+  spitfire::filesystem::DeleteFile(sFilePathC);
+  EXPECT_TRUE(cache.GetFile(sFilePathC) == nullptr);
+  EXPECT_EQ(1, cache.GetFileCount());
+
+  cache.Clear();
+  EXPECT_EQ(0, cache.GetFileCount());
+
+  spitfire::filesystem::DeleteFile(sFilePathA);
+  spitfire::filesystem::DeleteFile(sFilePathB);
+}
+
+TEST(SpitfireNetwork, TestEventLoopServerServeFile)
+{
+  const spitfire::string_t sFilePath = TEXT("http_server_test_file.bin");
+  const std::string sContent = CreateTestFileContent(3 * 1024 * 1024 + 17);
+  WriteTestFile(sFilePath, sContent);
+
+  spitfire::network::http::cOpenFileCache cache;
+  cFileRequestHandler requestHandler(cache, sFilePath);
+  spitfire::network::http::cEventLoopServerConnectionHandler connectionHandler(requestHandler);
+
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  // Get the whole file first so that we know the ETag
+  std::string sETag;
+  {
+    const int fd = ConnectToLocalHost(server.GetPort());
+    ASSERT_GE(fd, 0);
+    const std::string sRequest = CreateRequest("/file.bin", false);
+    ASSERT_EQ(ssize_t(sRequest.length()), send(fd, sRequest.data(), sRequest.length(), 0));
+    const std::vector<std::string> responses = ReadResponsesUntilClosed(fd);
+    close(fd);
+
+    ASSERT_EQ(1, responses.size());
+    EXPECT_EQ(0, responses[0].find("HTTP/1.1 200"));
+    EXPECT_EQ("bytes", GetResponseHeader(responses[0], "Accept-Ranges"));
+    EXPECT_EQ(spitfire::string::ToString(sContent.length()), GetResponseHeader(responses[0], "Content-Length"));
+    sETag = GetResponseHeader(responses[0], "ETag");
+    EXPECT_FALSE(sETag.empty());
+
+    const size_t nContentStart = responses[0].find("\n\n") + 2;
+    EXPECT_TRUE(responses[0].substr(nContentStart) == sContent);
+  }
+
+  // Ranges, conditional requests and the whole file again, pipelined on one keep alive connection
+  const int fd = ConnectToLocalHost(server.GetPort());
+  ASSERT_GE(fd, 0);
+
+  const std::string sRequests =
+    CreateRequest("/file.bin", true, "Range: bytes=100-199\r\n") +
+    CreateRequest("/file.bin", true, "Range: bytes=-10\r\n") +
+    CreateRequest("/file.bin", true, "If-None-Match: " + sETag + "\r\n") +
+    CreateRequest("/file.bin", true, "Range: bytes=" + spitfire::string::ToString(sContent.length()) + "-\r\n") +
+    CreateRequest("/file.bin", false);
+  ASSERT_EQ(ssize_t(sRequests.length()), send(fd, sRequests.data(), sRequests.length(), 0));
+
+  const std::vector<std::string> responses = ReadResponsesUntilClosed(fd);
+  close(fd);
+
+  ASSERT_EQ(5, responses.size());
+
+  EXPECT_EQ(0, responses[0].find("HTTP/1.1 206"));
+  EXPECT_EQ("bytes 100-199/" + spitfire::string::ToString(sContent.length()), GetResponseHeader(responses[0], "Content-Range"));
+  EXPECT_EQ(sContent.substr(100, 100), responses[0].substr(responses[0].find("\n\n") + 2));
+
+  EXPECT_EQ(0, responses[1].find("HTTP/1.1 206"));
+  EXPECT_EQ(sContent.substr(sContent.length() - 10), responses[1].substr(responses[1].find("\n\n") + 2));
+
+  EXPECT_EQ(0, responses[2].find("HTTP/1.1 304"));
+  EXPECT_EQ(responses[2].length(), responses[2].find("\n\n") + 2);
+
+  EXPECT_EQ(0, responses[3].find("HTTP/1.1 416"));
+  EXPECT_EQ("bytes */" + spitfire::string::ToString(sContent.length()), GetResponseHeader(responses[3], "Content-Range"));
+
+  EXPECT_EQ(0, responses[4].find("HTTP/1.1 200"));
+  EXPECT_EQ("Close", GetResponseHeader(responses[4], "Connection"));
+  EXPECT_TRUE(responses[4].substr(responses[4].find("\n\n") + 2) == sContent);
+
+  // Every request used the same open file
+  EXPECT_EQ(1, cache.GetFileCount());
+
+  server.Stop();
+
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
+
+TEST(SpitfireNetwork, TestEventLoopServer)
+{
+  cTestRequestHandler requestHandler;
+  spitfire::network::http::cEventLoopServerConnectionHandler connectionHandler(requestHandler);
+
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 2));
+  ASSERT_NE(0, server.GetPort());
+
+  // Two requests on the same keep alive connection, sent together to check pipelining
+  const int fd = ConnectToLocalHost(server.GetPort());
+  ASSERT_GE(fd, 0);
+
+  const std::string sRequests = CreateRequest("/first", true) + CreateRequest("/second", false);
+  ASSERT_EQ(ssize_t(sRequests.length()), send(fd, sRequests.data(), sRequests.length(), 0));
+
+  std::string sReceived;
+  char buffer[4096];
+  while (true) {
+    const ssize_t nRead = recv(fd, buffer, sizeof(buffer), 0);
+    if (nRead <= 0) break; // The server closes the connection after the second request
+    sReceived.append(buffer, nRead);
+  }
+  close(fd);
+
+  const size_t nFirstLength = spitfire::network::http::GetCompleteRequestLength(sReceived);
+  ASSERT_NE(0, nFirstLength);
+  const std::string sFirst = sReceived.substr(0, nFirstLength);
+  const std::string sSecond = sReceived.substr(nFirstLength);
+
+  EXPECT_EQ(0, sFirst.find("HTTP/1.1 200"));
+  EXPECT_NE(std::string::npos, sFirst.find("Connection: Keep-Alive"));
+  EXPECT_NE(std::string::npos, sFirst.find("\n\nHello /first"));
+  EXPECT_EQ(0, sSecond.find("HTTP/1.1 200"));
+  EXPECT_NE(std::string::npos, sSecond.find("Connection: Close"));
+  EXPECT_NE(std::string::npos, sSecond.find("\n\nHello /second"));
+
+  EXPECT_EQ(2, requestHandler.nRequests.load());
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestEventLoopServerClosesAfterErrorResponse)
+{
+  cTestRequestHandler requestHandler;
+  spitfire::network::http::cEventLoopServerConnectionHandler connectionHandler(requestHandler);
+
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  // The client asked to keep the connection open but the error response says it is closing, so the second request is never handled
+  const int fd = ConnectToLocalHost(server.GetPort());
+  ASSERT_GE(fd, 0);
+
+  const std::string sRequests = CreateRequest("/missing", true) + CreateRequest("/second", true);
+  ASSERT_EQ(ssize_t(sRequests.length()), send(fd, sRequests.data(), sRequests.length(), 0));
+
+  const std::vector<std::string> responses = ReadResponsesUntilClosed(fd);
+  close(fd);
+
+  ASSERT_EQ(1, responses.size());
+  EXPECT_EQ(0, responses[0].find("HTTP/1.1 404"));
+  EXPECT_EQ("Close", GetResponseHeader(responses[0], "Connection"));
+  EXPECT_EQ(1, requestHandler.nRequests.load());
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestEventLoopServerErrorResponseLength)
+{
+  cTestRequestHandler requestHandler;
+  spitfire::network::http::cEventLoopServerConnectionHandler connectionHandler(requestHandler);
+
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0, 1));
+
+  const int fd = ConnectToLocalHost(server.GetPort());
+  ASSERT_GE(fd, 0);
+
+  const std::string sRequest = CreateRequest("/error", true);
+  ASSERT_EQ(ssize_t(sRequest.length()), send(fd, sRequest.data(), sRequest.length(), 0));
+
+  std::string sReceived;
+  char buffer[4096];
+  while (true) {
+    const ssize_t nRead = recv(fd, buffer, sizeof(buffer), 0);
+    if (nRead <= 0) break;
+    sReceived.append(buffer, nRead);
+  }
+  close(fd);
+
+  // Nothing is sent after the content that the Content-Length covers
+  EXPECT_EQ(0, sReceived.find("HTTP/1.1 500"));
+  const size_t nContentStart = sReceived.find("\n\n") + 2;
+  EXPECT_EQ(spitfire::string::ToString(sReceived.length() - nContentStart), GetResponseHeader(sReceived, "Content-Length"));
+
+  server.Stop();
+}
+
+TEST(SpitfireNetwork, TestEventLoopConnectionOutlivesServer)
+{
+  // The handler keeps the connection after the server has been stopped and destroyed
+  class cKeepConnectionHandler : public spitfire::network::cEventLoopConnectionHandler
+  {
+  public:
+    cKeepConnectionHandler() : bIsReceived(false) {}
+
+    virtual void OnDataReceived(spitfire::network::cEventLoopServer& server, spitfire::network::cEventLoopConnection& connection) override
+    {
+      pConnection = connection.shared_from_this();
+      bIsReceived = true;
+    }
+
+    std::shared_ptr<spitfire::network::cEventLoopConnection> pConnection;
+    std::atomic<bool> bIsReceived;
+  };
+
+  cKeepConnectionHandler connectionHandler;
+
+  int fd = -1;
+  {
+    spitfire::network::cEventLoopServer server;
+    server.SetConnectionHandler(connectionHandler);
+    ASSERT_TRUE(server.Start(0, 1));
+
+    fd = ConnectToLocalHost(server.GetPort());
+    ASSERT_GE(fd, 0);
+    const std::string sRequest = CreateRequest("/", true);
+    ASSERT_EQ(ssize_t(sRequest.length()), send(fd, sRequest.data(), sRequest.length(), 0));
+
+    for (size_t i = 0; (i < 100) && !connectionHandler.bIsReceived; i++) spitfire::util::SleepThisThreadMS(10);
+    ASSERT_TRUE(connectionHandler.bIsReceived);
+
+    server.Stop();
+  }
+
+  // Writing to and closing a connection whose reactor has gone does nothing
+  connectionHandler.pConnection->Write("late response");
+  connectionHandler.pConnection->Close();
+  EXPECT_FALSE(connectionHandler.pConnection->IsOpen());
+  connectionHandler.pConnection.reset();
+
+  close(fd);
+}
+
+TEST(SpitfireNetwork, DISABLED_BenchmarkEventLoopServerConcurrentConnections)
+{
+  // Each connection needs a file descriptor on both the client and the server side
+  size_t nConnections = 10000;
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) nConnections = std::min<size_t>(nConnections, (limit.rlim_cur - 256) / 2);
+  }
+  const size_t nRequestsPerConnection = 5;
+
+  cTestRequestHandler requestHandler;
+  spitfire::network::http::cEventLoopServerConnectionHandler connectionHandler(requestHandler);
+
+  spitfire::network::cEventLoopServer server;
+  server.SetConnectionHandler(connectionHandler);
+  ASSERT_TRUE(server.Start(0));
+
+  struct cClient
+  {
+    int fd;
+    size_t nRequestsSent;
+    std::chrono::high_resolution_clock::time_point sent;
+    std::string sReceived;
+  };
+
+  std::vector<cClient> clients;
+  clients.reserve(nConnections);
+  for (size_t i = 0; i < nConnections; i++) {
+    const int fd = ConnectToLocalHost(server.GetPort());
+    if (fd < 0) break;
+    clients.push_back({ fd, 0, std::chrono::high_resolution_clock::time_point(), "" });
+  }
+  ASSERT_FALSE(clients.empty());
+
+  const int fdEpoll = epoll_create1(0);
+  for (size_t i = 0; i < clients.size(); i++) {
+    fcntl(clients[i].fd, F_SETFL, fcntl(clients[i].fd, F_GETFL) | O_NONBLOCK);
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = i;
+    epoll_ctl(fdEpoll, EPOLL_CTL_ADD, clients[i].fd, &event);
+  }
+
+  const std::string sRequest = CreateRequest("/benchmark", true);
+  std::vector<double> latenciesMS;
+  latenciesMS.reserve(clients.size() * nRequestsPerConnection);
+
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  // Every client has one request in flight at a time
+  for (auto& client : clients) {
+    client.sent = std::chrono::high_resolution_clock::now();
+    send(client.fd, sRequest.data(), sRequest.length(), MSG_NOSIGNAL);
+    client.nRequestsSent++;
+  }
+
+  size_t nFinished = 0;
+  epoll_event events[256];
+  char buffer[4096];
+  while (nFinished < clients.size()) {
+    const int nEvents = epoll_wait(fdEpoll, events, 256, 5000);
+    if (nEvents <= 0) break;
+
+    for (int e = 0; e < nEvents; e++) {
+      cClient& client = clients[events[e].data.u64];
+      while (true) {
+        const ssize_t nRead = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (nRead <= 0) break;
+        client.sReceived.append(buffer, nRead);
+      }
+
+      const size_t nResponseLength = spitfire::network::http::GetCompleteRequestLength(client.sReceived);
+      if (nResponseLength == 0) continue;
+
+      client.sReceived.erase(0, nResponseLength);
+      latenciesMS.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - client.sent).count());
+
+      if (client.nRequestsSent < nRequestsPerConnection) {
+        client.sent = std::chrono::high_resolution_clock::now();
+        send(client.fd, sRequest.data(), sRequest.length(), MSG_NOSIGNAL);
+        client.nRequestsSent++;
+      } else nFinished++;
+    }
+  }
+
+  const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+  close(fdEpoll);
+  for (auto& client : clients) close(client.fd);
+
+  server.Stop();
+
+  ASSERT_EQ(clients.size(), nFinished);
+  ASSERT_EQ(clients.size() * nRequestsPerConnection, latenciesMS.size());
+
+  std::sort(latenciesMS.begin(), latenciesMS.end());
+  const double fP50 = latenciesMS[latenciesMS.size() / 2];
+  const double fP99 = latenciesMS[(latenciesMS.size() * 99) / 100];
+
+  std::cout<<"cEventLoopServer connections="<<clients.size()<<" requests="<<latenciesMS.size()<<" requests/sec="<<(double(latenciesMS.size()) / fDurationSeconds)
+    <<" p50="<<fP50<<"ms p99="<<fP99<<"ms"<<std::endl;
+}
+
+TEST(SpitfireNetwork, DISABLED_BenchmarkEventLoopServerServeFile)
+{
+  const spitfire::string_t sFilePath = TEXT("http_server_benchmark_file.bin");
+  const std::string sContent = CreateTestFileContent(8 * 1024 * 1024);
+  WriteTestFile(sFilePath, sContent);
+
+  const size_t nRequests = 50;
+
+  spitfire::network::http::cOpenFileCache cache;
+  cFileRequestHandler sendFileRequestHandler(cache, sFilePath);
+  cReadFileRequestHandler readFileRequestHandler(sFilePath);
+
+  for (size_t i = 0; i < 2; i++) {
+    const bool bIsSendFile = (i == 0);
+
+    spitfire::network::http::cEventLoopServerConnectionHandler connectionHandler(bIsSendFile ? static_cast<spitfire::network::http::cServerRequestHandler&>(sendFileRequestHandler) : readFileRequestHandler);
+    spitfire::network::cEventLoopServer server;
+    server.SetConnectionHandler(connectionHandler);
+    ASSERT_TRUE(server.Start(0, 1));
+
+    const int fd = ConnectToLocalHost(server.GetPort());
+    ASSERT_GE(fd, 0);
+
+    const std::string sRequest = CreateRequest("/file.bin", true);
+    std::vector<char> buffer(256 * 1024);
+    size_t nTotalBytes = 0;
+
+    const std::clock_t startCPU = std::clock();
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // One request at a time, reading each response completely before sending the next one
+    for (size_t r = 0; r < nRequests; r++) {
+      ASSERT_EQ(ssize_t(sRequest.length()), send(fd, sRequest.data(), sRequest.length(), 0));
+
+      std::string sHeader;
+      size_t nRemaining = std::string::npos;
+      while (nRemaining != 0) {
+        const ssize_t nRead = recv(fd, buffer.data(), (nRemaining == std::string::npos) ? 1 : std::min(nRemaining, buffer.size()), 0);
+        ASSERT_GT(nRead, 0);
+        if (nRemaining == std::string::npos) {
+          sHeader.append(buffer.data(), nRead);
+          if (spitfire::string::EndsWith(sHeader, "\n\n")) nRemaining = spitfire::string::ToUnsignedInt(GetResponseHeader(sHeader, "Content-Length"));
+        } else {
+          nRemaining -= nRead;
+          nTotalBytes += nRead;
+        }
+      }
+    }
+
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    const double fCPUSeconds = double(std::clock() - startCPU) / CLOCKS_PER_SEC;
+
+    close(fd);
+    server.Stop();
+
+    EXPECT_EQ(nRequests * sContent.length(), nTotalBytes);
+
+    std::cout<<"cEventLoopServer "<<(bIsSendFile ? "sendfile" : "read and write")<<" file="<<(sContent.length() / (1024 * 1024))<<"MB requests="<<nRequests
+      <<" MB/sec="<<(double(nTotalBytes) / (1024.0 * 1024.0) / fDurationSeconds)<<" process cpu="<<(fCPUSeconds * 1000.0)<<"ms"<<std::endl;
+  }
+
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
@@ -0,0 +1,269 @@
+// Standard headers
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/file.h>
+#include <spitfire/storage/filesystem.h>
+#include <spitfire/storage/json.h>
+
+namespace {
+
+const std::string sTestDocument =
+  "{\n"
+  "  \"name\": \"Sydney\",\n"
+  "  \"id\": 42,\n"
+  "  \"big\": 12345678901,\n"
+  "  \"temperature\": -12.5e1,\n"
+  "  \"raining\": true,\n"
+  "  \"sunny\": false,\n"
+  "  \"wind\": null,\n"
+  "  \"readings\": [1, 2.5, \"three\", [], {}],\n"
+  "  \"station\": { \"code\": \"SYD\", \"height\": 3 }\n"
+  "}";
+
+std::string CreateLargeDocument(size_t nEntities)
+{
+  std::string sData = "{\"entities\":[\n";
+  for (size_t i = 0; i < nEntities; i++) {
+    const std::string sIndex = spitfire::string::ToString(i);
+    sData += "  {\"id\":" + sIndex + ",\"name\":\"entity " + sIndex + " \\\"quoted\\\"\",\"position\":[" + sIndex + ".5,2.25,-3.125],\"visible\":true,\"parent\":null}";
+    sData += ((i + 1) < nEntities) ? ",\n" : "\n";
+  }
+  sData += "],\"count\":" + spitfire::string::ToString(nEntities) + "}";
+  return sData;
+}
+
+}
+
+TEST(SpitfireJSON, TestRead)
+{
+  for (bool bIsLazy : { false, true }) {
+    spitfire::json::reader reader;
+    reader.SetLazy(bIsLazy);
+
+    spitfire::json::cDocument document;
+    ASSERT_TRUE(reader.ReadFromStringUTF8(document, sTestDocument));
+    ASSERT_TRUE(document.IsTypeObject());
+    EXPECT_EQ(9, document.GetChildCount());
+
+    std::string sName;
+    EXPECT_TRUE(document.GetAttribute("name", sName));
+    EXPECT_EQ("Sydney", sName);
+
+    const spitfire::json::cNode* pID = document.GetChild("id");
+    ASSERT_TRUE(pID != nullptr);
+    EXPECT_TRUE(pID->IsTypeInt());
+    EXPECT_EQ(42, pID->GetValueInt());
+
+    // Too big for an int
+    const spitfire::json::cNode* pBig = document.GetChild("big");
+    ASSERT_TRUE(pBig != nullptr);
+    EXPECT_TRUE(pBig->IsTypeFloat());
+    EXPECT_DOUBLE_EQ(12345678901.0, pBig->GetValueFloat());
+
+    const spitfire::json::cNode* pTemperature = document.GetChild("temperature");
+    ASSERT_TRUE(pTemperature != nullptr);
+    EXPECT_TRUE(pTemperature->IsTypeFloat());
+    EXPECT_DOUBLE_EQ(-125.0, pTemperature->GetValueFloat());
+
+    EXPECT_TRUE(document.GetChild("raining")->GetValueBool());
+    EXPECT_FALSE(document.GetChild("sunny")->GetValueBool());
+    EXPECT_TRUE(document.GetChild("wind")->IsTypeNull());
+    EXPECT_TRUE(document.GetChild("missing") == nullptr);
+
+    const spitfire::json::cNode* pReadings = document.GetChild("readings");
+    ASSERT_TRUE(pReadings != nullptr);
+    ASSERT_TRUE(pReadings->IsTypeArray());
+    const std::span<spitfire::json::cNode* const> readings = pReadings->GetValueObjectOrArray();
+    ASSERT_EQ(5, readings.size());
+    EXPECT_EQ(1, readings[0]->GetValueInt());
+    EXPECT_DOUBLE_EQ(2.5, readings[1]->GetValueFloat());
+    EXPECT_EQ("three", readings[2]->GetValueStringView());
+    EXPECT_TRUE(readings[3]->IsTypeArray());
+    EXPECT_EQ(0, readings[3]->GetChildCount());
+    EXPECT_TRUE(readings[4]->IsTypeObject());
+    EXPECT_EQ(0, readings[4]->GetChildCount());
+
+    const spitfire::json::cNode* pStation = document.GetChild("station");
+    ASSERT_TRUE(pStation != nullptr);
+    std::string sCode;
+    EXPECT_TRUE(pStation->GetAttribute("code", sCode));
+    EXPECT_EQ("SYD", sCode);
+    uint8_t uiHeight = 0;
+    EXPECT_TRUE(pStation->GetAttribute("height", uiHeight));
+    EXPECT_EQ(3, uiHeight);
+  }
+}
+
+TEST(SpitfireJSON, TestReadEscapes)
+{
+  spitfire::json::reader reader;
+  spitfire::json::cDocument document;
+  ASSERT_TRUE(reader.ReadFromStringUTF8(document, "[\"a\\\"b\", \"c\\\\\", \"\\\\\\\"\", \"\\n\\t\\/\", \"\\u0041\\u00e9\\u20ac\", \"\\ud83d\\ude00\", \"x\\\\\"]"));
+
+  const std::span<spitfire::json::cNode* const> children = document.GetValueObjectOrArray();
+  ASSERT_EQ(7, children.size());
+  EXPECT_EQ("a\"b", children[0]->GetValueStringView());
+  EXPECT_EQ("c\\", children[1]->GetValueStringView());
+  EXPECT_EQ("\\\"", children[2]->GetValueStringView());
+  EXPECT_EQ("\n\t/", children[3]->GetValueStringView());
+  EXPECT_EQ("A\xC3\xA9\xE2\x82\xAC", children[4]->GetValueStringView());
+  EXPECT_EQ("\xF0\x9F\x98\x80", children[5]->GetValueStringView());
+  EXPECT_EQ("x\\", children[6]->GetValueStringView());
+
+  // Runs of backslashes and structural characters inside strings that cross the 64 byte blocks of the scanner
+  for (size_t nPadding = 0; nPadding < 70; nPadding++) {
+    const std::string sValue = std::string(nPadding, ' ') + "{[\\\\\\\"],:}";
+    ASSERT_TRUE(reader.ReadFromStringUTF8(document, "{\"key\":\"" + sValue + "\",\"after\":[1]}"));
+    ASSERT_EQ(2, document.GetChildCount());
+    EXPECT_EQ(std::string(nPadding, ' ') + "{[\\\"],:}", document.GetChild("key")->GetValueStringView());
+    EXPECT_EQ(1, document.GetChild("after")->GetChildCount());
+  }
+}
+
+TEST(SpitfireJSON, TestReadErrors)
+{
+  const char* documents[] = {
+    "",
+    "   ",
+    "{",
+    "{\"a\":1",
+    "{\"a\" 1}",
+    "{\"a\":1,}",
+    "{1:2}",
+    "[1 2]",
+    "[1,,2]",
+    "[\"unterminated]",
+    "[tru]",
+    "[1.2.3]",
+    "[\"\\x\"]",
+    "[\"\\ud83d\"]",
+    "[1] [2]",
+    "{}}",
+  };
+
+  spitfire::json::reader reader;
+  for (const char* szDocument : documents) {
+    spitfire::json::cDocument document;
+    EXPECT_FALSE(reader.ReadFromStringUTF8(document, szDocument)) << szDocument;
+  }
+
+  // Too deep
+  spitfire::json::cDocument document;
+  EXPECT_FALSE(reader.ReadFromStringUTF8(document, std::string(5000, '[') + std::string(5000, ']')));
+  EXPECT_TRUE(reader.ReadFromStringUTF8(document, std::string(500, '[') + std::string(500, ']')));
+
+  // A bare value is a valid document
+  EXPECT_TRUE(reader.ReadFromStringUTF8(document, " 12 "));
+  EXPECT_EQ(12, document.GetValueInt());
+}
+
+TEST(SpitfireJSON, TestReadLazy)
+{
+  const std::string sData = CreateLargeDocument(100);
+
+  spitfire::json::reader reader;
+  reader.SetLazy(true);
+
+  spitfire::json::cDocument document;
+  ASSERT_TRUE(reader.ReadFromStringUTF8(document, sData));
+
+  // Only the root has been parsed so far
+  const size_t nArenaSizeBytesBefore = document.GetArenaSizeBytes();
+
+  const spitfire::json::cNode* pEntities = document.GetChild("entities");
+  ASSERT_TRUE(pEntities != nullptr);
+  ASSERT_EQ(100, pEntities->GetChildCount());
+
+  const spitfire::json::cNode* pEntity = pEntities->GetValueObjectOrArray()[57];
+  EXPECT_EQ(57, pEntity->GetChild("id")->GetValueInt());
+  EXPECT_EQ("entity 57 \"quoted\"", pEntity->GetChild("name")->GetValueStringView());
+  ASSERT_EQ(3, pEntity->GetChild("position")->GetChildCount());
+  EXPECT_DOUBLE_EQ(57.5, pEntity->GetChild("position")->GetValueObjectOrArray()[0]->GetValueFloat());
+  EXPECT_EQ(100, document.GetChild("count")->GetValueInt());
+
+  EXPECT_LE(nArenaSizeBytesBefore, document.GetArenaSizeBytes());
+
+  // Errors inside objects that are never accessed are not noticed
+  EXPECT_TRUE(reader.ReadFromStringUTF8(document, "{\"a\":[1,,2],\"b\":2}"));
+  EXPECT_EQ(2, document.GetChild("b")->GetValueInt());
+  EXPECT_EQ(0, document.GetChild("a")->GetChildCount());
+}
+
+TEST(SpitfireJSON, TestWriteAndReadBack)
+{
+  spitfire::json::cDocument document;
+  document.SetTypeObject();
+  document.SetAttribute("name", "line 1\nline \"2\"\t\\");
+  document.SetAttribute("count", uint64_t(3));
+  document.SetAttribute("enabled", true);
+
+  spitfire::json::cNode* pArray = document.CreateNode("items");
+  pArray->SetTypeArray();
+  document.AppendChild(pArray);
+  for (size_t i = 0; i < 10; i++) {
+    spitfire::json::cNode* pItem = document.CreateNode();
+    pItem->SetTypeObject();
+    pItem->SetAttribute("index", uint64_t(i));
+    pArray->AppendChild(pItem);
+  }
+
+  spitfire::json::writer writer;
+  std::string sContent;
+  writer.WriteToStringUTF8(document, sContent);
+
+  spitfire::json::reader reader;
+  spitfire::json::cDocument readBack;
+  ASSERT_TRUE(reader.ReadFromStringUTF8(readBack, sContent)) << sContent;
+
+  std::string sName;
+  EXPECT_TRUE(readBack.GetAttribute("name", sName));
+  EXPECT_EQ("line 1\nline \"2\"\t\\", sName);
+  EXPECT_EQ(3, readBack.GetChild("count")->GetValueInt());
+  EXPECT_TRUE(readBack.GetChild("enabled")->GetValueBool());
+
+  const spitfire::json::cNode* pItems = readBack.GetChild("items");
+  ASSERT_TRUE(pItems != nullptr);
+  ASSERT_EQ(10, pItems->GetChildCount());
+  EXPECT_EQ(7, pItems->GetValueObjectOrArray()[7]->GetChild("index")->GetValueInt());
+
+  // Reading a file
+  const spitfire::string_t sFilePath = TEXT("json_test_document.json");
+  spitfire::storage::WriteTextContents(sFilePath, sTestDocument);
+  ASSERT_TRUE(reader.ReadFromFile(readBack, sFilePath));
+  EXPECT_EQ(42, readBack.GetChild("id")->GetValueInt());
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
+
+TEST(SpitfireJSON, DISABLED_BenchmarkJSONLoad)
+{
+  const size_t nEntities = 100000;
+  const std::string sData = CreateLargeDocument(nEntities);
+
+  const double fSizeMB = double(sData.length()) / (1024.0 * 1024.0);
+
+  for (bool bIsLazy : { false, true }) {
+    spitfire::json::reader reader;
+    reader.SetLazy(bIsLazy);
+
+    spitfire::json::cDocument document;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(reader.ReadFromStringUTF8(document, sData));
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Access one entity
+    const spitfire::json::cNode* pEntities = document.GetChild("entities");
+    ASSERT_TRUE(pEntities != nullptr);
+    ASSERT_EQ(nEntities, pEntities->GetChildCount());
+    EXPECT_EQ(1234, pEntities->GetValueObjectOrArray()[1234]->GetChild("id")->GetValueInt());
+
+    std::cout<<"JSON "<<(bIsLazy ? "lazy" : "eager")<<" size="<<fSizeMB<<"MB time="<<(fDurationSeconds * 1000.0)<<"ms throughput="<<(fSizeMB / fDurationSeconds)<<"MB/s arena="<<(double(document.GetArenaSizeBytes()) / (1024.0 * 1024.0))<<"MB"<<std::endl;
+  }
+}
@@ -19,6 +19,10 @@ int main(int argc, char** argv)
   //testing::GTEST_FLAG(filter) = "SpitfireMath.TestUnitsPressure";
   //testing::GTEST_FLAG(filter) = "Voodoo.*";
 
+  // The benchmarks are disabled so that they don't slow down the normal run, to run them:
+  //testing::GTEST_FLAG(also_run_disabled_tests) = true;
+  //testing::GTEST_FLAG(filter) = "*.DISABLED_*Benchmark*";
+
   const int result = RUN_ALL_TESTS();
 
   spitfire::network::Destroy();
@@ -0,0 +1,297 @@
+// Standard headers
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cMat4.h>
+#include <spitfire/math/cDynamicAABBTree.h>
+#include <spitfire/math/cFrustumCuller.h>
+
+namespace {
+
+// Standing at the origin looking down the negative z axis with a 90 degree field of view, 1 to 100 units
+spitfire::math::cFrustumCuller CreateCuller()
+{
+  spitfire::math::cMat4 matView;
+  matView.SetLookAt(spitfire::math::cVec3(0.0f, 0.0f, 0.0f), spitfire::math::cVec3(0.0f, 0.0f, -1.0f), spitfire::math::cVec3(0.0f, 1.0f, 0.0f));
+
+  spitfire::math::cMat4 matProjection;
+  matProjection.SetPerspective(-1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 100.0f);
+
+  spitfire::math::cFrustumCuller culler;
+  culler.SetFromViewProjectionMatrix(matProjection * matView);
+  return culler;
+}
+
+spitfire::math::cAABB3 CreateBox(const spitfire::math::cVec3& centre, float fHalfWidth)
+{
+  const spitfire::math::cVec3 half(fHalfWidth, fHalfWidth, fHalfWidth);
+  spitfire::math::cAABB3 box;
+  box.SetMinMax(centre - half, centre + half);
+  return box;
+}
+
+// Objects scattered around the camera in every direction
+class cWorld
+{
+public:
+  explicit cWorld(size_t nObjects);
+
+  void Move(std::mt19937& generator, float fDistance);
+
+  std::vector<spitfire::math::cVec3> positions;
+  std::vector<float> radii;
+};
+
+cWorld::cWorld(size_t nObjects)
+{
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+  std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+  for (size_t i = 0; i < nObjects; i++) {
+    positions.push_back(spitfire::math::cVec3(position(generator), position(generator), position(generator)));
+    radii.push_back(radius(generator));
+  }
+}
+
+void cWorld::Move(std::mt19937& generator, float fDistance)
+{
+  std::uniform_real_distribution<float> offset(-fDistance, fDistance);
+  for (auto&& position : positions) position += spitfire::math::cVec3(offset(generator), offset(generator), offset(generator));
+}
+
+// What the tree should return, every fat box that the culler can see
+std::vector<size_t> GetExpectedVisible(const spitfire::math::cDynamicAABBTree& tree, const std::vector<size_t>& proxies, const spitfire::math::cFrustumCuller& culler)
+{
+  std::vector<size_t> visible;
+  for (size_t i = 0; i < proxies.size(); i++) {
+    if ((proxies[i] != spitfire::math::cDynamicAABBTree::NULL_PROXY) && culler.IsAABBVisible(tree.GetFatAABB(proxies[i]))) visible.push_back(i);
+  }
+  return visible;
+}
+
+std::vector<size_t> GetVisible(const spitfire::math::cDynamicAABBTree& tree, const spitfire::math::cFrustumCuller& culler)
+{
+  std::vector<void*> visible;
+  tree.Cull(culler, visible);
+
+  std::vector<size_t> indices;
+  for (void* pUserData : visible) indices.push_back(reinterpret_cast<size_t>(pUserData));
+  std::sort(indices.begin(), indices.end());
+  return indices;
+}
+
+}
+
+TEST(SpitfireMath, TestFrustumCuller)
+{
+  const spitfire::math::cFrustumCuller culler = CreateCuller();
+
+  // In front, behind, past the far plane, closer than the near plane, off to the side
+  EXPECT_TRUE(culler.IsSphereVisible(spitfire::math::cVec3(0.0f, 0.0f, -10.0f), 1.0f));
+  EXPECT_FALSE(culler.IsSphereVisible(spitfire::math::cVec3(0.0f, 0.0f, 10.0f), 1.0f));
+  EXPECT_FALSE(culler.IsSphereVisible(spitfire::math::cVec3(0.0f, 0.0f, -110.0f), 1.0f));
+  EXPECT_FALSE(culler.IsSphereVisible(spitfire::math::cVec3(0.0f, 0.0f, -0.5f), 0.1f));
+  EXPECT_FALSE(culler.IsSphereVisible(spitfire::math::cVec3(20.0f, 0.0f, -10.0f), 1.0f));
+  EXPECT_FALSE(culler.IsSphereVisible(spitfire::math::cVec3(0.0f, -20.0f, -10.0f), 1.0f));
+  EXPECT_TRUE(culler.IsSphereVisible(spitfire::math::cVec3(9.0f, 0.0f, -10.0f), 1.0f));
+
+  // A sphere poking in from the side
+  EXPECT_TRUE(culler.IsSphereVisible(spitfire::math::cVec3(11.0f, 0.0f, -10.0f), 2.0f));
+
+  uint32_t planeMask = 0;
+  EXPECT_EQ(spitfire::math::FRUSTUM_CLASSIFICATION::INSIDE, culler.ClassifyAABB(CreateBox(spitfire::math::cVec3(0.0f, 0.0f, -10.0f), 1.0f), spitfire::math::FRUSTUM_PLANES_ALL, planeMask));
+  EXPECT_EQ(0, planeMask);
+  EXPECT_EQ(spitfire::math::FRUSTUM_CLASSIFICATION::OUTSIDE, culler.ClassifyAABB(CreateBox(spitfire::math::cVec3(0.0f, 0.0f, 10.0f), 1.0f), spitfire::math::FRUSTUM_PLANES_ALL, planeMask));
+
+  // Crossing only the right hand plane, the other planes are left out of the mask for the children
+  EXPECT_EQ(spitfire::math::FRUSTUM_CLASSIFICATION::INTERSECTS, culler.ClassifyAABB(CreateBox(spitfire::math::cVec3(10.0f, 0.0f, -10.0f), 1.0f), spitfire::math::FRUSTUM_PLANES_ALL, planeMask));
+  EXPECT_EQ(1, __builtin_popcount(planeMask));
+
+  // Planes that are not in the mask are not tested
+  const uint32_t rightPlane = planeMask;
+  EXPECT_EQ(spitfire::math::FRUSTUM_CLASSIFICATION::INSIDE, culler.ClassifyAABB(CreateBox(spitfire::math::cVec3(10.0f, 0.0f, -10.0f), 1.0f), spitfire::math::FRUSTUM_PLANES_ALL & ~rightPlane, planeMask));
+}
+
+TEST(SpitfireMath, TestFrustumCullerBatchesMatchSingleTests)
+{
+  const spitfire::math::cFrustumCuller culler = CreateCuller();
+
+  // Not a multiple of the batch size so the scalar remainder is used too
+  const cWorld world(1003);
+  const size_t n = world.positions.size();
+
+  std::vector<float> x(n), y(n), z(n), radius(n);
+  std::vector<float> minX(n), minY(n), minZ(n), maxX(n), maxY(n), maxZ(n);
+  for (size_t i = 0; i < n; i++) {
+    // Scaled in so that plenty are visible
+    const spitfire::math::cVec3 position = world.positions[i] * 0.2f;
+    x[i] = position.x;
+    y[i] = position.y;
+    z[i] = position.z;
+    radius[i] = world.radii[i];
+    const spitfire::math::cAABB3 box = CreateBox(position, world.radii[i]);
+    minX[i] = box.cornerMin.x;
+    minY[i] = box.cornerMin.y;
+    minZ[i] = box.cornerMin.z;
+    maxX[i] = box.cornerMax.x;
+    maxY[i] = box.cornerMax.y;
+    maxZ[i] = box.cornerMax.z;
+  }
+
+  std::vector<uint8_t> spheres(n);
+  std::vector<uint8_t> boxes(n);
+  culler.CullSpheres(x.data(), y.data(), z.data(), radius.data(), n, spheres.data());
+  culler.CullAABBs(minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data(), n, boxes.data());
+
+  size_t nVisible = 0;
+  for (size_t i = 0; i < n; i++) {
+    const spitfire::math::cVec3 position(x[i], y[i], z[i]);
+    ASSERT_EQ(culler.IsSphereVisible(position, radius[i]) ? 1 : 0, spheres[i]) << i;
+    ASSERT_EQ(culler.IsAABBVisible(CreateBox(position, radius[i])) ? 1 : 0, boxes[i]) << i;
+
+    // A box around a sphere is at least as visible as the sphere
+    if (spheres[i] != 0) {
+      EXPECT_EQ(1, boxes[i]);
+    }
+    nVisible += spheres[i];
+  }
+
+  EXPECT_LT(0, nVisible);
+  EXPECT_GT(n, nVisible);
+}
+
+TEST(SpitfireMath, TestDynamicAABBTree)
+{
+  const spitfire::math::cFrustumCuller culler = CreateCuller();
+
+  cWorld world(3000);
+  for (auto&& position : world.positions) position *= 0.25f;
+
+  spitfire::math::cDynamicAABBTree tree;
+  tree.SetMargin(0.5f);
+  std::vector<size_t> proxies;
+  for (size_t i = 0; i < world.positions.size(); i++) proxies.push_back(tree.CreateProxy(CreateBox(world.positions[i], world.radii[i]), reinterpret_cast<void*>(i)));
+
+  EXPECT_EQ(3000, tree.GetProxyCount());
+  EXPECT_TRUE(tree.IsValid());
+  EXPECT_GE(30, tree.GetHeight()); // log2(3000) is about 12
+  EXPECT_TRUE(GetExpectedVisible(tree, proxies, culler) == GetVisible(tree, culler));
+  EXPECT_FALSE(GetVisible(tree, culler).empty());
+
+  // Small movements stay inside the fat boxes
+  EXPECT_FALSE(tree.MoveProxy(proxies[0], CreateBox(world.positions[0] + spitfire::math::cVec3(0.25f, 0.0f, 0.0f), world.radii[0])));
+
+  // Everything moves, some of it far enough to be reinserted
+  std::mt19937 generator(5678);
+  size_t nReinserted = 0;
+  for (size_t frame = 0; frame < 10; frame++) {
+    world.Move(generator, 1.0f);
+    for (size_t i = 0; i < proxies.size(); i++) {
+      if (tree.MoveProxy(proxies[i], CreateBox(world.positions[i], world.radii[i]))) nReinserted++;
+    }
+    ASSERT_TRUE(tree.IsValid());
+    ASSERT_TRUE(GetExpectedVisible(tree, proxies, culler) == GetVisible(tree, culler));
+  }
+  EXPECT_LT(0, nReinserted);
+
+  // Remove every third one, the freed nodes are reused
+  for (size_t i = 0; i < proxies.size(); i += 3) {
+    tree.DestroyProxy(proxies[i]);
+    proxies[i] = spitfire::math::cDynamicAABBTree::NULL_PROXY;
+  }
+  EXPECT_EQ(2000, tree.GetProxyCount());
+  EXPECT_TRUE(tree.IsValid());
+  EXPECT_TRUE(GetExpectedVisible(tree, proxies, culler) == GetVisible(tree, culler));
+
+  const size_t proxy = tree.CreateProxy(CreateBox(spitfire::math::cVec3(0.0f, 0.0f, -10.0f), 1.0f), reinterpret_cast<void*>(12345));
+  EXPECT_GT(2 * proxies.size(), proxy); // Every leaf and internal node that was ever allocated
+  EXPECT_EQ(reinterpret_cast<void*>(12345), tree.GetUserData(proxy));
+  EXPECT_TRUE(tree.IsValid());
+
+  tree.Clear();
+  EXPECT_EQ(0, tree.GetProxyCount());
+  EXPECT_TRUE(tree.IsValid());
+  EXPECT_TRUE(GetVisible(tree, culler).empty());
+}
+
+TEST(SpitfireMath, TestDynamicAABBTreeTransformedBoxIsCulled)
+{
+  const spitfire::math::cFrustumCuller culler = CreateCuller();
+
+  // A long thin object, in its local space along the x axis
+  spitfire::math::cAABB3 local;
+  local.SetMinMax(spitfire::math::cVec3(-4.0f, -0.5f, -0.5f), spitfire::math::cVec3(4.0f, 0.5f, 0.5f));
+
+  // Rotated a quarter turn around the y axis and moved in front of the camera
+  spitfire::math::cMat4 matrix;
+  matrix.SetRotationY(0.5f * spitfire::math::cPI);
+  matrix.SetTranslation(0.0f, 0.0f, -10.0f);
+
+  spitfire::math::cAABB3 box = spitfire::math::GetTransformedAABB(local, matrix);
+  EXPECT_NEAR(-0.5f, box.cornerMin.x, 0.001f);
+  EXPECT_NEAR(0.5f, box.cornerMax.x, 0.001f);
+  EXPECT_NEAR(-0.5f, box.cornerMin.y, 0.001f);
+  EXPECT_NEAR(0.5f, box.cornerMax.y, 0.001f);
+  EXPECT_NEAR(-14.0f, box.cornerMin.z, 0.001f);
+  EXPECT_NEAR(-6.0f, box.cornerMax.z, 0.001f);
+
+  spitfire::math::cDynamicAABBTree tree;
+  const size_t proxy = tree.CreateProxy(box, reinterpret_cast<void*>(1));
+  EXPECT_EQ(std::vector<size_t>({ 1 }), GetVisible(tree, culler));
+
+  // Moved behind the camera it is culled
+  matrix.SetTranslation(0.0f, 0.0f, 10.0f);
+  EXPECT_TRUE(tree.MoveProxy(proxy, spitfire::math::GetTransformedAABB(local, matrix)));
+  EXPECT_TRUE(tree.IsValid());
+  EXPECT_TRUE(GetVisible(tree, culler).empty());
+
+  // And back in front of it, just inside the left side of the frustum
+  matrix.SetTranslation(-9.0f, 0.0f, -10.0f);
+  EXPECT_TRUE(tree.MoveProxy(proxy, spitfire::math::GetTransformedAABB(local, matrix)));
+  EXPECT_EQ(std::vector<size_t>({ 1 }), GetVisible(tree, culler));
+}
+
+TEST(SpitfireMath, DISABLED_TestDynamicAABBTreeBenchmark)
+{
+  const spitfire::math::cFrustumCuller culler = CreateCuller();
+
+  for (size_t nObjects : { 1000, 10000, 100000 }) {
+    const cWorld world(nObjects);
+
+    spitfire::math::cDynamicAABBTree tree;
+    for (size_t i = 0; i < nObjects; i++) tree.CreateProxy(CreateBox(world.positions[i], world.radii[i]), reinterpret_cast<void*>(i));
+
+    const size_t nIterations = 20;
+
+    // One sphere at a time, like the cull visitor walking every node
+    std::vector<size_t> visibleLinear;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t iteration = 0; iteration < nIterations; iteration++) {
+      visibleLinear.clear();
+      for (size_t i = 0; i < nObjects; i++) {
+        if (culler.IsSphereVisible(world.positions[i], world.radii[i])) visibleLinear.push_back(i);
+      }
+    }
+    const double fLinearMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nIterations;
+
+    std::vector<void*> visibleTree;
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t iteration = 0; iteration < nIterations; iteration++) {
+      visibleTree.clear();
+      tree.Cull(culler, visibleTree);
+    }
+    const double fTreeMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / nIterations;
+
+    std::cout<<"cDynamicAABBTree nodes="<<nObjects<<" visible="<<visibleLinear.size()<<" linear="<<fLinearMS<<"ms tree="<<fTreeMS<<"ms"<<std::endl;
+
+    // The fat boxes around the spheres can only add to what is visible
+    EXPECT_LE(visibleLinear.size(), visibleTree.size());
+  }
+}
@@ -0,0 +1,142 @@
+// Standard headers
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/math.h>
+#include <spitfire/math/cKDTree.h>
+
+namespace {
+
+// Random points, with some snapped to a coarse grid so that there are duplicates and ties
+std::vector<spitfire::math::cVec3> CreatePoints(size_t nPoints, uint32_t seed)
+{
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+
+  std::vector<spitfire::math::cVec3> points;
+  for (size_t i = 0; i < nPoints; i++) {
+    spitfire::math::cVec3 point(coordinate(generator), coordinate(generator), 0.1f * coordinate(generator));
+    if ((i % 4) == 0) point = spitfire::math::cVec3(float(int(point.x / 10.0f) * 10), float(int(point.y / 10.0f) * 10), 0.0f);
+    points.push_back(point);
+  }
+
+  return points;
+}
+
+// Closest first, then the lowest index, the same order that cKDTree returns
+std::vector<size_t> GetSortedByDistance(const std::vector<spitfire::math::cVec3>& points, const spitfire::math::cVec3& position)
+{
+  std::vector<std::pair<float, size_t>> distances;
+  for (size_t i = 0; i < points.size(); i++) distances.push_back(std::make_pair((points[i] - position).GetSquaredLength(), i));
+  std::sort(distances.begin(), distances.end());
+
+  std::vector<size_t> result;
+  for (const std::pair<float, size_t>& entry : distances) result.push_back(entry.second);
+  return result;
+}
+
+size_t GetNearestLinear(const std::vector<spitfire::math::cVec3>& points, const spitfire::math::cVec3& position)
+{
+  size_t nearest = spitfire::math::cKDTree::NULL_INDEX;
+  float fNearestDistanceSquared = spitfire::math::cINFINITY;
+  for (size_t i = 0; i < points.size(); i++) {
+    const float fDistanceSquared = (points[i] - position).GetSquaredLength();
+    if (fDistanceSquared < fNearestDistanceSquared) {
+      fNearestDistanceSquared = fDistanceSquared;
+      nearest = i;
+    }
+  }
+
+  return nearest;
+}
+
+}
+
+TEST(SpitfireMath, TestKDTree)
+{
+  spitfire::math::cKDTree tree;
+  EXPECT_TRUE(tree.IsEmpty());
+  EXPECT_EQ(spitfire::math::cKDTree::NULL_INDEX, tree.FindNearest(spitfire::math::cVec3(1.0f, 2.0f, 3.0f)));
+
+  std::vector<size_t> result;
+  tree.FindKNearest(spitfire::math::cVec3(1.0f, 2.0f, 3.0f), 4, result);
+  EXPECT_TRUE(result.empty());
+
+  const std::vector<spitfire::math::cVec3> points = CreatePoints(2000, 1234);
+  tree.Build(points);
+  EXPECT_EQ(points.size(), tree.GetSize());
+
+  std::mt19937 generator(5678);
+  std::uniform_real_distribution<float> coordinate(-120.0f, 120.0f);
+
+  for (size_t i = 0; i < 200; i++) {
+    spitfire::math::cVec3 position(coordinate(generator), coordinate(generator), coordinate(generator));
+    if ((i % 10) == 0) position = points[generator() % points.size()];
+
+    const std::vector<size_t> expected = GetSortedByDistance(points, position);
+
+    EXPECT_EQ(GetNearestLinear(points, position), tree.FindNearest(position));
+
+    for (size_t k : { 1, 7, 50 }) {
+      tree.FindKNearest(position, k, result);
+      EXPECT_EQ(std::vector<size_t>(expected.begin(), expected.begin() + k), result);
+    }
+
+    const float fRadius = 20.0f;
+    tree.FindInRadius(position, fRadius, result);
+    std::sort(result.begin(), result.end());
+
+    std::vector<size_t> expectedInRadius;
+    for (size_t index : expected) {
+      if ((points[index] - position).GetSquaredLength() <= (fRadius * fRadius)) expectedInRadius.push_back(index);
+    }
+    std::sort(expectedInRadius.begin(), expectedInRadius.end());
+    EXPECT_EQ(expectedInRadius, result);
+  }
+
+  // Asking for more points than there are returns all of them
+  tree.FindKNearest(spitfire::math::cVec3(0.0f, 0.0f, 0.0f), 5000, result);
+  EXPECT_EQ(points.size(), result.size());
+
+  tree.Clear();
+  EXPECT_TRUE(tree.IsEmpty());
+}
+
+TEST(SpitfireMath, DISABLED_TestKDTreeBenchmark)
+{
+  for (size_t nPoints : { 1000, 10000, 100000 }) {
+    const std::vector<spitfire::math::cVec3> points = CreatePoints(nPoints, 1234);
+
+    std::mt19937 generator(5678);
+    std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+    std::vector<spitfire::math::cVec3> positions;
+    for (size_t i = 0; i < 1000; i++) positions.push_back(spitfire::math::cVec3(coordinate(generator), coordinate(generator), 0.0f));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    spitfire::math::cKDTree tree;
+    tree.Build(points);
+    const double fBuildMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::vector<size_t> linear;
+    start = std::chrono::high_resolution_clock::now();
+    for (const spitfire::math::cVec3& position : positions) linear.push_back(GetNearestLinear(points, position));
+    const double fLinearUS = 1000.0 * std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / positions.size();
+
+    std::vector<size_t> nearest;
+    start = std::chrono::high_resolution_clock::now();
+    for (const spitfire::math::cVec3& position : positions) nearest.push_back(tree.FindNearest(position));
+    const double fTreeUS = 1000.0 * std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / positions.size();
+
+    EXPECT_EQ(linear, nearest);
+
+    std::cout<<"cKDTree points="<<nPoints<<" build="<<fBuildMS<<"ms linear="<<fLinearUS<<"us tree="<<fTreeUS<<"us per query"<<std::endl;
+  }
+}
@@ -0,0 +1,170 @@
+// Standard headers
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cRectanglePacker.h>
+
+namespace {
+
+// Mostly glyph sized with some larger sprites
+std::vector<std::pair<size_t, size_t>> CreateSizes(size_t n)
+{
+  std::vector<std::pair<size_t, size_t>> sizes;
+  uint32_t seed = 1234;
+  for (size_t i = 0; i < n; i++) {
+    seed = (seed * 1103515245) + 12345;
+    const size_t nMaximum = ((i % 20) == 0) ? 200 : 40;
+    const size_t width = 4 + ((seed >> 8) % nMaximum);
+    const size_t height = 4 + ((seed >> 20) % nMaximum);
+    sizes.push_back(std::make_pair(width, height));
+  }
+  return sizes;
+}
+
+// Every rectangle is on a page and none of them overlap
+void CheckPacking(size_t pageWidth, size_t pageHeight, const std::vector<std::pair<size_t, size_t>>& sizes, const std::vector<spitfire::math::cRectanglePacker>& pages, const std::vector<spitfire::math::cPackedRectangle>& packed)
+{
+  ASSERT_EQ(sizes.size(), packed.size());
+
+  std::vector<std::vector<uint8_t>> coverage(pages.size(), std::vector<uint8_t>(pageWidth * pageHeight, 0));
+  std::vector<size_t> usedArea(pages.size(), 0);
+
+  for (size_t i = 0; i < sizes.size(); i++) {
+    const spitfire::math::cPackedRectangle& rectangle = packed[i];
+    ASSERT_LT(rectangle.page, pages.size());
+    ASSERT_LE(rectangle.x + sizes[i].first, pageWidth);
+    ASSERT_LE(rectangle.y + sizes[i].second, pageHeight);
+
+    for (size_t y = 0; y < sizes[i].second; y++) {
+      for (size_t x = 0; x < sizes[i].first; x++) {
+        uint8_t& covered = coverage[rectangle.page][((rectangle.y + y) * pageWidth) + rectangle.x + x];
+        ASSERT_EQ(0, covered) << "rectangle " << i << " overlaps another rectangle";
+        covered = 1;
+      }
+    }
+
+    usedArea[rectangle.page] += sizes[i].first * sizes[i].second;
+  }
+
+  for (size_t i = 0; i < pages.size(); i++) {
+    EXPECT_EQ(usedArea[i], pages[i].GetUsedArea());
+    EXPECT_FLOAT_EQ(float(usedArea[i]) / float(pageWidth * pageHeight), pages[i].GetOccupancy());
+  }
+}
+
+}
+
+TEST(SpitfireMath, TestRectanglePacker)
+{
+  for (auto algorithm : { spitfire::math::PACKING_ALGORITHM::SHELF, spitfire::math::PACKING_ALGORITHM::SKYLINE, spitfire::math::PACKING_ALGORITHM::MAX_RECTS }) {
+    spitfire::math::cRectanglePacker packer;
+    packer.Init(64, 64, algorithm);
+
+    size_t x = 0;
+    size_t y = 0;
+
+    // Too large
+    EXPECT_FALSE(packer.Insert(65, 1, x, y));
+    EXPECT_FALSE(packer.Insert(1, 65, x, y));
+
+    // Exactly fills the page
+    for (size_t i = 0; i < 16; i++) {
+      ASSERT_TRUE(packer.Insert(16, 16, x, y));
+      EXPECT_EQ(0, x % 16);
+      EXPECT_EQ(0, y % 16);
+    }
+    EXPECT_EQ(16, packer.GetRectangleCount());
+    EXPECT_FLOAT_EQ(1.0f, packer.GetOccupancy());
+    EXPECT_FALSE(packer.Insert(1, 1, x, y));
+
+    // A taller rectangle in the same row leaves a gap that the shelf packer can never use
+    packer.Init(64, 64, algorithm);
+    ASSERT_TRUE(packer.Insert(32, 64, x, y));
+    ASSERT_TRUE(packer.Insert(32, 32, x, y));
+    EXPECT_EQ(algorithm != spitfire::math::PACKING_ALGORITHM::SHELF, packer.Insert(32, 32, x, y));
+  }
+}
+
+TEST(SpitfireMath, TestPackRectangles)
+{
+  const std::vector<std::pair<size_t, size_t>> sizes = CreateSizes(2000);
+
+  for (auto algorithm : { spitfire::math::PACKING_ALGORITHM::SHELF, spitfire::math::PACKING_ALGORITHM::SKYLINE, spitfire::math::PACKING_ALGORITHM::MAX_RECTS }) {
+    std::vector<spitfire::math::cRectanglePacker> pages;
+    std::vector<spitfire::math::cPackedRectangle> packed;
+    ASSERT_TRUE(spitfire::math::PackRectangles(256, 256, algorithm, sizes, pages, packed));
+    EXPECT_LT(1, pages.size());
+    CheckPacking(256, 256, sizes, pages, packed);
+
+    // More rectangles go into the existing pages before new ones are added
+    const size_t nPages = pages.size();
+    std::vector<spitfire::math::cPackedRectangle> packedMore;
+    ASSERT_TRUE(spitfire::math::PackRectangles(256, 256, algorithm, std::vector<std::pair<size_t, size_t>>(10, std::make_pair(4, 4)), pages, packedMore));
+    EXPECT_EQ(nPages, pages.size());
+    for (auto&& rectangle : packedMore) EXPECT_LT(rectangle.page, nPages);
+  }
+
+  // Rectangles that are too large are skipped
+  std::vector<spitfire::math::cRectanglePacker> pages;
+  std::vector<spitfire::math::cPackedRectangle> packed;
+  EXPECT_FALSE(spitfire::math::PackRectangles(64, 64, spitfire::math::PACKING_ALGORITHM::MAX_RECTS, { { 10, 10 }, { 65, 10 }, { 20, 20 } }, pages, packed));
+  ASSERT_EQ(3, packed.size());
+  EXPECT_EQ(0, packed[0].page);
+  EXPECT_EQ(spitfire::math::INVALID_PAGE, packed[1].page);
+  EXPECT_EQ(0, packed[2].page);
+}
+
+TEST(SpitfireMath, DISABLED_BenchmarkRectanglePacker)
+{
+  const size_t nPageSize = 2048;
+  const std::vector<std::pair<size_t, size_t>> sizes = CreateSizes(20000);
+
+  size_t nTotalArea = 0;
+  for (auto&& size : sizes) nTotalArea += size.first * size.second;
+
+  auto Report = [&](const char* szName, double fDurationMS, const std::vector<spitfire::math::cRectanglePacker>& pages) {
+    // The fill ratio ignores the last page because it is only partly used whatever the algorithm
+    size_t nUsedArea = 0;
+    for (size_t i = 0; (i + 1) < pages.size(); i++) nUsedArea += pages[i].GetUsedArea();
+    const double fFill = (pages.size() > 1) ? (double(nUsedArea) / double((pages.size() - 1) * nPageSize * nPageSize)) : 0.0;
+    std::cout<<szName<<" rectangles="<<sizes.size()<<" time="<<fDurationMS<<"ms pages="<<pages.size()<<" fill="<<(100.0 * fFill)<<"% (ideal pages="<<(double(nTotalArea) / double(nPageSize * nPageSize))<<")"<<std::endl;
+  };
+
+  {
+    // The way cTextureAtlas used to pack, one at a time in the order they were added
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::vector<spitfire::math::cRectanglePacker> pages;
+    for (auto&& size : sizes) {
+      size_t x = 0;
+      size_t y = 0;
+      if (pages.empty() || !pages.back().Insert(size.first, size.second, x, y)) {
+        pages.push_back(spitfire::math::cRectanglePacker());
+        pages.back().Init(nPageSize, nPageSize, spitfire::math::PACKING_ALGORITHM::SHELF);
+        ASSERT_TRUE(pages.back().Insert(size.first, size.second, x, y));
+      }
+    }
+    Report("Shelf unsorted", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), pages);
+  }
+
+  const struct {
+    const char* szName;
+    spitfire::math::PACKING_ALGORITHM algorithm;
+  } algorithms[] = {
+    { "Shelf sorted", spitfire::math::PACKING_ALGORITHM::SHELF },
+    { "Skyline", spitfire::math::PACKING_ALGORITHM::SKYLINE },
+    { "MaxRects", spitfire::math::PACKING_ALGORITHM::MAX_RECTS },
+  };
+
+  for (auto&& algorithm : algorithms) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::vector<spitfire::math::cRectanglePacker> pages;
+    std::vector<spitfire::math::cPackedRectangle> packed;
+    ASSERT_TRUE(spitfire::math::PackRectangles(nPageSize, nPageSize, algorithm.algorithm, sizes, pages, packed));
+    Report(algorithm.szName, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), pages);
+  }
+}
@@ -0,0 +1,246 @@
+// Standard headers
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometry.h>
+#include <libopenglmm/cGeometryOptimiser.h>
+
+namespace {
+
+typedef std::vector<float> Point;
+typedef std::vector<Point> Triangle;
+
+size_t GetFloatsPerPoint(const opengl::cGeometryData& data)
+{
+  return data.nVerticesPerPoint + data.nNormalsPerPoint + data.nColoursPerPoint + data.nTextureCoordinatesPerPoint +
+    data.nFloatUserData0PerPoint + data.nFloatUserData1PerPoint + data.nFloatUserData2PerPoint;
+}
+
+// Every triangle rotated so that its smallest point is first, which keeps the winding, then sorted
+std::vector<Triangle> GetTriangles(const opengl::cGeometryData& data)
+{
+  const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+  const size_t nIndices = data.indices.empty() ? data.nVertexCount : data.indices.size();
+
+  std::vector<Triangle> triangles;
+  for (size_t i = 0; (i + 3) <= nIndices; i += 3) {
+    Triangle triangle;
+    for (size_t j = 0; j < 3; j++) {
+      const size_t index = data.indices.empty() ? (i + j) : data.indices[i + j];
+      triangle.push_back(Point(data.vertices.begin() + (index * nFloatsPerPoint), data.vertices.begin() + ((index + 1) * nFloatsPerPoint)));
+    }
+    std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+    triangles.push_back(triangle);
+  }
+
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+// A grid of triangles in a random order, like a model exported without any thought for the cache
+void CreateShuffledGrid(size_t nCells, opengl::cGeometryData& data)
+{
+  opengl::cGeometryBuilder_v3_n3_t2 builder(data);
+
+  std::vector<size_t> cells(nCells * nCells);
+  for (size_t i = 0; i < cells.size(); i++) cells[i] = i;
+  std::mt19937 generator(1234);
+  std::shuffle(cells.begin(), cells.end(), generator);
+
+  const spitfire::math::cVec3 normal(0.0f, 1.0f, 0.0f);
+  for (size_t cell : cells) {
+    const float x = float(cell % nCells);
+    const float z = float(cell / nCells);
+    const spitfire::math::cVec3 p0(x, 0.0f, z);
+    const spitfire::math::cVec3 p1(x + 1.0f, 0.0f, z);
+    const spitfire::math::cVec3 p2(x + 1.0f, 0.0f, z + 1.0f);
+    const spitfire::math::cVec3 p3(x, 0.0f, z + 1.0f);
+    const float fScale = 1.0f / float(nCells);
+    builder.PushBack(p0, normal, spitfire::math::cVec2(p0.x, p0.z) * fScale);
+    builder.PushBack(p2, normal, spitfire::math::cVec2(p2.x, p2.z) * fScale);
+    builder.PushBack(p1, normal, spitfire::math::cVec2(p1.x, p1.z) * fScale);
+    builder.PushBack(p0, normal, spitfire::math::cVec2(p0.x, p0.z) * fScale);
+    builder.PushBack(p3, normal, spitfire::math::cVec2(p3.x, p3.z) * fScale);
+    builder.PushBack(p2, normal, spitfire::math::cVec2(p2.x, p2.z) * fScale);
+  }
+}
+
+}
+
+TEST(OpenGLGeometryOptimiser, TestWeldVertices)
+{
+  opengl::cGeometryData data;
+  opengl::cGeometryBuilder builder;
+  builder.CreateBox(1.0f, 2.0f, 3.0f, data, 1);
+  ASSERT_EQ(36, data.nVertexCount);
+  ASSERT_TRUE(data.indices.empty());
+
+  const std::vector<Triangle> original = GetTriangles(data);
+
+  opengl::cGeometryOptimiser optimiser;
+  EXPECT_FLOAT_EQ(3.0f, optimiser.GetACMR(data));
+  EXPECT_FLOAT_EQ(1.0f, optimiser.GetATVR(data));
+
+  ASSERT_TRUE(optimiser.WeldVertices(data));
+
+  // Each face has 4 corners with their own normal
+  EXPECT_EQ(24, data.nVertexCount);
+  EXPECT_EQ(24 * GetFloatsPerPoint(data), data.vertices.size());
+  EXPECT_EQ(36, data.indices.size());
+  EXPECT_TRUE(original == GetTriangles(data));
+  EXPECT_GT(3.0f, optimiser.GetACMR(data));
+
+  // Welding again changes nothing
+  const std::vector<uint16_t> indices = data.indices;
+  ASSERT_TRUE(optimiser.WeldVertices(data));
+  EXPECT_EQ(24, data.nVertexCount);
+  EXPECT_TRUE(indices == data.indices);
+}
+
+TEST(OpenGLGeometryOptimiser, TestTooManyVertices)
+{
+  // More unique points than 16 bit indices can address
+  opengl::cGeometryData data;
+  opengl::cGeometryBuilder_v3_n3 builder(data);
+  for (size_t i = 0; i < 70002; i++) builder.PushBack(spitfire::math::cVec3(float(i), 0.0f, 0.0f), spitfire::math::cVec3(0.0f, 1.0f, 0.0f));
+
+  const std::vector<float> vertices = data.vertices;
+
+  opengl::cGeometryOptimiser optimiser;
+  EXPECT_FALSE(optimiser.Optimise(data));
+  EXPECT_EQ(70002, data.nVertexCount);
+  EXPECT_TRUE(data.indices.empty());
+  EXPECT_TRUE(vertices == data.vertices);
+}
+
+TEST(OpenGLGeometryOptimiser, TestEachStepKeepsTheTriangles)
+{
+  opengl::cGeometryData data;
+  opengl::cGeometryBuilder builder;
+  builder.CreateSphere(1.0f, 20, data, 1);
+
+  const std::vector<Triangle> original = GetTriangles(data);
+
+  opengl::cGeometryOptimiser optimiser;
+  ASSERT_TRUE(optimiser.WeldVertices(data));
+  EXPECT_TRUE(original == GetTriangles(data));
+  const float fACMRWelded = optimiser.GetACMR(data);
+
+  optimiser.OptimiseVertexCache(data);
+  EXPECT_TRUE(original == GetTriangles(data));
+  const float fACMRVertexCache = optimiser.GetACMR(data);
+  EXPECT_GT(fACMRWelded, fACMRVertexCache);
+
+  // Reordering the clusters can cost a little cache efficiency but not much
+  optimiser.OptimiseOverdraw(data);
+  EXPECT_TRUE(original == GetTriangles(data));
+  EXPECT_GT(fACMRVertexCache * 1.1f, optimiser.GetACMR(data));
+
+  // The vertices are in the order that they are first used and the cache behaviour doesn't change
+  const float fACMROverdraw = optimiser.GetACMR(data);
+  const size_t nVertexCount = data.nVertexCount;
+  optimiser.OptimiseVertexFetch(data);
+  EXPECT_TRUE(original == GetTriangles(data));
+  EXPECT_FLOAT_EQ(fACMROverdraw, optimiser.GetACMR(data));
+  EXPECT_EQ(nVertexCount, data.nVertexCount);
+
+  size_t nNextIndex = 0;
+  for (uint16_t index : data.indices) {
+    ASSERT_LE(index, nNextIndex);
+    if (index == nNextIndex) nNextIndex++;
+  }
+  EXPECT_EQ(data.nVertexCount, nNextIndex);
+}
+
+TEST(OpenGLGeometryOptimiser, TestOverdrawDrawsOutsideFirst)
+{
+  // Two boxes, one inside the other, the outer box should be drawn first because it faces away from the center
+  opengl::cGeometryData data;
+  opengl::cGeometryBuilder builder;
+  builder.CreateBox(1.0f, 1.0f, 1.0f, data, 1);
+  builder.CreateBox(4.0f, 4.0f, 4.0f, data, 1);
+
+  opengl::cGeometryOptimiser optimiser;
+  optimiser.SetOverdrawThreshold(2.0f);
+  ASSERT_TRUE(optimiser.WeldVertices(data));
+  optimiser.OptimiseVertexCache(data);
+  optimiser.OptimiseOverdraw(data);
+
+  // The first triangle drawn belongs to the outer box
+  const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+  const float* pFirst = &data.vertices[data.indices[0] * nFloatsPerPoint];
+  EXPECT_FLOAT_EQ(2.0f, std::max({ std::fabs(pFirst[0]), std::fabs(pFirst[1]), std::fabs(pFirst[2]) }));
+}
+
+TEST(OpenGLGeometryOptimiser, TestStatistics)
+{
+  opengl::cGeometryData data;
+  CreateShuffledGrid(40, data);
+  const std::vector<Triangle> original = GetTriangles(data);
+
+  opengl::cGeometryOptimiser optimiser;
+  opengl::cGeometryOptimiserStatistics statistics;
+  ASSERT_TRUE(optimiser.Optimise(data, statistics));
+
+  EXPECT_TRUE(original == GetTriangles(data));
+  EXPECT_EQ(40 * 40 * 6, statistics.nVertexCountBefore);
+  EXPECT_EQ(41 * 41, statistics.nVertexCountAfter);
+  EXPECT_FLOAT_EQ(3.0f, statistics.fACMRBefore);
+  EXPECT_GT(1.0f, statistics.fACMRAfter);
+  EXPECT_GT(1.5f, statistics.fATVRAfter);
+
+  // A smaller cache is less effective
+  opengl::cGeometryOptimiser smallCache;
+  smallCache.SetCacheSize(4);
+  EXPECT_LT(optimiser.GetACMR(data), smallCache.GetACMR(data));
+}
+
+TEST(OpenGLGeometryOptimiser, DISABLED_TestBenchmark)
+{
+  struct cMesh {
+    const char* szName;
+    opengl::cGeometryData data;
+  };
+  std::vector<cMesh> meshes(6);
+
+  opengl::cGeometryBuilder builder;
+  meshes[0].szName = "box";
+  builder.CreateBox(1.0f, 1.0f, 1.0f, meshes[0].data, 1);
+  meshes[1].szName = "sphere";
+  builder.CreateSphere(1.0f, 60, meshes[1].data, 1);
+  meshes[2].szName = "cylinder";
+  builder.CreateCylinder(1.0f, 2.0f, 60, meshes[2].data, 1);
+  meshes[3].szName = "teapot";
+  builder.CreateTeapot(1.0f, 16, meshes[3].data, 1);
+  meshes[4].szName = "gear";
+  builder.CreateGear(1.0f, 4.0f, 1.0f, 20, 0.7f, meshes[4].data);
+  meshes[5].szName = "shuffled grid";
+  CreateShuffledGrid(100, meshes[5].data);
+
+  opengl::cGeometryOptimiser optimiser;
+  for (auto&& mesh : meshes) {
+    const std::vector<Triangle> original = GetTriangles(mesh.data);
+
+    opengl::cGeometryOptimiserStatistics statistics;
+    const auto start = std::chrono::high_resolution_clock::now();
+    const bool bResult = optimiser.Optimise(mesh.data, statistics);
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    ASSERT_TRUE(bResult) << mesh.szName;
+
+    std::cout<<"cGeometryOptimiser "<<mesh.szName<<" triangles="<<(mesh.data.indices.size() / 3)<<" vertices="<<statistics.nVertexCountBefore<<"->"<<statistics.nVertexCountAfter
+      <<" ACMR="<<statistics.fACMRBefore<<"->"<<statistics.fACMRAfter<<" ATVR="<<statistics.fATVRBefore<<"->"<<statistics.fATVRAfter<<" time="<<fDurationMS<<"ms"<<std::endl;
+
+    EXPECT_TRUE(original == GetTriangles(mesh.data)) << mesh.szName;
+    EXPECT_GE(statistics.fACMRBefore, statistics.fACMRAfter) << mesh.szName;
+  }
+}
@@ -0,0 +1,330 @@
+// Standard headers
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/math/cDynamicAABBTree.h>
+#include <spitfire/math/cFrustumCuller.h>
+#include <spitfire/math/cMat4.h>
+
+// libopenglmm headers
+#include <libopenglmm/cGeometry.h>
+#include <libopenglmm/cGeometryOptimiser.h>
+#include <libopenglmm/cGeometrySimplifier.h>
+
+// Breathe headers
+#include <breathe/render/model/cStaticLOD.h>
+
+namespace {
+
+typedef std::vector<float> Point;
+
+size_t GetFloatsPerPoint(const opengl::cGeometryData& data)
+{
+  return data.nVerticesPerPoint + data.nNormalsPerPoint + data.nColoursPerPoint + data.nTextureCoordinatesPerPoint +
+    data.nFloatUserData0PerPoint + data.nFloatUserData1PerPoint + data.nFloatUserData2PerPoint;
+}
+
+size_t GetTriangleCount(const opengl::cGeometryData& data)
+{
+  return (data.indices.empty() ? data.nVertexCount : data.indices.size()) / 3;
+}
+
+std::set<Point> GetPoints(const opengl::cGeometryData& data)
+{
+  const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+
+  std::set<Point> points;
+  for (size_t i = 0; i < data.nVertexCount; i++) points.insert(Point(data.vertices.begin() + (i * nFloatsPerPoint), data.vertices.begin() + ((i + 1) * nFloatsPerPoint)));
+  return points;
+}
+
+// A latitude longitude sphere with shared vertices, the first and last columns are the texture coordinate seam
+void CreateUVSphere(size_t nSegments, opengl::cGeometryData& data)
+{
+  opengl::cGeometryBuilder_v3_n3_t2 builder(data);
+
+  const size_t nRows = nSegments / 2;
+  for (size_t i = 0; i <= nRows; i++) {
+    const float fLatitude = spitfire::math::cPI * ((float(i) / float(nRows)) - 0.5f);
+    for (size_t j = 0; j <= nSegments; j++) {
+      const float fLongitude = 2.0f * spitfire::math::cPI * float(j % nSegments) / float(nSegments);
+      const spitfire::math::cVec3 normal(std::cos(fLatitude) * std::cos(fLongitude), std::cos(fLatitude) * std::sin(fLongitude), std::sin(fLatitude));
+      builder.PushBack(normal, normal, spitfire::math::cVec2(float(j) / float(nSegments), float(i) / float(nRows)));
+    }
+  }
+
+  const size_t nColumns = nSegments + 1;
+  for (size_t i = 0; i < nRows; i++) {
+    for (size_t j = 0; j < nSegments; j++) {
+      const uint16_t a = uint16_t((i * nColumns) + j);
+      const uint16_t b = uint16_t((i * nColumns) + j + 1);
+      const uint16_t c = uint16_t(((i + 1) * nColumns) + j + 1);
+      const uint16_t d = uint16_t(((i + 1) * nColumns) + j);
+      if (i != 0) data.indices.insert(data.indices.end(), { a, b, d });
+      if (i != (nRows - 1)) data.indices.insert(data.indices.end(), { b, c, d });
+    }
+  }
+}
+
+// A flat grid with a texture coordinate seam down the middle, the right half uses a different part of the texture
+void CreateGridWithSeam(size_t nCells, opengl::cGeometryData& data)
+{
+  opengl::cGeometryBuilder_v3_n3_t2 builder(data);
+
+  const spitfire::math::cVec3 normal(0.0f, 1.0f, 0.0f);
+  for (size_t z = 0; z < nCells; z++) {
+    for (size_t x = 0; x < nCells; x++) {
+      const spitfire::math::cVec3 p0(float(x), 0.0f, float(z));
+      const spitfire::math::cVec3 p1(float(x + 1), 0.0f, float(z));
+      const spitfire::math::cVec3 p2(float(x + 1), 0.0f, float(z + 1));
+      const spitfire::math::cVec3 p3(float(x), 0.0f, float(z + 1));
+      const float fOffset = (x < (nCells / 2)) ? 0.0f : 10.0f;
+      builder.PushBack(p0, normal, spitfire::math::cVec2(p0.x + fOffset, p0.z));
+      builder.PushBack(p2, normal, spitfire::math::cVec2(p2.x + fOffset, p2.z));
+      builder.PushBack(p1, normal, spitfire::math::cVec2(p1.x + fOffset, p1.z));
+      builder.PushBack(p0, normal, spitfire::math::cVec2(p0.x + fOffset, p0.z));
+      builder.PushBack(p3, normal, spitfire::math::cVec2(p3.x + fOffset, p3.z));
+      builder.PushBack(p2, normal, spitfire::math::cVec2(p2.x + fOffset, p2.z));
+    }
+  }
+}
+
+
+// A unit sphere de-indexed like the OBJ loader produces
+void CreateSphereModel(breathe::render::model::cStaticModel& model)
+{
+  opengl::cGeometryData data;
+  CreateUVSphere(40, data);
+  const size_t nFloatsPerPoint = GetFloatsPerPoint(data);
+
+  breathe::render::model::cStaticModelMesh* pMesh = new breathe::render::model::cStaticModelMesh;
+  pMesh->sMaterial = TEXT("planet");
+  for (uint16_t index : data.indices) {
+    const float* pPoint = &data.vertices[index * nFloatsPerPoint];
+    pMesh->vertices.insert(pMesh->vertices.end(), pPoint, pPoint + 3);
+    pMesh->normals.insert(pMesh->normals.end(), pPoint + 3, pPoint + 6);
+    pMesh->textureCoordinates.insert(pMesh->textureCoordinates.end(), pPoint + 6, pPoint + 8);
+  }
+  model.mesh.push_back(pMesh);
+}
+}
+
+TEST(OpenGLGeometrySimplifier, TestSphereLODs)
+{
+  opengl::cGeometryData data;
+  CreateUVSphere(60, data);
+  const size_t nTriangles = GetTriangleCount(data);
+
+  opengl::cGeometrySimplifier simplifier;
+  std::vector<opengl::cGeometryData> lods;
+  std::vector<float> errors;
+  const auto start = std::chrono::high_resolution_clock::now();
+  ASSERT_TRUE(simplifier.GenerateLODs(data, { 0.5f, 0.25f, 0.1f }, lods, errors));
+  const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  ASSERT_EQ(3, lods.size());
+  ASSERT_EQ(3, errors.size());
+
+  std::cout<<"cGeometrySimplifier sphere triangles="<<nTriangles;
+  for (size_t i = 0; i < lods.size(); i++) std::cout<<" "<<GetTriangleCount(lods[i])<<" (error="<<errors[i]<<")";
+  std::cout<<" time="<<fDurationMS<<"ms"<<std::endl;
+
+  // The seam and the poles are locked so the smallest target can't quite be reached
+  EXPECT_GE(size_t(0.5f * nTriangles), GetTriangleCount(lods[0]));
+  EXPECT_GE(size_t(0.25f * nTriangles), GetTriangleCount(lods[1]));
+  EXPECT_GT(GetTriangleCount(lods[0]), GetTriangleCount(lods[1]));
+  EXPECT_GT(GetTriangleCount(lods[1]), GetTriangleCount(lods[2]));
+
+  EXPECT_LT(0.0f, errors[0]);
+  EXPECT_LE(errors[0], errors[1]);
+  EXPECT_LE(errors[1], errors[2]);
+  EXPECT_GT(0.05f, errors[0]);
+  EXPECT_GT(1.0f, errors[2]); // A bound rather than the actual distance, but still less than the radius
+
+  // The LODs are ready to render
+  opengl::cGeometryOptimiser optimiser;
+  EXPECT_GT(1.0f, optimiser.GetACMR(lods[0]));
+}
+
+TEST(OpenGLGeometrySimplifier, TestOutputVerticesAreInputVertices)
+{
+  opengl::cGeometryData data;
+  opengl::cGeometryBuilder builder;
+  builder.CreateTeapot(1.0f, 8, data, 1);
+  const std::set<Point> original = GetPoints(data);
+
+  opengl::cGeometrySimplifier simplifier;
+  opengl::cGeometryData simplified;
+  float fError = 0.0f;
+  ASSERT_TRUE(simplifier.Simplify(data, GetTriangleCount(data) / 4, simplified, fError));
+  EXPECT_GT(GetTriangleCount(data), GetTriangleCount(simplified));
+
+  // Every vertex keeps its normal and texture coordinates, and none are left unused
+  const std::set<Point> points = GetPoints(simplified);
+  EXPECT_EQ(simplified.nVertexCount, points.size());
+  for (const Point& point : points) EXPECT_TRUE(original.find(point) != original.end());
+
+  std::vector<bool> used(simplified.nVertexCount, false);
+  for (uint16_t index : simplified.indices) used[index] = true;
+  for (size_t i = 0; i < used.size(); i++) EXPECT_TRUE(used[i]);
+}
+
+TEST(OpenGLGeometrySimplifier, TestSeamsAndBordersArePreserved)
+{
+  const size_t nCells = 10;
+  opengl::cGeometryData data;
+  CreateGridWithSeam(nCells, data);
+
+  opengl::cGeometrySimplifier simplifier;
+  opengl::cGeometryData simplified;
+  float fError = 1.0f;
+  ASSERT_TRUE(simplifier.Simplify(data, 0, simplified, fError));
+
+  // Flat so nothing moves off the surface
+  EXPECT_FLOAT_EQ(0.0f, fError);
+  EXPECT_GT(GetTriangleCount(data) / 3, GetTriangleCount(simplified));
+
+  // Every point on the outside and on both sides of the seam is still there, almost everything inside is gone
+  const std::set<Point> original = GetPoints(data);
+  const std::set<Point> points = GetPoints(simplified);
+  size_t nLocked = 0;
+  size_t nInside = 0;
+  for (const Point& point : original) {
+    const bool bBorder = (point[0] == 0.0f) || (point[0] == float(nCells)) || (point[2] == 0.0f) || (point[2] == float(nCells));
+    const bool bSeam = (point[0] == float(nCells / 2));
+    if (bBorder || bSeam) {
+      EXPECT_TRUE(points.find(point) != points.end()) << point[0] << ", " << point[2];
+      nLocked++;
+    } else if (points.find(point) != points.end()) nInside++;
+  }
+  EXPECT_EQ((4 * nCells) + (2 * (nCells + 1)) - 2, nLocked);
+  EXPECT_GE(size_t(4), nInside);
+}
+
+TEST(OpenGLGeometrySimplifier, TestMaximumError)
+{
+  opengl::cGeometryData data;
+  CreateUVSphere(40, data);
+
+  opengl::cGeometrySimplifier simplifier;
+  simplifier.SetMaximumError(0.01f);
+  opengl::cGeometryData simplified;
+  float fError = 0.0f;
+  ASSERT_TRUE(simplifier.Simplify(data, 0, simplified, fError));
+
+  EXPECT_GE(0.01f, fError);
+  EXPECT_LT(0.0f, fError);
+  EXPECT_GT(GetTriangleCount(data), GetTriangleCount(simplified));
+
+  // Simplifying further has to move the surface more
+  simplifier.SetMaximumError(0.1f);
+  opengl::cGeometryData simpler;
+  float fSimplerError = 0.0f;
+  ASSERT_TRUE(simplifier.Simplify(data, 0, simpler, fSimplerError));
+  EXPECT_LT(fError, fSimplerError);
+  EXPECT_GT(GetTriangleCount(simplified), GetTriangleCount(simpler));
+}
+
+TEST(OpenGLGeometrySimplifier, TestLODSwitchDistance)
+{
+  // With a 90 degree field of view the screen is twice the distance high
+  EXPECT_FLOAT_EQ(500.0f, opengl::GetLODSwitchDistance(1.0f, 90.0f, 1000, 1.0f));
+  EXPECT_FLOAT_EQ(250.0f, opengl::GetLODSwitchDistance(1.0f, 90.0f, 1000, 2.0f));
+  EXPECT_FLOAT_EQ(1000.0f, opengl::GetLODSwitchDistance(2.0f, 90.0f, 1000, 1.0f));
+  EXPECT_FLOAT_EQ(0.0f, opengl::GetLODSwitchDistance(0.0f, 60.0f, 1080, 1.0f));
+  EXPECT_LT(opengl::GetLODSwitchDistance(1.0f, 90.0f, 1000, 1.0f), opengl::GetLODSwitchDistance(1.0f, 60.0f, 1000, 1.0f));
+}
+
+TEST(BreatheStaticModelLOD, TestGenerateStaticModelLODs)
+{
+  breathe::render::model::cStaticModel model;
+  CreateSphereModel(model);
+  const breathe::render::model::cStaticModelMesh* pMesh = model.mesh[0];
+
+  breathe::render::model::cStaticModelLOD lods;
+  ASSERT_TRUE(breathe::render::model::GenerateStaticModelLODs(model, { 0.5f, 0.2f }, 60.0f, 1080, 1.0f, lods));
+  ASSERT_EQ(3, lods.lod.size());
+  ASSERT_EQ(3, lods.distances.size());
+
+  EXPECT_TRUE(pMesh->vertices == lods.lod[0]->mesh[0]->vertices);
+  EXPECT_FLOAT_EQ(0.0f, lods.distances[0]);
+  EXPECT_LT(lods.distances[0], lods.distances[1]);
+  EXPECT_LE(lods.distances[1], lods.distances[2]);
+
+  for (size_t i = 1; i < lods.lod.size(); i++) {
+    ASSERT_EQ(1, lods.lod[i]->mesh.size());
+    const breathe::render::model::cStaticModelMesh& mesh = *lods.lod[i]->mesh[0];
+    EXPECT_TRUE(mesh.sMaterial == TEXT("planet"));
+    EXPECT_TRUE(mesh.indices.empty());
+    EXPECT_EQ(0, mesh.vertices.size() % 9);
+    EXPECT_EQ(mesh.vertices.size(), mesh.normals.size());
+    EXPECT_EQ((mesh.vertices.size() / 3) * 2, mesh.textureCoordinates.size());
+    EXPECT_GT(lods.lod[i - 1]->mesh[0]->vertices.size(), mesh.vertices.size());
+  }
+}
+
+TEST(BreatheStaticModelLOD, TestCullLODs)
+{
+  breathe::render::model::cStaticModel model;
+  CreateSphereModel(model);
+
+  breathe::render::model::cStaticModelLOD lods;
+  ASSERT_TRUE(breathe::render::model::GenerateStaticModelLODs(model, { 0.5f, 0.2f }, 60.0f, 1080, 1.0f, lods));
+
+  // The levels are picked by distance the same way that cLODNode does
+  EXPECT_EQ(0, breathe::render::model::GetStaticModelLODLevel(lods.distances, 0.0f));
+  EXPECT_EQ(0, breathe::render::model::GetStaticModelLODLevel(lods.distances, 0.5f * lods.distances[1]));
+  EXPECT_EQ(1, breathe::render::model::GetStaticModelLODLevel(lods.distances, lods.distances[1]));
+  EXPECT_EQ(2, breathe::render::model::GetStaticModelLODLevel(lods.distances, 2.0f * lods.distances[2]));
+  EXPECT_EQ(0, breathe::render::model::GetStaticModelLODLevel({ 0.0f }, 1000.0f));
+
+  // The bounds of a cLODNode surround the unit sphere at every level
+  spitfire::math::cAABB3 local;
+  ASSERT_TRUE(breathe::render::model::GetStaticModelLODBoundingBox(lods, local));
+  EXPECT_NEAR(-1.0f, local.cornerMin.x, 0.001f);
+  EXPECT_NEAR(1.0f, local.cornerMax.x, 0.001f);
+  EXPECT_NEAR(-1.0f, local.cornerMin.z, 0.001f);
+  EXPECT_NEAR(1.0f, local.cornerMax.z, 0.001f);
+
+  breathe::render::model::cStaticModelLOD empty;
+  EXPECT_FALSE(breathe::render::model::GetStaticModelLODBoundingBox(empty, local));
+  ASSERT_TRUE(breathe::render::model::GetStaticModelLODBoundingBox(lods, local));
+
+  // Standing at the origin looking down the negative z axis
+  spitfire::math::cMat4 matView;
+  matView.SetLookAt(spitfire::math::cVec3(0.0f, 0.0f, 0.0f), spitfire::math::cVec3(0.0f, 0.0f, -1.0f), spitfire::math::cVec3(0.0f, 1.0f, 0.0f));
+  spitfire::math::cMat4 matProjection;
+  matProjection.SetPerspective(-1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 100.0f);
+  spitfire::math::cFrustumCuller culler;
+  culler.SetFromViewProjectionMatrix(matProjection * matView);
+
+  // The node is found while it is in front of the camera
+  spitfire::math::cMat4 matrix;
+  matrix.SetTranslation(0.0f, 0.0f, -20.0f);
+  spitfire::math::cDynamicAABBTree tree;
+  const size_t proxy = tree.CreateProxy(spitfire::math::GetTransformedAABB(local, matrix), &lods);
+  std::vector<void*> visible;
+  tree.Cull(culler, visible);
+  EXPECT_EQ(std::vector<void*>({ &lods }), visible);
+
+  // The origin is outside the frustum but the sphere still pokes into it
+  matrix.SetTranslation(-20.5f, 0.0f, -20.0f);
+  tree.MoveProxy(proxy, spitfire::math::GetTransformedAABB(local, matrix));
+  visible.clear();
+  tree.Cull(culler, visible);
+  EXPECT_EQ(std::vector<void*>({ &lods }), visible);
+
+  // Once it is moved behind the camera it is culled
+  matrix.SetTranslation(0.0f, 0.0f, 20.0f);
+  tree.MoveProxy(proxy, spitfire::math::GetTransformedAABB(local, matrix));
+  visible.clear();
+  tree.Cull(culler, visible);
+  EXPECT_TRUE(visible.empty());
+}
@@ -0,0 +1,209 @@
+// Standard headers
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/queue.h>
+#include <spitfire/util/thread.h>
+
+namespace {
+
+struct cQueueItem
+{
+  explicit cQueueItem(size_t _value) : value(_value) {}
+
+  size_t value;
+};
+
+template <class Q>
+void ProduceAndConsume(Q& queue, size_t nProducers, size_t nConsumers, size_t nItemsPerProducer, std::atomic<size_t>& total)
+{
+  const size_t nItems = nProducers * nItemsPerProducer;
+  std::atomic<size_t> consumed(0);
+
+  std::vector<std::thread> threads;
+
+  for (size_t p = 0; p < nProducers; p++) {
+    threads.push_back(std::thread([&queue, nItemsPerProducer]() {
+      for (size_t i = 0; i < nItemsPerProducer; i++) queue.AddItemToBack(new cQueueItem(i));
+    }));
+  }
+
+  for (size_t c = 0; c < nConsumers; c++) {
+    threads.push_back(std::thread([&queue, &consumed, &total, nItems]() {
+      std::vector<cQueueItem*> items;
+      items.reserve(64);
+      while (consumed.load() < nItems) {
+        items.clear();
+        const size_t nRemoved = queue.RemoveItemsFromFront(items, 64);
+        if (nRemoved == 0) {
+          spitfire::util::YieldThisThread();
+          continue;
+        }
+
+        for (auto pItem : items) {
+          total += pItem->value;
+          delete pItem;
+        }
+        consumed += nRemoved;
+      }
+    }));
+  }
+
+  for (auto& thread : threads) thread.join();
+}
+
+size_t GetExpectedTotal(size_t nProducers, size_t nItemsPerProducer)
+{
+  return nProducers * ((nItemsPerProducer * (nItemsPerProducer - 1)) / 2);
+}
+
+}
+
+TEST(SpitfireUtil, TestThreadSafeQueueBatch)
+{
+  spitfire::util::cSignalObject soAction(TEXT("TestThreadSafeQueueBatch_soAction"));
+  spitfire::util::cThreadSafeQueue<cQueueItem> queue(soAction);
+
+  for (size_t i = 0; i < 10; i++) queue.AddItemToBack(new cQueueItem(i));
+
+  std::vector<cQueueItem*> items;
+  EXPECT_EQ(4, queue.RemoveItemsFromFront(items, 4));
+  EXPECT_EQ(6, queue.RemoveItemsFromFront(items, 100));
+  EXPECT_EQ(0, queue.RemoveItemsFromFront(items, 100));
+
+  ASSERT_EQ(10, items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_EQ(i, items[i]->value);
+    delete items[i];
+  }
+}
+
+TEST(SpitfireUtil, TestLockFreeQueue)
+{
+  spitfire::util::cSignalObject soAction(TEXT("TestLockFreeQueue_soAction"));
+  spitfire::util::cLockFreeQueue<cQueueItem> queue(soAction, 5);
+
+  // The capacity is rounded up to a power of two
+  EXPECT_EQ(8, queue.GetCapacity());
+  EXPECT_TRUE(queue.IsEmpty());
+  EXPECT_TRUE(queue.RemoveItemFromFront() == nullptr);
+
+  // Fill the queue
+  for (size_t i = 0; i < 8; i++) EXPECT_TRUE(queue.TryAddItemToBack(new cQueueItem(i)));
+
+  // The queue is full
+  cQueueItem* pExtra = new cQueueItem(8);
+  EXPECT_FALSE(queue.TryAddItemToBack(pExtra));
+
+  // Items come out in the order they were added
+  cQueueItem* pItem = queue.RemoveItemFromFront();
+  ASSERT_TRUE(pItem != nullptr);
+  EXPECT_EQ(0, pItem->value);
+  delete pItem;
+
+  // Now there is room again
+  EXPECT_TRUE(queue.TryAddItemToBack(pExtra));
+
+  std::vector<cQueueItem*> items;
+  EXPECT_EQ(3, queue.RemoveItemsFromFront(items, 3));
+  EXPECT_EQ(5, queue.RemoveItemsFromFront(items, 100));
+  EXPECT_TRUE(queue.IsEmpty());
+
+  ASSERT_EQ(8, items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_EQ(i + 1, items[i]->value);
+    delete items[i];
+  }
+}
+
+TEST(SpitfireUtil, TestLockFreeQueueSignalCoalescing)
+{
+  spitfire::util::cSignalObject soAction(TEXT("TestLockFreeQueueSignalCoalescing_soAction"));
+  spitfire::util::cLockFreeQueue<cQueueItem> queue(soAction, 16);
+
+  // A burst of items only signals once
+  for (size_t i = 0; i < 4; i++) queue.AddItemToBack(new cQueueItem(i));
+  EXPECT_TRUE(soAction.IsSignalled());
+  soAction.Reset();
+
+  queue.AddItemToBack(new cQueueItem(4));
+  EXPECT_FALSE(soAction.IsSignalled());
+
+  // Draining the queue re-arms the signal
+  std::vector<cQueueItem*> items;
+  EXPECT_EQ(5, queue.RemoveItemsFromFront(items, 100));
+  for (auto pItem : items) delete pItem;
+  EXPECT_FALSE(soAction.IsSignalled());
+
+  queue.AddItemToBack(new cQueueItem(5));
+  EXPECT_TRUE(soAction.IsSignalled());
+
+  // Partially draining the queue signals again so that the rest of the items are not forgotten
+  queue.AddItemToBack(new cQueueItem(6));
+  soAction.Reset();
+  cQueueItem* pItem = queue.RemoveItemFromFront();
+  ASSERT_TRUE(pItem != nullptr);
+  delete pItem;
+  EXPECT_TRUE(soAction.IsSignalled());
+
+  pItem = queue.RemoveItemFromFront();
+  ASSERT_TRUE(pItem != nullptr);
+  delete pItem;
+}
+
+TEST(SpitfireUtil, TestLockFreeQueueMultipleProducersAndConsumers)
+{
+  spitfire::util::cSignalObject soAction(TEXT("TestLockFreeQueueMultipleProducersAndConsumers_soAction"));
+  spitfire::util::cLockFreeQueue<cQueueItem> queue(soAction, 256);
+
+  const size_t nProducers = 4;
+  const size_t nItemsPerProducer = 20000;
+  std::atomic<size_t> total(0);
+  ProduceAndConsume(queue, nProducers, 4, nItemsPerProducer, total);
+
+  EXPECT_TRUE(queue.IsEmpty());
+  EXPECT_EQ(GetExpectedTotal(nProducers, nItemsPerProducer), total.load());
+}
+
+TEST(SpitfireUtil, DISABLED_BenchmarkQueueContention)
+{
+  const size_t nItemsTotal = 200000;
+
+  for (size_t nThreads : { 1, 2, 4, 8, 16, 32 }) {
+    // Split the threads between producers and consumers, with at least one of each
+    const size_t nProducers = std::max<size_t>(1, nThreads / 2);
+    const size_t nConsumers = std::max<size_t>(1, nThreads - nProducers);
+    const size_t nItemsPerProducer = nItemsTotal / nProducers;
+
+    spitfire::util::cSignalObject soAction(TEXT("BenchmarkQueueContention_soAction"));
+
+    std::atomic<size_t> totalMutex(0);
+    const auto startMutex = std::chrono::high_resolution_clock::now();
+    {
+      spitfire::util::cThreadSafeQueue<cQueueItem> queue(soAction);
+      ProduceAndConsume(queue, nProducers, nConsumers, nItemsPerProducer, totalMutex);
+    }
+    const auto durationMutex = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startMutex);
+
+    std::atomic<size_t> totalLockFree(0);
+    const auto startLockFree = std::chrono::high_resolution_clock::now();
+    {
+      spitfire::util::cLockFreeQueue<cQueueItem> queue(soAction, 1024);
+      ProduceAndConsume(queue, nProducers, nConsumers, nItemsPerProducer, totalLockFree);
+    }
+    const auto durationLockFree = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startLockFree);
+
+    EXPECT_EQ(GetExpectedTotal(nProducers, nItemsPerProducer), totalMutex.load());
+    EXPECT_EQ(GetExpectedTotal(nProducers, nItemsPerProducer), totalLockFree.load());
+
+    std::cout<<"Queue threads="<<nThreads<<" producers="<<nProducers<<" consumers="<<nConsumers<<" items="<<(nProducers * nItemsPerProducer)
+      <<" cThreadSafeQueue="<<durationMutex.count()<<"us cLockFreeQueue="<<durationLockFree.count()<<"us"<<std::endl;
+  }
+}
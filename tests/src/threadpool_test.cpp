@@ -0,0 +1,127 @@
+// Standard headers
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/util/threadpool.h>
+
+TEST(SpitfireUtil, TestThreadPoolSubmit)
+{
+  spitfire::util::cThreadPool pool(4);
+  EXPECT_EQ(4, pool.GetThreadCount());
+  EXPECT_FALSE(pool.IsWorkerThread());
+
+  std::atomic<size_t> count(0);
+  std::vector<spitfire::util::cTaskHandle> tasks;
+  for (size_t i = 0; i < 1000; i++) tasks.push_back(pool.Submit([&count]() { count++; }));
+
+  for (auto& task : tasks) task.Wait();
+
+  EXPECT_EQ(1000, count.load());
+  for (auto& task : tasks) EXPECT_TRUE(task.IsDone());
+}
+
+TEST(SpitfireUtil, TestThreadPoolContinuations)
+{
+  spitfire::util::cThreadPool pool(2);
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto append = [&](int value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    order.push_back(value);
+  };
+
+  spitfire::util::cTaskHandle first = pool.Submit([&]() { spitfire::util::SleepThisThreadMS(20); append(1); });
+  spitfire::util::cTaskHandle second = first.Then([&]() { append(2); });
+  spitfire::util::cTaskHandle third = second.Then([&]() { append(3); });
+  third.Wait();
+
+  // A continuation on a task that is already done runs straight away
+  spitfire::util::cTaskHandle fourth = first.Then([&]() { append(4); });
+  fourth.Wait();
+
+  ASSERT_EQ(4, order.size());
+  EXPECT_EQ(std::vector<int>({ 1, 2, 3, 4 }), order);
+}
+
+TEST(SpitfireUtil, TestThreadPoolParallelFor)
+{
+  spitfire::util::cThreadPool pool(4);
+
+  for (size_t nGrainSize : { 1, 7, 64, 1000, 5000 }) {
+    std::vector<int> values(1000, 0);
+    spitfire::util::ParallelFor(pool, 0, values.size(), nGrainSize, [&](size_t first, size_t last) {
+      EXPECT_LE(last - first, nGrainSize);
+      for (size_t i = first; i < last; i++) values[i]++;
+    });
+
+    // Every item was visited exactly once
+    for (auto value : values) ASSERT_EQ(1, value);
+  }
+
+  // An empty range does nothing
+  spitfire::util::ParallelFor(pool, 10, 10, 1, [](size_t, size_t) { FAIL(); });
+}
+
+TEST(SpitfireUtil, TestThreadPoolNestedParallelFor)
+{
+  spitfire::util::cThreadPool pool(2);
+
+  // Waiting inside a worker runs other tasks instead of blocking, so nesting does not deadlock even with a small pool
+  std::atomic<size_t> count(0);
+  spitfire::util::ParallelFor(pool, 0, 16, 1, [&](size_t, size_t) {
+    EXPECT_TRUE(true);
+    spitfire::util::ParallelFor(pool, 0, 100, 10, [&](size_t first, size_t last) { count += (last - first); });
+  });
+
+  EXPECT_EQ(1600, count.load());
+}
+
+TEST(SpitfireUtil, TestThreadPoolParallelReduce)
+{
+  spitfire::util::cThreadPool pool(4);
+
+  const uint64_t total = spitfire::util::ParallelReduce(pool, 1, 100001, 1000, uint64_t(0),
+    [](size_t first, size_t last) { uint64_t sum = 0; for (size_t i = first; i < last; i++) sum += i; return sum; },
+    [](uint64_t lhs, uint64_t rhs) { return lhs + rhs; }
+  );
+  EXPECT_EQ(uint64_t(5000050000), total);
+
+  // Results are combined in order so floating point sums are reproducible
+  auto sumSquareRoots = [&](spitfire::util::cThreadPool& p) {
+    return spitfire::util::ParallelReduce(p, 0, 100000, 333, 0.0f,
+      [](size_t first, size_t last) { float sum = 0.0f; for (size_t i = first; i < last; i++) sum += std::sqrt(float(i)); return sum; },
+      [](float lhs, float rhs) { return lhs + rhs; }
+    );
+  };
+  spitfire::util::cThreadPool poolSingle(1);
+  EXPECT_EQ(sumSquareRoots(poolSingle), sumSquareRoots(pool));
+}
+
+TEST(SpitfireUtil, DISABLED_BenchmarkThreadPoolParallelFor)
+{
+  const size_t n = 4000000;
+  std::vector<float> values(n, 1.0f);
+
+  for (size_t nThreads : { 1, 2, 4, 8 }) {
+    spitfire::util::cThreadPool pool(nThreads);
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (size_t iteration = 0; iteration < 10; iteration++) {
+      spitfire::util::ParallelFor(pool, 0, n, 16384, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) values[i] = std::sqrt(values[i] * 1.0001f + 0.5f);
+      });
+    }
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+
+    std::cout<<"ParallelFor threads="<<nThreads<<" items="<<n<<" iterations=10 time="<<duration.count()<<"us"<<std::endl;
+  }
+}
@@ -0,0 +1,347 @@
+// Standard headers
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/file.h>
+#include <spitfire/storage/filesystem.h>
+
+// libvoodoomm headers
+#include <libvoodoomm/hdr.h>
+
+namespace {
+
+// The loader that LoadHDR used before cHDRDecoder, it reads the file a character at a time
+
+typedef unsigned char RGBE[4];
+
+bool ReferenceOldDecrunch(RGBE* scanline, int len, FILE* file)
+{
+  int rshift = 0;
+
+  while (len > 0) {
+    scanline[0][0] = fgetc(file);
+    scanline[0][1] = fgetc(file);
+    scanline[0][2] = fgetc(file);
+    scanline[0][3] = fgetc(file);
+    if (feof(file)) return false;
+
+    if ((scanline[0][0] == 1) && (scanline[0][1] == 1) && (scanline[0][2] == 1)) {
+      for (int i = scanline[0][3] << rshift; i > 0; i--) {
+        memcpy(&scanline[0][0], &scanline[-1][0], 4);
+        scanline++;
+        len--;
+      }
+      rshift += 8;
+    } else {
+      scanline++;
+      len--;
+      rshift = 0;
+    }
+  }
+  return true;
+}
+
+bool ReferenceDecrunch(RGBE* scanline, int len, FILE* file)
+{
+  if ((len < 8) || (len > 0x7fff)) return ReferenceOldDecrunch(scanline, len, file);
+
+  int i = fgetc(file);
+  if (i != 2) {
+    fseek(file, -1, SEEK_CUR);
+    return ReferenceOldDecrunch(scanline, len, file);
+  }
+
+  scanline[0][1] = fgetc(file);
+  scanline[0][2] = fgetc(file);
+  i = fgetc(file);
+
+  if ((scanline[0][1] != 2) || (scanline[0][2] & 128)) {
+    scanline[0][0] = 2;
+    scanline[0][3] = i;
+    return ReferenceOldDecrunch(scanline + 1, len - 1, file);
+  }
+
+  for (i = 0; i < 4; i++) {
+    for (int j = 0; j < len; ) {
+      unsigned char code = fgetc(file);
+      if (code > 128) {
+        code &= 127;
+        const unsigned char val = fgetc(file);
+        while (code--) scanline[j++][i] = val;
+      } else {
+        while (code--) scanline[j++][i] = fgetc(file);
+      }
+    }
+  }
+
+  return !feof(file);
+}
+
+bool ReferenceLoadHDR(const std::string& sFilePath, size_t& width, size_t& height, std::vector<float>& cols)
+{
+  FILE* file = fopen(sFilePath.c_str(), "rb");
+  if (file == nullptr) return false;
+
+  char str[10];
+  if ((fread(str, 10, 1, file) != 1) || (memcmp(str, "#?RADIANCE", 10) != 0)) {
+    fclose(file);
+    return false;
+  }
+
+  fseek(file, 1, SEEK_CUR);
+
+  char c = 0;
+  char oldc = 0;
+  while (true) {
+    oldc = c;
+    c = fgetc(file);
+    if ((c == 0xa) && (oldc == 0xa)) break;
+  }
+
+  char reso[200];
+  int i = 0;
+  while (true) {
+    c = fgetc(file);
+    reso[i++] = c;
+    if (c == 0xa) break;
+  }
+  reso[i] = 0;
+
+  int w = 0;
+  int h = 0;
+  if (sscanf(reso, "-Y %d +X %d", &h, &w) != 2) {
+    fclose(file);
+    return false;
+  }
+
+  width = size_t(w);
+  height = size_t(h);
+  cols.resize(width * height * 3);
+
+  std::vector<RGBE> scanline(width);
+  for (int y = 0; y < h; y++) {
+    if (!ReferenceDecrunch(scanline.data(), w, file)) break;
+    for (int x = 0; x < w; x++) {
+      const float d = float(pow(2, int(scanline[x][3]) - 128));
+      for (size_t j = 0; j < 3; j++) cols[(((y * w) + x) * 3) + j] = (scanline[x][3] == 0) ? 0.0f : ((scanline[x][j] / 256.0f) * d);
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+// A mix of smooth gradients which run length encode well, noise that doesn't, black and some very bright and very dim pixels
+std::vector<float> CreateTestImage(size_t width, size_t height)
+{
+  std::vector<float> cols(width * height * 3);
+  uint32_t seed = 1234;
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      float* p = &cols[((y * width) + x) * 3];
+      seed = (seed * 1103515245) + 12345;
+      if (x < (width / 4)) {
+        p[0] = p[1] = p[2] = 0.0f;
+      } else if (x < (width / 2)) {
+        p[0] = float(x) / float(width);
+        p[1] = float(y) / float(height);
+        p[2] = 0.25f;
+      } else if ((y % 7) == 0) {
+        p[0] = 1000.0f * float(x);
+        p[1] = 1e-20f;
+        p[2] = 3.0f;
+      } else {
+        p[0] = float(seed >> 16) / 4096.0f;
+        p[1] = float((seed >> 8) & 0xFF) / 256.0f;
+        p[2] = float(seed & 0xFF) * 0.001f;
+      }
+    }
+  }
+  return cols;
+}
+
+void ExpectClose(const std::vector<float>& expected, const std::vector<float>& actual)
+{
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i += 3) {
+    // RGBE keeps 8 bits of precision relative to the brightest channel of each pixel
+    const float fTolerance = std::max(expected[i], std::max(expected[i + 1], expected[i + 2])) / 128.0f;
+    for (size_t j = 0; j < 3; j++) ASSERT_NEAR(expected[i + j], actual[i + j], fTolerance) << i / 3;
+  }
+}
+
+}
+
+TEST(Voodoo, TestHDRSaveAndLoad)
+{
+  const std::string sFilePath = "voodoo_hdr_test.hdr";
+
+  for (size_t width : { 1, 7, 8, 300 }) {
+    const size_t height = 37;
+    const std::vector<float> original = CreateTestImage(width, height);
+    ASSERT_TRUE(voodoo::SaveHDR(sFilePath, original.data(), width, height));
+
+    voodoo::cHDRDecoder decoder;
+    ASSERT_TRUE(decoder.Open(sFilePath));
+    ASSERT_EQ(width, decoder.GetWidth());
+    ASSERT_EQ(height, decoder.GetHeight());
+
+    std::vector<float> decoded(width * height * 3);
+    ASSERT_TRUE(decoder.DecodeRGB32F(decoded.data()));
+    ExpectClose(original, decoded);
+
+    // The old loader reads exactly the same values
+    size_t referenceWidth = 0;
+    size_t referenceHeight = 0;
+    std::vector<float> reference;
+    ASSERT_TRUE(ReferenceLoadHDR(sFilePath, referenceWidth, referenceHeight, reference));
+    ASSERT_EQ(width, referenceWidth);
+    ASSERT_EQ(height, referenceHeight);
+    ASSERT_TRUE(reference == decoded) << width;
+
+    decoder.Close();
+  }
+
+  spitfire::filesystem::DeleteFile(TEXT("voodoo_hdr_test.hdr"));
+}
+
+TEST(Voodoo, TestHDRDecodeFlatAndOldRunLengthEncoding)
+{
+  // 3 rows of 9 pixels from the bottom up, the first row is flat, the second uses the old run length encoding and the third is flat with a first pixel that looks like the start of the new encoding
+  std::string sData = "#?RGBE\n# A comment\n\n+Y 3 +X 9\n";
+  for (size_t x = 0; x < 9; x++) sData += std::string({ char(x), char(2 * x), char(3 * x), char(128 + 1) });
+  sData += std::string({ 10, 20, 30, char(128) });
+  sData += std::string({ 1, 1, 1, 3 });
+  sData += std::string({ 40, 50, 60, char(129) });
+  sData += std::string({ 1, 1, 1, 4 });
+  sData += std::string({ 2, 2, char(0x80), char(130) });
+  for (size_t x = 1; x < 9; x++) sData += std::string({ 64, 64, 64, char(127) });
+
+  voodoo::cHDRDecoder decoder;
+  ASSERT_TRUE(decoder.OpenFromMemory(reinterpret_cast<const uint8_t*>(sData.data()), sData.size()));
+  ASSERT_EQ(9, decoder.GetWidth());
+  ASSERT_EQ(3, decoder.GetHeight());
+
+  std::vector<float> decoded(9 * 3 * 3);
+  ASSERT_TRUE(decoder.DecodeRGB32F(decoded.data()));
+
+  // The top row is the last one in the file
+  EXPECT_FLOAT_EQ(2.0f / 64.0f, decoded[0]);
+  EXPECT_FLOAT_EQ(2.0f / 64.0f, decoded[1]);
+  EXPECT_FLOAT_EQ(128.0f / 64.0f, decoded[2]);
+  EXPECT_FLOAT_EQ(64.0f / 512.0f, decoded[3]);
+  EXPECT_FLOAT_EQ(64.0f / 512.0f, decoded[26]);
+
+  const float* pMiddle = &decoded[9 * 3];
+  for (size_t x = 0; x < 4; x++) EXPECT_FLOAT_EQ(10.0f / 256.0f, pMiddle[x * 3]);
+  for (size_t x = 4; x < 9; x++) EXPECT_FLOAT_EQ(60.0f / 128.0f, pMiddle[(x * 3) + 2]);
+
+  const float* pBottom = &decoded[2 * 9 * 3];
+  for (size_t x = 0; x < 9; x++) {
+    EXPECT_FLOAT_EQ(float(x) / 128.0f, pBottom[x * 3]);
+    EXPECT_FLOAT_EQ(float(3 * x) / 128.0f, pBottom[(x * 3) + 2]);
+  }
+
+  // Truncated files, bad dimensions and other formats are rejected
+  for (size_t length : { size_t(0), size_t(10), size_t(29), sData.size() - 1 }) EXPECT_FALSE(decoder.OpenFromMemory(reinterpret_cast<const uint8_t*>(sData.data()), length)) << length;
+  EXPECT_FALSE(decoder.IsOpen());
+
+  const std::string sXYZE = "#?RADIANCE\nFORMAT=32-bit_rle_xyze\n\n-Y 1 +X 1\n\x01\x02\x03\x80";
+  EXPECT_FALSE(decoder.OpenFromMemory(reinterpret_cast<const uint8_t*>(sXYZE.data()), sXYZE.size()));
+  const std::string sFlipped = "#?RADIANCE\n\n-Y 1 -X 1\n\x01\x02\x03\x80";
+  EXPECT_FALSE(decoder.OpenFromMemory(reinterpret_cast<const uint8_t*>(sFlipped.data()), sFlipped.size()));
+
+  // Old run length encoding with so many repeats in a row that the count would be shifted past the width of the count
+  std::string sLongRun = "#?RGBE\n\n+Y 1 +X 2\n";
+  sLongRun += std::string({ 10, 20, 30, char(128) });
+  for (size_t i = 0; i < 10; i++) sLongRun += std::string({ 1, 1, 1, 0 });
+  sLongRun += std::string({ 10, 20, 30, char(128) });
+  EXPECT_FALSE(decoder.OpenFromMemory(reinterpret_cast<const uint8_t*>(sLongRun.data()), sLongRun.size()));
+}
+
+TEST(Voodoo, TestHDRDecodeRows)
+{
+  const std::string sFilePath = "voodoo_hdr_test_rows.hdr";
+  const size_t width = 100;
+  const size_t height = 45;
+  const std::vector<float> original = CreateTestImage(width, height);
+  ASSERT_TRUE(voodoo::SaveHDR(sFilePath, original.data(), width, height));
+
+  voodoo::cHDRDecoder decoder;
+  ASSERT_TRUE(decoder.Open(sFilePath));
+
+  std::vector<float> decoded(width * height * 3);
+  ASSERT_TRUE(decoder.DecodeRGB32F(decoded.data()));
+
+  for (size_t nRowsPerBlock : { 1, 7, 45, 1000 }) {
+    std::vector<float> streamed;
+    size_t nExpectedY = 0;
+    EXPECT_TRUE(decoder.DecodeRows(nRowsPerBlock, [&](size_t y, size_t nRows, const float* pRGB) {
+      EXPECT_EQ(nExpectedY, y);
+      EXPECT_LE(nRows, nRowsPerBlock);
+      streamed.insert(streamed.end(), pRGB, pRGB + (nRows * width * 3));
+      nExpectedY += nRows;
+      return true;
+    }));
+    EXPECT_TRUE(streamed == decoded) << nRowsPerBlock;
+  }
+
+  // Returning false stops decoding
+  size_t nCalls = 0;
+  EXPECT_FALSE(decoder.DecodeRows(10, [&](size_t, size_t, const float*) {
+    nCalls++;
+    return (nCalls < 2);
+  }));
+  EXPECT_EQ(2, nCalls);
+
+  decoder.Close();
+  spitfire::filesystem::DeleteFile(TEXT("voodoo_hdr_test_rows.hdr"));
+}
+
+TEST(Voodoo, DISABLED_BenchmarkHDR)
+{
+  const std::string sFilePath = "voodoo_hdr_benchmark.hdr";
+  const size_t width = 4096;
+  const size_t height = 2048;
+  const std::vector<float> original = CreateTestImage(width, height);
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(voodoo::SaveHDR(sFilePath, original.data(), width, height));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"SaveHDR "<<width<<"x"<<height<<" time="<<fDurationMS<<"ms"<<std::endl;
+  }
+
+  std::vector<float> reference;
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    size_t referenceWidth = 0;
+    size_t referenceHeight = 0;
+    ASSERT_TRUE(ReferenceLoadHDR(sFilePath, referenceWidth, referenceHeight, reference));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"Old LoadHDR "<<width<<"x"<<height<<" time="<<fDurationMS<<"ms"<<std::endl;
+  }
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    voodoo::cHDRDecoder decoder;
+    ASSERT_TRUE(decoder.Open(sFilePath));
+    std::vector<float> decoded(width * height * 3);
+    ASSERT_TRUE(decoder.DecodeRGB32F(decoded.data()));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout<<"cHDRDecoder "<<width<<"x"<<height<<" time="<<fDurationMS<<"ms"<<std::endl;
+
+    EXPECT_TRUE(reference == decoded);
+  }
+
+  spitfire::filesystem::DeleteFile(TEXT("voodoo_hdr_benchmark.hdr"));
+}
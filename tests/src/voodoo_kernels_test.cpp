@@ -0,0 +1,374 @@
+// Standard headers
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// libvoodoomm headers
+#include <libvoodoomm/kernels.h>
+
+namespace {
+
+// Scalar versions of the kernels, these are the loops that cImage used before the kernels were added, extended to
+// support the same formats
+
+void ReferenceConvertToNegative(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels)
+{
+  const size_t n = width * height * nChannels;
+  for (size_t i = 0; i < n; i += nChannels) {
+    for (size_t c = 0; c < std::min<size_t>(nChannels, 3); c++) pBuffer[i + c] = 255 - pBuffer[i + c];
+  }
+}
+
+void ReferenceConvertToGreyScale(uint8_t* pBuffer, size_t width, size_t height, size_t nChannels)
+{
+  if (nChannels == 1) return;
+
+  const size_t n = width * height * nChannels;
+  for (size_t i = 0; i < n; i += nChannels) {
+    const uint8_t y = uint8_t(((77 * pBuffer[i]) + (150 * pBuffer[i + 1]) + (29 * pBuffer[i + 2]) + 128) >> 8);
+    pBuffer[i] = y;
+    pBuffer[i + 1] = y;
+    pBuffer[i + 2] = y;
+  }
+}
+
+void ReferenceFlipVertically(std::vector<uint8_t>& buffer, size_t nBytesPerRow, size_t height)
+{
+  std::vector<uint8_t> tempBuffer(nBytesPerRow);
+  const size_t halfHeight = height / 2;
+  for (size_t y = 0; y < halfHeight; y++) {
+    std::memcpy(&tempBuffer[0], &buffer[(nBytesPerRow * (height - 1)) - (y * nBytesPerRow)], nBytesPerRow);
+    std::memcpy(&buffer[(nBytesPerRow * (height - 1)) - (y * nBytesPerRow)], &buffer[(y * nBytesPerRow)], nBytesPerRow);
+    std::memcpy(&buffer[(y * nBytesPerRow)], &tempBuffer[0], nBytesPerRow);
+  }
+}
+
+// The old half size skipped every second pixel
+void ReferenceHalfSizeSkip(const uint8_t* pSource, size_t widthSource, size_t heightSource, uint8_t* pDestination)
+{
+  const size_t widthDestination = widthSource / 2;
+  const size_t heightDestination = heightSource / 2;
+  for (size_t y = 0; y < heightDestination; y++) {
+    for (size_t x = 0; x < widthDestination; x++) {
+      const size_t indexSource = (((2 * y) * (2 * widthDestination)) + (2 * x)) * 4;
+      const size_t indexDestination = ((y * widthDestination) + x) * 4;
+      pDestination[indexDestination] = pSource[indexSource];
+      pDestination[indexDestination + 1] = pSource[indexSource + 1];
+      pDestination[indexDestination + 2] = pSource[indexSource + 2];
+      pDestination[indexDestination + 3] = pSource[indexSource + 3];
+    }
+  }
+}
+
+void ReferenceHalfSizeAverage(const uint8_t* pSource, size_t widthSource, size_t heightSource, size_t nChannels, uint8_t* pDestination)
+{
+  const size_t widthDestination = std::max<size_t>(1, widthSource / 2);
+  const size_t heightDestination = std::max<size_t>(1, heightSource / 2);
+  for (size_t y = 0; y < heightDestination; y++) {
+    const size_t y0 = 2 * y;
+    const size_t y1 = std::min(y0 + 1, heightSource - 1);
+    for (size_t x = 0; x < widthDestination; x++) {
+      const size_t x0 = 2 * x;
+      const size_t x1 = std::min(x0 + 1, widthSource - 1);
+      for (size_t c = 0; c < nChannels; c++) {
+        const size_t sum = pSource[(((y0 * widthSource) + x0) * nChannels) + c] + pSource[(((y0 * widthSource) + x1) * nChannels) + c] +
+          pSource[(((y1 * widthSource) + x0) * nChannels) + c] + pSource[(((y1 * widthSource) + x1) * nChannels) + c];
+        pDestination[(((y * widthDestination) + x) * nChannels) + c] = uint8_t((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// The old nearest neighbour resize only supported whole number scaling factors
+void ReferenceResizeNearestNeighbour(const uint8_t* pSource, size_t widthSource, size_t heightSource, uint8_t* pDestination, size_t widthDestination, size_t heightDestination)
+{
+  const size_t scalingFactorHorizontal = std::max<size_t>(1, widthSource / widthDestination);
+  const size_t scalingFactorVertical = std::max<size_t>(1, heightSource / heightDestination);
+  for (size_t y = 0; y < heightDestination; y++) {
+    for (size_t x = 0; x < widthDestination; x++) {
+      const size_t indexSource = (((y * scalingFactorVertical) * widthSource) + (x * scalingFactorHorizontal)) * 4;
+      const size_t indexDestination = ((y * widthDestination) + x) * 4;
+      pDestination[indexDestination] = pSource[indexSource];
+      pDestination[indexDestination + 1] = pSource[indexSource + 1];
+      pDestination[indexDestination + 2] = pSource[indexSource + 2];
+      pDestination[indexDestination + 3] = pSource[indexSource + 3];
+    }
+  }
+}
+
+void ReferenceSmooth(std::vector<uint8_t>& buffer, size_t width, size_t height, size_t nChannels, size_t iterations)
+{
+  std::vector<uint8_t> source;
+  for (size_t i = 0; i < iterations; i++) {
+    source = buffer;
+    for (size_t y = 0; y < height; y++) {
+      for (size_t x = 0; x < width; x++) {
+        for (size_t c = 0; c < nChannels; c++) {
+          auto Get = [&](size_t _x, size_t _y) { return size_t(source[(((_y * width) + _x) * nChannels) + c]); };
+          const size_t centre = Get(x, y);
+          const size_t left = (x != 0) ? Get(x - 1, y) : centre;
+          const size_t right = ((x + 1) < width) ? Get(x + 1, y) : centre;
+          const size_t up = (y != 0) ? Get(x, y - 1) : centre;
+          const size_t down = ((y + 1) < height) ? Get(x, y + 1) : centre;
+          buffer[(((y * width) + x) * nChannels) + c] = uint8_t((left + right + up + down + 2) / 4);
+        }
+      }
+    }
+  }
+}
+
+std::vector<uint8_t> CreateRandomImage(size_t width, size_t height, size_t nChannels)
+{
+  std::vector<uint8_t> buffer(width * height * nChannels);
+  uint32_t seed = 1234;
+  for (auto& value : buffer) {
+    seed = (seed * 1664525) + 1013904223;
+    value = uint8_t(seed >> 24);
+  }
+  return buffer;
+}
+
+double GetMilliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+  return 1000.0 * std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+}
+
+TEST(Voodoo, TestKernelsMatchScalar)
+{
+  // Odd sizes so that the SIMD loops have tails
+  const size_t sizes[][2] = { { 1, 1 }, { 2, 3 }, { 17, 5 }, { 64, 64 }, { 101, 37 } };
+
+  for (size_t nChannels : { 1, 3, 4 }) {
+    for (auto& size : sizes) {
+      const size_t width = size[0];
+      const size_t height = size[1];
+      const std::vector<uint8_t> original = CreateRandomImage(width, height, nChannels);
+
+      {
+        std::vector<uint8_t> expected = original;
+        ReferenceConvertToNegative(expected.data(), width, height, nChannels);
+        std::vector<uint8_t> actual = original;
+        voodoo::kernels::ConvertToNegative(actual.data(), width, height, nChannels);
+        EXPECT_TRUE(expected == actual) << "negative " << width << "x" << height << "x" << nChannels;
+      }
+
+      {
+        std::vector<uint8_t> expected = original;
+        ReferenceConvertToGreyScale(expected.data(), width, height, nChannels);
+        std::vector<uint8_t> actual = original;
+        voodoo::kernels::ConvertToGreyScale(actual.data(), width, height, nChannels);
+        EXPECT_TRUE(expected == actual) << "grey " << width << "x" << height << "x" << nChannels;
+      }
+
+      {
+        std::vector<uint8_t> expected = original;
+        ReferenceFlipVertically(expected, width * nChannels, height);
+        std::vector<uint8_t> actual = original;
+        voodoo::kernels::FlipVertically(actual.data(), width * nChannels, height);
+        EXPECT_TRUE(expected == actual) << "flip " << width << "x" << height << "x" << nChannels;
+      }
+
+      {
+        const size_t n = std::max<size_t>(1, width / 2) * std::max<size_t>(1, height / 2) * nChannels;
+        std::vector<uint8_t> expected(n);
+        ReferenceHalfSizeAverage(original.data(), width, height, nChannels, expected.data());
+        std::vector<uint8_t> actual(n);
+        voodoo::kernels::HalfSize(original.data(), width, height, nChannels, actual.data());
+        EXPECT_TRUE(expected == actual) << "half " << width << "x" << height << "x" << nChannels;
+      }
+
+      {
+        std::vector<uint8_t> expected = original;
+        ReferenceSmooth(expected, width, height, nChannels, 3);
+        std::vector<uint8_t> actual = original;
+        voodoo::kernels::Smooth(actual.data(), width, height, nChannels, 3);
+        EXPECT_TRUE(expected == actual) << "smooth " << width << "x" << height << "x" << nChannels;
+      }
+    }
+  }
+}
+
+TEST(Voodoo, TestKernelsResize)
+{
+  for (size_t nChannels : { 1, 3, 4 }) {
+    const size_t width = 37;
+    const size_t height = 23;
+    const std::vector<uint8_t> original = CreateRandomImage(width, height, nChannels);
+
+    for (auto filter : { voodoo::RESIZE_FILTER::BOX, voodoo::RESIZE_FILTER::BILINEAR, voodoo::RESIZE_FILTER::LANCZOS3 }) {
+      // The same size is a copy
+      std::vector<uint8_t> same(original.size());
+      voodoo::kernels::Resize(original.data(), width, height, nChannels, same.data(), width, height, filter);
+      EXPECT_TRUE(original == same);
+
+      // A flat colour stays the same colour at any size
+      const std::vector<uint8_t> flat(width * height * nChannels, 200);
+      for (size_t newSize : { 1, 5, 16, 50, 111 }) {
+        std::vector<uint8_t> resized(newSize * newSize * nChannels, 0);
+        voodoo::kernels::Resize(flat.data(), width, height, nChannels, resized.data(), newSize, newSize, filter);
+        for (auto value : resized) ASSERT_EQ(200, value);
+      }
+    }
+
+    // A box filter to half size is the same as averaging each 2x2 block, apart from rounding
+    const size_t evenWidth = 36;
+    const size_t evenHeight = 22;
+    const std::vector<uint8_t> even = CreateRandomImage(evenWidth, evenHeight, nChannels);
+    std::vector<uint8_t> half((evenWidth / 2) * (evenHeight / 2) * nChannels);
+    voodoo::kernels::HalfSize(even.data(), evenWidth, evenHeight, nChannels, half.data());
+    std::vector<uint8_t> box(half.size());
+    voodoo::kernels::Resize(even.data(), evenWidth, evenHeight, nChannels, box.data(), evenWidth / 2, evenHeight / 2, voodoo::RESIZE_FILTER::BOX);
+    for (size_t i = 0; i < half.size(); i++) ASSERT_NEAR(int(half[i]), int(box[i]), 1);
+  }
+
+  // Nearest neighbour picks the pixel under the centre of each destination pixel
+  const uint8_t source[] = { 10, 20, 30, 40 };
+  uint8_t destination[8] = { 0 };
+  voodoo::kernels::ResizeNearestNeighbour(source, 4, 1, 1, destination, 8, 1);
+  const uint8_t expected[] = { 10, 10, 20, 20, 30, 30, 40, 40 };
+  EXPECT_EQ(0, memcmp(expected, destination, sizeof(expected)));
+}
+
+TEST(Voodoo, TestKernelsCopyAndExtrudeEdges)
+{
+  // A 5x3 image in a 13x11 page, like an atlas entry with padding around it
+  const size_t width = 5;
+  const size_t height = 3;
+  const size_t widthPage = 13;
+  const size_t heightPage = 11;
+  const size_t x = 4;
+  const size_t y = 3;
+
+  for (size_t nBytesPerPixel : { 1, 3, 4 }) {
+    const std::vector<uint8_t> image = CreateRandomImage(width, height, nBytesPerPixel);
+
+    for (size_t nExtrudePixels : { 0, 1, 3 }) {
+      std::vector<uint8_t> page(widthPage * heightPage * nBytesPerPixel, 0xcd);
+      voodoo::kernels::CopyAndExtrudeEdges(image.data(), width, height, nBytesPerPixel, page.data(), widthPage, heightPage, x, y, nExtrudePixels);
+
+      for (size_t py = 0; py < heightPage; py++) {
+        for (size_t px = 0; px < widthPage; px++) {
+          const bool bIsInside = ((px + nExtrudePixels) >= x) && (px < (x + width + nExtrudePixels)) && ((py + nExtrudePixels) >= y) && (py < (y + height + nExtrudePixels));
+          for (size_t c = 0; c < nBytesPerPixel; c++) {
+            const uint8_t value = page[(((py * widthPage) + px) * nBytesPerPixel) + c];
+            if (!bIsInside) {
+              // Everything outside the image and its padding is left alone
+              ASSERT_EQ(0xcd, value) << px << "," << py;
+            } else {
+              // The padding is the nearest edge pixel of the image, the corners are the corner pixels
+              const size_t ix = std::min(std::max(px, x), x + width - 1) - x;
+              const size_t iy = std::min(std::max(py, y), y + height - 1) - y;
+              ASSERT_EQ(image[(((iy * width) + ix) * nBytesPerPixel) + c], value) << px << "," << py;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Voodoo, DISABLED_BenchmarkKernels)
+{
+  const size_t width = 2048;
+  const size_t height = 2048;
+
+  for (size_t nChannels : { 1, 3, 4 }) {
+    const std::vector<uint8_t> original = CreateRandomImage(width, height, nChannels);
+    std::vector<uint8_t> buffer = original;
+    std::vector<uint8_t> destination(width * height * nChannels);
+
+    std::cout<<"Voodoo kernels "<<width<<"x"<<height<<"x"<<nChannels<<std::endl;
+
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+      ReferenceConvertToNegative(buffer.data(), width, height, nChannels);
+      const double fScalar = GetMilliseconds(start);
+      start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::ConvertToNegative(buffer.data(), width, height, nChannels);
+      const double fKernel = GetMilliseconds(start);
+      EXPECT_TRUE(buffer == original);
+      std::cout<<"  ConvertToNegative scalar="<<fScalar<<"ms kernel="<<fKernel<<"ms"<<std::endl;
+    }
+
+    {
+      buffer = original;
+      auto start = std::chrono::high_resolution_clock::now();
+      ReferenceConvertToGreyScale(buffer.data(), width, height, nChannels);
+      const double fScalar = GetMilliseconds(start);
+      buffer = original;
+      start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::ConvertToGreyScale(buffer.data(), width, height, nChannels);
+      const double fKernel = GetMilliseconds(start);
+      std::cout<<"  ConvertToGreyScale scalar="<<fScalar<<"ms kernel="<<fKernel<<"ms"<<std::endl;
+    }
+
+    {
+      buffer = original;
+      auto start = std::chrono::high_resolution_clock::now();
+      ReferenceFlipVertically(buffer, width * nChannels, height);
+      const double fScalar = GetMilliseconds(start);
+      start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::FlipVertically(buffer.data(), width * nChannels, height);
+      const double fKernel = GetMilliseconds(start);
+      EXPECT_TRUE(buffer == original);
+      std::cout<<"  FlipVertically scalar="<<fScalar<<"ms kernel="<<fKernel<<"ms"<<std::endl;
+    }
+
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+      ReferenceHalfSizeAverage(original.data(), width, height, nChannels, destination.data());
+      const double fScalar = GetMilliseconds(start);
+      double fScalarSkip = 0.0;
+      if (nChannels == 4) {
+        start = std::chrono::high_resolution_clock::now();
+        ReferenceHalfSizeSkip(original.data(), width, height, destination.data());
+        fScalarSkip = GetMilliseconds(start);
+      }
+      start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::HalfSize(original.data(), width, height, nChannels, destination.data());
+      const double fKernel = GetMilliseconds(start);
+      std::cout<<"  HalfSize scalar average="<<fScalar<<"ms";
+      if (nChannels == 4) std::cout<<" old scalar skip="<<fScalarSkip<<"ms";
+      std::cout<<" kernel="<<fKernel<<"ms"<<std::endl;
+    }
+
+    {
+      buffer = original;
+      auto start = std::chrono::high_resolution_clock::now();
+      ReferenceSmooth(buffer, width, height, nChannels, 1);
+      const double fScalar = GetMilliseconds(start);
+      buffer = original;
+      start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::Smooth(buffer.data(), width, height, nChannels, 1);
+      const double fKernel = GetMilliseconds(start);
+      std::cout<<"  Smooth scalar="<<fScalar<<"ms kernel="<<fKernel<<"ms"<<std::endl;
+    }
+
+    if (nChannels == 4) {
+      auto start = std::chrono::high_resolution_clock::now();
+      ReferenceResizeNearestNeighbour(original.data(), width, height, destination.data(), 1000, 1000);
+      const double fScalar = GetMilliseconds(start);
+      start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::ResizeNearestNeighbour(original.data(), width, height, nChannels, destination.data(), 1000, 1000);
+      const double fKernel = GetMilliseconds(start);
+      std::cout<<"  ResizeNearestNeighbour 1000x1000 old scalar="<<fScalar<<"ms kernel="<<fKernel<<"ms"<<std::endl;
+    }
+
+    for (auto filter : { voodoo::RESIZE_FILTER::BOX, voodoo::RESIZE_FILTER::BILINEAR, voodoo::RESIZE_FILTER::LANCZOS3 }) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      voodoo::kernels::Resize(original.data(), width, height, nChannels, destination.data(), 1000, 1000, filter);
+      const double fKernel = GetMilliseconds(start);
+      std::cout<<"  Resize 1000x1000 filter="<<int(filter)<<" kernel="<<fKernel<<"ms"<<std::endl;
+    }
+  }
+}
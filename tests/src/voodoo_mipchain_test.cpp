@@ -0,0 +1,256 @@
+// Standard headers
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+
+// libvoodoomm headers
+#include <libvoodoomm/cMipChain.h>
+#include <libvoodoomm/kernels.h>
+
+namespace {
+
+std::vector<uint8_t> CreateNoise(size_t nBytes)
+{
+  std::vector<uint8_t> buffer(nBytes);
+  uint32_t seed = 1234;
+  for (auto& value : buffer) {
+    seed = (seed * 1103515245) + 12345;
+    value = uint8_t(seed >> 16);
+  }
+  return buffer;
+}
+
+template <class T>
+std::vector<uint8_t> ToBytes(const std::vector<T>& values)
+{
+  std::vector<uint8_t> buffer(values.size() * sizeof(T));
+  std::memcpy(buffer.data(), values.data(), buffer.size());
+  return buffer;
+}
+
+template <class T>
+T GetValue(const voodoo::cMipChain& mipChain, size_t level, size_t index)
+{
+  T value;
+  std::memcpy(&value, mipChain.GetPointerToLevel(level) + (index * sizeof(T)), sizeof(T));
+  return value;
+}
+
+}
+
+TEST(Voodoo, TestMipChainLevels)
+{
+  EXPECT_EQ(1, voodoo::cMipChain::GetLevelCountForSize(1, 1));
+  EXPECT_EQ(9, voodoo::cMipChain::GetLevelCountForSize(256, 64));
+  EXPECT_EQ(3, voodoo::cMipChain::GetLevelCountForSize(5, 3));
+
+  const std::vector<uint8_t> buffer = CreateNoise(256 * 64 * 4);
+
+  voodoo::cMipChain mipChain;
+  ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 256, 64, voodoo::PIXELFORMAT::R8G8B8A8, voodoo::COLOUR_SPACE::SRGB));
+  ASSERT_EQ(9, mipChain.GetLevelCount());
+
+  size_t nTotalBytes = 0;
+  for (size_t i = 0; i < mipChain.GetLevelCount(); i++) {
+    EXPECT_EQ(std::max<size_t>(1, 256 >> i), mipChain.GetWidth(i));
+    EXPECT_EQ(std::max<size_t>(1, 64 >> i), mipChain.GetHeight(i));
+    EXPECT_EQ(mipChain.GetWidth(i) * mipChain.GetHeight(i) * 4, mipChain.GetLevelSizeBytes(i));
+    EXPECT_EQ(mipChain.GetPointerToBuffer() + nTotalBytes, mipChain.GetPointerToLevel(i));
+    nTotalBytes += mipChain.GetLevelSizeBytes(i);
+  }
+  EXPECT_EQ(nTotalBytes, mipChain.GetBufferSizeBytes());
+
+  // The first level is an exact copy
+  EXPECT_EQ(0, memcmp(buffer.data(), mipChain.GetPointerToLevel(0), buffer.size()));
+
+  // Unsupported formats and empty images
+  EXPECT_FALSE(mipChain.CreateFromBuffer(buffer.data(), 16, 16, voodoo::PIXELFORMAT::R5G6B5, voodoo::COLOUR_SPACE::LINEAR));
+  EXPECT_FALSE(mipChain.IsValid());
+  EXPECT_FALSE(mipChain.CreateFromBuffer(buffer.data(), 0, 16, voodoo::PIXELFORMAT::H8, voodoo::COLOUR_SPACE::LINEAR));
+}
+
+TEST(Voodoo, TestMipChainLinearBox)
+{
+  const struct {
+    voodoo::PIXELFORMAT pixelFormat;
+    size_t nChannels;
+  } formats[] = {
+    { voodoo::PIXELFORMAT::H8, 1 },
+    { voodoo::PIXELFORMAT::R8G8B8, 3 },
+    { voodoo::PIXELFORMAT::R8G8B8A8, 4 },
+  };
+
+  for (auto&& format : formats) {
+    const size_t width = 128;
+    const size_t height = 32;
+    const std::vector<uint8_t> buffer = CreateNoise(width * height * format.nChannels);
+
+    voodoo::cMipChain mipChain;
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), width, height, format.pixelFormat, voodoo::COLOUR_SPACE::LINEAR));
+
+    // The first level down is the same as cImage::CreateFromImageHalfSize
+    std::vector<uint8_t> halfSize(mipChain.GetLevelSizeBytes(1));
+    voodoo::kernels::HalfSize(buffer.data(), width, height, format.nChannels, halfSize.data());
+    ASSERT_EQ(0, memcmp(halfSize.data(), mipChain.GetPointerToLevel(1), halfSize.size())) << "channels " << format.nChannels;
+
+    // The levels are not rounded between steps, so each pixel is the rounded average of the whole block of pixels it covers
+    for (size_t i = 2; i < mipChain.GetLevelCount(); i++) {
+      const size_t nBlockWidth = width / mipChain.GetWidth(i);
+      const size_t nBlockHeight = height / mipChain.GetHeight(i);
+      for (size_t y = 0; y < mipChain.GetHeight(i); y++) {
+        for (size_t x = 0; x < mipChain.GetWidth(i); x++) {
+          for (size_t c = 0; c < format.nChannels; c++) {
+            size_t nTotal = 0;
+            for (size_t by = 0; by < nBlockHeight; by++) {
+              for (size_t bx = 0; bx < nBlockWidth; bx++) nTotal += buffer[((((y * nBlockHeight) + by) * width) + (x * nBlockWidth) + bx) * format.nChannels + c];
+            }
+            const size_t nBlockSize = nBlockWidth * nBlockHeight;
+            const uint8_t expected = uint8_t(((2 * nTotal) + nBlockSize) / (2 * nBlockSize));
+            ASSERT_EQ(expected, mipChain.GetPointerToLevel(i)[(((y * mipChain.GetWidth(i)) + x) * format.nChannels) + c]) << "level " << i << " channels " << format.nChannels;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Voodoo, TestMipChainSRGB)
+{
+  // Every sRGB value survives the trip to linear and back
+  for (size_t i = 0; i < 256; i++) {
+    const uint8_t value = uint8_t(i);
+    const std::vector<uint8_t> buffer(2 * 2 * 3, value);
+    voodoo::cMipChain mipChain;
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2, 2, voodoo::PIXELFORMAT::R8G8B8, voodoo::COLOUR_SPACE::SRGB));
+    ASSERT_EQ(value, mipChain.GetPointerToLevel(1)[0]);
+  }
+
+  // Black and white average to half the light, not half the sRGB value, alpha is still averaged linearly
+  const std::vector<uint8_t> buffer = {
+    0, 0, 0, 0, 255, 255, 255, 255,
+    255, 255, 255, 255, 0, 0, 0, 0,
+  };
+
+  voodoo::cMipChain mipChain;
+  ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2, 2, voodoo::PIXELFORMAT::R8G8B8A8, voodoo::COLOUR_SPACE::SRGB));
+  const uint8_t* pLevel = mipChain.GetPointerToLevel(1);
+  EXPECT_NEAR(188, pLevel[0], 1);
+  EXPECT_NEAR(188, pLevel[1], 1);
+  EXPECT_NEAR(188, pLevel[2], 1);
+  EXPECT_EQ(128, pLevel[3]);
+
+  ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2, 2, voodoo::PIXELFORMAT::R8G8B8A8, voodoo::COLOUR_SPACE::LINEAR));
+  EXPECT_EQ(128, mipChain.GetPointerToLevel(1)[0]);
+}
+
+TEST(Voodoo, TestMipChainOddSizes)
+{
+  voodoo::cMipChain mipChain;
+
+  // Each destination pixel covers one and a half source pixels
+  {
+    const std::vector<uint8_t> buffer = { 0, 90, 180 };
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 3, 1, voodoo::PIXELFORMAT::H8, voodoo::COLOUR_SPACE::LINEAR));
+    ASSERT_EQ(2, mipChain.GetLevelCount());
+    ASSERT_EQ(1, mipChain.GetWidth(1));
+    EXPECT_EQ(90, mipChain.GetPointerToLevel(1)[0]);
+  }
+  {
+    const std::vector<uint8_t> buffer = { 0, 50, 100, 150, 200 };
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 5, 1, voodoo::PIXELFORMAT::H8, voodoo::COLOUR_SPACE::LINEAR));
+    ASSERT_EQ(2, mipChain.GetWidth(1));
+    EXPECT_EQ(40, mipChain.GetPointerToLevel(1)[0]); // (2 * 0 + 2 * 50 + 1 * 100) / 5
+    EXPECT_EQ(160, mipChain.GetPointerToLevel(1)[1]); // (1 * 100 + 2 * 150 + 2 * 200) / 5
+    EXPECT_EQ(100, mipChain.GetPointerToLevel(2)[0]);
+  }
+
+  // A flat colour stays flat at every size
+  for (size_t width : { 1, 2, 3, 5, 7, 33 }) {
+    for (size_t height : { 1, 3, 4, 9 }) {
+      const std::vector<uint8_t> buffer(width * height * 3, 77);
+      ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), width, height, voodoo::PIXELFORMAT::R8G8B8, voodoo::COLOUR_SPACE::SRGB));
+      for (size_t i = 0; i < mipChain.GetLevelCount(); i++) {
+        const uint8_t* pLevel = mipChain.GetPointerToLevel(i);
+        for (size_t j = 0; j < mipChain.GetLevelSizeBytes(i); j++) ASSERT_EQ(77, pLevel[j]) << width << "x" << height << " level " << i;
+      }
+    }
+  }
+}
+
+TEST(Voodoo, TestMipChainFormats)
+{
+  voodoo::cMipChain mipChain;
+
+  {
+    const std::vector<uint8_t> buffer = ToBytes(std::vector<uint16_t>({ 0, 65535, 1000, 3001 }));
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2, 2, voodoo::PIXELFORMAT::H16, voodoo::COLOUR_SPACE::SRGB));
+    EXPECT_EQ(17384, GetValue<uint16_t>(mipChain, 1, 0));
+  }
+
+  {
+    const std::vector<uint8_t> buffer = ToBytes(std::vector<float>({ 1.0f, 2.0f, -3.0f, 3.0f, 4.0f, 100.0f }));
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2, 1, voodoo::PIXELFORMAT::RGB32F, voodoo::COLOUR_SPACE::LINEAR));
+    EXPECT_FLOAT_EQ(2.0f, GetValue<float>(mipChain, 1, 0));
+    EXPECT_FLOAT_EQ(3.0f, GetValue<float>(mipChain, 1, 1));
+    EXPECT_FLOAT_EQ(48.5f, GetValue<float>(mipChain, 1, 2));
+  }
+
+  {
+    // 1.0, 2.0, 0.5 and 65504
+    const std::vector<uint8_t> buffer = ToBytes(std::vector<uint16_t>({ 0x3C00, 0x3800, 0x7BFF, 0x4000, 0x3800, 0x7BFF }));
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2, 1, voodoo::PIXELFORMAT::RGB16F, voodoo::COLOUR_SPACE::LINEAR));
+    EXPECT_EQ(0x3E00, GetValue<uint16_t>(mipChain, 1, 0)); // 1.5
+    EXPECT_EQ(0x3800, GetValue<uint16_t>(mipChain, 1, 1));
+    EXPECT_EQ(0x7BFF, GetValue<uint16_t>(mipChain, 1, 2));
+  }
+
+  // Every half that is not a NaN survives the trip to float and back, including the denormals and infinities
+  std::vector<uint16_t> values;
+  for (size_t i = 0; i < 65536; i++) {
+    const uint16_t value = uint16_t(i);
+    if (((value & 0x7C00) == 0x7C00) && ((value & 0x3FF) != 0)) continue;
+    values.push_back(value);
+  }
+  const size_t width = values.size() / 3;
+
+  // Duplicate each pixel and each row so that each pixel in the next level is the average of 4 identical pixels
+  std::vector<uint16_t> doubled(2 * width * 2 * 3);
+  for (size_t x = 0; x < width; x++) {
+    for (size_t c = 0; c < 3; c++) {
+      const uint16_t value = values[(x * 3) + c];
+      doubled[(2 * x * 3) + c] = value;
+      doubled[(((2 * x) + 1) * 3) + c] = value;
+      doubled[(2 * width * 3) + (2 * x * 3) + c] = value;
+      doubled[(2 * width * 3) + ((2 * x) + 1) * 3 + c] = value;
+    }
+  }
+
+  const std::vector<uint8_t> buffer = ToBytes(doubled);
+  ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), 2 * width, 2, voodoo::PIXELFORMAT::RGB16F, voodoo::COLOUR_SPACE::LINEAR));
+  for (size_t i = 0; i < width * 3; i++) ASSERT_EQ(values[i], GetValue<uint16_t>(mipChain, 1, i)) << std::hex << values[i];
+}
+
+TEST(Voodoo, DISABLED_BenchmarkMipChain)
+{
+  const size_t width = 2048;
+  const size_t height = 2048;
+  const std::vector<uint8_t> buffer = CreateNoise(width * height * 4);
+
+  for (voodoo::COLOUR_SPACE colourSpace : { voodoo::COLOUR_SPACE::LINEAR, voodoo::COLOUR_SPACE::SRGB }) {
+    voodoo::cMipChain mipChain;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(mipChain.CreateFromBuffer(buffer.data(), width, height, voodoo::PIXELFORMAT::R8G8B8A8, colourSpace));
+    const double fDurationMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    EXPECT_EQ(12, mipChain.GetLevelCount());
+    std::cout<<"cMipChain 2048x2048 R8G8B8A8 "<<((colourSpace == voodoo::COLOUR_SPACE::SRGB) ? "sRGB" : "linear")<<" time="<<fDurationMS<<"ms"<<std::endl;
+  }
+}
@@ -0,0 +1,312 @@
+// Standard headers
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Spitfire headers
+#include <spitfire/spitfire.h>
+#include <spitfire/storage/document.h>
+#include <spitfire/storage/file.h>
+#include <spitfire/storage/filesystem.h>
+#include <spitfire/storage/xml.h>
+
+namespace {
+
+class cRecordingSAXListener : public spitfire::xml::cSAXListener
+{
+public:
+  std::vector<std::string> events;
+
+private:
+  virtual void OnStartElement(std::string_view sName) override { events.push_back("start " + std::string(sName)); }
+  virtual void OnAttribute(std::string_view sName, std::string_view sValue) override { events.push_back("attribute " + std::string(sName) + "=" + std::string(sValue)); }
+  virtual void OnText(std::string_view sText) override { events.push_back("text " + std::string(sText)); }
+  virtual void OnEndElement(std::string_view sName) override { events.push_back("end " + std::string(sName)); }
+};
+
+class cCountingSAXListener : public spitfire::xml::cSAXListener
+{
+public:
+  cCountingSAXListener() : nElements(0), nAttributes(0), nTextBytes(0) {}
+
+  size_t nElements;
+  size_t nAttributes;
+  size_t nTextBytes;
+
+private:
+  virtual void OnStartElement(std::string_view sName) override { nElements++; }
+  virtual void OnAttribute(std::string_view sName, std::string_view sValue) override { nAttributes++; }
+  virtual void OnText(std::string_view sText) override { nTextBytes += sText.length(); }
+};
+
+std::string CreateLargeDocument(size_t nEntities)
+{
+  std::string sData = "<?xml version=\"1.0\"?>\n<world name=\"benchmark\">\n";
+  for (size_t i = 0; i < nEntities; i++) {
+    const std::string sIndex = spitfire::string::ToString(i);
+    sData += "  <entity id=\"" + sIndex + "\" type=\"tree\" position=\"" + sIndex + ".5, 12.25, -3.75\" rotation=\"0, 0, 0, 1\">\n";
+    sData += "    <!-- Generated entity -->\n";
+    sData += "    <model>models/tree" + sIndex + ".obj</model>\n";
+    sData += "    <physics mass=\"10.5\" static=\"false\"/>\n";
+    sData += "  </entity>\n";
+  }
+  sData += "</world>\n";
+  return sData;
+}
+
+}
+
+TEST(SpitfireStorage, TestXMLPullParser)
+{
+  const std::string sData =
+    "\xEF\xBB\xBF<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE config>\n"
+    "<config version='2' enabled>\n"
+    "  <!-- A comment -->\n"
+    "  <item name=\"a\" value = \"1\"/>\n"
+    "  <text>  Hello\n  world  </text>\n"
+    "  <data><![CDATA[<raw> & data]]></data>\n"
+    "</config>\n";
+
+  spitfire::xml::cPullParser parser(sData);
+
+  EXPECT_EQ(spitfire::xml::EVENT::START_ELEMENT, parser.Next());
+  EXPECT_EQ("config", parser.GetName());
+  EXPECT_EQ(1, parser.GetDepth());
+  EXPECT_TRUE(parser.IsXMLDeclarationFound());
+
+  EXPECT_EQ(spitfire::xml::EVENT::ATTRIBUTE, parser.Next());
+  EXPECT_EQ("version", parser.GetName());
+  EXPECT_EQ("2", parser.GetValue());
+  EXPECT_EQ(spitfire::xml::EVENT::ATTRIBUTE, parser.Next());
+  EXPECT_EQ("enabled", parser.GetName());
+  EXPECT_EQ("", parser.GetValue());
+
+  EXPECT_EQ(spitfire::xml::EVENT::START_ELEMENT, parser.Next());
+  EXPECT_EQ("item", parser.GetName());
+  EXPECT_EQ(spitfire::xml::EVENT::ATTRIBUTE, parser.Next());
+  EXPECT_EQ("name", parser.GetName());
+  EXPECT_EQ("a", parser.GetValue());
+  EXPECT_EQ(spitfire::xml::EVENT::ATTRIBUTE, parser.Next());
+  EXPECT_EQ("value", parser.GetName());
+  EXPECT_EQ("1", parser.GetValue());
+  EXPECT_EQ(spitfire::xml::EVENT::END_ELEMENT, parser.Next());
+  EXPECT_EQ("item", parser.GetName());
+
+  EXPECT_EQ(spitfire::xml::EVENT::START_ELEMENT, parser.Next());
+  EXPECT_EQ("text", parser.GetName());
+  EXPECT_EQ(spitfire::xml::EVENT::TEXT, parser.Next());
+  EXPECT_EQ("Hello\n  world", parser.GetValue());
+  EXPECT_EQ(spitfire::xml::EVENT::END_ELEMENT, parser.Next());
+  EXPECT_EQ("text", parser.GetName());
+
+  EXPECT_EQ(spitfire::xml::EVENT::START_ELEMENT, parser.Next());
+  EXPECT_EQ(spitfire::xml::EVENT::TEXT, parser.Next());
+  EXPECT_EQ("<raw> & data", parser.GetValue());
+  EXPECT_EQ(spitfire::xml::EVENT::END_ELEMENT, parser.Next());
+
+  EXPECT_EQ(spitfire::xml::EVENT::END_ELEMENT, parser.Next());
+  EXPECT_EQ("config", parser.GetName());
+  EXPECT_EQ(0, parser.GetDepth());
+
+  EXPECT_EQ(spitfire::xml::EVENT::END_OF_DOCUMENT, parser.Next());
+  EXPECT_EQ(spitfire::xml::EVENT::END_OF_DOCUMENT, parser.Next());
+
+  // The views point straight into the original buffer
+  spitfire::xml::cPullParser parserViews(sData);
+  parserViews.Next();
+  EXPECT_GE(parserViews.GetName().data(), sData.data());
+  EXPECT_LT(parserViews.GetName().data(), sData.data() + sData.length());
+}
+
+TEST(SpitfireStorage, TestXMLPullParserErrors)
+{
+  const char* szInvalid[] = {
+    "<a><b></a>",
+    "<a>",
+    "<a attribute=\"unterminated></a>",
+    "</a>",
+    "<a><!-- unterminated </a>",
+    "< >",
+  };
+
+  for (const char* szData : szInvalid) {
+    spitfire::xml::cPullParser parser(szData);
+    spitfire::xml::EVENT event = parser.Next();
+    while ((event != spitfire::xml::EVENT::END_OF_DOCUMENT) && (event != spitfire::xml::EVENT::ERROR)) event = parser.Next();
+
+    EXPECT_EQ(spitfire::xml::EVENT::ERROR, event) << szData;
+    EXPECT_FALSE(parser.GetError().empty());
+    EXPECT_EQ(spitfire::xml::EVENT::ERROR, parser.Next());
+  }
+}
+
+TEST(SpitfireStorage, TestXMLSAX)
+{
+  spitfire::util::cProcessInterface interface;
+
+  cRecordingSAXListener listener;
+  EXPECT_EQ(spitfire::util::PROCESS_RESULT::COMPLETE, spitfire::xml::ParseSAX(interface, "<a x=\"1\"><b>text</b><c/></a>", listener));
+
+  const std::vector<std::string> expected = {
+    "start a", "attribute x=1",
+    "start b", "text text", "end b",
+    "start c", "end c",
+    "end a",
+  };
+  EXPECT_EQ(expected, listener.events);
+
+  cRecordingSAXListener listenerFailed;
+  EXPECT_EQ(spitfire::util::PROCESS_RESULT::FAILED, spitfire::xml::ParseSAX(interface, "<a><b></a>", listenerFailed));
+}
+
+TEST(SpitfireStorage, TestXMLDocument)
+{
+  const std::string sData =
+    "<?xml version=\"1.0\"?>\n"
+    "<config>\n"
+    "  <!-- Comments are skipped -->\n"
+    "  <section name=\"graphics\">\n"
+    "    <item name=\"width\" value=\"1920\"/>\n"
+    "    <item name=\"title\" value=\"Say \\\"hello\\\"\"/>\n"
+    "  </section>\n"
+    "  <motd>Welcome</motd>\n"
+    "</config>\n";
+
+  spitfire::util::cProcessInterface interface;
+  spitfire::document::cDocument document;
+  spitfire::xml::reader reader;
+  ASSERT_EQ(spitfire::util::PROCESS_RESULT::COMPLETE, reader.ReadFromString(interface, document, sData));
+
+  spitfire::document::cNode::const_iterator iterConfig(document);
+  iterConfig.FindChild("config");
+  ASSERT_TRUE(iterConfig.IsValid());
+
+  spitfire::document::cNode::const_iterator iterSection = iterConfig.GetChild("section");
+  ASSERT_TRUE(iterSection.IsValid());
+  std::string sName;
+  EXPECT_TRUE(iterSection.GetAttribute("name", sName));
+  EXPECT_EQ("graphics", sName);
+
+  spitfire::document::cNode::const_iterator iterItem = iterSection.GetChild("item");
+  ASSERT_TRUE(iterItem.IsValid());
+  uint32_t uiWidth = 0;
+  EXPECT_TRUE(iterItem.GetAttribute("value", uiWidth));
+  EXPECT_EQ(1920, uiWidth);
+
+  iterItem.Next("item");
+  ASSERT_TRUE(iterItem.IsValid());
+  std::string sTitle;
+  EXPECT_TRUE(iterItem.GetAttribute("value", sTitle));
+  EXPECT_EQ("Say \"hello\"", sTitle);
+
+  iterItem.Next("item");
+  EXPECT_FALSE(iterItem.IsValid());
+
+  EXPECT_EQ("Welcome", iterConfig.GetChild("motd").GetChildContent());
+
+  // Invalid documents fail
+  spitfire::document::cDocument documentInvalid;
+  EXPECT_EQ(spitfire::util::PROCESS_RESULT::FAILED, reader.ReadFromString(interface, documentInvalid, "<config><section></config>"));
+}
+
+TEST(SpitfireStorage, TestXMLDocumentSaveAndLoad)
+{
+  const spitfire::string_t sFilePath = TEXT("xml_test_document.xml");
+
+  {
+    spitfire::document::cDocument document;
+    spitfire::document::element* pConfig = document.CreateElement("config");
+    document.AppendChild(pConfig);
+
+    spitfire::document::element* pItem = document.CreateElement("item");
+    pItem->SetAttribute("name", "volume");
+    pItem->SetAttribute("value", uint32_t(11));
+    pConfig->AppendChild(pItem);
+
+    spitfire::document::element* pText = document.CreateElement("text");
+    pText->AppendChild(document.CreateTextNode("Some text"));
+    pConfig->AppendChild(pText);
+
+    spitfire::xml::writer writer;
+    ASSERT_TRUE(writer.WriteToFile(document, sFilePath));
+  }
+
+  spitfire::util::cProcessInterface interface;
+  spitfire::document::cDocument document;
+  spitfire::xml::reader reader;
+  ASSERT_EQ(spitfire::util::PROCESS_RESULT::COMPLETE, reader.ReadFromFile(interface, document, sFilePath));
+
+  spitfire::document::cNode::const_iterator iterConfig(document);
+  iterConfig.FindChild("config");
+  ASSERT_TRUE(iterConfig.IsValid());
+
+  uint32_t uiVolume = 0;
+  EXPECT_TRUE(iterConfig.GetChild("item").GetAttribute("value", uiVolume));
+  EXPECT_EQ(11, uiVolume);
+  EXPECT_EQ("Some text", iterConfig.GetChild("text").GetChildContent());
+
+  // The same file through the SAX interface
+  cRecordingSAXListener listener;
+  EXPECT_EQ(spitfire::util::PROCESS_RESULT::COMPLETE, reader.ParseFile(interface, listener, sFilePath));
+  ASSERT_FALSE(listener.events.empty());
+  EXPECT_EQ("start config", listener.events.front());
+  EXPECT_EQ("end config", listener.events.back());
+
+  spitfire::filesystem::DeleteFile(sFilePath);
+
+  // Missing files fail
+  spitfire::document::cDocument documentMissing;
+  EXPECT_EQ(spitfire::util::PROCESS_RESULT::FAILED, reader.ReadFromFile(interface, documentMissing, sFilePath));
+}
+
+TEST(SpitfireStorage, DISABLED_BenchmarkXMLLoad)
+{
+  const spitfire::string_t sFilePath = TEXT("xml_benchmark_document.xml");
+
+  const size_t nEntities = 50000;
+  const std::string sData = CreateLargeDocument(nEntities);
+  spitfire::storage::WriteTextContents(sFilePath, sData);
+
+  const double fSizeMB = double(sData.length()) / (1024.0 * 1024.0);
+
+  spitfire::util::cProcessInterface interface;
+  spitfire::xml::reader reader;
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    cCountingSAXListener listener;
+    EXPECT_EQ(spitfire::util::PROCESS_RESULT::COMPLETE, reader.ParseFile(interface, listener, sFilePath));
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    EXPECT_EQ(1 + (3 * nEntities), listener.nElements);
+    EXPECT_EQ(1 + (6 * nEntities), listener.nAttributes);
+
+    std::cout<<"XML SAX size="<<fSizeMB<<"MB time="<<(fDurationSeconds * 1000.0)<<"ms throughput="<<(fSizeMB / fDurationSeconds)<<"MB/s"<<std::endl;
+  }
+
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    spitfire::document::cDocument document;
+    EXPECT_EQ(spitfire::util::PROCESS_RESULT::COMPLETE, reader.ReadFromFile(interface, document, sFilePath));
+    const double fDurationSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    spitfire::document::cNode::const_iterator iter(document);
+    iter.FindChild("world");
+    ASSERT_TRUE(iter.IsValid());
+    iter.FirstChild();
+    size_t nFound = 0;
+    while (iter.IsValid()) {
+      nFound++;
+      iter.Next("entity");
+    }
+    EXPECT_EQ(nEntities, nFound);
+
+    std::cout<<"XML DOM size="<<fSizeMB<<"MB time="<<(fDurationSeconds * 1000.0)<<"ms throughput="<<(fSizeMB / fDurationSeconds)<<"MB/s"<<std::endl;
+  }
+
+  spitfire::filesystem::DeleteFile(sFilePath);
+}
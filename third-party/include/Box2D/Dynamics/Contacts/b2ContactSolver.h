@@ -16,6 +16,8 @@
 * 3. This notice may not be removed or altered from any source distribution.
 */
 
+// Altered from the original to solve islands on several threads, see b2World::Solve.
+
 #ifndef B2_CONTACT_SOLVER_H
 #define B2_CONTACT_SOLVER_H
 
@@ -26,6 +28,7 @@
 class b2Contact;
 class b2Body;
 class b2StackAllocator;
+class b2Island;
 struct b2ContactPositionConstraint;
 
 struct b2VelocityConstraintPoint
@@ -63,6 +66,7 @@ struct b2ContactSolverDef
 	b2Position* positions;
 	b2Velocity* velocities;
 	b2StackAllocator* allocator;
+	const b2Island* island;
 };
 
 class b2ContactSolver
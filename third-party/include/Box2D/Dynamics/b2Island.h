@@ -16,6 +16,8 @@
 * 3. This notice may not be removed or altered from any source distribution.
 */
 
+// Altered from the original to solve islands on several threads, see b2World::Solve.
+
 #ifndef B2_ISLAND_H
 #define B2_ISLAND_H
 
@@ -27,15 +29,33 @@ class b2Contact;
 class b2Joint;
 class b2StackAllocator;
 class b2ContactListener;
+struct b2ContactImpulse;
 struct b2ContactVelocityConstraint;
 struct b2Profile;
 
+/// The index of a static body in one island. A static body can be in several islands when
+/// they are solved in parallel, so its index is looked up per island instead of being stored
+/// in the body. These are sorted by body.
+struct b2IslandStaticBody
+{
+	b2Body* body;
+	int32 index;
+};
+
 /// This is an internal class.
 class b2Island
 {
 public:
 	b2Island(int32 bodyCapacity, int32 contactCapacity, int32 jointCapacity,
 			b2StackAllocator* allocator, b2ContactListener* listener);
+
+	/// An island over bodies, contacts and joints that have already been collected by b2World::Solve.
+	/// The island index of each non-static body must already be set. The contact impulses are
+	/// written to impulses instead of being reported to a listener, impulses may be NULL.
+	b2Island(b2Body** bodies, int32 bodyCount, b2Contact** contacts, int32 contactCount,
+			b2Joint** joints, int32 jointCount, const b2IslandStaticBody* staticBodies, int32 staticBodyCount,
+			b2StackAllocator* allocator, b2ContactImpulse* impulses);
+
 	~b2Island();
 
 	void Clear()
@@ -69,10 +89,29 @@ public:
 		m_joints[m_jointCount++] = joint;
 	}
 
+	/// Get the index of a body in the positions and velocities of this island.
+	int32 GetIndex(const b2Body* body) const
+	{
+		if (m_staticBodyCount == 0 || body->m_type != b2_staticBody)
+		{
+			return body->m_islandIndex;
+		}
+
+		return GetStaticIndex(body);
+	}
+
+	int32 GetStaticIndex(const b2Body* body) const;
+
 	void Report(const b2ContactVelocityConstraint* constraints);
 
 	b2StackAllocator* m_allocator;
 	b2ContactListener* m_listener;
+	b2ContactImpulse* m_impulses;
+
+	const b2IslandStaticBody* m_staticBodies;
+	int32 m_staticBodyCount;
+	bool m_ownsLists;
+	bool m_isSleeping;
 
 	b2Body** m_bodies;
 	b2Contact** m_contacts;
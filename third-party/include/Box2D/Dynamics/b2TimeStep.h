@@ -16,11 +16,15 @@
 * 3. This notice may not be removed or altered from any source distribution.
 */
 
+// Altered from the original to solve islands on several threads, see b2World::Solve.
+
 #ifndef B2_TIME_STEP_H
 #define B2_TIME_STEP_H
 
 #include <Box2D/Common/b2Math.h>
 
+class b2Island;
+
 /// Profiling data. Times are in milliseconds.
 struct b2Profile
 {
@@ -65,6 +69,7 @@ struct b2SolverData
 	b2TimeStep step;
 	b2Position* positions;
 	b2Velocity* velocities;
+	const b2Island* island;		// use island->GetIndex to find a body in positions and velocities
 };
 
 #endif
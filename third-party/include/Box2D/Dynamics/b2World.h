@@ -16,6 +16,8 @@
 * 3. This notice may not be removed or altered from any source distribution.
 */
 
+// Altered from the original to solve islands on several threads, see b2World::Solve.
+
 #ifndef B2_WORLD_H
 #define B2_WORLD_H
 
@@ -61,6 +63,12 @@ public:
 	/// remain in scope.
 	void SetContactListener(b2ContactListener* listener);
 
+	/// Register a task executor to solve islands on several threads. Pass NULL
+	/// to solve them on the calling thread. The contact listener is still called
+	/// on the calling thread, PostSolve is called for every island after they
+	/// have all been solved. The executor is owned by you and must remain in scope.
+	void SetTaskExecutor(b2TaskExecutor* executor);
+
 	/// Register a routine for debug drawing. The debug draw functions are called
 	/// inside with b2World::DrawDebugData method. The debug draw object is owned
 	/// by you and must remain in scope.
@@ -244,6 +252,11 @@ private:
 	b2DestructionListener* m_destructionListener;
 	b2Draw* m_debugDraw;
 
+	// Each thread other than the calling thread has its own stack allocator for solving islands.
+	b2TaskExecutor* m_taskExecutor;
+	b2StackAllocator** m_threadAllocators;
+	int32 m_threadAllocatorCount;
+
 	// This is used to compute the time step ratio to
 	// support a variable time step.
 	float32 m_inv_dt0;
@@ -16,6 +16,8 @@
 * 3. This notice may not be removed or altered from any source distribution.
 */
 
+// Altered from the original to solve islands on several threads, see b2World::Solve.
+
 #ifndef B2_WORLD_CALLBACKS_H
 #define B2_WORLD_CALLBACKS_H
 
@@ -152,4 +154,32 @@ public:
 									const b2Vec2& normal, float32 fraction) = 0;
 };
 
+/// A piece of work that is run on several threads at the same time.
+/// See b2TaskExecutor
+class b2Task
+{
+public:
+	virtual ~b2Task() {}
+
+	/// Called once for each thread.
+	/// @param threadIndex the index of the calling thread, in [0, b2TaskExecutor::GetThreadCount())
+	virtual void Execute(int32 threadIndex) = 0;
+};
+
+/// Implement this class to let the world solve islands on several threads.
+/// The executor is owned by you and must remain in scope.
+/// See b2World::SetTaskExecutor
+class b2TaskExecutor
+{
+public:
+	virtual ~b2TaskExecutor() {}
+
+	/// The number of threads that a task is run on, including the calling thread.
+	virtual int32 GetThreadCount() const = 0;
+
+	/// Call task->Execute once for each thread index, concurrently, and return
+	/// when every call has returned.
+	virtual void Run(b2Task* task) = 0;
+};
+
 #endif